@@ -28,12 +28,12 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 
 ////////// BasicTaskScheduler //////////
 
-BasicTaskScheduler* BasicTaskScheduler::createNew(unsigned maxSchedulerGranularity) {
-    return new BasicTaskScheduler(maxSchedulerGranularity);
+BasicTaskScheduler* BasicTaskScheduler::createNew(unsigned maxSchedulerGranularity, DelayQueueType delayQueueType) {
+    return new BasicTaskScheduler(maxSchedulerGranularity, delayQueueType);
 }
 
-BasicTaskScheduler::BasicTaskScheduler(unsigned maxSchedulerGranularity)
-  : fMaxSchedulerGranularity(maxSchedulerGranularity), fMaxNumSockets(0)
+BasicTaskScheduler::BasicTaskScheduler(unsigned maxSchedulerGranularity, DelayQueueType delayQueueType)
+  : BasicTaskScheduler0(delayQueueType), fMaxSchedulerGranularity(maxSchedulerGranularity), fMaxNumSockets(0)
 #if defined(__WIN32__) || defined(_WIN32)
   , fDummySocketNum(-1)
 #endif
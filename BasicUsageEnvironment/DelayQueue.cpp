@@ -20,6 +20,10 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 
 #include "DelayQueue.hh"
 #include "GroupsockHelper.hh"
+#include "HashTable.hh"
+#if !defined(__WIN32__) && !defined(_WIN32)
+#include <time.h>
+#endif
 
 static const int MILLION = 1000000;
 
@@ -95,7 +99,7 @@ const DelayInterval ETERNITY(INT_MAX, MILLION-1);
 intptr_t DelayQueueEntry::tokenCounter = 0;
 
 DelayQueueEntry::DelayQueueEntry(DelayInterval delay)
-  : fDeltaTimeRemaining(delay) {
+  : fDeltaTimeRemaining(delay), fSequence(0), fHeapIndex(-1) {
   fNext = fPrev = this;
   fToken = ++tokenCounter;
 }
@@ -110,9 +114,32 @@ void DelayQueueEntry::handleTimeout() {
 
 ///// DelayQueue /////
 
-DelayQueue::DelayQueue()
-  : DelayQueueEntry(ETERNITY) {
+// A "DELAY_QUEUE_HEAP" queue uses a monotonic clock (where available), so that its absolute fire
+// times are unaffected by changes to the system clock:
+static _EventTime monotonicTimeNow() {
+#if defined(CLOCK_MONOTONIC)
+  struct timespec tsNow;
+  if (clock_gettime(CLOCK_MONOTONIC, &tsNow) == 0) {
+    return _EventTime(tsNow.tv_sec, tsNow.tv_nsec/1000);
+  }
+#endif
+  return TimeNow();
+}
+
+#define HEAP_ARITY 4
+#define HEAP_INITIAL_CAPACITY 256
+
+DelayQueue::DelayQueue(DelayQueueType type)
+  : DelayQueueEntry(ETERNITY),
+    fType(type), fHeap(NULL), fHeapSize(0), fHeapCapacity(0), fNextSequence(0),
+    fTokenIndex(NULL), fTimeToNextAlarm(ETERNITY) {
   fLastSyncTime = TimeNow();
+
+  if (fType == DELAY_QUEUE_HEAP) {
+    fHeapCapacity = HEAP_INITIAL_CAPACITY;
+    fHeap = new DelayQueueEntry*[fHeapCapacity];
+    fTokenIndex = HashTable::create(ONE_WORD_HASH_KEYS);
+  }
 }
 
 DelayQueue::~DelayQueue() {
@@ -121,9 +148,22 @@ DelayQueue::~DelayQueue() {
     removeEntry(entryToRemove);
     delete entryToRemove;
   }
+
+  while (fHeapSize > 0) {
+    DelayQueueEntry* entryToRemove = fHeap[fHeapSize-1];
+    removeEntry(entryToRemove);
+    delete entryToRemove;
+  }
+  delete[] fHeap;
+  delete fTokenIndex;
 }
 
 void DelayQueue::addEntry(DelayQueueEntry* newEntry) {
+  if (fType == DELAY_QUEUE_HEAP) {
+    heapAddEntry(newEntry);
+    return;
+  }
+
   synchronize();
 
   DelayQueueEntry* cur = head();
@@ -154,6 +194,11 @@ void DelayQueue::updateEntry(intptr_t tokenToFind, DelayInterval newDelay) {
 }
 
 void DelayQueue::removeEntry(DelayQueueEntry* entry) {
+  if (fType == DELAY_QUEUE_HEAP) {
+    if (entry != NULL && entry->fHeapIndex >= 0) heapRemoveEntry(entry);
+    return;
+  }
+
   if (entry == NULL || entry->fNext == NULL) return;
 
   entry->fNext->fDeltaTimeRemaining += entry->fDeltaTimeRemaining;
@@ -170,6 +215,13 @@ DelayQueueEntry* DelayQueue::removeEntry(intptr_t tokenToFind) {
 }
 
 DelayInterval const& DelayQueue::timeToNextAlarm() {
+  if (fType == DELAY_QUEUE_HEAP) {
+    if (fHeapSize == 0) return ETERNITY;
+
+    fTimeToNextAlarm = fHeap[0]->fFireTime - monotonicTimeNow();
+    return fTimeToNextAlarm;
+  }
+
   if (head()->fDeltaTimeRemaining == DELAY_ZERO) return DELAY_ZERO; // a common case
 
   synchronize();
@@ -177,6 +229,17 @@ DelayInterval const& DelayQueue::timeToNextAlarm() {
 }
 
 void DelayQueue::handleAlarm() {
+  if (fType == DELAY_QUEUE_HEAP) {
+    if (fHeapSize > 0 && fHeap[0]->fFireTime <= monotonicTimeNow()) {
+      // This event is due to be handled:
+      DelayQueueEntry* toRemove = fHeap[0];
+      removeEntry(toRemove); // do this first, in case handler accesses queue
+
+      toRemove->handleTimeout();
+    }
+    return;
+  }
+
   if (head()->fDeltaTimeRemaining != DELAY_ZERO) synchronize();
 
   if (head()->fDeltaTimeRemaining == DELAY_ZERO) {
@@ -189,6 +252,10 @@ void DelayQueue::handleAlarm() {
 }
 
 DelayQueueEntry* DelayQueue::findEntryByToken(intptr_t tokenToFind) {
+  if (fType == DELAY_QUEUE_HEAP) {
+    return (DelayQueueEntry*)fTokenIndex->Lookup((char const*)tokenToFind);
+  }
+
   DelayQueueEntry* cur = head();
   while (cur != this) {
     if (cur->token() == tokenToFind) return cur;
@@ -220,6 +287,85 @@ void DelayQueue::synchronize() {
 }
 
 
+void DelayQueue::heapAddEntry(DelayQueueEntry* newEntry) {
+  if (fHeapSize == fHeapCapacity) {
+    DelayQueueEntry** newHeap = new DelayQueueEntry*[2*fHeapCapacity];
+    memmove(newHeap, fHeap, fHeapSize*sizeof (DelayQueueEntry*));
+    delete[] fHeap;
+    fHeap = newHeap;
+    fHeapCapacity *= 2;
+  }
+
+  newEntry->fFireTime = monotonicTimeNow();
+  newEntry->fFireTime += newEntry->fDeltaTimeRemaining;
+  newEntry->fSequence = fNextSequence++;
+  fTokenIndex->Add((char const*)newEntry->token(), newEntry);
+
+  heapPlace(newEntry, fHeapSize++);
+  siftUp(newEntry->fHeapIndex);
+}
+
+void DelayQueue::heapRemoveEntry(DelayQueueEntry* entry) {
+  unsigned index = (unsigned)entry->fHeapIndex;
+  fTokenIndex->Remove((char const*)entry->token());
+  entry->fHeapIndex = -1; // in case we should try to remove it again
+
+  // Fill the hole with the last entry, then restore the heap property around it:
+  DelayQueueEntry* last = fHeap[--fHeapSize];
+  if (index == fHeapSize) return;
+
+  heapPlace(last, index);
+  if (index > 0 && heapBefore(last, fHeap[(index-1)/HEAP_ARITY])) {
+    siftUp(index);
+  } else {
+    siftDown(index);
+  }
+}
+
+int DelayQueue::heapBefore(DelayQueueEntry const* a, DelayQueueEntry const* b) const {
+  if (a->fFireTime != b->fFireTime) return a->fFireTime < b->fFireTime;
+  return a->fSequence < b->fSequence;
+}
+
+void DelayQueue::heapPlace(DelayQueueEntry* entry, unsigned index) {
+  fHeap[index] = entry;
+  entry->fHeapIndex = (int)index;
+}
+
+void DelayQueue::siftUp(unsigned index) {
+  DelayQueueEntry* entry = fHeap[index];
+  while (index > 0) {
+    unsigned parent = (index-1)/HEAP_ARITY;
+    if (!heapBefore(entry, fHeap[parent])) break;
+
+    heapPlace(fHeap[parent], index);
+    index = parent;
+  }
+  heapPlace(entry, index);
+}
+
+void DelayQueue::siftDown(unsigned index) {
+  DelayQueueEntry* entry = fHeap[index];
+  while (1) {
+    unsigned firstChild = HEAP_ARITY*index + 1;
+    if (firstChild >= fHeapSize) break;
+
+    unsigned lastChild = firstChild + HEAP_ARITY;
+    if (lastChild > fHeapSize) lastChild = fHeapSize;
+
+    unsigned best = firstChild;
+    for (unsigned child = firstChild + 1; child < lastChild; ++child) {
+      if (heapBefore(fHeap[child], fHeap[best])) best = child;
+    }
+    if (!heapBefore(fHeap[best], entry)) break;
+
+    heapPlace(fHeap[best], index);
+    index = best;
+  }
+  heapPlace(entry, index);
+}
+
+
 ///// _EventTime /////
 
 _EventTime TimeNow() {
@@ -23,17 +23,34 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #define EPOLL_INVALID NULL
 #else
 #include <sys/epoll.h>
+#include <unistd.h>
 #define EPOLL_INVALID -1
 #endif
 
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// The epoll "data" of each registered socket is its socket number plus the generation of its handler slot:
+#define EPOLL_DATA(socketNum, generation) ((((u_int64_t)(generation)) << 32) | (u_int32_t)(socketNum))
+#define EPOLL_DATA_SOCKET(data) ((int)(u_int32_t)((data)&0xFFFFFFFF))
+#define EPOLL_DATA_GENERATION(data) ((unsigned)((data) >> 32))
+
+#define INITIAL_HANDLER_TABLE_SIZE 1024
+
 ////////// EpollTaskScheduler //////////
 
-EpollTaskScheduler* EpollTaskScheduler::createNew(unsigned maxSchedulerGranularity) {
-  return new EpollTaskScheduler(maxSchedulerGranularity);
+EpollTaskScheduler* EpollTaskScheduler::createNew(unsigned maxSchedulerGranularity, unsigned maxEventsPerWait,
+						  DelayQueueType delayQueueType) {
+  return new EpollTaskScheduler(maxSchedulerGranularity, maxEventsPerWait, delayQueueType);
 }
 
-EpollTaskScheduler::EpollTaskScheduler(unsigned maxSchedulerGranularity)
-  : fMaxSchedulerGranularity(maxSchedulerGranularity), fEpollHandle(EPOLL_INVALID)
+EpollTaskScheduler::EpollTaskScheduler(unsigned maxSchedulerGranularity, unsigned maxEventsPerWait,
+				       DelayQueueType delayQueueType)
+  : BasicTaskScheduler0(delayQueueType), fMaxSchedulerGranularity(maxSchedulerGranularity),
+    fHandlerTable(NULL), fHandlerTableSize(0),
+    fEventArray(NULL), fMaxEventsPerWait(maxEventsPerWait == 0 ? 1 : maxEventsPerWait),
+    fEpollHandle(EPOLL_INVALID)
 {
 #if defined(__WIN32__) || defined(_WIN32)
   fEpollHandle = epoll_create();
@@ -45,6 +62,8 @@ EpollTaskScheduler::EpollTaskScheduler(unsigned maxSchedulerGranularity)
     internalError();
   }
 
+  fEventArray = new struct epoll_event[fMaxEventsPerWait];
+
   if (maxSchedulerGranularity > 0) schedulerTickTask(); // ensures that we handle events frequently
 }
 
@@ -53,7 +72,13 @@ EpollTaskScheduler::~EpollTaskScheduler() {
   if (fEpollHandle != EPOLL_INVALID) {
     epoll_close(fEpollHandle);
   }
+#else
+  if (fEpollHandle != EPOLL_INVALID) {
+    close(fEpollHandle);
+  }
 #endif
+  delete[] fEventArray;
+  free(fHandlerTable);
 }
 
 void EpollTaskScheduler::schedulerTickTask(void* clientData) {
@@ -89,26 +114,30 @@ void EpollTaskScheduler::SingleStep(unsigned maxDelayTime) {
   }
 
   const int timeout = tv_timeToDelay.tv_sec * 1000 + tv_timeToDelay.tv_usec / 1000;
-  epoll_event event;
-  int ret = epoll_wait(fEpollHandle, &event, 1, timeout);
+  int ret = epoll_wait(fEpollHandle, fEventArray, (int)fMaxEventsPerWait, timeout);
   if (ret < 0) {
     if (errno != EINTR) {
       internalError();
     }
   }
 
-  if (ret > 0) {
-    const HandlerDescriptor* handler =
-      static_cast<const HandlerDescriptor*>(event.data.ptr);
-    if (handler != NULL) {
-      int resultConditionSet = 0;
-      if (event.events & EPOLLIN)  resultConditionSet |= SOCKET_READABLE;
-      if (event.events & EPOLLOUT) resultConditionSet |= SOCKET_WRITABLE;
-      if (event.events & EPOLLERR) resultConditionSet |= SOCKET_EXCEPTION;
-
-      if ((resultConditionSet & handler->conditionSet) != 0) {
-        (*handler->handlerProc)(handler->clientData, resultConditionSet);
-      }
+  // Handle every socket that was reported ready.  A handler may clear (or reassign) the handling of
+  // another socket in this batch, so we look up each handler again, and skip events whose slot has changed:
+  for (int i = 0; i < ret; ++i) {
+    u_int64_t data = fEventArray[i].data.u64;
+    int socketNum = EPOLL_DATA_SOCKET(data);
+    EpollHandler* handler = lookupHandler(socketNum);
+    if (handler == NULL || handler->conditionSet == 0
+	|| handler->generation != EPOLL_DATA_GENERATION(data)) continue;
+
+    int resultConditionSet = 0;
+    unsigned events = fEventArray[i].events;
+    if (events & (EPOLLIN|EPOLLHUP)) resultConditionSet |= SOCKET_READABLE;
+    if (events & EPOLLOUT) resultConditionSet |= SOCKET_WRITABLE;
+    if (events & EPOLLERR) resultConditionSet |= SOCKET_EXCEPTION;
+
+    if ((resultConditionSet & handler->conditionSet) != 0) {
+      (*handler->handlerProc)(handler->clientData, resultConditionSet);
     }
   }
 
@@ -153,54 +182,107 @@ void EpollTaskScheduler
   ::setBackgroundHandling(int socketNum, int conditionSet, BackgroundHandlerProc* handlerProc, void* clientData) {
   if (socketNum < 0) return;
 
-  epoll_event ev;
-  memset(&ev, 0, sizeof(ev));
-
-  const HandlerDescriptor* handler = lookupHandlerDescriptor(socketNum);
-  if (handler != NULL) {
-      epoll_ctl(fEpollHandle, EPOLL_CTL_DEL, socketNum, &ev);
-  }  
-
+  EpollHandler* handler;
   if (conditionSet == 0) {
-    fHandlers->clearHandler(socketNum);
-  } else {
-    fHandlers->assignHandler(socketNum, conditionSet, handlerProc, clientData);
+    handler = lookupHandler(socketNum);
+    if (handler == NULL || handler->conditionSet == 0) return;
 
-    handler = lookupHandlerDescriptor(socketNum);
-    ev.data.ptr = const_cast<HandlerDescriptor*>(handler);
-
-    if (conditionSet&SOCKET_READABLE) ev.events |= EPOLLIN;
-    if (conditionSet&SOCKET_WRITABLE) ev.events |= EPOLLOUT;
+    handler->conditionSet = 0;
+    handler->handlerProc = NULL;
+    handler->clientData = NULL;
+    updateEpoll(socketNum, *handler);
+    return;
+  }
 
-    epoll_ctl(fEpollHandle, EPOLL_CTL_ADD, socketNum, &ev);
+  handler = handlerSlot(socketNum);
+  if (handler == NULL) {
+    internalError();
+    return;
   }
+  if (handler->conditionSet == 0) ++handler->generation; // a new use of this slot
+
+  handler->conditionSet = conditionSet;
+  handler->handlerProc = handlerProc;
+  handler->clientData = clientData;
+  updateEpoll(socketNum, *handler);
 }
 
 void EpollTaskScheduler::moveSocketHandling(int oldSocketNum, int newSocketNum) {
   if (oldSocketNum < 0 || newSocketNum < 0) return; // sanity check
 
-  const HandlerDescriptor* handler = lookupHandlerDescriptor(oldSocketNum);
-  if (handler == NULL) {
+  EpollHandler* oldHandler = lookupHandler(oldSocketNum);
+  if (oldHandler == NULL || oldHandler->conditionSet == 0) {
     return;
   }
 
-  epoll_event ev;
-  memset(&ev, 0, sizeof(ev));
+  int conditionSet = oldHandler->conditionSet;
+  BackgroundHandlerProc* handlerProc = oldHandler->handlerProc;
+  void* clientData = oldHandler->clientData;
+
+  setBackgroundHandling(oldSocketNum, 0, NULL, NULL);
+  setBackgroundHandling(newSocketNum, conditionSet, handlerProc, clientData);
+}
 
-  if (handler->conditionSet&SOCKET_READABLE) ev.events |= EPOLLIN;
-  if (handler->conditionSet&SOCKET_WRITABLE) ev.events |= EPOLLOUT;
+EpollTaskScheduler::EpollHandler* EpollTaskScheduler::lookupHandler(int socketNum) const {
+  if (socketNum < 0 || socketNum >= fHandlerTableSize) return NULL;
+  return &fHandlerTable[socketNum];
+}
+
+EpollTaskScheduler::EpollHandler* EpollTaskScheduler::handlerSlot(int socketNum) {
+  if (socketNum < 0) return NULL;
+
+  if (socketNum >= fHandlerTableSize) {
+    int newSize = fHandlerTableSize == 0 ? INITIAL_HANDLER_TABLE_SIZE : fHandlerTableSize;
+    while (newSize <= socketNum) newSize *= 2;
 
-  epoll_ctl(fEpollHandle, EPOLL_CTL_DEL, oldSocketNum, &ev);
-  epoll_ctl(fEpollHandle, EPOLL_CTL_ADD, newSocketNum, &ev);
+    EpollHandler* newTable = (EpollHandler*)realloc(fHandlerTable, newSize*sizeof (EpollHandler));
+    if (newTable == NULL) return NULL;
+    memset(&newTable[fHandlerTableSize], 0, (newSize - fHandlerTableSize)*sizeof (EpollHandler));
+
+    fHandlerTable = newTable;
+    fHandlerTableSize = newSize;
+  }
 
-  fHandlers->moveHandler(oldSocketNum, newSocketNum);
+  return &fHandlerTable[socketNum];
 }
 
-const HandlerDescriptor* EpollTaskScheduler::lookupHandlerDescriptor(int socketNum) const {
-  HandlerDescriptor* handler;
-  HandlerIterator iter(*fHandlers);
-  while ((handler = iter.next()) != NULL) {
-    if (handler->socketNum == socketNum) break;
+unsigned EpollTaskScheduler::epollEvents(EpollHandler const& handler) const {
+  unsigned events = 0;
+  if (handler.conditionSet&SOCKET_READABLE) events |= EPOLLIN;
+  if (handler.conditionSet&SOCKET_WRITABLE) events |= EPOLLOUT;
+  return events;
+}
+
+void EpollTaskScheduler::updateEpoll(int socketNum, EpollHandler& handler) {
+  // Re-arm a registered socket with EPOLL_CTL_MOD (rather than DEL+ADD).
+  // (We do this even if its events are unchanged, because the socket number may have been closed and reused since -
+  // which silently removes it from the epoll set - and a new socket with the same number would then never be armed.)
+  unsigned events = epollEvents(handler);
+
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.u64 = EPOLL_DATA(socketNum, handler.generation);
+
+  if (handler.events == 0) {
+    if (events == 0) return;
+    if (epoll_ctl(fEpollHandle, EPOLL_CTL_ADD, socketNum, &ev) == 0) {
+      handler.events = events;
+    } else if (errno == EEXIST && epoll_ctl(fEpollHandle, EPOLL_CTL_MOD, socketNum, &ev) == 0) {
+      // The socket was closed and its number reused without our handling being cleared
+      handler.events = events;
+    }
+  } else if (events == 0 || handler.conditionSet == 0) {
+    epoll_ctl(fEpollHandle, EPOLL_CTL_DEL, socketNum, &ev);
+    handler.events = 0;
+  } else {
+    if (epoll_ctl(fEpollHandle, EPOLL_CTL_MOD, socketNum, &ev) != 0 && errno == ENOENT) {
+      // The socket was closed (which removes it from the epoll set) and its number reused
+      if (epoll_ctl(fEpollHandle, EPOLL_CTL_ADD, socketNum, &ev) != 0) {
+	handler.events = 0;
+	return;
+      }
+    }
+    handler.events = events;
   }
-  return handler;
 }
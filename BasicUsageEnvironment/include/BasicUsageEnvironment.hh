@@ -46,15 +46,18 @@ protected:
 
 class BasicTaskScheduler: public BasicTaskScheduler0 {
 public:
-  static BasicTaskScheduler* createNew(unsigned maxSchedulerGranularity = 10000/*microseconds*/);
+  static BasicTaskScheduler* createNew(unsigned maxSchedulerGranularity = 10000/*microseconds*/,
+				       DelayQueueType delayQueueType = DELAY_QUEUE_LIST);
     // "maxSchedulerGranularity" (default value: 10 ms) specifies the maximum time that we wait (in "select()") before
     // returning to the event loop to handle non-socket or non-timer-based events, such as 'triggered events'.
     // You can change this is you wish (but only if you know what you're doing!), or set it to 0, to specify no such maximum time.
     // (You should set it to 0 only if you know that you will not be using 'event triggers'.)
+    // "delayQueueType" selects the implementation of the delayed task queue; use "DELAY_QUEUE_HEAP" if you
+    // expect many (e.g., thousands of) delayed tasks to be scheduled at once.
   virtual ~BasicTaskScheduler();
 
 protected:
-  BasicTaskScheduler(unsigned maxSchedulerGranularity);
+  BasicTaskScheduler(unsigned maxSchedulerGranularity, DelayQueueType delayQueueType = DELAY_QUEUE_LIST);
       // called only by "createNew()"
 
   static void schedulerTickTask(void* clientData);
@@ -93,7 +93,7 @@ public:
   virtual void triggerEvent(EventTriggerId eventTriggerId, void* clientData = NULL);
 
 protected:
-  BasicTaskScheduler0();
+  BasicTaskScheduler0(DelayQueueType delayQueueType = DELAY_QUEUE_LIST);
 
 protected:
   // To implement delayed operations:
@@ -151,15 +151,30 @@ private:
   DelayQueueEntry* fPrev;
   DelayInterval fDeltaTimeRemaining;
 
+  // Used only by a "DELAY_QUEUE_HEAP" queue:
+  _EventTime fFireTime;
+  unsigned long fSequence; // breaks ties between equal "fFireTime"s, in insertion order
+  int fHeapIndex; // -1 iff not in a heap
+
   intptr_t fToken;
   static intptr_t tokenCounter;
 };
 
 ///// DelayQueue /////
 
+// The original implementation keeps entries in a sorted list of 'delta' times, which makes
+// "addEntry()" and "removeEntry(token)" O(n).  A "DELAY_QUEUE_HEAP" queue instead keeps absolute
+// (monotonic) fire times in a 4-ary min-heap, with a token->entry hash index, making both O(log n).
+enum DelayQueueType {
+  DELAY_QUEUE_LIST,
+  DELAY_QUEUE_HEAP
+};
+
+class HashTable; // forward
+
 class DelayQueue: public DelayQueueEntry {
 public:
-  DelayQueue();
+  DelayQueue(DelayQueueType type = DELAY_QUEUE_LIST);
   virtual ~DelayQueue();
 
   void addEntry(DelayQueueEntry* newEntry); // returns a token for the entry
@@ -171,12 +186,29 @@ public:
   DelayInterval const& timeToNextAlarm();
   void handleAlarm();
 
+  DelayQueueType type() const { return fType; }
+
 private:
   DelayQueueEntry* head() { return fNext; }
   DelayQueueEntry* findEntryByToken(intptr_t token);
   void synchronize(); // bring the 'time remaining' fields up-to-date
 
+  // Implementation of a "DELAY_QUEUE_HEAP" queue:
+  void heapAddEntry(DelayQueueEntry* newEntry);
+  void heapRemoveEntry(DelayQueueEntry* entry);
+  int heapBefore(DelayQueueEntry const* a, DelayQueueEntry const* b) const;
+  void heapPlace(DelayQueueEntry* entry, unsigned index);
+  void siftUp(unsigned index);
+  void siftDown(unsigned index);
+
   _EventTime fLastSyncTime;
+
+  DelayQueueType fType;
+  DelayQueueEntry** fHeap;
+  unsigned fHeapSize, fHeapCapacity;
+  unsigned long fNextSequence;
+  HashTable* fTokenIndex; // token -> entry
+  DelayInterval fTimeToNextAlarm;
 };
 
 #endif
@@ -25,16 +25,32 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 
 class EpollTaskScheduler : public BasicTaskScheduler0 {
 public:
-  static EpollTaskScheduler* createNew(unsigned maxSchedulerGranularity = 10000 /*microseconds*/);
+  static EpollTaskScheduler* createNew(unsigned maxSchedulerGranularity = 10000 /*microseconds*/,
+				       unsigned maxEventsPerWait = 256,
+				       DelayQueueType delayQueueType = DELAY_QUEUE_HEAP);
+    // "maxEventsPerWait" is the number of ready sockets that are harvested (and handled) by each "epoll_wait()".
+    // "delayQueueType" defaults to "DELAY_QUEUE_HEAP", because this scheduler is intended for envs that serve
+    // many sessions (each with its own RTCP, liveness and stream timers).
   virtual ~EpollTaskScheduler();
 
 private:
-  EpollTaskScheduler(unsigned maxSchedulerGranularity);
+  EpollTaskScheduler(unsigned maxSchedulerGranularity, unsigned maxEventsPerWait, DelayQueueType delayQueueType);
 
   static void schedulerTickTask(void* clientData);
   void schedulerTickTask();
 
-  const HandlerDescriptor* lookupHandlerDescriptor(int socketNum) const;
+  // The handler of each socket is kept in a table indexed by the socket number:
+  struct EpollHandler {
+    int conditionSet; // 0 iff the slot is unused
+    BackgroundHandlerProc* handlerProc;
+    void* clientData;
+    unsigned events; // what is registered with epoll (0 iff not registered)
+    unsigned generation; // changes each time the slot is (re)used, so stale events can be ignored
+  };
+  EpollHandler* lookupHandler(int socketNum) const;
+  EpollHandler* handlerSlot(int socketNum); // grows the table, if necessary
+  unsigned epollEvents(EpollHandler const& handler) const;
+  void updateEpoll(int socketNum, EpollHandler& handler);
 
 private:
   virtual void SingleStep(unsigned maxDelayTime);
@@ -45,6 +61,12 @@ private:
 private:
   unsigned fMaxSchedulerGranularity;
 
+  EpollHandler* fHandlerTable;
+  int fHandlerTableSize;
+
+  struct epoll_event* fEventArray;
+  unsigned fMaxEventsPerWait;
+
 private:
 #if defined(__WIN32__) || defined(_WIN32)
   void* fEpollHandle;
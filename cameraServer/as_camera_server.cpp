@@ -12,6 +12,9 @@
 #include "as_ini_config.h"
 #include "as_timer.h"
 #include "as_mem.h"
+#if AS_APP_OS == AS_OS_LINUX
+#include "as_media_exchange.h"
+#endif
 
 using namespace tinyxml2;
 
@@ -676,7 +679,6 @@ int32_t ASEvLiveHttpClient::send_http_request(std::string& strUrl,std::string& s
 
 ASCameraSvrManager::ASCameraSvrManager()
 {
-    m_ulTdIndex        = 0;
     m_LoopWatchVar     = 0;
     m_ulRecvBufSize    = RTSP_SOCKET_RECV_BUFFER_SIZE_DEFAULT;
     m_HttpThreadHandle = NULL;
@@ -685,10 +687,8 @@ ASCameraSvrManager::ASCameraSvrManager()
     m_httpServer       = NULL;
     m_httpListenPort   = GW_SERVER_PORT_DEFAULT;
     m_mutex            = NULL;
-    memset(m_ThreadHandle,0,sizeof(as_thread_t*)*RTSP_MANAGE_ENV_MAX_COUNT);
-    memset(m_envArray,0,sizeof(UsageEnvironment*)*RTSP_MANAGE_ENV_MAX_COUNT);
-    memset(m_clCountArray,0,sizeof(u_int32_t)*RTSP_MANAGE_ENV_MAX_COUNT);
     m_ulLogLM          = AS_LOG_WARNING;
+    m_ulExchangeThreads= AS_EXCHANGE_THREAD_DEFAULT;
 }
 
 ASCameraSvrManager::~ASCameraSvrManager()
@@ -746,9 +746,6 @@ void    ASCameraSvrManager::release()
 
 int32_t ASCameraSvrManager::open()
 {
-    // Begin by setting up our usage environment:
-    u_int32_t i = 0;
-
     AS_LOG(AS_LOG_DEBUG,"ASCameraSvrManager::open begin.");
 
     m_LoopWatchVar = 0;
@@ -759,19 +756,18 @@ int32_t ASCameraSvrManager::open()
         return AS_ERROR_CODE_FAIL;
     }
 
-    /* start the rtsp client deal thread */
-    for(i = 0;i < RTSP_MANAGE_ENV_MAX_COUNT;i++) {
-        m_envArray[i] = NULL;
-        m_clCountArray[i] = 0;
+#if AS_APP_OS == AS_OS_LINUX
+    /* start the media exchange before the event loops,the receivers in them feed it */
+    if (AS_ERROR_CODE_OK != ASMediaExchangeSvr::instance().open(m_ulExchangeThreads)) {
+        AS_LOG(AS_LOG_ERROR,"ASCameraSvrManager::open,open the media exchange fail.");
+        return AS_ERROR_CODE_FAIL;
     }
+#endif
 
-    for(i = 0;i < RTSP_MANAGE_ENV_MAX_COUNT;i++) {
-        if( AS_ERROR_CODE_OK != as_create_thread((AS_THREAD_FUNC)rtsp_env_invoke,
-                                                 this,&m_ThreadHandle[i],AS_DEFAULT_STACK_SIZE)) {
-            AS_LOG(AS_LOG_ERROR,"ASCameraSvrManager::open,create the rtsp server thread fail.");
-            return AS_ERROR_CODE_FAIL;
-        }
-
+    /* start the rtsp client event loops */
+    if (AS_ERROR_CODE_OK != m_envPool.open()) {
+        AS_LOG(AS_LOG_ERROR,"ASCameraSvrManager::open,open the rtsp env pool fail.");
+        return AS_ERROR_CODE_FAIL;
     }
 
     /* start the notify deal thread */
@@ -796,6 +792,11 @@ void ASCameraSvrManager::close()
 {
     AS_LOG(AS_LOG_DEBUG,"ASCameraSvrManager::close.");
     m_LoopWatchVar = 1;
+    m_envPool.close();
+#if AS_APP_OS == AS_OS_LINUX
+    /* the event loops are stopped,no receiver adds data any more */
+    ASMediaExchangeSvr::instance().close();
+#endif
 
     return;
 }
@@ -828,6 +829,19 @@ int32_t ASCameraSvrManager::read_system_conf()
     {
         m_ulLogLM = atoi(strValue.c_str());
     }
+
+    /* rtsp event loop pool */
+    m_envPool.read_conf(config);
+
+    /* media exchange threads */
+    if(INI_SUCCESS == config.GetValue("EXCHANGE_CFG","ExchangeThreads",strValue))
+    {
+        m_ulExchangeThreads = atoi(strValue.c_str());
+        if(0 == m_ulExchangeThreads)
+        {
+            m_ulExchangeThreads = AS_EXCHANGE_THREAD_DEFAULT;
+        }
+    }
     return AS_ERROR_CODE_OK;
 }
 
@@ -844,12 +858,6 @@ void *ASCameraSvrManager::http_env_invoke(void *arg)
     return NULL;
 }
 
-void *ASCameraSvrManager::rtsp_env_invoke(void *arg)
-{
-    ASCameraSvrManager* manager = (ASCameraSvrManager*)(void*)arg;
-    manager->rtsp_env_thread();
-    return NULL;
-}
 void *ASCameraSvrManager::sip_evn_invoke(void *arg)
 {
     ASCameraSvrManager* manager = (ASCameraSvrManager*)(void*)arg;
@@ -894,38 +902,6 @@ void ASCameraSvrManager::http_env_thread()
     AS_LOG(AS_LOG_DEBUG,"ASCameraSvrManager::http_env_thread end.");
     return;
 }
-void ASCameraSvrManager::rtsp_env_thread()
-{
-    u_int32_t index = thread_index();
-    AS_LOG(AS_LOG_DEBUG,"ASCameraSvrManager::rtsp_env_thread,index:[%d] begin.",index);
-
-    TaskScheduler* scheduler = NULL;
-    UsageEnvironment* env = NULL;
-
-
-    if(RTSP_MANAGE_ENV_MAX_COUNT <= index) {
-        return;
-    }
-    scheduler = BasicTaskScheduler::createNew();
-    env = BasicUsageEnvironment::createNew(*scheduler);
-    m_envArray[index] = env;
-    m_clCountArray[index] = 0;
-
-
-    // All subsequent activity takes place within the event loop:
-    env->taskScheduler().doEventLoop(&m_LoopWatchVar);
-
-    // LOOP EXIST
-    env->reclaim();
-    env = NULL;
-    delete scheduler;
-    scheduler = NULL;
-    m_envArray[index] = NULL;
-    m_clCountArray[index] = 0;
-    AS_LOG(AS_LOG_ERROR,"ASCameraSvrManager::rtsp_env_thread,index:[%d] end.",index);
-    return;
-}
-
 void ASCameraSvrManager::sip_env_thread()
 {
     AS_LOG(AS_LOG_DEBUG,"ASCameraSvrManager::sip_env_thread begin.");
@@ -984,31 +960,15 @@ void ASCameraSvrManager::notify_env_thread()
 
 u_int32_t ASCameraSvrManager::find_beast_thread()
 {
-    as_mutex_lock(m_mutex);
-    u_int32_t index = 0;
-    u_int32_t count = 0xFFFFFFFF;
-    for(u_int32_t i = 0; i < RTSP_MANAGE_ENV_MAX_COUNT;i++) {
-        if(count > m_clCountArray[i]) {
-            index = i;
-            count = m_clCountArray[i];
-        }
-    }
-    as_mutex_unlock(m_mutex);
-    return index;
+    return m_envPool.alloc_env();
 }
 UsageEnvironment* ASCameraSvrManager::get_env(u_int32_t index)
 {
-    UsageEnvironment* env = m_envArray[index];
-    m_clCountArray[index]++;
-    return env;
+    return m_envPool.get_env(index);
 }
 void ASCameraSvrManager::releas_env(u_int32_t index)
 {
-    if (0 == m_clCountArray[index])
-    {
-        return;
-    }
-    m_clCountArray[index]--;
+    m_envPool.release_env(index);
 }
 
 
@@ -95,6 +95,10 @@ extern "C"{
 
 #define GW_PORT_PAIR_SIZE              4
 
+#ifndef AS_EXCHANGE_THREAD_DEFAULT
+#define AS_EXCHANGE_THREAD_DEFAULT     4
+#endif
+
 
 #define SIP_STATIC_INTER          60000
 #define SIP_SESSION_EXPIRY        1800
@@ -138,8 +142,6 @@ extern "C"{
 // If you don't want to see debugging output for each received frame, then comment out the following line:
 #define DEBUG_PRINT_EACH_RECEIVED_FRAME 1
 
-#define RTSP_MANAGE_ENV_MAX_COUNT       4
-
 #define ALLCAM_AGENT_NAME                 "all camera server"
 
 
@@ -251,7 +253,6 @@ public:
     int32_t reg_lens_dev_map(std::string& strLensID,std::string& strDevID);
 public:
     void http_env_thread();
-    void rtsp_env_thread();
     void sip_env_thread();
     void notify_env_thread();
     u_int32_t find_beast_thread();
@@ -267,17 +268,8 @@ private:
     static void  http_callback(struct evhttp_request *req, void *arg);
 private:
     static void *http_env_invoke(void *arg);
-    static void *rtsp_env_invoke(void *arg);
     static void *sip_evn_invoke(void *arg);
     static void *notify_evn_invoke(void *arg);
-    u_int32_t thread_index()
-    {
-        as_mutex_lock(m_mutex);
-        u_int32_t index = m_ulTdIndex;
-        m_ulTdIndex++;
-        as_mutex_unlock(m_mutex);
-        return index;
-    }
 private:
     // function for the sip deal
     int32_t read_sip_conf();
@@ -296,11 +288,11 @@ private:
     void release_device(ASDevice* pDev);
     int32_t handle_http_message(std::string& strReq,std::string& strResp);
 private:
-    u_int32_t         m_ulTdIndex;
     as_mutex_t       *m_mutex;
     char              m_LoopWatchVar;
     u_int32_t         m_ulRecvBufSize;
     u_int32_t         m_ulLogLM;
+    u_int32_t         m_ulExchangeThreads;
 private:
     typedef std::map<std::string, ASDevice*> DEV_MAP;
     DEV_MAP           m_devMap;
@@ -332,8 +324,6 @@ private:
     std::string       m_strAlarmNotifyUrl;
 private:
     //Stream service
-    as_thread_t      *m_ThreadHandle[RTSP_MANAGE_ENV_MAX_COUNT];
-    UsageEnvironment *m_envArray[RTSP_MANAGE_ENV_MAX_COUNT];
-    u_int32_t         m_clCountArray[RTSP_MANAGE_ENV_MAX_COUNT];
+    as_env_pool       m_envPool;
 };
 #endif /* __AS_RTSP_CLIENT_MANAGE_H__ */
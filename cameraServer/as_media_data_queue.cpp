@@ -1,17 +1,79 @@
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include "as_media_data_queue.h"
+extern "C"{
+#include "as_common.h"
+#include "as_time.h"
+}
 
 CMediaDataBlock::CMediaDataBlock()
 {
-    m_pData   = NULL;
+    m_pData     = NULL;
+    m_ulSize    = 0;
+    m_rd_ptr    = NULL;
+    m_wr_ptr    = NULL;
+    m_lRefCount = 1;
+    m_bFromPool = false;
+    m_pClass    = NULL;
+    m_pUsage    = NULL;
+    m_pNext     = NULL;
+}
+CMediaDataBlock::CMediaDataBlock(size_t ulSize)
+{
+    m_pData     = NULL;
+    m_ulSize    = 0;
+    m_rd_ptr    = NULL;
+    m_wr_ptr    = NULL;
+    m_lRefCount = 1;
+    m_bFromPool = false;
+    m_pClass    = NULL;
+    m_pUsage    = NULL;
+    m_pNext     = NULL;
+    (void)size(ulSize);
+}
+CMediaDataBlock::~CMediaDataBlock()
+{
+    if(NULL != m_pData)
+    {
+        delete[] m_pData;
+        m_pData = NULL;
+    }
     m_ulSize  = 0;
     m_rd_ptr  = NULL;
     m_wr_ptr  = NULL;
 }
-CMediaDataBlock::CMediaDataBlock(size_t ulSize)
+CMediaDataBlock *CMediaDataBlock::duplicate (void)
 {
+    (void)__atomic_add_fetch(&m_lRefCount, 1, __ATOMIC_RELAXED);
+    return this;
 }
-CMediaDataBlock::~CMediaDataBlock()
+CMediaDataBlock *CMediaDataBlock::release (void)
+{
+    if (0 < __atomic_sub_fetch(&m_lRefCount, 1, __ATOMIC_ACQ_REL))
+    {
+        return NULL;
+    }
+
+    if (m_bFromPool)
+    {
+        CMediaBlockPool::instance().free(this);
+    }
+    else
+    {
+        delete this;
+    }
+    return NULL;
+}
+int32_t CMediaDataBlock::reference_count (void) const
+{
+    return __atomic_load_n(&m_lRefCount, __ATOMIC_RELAXED);
+}
+void CMediaDataBlock::reset (void)
 {
+    m_rd_ptr = m_pData;
+    m_wr_ptr = m_pData;
 }
 char *CMediaDataBlock::base (void) const
 {
@@ -52,219 +114,752 @@ void CMediaDataBlock::wr_ptr (size_t n)
 
 size_t CMediaDataBlock::length (void) const
 {
-    return
+    return (size_t)(m_wr_ptr - m_rd_ptr);
 }
 void CMediaDataBlock::length (size_t n)
 {
+    m_wr_ptr = m_rd_ptr + n;
 }
 size_t CMediaDataBlock::size (void) const
 {
+    return m_ulSize;
 }
 int CMediaDataBlock::size (size_t length)
 {
+    if(length <= m_ulSize)
+    {
+        m_ulSize = length;
+        return 0;
+    }
+
+    char* pData = NULL;
+    try
+    {
+        pData = new char[length];
+    }
+    catch (...)
+    {
+        return -1;
+    }
+
+    size_t rdOffset = (size_t)(m_rd_ptr - m_pData);
+    size_t wrOffset = (size_t)(m_wr_ptr - m_pData);
+    if(NULL != m_pData)
+    {
+        memcpy(pData, m_pData, m_ulSize);
+        delete[] m_pData;
+    }
+    else
+    {
+        rdOffset = 0;
+        wrOffset = 0;
+    }
+
+    m_pData  = pData;
+    m_ulSize = length;
+    m_rd_ptr = m_pData + rdOffset;
+    m_wr_ptr = m_pData + wrOffset;
+    return 0;
 }
 
 
-CMediaDataQueue::CMediaDataQueue()
+CMediaBlockPool::CMediaBlockPool()
 {
-    atomic_set(m_ActiveFlag, 1);
-    m_unArraySize    = 0;
-    m_unMaxQueueSize = 0;
+    size_t   ulBlockSize[MEDIA_BLOCK_CLASS_MAX] = {MEDIA_BLOCK_SIZE_SMALL,
+                                                   MEDIA_BLOCK_SIZE_MIDDLE,
+                                                   MEDIA_BLOCK_SIZE_LARGE};
+    uint32_t ulMaxFree[MEDIA_BLOCK_CLASS_MAX]   = {MEDIA_BLOCK_FREE_SMALL,
+                                                   MEDIA_BLOCK_FREE_MIDDLE,
+                                                   MEDIA_BLOCK_FREE_LARGE};
+    for (uint32_t i = 0; i < MEDIA_BLOCK_CLASS_MAX; i++)
+    {
+        m_Class[i].ulBlockSize   = ulBlockSize[i];
+        m_Class[i].ulMaxFree     = ulMaxFree[i];
+        m_Class[i].pMutex        = NULL;
+        m_Class[i].pFreeList     = NULL;
+        m_Class[i].ulFreeCount   = 0;
+        m_Class[i].ulTotalCount  = 0;
+        m_Class[i].ulInUseCount  = 0;
+        m_Class[i].ullAllocCount = 0;
+        m_Class[i].ullMissCount  = 0;
+    }
+    m_ulOverSizeInUse  = 0;
+    m_ullOverSizeBytes = 0;
+    m_pUsageMutex      = NULL;
+}
 
-    atomic_set(m_QueueSize, 0);
-    m_pDataArray  = NULL;
+CMediaBlockPool::~CMediaBlockPool()
+{
+    close();
+}
 
-    atomic_set(m_WriteIndex, 0);
-    atomic_set(m_WriteTag, 0);
-    atomic_set(m_ReadIndex, 0);
-    atomic_set(m_ReadTag, 0);
+int32_t CMediaBlockPool::open()
+{
+    for (uint32_t i = 0; i < MEDIA_BLOCK_CLASS_MAX; i++)
+    {
+        if (NULL != m_Class[i].pMutex)
+        {
+            continue;
+        }
+        m_Class[i].pMutex = as_create_mutex();
+        if (NULL == m_Class[i].pMutex)
+        {
+            return AS_ERROR_CODE_SYS;
+        }
+    }
+    if (NULL == m_pUsageMutex)
+    {
+        m_pUsageMutex = as_create_mutex();
+        if (NULL == m_pUsageMutex)
+        {
+            return AS_ERROR_CODE_SYS;
+        }
+    }
+    return AS_ERROR_CODE_OK;
 }
 
-CMediaDataQueue::~CMediaDataQueue()
+void CMediaBlockPool::close()
 {
-    if (NULL != m_pDataArray)
+    CMediaDataBlock* mb = NULL;
+    for (uint32_t i = 0; i < MEDIA_BLOCK_CLASS_MAX; i++)
     {
-        delete[] m_pDataArray;
-        m_pDataArray = NULL;
+        if (NULL == m_Class[i].pMutex)
+        {
+            continue;
+        }
+        as_mutex_lock(m_Class[i].pMutex);
+        while (NULL != m_Class[i].pFreeList)
+        {
+            mb = m_Class[i].pFreeList;
+            m_Class[i].pFreeList = mb->m_pNext;
+            m_Class[i].ulFreeCount--;
+            (void)__atomic_sub_fetch(&m_Class[i].ulTotalCount, 1, __ATOMIC_RELAXED);
+            delete mb;
+        }
+        as_mutex_unlock(m_Class[i].pMutex);
     }
 }
 
+CMediaDataBlock* CMediaBlockPool::alloc(size_t ulSize, MEDIA_BLOCK_USAGE* pUsage)
+{
+    MEDIA_BLOCK_CLASS* pClass = NULL;
+    for (uint32_t i = 0; i < MEDIA_BLOCK_CLASS_MAX; i++)
+    {
+        if ((ulSize <= m_Class[i].ulBlockSize) && (NULL != m_Class[i].pMutex))
+        {
+            pClass = &m_Class[i];
+            break;
+        }
+    }
 
-int32_t CMediaDataQueue::init(uint32_t unQueueSize)
+    CMediaDataBlock* mb = NULL;
+    if (NULL != pClass)
+    {
+        as_mutex_lock(pClass->pMutex);
+        mb = pClass->pFreeList;
+        if (NULL != mb)
+        {
+            pClass->pFreeList = mb->m_pNext;
+            pClass->ulFreeCount--;
+        }
+        as_mutex_unlock(pClass->pMutex);
+        (void)__atomic_add_fetch(&pClass->ullAllocCount, 1, __ATOMIC_RELAXED);
+    }
+
+    if (NULL == mb)
+    {
+        /* the free list is empty or the size is over the large class */
+        size_t ulBlockSize = (NULL != pClass) ? pClass->ulBlockSize : ulSize;
+        try
+        {
+            mb = new CMediaDataBlock(ulBlockSize);
+        }
+        catch (...)
+        {
+            return NULL;
+        }
+        if (NULL == mb->base())
+        {
+            delete mb;
+            return NULL;
+        }
+        mb->m_bFromPool = true;
+        mb->m_pClass    = pClass;
+        if (NULL != pClass)
+        {
+            (void)__atomic_add_fetch(&pClass->ullMissCount, 1, __ATOMIC_RELAXED);
+            (void)__atomic_add_fetch(&pClass->ulTotalCount, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (NULL != pClass)
+    {
+        (void)__atomic_add_fetch(&pClass->ulInUseCount, 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        (void)__atomic_add_fetch(&m_ulOverSizeInUse, 1, __ATOMIC_RELAXED);
+        (void)__atomic_add_fetch(&m_ullOverSizeBytes, mb->size(), __ATOMIC_RELAXED);
+    }
+
+    mb->m_lRefCount = 1;
+    mb->m_pNext     = NULL;
+    mb->m_pUsage    = pUsage;
+    mb->reset();
+    if (NULL != pUsage)
+    {
+        (void)__atomic_add_fetch(&pUsage->lRefCount, 1, __ATOMIC_RELAXED);
+        (void)__atomic_add_fetch(&pUsage->ulBlockCount, 1, __ATOMIC_RELAXED);
+        (void)__atomic_add_fetch(&pUsage->ullBytes, mb->size(), __ATOMIC_RELAXED);
+    }
+    return mb;
+}
+
+void CMediaBlockPool::free(CMediaDataBlock* mb)
+{
+    MEDIA_BLOCK_USAGE* pUsage = mb->m_pUsage;
+    if (NULL != pUsage)
+    {
+        mb->m_pUsage = NULL;
+        (void)__atomic_sub_fetch(&pUsage->ulBlockCount, 1, __ATOMIC_RELAXED);
+        (void)__atomic_sub_fetch(&pUsage->ullBytes, mb->size(), __ATOMIC_RELAXED);
+        dec_usage(pUsage);
+    }
+
+    MEDIA_BLOCK_CLASS* pClass = mb->m_pClass;
+    if (NULL == pClass)
+    {
+        (void)__atomic_sub_fetch(&m_ulOverSizeInUse, 1, __ATOMIC_RELAXED);
+        (void)__atomic_sub_fetch(&m_ullOverSizeBytes, mb->size(), __ATOMIC_RELAXED);
+        delete mb;
+        return;
+    }
+
+    (void)__atomic_sub_fetch(&pClass->ulInUseCount, 1, __ATOMIC_RELAXED);
+    as_mutex_lock(pClass->pMutex);
+    if (pClass->ulFreeCount < pClass->ulMaxFree)
+    {
+        mb->m_pNext       = pClass->pFreeList;
+        pClass->pFreeList = mb;
+        pClass->ulFreeCount++;
+        mb = NULL;
+    }
+    as_mutex_unlock(pClass->pMutex);
+
+    if (NULL != mb)
+    {
+        /* keep the pool bounded after a burst */
+        (void)__atomic_sub_fetch(&pClass->ulTotalCount, 1, __ATOMIC_RELAXED);
+        delete mb;
+    }
+}
+
+MEDIA_BLOCK_USAGE* CMediaBlockPool::create_usage(uint64_t ullOwnerID)
+{
+    MEDIA_BLOCK_USAGE* pUsage = NULL;
+    try
+    {
+        pUsage = new MEDIA_BLOCK_USAGE;
+    }
+    catch (...)
+    {
+        return NULL;
+    }
+    pUsage->ullOwnerID   = ullOwnerID;
+    pUsage->lRefCount    = 1;
+    pUsage->ulBlockCount = 0;
+    pUsage->ullBytes     = 0;
+
+    if (NULL != m_pUsageMutex)
+    {
+        as_mutex_lock(m_pUsageMutex);
+        m_UsageMap[ullOwnerID] = pUsage;
+        as_mutex_unlock(m_pUsageMutex);
+    }
+    return pUsage;
+}
+
+void CMediaBlockPool::release_usage(MEDIA_BLOCK_USAGE* pUsage)
+{
+    if (NULL == pUsage)
+    {
+        return;
+    }
+
+    if (NULL != m_pUsageMutex)
+    {
+        as_mutex_lock(m_pUsageMutex);
+        USAGEMAP::iterator iter = m_UsageMap.find(pUsage->ullOwnerID);
+        if ((iter != m_UsageMap.end()) && (iter->second == pUsage))
+        {
+            m_UsageMap.erase(iter);
+        }
+        as_mutex_unlock(m_pUsageMutex);
+    }
+
+    /* the blocks still in flight keep the usage alive */
+    dec_usage(pUsage);
+}
+
+int32_t CMediaBlockPool::get_usage(uint64_t ullOwnerID, uint32_t& ulBlockCount, uint64_t& ullBytes)
+{
+    if (NULL == m_pUsageMutex)
+    {
+        return AS_ERROR_CODE_FAIL;
+    }
+
+    int32_t nRet = AS_ERROR_CODE_FAIL;
+    as_mutex_lock(m_pUsageMutex);
+    USAGEMAP::iterator iter = m_UsageMap.find(ullOwnerID);
+    if (iter != m_UsageMap.end())
+    {
+        ulBlockCount = __atomic_load_n(&iter->second->ulBlockCount, __ATOMIC_RELAXED);
+        ullBytes     = __atomic_load_n(&iter->second->ullBytes, __ATOMIC_RELAXED);
+        nRet         = AS_ERROR_CODE_OK;
+    }
+    as_mutex_unlock(m_pUsageMutex);
+    return nRet;
+}
+
+void CMediaBlockPool::get_stat(MEDIA_BLOCK_POOL_STAT& stat)
 {
-    atomic_set(m_ActiveFlag, 1);
-    m_unMaxQueueSize = unQueueSize;
-    m_unArraySize    = unQueueSize + 1;
+    for (uint32_t i = 0; i < MEDIA_BLOCK_CLASS_MAX; i++)
+    {
+        stat.stClass[i].ulBlockSize   = m_Class[i].ulBlockSize;
+        stat.stClass[i].ulTotalCount  = __atomic_load_n(&m_Class[i].ulTotalCount, __ATOMIC_RELAXED);
+        stat.stClass[i].ulInUseCount  = __atomic_load_n(&m_Class[i].ulInUseCount, __ATOMIC_RELAXED);
+        stat.stClass[i].ullAllocCount = __atomic_load_n(&m_Class[i].ullAllocCount, __ATOMIC_RELAXED);
+        stat.stClass[i].ullMissCount  = __atomic_load_n(&m_Class[i].ullMissCount, __ATOMIC_RELAXED);
+        stat.stClass[i].ulFreeCount   = 0;
+        if (NULL != m_Class[i].pMutex)
+        {
+            as_mutex_lock(m_Class[i].pMutex);
+            stat.stClass[i].ulFreeCount = m_Class[i].ulFreeCount;
+            as_mutex_unlock(m_Class[i].pMutex);
+        }
+    }
+    stat.ulOverSizeInUse  = __atomic_load_n(&m_ulOverSizeInUse, __ATOMIC_RELAXED);
+    stat.ullOverSizeBytes = __atomic_load_n(&m_ullOverSizeBytes, __ATOMIC_RELAXED);
+}
+
+void CMediaBlockPool::dec_usage(MEDIA_BLOCK_USAGE* pUsage)
+{
+    if (0 == __atomic_sub_fetch(&pUsage->lRefCount, 1, __ATOMIC_ACQ_REL))
+    {
+        delete pUsage;
+    }
+}
+
+
+/* the producers wait for space in slices,more than one producer may park at once */
+#define MEDIA_QUEUE_PRODUCER_WAIT_SLICE    10
+
+CMediaDataQueue::CMediaDataQueue()
+{
+    m_ullTail           = 0;
+    m_ullHead           = 0;
+    m_ulConsumerWaiting = 0;
+    m_ulProducerWaiting = 0;
+    memset(m_pad0, 0x0, sizeof(m_pad0));
+    memset(m_pad1, 0x0, sizeof(m_pad1));
+    memset(m_pad2, 0x0, sizeof(m_pad2));
+
+    m_ActiveFlag      = 1;
+    m_unArraySize     = 0;
+    m_ullMask         = 0;
+    m_pSlotArray      = NULL;
+    m_lConsumerFd     = -1;
+    m_lProducerFd     = -1;
+
+    m_ullEnqueueCount = 0;
+    m_ullDequeueCount = 0;
+    m_ullFullCount    = 0;
+    m_ullWakeupCount  = 0;
+    m_ulHighWaterMark = 0;
+}
+
+CMediaDataQueue::~CMediaDataQueue()
+{
+    if (NULL != m_pSlotArray)
+    {
+        delete[] m_pSlotArray;
+        m_pSlotArray = NULL;
+    }
+    if (-1 != m_lConsumerFd)
+    {
+        ::close(m_lConsumerFd);
+        m_lConsumerFd = -1;
+    }
+    if (-1 != m_lProducerFd)
+    {
+        ::close(m_lProducerFd);
+        m_lProducerFd = -1;
+    }
+}
 
-    atomic_set(m_QueueSize, 0);
-    m_pDataArray  = NULL;
 
-    atomic_set(m_WriteIndex, 0);
-    atomic_set(m_WriteTag, 0);
-    atomic_set(m_ReadIndex, 0);
-    atomic_set(m_ReadTag, 0);
+int32_t CMediaDataQueue::init(uint32_t unQueueSize)
+{
+    if ((0 == unQueueSize) || (0x80000000 < unQueueSize) || (NULL != m_pSlotArray))
+    {
+        return AS_ERROR_CODE_PARAM;
+    }
 
-    m_unMaxQueueSize = unQueueSize;
-    m_unArraySize    = unQueueSize + 1;
+    uint32_t unArraySize = 2;
+    while (unArraySize < unQueueSize)
+    {
+        unArraySize <<= 1;
+    }
 
     try
     {
-        m_pDataArray = new CMediaDataBlock*[m_unArraySize];
+        m_pSlotArray = new QUEUE_SLOT[unArraySize];
     }
     catch (...)
     {
-        return RET_ERR_SYS_NEW;
+        return AS_ERROR_CODE_MEM;
     }
 
-    memset(m_pDataArray, 0x0, sizeof(CMediaDataBlock*) * m_unArraySize);
-    return RET_OK;
+    for (uint32_t i = 0; i < unArraySize; i++)
+    {
+        m_pSlotArray[i].ullSeq = i;
+        m_pSlotArray[i].mb     = NULL;
+    }
+
+    m_lConsumerFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_lProducerFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((-1 == m_lConsumerFd) || (-1 == m_lProducerFd))
+    {
+        return AS_ERROR_CODE_SYS;
+    }
+
+    m_unArraySize = unArraySize;
+    m_ullMask     = unArraySize - 1;
+    m_ullTail     = 0;
+    m_ullHead     = 0;
+    __atomic_store_n(&m_ActiveFlag, 1, __ATOMIC_SEQ_CST);
+    return AS_ERROR_CODE_OK;
 }
 
 
 void CMediaDataQueue::close()
 {
-    atomic_set(m_ActiveFlag, 0);
+    __atomic_store_n(&m_ActiveFlag, 0, __ATOMIC_SEQ_CST);
+
+    /* wake up everyone parked on the queue */
+    uint64_t ullValue = 1;
+    if (-1 != m_lConsumerFd)
+    {
+        (void)::write(m_lConsumerFd, &ullValue, sizeof(ullValue));
+    }
+    if (-1 != m_lProducerFd)
+    {
+        (void)::write(m_lProducerFd, &ullValue, sizeof(ullValue));
+    }
 }
 
 
 uint32_t CMediaDataQueue::message_count() const
 {
-    return (uint32_t) atomic_read(m_QueueSize);
+    uint64_t ullHead = __atomic_load_n(&m_ullHead, __ATOMIC_ACQUIRE);
+    uint64_t ullTail = __atomic_load_n(&m_ullTail, __ATOMIC_ACQUIRE);
+    if (ullTail <= ullHead)
+    {
+        return 0;
+    }
+    if (ullTail - ullHead > m_unArraySize)
+    {
+        return m_unArraySize;
+    }
+    return (uint32_t)(ullTail - ullHead);
 }
 
 
 bool CMediaDataQueue::empty() const
 {
-    return (atomic_read(m_QueueSize) == 0);
+    return (0 == message_count());
 }
 
 
 bool CMediaDataQueue::full() const
 {
-    return ((uint32_t) atomic_read(m_QueueSize) >= m_unMaxQueueSize);
+    return (message_count() >= m_unArraySize);
 }
 
 
-int32_t CMediaDataQueue::enqueue_tail(CMediaDataBlock* mb, const ACE_Time_Value *timeout)
+int32_t CMediaDataQueue::enqueue_tail(CMediaDataBlock* mb, uint32_t ulTimeOut)
 {
-    if (NULL == mb)
+    return enqueue_batch(&mb, 1, ulTimeOut);
+}
+
+
+int32_t CMediaDataQueue::dequeue_head(CMediaDataBlock* &mb, uint32_t ulTimeOut)
+{
+    mb = NULL;
+    if (0 < dequeue_batch(&mb, 1, ulTimeOut))
     {
-        return RET_FAIL;
+        return AS_ERROR_CODE_OK;
     }
 
-    if ((NULL == m_pDataArray) || (0 == m_unArraySize))
+    if (0 == __atomic_load_n(&m_ActiveFlag, __ATOMIC_ACQUIRE))
     {
-        return RET_FAIL;
+        return AS_ERROR_CODE_FAIL;
     }
-    bool bFlag               = false;
-    bool bTimeOut            = false;
-    uint32_t unHeadIndex = 0;
+    return AS_ERROR_CODE_TIMEOUT;
+}
+
 
-    ACE_Time_Value tvTimeOut;
-    ACE_Time_Value startTime = ACE_OS::gettimeofday();
-    if (NULL != timeout)
+int32_t CMediaDataQueue::enqueue_batch(CMediaDataBlock** mbArray, uint32_t ulCount, uint32_t ulTimeOut)
+{
+    if ((NULL == mbArray) || (0 == ulCount))
     {
-        bTimeOut  = true;
-        tvTimeOut = *timeout;
+        return AS_ERROR_CODE_PARAM;
     }
 
-    while (0 != atomic_read(m_ActiveFlag))
+    if ((NULL == m_pSlotArray) || (ulCount > m_unArraySize))
     {
-        if (bTimeOut && (ACE_OS::gettimeofday() - startTime > tvTimeOut))
+        return AS_ERROR_CODE_FAIL;
+    }
+
+    for (uint32_t i = 0; i < ulCount; i++)
+    {
+        if (NULL == mbArray[i])
         {
-            return RET_ERR_TIMEOUT;
+            return AS_ERROR_CODE_PARAM;
         }
+    }
 
-        unHeadIndex = (uint32_t)atomic_read(m_WriteIndex);
-        uint32_t unTag       = (uint32_t)atomic_read(m_WriteTag);
-        if ((unHeadIndex + 1) % m_unArraySize == (uint32_t)atomic_read(m_ReadIndex))
+    uint64_t ullPos = 0;
+    int32_t  nRet   = claim(ulCount, ullPos, ulTimeOut);
+    if (AS_ERROR_CODE_OK != nRet)
+    {
+        return nRet;
+    }
+
+    publish(ullPos, mbArray, ulCount);
+    return AS_ERROR_CODE_OK;
+}
+
+
+uint32_t CMediaDataQueue::dequeue_batch(CMediaDataBlock** mbArray, uint32_t ulMaxCount, uint32_t ulTimeOut)
+{
+    if ((NULL == mbArray) || (0 == ulMaxCount) || (NULL == m_pSlotArray))
+    {
+        return 0;
+    }
+
+    uint32_t ulStartTime = as_get_cur_msecond();
+    uint32_t ulCount     = 0;
+    while (0 != __atomic_load_n(&m_ActiveFlag, __ATOMIC_ACQUIRE))
+    {
+        ulCount = take(mbArray, ulMaxCount);
+        if (0 < ulCount)
         {
-            (void)usleep(1000);
-            continue;
+            return ulCount;
         }
 
-        if (NULL != m_pDataArray[unHeadIndex])
+        if (!wait(m_lConsumerFd, &m_ulConsumerWaiting, ulTimeOut, ulStartTime, true))
         {
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+
+void CMediaDataQueue::get_stat(MEDIA_QUEUE_STAT& stat) const
+{
+    stat.ullEnqueueCount = __atomic_load_n(&m_ullEnqueueCount, __ATOMIC_RELAXED);
+    stat.ullDequeueCount = __atomic_load_n(&m_ullDequeueCount, __ATOMIC_RELAXED);
+    stat.ullFullCount    = __atomic_load_n(&m_ullFullCount, __ATOMIC_RELAXED);
+    stat.ullWakeupCount  = __atomic_load_n(&m_ullWakeupCount, __ATOMIC_RELAXED);
+    stat.ulHighWaterMark = __atomic_load_n(&m_ulHighWaterMark, __ATOMIC_RELAXED);
+    stat.ulQueueSize     = m_unArraySize;
+}
+
+
+int32_t CMediaDataQueue::claim(uint32_t ulCount, uint64_t& ullPos, uint32_t ulTimeOut)
+{
+    uint32_t ulStartTime = as_get_cur_msecond();
+    uint64_t ullLast     = 0;
+    uint64_t ullSeq      = 0;
+
+    while (0 != __atomic_load_n(&m_ActiveFlag, __ATOMIC_ACQUIRE))
+    {
+        ullPos  = __atomic_load_n(&m_ullTail, __ATOMIC_RELAXED);
+        ullLast = ullPos + ulCount - 1;
+
+        /* the consumer frees the slots in order,so the last slot being free
+           means the whole range is free */
+        ullSeq = __atomic_load_n(&m_pSlotArray[ullLast & m_ullMask].ullSeq, __ATOMIC_ACQUIRE);
+        if (ullSeq == ullLast)
+        {
+            if (__atomic_compare_exchange_n(&m_ullTail, &ullPos, ullPos + ulCount,
+                                            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            {
+                return AS_ERROR_CODE_OK;
+            }
             continue;
         }
 
-        if (compare_and_swap2(&m_WriteIndex, unHeadIndex, unTag, (unHeadIndex + 1) % m_unArraySize, unTag + 1))
+        if (ullSeq > ullLast)
         {
-            bFlag = true;
-            break;
+            /* another producer has moved the tail */
+            continue;
         }
 
+        (void)__atomic_fetch_add(&m_ullFullCount, 1, __ATOMIC_RELAXED);
+        if (!wait(m_lProducerFd, &m_ulProducerWaiting, ulTimeOut, ulStartTime, false))
+        {
+            return AS_ERROR_CODE_TIMEOUT;
+        }
     }
 
-    if (bFlag)
-    {
-        m_pDataArray[unHeadIndex] = mb;
-        atomic_inc(&m_QueueSize);
+    return AS_ERROR_CODE_FAIL;
+}
 
-        return RET_OK;
+
+void CMediaDataQueue::publish(uint64_t ullPos, CMediaDataBlock** mbArray, uint32_t ulCount)
+{
+    QUEUE_SLOT* pSlot = NULL;
+    for (uint32_t i = 0; i < ulCount; i++)
+    {
+        pSlot     = &m_pSlotArray[(ullPos + i) & m_ullMask];
+        pSlot->mb = mbArray[i];
+        __atomic_store_n(&pSlot->ullSeq, ullPos + i + 1, __ATOMIC_RELEASE);
     }
 
-    return RET_FAIL;
+    (void)__atomic_fetch_add(&m_ullEnqueueCount, ulCount, __ATOMIC_RELAXED);
+    update_high_water(ullPos + ulCount);
+
+    /* pairs with the fence in wait(),the consumer either sees the data or we see it parked */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    notify(m_lConsumerFd, &m_ulConsumerWaiting);
 }
 
 
-int32_t CMediaDataQueue::dequeue_head(CMediaDataBlock* &mb, const ACE_Time_Value *timeout)
+uint32_t CMediaDataQueue::take(CMediaDataBlock** mbArray, uint32_t ulMaxCount)
 {
-    if ((NULL == m_pDataArray) || (0 == m_unArraySize))
-    {
-        return RET_FAIL;
-    }
+    uint64_t    ullHead = m_ullHead;
+    uint32_t    ulCount = 0;
+    QUEUE_SLOT* pSlot   = NULL;
 
-    bool bFlag               = false;
-    bool bTimeOut            = false;
-    uint32_t unTailIndex = 0;
-    ACE_Time_Value tvTimeOut;
-    ACE_Time_Value startTime = ACE_OS::gettimeofday();
-    if (NULL != timeout)
+    while (ulCount < ulMaxCount)
     {
-        bTimeOut  = true;
-        tvTimeOut = *timeout;
+        pSlot = &m_pSlotArray[ullHead & m_ullMask];
+        if (__atomic_load_n(&pSlot->ullSeq, __ATOMIC_ACQUIRE) != ullHead + 1)
+        {
+            break;
+        }
+
+        mbArray[ulCount++] = pSlot->mb;
+        pSlot->mb = NULL;
+        __atomic_store_n(&pSlot->ullSeq, ullHead + m_unArraySize, __ATOMIC_RELEASE);
+        ullHead++;
     }
 
-    while (0 != atomic_read(m_ActiveFlag))
+    if (0 == ulCount)
     {
-        if (bTimeOut && (ACE_OS::gettimeofday() - startTime > tvTimeOut))
-        {
-            return RET_ERR_TIMEOUT;
-        }
+        return 0;
+    }
 
-        unTailIndex = (uint32_t)atomic_read(m_ReadIndex);
-        uint32_t unTag = (uint32_t)atomic_read(m_ReadTag);
+    __atomic_store_n(&m_ullHead, ullHead, __ATOMIC_RELEASE);
+    (void)__atomic_fetch_add(&m_ullDequeueCount, ulCount, __ATOMIC_RELAXED);
 
-        if (unTailIndex == (uint32_t)atomic_read(m_WriteIndex))
-        {
-            (void)usleep(1000);
-            continue;
-        }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    notify(m_lProducerFd, &m_ulProducerWaiting);
+    return ulCount;
+}
 
 
-        if (NULL == m_pDataArray[unTailIndex])
+bool CMediaDataQueue::wait(int32_t lEventFd, volatile uint32_t* pWaiting, uint32_t ulTimeOut,
+                           uint32_t ulStartTime, bool bConsumer)
+{
+    int32_t lWaitTime = -1;
+    if (MEDIA_QUEUE_WAIT_INFINITE != ulTimeOut)
+    {
+        uint32_t ulPassTime = as_get_cur_msecond() - ulStartTime;
+        if (ulPassTime >= ulTimeOut)
         {
-            continue;
+            return false;
         }
+        lWaitTime = (int32_t)(ulTimeOut - ulPassTime);
+    }
+    if ((!bConsumer) && ((-1 == lWaitTime) || (MEDIA_QUEUE_PRODUCER_WAIT_SLICE < lWaitTime)))
+    {
+        lWaitTime = MEDIA_QUEUE_PRODUCER_WAIT_SLICE;
+    }
 
-        if (compare_and_swap2(&m_ReadIndex, unTailIndex, unTag, (unTailIndex + 1) % m_unArraySize, unTag + 1))
-        {
-            bFlag = true;
-            break;
-        }
+    __atomic_store_n(pWaiting, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
 
+    /* check again after announce the waiting,the other side may have just
+       changed the queue before it could see us */
+    bool bReady = false;
+    if (bConsumer)
+    {
+        QUEUE_SLOT* pSlot = &m_pSlotArray[m_ullHead & m_ullMask];
+        bReady = (__atomic_load_n(&pSlot->ullSeq, __ATOMIC_ACQUIRE) == m_ullHead + 1);
+    }
+    else
+    {
+        bReady = !full();
+    }
+    if (bReady || (0 == __atomic_load_n(&m_ActiveFlag, __ATOMIC_ACQUIRE)))
+    {
+        __atomic_store_n(pWaiting, 0, __ATOMIC_RELAXED);
+        return true;
     }
 
-    if (bFlag)
+    struct pollfd stPollFd;
+    stPollFd.fd      = lEventFd;
+    stPollFd.events  = POLLIN;
+    stPollFd.revents = 0;
+    if (0 < ::poll(&stPollFd, 1, lWaitTime))
     {
-        mb = m_pDataArray[unTailIndex];
-        m_pDataArray[unTailIndex] = 0;
-        atomic_dec(&m_QueueSize);
+        uint64_t ullValue = 0;
+        (void)::read(lEventFd, &ullValue, sizeof(ullValue));
+    }
+    return true;
+}
+
 
-        return RET_OK;
+void CMediaDataQueue::notify(int32_t lEventFd, volatile uint32_t* pWaiting)
+{
+    /* only the empty to non-empty (or full to non-full) change with a parked
+       waiter costs a syscall */
+    if (0 == __atomic_load_n(pWaiting, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+    if (0 == __atomic_exchange_n(pWaiting, 0, __ATOMIC_SEQ_CST))
+    {
+        return;
     }
 
-    return RET_FAIL;
+    uint64_t ullValue = 1;
+    (void)::write(lEventFd, &ullValue, sizeof(ullValue));
+    (void)__atomic_fetch_add(&m_ullWakeupCount, 1, __ATOMIC_RELAXED);
 }
 
+
+void CMediaDataQueue::update_high_water(uint64_t ullTail)
+{
+    uint64_t ullHead = __atomic_load_n(&m_ullHead, __ATOMIC_ACQUIRE);
+    if (ullTail <= ullHead)
+    {
+        return;
+    }
+
+    uint32_t ulCount = (uint32_t)(ullTail - ullHead);
+    uint32_t ulMark  = __atomic_load_n(&m_ulHighWaterMark, __ATOMIC_RELAXED);
+    while (ulCount > ulMark)
+    {
+        if (__atomic_compare_exchange_n(&m_ulHighWaterMark, &ulMark, ulCount,
+                                        true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+    }
+}
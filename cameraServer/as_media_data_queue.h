@@ -1,14 +1,34 @@
 #ifndef __CMEDIADATAQUEUE_H__
 #define __CMEDIADATAQUEUE_H__
 
-#include "as_atomic.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+extern "C"{
+#include "as_mutex.h"
+}
 
+class CMediaBlockPool;
+struct tagMEDIA_BLOCK_CLASS;
+struct tagMEDIA_BLOCK_USAGE;
+
+/*
+ * the data block is reference counted like ACE_Message_Block,duplicate()
+ * share the same buffer and release() give it back to the pool when the
+ * last reference is gone.a block made by new is deleted on the last release().
+ */
 class CMediaDataBlock
 {
+    friend class CMediaBlockPool;
 public:
     CMediaDataBlock();
     CMediaDataBlock(size_t ulSize);
     virtual ~CMediaDataBlock();
+    CMediaDataBlock *duplicate (void);
+    CMediaDataBlock *release (void);
+    int32_t reference_count (void) const;
+    /* rd_ptr and wr_ptr back to the base */
+    void reset (void);
     char *base (void) const;
     char *end (void) const;
     char *rd_ptr (void) const;
@@ -35,8 +55,126 @@ private:
     size_t        m_ulSize;
     char         *m_rd_ptr;
     char         *m_wr_ptr;
+
+    volatile int32_t              m_lRefCount;
+    bool                          m_bFromPool;
+    struct tagMEDIA_BLOCK_CLASS  *m_pClass;     /* NULL if over size */
+    struct tagMEDIA_BLOCK_USAGE  *m_pUsage;
+    CMediaDataBlock              *m_pNext;      /* link of the free list */
 };
 
+#define MEDIA_BLOCK_SIZE_SMALL         (2*1024)
+#define MEDIA_BLOCK_SIZE_MIDDLE        (64*1024)
+#define MEDIA_BLOCK_SIZE_LARGE         (512*1024)
+
+#define MEDIA_BLOCK_FREE_SMALL         4096   /* max free blocks keep in the pool */
+#define MEDIA_BLOCK_FREE_MIDDLE        512
+#define MEDIA_BLOCK_FREE_LARGE         64
+
+enum MEDIA_BLOCK_CLASS_TYPE
+{
+    MEDIA_BLOCK_CLASS_SMALL    = 0,
+    MEDIA_BLOCK_CLASS_MIDDLE   = 1,
+    MEDIA_BLOCK_CLASS_LARGE    = 2,
+    MEDIA_BLOCK_CLASS_MAX
+};
+
+typedef struct tagMEDIA_BLOCK_CLASS
+{
+    size_t              ulBlockSize;
+    uint32_t            ulMaxFree;
+    as_mutex_t         *pMutex;
+    CMediaDataBlock    *pFreeList;
+    uint32_t            ulFreeCount;
+    volatile uint32_t   ulTotalCount;    /* blocks alive,free and in use */
+    volatile uint32_t   ulInUseCount;
+    volatile uint64_t   ullAllocCount;
+    volatile uint64_t   ullMissCount;    /* alloc not served by the free list */
+}MEDIA_BLOCK_CLASS;
+
+/* the occupancy of one owner(camera),alive until the owner and all its blocks are released */
+typedef struct tagMEDIA_BLOCK_USAGE
+{
+    uint64_t            ullOwnerID;
+    volatile int32_t    lRefCount;       /* the owner and every block in use */
+    volatile uint32_t   ulBlockCount;
+    volatile uint64_t   ullBytes;        /* buffer size of the blocks in use */
+}MEDIA_BLOCK_USAGE;
+
+typedef struct tagMEDIA_BLOCK_CLASS_STAT
+{
+    size_t              ulBlockSize;
+    uint32_t            ulTotalCount;
+    uint32_t            ulInUseCount;
+    uint32_t            ulFreeCount;
+    uint64_t            ullAllocCount;
+    uint64_t            ullMissCount;
+}MEDIA_BLOCK_CLASS_STAT;
+
+typedef struct tagMEDIA_BLOCK_POOL_STAT
+{
+    MEDIA_BLOCK_CLASS_STAT  stClass[MEDIA_BLOCK_CLASS_MAX];
+    uint32_t                ulOverSizeInUse; /* blocks larger than the large class */
+    uint64_t                ullOverSizeBytes;
+}MEDIA_BLOCK_POOL_STAT;
+
+class CMediaBlockPool
+{
+public:
+    static CMediaBlockPool& instance()
+    {
+        static CMediaBlockPool objCMediaBlockPool;
+        return objCMediaBlockPool;
+    }
+    virtual ~CMediaBlockPool();
+public:
+    int32_t  open();
+    void     close();
+    /* the block can hold ulSize bytes,it has one reference */
+    CMediaDataBlock* alloc(size_t ulSize, MEDIA_BLOCK_USAGE* pUsage = NULL);
+
+    /* create the occupancy counter for one owner */
+    MEDIA_BLOCK_USAGE* create_usage(uint64_t ullOwnerID);
+    void     release_usage(MEDIA_BLOCK_USAGE* pUsage);
+    int32_t  get_usage(uint64_t ullOwnerID, uint32_t& ulBlockCount, uint64_t& ullBytes);
+
+    void     get_stat(MEDIA_BLOCK_POOL_STAT& stat);
+protected:
+    CMediaBlockPool();
+private:
+    friend class CMediaDataBlock;
+    void     free(CMediaDataBlock* mb);
+    void     dec_usage(MEDIA_BLOCK_USAGE* pUsage);
+private:
+    MEDIA_BLOCK_CLASS   m_Class[MEDIA_BLOCK_CLASS_MAX];
+    volatile uint32_t   m_ulOverSizeInUse;
+    volatile uint64_t   m_ullOverSizeBytes;
+
+    typedef std::map<uint64_t, MEDIA_BLOCK_USAGE*> USAGEMAP;
+    USAGEMAP            m_UsageMap;
+    as_mutex_t         *m_pUsageMutex;
+};
+
+#define MEDIA_QUEUE_CACHE_LINE_SIZE    64
+#define MEDIA_QUEUE_WAIT_INFINITE      0xFFFFFFFF
+
+typedef struct tagMEDIA_QUEUE_STAT
+{
+    uint64_t    ullEnqueueCount;     /* blocks enqueued */
+    uint64_t    ullDequeueCount;     /* blocks dequeued */
+    uint64_t    ullFullCount;        /* enqueue found the queue full */
+    uint64_t    ullWakeupCount;      /* consumer wakeups by the producers */
+    uint32_t    ulHighWaterMark;     /* max message count ever seen */
+    uint32_t    ulQueueSize;
+}MEDIA_QUEUE_STAT;
+
+/*
+ * bounded multi-producer/single-consumer ring of CMediaDataBlock.
+ * producers claim slots with a CAS on the tail,every slot carries a sequence
+ * so the single consumer never writes a shared index.the consumer parks on
+ * an eventfd and is only woken when it is parked,so a busy queue costs no
+ * syscall.
+ */
 class CMediaDataQueue
 {
 public:
@@ -44,6 +182,7 @@ public:
 
     virtual ~CMediaDataQueue();
 
+    /* the size is rounded up to the power of 2 */
     int32_t init(uint32_t unQueueSize);
 
     void close();
@@ -54,21 +193,59 @@ public:
 
     bool full() const;
 
-    int32_t enqueue_tail(CMediaDataBlock* mb, const ACE_Time_Value *timeout = NULL);
+    /* ulTimeOut is in milliseconds, 0 means no wait,
+       MEDIA_QUEUE_WAIT_INFINITE means wait until success or close() */
+    int32_t enqueue_tail(CMediaDataBlock* mb, uint32_t ulTimeOut = MEDIA_QUEUE_WAIT_INFINITE);
+
+    int32_t dequeue_head(CMediaDataBlock*& mb, uint32_t ulTimeOut = MEDIA_QUEUE_WAIT_INFINITE);
+
+    /* all or none of the blocks are enqueued,the batch must not exceed the queue size */
+    int32_t enqueue_batch(CMediaDataBlock** mbArray, uint32_t ulCount,
+                          uint32_t ulTimeOut = MEDIA_QUEUE_WAIT_INFINITE);
+
+    /* return the count of the blocks dequeued,0 on timeout or close() */
+    uint32_t dequeue_batch(CMediaDataBlock** mbArray, uint32_t ulMaxCount,
+                           uint32_t ulTimeOut = MEDIA_QUEUE_WAIT_INFINITE);
+
+    void get_stat(MEDIA_QUEUE_STAT& stat) const;
+private:
+    typedef struct tagQUEUE_SLOT
+    {
+        uint64_t          ullSeq;
+        CMediaDataBlock*  mb;
+    }QUEUE_SLOT;
 
-    int32_t dequeue_head(CMediaDataBlock*& mb, const ACE_Time_Value *timeout = NULL);
+    int32_t  claim(uint32_t ulCount, uint64_t& ullPos, uint32_t ulTimeOut);
+    void     publish(uint64_t ullPos, CMediaDataBlock** mbArray, uint32_t ulCount);
+    uint32_t take(CMediaDataBlock** mbArray, uint32_t ulMaxCount);
+    bool     wait(int32_t lEventFd, volatile uint32_t* pWaiting, uint32_t ulTimeOut,
+                  uint32_t ulStartTime, bool bConsumer);
+    void     notify(int32_t lEventFd, volatile uint32_t* pWaiting);
+    void     update_high_water(uint64_t ullTail);
 private:
-    volatile uint32_t      m_WriteIndex;
-    volatile uint32_t      m_WriteTag;
-    volatile uint32_t      m_ReadIndex;
-    volatile uint32_t      m_ReadTag;
+    /* producer side */
+    volatile uint64_t      m_ullTail;
+    char                   m_pad0[MEDIA_QUEUE_CACHE_LINE_SIZE - sizeof(uint64_t)];
+    /* consumer side */
+    volatile uint64_t      m_ullHead;
+    char                   m_pad1[MEDIA_QUEUE_CACHE_LINE_SIZE - sizeof(uint64_t)];
+    volatile uint32_t      m_ulConsumerWaiting;
+    volatile uint32_t      m_ulProducerWaiting;
+    char                   m_pad2[MEDIA_QUEUE_CACHE_LINE_SIZE - 2 * sizeof(uint32_t)];
 
     volatile int32_t       m_ActiveFlag;
-    uint32_t               m_unMaxQueueSize;
     uint32_t               m_unArraySize;
+    uint64_t               m_ullMask;
+    QUEUE_SLOT*            m_pSlotArray;
+    int32_t                m_lConsumerFd;
+    int32_t                m_lProducerFd;
 
-    volatile uint32_t      m_QueueSize;
-    CMediaDataBlock**      m_pDataArray;
+    /* statistics,updated with relaxed atomics */
+    volatile uint64_t      m_ullEnqueueCount;
+    volatile uint64_t      m_ullDequeueCount;
+    volatile uint64_t      m_ullFullCount;
+    volatile uint64_t      m_ullWakeupCount;
+    volatile uint32_t      m_ulHighWaterMark;
 };
 
 #endif // __CMEDIADATAQUEUE_H__
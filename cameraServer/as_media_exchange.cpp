@@ -5,6 +5,7 @@
 #include "as_ini_config.h"
 #include "as_timer.h"
 #include "as_mem.h"
+#include "as_env_pool.h"
 
 ASMediaSession::ASMediaSession()
 {
@@ -30,18 +31,179 @@ int32_t ASMediaSession::decReference()
 }
 
 
+CMediaDataBlock* as_alloc_media_data_block(uint64_t ullRecvID, uint32_t ulDataSize,
+                                           MEDIA_BLOCK_USAGE* pUsage)
+{
+    CMediaDataBlock* mb = CMediaBlockPool::instance().alloc(
+                              offsetof(MEDIA_DATA_BLOCK, szData) + ulDataSize, pUsage);
+    if(NULL == mb) {
+        return NULL;
+    }
+    MEDIA_DATA_BLOCK* pData = (MEDIA_DATA_BLOCK*)(void*)mb->wr_ptr();
+    pData->enType           = AS_MEDIA_DATA_TYPE_DATA;
+    pData->ullRecvID        = ullRecvID;
+    pData->value.ulSize     = ulDataSize;
+    mb->wr_ptr(offsetof(MEDIA_DATA_BLOCK, szData));
+    return mb;
+}
+
+
+ASMediaRecvSink* ASMediaRecvSink::createNew(UsageEnvironment& env, uint64_t ullRecvID,
+                                            uint32_t ulMaxFrameSize)
+{
+    return new ASMediaRecvSink(env, ullRecvID, ulMaxFrameSize);
+}
+
+ASMediaRecvSink::ASMediaRecvSink(UsageEnvironment& env, uint64_t ullRecvID, uint32_t ulMaxFrameSize)
+  : MediaSink(env)
+{
+    m_ullRecvID      = ullRecvID;
+    m_ulMaxFrameSize = ulMaxFrameSize;
+    m_pRecvBlock     = NULL;
+    m_RetryTask      = NULL;
+    m_pUsage         = CMediaBlockPool::instance().create_usage(ullRecvID);
+}
+
+ASMediaRecvSink::~ASMediaRecvSink()
+{
+    envir().taskScheduler().unscheduleDelayedTask(m_RetryTask);
+    if(NULL != m_pRecvBlock) {
+        (void)m_pRecvBlock->release();
+        m_pRecvBlock = NULL;
+    }
+    /* the blocks still in the exchange keep the usage until they are released */
+    CMediaBlockPool::instance().release_usage(m_pUsage);
+    m_pUsage = NULL;
+}
+
+void ASMediaRecvSink::afterGettingFrame(void* clientData, unsigned frameSize,
+                                        unsigned numTruncatedBytes,
+                                        struct timeval /*presentationTime*/,
+                                        unsigned /*durationInMicroseconds*/)
+{
+    ASMediaRecvSink* sink = (ASMediaRecvSink*)clientData;
+    sink->afterGettingFrame(frameSize, numTruncatedBytes);
+}
+
+void ASMediaRecvSink::afterGettingFrame(unsigned frameSize, unsigned numTruncatedBytes)
+{
+    if(0 < numTruncatedBytes) {
+        AS_LOG(AS_LOG_WARNING,"ASMediaRecvSink::afterGettingFrame,recv:[%lld] frame truncated:[%u].",
+                              m_ullRecvID, numTruncatedBytes);
+    }
+
+    as_env_pool::add_frame(frameSize);
+
+    /* the frame is already in the block,just close it and hand it over */
+    CMediaDataBlock* mb = m_pRecvBlock;
+    m_pRecvBlock = NULL;
+    as_media_data_block(mb)->value.ulSize = frameSize;
+    mb->wr_ptr(frameSize);
+    if(AS_ERROR_CODE_OK != ASMediaExchangeSvr::instance().addData(mb)) {
+        (void)mb->release();
+    }
+
+    continuePlaying();
+}
+
+void ASMediaRecvSink::retryGettingFrame(void* clientData)
+{
+    ASMediaRecvSink* sink = (ASMediaRecvSink*)clientData;
+    sink->m_RetryTask = NULL;
+    sink->continuePlaying();
+}
+
+Boolean ASMediaRecvSink::continuePlaying()
+{
+    envir().taskScheduler().unscheduleDelayedTask(m_RetryTask);
+    if(NULL == fSource) {
+        return False;
+    }
+    if(NULL == m_pRecvBlock) {
+        m_pRecvBlock = as_alloc_media_data_block(m_ullRecvID, m_ulMaxFrameSize, m_pUsage);
+        if(NULL == m_pRecvBlock) {
+            /* the source keeps its data until we ask again */
+            AS_LOG(AS_LOG_WARNING,"ASMediaRecvSink::continuePlaying,recv:[%lld] alloc block fail.",m_ullRecvID);
+            m_RetryTask = envir().taskScheduler().scheduleDelayedTask(AS_RECV_ALLOC_RETRY_TIME*1000,
+                                                                      retryGettingFrame, this);
+            return True;
+        }
+    }
+    fSource->getNextFrame((unsigned char*)m_pRecvBlock->wr_ptr(), m_ulMaxFrameSize,
+                          afterGettingFrame, this, onSourceClosure, this);
+    return True;
+}
+
+
+ASSessionFactory::ASSessionFactory()
+{
+}
+ASSessionFactory::~ASSessionFactory()
+{
+}
+
+
 ASExchange::ASExchange()
 {
 }
 ASExchange::~ASExchange()
 {
+    ASMediaSession* pSession = NULL;
+    SENDSESSSIONLIST::iterator iter = m_SendSessionList.begin();
+    for(;iter != m_SendSessionList.end();++iter) {
+        pSession = *iter;
+        ASMediaExchangeSvr::instance().releaseSession(pSession);
+    }
+    m_SendSessionList.clear();
 }
 int32_t ASExchange::addSendSession(uint64_t ullSessionID)
 {
+    SENDSESSSIONLIST::iterator iter = m_SendSessionList.begin();
+    for(;iter != m_SendSessionList.end();++iter) {
+        if(ullSessionID == (*iter)->getSessionID()) {
+            return AS_ERROR_CODE_OK;
+        }
+    }
+
+    /* hold the reference of the send session until it is removed */
+    ASMediaSession* pSession = ASMediaExchangeSvr::instance().findSession(ullSessionID);
+    if(NULL == pSession) {
+        AS_LOG(AS_LOG_WARNING,"ASExchange::addSendSession,find session:[%lld] fail.",ullSessionID);
+        return AS_ERROR_CODE_FAIL;
+    }
+    m_SendSessionList.push_back(pSession);
     return AS_ERROR_CODE_OK;
 }
-int32_t ASExchange::sendMediaData(MEDIA_DATA_BLOCK **pMbArray, uint32_t MsgCount)
+int32_t ASExchange::delSendSession(uint64_t ullSessionID)
 {
+    ASMediaSession* pSession = NULL;
+    SENDSESSSIONLIST::iterator iter = m_SendSessionList.begin();
+    for(;iter != m_SendSessionList.end();++iter) {
+        pSession = *iter;
+        if(ullSessionID != pSession->getSessionID()) {
+            continue;
+        }
+        m_SendSessionList.erase(iter);
+        ASMediaExchangeSvr::instance().releaseSession(pSession);
+        return AS_ERROR_CODE_OK;
+    }
+    return AS_ERROR_CODE_FAIL;
+}
+uint32_t ASExchange::sendSessionCount()
+{
+    return (uint32_t)m_SendSessionList.size();
+}
+int32_t ASExchange::sendMediaData(CMediaDataBlock **pMbArray, uint32_t MsgCount)
+{
+    ASMediaSession* pSession = NULL;
+    SENDSESSSIONLIST::iterator iter = m_SendSessionList.begin();
+    for(;iter != m_SendSessionList.end();++iter) {
+        pSession = *iter;
+        if(AS_ERROR_CODE_OK != pSession->sendMediaData(pMbArray,MsgCount)) {
+            AS_LOG(AS_LOG_DEBUG,"ASExchange::sendMediaData,session:[%lld] send fail.",
+                                pSession->getSessionID());
+        }
+    }
     return AS_ERROR_CODE_OK;
 }
 
@@ -59,6 +221,7 @@ ASMediaExchangeSvr::ASMediaExchangeSvr()
     m_ThreadDealCount    = NULL;
     m_ulThreadCount      = 0;
     m_pDataExchangeQueue = NULL;
+    m_ullDropCount       = 0;
 }
 
 ASMediaExchangeSvr::~ASMediaExchangeSvr()
@@ -67,7 +230,24 @@ ASMediaExchangeSvr::~ASMediaExchangeSvr()
 int32_t   ASMediaExchangeSvr::open(uint32_t ulThreadCount)
 {
     AS_LOG(AS_LOG_DEBUG,"ASMediaExchangeSvr::open,begin.");
+    if(0 == ulThreadCount) {
+        AS_LOG(AS_LOG_CRITICAL,"ASMediaExchangeSvr::open,the thread count is zero.");
+        return AS_ERROR_CODE_PARAM;
+    }
     m_ulThreadCount = ulThreadCount;
+    m_ulTdIndex     = 0;
+
+    /* every fail below goes through close(),which release what is created so far */
+    int32_t nRet = open_exchange();
+    if(AS_ERROR_CODE_OK != nRet) {
+        close();
+        return nRet;
+    }
+    AS_LOG(AS_LOG_DEBUG,"ASMediaExchangeSvr::open,end.");
+    return AS_ERROR_CODE_OK;
+}
+int32_t   ASMediaExchangeSvr::open_exchange()
+{
     m_mutex = as_create_mutex();
     if(NULL == m_mutex) {
         AS_LOG(AS_LOG_CRITICAL,"ASMediaExchangeSvr::open,create the mutex fail.");
@@ -79,12 +259,20 @@ int32_t   ASMediaExchangeSvr::open(uint32_t ulThreadCount)
         return AS_ERROR_CODE_FAIL;
     }
 
+    if(AS_ERROR_CODE_OK != CMediaBlockPool::instance().open()) {
+        AS_LOG(AS_LOG_CRITICAL,"ASMediaExchangeSvr::open,open the block pool fail.");
+        return AS_ERROR_CODE_FAIL;
+    }
+
+    uint32_t i = 0;
     m_ExchangMapArray = AS_NEW(m_ExchangMapArray,m_ulThreadCount);
     if(NULL == m_ExchangMapArray) {
         AS_LOG(AS_LOG_CRITICAL,"ASMediaExchangeSvr::open,create exchange map array fail.");
         return AS_ERROR_CODE_FAIL;
     }
-    uint32_t i = 0;
+    for(i = 0;i < m_ulThreadCount;i++) {
+        m_ExchangMapArray[i] = NULL;
+    }
     EXCHANGEMAP* pMap = NULL;
     for(i = 0;i < m_ulThreadCount;i++) {
         pMap = AS_NEW(pMap);
@@ -96,10 +284,13 @@ int32_t   ASMediaExchangeSvr::open(uint32_t ulThreadCount)
     }
 
     m_pDataExchangeQueue = AS_NEW(m_pDataExchangeQueue,m_ulThreadCount);
-    if(NULL == m_ThreadDealCount) {
+    if(NULL == m_pDataExchangeQueue) {
         AS_LOG(AS_LOG_CRITICAL,"ASMediaExchangeSvr::open,create queue array fail.");
         return AS_ERROR_CODE_FAIL;
     }
+    for(i = 0;i < m_ulThreadCount;i++) {
+        m_pDataExchangeQueue[i] = NULL;
+    }
     CMediaDataQueue* pQueue = NULL;
     for(i = 0;i < m_ulThreadCount;i++) {
         pQueue = AS_NEW(pQueue);
@@ -108,6 +299,10 @@ int32_t   ASMediaExchangeSvr::open(uint32_t ulThreadCount)
             return AS_ERROR_CODE_FAIL;
         }
         m_pDataExchangeQueue[i] = pQueue;
+        if(AS_ERROR_CODE_OK != pQueue->init(AS_EXCHANGE_QUEUE_SIZE)) {
+            AS_LOG(AS_LOG_CRITICAL,"ASMediaExchangeSvr::open,init queue[%d] fail.",i);
+            return AS_ERROR_CODE_FAIL;
+        }
     }
 
     m_ThreadDealCount = AS_NEW(m_ThreadDealCount,m_ulThreadCount);
@@ -120,6 +315,10 @@ int32_t   ASMediaExchangeSvr::open(uint32_t ulThreadCount)
         AS_LOG(AS_LOG_CRITICAL,"ASMediaExchangeSvr::open,create thread handle array fail.");
         return AS_ERROR_CODE_FAIL;
     }
+    for(i = 0;i < m_ulThreadCount;i++) {
+        m_ThreadDealCount[i]   = 0;
+        m_ThreadHandleArray[i] = NULL;
+    }
     m_bRunning = true;
     /* start the deal thread */
     for(i = 0;i < m_ulThreadCount;i++) {
@@ -128,17 +327,68 @@ int32_t   ASMediaExchangeSvr::open(uint32_t ulThreadCount)
             AS_LOG(AS_LOG_ERROR,"ASMediaExchangeSvr::open,create the exchaneg thread fail.");
             return AS_ERROR_CODE_FAIL;
         }
-        m_ThreadDealCount[i] = 0;
     }
-    AS_LOG(AS_LOG_DEBUG,"ASMediaExchangeSvr::open,end.");
     return AS_ERROR_CODE_OK;
 }
 void      ASMediaExchangeSvr::close()
 {
+    AS_LOG(AS_LOG_DEBUG,"ASMediaExchangeSvr::close,begin.");
+    /* the exchange threads wake up at least every AS_EXCHANGE_WAIT_TIME */
     m_bRunning = false;
+    uint32_t i = 0;
+    if(NULL != m_ThreadHandleArray) {
+        for(i = 0;i < m_ulThreadCount;i++) {
+            if(NULL != m_ThreadHandleArray[i]) {
+                (void)as_join_thread(m_ThreadHandleArray[i]);
+                m_ThreadHandleArray[i] = NULL;
+            }
+        }
+        AS_DELETE(m_ThreadHandleArray,MULTI);
+    }
+
+    /* the exchange threads are gone,release the remain data and exchanges */
+    CMediaDataBlock* mb = NULL;
+    if(NULL != m_pDataExchangeQueue) {
+        for(i = 0;i < m_ulThreadCount;i++) {
+            if(NULL == m_pDataExchangeQueue[i]) {
+                continue;
+            }
+            while(AS_ERROR_CODE_OK == m_pDataExchangeQueue[i]->dequeue_head(mb,0)) {
+                (void)mb->release();
+            }
+            m_pDataExchangeQueue[i]->close();
+            AS_DELETE(m_pDataExchangeQueue[i]);
+        }
+        AS_DELETE(m_pDataExchangeQueue,MULTI);
+    }
+    if(NULL != m_ExchangMapArray) {
+        for(i = 0;i < m_ulThreadCount;i++) {
+            if(NULL == m_ExchangMapArray[i]) {
+                continue;
+            }
+            EXCHANGEMAP::iterator iter = m_ExchangMapArray[i]->begin();
+            for(;iter != m_ExchangMapArray[i]->end();++iter) {
+                AS_DELETE(iter->second);
+            }
+            AS_DELETE(m_ExchangMapArray[i]);
+        }
+        AS_DELETE(m_ExchangMapArray,MULTI);
+    }
+    AS_DELETE(m_ThreadDealCount,MULTI);
+    CMediaBlockPool::instance().close();
+
+    if(NULL != m_sessionMutex) {
+        as_destroy_mutex(m_sessionMutex);
+        m_sessionMutex = NULL;
+    }
+    if(NULL != m_mutex) {
+        as_destroy_mutex(m_mutex);
+        m_mutex = NULL;
+    }
+    AS_LOG(AS_LOG_DEBUG,"ASMediaExchangeSvr::close,end.");
     return;
 }
-int32_t   ASMediaExchangeSvr::regFactory(const ASSessionFactory* factory)
+int32_t   ASMediaExchangeSvr::regFactory(ASSessionFactory* factory)
 {
     as_lock_guard locker(m_sessionMutex);
     m_factMap.insert(FACTORYMAP::value_type(factory->getSessionType(),factory));
@@ -160,9 +410,10 @@ ASMediaSession* ASMediaExchangeSvr::createSession(uint32_t ulType)
         AS_LOG(AS_LOG_DEBUG,"ASMediaExchangeSvr::createSession,create session fail,type:[%d].",ulType);
         return NULL;
     }
+    pSession->m_ulSessionType = ulType;
     pSession->setSessionID(m_ullSessionIdx++);
     m_sessionMap.insert(SESSIONMAP::value_type(pSession->getSessionID(),pSession));
-    return NULL;
+    return pSession;
 }
 ASMediaSession* ASMediaExchangeSvr::findSession(uint64_t ullSessionID)
 {
@@ -209,29 +460,72 @@ void ASMediaExchangeSvr::releaseSession(uint64_t ullSessionID)
     m_sessionMap.erase(iter);
 
     ASSessionFactory* factory = NULL;
-    FACTORYMAP::iterator iter = m_factMap.find(pSession->getSessionType());
-    if(iter == m_factMap.end()) {
+    FACTORYMAP::iterator factIter = m_factMap.find(pSession->getSessionType());
+    if(factIter == m_factMap.end()) {
         AS_LOG(AS_LOG_DEBUG,"ASMediaExchangeSvr::releaseSession,not find the factory,type:[%d].",pSession->getSessionType());
         AS_DELETE(pSession);
         return ;
     }
-    factory = iter->second;
-    pSession = factory->destorySession(pSession);
+    factory = factIter->second;
+    factory->destorySession(pSession);
 
     return;
 }
 
-int32_t   ASMediaExchangeSvr::addData(MEDIA_DATA_BLOCK* pBlock)
+int32_t   ASMediaExchangeSvr::addData(CMediaDataBlock* pBlock)
 {
-    return AS_ERROR_CODE_OK;
+    if((NULL == pBlock) || (offsetof(MEDIA_DATA_BLOCK, szData) > pBlock->length())) {
+        return AS_ERROR_CODE_PARAM;
+    }
+    if(!m_bRunning) {
+        return AS_ERROR_CODE_FAIL;
+    }
+    MEDIA_DATA_BLOCK* pData = as_media_data_block(pBlock);
+    uint32_t ulIndex = exchange_index(pData->ullRecvID);
+
+    /* all the block of one recv session go to the same thread,keep the order.
+       the caller is the env loop of the stream,it never waits for a full queue
+       (that would stall every stream of the env),the frame is dropped instead */
+    int32_t nRet = m_pDataExchangeQueue[ulIndex]->enqueue_tail(pBlock,0);
+    if(AS_ERROR_CODE_TIMEOUT == nRet) {
+        uint64_t ullDrop = __atomic_add_fetch(&m_ullDropCount, 1, __ATOMIC_RELAXED);
+        if(1 == (ullDrop % AS_EXCHANGE_DROP_LOG_INTERVAL)) {
+            AS_LOG(AS_LOG_WARNING,"ASMediaExchangeSvr::addData,exchange queue:[%u] full,"
+                                  "recv:[%lld] frame dropped,total dropped:[%llu].",
+                                  ulIndex, pData->ullRecvID, ullDrop);
+        }
+    }
+    return nRet;
 }
 int32_t   ASMediaExchangeSvr::regExChanger(uint64_t ullRecvID,uint64_t ullSendID)
 {
-    return AS_ERROR_CODE_OK;
+    return addCtrlData(AS_MEDIA_DATA_TYPE_ADD,ullRecvID,ullSendID);
 }
 int32_t   ASMediaExchangeSvr::unRegExChanger(uint64_t ullRecvID,uint64_t ullSendID)
 {
-    return AS_ERROR_CODE_OK;
+    return addCtrlData(AS_MEDIA_DATA_TYPE_DEL,ullRecvID,ullSendID);
+}
+int32_t   ASMediaExchangeSvr::addCtrlData(MEDIA_DATA_TYPE enType,uint64_t ullRecvID,uint64_t ullSendID)
+{
+    /* the exchange map is owned by the exchange thread,so the register
+       goes through the same queue as the media data */
+    CMediaDataBlock* mb = CMediaBlockPool::instance().alloc(sizeof(MEDIA_DATA_BLOCK));
+    if(NULL == mb) {
+        return AS_ERROR_CODE_MEM;
+    }
+    MEDIA_DATA_BLOCK* pData = (MEDIA_DATA_BLOCK*)(void*)mb->wr_ptr();
+    pData->enType          = enType;
+    pData->ullRecvID       = ullRecvID;
+    pData->value.ullSendID = ullSendID;
+    mb->wr_ptr(sizeof(MEDIA_DATA_BLOCK));
+
+    int32_t nRet = addData(mb);
+    if(AS_ERROR_CODE_OK != nRet) {
+        AS_LOG(AS_LOG_WARNING,"ASMediaExchangeSvr::addCtrlData,type:[%d] recv:[%lld] send:[%lld] fail.",
+                              enType,ullRecvID,ullSendID);
+        (void)mb->release();
+    }
+    return nRet;
 }
 void *ASMediaExchangeSvr::exchange_invoke(void *arg)
 {
@@ -246,19 +540,93 @@ void      ASMediaExchangeSvr::exchange_thread()
     AS_LOG(AS_LOG_DEBUG,"ASMediaExchangeSvr::exchange_thread,thread:[%d],begin.",ulThreadIndex);
 
     CMediaDataQueue* pQueue = m_pDataExchangeQueue[ulThreadIndex];
+    EXCHANGEMAP*     pMap   = m_ExchangMapArray[ulThreadIndex];
 
-    CMediaDataBlock* mb = NULL;
+    CMediaDataBlock*  mbArray[AS_EXCHANGE_BATCH_MAX];
+    MEDIA_DATA_BLOCK* pData   = NULL;
+    uint32_t          ulCount = 0;
+    uint32_t          ulStart = 0;
+    uint32_t          i       = 0;
 
     while(m_bRunning)
     {
-        (void)pQueue->dequeue_head(mb, &timeout);
-        if (NULL == mb)
+        /* one wakeup deal all the queued blocks,up to a batch */
+        ulCount = pQueue->dequeue_batch(mbArray,AS_EXCHANGE_BATCH_MAX,AS_EXCHANGE_WAIT_TIME);
+        if (0 == ulCount)
         {
             continue;
         }
+
+        /* the continuous data of one recv session is sent in one call,
+           the control data is dealed in order between them */
+        ulStart = 0;
+        for(i = 0;i < ulCount;i++) {
+            pData = as_media_data_block(mbArray[i]);
+            if(AS_MEDIA_DATA_TYPE_DATA == pData->enType) {
+                if((ulStart < i) && (as_media_data_block(mbArray[ulStart])->ullRecvID != pData->ullRecvID)) {
+                    dealMediaData(pMap,&mbArray[ulStart],i - ulStart);
+                    ulStart = i;
+                }
+                continue;
+            }
+            if(ulStart < i) {
+                dealMediaData(pMap,&mbArray[ulStart],i - ulStart);
+            }
+            dealCtrlData(pMap,pData);
+            ulStart = i + 1;
+        }
+        if(ulStart < ulCount) {
+            dealMediaData(pMap,&mbArray[ulStart],ulCount - ulStart);
+        }
+
+        /* the send sessions keep their own reference if they still need the data */
+        for(i = 0;i < ulCount;i++) {
+            (void)mbArray[i]->release();
+        }
+        m_ThreadDealCount[ulThreadIndex] += ulCount;
     }
     AS_LOG(AS_LOG_DEBUG,"ASMediaExchangeSvr::exchange_thread,thread:[%d],end.",ulThreadIndex);
     return;
 }
+void      ASMediaExchangeSvr::dealCtrlData(EXCHANGEMAP* pMap,MEDIA_DATA_BLOCK* pBlock)
+{
+    ASExchange* pExchange = NULL;
+    EXCHANGEMAP::iterator iter = pMap->find(pBlock->ullRecvID);
+    if(iter != pMap->end()) {
+        pExchange = iter->second;
+    }
 
+    if(AS_MEDIA_DATA_TYPE_ADD == pBlock->enType) {
+        if(NULL == pExchange) {
+            pExchange = AS_NEW(pExchange);
+            if(NULL == pExchange) {
+                AS_LOG(AS_LOG_WARNING,"ASMediaExchangeSvr::dealCtrlData,create exchange recv:[%lld] fail.",
+                                      pBlock->ullRecvID);
+                return;
+            }
+            pMap->insert(EXCHANGEMAP::value_type(pBlock->ullRecvID,pExchange));
+        }
+        (void)pExchange->addSendSession(pBlock->value.ullSendID);
+        return;
+    }
 
+    if(NULL == pExchange) {
+        return;
+    }
+    (void)pExchange->delSendSession(pBlock->value.ullSendID);
+    if(0 == pExchange->sendSessionCount()) {
+        pMap->erase(iter);
+        AS_DELETE(pExchange);
+    }
+    return;
+}
+void      ASMediaExchangeSvr::dealMediaData(EXCHANGEMAP* pMap,CMediaDataBlock **pMbArray, uint32_t MsgCount)
+{
+    EXCHANGEMAP::iterator iter = pMap->find(as_media_data_block(pMbArray[0])->ullRecvID);
+    if(iter == pMap->end()) {
+        /* no one is watching the recv session */
+        return;
+    }
+    (void)iter->second->sendMediaData(pMbArray,MsgCount);
+    return;
+}
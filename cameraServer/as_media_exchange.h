@@ -3,8 +3,21 @@
 
 #include <list>
 #include <map>
+#include "liveMedia.hh"
 #include "as_def.h"
 #include "as.h"
+#include "as_media_data_queue.h"
+
+#define AS_EXCHANGE_QUEUE_SIZE       4096   /* blocks per exchange thread */
+#define AS_EXCHANGE_BATCH_MAX        64     /* blocks drained per loop */
+#define AS_EXCHANGE_WAIT_TIME        100    /* ms */
+#define AS_EXCHANGE_DROP_LOG_INTERVAL 1000  /* log one of so many dropped frames */
+#ifndef AS_EXCHANGE_THREAD_DEFAULT
+#define AS_EXCHANGE_THREAD_DEFAULT   4
+#endif
+/* the frame is received straight into a large pool block,behind the header */
+#define AS_RECV_FRAME_SIZE_MAX       (MEDIA_BLOCK_SIZE_LARGE - offsetof(MEDIA_DATA_BLOCK, szData))
+#define AS_RECV_ALLOC_RETRY_TIME     10     /* ms */
 
 
 typedef enum AS_MEDIA_DATA_TYPE
@@ -16,6 +29,10 @@ typedef enum AS_MEDIA_DATA_TYPE
 }MEDIA_DATA_TYPE;
 
 
+/*
+ * the MEDIA_DATA_BLOCK header is carried at the rd_ptr() of a CMediaDataBlock,
+ * the frame data follows in szData.
+ */
 typedef struct tagMEDIA_DATA_BLOCK
 {
     MEDIA_DATA_TYPE    enType;
@@ -27,6 +44,16 @@ typedef struct tagMEDIA_DATA_BLOCK
     uint8_t            szData[1];
 }MEDIA_DATA_BLOCK;
 
+inline MEDIA_DATA_BLOCK* as_media_data_block(CMediaDataBlock* mb)
+{
+    return (MEDIA_DATA_BLOCK*)(void*)mb->rd_ptr();
+}
+
+/* the block for the media data of ulDataSize bytes,the header is filled and the
+   wr_ptr is at szData,so the receiver can write the frame into it directly */
+CMediaDataBlock* as_alloc_media_data_block(uint64_t ullRecvID, uint32_t ulDataSize,
+                                           MEDIA_BLOCK_USAGE* pUsage = NULL);
+
 
 class ASMediaSession
 {
@@ -41,7 +68,9 @@ public:
 
     virtual uint32_t getSessionType(){ return m_ulSessionType;};
 
-    virtual int32_t sendMediaData(MEDIA_DATA_BLOCK **pMbArray, uint32_t MsgCount) = 0;
+    /* the blocks are shared by all the send sessions and only valid during the call,
+       duplicate() the block to keep it and release() it when sent */
+    virtual int32_t sendMediaData(CMediaDataBlock **pMbArray, uint32_t MsgCount) = 0;
 protected:
     int32_t addReference();
     int32_t decReference();
@@ -51,6 +80,37 @@ protected:
     int32_t      m_ulRefCount;
 };
 
+/*
+ * the receiver of one camera stream,it runs in the env of the stream and hands
+ * every frame to the exchange in a block from the CMediaBlockPool.the frame is
+ * received straight into the block,behind the MEDIA_DATA_BLOCK header.
+ */
+class ASMediaRecvSink: public MediaSink
+{
+public:
+    static ASMediaRecvSink* createNew(UsageEnvironment& env, uint64_t ullRecvID,
+                                      uint32_t ulMaxFrameSize = AS_RECV_FRAME_SIZE_MAX);
+    uint64_t getRecvID(){return m_ullRecvID;};
+protected:
+    ASMediaRecvSink(UsageEnvironment& env, uint64_t ullRecvID, uint32_t ulMaxFrameSize);
+    virtual ~ASMediaRecvSink();
+private:
+    static void afterGettingFrame(void* clientData, unsigned frameSize,
+                                  unsigned numTruncatedBytes,
+                                  struct timeval presentationTime,
+                                  unsigned durationInMicroseconds);
+    void afterGettingFrame(unsigned frameSize, unsigned numTruncatedBytes);
+    static void retryGettingFrame(void* clientData);
+private: // redefined virtual functions:
+    virtual Boolean continuePlaying();
+private:
+    uint64_t           m_ullRecvID;
+    uint32_t           m_ulMaxFrameSize;
+    CMediaDataBlock   *m_pRecvBlock;   /* the block the next frame is received into */
+    TaskToken          m_RetryTask;
+    MEDIA_BLOCK_USAGE *m_pUsage;
+};
+
 class ASSessionFactory
 {
 public:
@@ -61,13 +121,16 @@ public:
     virtual uint32_t getSessionType() = 0;
 };
 
+/* the exchange of one recv session, only touched by its own exchange thread */
 class ASExchange
 {
 public:
     ASExchange();
     virtual ~ASExchange();
     int32_t addSendSession(uint64_t ullSessionID);
-    int32_t sendMediaData(MEDIA_DATA_BLOCK **pMbArray, uint32_t MsgCount);
+    int32_t delSendSession(uint64_t ullSessionID);
+    uint32_t sendSessionCount();
+    int32_t sendMediaData(CMediaDataBlock **pMbArray, uint32_t MsgCount);
 private:
     typedef std::list<ASMediaSession*>    SENDSESSSIONLIST;
     SENDSESSSIONLIST   m_SendSessionList;
@@ -75,6 +138,7 @@ private:
 
 class ASMediaExchangeSvr
 {
+    typedef std::map<uint64_t,ASExchange*>        EXCHANGEMAP;
 public:
     static ASMediaExchangeSvr& instance()
     {
@@ -85,21 +149,32 @@ public:
 public:
     int32_t   open(uint32_t ulThreadCount);
     void      close();
-    int32_t   regFactory(const ASSessionFactory* factory);
+    int32_t   regFactory(ASSessionFactory* factory);
     ASMediaSession* createSession(uint32_t ulType);
     ASMediaSession* findSession(uint64_t ullSessionID);
     void releaseSession(ASMediaSession* pSession);
     void releaseSession(uint64_t ullSessionID);
 public:
-    int32_t   addData(MEDIA_DATA_BLOCK* pBlock);
+    /* the exchange owns the reference after success,the caller release it on fail */
+    int32_t   addData(CMediaDataBlock* pBlock);
     int32_t   regExChanger(uint64_t ullRecvID,uint64_t ullSendID);
     int32_t   unRegExChanger(uint64_t ullRecvID,uint64_t ullSendID);
+    /* the frames dropped by addData() because the exchange queue was full */
+    uint64_t  getDropCount(){return __atomic_load_n(&m_ullDropCount, __ATOMIC_RELAXED);};
 public:
     void      exchange_thread();
 protected:
     ASMediaExchangeSvr();
 private:
     static void *exchange_invoke(void *arg);
+    uint32_t  exchange_index(uint64_t ullRecvID)
+    {
+        return (uint32_t)(ullRecvID % m_ulThreadCount);
+    }
+    int32_t   open_exchange();
+    int32_t   addCtrlData(MEDIA_DATA_TYPE enType,uint64_t ullRecvID,uint64_t ullSendID);
+    void      dealCtrlData(EXCHANGEMAP* pMap,MEDIA_DATA_BLOCK* pBlock);
+    void      dealMediaData(EXCHANGEMAP* pMap,CMediaDataBlock **pMbArray, uint32_t MsgCount);
     u_int32_t thread_index()
     {
         as_mutex_lock(m_mutex);
@@ -116,7 +191,6 @@ private:
     as_mutex_t       *m_sessionMutex;
     uint64_t          m_ullSessionIdx;
 private:
-    typedef std::map<uint64_t,ASExchange*>        EXCHANGEMAP;
     EXCHANGEMAP     **m_ExchangMapArray;
     u_int32_t         m_ulTdIndex;
     as_mutex_t       *m_mutex;
@@ -125,5 +199,6 @@ private:
     u_int32_t        *m_ThreadDealCount;
     CMediaDataQueue** m_pDataExchangeQueue;
     uint32_t          m_ulThreadCount;
+    uint64_t          m_ullDropCount;
 };
 #endif /* __AS_MEDIA_EXCHANGE_SERVER_H__ */
@@ -0,0 +1,127 @@
+/*
+ * micro benchmark of CMediaDataQueue:N producers feed one consumer,
+ * report the frames per second and the enqueue to dequeue latency.
+ * usage: bench_media_queue [frames per producer]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <algorithm>
+#include <vector>
+#include "../as_media_data_queue.h"
+extern "C"{
+#include "as_common.h"
+}
+
+#define BENCH_QUEUE_SIZE    4096
+#define BENCH_BATCH_SIZE    64
+
+static uint64_t bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+typedef struct tagBENCH_CTX
+{
+    CMediaDataQueue*  pQueue;
+    uint32_t          ulFrames;
+}BENCH_CTX;
+
+static void* bench_producer(void* arg)
+{
+    BENCH_CTX* pCtx = (BENCH_CTX*)arg;
+    CMediaDataBlock* mb = NULL;
+    for (uint32_t i = 0; i < pCtx->ulFrames; i++)
+    {
+        mb = new CMediaDataBlock(sizeof(uint64_t));
+        *(uint64_t*)(void*)mb->wr_ptr() = bench_now_ns();
+        mb->wr_ptr(sizeof(uint64_t));
+        if (AS_ERROR_CODE_OK != pCtx->pQueue->enqueue_tail(mb))
+        {
+            delete mb;
+        }
+    }
+    return NULL;
+}
+
+static void bench_run(uint32_t ulProducers, uint32_t ulFrames)
+{
+    CMediaDataQueue queue;
+    if (AS_ERROR_CODE_OK != queue.init(BENCH_QUEUE_SIZE))
+    {
+        printf("init the queue fail\n");
+        return;
+    }
+
+    uint64_t ullTotal = (uint64_t)ulProducers * ulFrames;
+    std::vector<uint64_t> latency;
+    latency.reserve(ullTotal);
+
+    BENCH_CTX ctx;
+    ctx.pQueue   = &queue;
+    ctx.ulFrames = ulFrames;
+
+    std::vector<pthread_t> threads(ulProducers);
+    uint64_t ullStart = bench_now_ns();
+    for (uint32_t i = 0; i < ulProducers; i++)
+    {
+        pthread_create(&threads[i], NULL, bench_producer, &ctx);
+    }
+
+    CMediaDataBlock* mbArray[BENCH_BATCH_SIZE];
+    uint64_t ullRecv = 0;
+    uint32_t ulCount = 0;
+    while (ullRecv < ullTotal)
+    {
+        ulCount = queue.dequeue_batch(mbArray, BENCH_BATCH_SIZE, 1000);
+        uint64_t ullNow = bench_now_ns();
+        for (uint32_t i = 0; i < ulCount; i++)
+        {
+            latency.push_back(ullNow - *(uint64_t*)(void*)mbArray[i]->rd_ptr());
+            delete mbArray[i];
+        }
+        ullRecv += ulCount;
+        if (0 == ulCount)
+        {
+            printf("dequeue timeout,recv:[%llu]\n", (unsigned long long)ullRecv);
+            break;
+        }
+    }
+    uint64_t ullCost = bench_now_ns() - ullStart;
+
+    for (uint32_t i = 0; i < ulProducers; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    std::sort(latency.begin(), latency.end());
+    uint64_t ullP50 = latency.empty() ? 0 : latency[latency.size() / 2];
+    uint64_t ullP99 = latency.empty() ? 0 : latency[latency.size() * 99 / 100];
+
+    MEDIA_QUEUE_STAT stat;
+    queue.get_stat(stat);
+    printf("producers:%2u frames/s:%10.0f p50:%7.2fus p99:%8.2fus high water:%5u full:%llu wakeup:%llu\n",
+           ulProducers, (double)ullRecv * 1e9 / (double)ullCost,
+           (double)ullP50 / 1000.0, (double)ullP99 / 1000.0, stat.ulHighWaterMark,
+           (unsigned long long)stat.ullFullCount, (unsigned long long)stat.ullWakeupCount);
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t ulFrames = 200000;
+    if (1 < argc)
+    {
+        ulFrames = (uint32_t)atoi(argv[1]);
+    }
+
+    uint32_t producers[] = {1, 2, 4, 8, 16};
+    for (uint32_t i = 0; i < sizeof(producers) / sizeof(producers[0]); i++)
+    {
+        bench_run(producers[i], ulFrames);
+    }
+    return 0;
+}
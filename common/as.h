@@ -21,5 +21,8 @@ extern "C"{
 #include "as_tinyxml2.h"
 #include "as_mem.h"
 #include "as_daemon.h"
+#include "as_env_pool.h"
+#include "as_rtp_packetizer.h"
+#include "as_rtp_port_pool.h"
 using namespace tinyxml2;
 #endif
\ No newline at end of file
@@ -17,7 +17,10 @@
 
 #ifndef WIN32
 #include <sys/epoll.h>
+#include <sys/uio.h>
 #include <netinet/tcp.h>
+#include <poll.h>
+#include <time.h>
 #endif
 
 #include "as_conn_manage.h"
@@ -33,6 +36,94 @@ IConnMgrLog *g_pConnMgrLog = NULL;
 //ļк
 #define _FL_ __FILE__, __LINE__
 
+#if AS_APP_OS == AS_OS_LINUX
+//Աشʽһעȫ¼Ƿm_ulEvents
+//ضдⲻҪepoll_ctl
+#define CONN_EPOLL_EVENTS (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET)
+#endif
+
+/*******************************************************************************
+  Function:       connAtomicLoad()/connAtomicOr()/connAtomicAnd()
+  Description:    ¼ԭӲOr/And޸ǰֵ
+*******************************************************************************/
+static inline ULONG connAtomicLoad(volatile ULONG *pulValue)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    return (ULONG)InterlockedCompareExchange((volatile LONG *)pulValue, 0, 0);
+#else
+    return __atomic_load_n(pulValue, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline ULONG connAtomicOr(volatile ULONG *pulValue, ULONG ulBits)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    return (ULONG)InterlockedOr((volatile LONG *)pulValue, (LONG)ulBits);
+#else
+    return __atomic_fetch_or(pulValue, ulBits, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline ULONG connAtomicAnd(volatile ULONG *pulValue, ULONG ulBits)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    return (ULONG)InterlockedAnd((volatile LONG *)pulValue, (LONG)ulBits);
+#else
+    return __atomic_fetch_and(pulValue, ulBits, __ATOMIC_SEQ_CST);
+#endif
+}
+
+#if AS_APP_OS == AS_OS_LINUX
+/*******************************************************************************
+  Function:       connWaitWritable()
+  Description:    ȴsocketдȴʱstStart𲻳ulTimeOut
+  Calls:
+  Called By:      CTcpConnHandle::send, CTcpConnHandle::drainSendQueue
+  Input:          lSockFd: socketstStart: ʼʱ䣬ulTimeOut: ʱ(ms)
+  Output:         
+  Return:
+  AS_ERROR_CODE_OK: дsocketһηͱ
+  SendRecvErrorTIMEO: ʱ
+  SendRecvError: pollʧ
+*******************************************************************************/
+static long connWaitWritable(long lSockFd, const struct timespec &stStart,
+    ULONG ulTimeOut)
+{
+    for(;;)
+    {
+        struct timespec stNow;
+        (void)clock_gettime(CLOCK_MONOTONIC, &stNow);
+        long lElapsed = (long)(stNow.tv_sec - stStart.tv_sec) * CONN_SECOND_IN_MS
+            + (long)(stNow.tv_nsec - stStart.tv_nsec) / (CONN_MS_IN_US * CONN_MS_IN_US);
+        if(lElapsed >= (long)ulTimeOut)
+        {
+            return SendRecvErrorTIMEO;
+        }
+
+        struct pollfd stPollFd;
+        stPollFd.fd = (int)lSockFd;
+        stPollFd.events = POLLOUT;
+        stPollFd.revents = 0;
+        errno = 0;
+        int nRet = ::poll(&stPollFd, 1, (int)((long)ulTimeOut - lElapsed));
+        if(0 < nRet)
+        {
+            return AS_ERROR_CODE_OK;
+        }
+
+        if(0 == nRet)
+        {
+            return SendRecvErrorTIMEO;
+        }
+
+        if(EINTR != CONN_ERRNO)
+        {
+            return SendRecvError;
+        }
+    }
+}
+#endif
+
 /*******************************************************************************
   Function:       CONN_WRITE_LOG()
   Description:    ־ӡ
@@ -111,7 +202,9 @@ CHandle::CHandle()
 {
     m_lSockFD = InvalidSocket;
     m_pHandleNode = NULL;
+    m_pHandleMgr = NULL;
     m_ulEvents = EPOLLIN;
+    m_ulReady = 0;
 #if AS_APP_OS == AS_OS_LINUX
     m_lEpfd = InvalidFd;
 #endif //#if
@@ -175,10 +268,12 @@ long CHandle::initHandle(void)
 
     m_lSockFD = InvalidSocket;
     m_pHandleNode = NULL;
+    m_pHandleMgr = NULL;
 #if AS_APP_OS == AS_OS_LINUX
     m_lEpfd = InvalidFd;
 #endif
     m_ulEvents = EPOLLIN;
+    m_ulReady = 0;
     if(NULL == m_pMutexHandle)
     {
         m_pMutexHandle = as_create_mutex();
@@ -203,63 +298,118 @@ long CHandle::initHandle(void)
 *******************************************************************************/
 void CHandle::setHandleSend(AS_BOOLEAN bHandleSend)
 {
-    if(m_pMutexHandle != NULL)
-    {
-        if(AS_ERROR_CODE_OK != as_mutex_lock(m_pMutexHandle))
-        {
-            return;
-        }
-    }
-
     //Ҫ¼
     if(AS_FALSE == bHandleSend)
     {
-        m_ulEvents = m_ulEvents & (~EPOLLOUT);
+        (void)connAtomicAnd(&m_ulEvents, ~(ULONG)EPOLLOUT);
+        return;
     }
-    else
+
+    (void)connAtomicOr(&m_ulEvents, (ULONG)EPOLLOUT);
+
+#if AS_APP_OS == AS_OS_LINUX
+    //رռڼϱıزںһξ״̬
+    if(0 != (connAtomicLoad(&m_ulReady) & EPOLLOUT))
     {
-        m_ulEvents = m_ulEvents | EPOLLOUT;
+        rearmEvent();
     }
+#endif
+}
 
-    if((m_pHandleNode != NULL) && (m_lSockFD != InvalidSocket))
+/*******************************************************************************
+  Function:       CHandle::setHandleRecv()
+  Description:    Ƿ¼
+  Calls:
+  Called By:
+  Input:          bHandleRecv: SVS_TRUEʾ⣬SVS_FALSEʾ
+  Output:         
+  Return:         
+*******************************************************************************/
+void CHandle::setHandleRecv(AS_BOOLEAN bHandleRecv)
+{
+    //Ҫ¼
+    if(AS_FALSE == bHandleRecv)
     {
+        (void)connAtomicAnd(&m_ulEvents, ~(ULONG)EPOLLIN);
+        return;
+    }
+
+    (void)connAtomicOr(&m_ulEvents, (ULONG)EPOLLIN);
+
 #if AS_APP_OS == AS_OS_LINUX
-        //handleӵepollļ
-        struct epoll_event epEvent;
-        memset(&epEvent, 0, sizeof(epEvent));
-        //Ҫ¼صļ
-        epEvent.data.ptr = (void *)m_pHandleNode;
-        //Ҫ¼
-        epEvent.events = m_ulEvents;
-        //޸עepoll¼
-        if ( 0 != epoll_ctl(m_lEpfd, EPOLL_CTL_MOD, m_lSockFD, &epEvent))
-        {
-            CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
-                "CHandle::setHandleSend: modify event fail, "
-                "m_lSockFD = %d", _FL_, m_lSockFD);
-        }
-#endif
+    //ûжEAGAINں˲ٸأһξ״̬
+    if(0 != (connAtomicLoad(&m_ulReady) & EPOLLIN))
+    {
+        rearmEvent();
     }
+#endif
+}
 
-    if(m_pMutexHandle != NULL)
+/*******************************************************************************
+  Function:       CHandle::getEvents()
+  Description:    ȡҪ¼
+  Calls:
+  Called By:
+  Input:          
+  Output:         
+  Return:         EPOLLIN/EPOLLOUT
+*******************************************************************************/
+ULONG CHandle::getEvents(void)
+{
+    return connAtomicLoad(&m_ulEvents);
+}
+
+/*******************************************************************************
+  Function:       CHandle::takeEvent()
+  Description:    һ¼ļ⣬ǰǷڼ
+  Calls:
+  Called By:      managercheckSelectResult
+  Input:          ulEvent: EPOLLINEPOLLOUT
+  Output:         
+  Return:         AS_TRUEʾҪ¼
+*******************************************************************************/
+AS_BOOLEAN CHandle::takeEvent(ULONG ulEvent)
+{
+    if(0 == (connAtomicAnd(&m_ulEvents, ~ulEvent) & ulEvent))
     {
-        (void)as_mutex_unlock(m_pMutexHandle);
+        return AS_FALSE;
     }
+
+    return AS_TRUE;
 }
 
 /*******************************************************************************
-  Function:       CHandle::setHandleRecv()
-  Description:    Ƿ¼
+  Function:       CHandle::setReady()/clearReady()
+  Description:    ¼/Ѿ¼дEAGAIN֮ǰ
   Calls:
   Called By:
-  Input:          bHandleRecv: SVS_TRUEʾ⣬SVS_FALSEʾ
+  Input:          ulEvents: EPOLLIN/EPOLLOUT
   Output:         
-  Return:
-  AS_ERROR_CODE_OK: init success
-  AS_ERROR_CODE_FAIL: init fail
+  Return:         
 *******************************************************************************/
-void CHandle::setHandleRecv(AS_BOOLEAN bHandleRecv)
+void CHandle::setReady(ULONG ulEvents)
+{
+    (void)connAtomicOr(&m_ulReady, ulEvents);
+}
+
+void CHandle::clearReady(ULONG ulEvents)
+{
+    (void)connAtomicAnd(&m_ulReady, ~ulEvents);
+}
+
+/*******************************************************************************
+  Function:       CHandle::rearmEvent()
+  Description:    EPOLL_CTL_MODעᣬں˷־Ծʱϱһ
+  Calls:
+  Called By:      setHandleSend/setHandleRecv
+  Input:          
+  Output:         
+  Return:         
+*******************************************************************************/
+void CHandle::rearmEvent(void)
 {
+#if AS_APP_OS == AS_OS_LINUX
+    //close⣬ѹرղõfdepoll_ctl
     if(m_pMutexHandle != NULL)
     {
         if(AS_ERROR_CODE_OK != as_mutex_lock(m_pMutexHandle))
@@ -268,40 +418,26 @@ void CHandle::setHandleRecv(AS_BOOLEAN bHandleRecv)
         }
     }
 
-    //Ҫ¼
-    if(AS_FALSE == bHandleRecv)
-    {
-        m_ulEvents = m_ulEvents & (~EPOLLIN);
-    }
-    else
-    {
-        m_ulEvents = m_ulEvents | EPOLLIN;
-    }
-
-    if((m_pHandleNode != NULL) && (m_lSockFD != InvalidSocket))
+    if((m_pHandleNode != NULL) && (m_lSockFD != InvalidSocket)
+        && (m_lEpfd != InvalidFd))
     {
-#if AS_APP_OS == AS_OS_LINUX
-        //handleӵepollļ
         struct epoll_event epEvent;
         memset(&epEvent, 0, sizeof(epEvent));
-        //Ҫ¼صļ
         epEvent.data.ptr = (void *)m_pHandleNode;
-        //Ҫ¼
-        epEvent.events = m_ulEvents;
-        //޸עepoll¼
+        epEvent.events = CONN_EPOLL_EVENTS;
         if ( 0 != epoll_ctl(m_lEpfd, EPOLL_CTL_MOD, m_lSockFD, &epEvent))
         {
             CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
-                "CHandle::setHandleRecv: modify event fail, "
+                "CHandle::rearmEvent: modify event fail, "
                 "m_lSockFD = %d", _FL_, m_lSockFD);
         }
-#endif
     }
 
     if(m_pMutexHandle != NULL)
     {
         (void)as_mutex_unlock(m_pMutexHandle);
     }
+#endif
 }
 
 /*******************************************************************************
@@ -391,6 +527,10 @@ long CNetworkHandle::sendMsg(const struct msghdr *pMsg)
 CTcpConnHandle::CTcpConnHandle()
 {
     m_lConnStatus = enIdle;
+#if AS_APP_OS == AS_OS_LINUX
+    m_ulSendQueueSize = 0;
+    m_ulMaxSendQueueSize = DEFAULT_TCP_SEND_QUEUE_SIZE;
+#endif
 }
 
 /*******************************************************************************
@@ -415,6 +555,9 @@ CTcpConnHandle::~CTcpConnHandle()
             (void)CLOSESOCK((SOCKET)m_lSockFD);
             m_lSockFD = InvalidSocket;
         }
+#if AS_APP_OS == AS_OS_LINUX
+        clearSendQueue();
+#endif
     }
     catch (...)
     {
@@ -694,6 +837,7 @@ long CTcpConnHandle::conn(const CNetworkAddr *pLocalAddr,
   Return:
   lBytesSent: ֽ(>0)
   SendRecvError: ʧ
+  SendRecvErrorTIMEO: ͬͳʱδκ
 *******************************************************************************/
 long CTcpConnHandle::send(const char *pArrayData, const ULONG ulDataSize,
     const EnumSyncAsync bSyncSend)
@@ -705,6 +849,131 @@ long CTcpConnHandle::send(const char *pArrayData, const ULONG ulDataSize,
         return SendRecvError;
     }
 
+#if AS_APP_OS == AS_OS_LINUX
+    //첽Ͳ:ں˷ͻʱʣݽ뷢ͶУ
+    //ɷӦ߳EPOLLOUTʱsendmsg
+    //ͬͲӣCONN_SYNC_SEND_TIMEOUTȴд
+    if(m_pMutexHandle != NULL)
+    {
+        if(AS_ERROR_CODE_OK != as_mutex_lock(m_pMutexHandle))
+        {
+            return SendRecvError;
+        }
+    }
+
+    ULONG ulBytesSent = 0;
+    long lRetVal = (long)ulDataSize;
+    struct timespec stStart;
+    (void)clock_gettime(CLOCK_MONOTONIC, &stStart);
+    if((enSyncOp == bSyncSend) && (!m_listSendBlock.empty()))
+    {
+        //ͬȷնлѹݣֽ֤˳
+        lRetVal = drainSendQueue(CONN_SYNC_SEND_TIMEOUT);
+        if(AS_ERROR_CODE_OK != lRetVal)
+        {
+            if(m_pMutexHandle != NULL)
+            {
+                (void)as_mutex_unlock(m_pMutexHandle);
+            }
+            return lRetVal;
+        }
+        lRetVal = (long)ulDataSize;
+    }
+
+    if(m_listSendBlock.empty())
+    {
+        //ٷͣ͵EAGAINһλ
+        clearReady(EPOLLOUT);
+        while(ulBytesSent < ulDataSize)
+        {
+            errno = 0;
+            long lBytes = ::send((SOCKET)m_lSockFD, pArrayData + ulBytesSent,
+                (int)(ulDataSize - ulBytesSent), MSG_DONTWAIT|MSG_NOSIGNAL);
+            if(lBytes >= 0)
+            {
+                ulBytesSent += (ULONG)lBytes;
+                continue;
+            }
+
+            if(EINTR == CONN_ERRNO)
+            {
+                continue;
+            }
+
+            if((EWOULDBLOCK == CONN_ERRNO) || (EAGAIN == CONN_ERRNO))
+            {
+                //ͬ͵ȴдʱֹͣ
+                if((enSyncOp == bSyncSend)
+                    && (AS_ERROR_CODE_OK == connWaitWritable(m_lSockFD, stStart,
+                                                CONN_SYNC_SEND_TIMEOUT)))
+                {
+                    continue;
+                }
+                break;
+            }
+
+            CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
+                "CTcpConnHandle::send to peer(IP:0x%x, Port:%d) "
+                "Error(%d): %s",  _FL_, ntohl((ULONG)(m_peerAddr.m_lIpAddr)),
+               ntohs(m_peerAddr.m_usPort), CONN_ERRNO, strerror(CONN_ERRNO));
+
+            (void)CLOSESOCK((SOCKET)m_lSockFD);
+            m_lSockFD = InvalidSocket;
+            if(m_pMutexHandle != NULL)
+            {
+                (void)as_mutex_unlock(m_pMutexHandle);
+            }
+            return SendRecvError;
+        }
+
+        if(ulBytesSent == ulDataSize)
+        {
+            setReady(EPOLLOUT);
+        }
+    }
+
+    ULONG ulLeft = ulDataSize - ulBytesSent;
+    if((0 < ulLeft) && (enSyncOp == bSyncSend))
+    {
+        //ͬͳʱsendһѷ͵ֽʣಿɵߴ
+        CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
+            "CTcpConnHandle::send: sync send timeout, "
+            "peer(IP:0x%x, Port:%d) sent(%lu) total(%lu)", _FL_,
+            ntohl((ULONG)(m_peerAddr.m_lIpAddr)),
+            ntohs(m_peerAddr.m_usPort), ulBytesSent, ulDataSize);
+        lRetVal = (0 < ulBytesSent) ? (long)ulBytesSent : SendRecvErrorTIMEO;
+        ulLeft = 0;
+    }
+
+    if(0 < ulLeft)
+    {
+        //Ͷʱѷ͵ֽʣಿɵhandle_sendط
+        if(m_ulSendQueueSize + ulLeft > m_ulMaxSendQueueSize)
+        {
+            lRetVal = (long)ulBytesSent;
+            ulLeft = 0;
+        }
+
+        if((0 < ulLeft)
+            && (AS_ERROR_CODE_OK != queueSendData(pArrayData + ulBytesSent, ulLeft)))
+        {
+            lRetVal = (0 < ulBytesSent) ? (long)ulBytesSent : SendRecvError;
+        }
+    }
+
+    if(m_pMutexHandle != NULL)
+    {
+        (void)as_mutex_unlock(m_pMutexHandle);
+    }
+
+    if(enAsyncOp == bSyncSend)
+    {
+        //ʼǷԷݣͶպصhandle_send
+        setHandleSend(AS_TRUE);
+    }
+
+    return lRetVal;
+#else
     errno = 0;
     long lBytesSent = 0;
     if(enSyncOp == bSyncSend)
@@ -762,6 +1031,7 @@ long CTcpConnHandle::send(const char *pArrayData, const ULONG ulDataSize,
     }
 
     return lBytesSent;
+#endif
 }
 
 /*******************************************************************************
@@ -813,8 +1083,19 @@ long CTcpConnHandle::recv(char *pArrayData, CNetworkAddr *pPeerAddr,
                 "Set Socket NoBlock fail.", _FL_);
             return SendRecvError;
         }
+#endif
+#if AS_APP_OS == AS_OS_LINUX
+        //ǣEAGAINһλ
+        clearReady(EPOLLIN);
 #endif
         lBytesRecv = ::recv((SOCKET)m_lSockFD, pArrayData, (int)ulDataSize, MSG_DONTWAIT);
+#if AS_APP_OS == AS_OS_LINUX
+        if((lBytesRecv >= 0)
+            || ((EWOULDBLOCK != CONN_ERRNO) && (EAGAIN != CONN_ERRNO)))
+        {
+            setReady(EPOLLIN);
+        }
+#endif
     }
 
     //0ʾѾ
@@ -1006,6 +1287,17 @@ void CTcpConnHandle::close(void)
         //The close of an fd will cause it to be removed from
         //all epoll sets automatically.
 #if AS_APP_OS == AS_OS_LINUX
+        //رǰ޶ʱڷѹݣʱŶ
+        if((!m_listSendBlock.empty())
+            && (AS_ERROR_CODE_OK != drainSendQueue(CONN_CLOSE_DRAIN_TIMEOUT))
+            && (0 < m_ulSendQueueSize))
+        {
+            CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
+                "CTcpConnHandle::close: drop %lu unsent bytes, "
+                "peer(IP:0x%x, Port:%d)", _FL_, m_ulSendQueueSize,
+                ntohl((ULONG)(m_peerAddr.m_lIpAddr)), ntohs(m_peerAddr.m_usPort));
+        }
+
         struct epoll_event epEvent;
         memset(&epEvent, 0, sizeof(epEvent));
         epEvent.data.ptr = (void *)NULL;
@@ -1032,17 +1324,246 @@ void CTcpConnHandle::close(void)
         (void)CLOSESOCK((SOCKET)m_lSockFD);
         m_lSockFD = InvalidSocket;
     }
-    m_lConnStatus = enClosed;
+    m_lConnStatus = enClosed;
+#if AS_APP_OS == AS_OS_LINUX
+    //ʱδһ
+    clearSendQueue();
+#endif
+
+    CHandle::close();
+
+    if(m_pMutexHandle != NULL)
+    {
+        (void)as_mutex_unlock(m_pMutexHandle);
+    }
+
+    return;
+}
+
+#if AS_APP_OS == AS_OS_LINUX
+/*******************************************************************************
+  Function:       CTcpConnHandle::flushSendQueue()
+  Description:    sendmsgѷͶоֱΪջEAGAIN
+  Calls:
+  Called By:      CTcpConnMgr::checkSelectResult
+  Input:          
+  Output:         
+  Return:
+  AS_ERROR_CODE_OK: ѷջͻ
+  SendRecvError: ʧܣѶ
+*******************************************************************************/
+long CTcpConnHandle::flushSendQueue(void)
+{
+    if(m_pMutexHandle != NULL)
+    {
+        if(AS_ERROR_CODE_OK != as_mutex_lock(m_pMutexHandle))
+        {
+            return SendRecvError;
+        }
+    }
+
+    long lRetVal = AS_ERROR_CODE_OK;
+    struct iovec iov[CONN_MAX_IOV];
+    while((!m_listSendBlock.empty()) && (InvalidSocket != m_lSockFD))
+    {
+        ULONG ulIovNum = 0;
+        for(ListOfSendBlockIte it = m_listSendBlock.begin();
+            (it != m_listSendBlock.end()) && (ulIovNum < CONN_MAX_IOV); ++it)
+        {
+            iov[ulIovNum].iov_base = it->pData + it->ulHead;
+            iov[ulIovNum].iov_len = it->ulTail - it->ulHead;
+            ++ulIovNum;
+        }
+
+        struct msghdr stMsg;
+        memset(&stMsg, 0, sizeof(stMsg));
+        stMsg.msg_iov = iov;
+        stMsg.msg_iovlen = ulIovNum;
+
+        clearReady(EPOLLOUT);
+        errno = 0;
+        long lBytes = ::sendmsg(m_lSockFD, &stMsg, MSG_DONTWAIT|MSG_NOSIGNAL);
+        if(lBytes < 0)
+        {
+            if(EINTR == CONN_ERRNO)
+            {
+                continue;
+            }
+
+            if((EWOULDBLOCK != CONN_ERRNO) && (EAGAIN != CONN_ERRNO))
+            {
+                CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
+                    "CTcpConnHandle::flushSendQueue to peer(IP:0x%x, Port:%d) "
+                    "Error(%d): %s, drop %lu bytes",  _FL_,
+                    ntohl((ULONG)(m_peerAddr.m_lIpAddr)),
+                    ntohs(m_peerAddr.m_usPort), CONN_ERRNO, strerror(CONN_ERRNO),
+                    m_ulSendQueueSize);
+                clearSendQueue();
+                lRetVal = SendRecvError;
+            }
+            break;
+        }
+
+        setReady(EPOLLOUT);
+        m_ulSendQueueSize -= (ULONG)lBytes;
+        while((0 < lBytes) && (!m_listSendBlock.empty()))
+        {
+            SendBlock &stBlock = m_listSendBlock.front();
+            ULONG ulBlockLeft = stBlock.ulTail - stBlock.ulHead;
+            if((ULONG)lBytes < ulBlockLeft)
+            {
+                stBlock.ulHead += (ULONG)lBytes;
+                break;
+            }
+
+            lBytes -= (long)ulBlockLeft;
+            AS_DELETE(stBlock.pData, MULTI);
+            m_listSendBlock.pop_front();
+        }
+    }
+
+    if(m_pMutexHandle != NULL)
+    {
+        (void)as_mutex_unlock(m_pMutexHandle);
+    }
+
+    return lRetVal;
+}
+
+/*******************************************************************************
+  Function:       CTcpConnHandle::drainSendQueue()
+  Description:    ޶ʱڰѷͶзգͻʱȴд
+  Calls:          CTcpConnHandle::flushSendQueue
+  Called By:      CTcpConnHandle::send, CTcpConnHandle::close
+  Input:          ulTimeOut: ȴʱ(ms)
+  Output:         
+  Return:
+  AS_ERROR_CODE_OK: ѷ
+  SendRecvErrorTIMEO: ʱ
+  SendRecvError: ʧܣѶ
+*******************************************************************************/
+long CTcpConnHandle::drainSendQueue(ULONG ulTimeOut)
+{
+    if(m_pMutexHandle != NULL)
+    {
+        if(AS_ERROR_CODE_OK != as_mutex_lock(m_pMutexHandle))
+        {
+            return SendRecvError;
+        }
+    }
+
+    struct timespec stStart;
+    (void)clock_gettime(CLOCK_MONOTONIC, &stStart);
+    long lRetVal = AS_ERROR_CODE_OK;
+    while(!m_listSendBlock.empty())
+    {
+        if(InvalidSocket == m_lSockFD)
+        {
+            lRetVal = SendRecvError;
+            break;
+        }
+
+        lRetVal = flushSendQueue();
+        if((AS_ERROR_CODE_OK != lRetVal) || m_listSendBlock.empty())
+        {
+            break;
+        }
+
+        lRetVal = connWaitWritable(m_lSockFD, stStart, ulTimeOut);
+        if(AS_ERROR_CODE_OK != lRetVal)
+        {
+            break;
+        }
+    }
+
+    if(m_pMutexHandle != NULL)
+    {
+        (void)as_mutex_unlock(m_pMutexHandle);
+    }
+
+    return lRetVal;
+}
+
+/*******************************************************************************
+  Function:       CTcpConnHandle::queueSendData()
+  Description:    ׷ӵͶУβʣռ䣬߳
+  Calls:
+  Called By:      CTcpConnHandle::send
+  Input:          pArrayData: bufferulDataSize: ݳ
+  Output:         
+  Return:
+  AS_ERROR_CODE_OK: success
+  AS_ERROR_CODE_FAIL: ڴʧ
+*******************************************************************************/
+long CTcpConnHandle::queueSendData(const char *pArrayData, const ULONG ulDataSize)
+{
+    ULONG ulTailSpace = 0;
+    if(!m_listSendBlock.empty())
+    {
+        ulTailSpace = m_listSendBlock.back().ulSize - m_listSendBlock.back().ulTail;
+    }
+
+    //¿ٿʧʱбֲ
+    SendBlock stNewBlock;
+    stNewBlock.pData = NULL;
+    stNewBlock.ulSize = 0;
+    stNewBlock.ulHead = 0;
+    stNewBlock.ulTail = 0;
+    if(ulDataSize > ulTailSpace)
+    {
+        stNewBlock.ulSize = ulDataSize - ulTailSpace;
+        if(stNewBlock.ulSize < TCP_SEND_BLOCK_SIZE)
+        {
+            stNewBlock.ulSize = TCP_SEND_BLOCK_SIZE;
+        }
+        (void)AS_NEW(stNewBlock.pData, stNewBlock.ulSize);
+        if(NULL == stNewBlock.pData)
+        {
+            CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
+                "CTcpConnHandle::queueSendData: alloc %lu bytes fail", _FL_,
+                stNewBlock.ulSize);
+            return AS_ERROR_CODE_FAIL;
+        }
+    }
 
-    CHandle::close();
+    ULONG ulCopied = (ulTailSpace < ulDataSize) ? ulTailSpace : ulDataSize;
+    if(0 < ulCopied)
+    {
+        SendBlock &stBlock = m_listSendBlock.back();
+        memcpy(stBlock.pData + stBlock.ulTail, pArrayData, ulCopied);
+        stBlock.ulTail += ulCopied;
+    }
 
-    if(m_pMutexHandle != NULL)
+    if(NULL != stNewBlock.pData)
     {
-        (void)as_mutex_unlock(m_pMutexHandle);
+        memcpy(stNewBlock.pData, pArrayData + ulCopied, ulDataSize - ulCopied);
+        stNewBlock.ulTail = ulDataSize - ulCopied;
+        m_listSendBlock.push_back(stNewBlock);
     }
 
-    return;
+    m_ulSendQueueSize += ulDataSize;
+    return AS_ERROR_CODE_OK;
+}
+
+/*******************************************************************************
+  Function:       CTcpConnHandle::clearSendQueue()
+  Description:    Ͷе
+  Calls:
+  Called By:
+  Input:          
+  Output:         
+  Return:         
+*******************************************************************************/
+void CTcpConnHandle::clearSendQueue(void)
+{
+    while(!m_listSendBlock.empty())
+    {
+        AS_DELETE(m_listSendBlock.front().pData, MULTI);
+        m_listSendBlock.pop_front();
+    }
+    m_ulSendQueueSize = 0;
 }
+#endif
 
 /*******************************************************************************
   Function:       CUdpSockHandle::createSock()
@@ -1297,8 +1818,18 @@ long CUdpSockHandle::recv(char *pArrayData, CNetworkAddr *pPeerAddr,
             return SendRecvError;
         }
 #endif
-        lBytesRecv = recvfrom((SOCKET)m_lSockFD, pArrayData, (int)ulDataSize, 0,
-            (struct sockaddr *)&peerAddr, &iFromlen);
+#if AS_APP_OS == AS_OS_LINUX
+        clearReady(EPOLLIN);
+#endif
+        lBytesRecv = recvfrom((SOCKET)m_lSockFD, pArrayData, (int)ulDataSize,
+            MSG_DONTWAIT, (struct sockaddr *)&peerAddr, &iFromlen);
+#if AS_APP_OS == AS_OS_LINUX
+        if((lBytesRecv >= 0)
+            || ((EWOULDBLOCK != CONN_ERRNO) && (EAGAIN != CONN_ERRNO)))
+        {
+            setReady(EPOLLIN);
+        }
+#endif
     }
 
     //0ʾѾ
@@ -1516,6 +2047,27 @@ long CTcpServerHandle::listen(const CNetworkAddr *pLocalAddr)
             "setsockopt client socket error(%d)", _FL_, CONN_ERRNO);
         return AS_ERROR_CODE_FAIL;
     }
+
+#ifdef SO_REUSEPORT
+    //socket(̻server handle)ͬһ˿ڣں˷̯
+    long lReusePortFlag = 1;
+    if(setsockopt((SOCKET)lSockFd, SOL_SOCKET, SO_REUSEPORT, (char*)&lReusePortFlag,
+        sizeof(lReusePortFlag)) < 0)
+    {
+        CONN_WRITE_LOG(CONN_WARNING,  (char *)"FILE(%s)LINE(%d): "
+            "set SO_REUSEPORT error(%d), ignore it", _FL_, CONN_ERRNO);
+    }
+#endif
+
+    //شҪacceptEAGAINsocketΪ
+    //acceptõsocket̳иñ־
+    if(fcntl(lSockFd, F_SETFL, fcntl(lSockFd, F_GETFL)|O_NONBLOCK) < 0)
+    {
+        (void)CLOSESOCK((SOCKET)lSockFd);
+        CONN_WRITE_LOG(CONN_WARNING,  (char *)"FILE(%s)LINE(%d): "
+            "fcntl server socket error(%d)", _FL_, CONN_ERRNO);
+        return AS_ERROR_CODE_FAIL;
+    }
 #endif
     //󶨱صַ
     struct sockaddr_in  serverAddr;
@@ -1720,6 +2272,7 @@ long CHandleManager::init(const ULONG ulSelectPeriod)
     }
 
 #if AS_APP_OS == AS_OS_LINUX
+    //sizeֻʾֵÿӦľMAX_EPOLL_FD_SIZE
     m_lEpfd = epoll_create(MAX_EPOLL_FD_SIZE);
 
     if(m_lEpfd < 0)
@@ -2036,14 +2589,32 @@ void CHandleManager::mainLoop()
                 continue;
             }
 
+            //Ҷʱд඼Ҫд᷵ش
+            ULONG ulEvents = m_epEvents[i].events;
+            if(0 != (ulEvents & (EPOLLERR | EPOLLHUP)))
+            {
+                ulEvents |= (EPOLLIN | EPOLLOUT);
+            }
+            if(0 != (ulEvents & EPOLLRDHUP))
+            {
+                ulEvents |= EPOLLIN;
+            }
+            pHandle->setReady(ulEvents & (EPOLLIN | EPOLLOUT));
+
             //ͨ¼ͼǷΪ
-            if(m_epEvents[i].events & EPOLLIN)
+            if(ulEvents & EPOLLIN)
             {
                 this->checkSelectResult(enEpollRead, pHandle);
             }
 
+            //handleѱע
+            if(AS_FALSE != pHandleNode->m_bRemoved)
+            {
+                continue;
+            }
+
             //ͨ¼ͼǷΪд
-            if(m_epEvents[i].events & EPOLLOUT)
+            if(ulEvents & EPOLLOUT)
             {
                 this->checkSelectResult(enEpollWrite, pHandle);
             }
@@ -2179,8 +2750,8 @@ long CHandleManager::addHandle(CHandle *pHandle,
     memset(&epEvent, 0, sizeof(epEvent));
     //Ҫ¼صļ
     epEvent.data.ptr = (void *)pHandleNode;
-    //Ҫ¼
-    epEvent.events = pHandle->getEvents();
+    //شһעȫ¼ǷpHandle->m_ulEvents
+    epEvent.events = CONN_EPOLL_EVENTS;
     //עepoll¼
     errno = 0;
     if ( 0 != epoll_ctl(m_lEpfd, EPOLL_CTL_ADD, pHandle->m_lSockFD, &epEvent))
@@ -2204,6 +2775,7 @@ long CHandleManager::addHandle(CHandle *pHandle,
     }
 #endif
     pHandle->m_pHandleNode = pHandleNode;
+    pHandle->m_pHandleMgr = this;
 
 #if AS_APP_OS == AS_OS_LINUX
     pHandle->m_lEpfd = m_lEpfd;
@@ -2387,8 +2959,12 @@ void CTcpConnMgr::checkSelectResult(const EpollEventType enEpEvent,
     //¼
     if(enEpollRead == enEpEvent)
     {
-        //¼
-        pTcpConnHandle->setHandleRecv(AS_FALSE);
+        //¼⣬δڼʱ¼ֻΪ
+        if(AS_TRUE != pTcpConnHandle->takeEvent(EPOLLIN))
+        {
+            return;
+        }
+
         //handle¼
         pTcpConnHandle->handle_recv();
     }
@@ -2396,9 +2972,6 @@ void CTcpConnMgr::checkSelectResult(const EpollEventType enEpEvent,
     //д¼
     if(enEpollWrite == enEpEvent)
     {
-        //д¼
-        pTcpConnHandle->setHandleSend(AS_FALSE);
-
         //Ƿӳɹ
         if(pTcpConnHandle->getStatus() == enConnecting)
         {
@@ -2423,10 +2996,27 @@ void CTcpConnMgr::checkSelectResult(const EpollEventType enEpEvent,
             pTcpConnHandle->m_lConnStatus = enConnected;
         }
 
+#if AS_APP_OS == AS_OS_LINUX
+        //ȷͶлѹݣ֮ǰصhandle_send
+        if(0 < pTcpConnHandle->getSendQueueSize())
+        {
+            (void)pTcpConnHandle->flushSendQueue();
+            if(0 < pTcpConnHandle->getSendQueueSize())
+            {
+                return;
+            }
+        }
+#endif
+
+        //д¼
+        if(AS_TRUE != pTcpConnHandle->takeEvent(EPOLLOUT))
+        {
+            return;
+        }
+
         //handleд¼
         pTcpConnHandle->handle_send();
     }
-
 }
 
 /*******************************************************************************
@@ -2454,20 +3044,18 @@ void CUdpSockMgr::checkSelectResult(const EpollEventType enEpEvent,
         return;
     }
 
-    //¼
-    if(enEpollRead == enEpEvent)
+    //¼ͬʱ¼
+    if((enEpollRead == enEpEvent)
+        && (AS_TRUE == pUdpSockHandle->takeEvent(EPOLLIN)))
     {
-        //¼
-        pUdpSockHandle->setHandleRecv(AS_FALSE);
         //handle¼
         pUdpSockHandle->handle_recv();
     }
 
-    //д¼
-    if(enEpollWrite == enEpEvent)
+    //д¼ͬʱд¼
+    if((enEpollWrite == enEpEvent)
+        && (AS_TRUE == pUdpSockHandle->takeEvent(EPOLLOUT)))
     {
-        //д¼
-        pUdpSockHandle->setHandleSend(AS_FALSE);
         //handleд¼
         pUdpSockHandle->handle_send();
     }
@@ -2492,7 +3080,7 @@ void CTcpServerMgr::checkSelectResult(const EpollEventType enEpEvent,
         return;
     }
 
-    if(NULL == m_pTcpConnMgr)
+    if(0 == m_ulTcpConnMgrNum)
     {
         CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
             "CTcpServerMgr::checkSelectResult: m_pTcpConnMgr is NULL.", _FL_);
@@ -2506,133 +3094,258 @@ void CTcpServerMgr::checkSelectResult(const EpollEventType enEpEvent,
     }
 
     //ӵ¼
-    if(enEpollRead == enEpEvent)
+    if((enEpollRead == enEpEvent)
+        && (0 != (pTcpServerHandle->getEvents() & EPOLLIN)))
     {
-        struct sockaddr_in peerAddr;
-        memset(&peerAddr, 0, sizeof(struct sockaddr_in));
-
-        //
-        socklen_t len = sizeof(struct sockaddr_in);
-        long lClientSockfd = InvalidFd;
-        errno = 0;
-        lClientSockfd = (long)::accept((SOCKET)(pTcpServerHandle->m_lSockFD),
-            (struct sockaddr *)&peerAddr, &len);
-        if( 0 > lClientSockfd)
-        {
-            if((EWOULDBLOCK != CONN_ERRNO) && (CONN_ERRNO != EAGAIN))
-            {
-                CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
-                    "accept Error(%d): %s. ", _FL_, CONN_ERRNO, strerror(CONN_ERRNO));
-            }
-            return;
-        }
-        //setSendBufSize
-        long lSendBufSize = DEFAULT_TCP_SENDRECV_SIZE;
-        socklen_t lSendBufLength = sizeof(lSendBufSize);
-        if(setsockopt((SOCKET)lClientSockfd, SOL_SOCKET, SO_SNDBUF, (char*)&lSendBufSize,
-            lSendBufLength) < 0)
+#if AS_APP_OS == AS_OS_LINUX
+        //شܵEAGAINΪֹ
+        while(AS_ERROR_CODE_OK == acceptConn(pTcpServerHandle))
         {
-            (void)CLOSESOCK((SOCKET)lClientSockfd);
-            CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
-                "setSendBufSize client socket error(%d)", _FL_, CONN_ERRNO);
-            return;
         }
+#elif AS_APP_OS == AS_OS_WIN32
+        (void)acceptConn(pTcpServerHandle);
+#endif
+    }
 
-        //setRecBufSize
-        long lRecvBufSize = DEFAULT_TCP_SENDRECV_SIZE;
-        socklen_t lRecvBufLength = sizeof(lRecvBufSize);
-        if(setsockopt((SOCKET)lClientSockfd, SOL_SOCKET, SO_RCVBUF, (char*)&lRecvBufSize,
-            lRecvBufLength) < 0)
-        {
-            (void)CLOSESOCK((SOCKET)lClientSockfd);
-            CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
-                "setRecvBufSize client socket error(%d)", _FL_, CONN_ERRNO);
-            return;
-        }
-        long flag = 1;
-        if(setsockopt((SOCKET)lClientSockfd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag,
-            sizeof(flag)) < 0)
-        {
-            (void)CLOSESOCK((SOCKET)lClientSockfd);
-            CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
-                "set TCP_NODELAY client socket error(%d)", _FL_, CONN_ERRNO);
-            return;
-        }
-        //setReuseAddr();
-        long lReuseAddrFlag = 1;
-        if(setsockopt((SOCKET)lClientSockfd, SOL_SOCKET, SO_REUSEADDR, (char*)&lReuseAddrFlag,
-            sizeof(lReuseAddrFlag)) < 0)
-        {
-            (void)CLOSESOCK((SOCKET)lClientSockfd);
-            CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
-                "setsockopt client socket error(%d)", _FL_, CONN_ERRNO);
-            return;
-        }
-        //server handleӵ
-        CNetworkAddr clientAddr;
-        clientAddr.m_lIpAddr = (LONG)peerAddr.sin_addr.s_addr;
-        clientAddr.m_usPort = peerAddr.sin_port;
-        CTcpConnHandle *pTcpConnHandle = NULL;
+    //socketֻڳʱд¼Ҫ
+    if(enEpollWrite == enEpEvent)
+    {
+        CONN_WRITE_LOG(CONN_DEBUG,  (char *)"FILE(%s)LINE(%d): "
+            "CTcpServerMgr ignore write event", _FL_);
+    }
+}
+
+/*******************************************************************************
+  Function:       CTcpServerMgr::~CTcpServerMgr()
+  Description:    ͷűþ
+  Calls:
+  Called By:
+  Input:          
+  Output:         
+  Return:         
+*******************************************************************************/
+CTcpServerMgr::~CTcpServerMgr()
+{
+#if AS_APP_OS == AS_OS_LINUX
+    if(InvalidFd != m_lSpareFd)
+    {
+        (void)::close((int)m_lSpareFd);
+        m_lSpareFd = InvalidFd;
+    }
+#endif
+}
+
+/*******************************************************************************
+  Function:       CTcpServerMgr::reserveSpareFd()
+  Description:    Ԥһþľʱڽܲر
+  Calls:
+  Called By:      CTcpServerMgr::CTcpServerMgr, CTcpServerMgr::rejectConn
+  Input:          
+  Output:         
+  Return:         
+*******************************************************************************/
+void CTcpServerMgr::reserveSpareFd(void)
+{
+#if AS_APP_OS == AS_OS_LINUX
+    if(InvalidFd == m_lSpareFd)
+    {
+        m_lSpareFd = (long)::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+#endif
+}
+
+/*******************************************************************************
+  Function:       CTcpServerMgr::rejectConn()
+  Description:    ľʱͷűþܲرһӣԤ
+  Calls:
+  Called By:      CTcpServerMgr::acceptConn
+  Input:          pTcpServerHandle: handle
+  Output:         
+  Return:
+  AS_ERROR_CODE_OK: رһӣԼaccept
+  AS_ERROR_CODE_FAIL: ûбþûдܵ
+*******************************************************************************/
+long CTcpServerMgr::rejectConn(CTcpServerHandle *pTcpServerHandle)
+{
+#if AS_APP_OS == AS_OS_LINUX
+    reserveSpareFd();
+    if(InvalidFd == m_lSpareFd)
+    {
+        return AS_ERROR_CODE_FAIL;
+    }
+
+    (void)::close((int)m_lSpareFd);
+    m_lSpareFd = InvalidFd;
 
-        /*˴,ʹɵpTcpConnHandle,removeTcpClient*/
-        m_pTcpConnMgr->lockListOfHandle();
-        if (AS_ERROR_CODE_OK != pTcpServerHandle->handle_accept(&clientAddr, pTcpConnHandle))
+    long lRetVal = AS_ERROR_CODE_FAIL;
+    long lClientSockfd = (long)::accept((SOCKET)(pTcpServerHandle->m_lSockFD),
+        NULL, NULL);
+    if(0 <= lClientSockfd)
+    {
+        (void)CLOSESOCK((SOCKET)lClientSockfd);
+        lRetVal = AS_ERROR_CODE_OK;
+    }
+
+    reserveSpareFd();
+    return lRetVal;
+#else
+    return AS_ERROR_CODE_FAIL;
+#endif
+}
+
+/*******************************************************************************
+  Function:       CTcpServerMgr::acceptConn()
+  Description:    һӣתѡķӦ
+  Calls:
+  Called By:      CTcpServerMgr::checkSelectResult
+  Input:          pTcpServerHandle: handle
+  Output:         
+  Return:
+  AS_ERROR_CODE_OK: һ(ʧ)Լaccept
+  AS_ERROR_CODE_FAIL: ûдܵӻaccept
+*******************************************************************************/
+long CTcpServerMgr::acceptConn(CTcpServerHandle *pTcpServerHandle)
+{
+    struct sockaddr_in peerAddr;
+    memset(&peerAddr, 0, sizeof(struct sockaddr_in));
+
+    //
+    socklen_t len = sizeof(struct sockaddr_in);
+    long lClientSockfd = InvalidFd;
+    errno = 0;
+    lClientSockfd = (long)::accept((SOCKET)(pTcpServerHandle->m_lSockFD),
+        (struct sockaddr *)&peerAddr, &len);
+    if( 0 > lClientSockfd)
+    {
+#if AS_APP_OS == AS_OS_LINUX
+        //źжϻacceptǰѶϿaccept
+        if((EINTR == CONN_ERRNO) || (ECONNABORTED == CONN_ERRNO)
+            || (EPROTO == CONN_ERRNO))
         {
-            (void)CLOSESOCK((SOCKET)lClientSockfd);
-            CONN_WRITE_LOG(CONN_WARNING,  (char *)"FILE(%s)LINE(%d): "
-                "CTcpServerMgr::checkSelectResult: accept fail.", _FL_);
-            m_pTcpConnMgr->unlockListOfHandle();
-            return;
+            return AS_ERROR_CODE_OK;
         }
 
-        if (NULL == pTcpConnHandle)
+        //ľʱУش²֪ͨ
+        //ڳþܲرոӣacceptEAGAIN
+        if((EMFILE == CONN_ERRNO) || (ENFILE == CONN_ERRNO))
         {
-            (void)CLOSESOCK((SOCKET)lClientSockfd);
             CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
-                "CTcpServerMgr::checkSelectResult: "
-                "return NULL arg.", _FL_);
-            m_pTcpConnMgr->unlockListOfHandle();
-            return;
-        }
-        if(AS_ERROR_CODE_OK != pTcpConnHandle->initHandle())
-        {
-            CONN_WRITE_LOG(CONN_WARNING,  (char *)"FILE(%s)LINE(%d): "
-                "CTcpServerMgr::checkSelectResult: "
-                "pTcpConnHandle init fail", _FL_);
-            m_pTcpConnMgr->unlockListOfHandle();
-            return;
+                "accept Error(%d): %s, reject connection. ", _FL_, CONN_ERRNO,
+                strerror(CONN_ERRNO));
+            return rejectConn(pTcpServerHandle);
         }
-        pTcpConnHandle->m_lSockFD = lClientSockfd;
-        pTcpConnHandle->m_localAddr.m_lIpAddr = pTcpServerHandle->m_localAddr.m_lIpAddr;
-        pTcpConnHandle->m_localAddr.m_usPort = pTcpServerHandle->m_localAddr.m_usPort;
-        pTcpConnHandle->m_lConnStatus = enConnected;
-        pTcpConnHandle->m_peerAddr.m_lIpAddr = clientAddr.m_lIpAddr;
-        pTcpConnHandle->m_peerAddr.m_usPort = clientAddr.m_usPort;
-
-        AS_BOOLEAN bIsListOfHandleLocked = AS_TRUE;
-        if (AS_ERROR_CODE_OK != m_pTcpConnMgr->addHandle(pTcpConnHandle,
-                                                    bIsListOfHandleLocked))
+#endif
+        if((EWOULDBLOCK != CONN_ERRNO) && (CONN_ERRNO != EAGAIN))
         {
             CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
-                "CTcpServerMgr::checkSelectResult: addHandle fail.", _FL_);
-            pTcpConnHandle->close();
+                "accept Error(%d): %s. ", _FL_, CONN_ERRNO, strerror(CONN_ERRNO));
         }
-        m_pTcpConnMgr->unlockListOfHandle();
-        CONN_WRITE_LOG(CONN_DEBUG, (char *)"FILE(%s)LINE(%d): "
-            "CTcpServerMgr::checkSelectResult: accept connect, "
-            "m_lSockFD = %d, peer_ip(0x%x), peer_port(%d)", _FL_,
-            pTcpConnHandle->m_lSockFD,
-            ntohl((ULONG)(pTcpConnHandle->m_peerAddr.m_lIpAddr)),
-            ntohs(pTcpConnHandle->m_peerAddr.m_usPort));
+        return AS_ERROR_CODE_FAIL;
+    }
+    //setSendBufSize
+    long lSendBufSize = DEFAULT_TCP_SENDRECV_SIZE;
+    socklen_t lSendBufLength = sizeof(lSendBufSize);
+    if(setsockopt((SOCKET)lClientSockfd, SOL_SOCKET, SO_SNDBUF, (char*)&lSendBufSize,
+        lSendBufLength) < 0)
+    {
+        (void)CLOSESOCK((SOCKET)lClientSockfd);
+        CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
+            "setSendBufSize client socket error(%d)", _FL_, CONN_ERRNO);
+        return AS_ERROR_CODE_OK;
+    }
+
+    //setRecBufSize
+    long lRecvBufSize = DEFAULT_TCP_SENDRECV_SIZE;
+    socklen_t lRecvBufLength = sizeof(lRecvBufSize);
+    if(setsockopt((SOCKET)lClientSockfd, SOL_SOCKET, SO_RCVBUF, (char*)&lRecvBufSize,
+        lRecvBufLength) < 0)
+    {
+        (void)CLOSESOCK((SOCKET)lClientSockfd);
+        CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
+            "setRecvBufSize client socket error(%d)", _FL_, CONN_ERRNO);
+        return AS_ERROR_CODE_OK;
+    }
+    long flag = 1;
+    if(setsockopt((SOCKET)lClientSockfd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag,
+        sizeof(flag)) < 0)
+    {
+        (void)CLOSESOCK((SOCKET)lClientSockfd);
+        CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
+            "set TCP_NODELAY client socket error(%d)", _FL_, CONN_ERRNO);
+        return AS_ERROR_CODE_OK;
+    }
+    //setReuseAddr();
+    long lReuseAddrFlag = 1;
+    if(setsockopt((SOCKET)lClientSockfd, SOL_SOCKET, SO_REUSEADDR, (char*)&lReuseAddrFlag,
+        sizeof(lReuseAddrFlag)) < 0)
+    {
+        (void)CLOSESOCK((SOCKET)lClientSockfd);
+        CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
+            "setsockopt client socket error(%d)", _FL_, CONN_ERRNO);
+        return AS_ERROR_CODE_OK;
+    }
+    //server handleӵ
+    CNetworkAddr clientAddr;
+    clientAddr.m_lIpAddr = (LONG)peerAddr.sin_addr.s_addr;
+    clientAddr.m_usPort = peerAddr.sin_port;
+    CTcpConnHandle *pTcpConnHandle = NULL;
 
+    //ӰתʽָӦ
+    CTcpConnMgr *pTcpConnMgr = m_pTcpConnMgr[m_ulNextTcpConnMgr % m_ulTcpConnMgrNum];
+    ++m_ulNextTcpConnMgr;
+
+    /*˴,ʹɵpTcpConnHandle,removeTcpClient*/
+    pTcpConnMgr->lockListOfHandle();
+    if (AS_ERROR_CODE_OK != pTcpServerHandle->handle_accept(&clientAddr, pTcpConnHandle))
+    {
+        (void)CLOSESOCK((SOCKET)lClientSockfd);
+        CONN_WRITE_LOG(CONN_WARNING,  (char *)"FILE(%s)LINE(%d): "
+            "CTcpServerMgr::acceptConn: accept fail.", _FL_);
+        pTcpConnMgr->unlockListOfHandle();
+        return AS_ERROR_CODE_OK;
     }
 
-    //Ӧü⵽д¼
-    if(enEpollWrite == enEpEvent)
+    if (NULL == pTcpConnHandle)
+    {
+        (void)CLOSESOCK((SOCKET)lClientSockfd);
+        CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
+            "CTcpServerMgr::acceptConn: "
+            "return NULL arg.", _FL_);
+        pTcpConnMgr->unlockListOfHandle();
+        return AS_ERROR_CODE_OK;
+    }
+    if(AS_ERROR_CODE_OK != pTcpConnHandle->initHandle())
     {
         CONN_WRITE_LOG(CONN_WARNING,  (char *)"FILE(%s)LINE(%d): "
-            "CTcpServerMgr should not process write event", _FL_);
+            "CTcpServerMgr::acceptConn: "
+            "pTcpConnHandle init fail", _FL_);
+        pTcpConnMgr->unlockListOfHandle();
+        return AS_ERROR_CODE_OK;
+    }
+    pTcpConnHandle->m_lSockFD = lClientSockfd;
+    pTcpConnHandle->m_localAddr.m_lIpAddr = pTcpServerHandle->m_localAddr.m_lIpAddr;
+    pTcpConnHandle->m_localAddr.m_usPort = pTcpServerHandle->m_localAddr.m_usPort;
+    pTcpConnHandle->m_lConnStatus = enConnected;
+    pTcpConnHandle->m_peerAddr.m_lIpAddr = clientAddr.m_lIpAddr;
+    pTcpConnHandle->m_peerAddr.m_usPort = clientAddr.m_usPort;
+
+    AS_BOOLEAN bIsListOfHandleLocked = AS_TRUE;
+    if (AS_ERROR_CODE_OK != pTcpConnMgr->addHandle(pTcpConnHandle,
+                                                bIsListOfHandleLocked))
+    {
+        CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
+            "CTcpServerMgr::acceptConn: addHandle fail.", _FL_);
+        pTcpConnHandle->close();
     }
+    pTcpConnMgr->unlockListOfHandle();
+    CONN_WRITE_LOG(CONN_DEBUG, (char *)"FILE(%s)LINE(%d): "
+        "CTcpServerMgr::acceptConn: accept connect, "
+        "m_lSockFD = %d, peer_ip(0x%x), peer_port(%d)", _FL_,
+        pTcpConnHandle->m_lSockFD,
+        ntohl((ULONG)(pTcpConnHandle->m_peerAddr.m_lIpAddr)),
+        ntohs(pTcpConnHandle->m_peerAddr.m_usPort));
+
+    return AS_ERROR_CODE_OK;
 }
 
 /*******************************************************************************
@@ -2647,7 +3360,9 @@ void CTcpServerMgr::checkSelectResult(const EpollEventType enEpEvent,
 CConnMgr::CConnMgr()
 {
     m_lLocalIpAddr = InvalidIp;
-    m_pTcpConnMgr = NULL;
+    memset(m_pTcpConnMgr, 0, sizeof(m_pTcpConnMgr));
+    m_ulTcpConnMgrNum = 0;
+    m_ulNextTcpConnMgr = 0;
     m_pUdpSockMgr = NULL;
     m_pTcpServerMgr = NULL;
 
@@ -2666,7 +3381,10 @@ CConnMgr::~CConnMgr()
 {
     try
     {
-        AS_DELETE(m_pTcpConnMgr);
+        for(ULONG i = 0; i < MAX_CONN_REACTOR_NUM; ++i)
+        {
+            AS_DELETE(m_pTcpConnMgr[i]);
+        }
         AS_DELETE(m_pUdpSockMgr);
         AS_DELETE(m_pTcpServerMgr);
     }
@@ -2680,14 +3398,15 @@ CConnMgr::~CConnMgr()
   Description:    ʼ
   Calls:
   Called By:
-  Input:          
+  Input:          ulReactorNum: TCPӷӦ߳0ʾCPU
   Output:         
   Return:
   AS_ERROR_CODE_OK: init success
   AS_ERROR_CODE_FAIL: init fail
 *******************************************************************************/
 long CConnMgr::init(const ULONG ulSelectPeriod, const AS_BOOLEAN bHasUdpSock,
-            const AS_BOOLEAN bHasTcpClient, const AS_BOOLEAN bHasTcpServer)
+            const AS_BOOLEAN bHasTcpClient, const AS_BOOLEAN bHasTcpServer,
+            const ULONG ulReactorNum)
 {
 #if AS_APP_OS == AS_OS_WIN32
     WSAData wsaData;
@@ -2717,18 +3436,45 @@ long CConnMgr::init(const ULONG ulSelectPeriod, const AS_BOOLEAN bHasUdpSock,
 
     if((AS_TRUE == bHasTcpClient) || (AS_TRUE == bHasTcpServer))
     {
-        (void)AS_NEW(m_pTcpConnMgr);
-        if(NULL == m_pTcpConnMgr)
+        //ÿӦһepolḷ߳עʱתʽ
+        ULONG ulMgrNum = ulReactorNum;
+        if(0 == ulMgrNum)
         {
-            CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
-                "CConnMgr::init: create m_pTcpConnMgr fail", _FL_);
-            return AS_ERROR_CODE_FAIL;
+#if AS_APP_OS == AS_OS_LINUX
+            long lCpuNum = sysconf(_SC_NPROCESSORS_ONLN);
+            ulMgrNum = (0 < lCpuNum) ? (ULONG)lCpuNum : 1;
+#elif AS_APP_OS == AS_OS_WIN32
+            SYSTEM_INFO stSysInfo;
+            GetSystemInfo(&stSysInfo);
+            ulMgrNum = (0 < stSysInfo.dwNumberOfProcessors)
+                        ? (ULONG)stSysInfo.dwNumberOfProcessors : 1;
+#endif
         }
-        if(AS_ERROR_CODE_OK != m_pTcpConnMgr->init(ulSelectPeriod))
+        if(MAX_CONN_REACTOR_NUM < ulMgrNum)
         {
-            CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
-                "CConnMgr::init: init m_pTcpConnMgr fail", _FL_);
-            return AS_ERROR_CODE_FAIL;
+            ulMgrNum = MAX_CONN_REACTOR_NUM;
+        }
+
+        for(m_ulTcpConnMgrNum = 0; m_ulTcpConnMgrNum < ulMgrNum; ++m_ulTcpConnMgrNum)
+        {
+            CTcpConnMgr *pTcpConnMgr = NULL;
+            (void)AS_NEW(pTcpConnMgr);
+            if(NULL == pTcpConnMgr)
+            {
+                CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
+                    "CConnMgr::init: create m_pTcpConnMgr[%lu] fail", _FL_,
+                    m_ulTcpConnMgrNum);
+                return AS_ERROR_CODE_FAIL;
+            }
+            m_pTcpConnMgr[m_ulTcpConnMgrNum] = pTcpConnMgr;
+
+            if(AS_ERROR_CODE_OK != pTcpConnMgr->init(ulSelectPeriod))
+            {
+                CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
+                    "CConnMgr::init: init m_pTcpConnMgr[%lu] fail", _FL_,
+                    m_ulTcpConnMgrNum);
+                return AS_ERROR_CODE_FAIL;
+            }
         }
     }
 
@@ -2747,7 +3493,7 @@ long CConnMgr::init(const ULONG ulSelectPeriod, const AS_BOOLEAN bHasUdpSock,
                 "CConnMgr::init: init m_pTcpServerMgr fail", _FL_);
             return AS_ERROR_CODE_FAIL;
         }
-        m_pTcpServerMgr->setTcpClientMgr(m_pTcpConnMgr);
+        m_pTcpServerMgr->setTcpClientMgr(m_pTcpConnMgr, m_ulTcpConnMgrNum);
     }
 
     return AS_ERROR_CODE_OK;
@@ -2776,12 +3522,12 @@ long CConnMgr::run(void)
         }
     }
 
-    if(NULL != m_pTcpConnMgr)
+    for(ULONG i = 0; i < m_ulTcpConnMgrNum; ++i)
     {
-        if(AS_ERROR_CODE_OK != m_pTcpConnMgr->run())
+        if(AS_ERROR_CODE_OK != m_pTcpConnMgr[i]->run())
         {
             CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
-                "CConnMgr::run: run m_pTcpConnMgr fail", _FL_);
+                "CConnMgr::run: run m_pTcpConnMgr[%lu] fail", _FL_, i);
             return AS_ERROR_CODE_FAIL;
         }
     }
@@ -2824,11 +3570,12 @@ void CConnMgr::exit(void)
         AS_DELETE(m_pTcpServerMgr);
     }
 
-    if(NULL != m_pTcpConnMgr)
+    for(ULONG i = 0; i < m_ulTcpConnMgrNum; ++i)
     {
-        m_pTcpConnMgr->exit();
-        AS_DELETE(m_pTcpConnMgr);
+        m_pTcpConnMgr[i]->exit();
+        AS_DELETE(m_pTcpConnMgr[i]);
     }
+    m_ulTcpConnMgrNum = 0;
 
 #if AS_APP_OS == AS_OS_WIN32
     (void)WSACleanup();
@@ -2859,6 +3606,31 @@ void CConnMgr::setDefaultLocalAddr(const char *szLocalIpAddr)
     return;
 }
 
+/*******************************************************************************
+  Function:       CConnMgr::selectTcpConnMgr()
+  Description:    תʽѡڵķӦ
+  Calls:
+  Called By:
+  Input:          
+  Output:         
+  Return:         ӦûʱNULL
+*******************************************************************************/
+CTcpConnMgr *CConnMgr::selectTcpConnMgr(void)
+{
+    if(0 == m_ulTcpConnMgrNum)
+    {
+        return NULL;
+    }
+
+#if AS_APP_OS == AS_OS_WIN32
+    ULONG ulIndex = (ULONG)InterlockedIncrement((volatile LONG *)&m_ulNextTcpConnMgr) - 1;
+#else
+    ULONG ulIndex = __atomic_fetch_add(&m_ulNextTcpConnMgr, 1, __ATOMIC_RELAXED);
+#endif
+
+    return m_pTcpConnMgr[ulIndex % m_ulTcpConnMgrNum];
+}
+
 /*******************************************************************************
   Function:       CConnMgr::regTcpClient()
   Description:    TCPͻ
@@ -2904,7 +3676,8 @@ long CConnMgr::regTcpClient( const CNetworkAddr *pLocalAddr,
         return AS_ERROR_CODE_FAIL;
     }
 
-    if(NULL == m_pTcpConnMgr)
+    CTcpConnMgr *pTcpConnMgr = selectTcpConnMgr();
+    if(NULL == pTcpConnMgr)
     {
         CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
             "CConnMgr::regTcpClient: m_pTcpConnMgr is NULL", _FL_);
@@ -2935,7 +3708,7 @@ long CConnMgr::regTcpClient( const CNetworkAddr *pLocalAddr,
         return lRetVal;
     }
 
-    lRetVal = m_pTcpConnMgr->addHandle(pTcpConnHandle);
+    lRetVal = pTcpConnMgr->addHandle(pTcpConnHandle);
     if(lRetVal != AS_ERROR_CODE_OK)
     {
         pTcpConnHandle->close();
@@ -2979,14 +3752,16 @@ void CConnMgr::removeTcpClient(CTcpConnHandle *pTcpConnHandle)
     //ԹرsocketҪͼsocket¼ʱҪ.
     //pTcpConnHandle->close();
 
-    if(NULL == m_pTcpConnMgr)
+    //עʱڵķӦע
+    CHandleManager *pHandleMgr = pTcpConnHandle->m_pHandleMgr;
+    if(NULL == pHandleMgr)
     {
         CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
-            "CConnMgr::removeTcpClient: m_pTcpConnMgr is NULL", _FL_);
+            "CConnMgr::removeTcpClient: handle is not registered", _FL_);
         return;
     }
 
-    m_pTcpConnMgr->removeHandle(pTcpConnHandle);
+    pHandleMgr->removeHandle(pTcpConnHandle);
 
     return;
 }
@@ -3027,7 +3802,7 @@ long CConnMgr::regTcpServer(const CNetworkAddr *pLocalAddr,
         return AS_ERROR_CODE_FAIL;
     }
 
-    if(NULL == m_pTcpConnMgr)
+    if(0 == m_ulTcpConnMgrNum)
     {
         CONN_WRITE_LOG(CONN_WARNING, (char *)"FILE(%s)LINE(%d): "
             "CConnMgr::regTcpServer: m_pTcpConnMgr is NULL", _FL_);
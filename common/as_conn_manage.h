@@ -39,9 +39,11 @@
 #include <unistd.h>
 #include <stdio.h>
 
+extern "C"{
 #include "as_config.h"
 #include "as_basetype.h"
 #include "as_common.h"
+}
 #include "as.h"
 
 #define InvalidFd -1
@@ -58,9 +60,16 @@
 
 #define MAX_LISTEN_QUEUE_SIZE 2000
 #define EPOLL_MAX_EVENT (MAX_LISTEN_QUEUE_SIZE + 1000)
-#define MAX_EPOLL_FD_SIZE 3000
+#define MAX_EPOLL_FD_SIZE 3000 //epoll_createʾֵں˲ݴƾ
 #define LINGER_WAIT_SECONDS 1 //LINGERȴʱ(seconds)
 
+#define MAX_CONN_REACTOR_NUM 16 //TCPӷӦ߳
+#define DEFAULT_TCP_SEND_QUEUE_SIZE (4 * 1024 * 1024) //ÿӷͶеȱʡ
+#define TCP_SEND_BLOCK_SIZE (16 * 1024) //ͶеĿССϲͬһ
+#define CONN_MAX_IOV 64 //һsendmsgЯĿ
+#define CONN_SYNC_SEND_TIMEOUT 3000 //ͬ͵ȴдʱ(ms)
+#define CONN_CLOSE_DRAIN_TIMEOUT (LINGER_WAIT_SECONDS * 1000) //رǰͻѹݵʱ(ms)
+
 //ӹô
 #if AS_APP_OS == AS_OS_LINUX
 #define CONN_ERR_TIMEO      ETIMEDOUT
@@ -149,9 +158,21 @@ typedef enum tagEpollEventType
 
 class CHandle;
 class CHandleNode;
+class CHandleManager;
 typedef std::list<CHandleNode *> ListOfHandle;
 typedef ListOfHandle::iterator ListOfHandleIte;
 
+//Ͷеһݣ[ulHead, ulTail)ΪδͲ
+typedef struct tagSendBlock
+{
+    char *pData;
+    ULONG ulSize;
+    ULONG ulHead;
+    ULONG ulTail;
+} SendBlock;
+typedef std::list<SendBlock> ListOfSendBlock;
+typedef ListOfSendBlock::iterator ListOfSendBlockIte;
+
 class CHandle
 {
   public:
@@ -162,26 +183,19 @@ class CHandle
     virtual long initHandle(void);
     virtual void setHandleSend(AS_BOOLEAN bHandleSend);
     virtual void setHandleRecv(AS_BOOLEAN bHandleRecv);
-    ULONG getEvents(void)
-    {
-        if(m_pMutexHandle != NULL)
-        {
-            (void)as_mutex_lock(m_pMutexHandle);
-        }
-
-        ULONG ulEvents = m_ulEvents;
-
-        if(m_pMutexHandle != NULL)
-        {
-            (void)as_mutex_unlock(m_pMutexHandle);
-        }
-        return ulEvents;
-    };
+    ULONG getEvents(void);
+    AS_BOOLEAN takeEvent(ULONG ulEvent);
+    void setReady(ULONG ulEvents);
+    void clearReady(ULONG ulEvents);
     virtual void close(void);
 
+  protected:
+    void rearmEvent(void);
+
   public:
     long m_lSockFD;
     CHandleNode *m_pHandleNode;
+    CHandleManager *m_pHandleMgr;   //ķӦ
     CNetworkAddr m_localAddr;
 
 #if AS_APP_OS == AS_OS_WIN32
@@ -192,7 +206,8 @@ class CHandle
 #if AS_APP_OS == AS_OS_LINUX
     long m_lEpfd;
 #endif  //#if
-    ULONG m_ulEvents;
+    volatile ULONG m_ulEvents;  //ʹҪ¼ԭӶд
+    volatile ULONG m_ulReady;   //شϱδдEAGAIN¼
     as_mutex_t *m_pMutexHandle;
 };
 
@@ -254,10 +269,33 @@ class CTcpConnHandle : public CNetworkHandle
         return m_lConnStatus;
     };
     virtual void close(void);
+#if AS_APP_OS == AS_OS_LINUX
+    virtual long flushSendQueue(void);
+    long drainSendQueue(ULONG ulTimeOut);
+    ULONG getSendQueueSize(void) const
+    {
+        return m_ulSendQueueSize;
+    };
+    void setMaxSendQueueSize(ULONG ulMaxSize)
+    {
+        m_ulMaxSendQueueSize = ulMaxSize;
+    };
+
+  protected:
+    long queueSendData(const char *pArrayData, const ULONG ulDataSize);
+    void clearSendQueue(void);
+#endif
 
   public:
     ConnStatus m_lConnStatus;
     CNetworkAddr m_peerAddr;
+
+#if AS_APP_OS == AS_OS_LINUX
+  protected:
+    ListOfSendBlock m_listSendBlock;
+    volatile ULONG m_ulSendQueueSize;
+    ULONG m_ulMaxSendQueueSize;
+#endif
 };
 
 class CUdpSockHandle : public CNetworkHandle
@@ -364,22 +402,38 @@ class CTcpServerMgr : public CHandleManager
   public:
     CTcpServerMgr()
     {
-        m_pTcpConnMgr = NULL;
+        memset(m_pTcpConnMgr, 0, sizeof(m_pTcpConnMgr));
+        m_ulTcpConnMgrNum = 0;
+        m_ulNextTcpConnMgr = 0;
+        m_lSpareFd = InvalidFd;
         (void)strncpy(m_szMgrType, "CTcpServerMgr", MAX_HANDLE_MGR_TYPE_LEN);
+        reserveSpareFd();
     };
+    virtual ~CTcpServerMgr();
 
   public:
-    void setTcpClientMgr(CTcpConnMgr *pTcpConnMgr)
+    //ӰתʽָӦ
+    void setTcpClientMgr(CTcpConnMgr **ppTcpConnMgr, ULONG ulMgrNum)
     {
-        m_pTcpConnMgr = pTcpConnMgr;
+        m_ulTcpConnMgrNum = 0;
+        for(ULONG i = 0; (i < ulMgrNum) && (i < MAX_CONN_REACTOR_NUM); ++i)
+        {
+            m_pTcpConnMgr[m_ulTcpConnMgrNum++] = ppTcpConnMgr[i];
+        }
     };
 
   protected:
     virtual void checkSelectResult(const EpollEventType enEpEvent,
         CHandle *pHandle);  /*lint !e1768*///Ҫθýӿ
+    long acceptConn(CTcpServerHandle *pTcpServerHandle);
+    void reserveSpareFd(void);
+    long rejectConn(CTcpServerHandle *pTcpServerHandle);
 
   protected:
-    CTcpConnMgr *m_pTcpConnMgr;
+    CTcpConnMgr *m_pTcpConnMgr[MAX_CONN_REACTOR_NUM];
+    ULONG m_ulTcpConnMgrNum;
+    ULONG m_ulNextTcpConnMgr;
+    long m_lSpareFd;    //ľʱڳһܲرӣⶪʧ
 };
 
 #define DEFAULT_SELECT_PERIOD 20
@@ -422,8 +476,10 @@ class CConnMgr
 protected:
     CConnMgr();
 public:
+    //ulReactorNum: TCPӷӦ߳0ʾCPU
     virtual long init(const ULONG ulSelectPeriod, const AS_BOOLEAN bHasUdpSock,
-        const AS_BOOLEAN bHasTcpClient, const AS_BOOLEAN bHasTcpServer);
+        const AS_BOOLEAN bHasTcpClient, const AS_BOOLEAN bHasTcpServer,
+        const ULONG ulReactorNum = 0);
     virtual void setLogWriter(IConnMgrLog *pConnMgrLog) const
     {
         g_pConnMgrLog = pConnMgrLog;
@@ -445,9 +501,14 @@ public:
                                  const CNetworkAddr *pMultiAddr= NULL);
     virtual void removeUdpSocket(CUdpSockHandle *pUdpSockHandle);
 
+  protected:
+    CTcpConnMgr *selectTcpConnMgr(void);
+
   protected:
     long m_lLocalIpAddr;
-    CTcpConnMgr *m_pTcpConnMgr;
+    CTcpConnMgr *m_pTcpConnMgr[MAX_CONN_REACTOR_NUM];
+    ULONG m_ulTcpConnMgrNum;
+    volatile ULONG m_ulNextTcpConnMgr;
     CUdpSockMgr *m_pUdpSockMgr;
     CTcpServerMgr *m_pTcpServerMgr;
 };
@@ -0,0 +1,639 @@
+#include <stdlib.h>
+#include <string.h>
+#include "as_env_pool.h"
+#include "as_lock_guard.h"
+#include "as_log.h"
+#include "as_mem.h"
+#include "as_ini_config.h"
+extern "C"{
+#include "as_time.h"
+}
+#include "BasicUsageEnvironment.hh"
+#if AS_APP_OS == AS_OS_LINUX
+#include "EpollTaskScheduler.hh"
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/time.h>
+#define AS_THREAD_LOCAL __thread
+#elif AS_APP_OS == AS_OS_WIN32
+#define AS_THREAD_LOCAL __declspec(thread)
+#endif
+
+struct tagAS_ENV_LOOP
+{
+    as_env_pool          *pPool;
+    uint32_t              ulIndex;
+    int32_t               lCpu;
+    as_thread_t          *pThread;
+    volatile char         cWatchVar;  /* set to stop the loop */
+    TaskScheduler        *pScheduler;
+    UsageEnvironment     *volatile pEnv;
+    TaskToken             statTask;
+    /* the command mailbox,pushed by any thread,drained by the loop thread */
+    AS_ENV_CMD           *volatile pCmdHead;
+    EventTriggerId        cmdTrigger;
+    uint64_t              ullCmdPosted;
+    uint64_t              ullCmdRun;
+    uint32_t              ulSessions;
+    /* written by the loop thread only */
+    uint64_t              ullBytes;
+    uint64_t              ullPackets;
+    uint64_t              ullLastBytes;
+    uint64_t              ullLastPackets;
+    uint32_t              ulLastStatTime;
+    /* smoothed rates,read by the other threads */
+    uint64_t              ullBytesPerSec;
+    uint64_t              ullPacketsPerSec;
+};
+
+/* the loop run by the calling thread,NULL on the other threads */
+static AS_THREAD_LOCAL AS_ENV_LOOP* g_pCurLoop = NULL;
+
+static inline uint64_t envLoad64(uint64_t *pullValue)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)pullValue, 0, 0);
+#else
+    return __atomic_load_n(pullValue, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline void envStore64(uint64_t *pullValue, uint64_t ullValue)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    (void)InterlockedExchange64((volatile LONG64 *)pullValue, (LONG64)ullValue);
+#else
+    __atomic_store_n(pullValue, ullValue, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline void envAdd64(uint64_t *pullValue, uint64_t ullDelta)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    (void)InterlockedExchangeAdd64((volatile LONG64 *)pullValue, (LONG64)ullDelta);
+#else
+    (void)__atomic_add_fetch(pullValue, ullDelta, __ATOMIC_RELAXED);
+#endif
+}
+
+/* push pCmd on the head of the mailbox */
+static inline void envPushCmd(AS_ENV_CMD *volatile *ppHead, AS_ENV_CMD *pCmd)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    AS_ENV_CMD* pHead = NULL;
+    do {
+        pHead       = *ppHead;
+        pCmd->pNext = pHead;
+    } while(InterlockedCompareExchangePointer((PVOID volatile *)ppHead, pCmd, pHead) != pHead);
+#else
+    AS_ENV_CMD* pHead = __atomic_load_n(ppHead, __ATOMIC_RELAXED);
+    do {
+        pCmd->pNext = pHead;
+    } while(!__atomic_compare_exchange_n(ppHead, &pHead, pCmd, true,
+                                         __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#endif
+}
+
+/* take the whole mailbox,NULL if it is empty */
+static inline AS_ENV_CMD* envTakeCmds(AS_ENV_CMD *volatile *ppHead)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    return (AS_ENV_CMD*)InterlockedExchangePointer((PVOID volatile *)ppHead, NULL);
+#else
+    return __atomic_exchange_n(ppHead, (AS_ENV_CMD*)NULL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+as_env_pool::as_env_pool()
+{
+    m_mutex        = NULL;
+    m_pLoops       = NULL;
+    m_ulCount      = 0;
+    m_ulMaxCount   = 0;
+    m_ulConfCount  = 0;
+    m_bPinCpu      = true;
+    m_ullHotLoad   = AS_ENV_POOL_HOT_LOAD_DEFAULT;
+    m_pStartEvent  = NULL;
+    m_bGrowing     = false;
+}
+
+as_env_pool::~as_env_pool()
+{
+}
+
+uint32_t as_env_pool::cpu_count()
+{
+    uint32_t ulCount = 1;
+#if AS_APP_OS == AS_OS_LINUX
+    long lCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if(0 < lCount) {
+        ulCount = (uint32_t)lCount;
+    }
+#elif AS_APP_OS == AS_OS_WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    if(0 < info.dwNumberOfProcessors) {
+        ulCount = (uint32_t)info.dwNumberOfProcessors;
+    }
+#endif
+    return ulCount;
+}
+
+void as_env_pool::set_conf(uint32_t ulCount, uint32_t ulMaxCount, bool bPinCpu)
+{
+    m_ulConfCount = ulCount;
+    m_ulMaxCount  = ulMaxCount;
+    m_bPinCpu     = bPinCpu;
+}
+
+void as_env_pool::read_conf(as_ini_config& config)
+{
+    std::string strValue = "";
+
+    if(INI_SUCCESS == config.GetValue("ENV_CFG","EnvCount",strValue)) {
+        m_ulConfCount = atoi(strValue.c_str());
+    }
+    if(INI_SUCCESS == config.GetValue("ENV_CFG","EnvMaxCount",strValue)) {
+        m_ulMaxCount = atoi(strValue.c_str());
+    }
+    if(INI_SUCCESS == config.GetValue("ENV_CFG","EnvCpuPin",strValue)) {
+        m_bPinCpu = (0 != atoi(strValue.c_str()));
+    }
+    if(INI_SUCCESS == config.GetValue("ENV_CFG","EnvHotLoad",strValue)) {
+        m_ullHotLoad = (uint64_t)strtoull(strValue.c_str(),NULL,10)*1024;
+    }
+}
+
+int32_t as_env_pool::open()
+{
+    AS_LOG(AS_LOG_DEBUG,"as_env_pool::open begin.");
+    uint32_t ulCount    = m_ulConfCount;
+    uint32_t ulMaxCount = m_ulMaxCount;
+
+    if(0 == ulMaxCount) {
+        ulMaxCount = cpu_count();
+    }
+    if(AS_ENV_POOL_MAX_COUNT < ulMaxCount) {
+        ulMaxCount = AS_ENV_POOL_MAX_COUNT;
+    }
+    if(0 == ulCount) {
+        ulCount = AS_ENV_POOL_DEFAULT_COUNT;
+    }
+    if(ulCount > ulMaxCount) {
+        ulCount = ulMaxCount;
+    }
+
+    m_mutex = as_create_mutex();
+    if(NULL == m_mutex) {
+        AS_LOG(AS_LOG_ERROR,"as_env_pool::open,create mutex fail.");
+        return AS_ERROR_CODE_FAIL;
+    }
+    m_pStartEvent = as_create_event();
+    if(NULL == m_pStartEvent) {
+        AS_LOG(AS_LOG_ERROR,"as_env_pool::open,create the start event fail.");
+        close();
+        return AS_ERROR_CODE_FAIL;
+    }
+
+    m_pLoops = AS_NEW(m_pLoops,ulMaxCount);
+    if(NULL == m_pLoops) {
+        AS_LOG(AS_LOG_ERROR,"as_env_pool::open,create the loop array fail.");
+        close();
+        return AS_ERROR_CODE_FAIL;
+    }
+    memset(m_pLoops,0,sizeof(AS_ENV_LOOP)*ulMaxCount);
+
+    m_ulMaxCount   = ulMaxCount;
+    m_ulCount      = 0;
+    m_bGrowing     = false;
+
+    for(uint32_t i = 0; i < ulCount; i++) {
+        if(AS_ERROR_CODE_OK != start_loop(i)) {
+            AS_LOG(AS_LOG_ERROR,"as_env_pool::open,start the loop:[%d] fail.",i);
+            /* stop the loops already started */
+            close();
+            return AS_ERROR_CODE_FAIL;
+        }
+        m_ulCount = i + 1;
+    }
+
+    AS_LOG(AS_LOG_INFO,"as_env_pool::open end,loop count:[%d],max count:[%d],pin cpu:[%d].",
+                       ulCount,ulMaxCount,m_bPinCpu);
+    return AS_ERROR_CODE_OK;
+}
+
+void as_env_pool::close()
+{
+    AS_LOG(AS_LOG_DEBUG,"as_env_pool::close begin.");
+    uint32_t i = 0;
+    /* let all the loops stop together,then wait for each */
+    for(i = 0; i < m_ulCount; i++) {
+        m_pLoops[i].cWatchVar = 1;
+    }
+    for(i = 0; i < m_ulCount; i++) {
+        stop_loop(&m_pLoops[i]);
+    }
+    m_ulCount = 0;
+
+    if(NULL != m_pLoops) {
+        AS_DELETE(m_pLoops,MULTI);
+        m_pLoops = NULL;
+    }
+    if(NULL != m_pStartEvent) {
+        (void)as_destroy_event(m_pStartEvent);
+        m_pStartEvent = NULL;
+    }
+    if(NULL != m_mutex) {
+        as_destroy_mutex(m_mutex);
+        m_mutex = NULL;
+    }
+    AS_LOG(AS_LOG_DEBUG,"as_env_pool::close end.");
+}
+
+uint32_t as_env_pool::alloc_env()
+{
+    return alloc_env(0);
+}
+
+uint32_t as_env_pool::alloc_env(uint32_t ulMaxSessions)
+{
+    as_mutex_lock(m_mutex);
+    uint32_t index = AS_ENV_POOL_INVALID_INDEX;
+    uint64_t ullMin = 0xFFFFFFFFFFFFFFFFULL;
+    uint64_t ullLoad = 0;
+
+    for(uint32_t i = 0; i < m_ulCount; i++) {
+        if((0 != ulMaxSessions) && (m_pLoops[i].ulSessions >= ulMaxSessions)) {
+            continue;
+        }
+        ullLoad = loop_load(&m_pLoops[i]);
+        if((AS_ENV_POOL_INVALID_INDEX == index) || (ullMin > ullLoad)) {
+            index = i;
+            ullMin = ullLoad;
+        }
+    }
+
+    /*
+     * every loop is hot or full,take one more core if we may.the new loop is
+     * started without m_mutex,so the other callers go on meanwhile(they do not
+     * grow the pool too),and it is counted only once its env is up.
+     */
+    if((ullMin > m_ullHotLoad) && (m_ulCount < m_ulMaxCount) && (!m_bGrowing)) {
+        uint32_t ulNew = m_ulCount;
+        m_bGrowing = true;
+        as_mutex_unlock(m_mutex);
+
+        int32_t nRet = start_loop(ulNew);
+
+        as_mutex_lock(m_mutex);
+        m_bGrowing = false;
+        if(AS_ERROR_CODE_OK == nRet) {
+            m_ulCount = ulNew + 1;
+            index = ulNew;
+            AS_LOG(AS_LOG_INFO,"as_env_pool::alloc_env,all loops are hot,start the loop:[%d].",index);
+        }
+        else {
+            AS_LOG(AS_LOG_WARNING,"as_env_pool::alloc_env,start the loop:[%d] fail.",ulNew);
+        }
+    }
+
+    if(AS_ENV_POOL_INVALID_INDEX != index) {
+        m_pLoops[index].ulSessions++;
+    }
+    as_mutex_unlock(m_mutex);
+    return index;
+}
+
+bool as_env_pool::has_room(uint32_t ulMaxSessions)
+{
+    as_lock_guard locker(m_mutex);
+    if((0 == ulMaxSessions) || (m_ulCount < m_ulMaxCount)) {
+        return true;
+    }
+    for(uint32_t i = 0; i < m_ulCount; i++) {
+        if(m_pLoops[i].ulSessions < ulMaxSessions) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void as_env_pool::release_env(uint32_t ulIndex)
+{
+    as_lock_guard locker(m_mutex);
+    if((ulIndex >= m_ulCount) || (0 == m_pLoops[ulIndex].ulSessions)) {
+        return;
+    }
+    m_pLoops[ulIndex].ulSessions--;
+}
+
+UsageEnvironment* as_env_pool::get_env(uint32_t ulIndex)
+{
+    if(ulIndex >= m_ulCount) {
+        return NULL;
+    }
+    return m_pLoops[ulIndex].pEnv;
+}
+
+uint32_t as_env_pool::env_count()
+{
+    return m_ulCount;
+}
+
+int32_t as_env_pool::get_load(uint32_t ulIndex, AS_ENV_LOAD& load)
+{
+    as_lock_guard locker(m_mutex);
+    if(ulIndex >= m_ulCount) {
+        return AS_ERROR_CODE_FAIL;
+    }
+    AS_ENV_LOOP* pLoop = &m_pLoops[ulIndex];
+    load.ulSessions       = pLoop->ulSessions;
+    load.ullBytesPerSec   = envLoad64(&pLoop->ullBytesPerSec);
+    load.ullPacketsPerSec = envLoad64(&pLoop->ullPacketsPerSec);
+    load.ullLoad          = loop_load(pLoop);
+    load.lCpu             = pLoop->lCpu;
+    return AS_ERROR_CODE_OK;
+}
+
+void as_env_pool::set_hot_load(uint64_t ullHotLoad)
+{
+    m_ullHotLoad = ullHotLoad;
+}
+
+void as_env_pool::add_traffic(uint32_t ulBytes, uint32_t ulPackets)
+{
+    AS_ENV_LOOP* pLoop = g_pCurLoop;
+    if(NULL == pLoop) {
+        return;
+    }
+    pLoop->ullBytes   += ulBytes;
+    pLoop->ullPackets += ulPackets;
+}
+
+int32_t as_env_pool::post(uint32_t ulIndex, AS_ENV_CMD_FUNC pFunc, void* pArg,
+                          AS_ENV_CMD_FREE pFree)
+{
+    if((ulIndex >= m_ulCount) || (NULL == pFunc)) {
+        return AS_ERROR_CODE_FAIL;
+    }
+    AS_ENV_LOOP* pLoop = &m_pLoops[ulIndex];
+    if((NULL == pLoop->pEnv) || (0 == pLoop->cmdTrigger)) {
+        return AS_ERROR_CODE_FAIL;
+    }
+
+    AS_ENV_CMD* pCmd = NULL;
+    pCmd = AS_NEW(pCmd);
+    if(NULL == pCmd) {
+        AS_LOG(AS_LOG_ERROR,"as_env_pool::post,create the command for the loop:[%d] fail.",ulIndex);
+        return AS_ERROR_CODE_FAIL;
+    }
+    pCmd->pFunc = pFunc;
+    pCmd->pArg  = pArg;
+    pCmd->pFree = pFree;
+
+    /* push on the head,the loop takes the whole list and reverses it */
+    envPushCmd(&pLoop->pCmdHead, pCmd);
+    envAdd64(&pLoop->ullCmdPosted, 1);
+
+    pLoop->pScheduler->triggerEvent(pLoop->cmdTrigger, pLoop);
+    return AS_ERROR_CODE_OK;
+}
+
+int32_t as_env_pool::get_cmd_count(uint32_t ulIndex, uint64_t& ullPosted, uint64_t& ullRun)
+{
+    if(ulIndex >= m_ulCount) {
+        return AS_ERROR_CODE_FAIL;
+    }
+    AS_ENV_LOOP* pLoop = &m_pLoops[ulIndex];
+    ullPosted = envLoad64(&pLoop->ullCmdPosted);
+    ullRun    = envLoad64(&pLoop->ullCmdRun);
+    return AS_ERROR_CODE_OK;
+}
+
+int32_t as_env_pool::start_loop(uint32_t ulIndex)
+{
+    AS_ENV_LOOP* pLoop = &m_pLoops[ulIndex];
+    memset(pLoop,0,sizeof(AS_ENV_LOOP));
+    pLoop->pPool   = this;
+    pLoop->ulIndex = ulIndex;
+    pLoop->lCpu    = m_bPinCpu ? (int32_t)(ulIndex % cpu_count()) : -1;
+
+    if( AS_ERROR_CODE_OK != as_create_thread((AS_THREAD_FUNC)env_invoke,
+                                             pLoop,&pLoop->pThread,AS_DEFAULT_STACK_SIZE)) {
+        AS_LOG(AS_LOG_ERROR,"as_env_pool::start_loop,create the loop thread:[%d] fail.",ulIndex);
+        return AS_ERROR_CODE_FAIL;
+    }
+
+    /* the env is made by the loop thread,wait for it */
+    if(!wait_loop_up(pLoop)) {
+        AS_LOG(AS_LOG_ERROR,"as_env_pool::start_loop,the loop:[%d] does not come up.",ulIndex);
+        stop_loop(pLoop);
+        return AS_ERROR_CODE_FAIL;
+    }
+    return AS_ERROR_CODE_OK;
+}
+
+void as_env_pool::stop_loop(AS_ENV_LOOP* pLoop)
+{
+    /* a loop which is not up yet leaves its event loop as soon as it enters it */
+    pLoop->cWatchVar = 1;
+    if(NULL != pLoop->pThread) {
+        as_join_thread(pLoop->pThread);
+        pLoop->pThread = NULL;
+    }
+    /* posted after the loop took its last commands,there is no env to run them */
+    AS_ENV_CMD* pCmd = envTakeCmds(&pLoop->pCmdHead);
+    while(NULL != pCmd) {
+        AS_ENV_CMD* pNext = pCmd->pNext;
+        AS_LOG(AS_LOG_WARNING,"as_env_pool::stop_loop,drop a command posted to the stopped loop:[%d].",
+                              pLoop->ulIndex);
+        if(NULL != pCmd->pFree) {
+            pCmd->pFree(pCmd->pArg);
+        }
+        AS_DELETE(pCmd);
+        pCmd = pNext;
+    }
+}
+
+bool as_env_pool::wait_loop_up(AS_ENV_LOOP* pLoop)
+{
+    uint32_t ulStartTime = as_get_cur_msecond();
+    uint32_t ulPassTime  = 0;
+#if AS_APP_OS == AS_OS_LINUX
+    /* the env is checked under the mutex of the event,so the signal can not
+       come between the check and the wait */
+    (void)pthread_mutex_lock(&m_pStartEvent->EventMutex);
+    while(NULL == pLoop->pEnv) {
+        ulPassTime = as_get_cur_msecond() - ulStartTime;
+        if(ulPassTime >= AS_ENV_POOL_START_TIMEOUT) {
+            break;
+        }
+        uint32_t ulWaitTime = AS_ENV_POOL_START_TIMEOUT - ulPassTime;
+        struct timespec ts;
+        struct timeval  tv;
+        gettimeofday(&tv, NULL);
+        ts.tv_sec  = tv.tv_sec + ulWaitTime/1000;
+        ts.tv_nsec = (tv.tv_usec + (ulWaitTime%1000)*1000)*1000;
+        if(ts.tv_nsec >= 1000000000) {
+            ts.tv_sec  += 1;
+            ts.tv_nsec -= 1000000000;
+        }
+        (void)pthread_cond_timedwait(&m_pStartEvent->EventCond,&m_pStartEvent->EventMutex,&ts);
+    }
+    (void)pthread_mutex_unlock(&m_pStartEvent->EventMutex);
+#elif AS_APP_OS == AS_OS_WIN32
+    /* an auto-reset event keeps a signal that comes before the wait */
+    while(NULL == pLoop->pEnv) {
+        ulPassTime = as_get_cur_msecond() - ulStartTime;
+        if(ulPassTime >= AS_ENV_POOL_START_TIMEOUT) {
+            break;
+        }
+        (void)as_wait_event(m_pStartEvent,(int32_t)(AS_ENV_POOL_START_TIMEOUT - ulPassTime));
+    }
+#endif
+    return (NULL != pLoop->pEnv);
+}
+
+void as_env_pool::notify_loop_up()
+{
+#if AS_APP_OS == AS_OS_LINUX
+    (void)pthread_mutex_lock(&m_pStartEvent->EventMutex);
+    (void)pthread_cond_broadcast(&m_pStartEvent->EventCond);
+    (void)pthread_mutex_unlock(&m_pStartEvent->EventMutex);
+#elif AS_APP_OS == AS_OS_WIN32
+    (void)as_set_event(m_pStartEvent);
+#endif
+}
+
+uint64_t as_env_pool::loop_load(AS_ENV_LOOP* pLoop)
+{
+    return envLoad64(&pLoop->ullBytesPerSec)
+         + envLoad64(&pLoop->ullPacketsPerSec)*AS_ENV_POOL_PACKET_COST
+         + (uint64_t)pLoop->ulSessions*AS_ENV_POOL_SESSION_COST;
+}
+
+void *as_env_pool::env_invoke(void *arg)
+{
+    AS_ENV_LOOP* pLoop = (AS_ENV_LOOP*)arg;
+    pLoop->pPool->env_thread(pLoop);
+    return NULL;
+}
+
+void as_env_pool::env_thread(AS_ENV_LOOP* pLoop)
+{
+    AS_LOG(AS_LOG_DEBUG,"as_env_pool::env_thread,index:[%d] begin.",pLoop->ulIndex);
+
+#if AS_APP_OS == AS_OS_LINUX
+    if(0 <= pLoop->lCpu) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(pLoop->lCpu,&cpuSet);
+        if(0 != pthread_setaffinity_np(pthread_self(),sizeof(cpuSet),&cpuSet)) {
+            AS_LOG(AS_LOG_WARNING,"as_env_pool::env_thread,pin the loop:[%d] to cpu:[%d] fail.",
+                                  pLoop->ulIndex,pLoop->lCpu);
+            pLoop->lCpu = -1;
+        }
+    }
+    pLoop->pScheduler = EpollTaskScheduler::createNew();
+#elif AS_APP_OS == AS_OS_WIN32
+    if(0 <= pLoop->lCpu) {
+        SetThreadAffinityMask(GetCurrentThread(),((DWORD_PTR)1) << pLoop->lCpu);
+    }
+    pLoop->pScheduler = BasicTaskScheduler::createNew();
+#endif
+    UsageEnvironment* env = BasicUsageEnvironment::createNew(*pLoop->pScheduler);
+
+    g_pCurLoop = pLoop;
+    pLoop->cmdTrigger = pLoop->pScheduler->createEventTrigger(cmd_handler);
+    if(0 == pLoop->cmdTrigger) {
+        AS_LOG(AS_LOG_WARNING,"as_env_pool::env_thread,create the command trigger of the loop:[%d] fail.",
+                              pLoop->ulIndex);
+    }
+    pLoop->ulLastStatTime = as_get_cur_msecond();
+    pLoop->statTask = pLoop->pScheduler->scheduleDelayedTask(AS_ENV_POOL_STAT_INTERVAL*1000,
+                                                             stat_task, pLoop);
+    pLoop->pEnv = env;
+    notify_loop_up();
+
+    // All subsequent activity takes place within the event loop:
+    env->taskScheduler().doEventLoop(&pLoop->cWatchVar);
+
+    // LOOP EXIST
+    pLoop->pScheduler->unscheduleDelayedTask(pLoop->statTask);
+    /* the sessions are closed by the commands still queued,run them */
+    drain_cmd(pLoop);
+    if(0 != pLoop->cmdTrigger) {
+        pLoop->pScheduler->deleteEventTrigger(pLoop->cmdTrigger);
+    }
+    g_pCurLoop = NULL;
+    pLoop->pEnv = NULL;
+    env->reclaim();
+    env = NULL;
+    delete pLoop->pScheduler;
+    pLoop->pScheduler = NULL;
+    AS_LOG(AS_LOG_INFO,"as_env_pool::env_thread,index:[%d] end.",pLoop->ulIndex);
+    return;
+}
+
+void as_env_pool::stat_task(void* clientData)
+{
+    AS_ENV_LOOP* pLoop = (AS_ENV_LOOP*)clientData;
+
+    /*
+     * triggerEvent() is not atomic against the loop clearing another trigger,
+     * a lost wakeup only delays the commands until this tick.
+     */
+    drain_cmd(pLoop);
+    uint32_t ulNow     = as_get_cur_msecond();
+    uint32_t ulElapsed = ulNow - pLoop->ulLastStatTime;
+
+    if(0 < ulElapsed) {
+        uint64_t ullBytesPerSec   = (pLoop->ullBytes - pLoop->ullLastBytes)*1000/ulElapsed;
+        uint64_t ullPacketsPerSec = (pLoop->ullPackets - pLoop->ullLastPackets)*1000/ulElapsed;
+
+        /* smooth over the last few intervals,so one key frame does not make a loop hot */
+        ullBytesPerSec   = (envLoad64(&pLoop->ullBytesPerSec) + ullBytesPerSec)/2;
+        ullPacketsPerSec = (envLoad64(&pLoop->ullPacketsPerSec) + ullPacketsPerSec)/2;
+        envStore64(&pLoop->ullBytesPerSec, ullBytesPerSec);
+        envStore64(&pLoop->ullPacketsPerSec, ullPacketsPerSec);
+
+        pLoop->ullLastBytes   = pLoop->ullBytes;
+        pLoop->ullLastPackets = pLoop->ullPackets;
+        pLoop->ulLastStatTime = ulNow;
+    }
+
+    pLoop->statTask = pLoop->pScheduler->scheduleDelayedTask(AS_ENV_POOL_STAT_INTERVAL*1000,
+                                                             stat_task, pLoop);
+}
+
+void as_env_pool::cmd_handler(void* clientData)
+{
+    drain_cmd((AS_ENV_LOOP*)clientData);
+}
+
+void as_env_pool::drain_cmd(AS_ENV_LOOP* pLoop)
+{
+    AS_ENV_CMD* pList = NULL;
+    AS_ENV_CMD* pCmd  = NULL;
+
+    /* a command may post again,so take the mailbox until it stays empty */
+    while(NULL != (pList = envTakeCmds(&pLoop->pCmdHead))) {
+        /* the mailbox is LIFO,reverse it to run the commands in posting order */
+        AS_ENV_CMD* pFifo = NULL;
+        while(NULL != pList) {
+            pCmd        = pList;
+            pList       = pList->pNext;
+            pCmd->pNext = pFifo;
+            pFifo       = pCmd;
+        }
+
+        while(NULL != pFifo) {
+            pCmd  = pFifo;
+            pFifo = pFifo->pNext;
+            pCmd->pFunc(*pLoop->pEnv, pCmd->pArg);
+            AS_DELETE(pCmd);
+            envAdd64(&pLoop->ullCmdRun, 1);
+        }
+    }
+}
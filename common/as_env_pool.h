@@ -0,0 +1,153 @@
+#ifndef __AS_ENV_POOL_H__
+#define __AS_ENV_POOL_H__
+
+#include <stdint.h>
+extern "C"{
+#include "as_config.h"
+#include "as_basetype.h"
+#include "as_common.h"
+#include "as_mutex.h"
+#include "as_thread.h"
+#include "as_event.h"
+}
+
+class UsageEnvironment;
+class TaskScheduler;
+class as_ini_config;
+
+#define AS_ENV_POOL_MAX_COUNT          128
+/* loops started by open() when the config does not say */
+#define AS_ENV_POOL_DEFAULT_COUNT      4
+/* the load of each loop is re-computed at this interval(ms) */
+#define AS_ENV_POOL_STAT_INTERVAL      1000
+/* how long open()/alloc_env() wait for a new loop to come up(ms) */
+#define AS_ENV_POOL_START_TIMEOUT      2000
+/*
+ * the load of a loop is counted in bytes/s,a packet costs as much as
+ * AS_ENV_POOL_PACKET_COST bytes(the syscall and the parser dominate,not
+ * the copy),a session costs AS_ENV_POOL_SESSION_COST bytes/s until its
+ * media flows so that a burst of opens is spread over the loops.
+ */
+#define AS_ENV_POOL_PACKET_COST        1024
+#define AS_ENV_POOL_SESSION_COST       (64*1024)
+/* payload of one RTP packet,to count the packets of a frame */
+#define AS_ENV_POOL_PACKET_PAYLOAD     1400
+/* a loop above this load(bytes/s) is hot,no new session is placed on it */
+#define AS_ENV_POOL_HOT_LOAD_DEFAULT   (48*1024*1024)
+/* returned by alloc_env(ulMaxSessions) when no loop may take the session */
+#define AS_ENV_POOL_INVALID_INDEX      0xFFFFFFFF
+
+typedef struct tagAS_ENV_LOAD
+{
+    uint32_t ulSessions;
+    uint64_t ullBytesPerSec;
+    uint64_t ullPacketsPerSec;
+    uint64_t ullLoad;
+    int32_t  lCpu;            /* -1 if not pinned */
+} AS_ENV_LOAD;
+
+typedef struct tagAS_ENV_LOOP AS_ENV_LOOP;
+
+/* a command posted to a loop,it runs on the loop thread with the loop's env */
+typedef void (*AS_ENV_CMD_FUNC)(UsageEnvironment& env, void* pArg);
+/* frees the argument of a command which is dropped without being run */
+typedef void (*AS_ENV_CMD_FREE)(void* pArg);
+
+typedef struct tagAS_ENV_CMD
+{
+    struct tagAS_ENV_CMD *pNext;
+    AS_ENV_CMD_FUNC       pFunc;
+    void                 *pArg;
+    AS_ENV_CMD_FREE       pFree;
+} AS_ENV_CMD;
+
+/*
+ * a pool of live555 event loops,each loop runs one UsageEnvironment on
+ * its own thread pinned to one core.alloc_env() places a new session on
+ * the least loaded loop(by bytes/s and packets/s),and starts one more loop
+ * when every running loop is hot,until ulMaxCount loops are running.
+ */
+class as_env_pool
+{
+public:
+    as_env_pool();
+    virtual ~as_env_pool();
+public:
+    /*
+     * ulCount loops are started(0:AS_ENV_POOL_DEFAULT_COUNT),the pool grows
+     * up to ulMaxCount loops(0:the number of cores).
+     */
+    void    set_conf(uint32_t ulCount, uint32_t ulMaxCount, bool bPinCpu);
+    /* [ENV_CFG] EnvCount,EnvMaxCount,EnvCpuPin,EnvHotLoad(KB/s) */
+    void    read_conf(as_ini_config& config);
+    int32_t open();
+    void    close();
+
+    /* pick the loop for a new session,the session is counted on it */
+    uint32_t alloc_env();
+    /*
+     * as alloc_env(),but skip the loops running ulMaxSessions sessions
+     * already(0:no limit),AS_ENV_POOL_INVALID_INDEX if every loop is full
+     * and the pool may not grow.
+     */
+    uint32_t alloc_env(uint32_t ulMaxSessions);
+    /* whether alloc_env(ulMaxSessions) would find a loop now */
+    bool     has_room(uint32_t ulMaxSessions);
+    void     release_env(uint32_t ulIndex);
+    UsageEnvironment* get_env(uint32_t ulIndex);
+    uint32_t env_count();
+    int32_t  get_load(uint32_t ulIndex, AS_ENV_LOAD& load);
+    void     set_hot_load(uint64_t ullHotLoad);
+
+    /*
+     * run pFunc(env,pArg) on the loop ulIndex,from any thread.the command is
+     * pushed to the loop's lock-free mailbox and the loop is woken by its event
+     * trigger,so the caller never waits for the loop.the commands posted to
+     * one loop run in the order they were posted.the commands still queued
+     * when the pool is closed are run by the loop before its env is reclaimed,
+     * a command which comes after the loop stopped is dropped by close() and
+     * its pArg is handed to pFree(if any).
+     */
+    int32_t  post(uint32_t ulIndex, AS_ENV_CMD_FUNC pFunc, void* pArg,
+                  AS_ENV_CMD_FREE pFree = NULL);
+    /* the commands posted to/run by the loop ulIndex so far */
+    int32_t  get_cmd_count(uint32_t ulIndex, uint64_t& ullPosted, uint64_t& ullRun);
+
+    /*
+     * count the media of the calling loop,call it from the loop thread
+     * (e.g. in afterGettingFrame),a call from any other thread is ignored.
+     */
+    static void add_traffic(uint32_t ulBytes, uint32_t ulPackets);
+    static void add_frame(uint32_t ulFrameSize)
+    {
+        add_traffic(ulFrameSize,
+                    (ulFrameSize + AS_ENV_POOL_PACKET_PAYLOAD - 1)/AS_ENV_POOL_PACKET_PAYLOAD);
+    }
+
+    static uint32_t cpu_count();
+private:
+    /* called without m_mutex,it waits for the loop to come up */
+    int32_t start_loop(uint32_t ulIndex);
+    void    stop_loop(AS_ENV_LOOP* pLoop);
+    bool    wait_loop_up(AS_ENV_LOOP* pLoop);
+    void    notify_loop_up();
+    uint64_t loop_load(AS_ENV_LOOP* pLoop);
+    static void *env_invoke(void *arg);
+    void env_thread(AS_ENV_LOOP* pLoop);
+    static void stat_task(void* clientData);
+    static void cmd_handler(void* clientData);
+    static void drain_cmd(AS_ENV_LOOP* pLoop);
+private:
+    as_mutex_t      *m_mutex;
+    AS_ENV_LOOP     *m_pLoops;
+    volatile uint32_t m_ulCount;
+    uint32_t         m_ulMaxCount;
+    uint32_t         m_ulConfCount;
+    bool             m_bPinCpu;
+    uint64_t         m_ullHotLoad;
+    /* signalled by a loop thread when its env is up */
+    as_event_t      *m_pStartEvent;
+    /* one alloc_env() is starting a loop,the others do not grow the pool meanwhile */
+    bool             m_bGrowing;
+};
+#endif /* __AS_ENV_POOL_H__ */
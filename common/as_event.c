@@ -66,6 +66,11 @@ int32_t as_wait_event(as_event_t *pstASEvent, int32_t lTimeOut)
     gettimeofday(&tv, 0);
     ts.tv_sec  = tv.tv_sec  + lTimeOut/1000;
     ts.tv_nsec = (tv.tv_usec + (lTimeOut %1000)*1000) * 1000;
+    if(ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec  += 1;
+        ts.tv_nsec -= 1000000000;
+    }
 
 
     (void)pthread_mutex_lock(&pstASEvent->EventMutex);
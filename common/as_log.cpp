@@ -1,4 +1,3 @@
-
 /******************************************************************************
    Ȩ (C), 2008-2011, M.Kernel
 
@@ -18,12 +17,13 @@
 
 
 #include <stdio.h>
-#include "as_ring_cache.h"
+#include <string.h>
 #include "as_log.h"
 #include <time.h>
 
 #ifdef WIN32
 #include "atlstr.h"
+#include <intrin.h>
 #endif
 extern "C"{
 #include "as_config.h"
@@ -35,6 +35,27 @@ extern "C"{
 #include "as_time.h"
 #include "as_json.h"
 }
+#if AS_APP_OS == AS_OS_LINUX
+#include <pthread.h>
+#endif
+
+#ifndef AS_THREAD_LOCAL
+#if AS_APP_OS == AS_OS_LINUX
+#define AS_THREAD_LOCAL __thread
+#elif AS_APP_OS == AS_OS_WIN32
+#define AS_THREAD_LOCAL __declspec(thread)
+#endif
+#endif
+
+#ifndef va_copy
+#define va_copy(d,s) ((d) = (s))
+#endif
+
+#if AS_APP_OS == AS_OS_WIN32
+#define as_log_snprintf _snprintf
+#else
+#define as_log_snprintf snprintf
+#endif
 
 
 
@@ -49,8 +70,6 @@ extern "C"{
 #define ASLOG_ERROR_CREATE_EVENT   (-4)    //¼
 #define ASLOG_ERROR_CREATE_THREAD  (-5)    //̳߳
 
-//ĬϻС1M
-#define DEFAULT_CACHE_SIZE          (1024*1024)
 //ĬļлȣλByte
 #define DEFAULT_CHANGE_FILE_LEN     (10*1024*1024)
 //ĬļлȣλByte
@@ -62,6 +81,19 @@ extern "C"{
 //־󳤶
 #define MAX_LEN_OF_SINGLE_LOG       2048
 
+//ÿ߳־ĴС2
+#define LOG_RING_SIZE               (256*1024)
+//һ¼(¼ͷ+)󳤶
+#define LOG_MAX_RECORD_LEN          (MAX_LEN_OF_SINGLE_LOG + 1024)
+//д߳ÿθʽĿС
+#define LOG_WRITE_BLOCK_SIZE        (256*1024)
+//һ־ͷ(ʱ䡢ļ߳)󳤶
+#define LOG_MAX_HEADER_LEN          256
+//һʽ˵󳤶ȣİִ֧
+#define LOG_MAX_SPEC_LEN            32
+//д߳δʱˢ¼(ms)
+#define LOG_FLUSH_INTERVAL          50
+
 
 //ȴ˳¼ʱ
 #define LOG_WAIT_FOR_EXIT_EVENT     5000
@@ -70,6 +102,74 @@ extern "C"{
 //ȴд
 #define LOG_WAIT_FOR_WRITE_OVER_INTERVAL 10
 
+//¼
+#define LOG_RECORD_ARGS             0   //¼ͷԭʼд̸߳ʽ
+#define LOG_RECORD_TEXT             1   //ʽвֵ֧˵¼ͷǸʽõ
+
+//еһ־¼8ֽڶ
+typedef struct tagASLogRecord
+{
+    uint32_t        ulSize;         //¼ĳȣ0ʾβʣռ䲻ãӻ׼
+    uint32_t        ulType;         //LOG_RECORD_XXX
+    uint64_t        ullTimeMs;      //1970ĺ
+    const char*     szFile;
+    const char*     szFormat;
+    long            lLine;
+    long            lLevel;
+    unsigned long   ulErr;
+    uint32_t        ulDataLen;      //¼ͷݵĳ
+    uint32_t        ulReserved;
+} AS_LOG_RECORD;
+
+//̵߳־(߳)(д߳)߲
+typedef struct tagASLogRing
+{
+    volatile uint32_t   ulHead;         //дλãֻ
+    char                szPad1[60];
+    volatile uint32_t   ulTail;         //д̶߳λãֻ
+    char                szPad2[60];
+    volatile uint64_t   ullDropped;     //־
+    volatile uint32_t   ulRetired;      //߳˳
+    uint32_t            ulThreadID;
+    //ֻд̷߳
+    uint32_t            ulReadPos;      //ֺϲλ
+    uint32_t            ulReadEnd;      //ֿʼʱulHead
+    uint64_t            ullReported;    //ѱĶ
+    uint8_t*            pBuf;
+    struct tagASLogRing* pNext;
+} AS_LOG_RING;
+
+//ʽ˵ӦĲ
+enum ASLogArgType
+{
+    LOG_ARG_NONE = 0,       //%%
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_SIZE,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_LDOUBLE,
+    LOG_ARG_PTR,
+    LOG_ARG_STR,
+    LOG_ARG_UNSUPPORTED     //%n%ls%mȣ־ڵ̸߳ʽ
+};
+
+typedef struct tagASLogSpec
+{
+    const char*     pStart;         //'%'λ
+    uint32_t        ulLen;
+    bool            bWidthArg;      //'*'
+    bool            bPrecArg;       //'*'
+    long            lPrec;          //澫ȣûΪ-1
+    ASLogArgType    enType;
+} AS_LOG_SPEC;
+
+//ǰ־ĬΪINFO
+volatile long g_lASLogLevel = AS_LOG_INFO;
+
+//̵߳־
+static AS_THREAD_LOCAL AS_LOG_RING* g_pThreadLogRing = NULL;
+
 
 class as_log
 {
@@ -96,6 +196,8 @@ class as_log
             long lLevel, const char* format, va_list argp);
         //ֹͣ־
         long Stop();
+        //־
+        unsigned long long GetDroppedCount();
 
     private:
         //дļ߳
@@ -109,6 +211,21 @@ class as_log
 
         const char* GetLevelString(long lLevel) const;
 
+        //ȡ̵߳־һд־ʱ
+        AS_LOG_RING* GetThreadRing();
+#if AS_APP_OS == AS_OS_LINUX
+        static void ThreadRingExit(void* pRing);
+#endif
+        //̵߳־ǷѶ
+        bool RingsEmpty();
+        //ʱϲ̵߳ļ¼ʽpBufbMoreʾûļ¼
+        unsigned long Drain(char* pBuf, unsigned long ulBufLen, bool& bMore);
+        unsigned long FormatHeader(char* pBuf, uint64_t ullTimeMs, long lLevel,
+                                   const char* szFile, long lLine,
+                                   uint32_t ulThreadID, unsigned long ulErr);
+        unsigned long FormatRecord(char* pBuf, unsigned long ulBufLen,
+                                   const AS_LOG_RECORD* pRecord, uint32_t ulThreadID);
+
     private:
         //־ģǷ
         bool    m_bRun;
@@ -124,9 +241,6 @@ class as_log
         //ϴμʱ(ڴ־ֹͣʱ)
         unsigned long   m_dwLastCheckDiskSpaceTime;
 
-        //־ĬΪINFO
-        long    m_lLevel;
-
         //дļ̵߳ľ
         as_thread_t* m_hWriteThread;
 
@@ -136,8 +250,19 @@ class as_log
         //д߳˳¼ľ
         as_event_t*    m_hThreadExitEvent;
 
-        //־
-        as_ring_cache    m_Cache;
+        //̵߳־ֻ߳עд̱߳ʱʹ
+        as_mutex_t*    m_pRingMutex;
+        AS_LOG_RING*   m_pRings;
+#if AS_APP_OS == AS_OS_LINUX
+        //߳˳ʱ־д̶߳պͷ
+        pthread_key_t  m_RingKey;
+#endif
+        //ͷŵ־
+        unsigned long long m_ullRetiredDropped;
+
+        //־ʱ仺棬ͬһֻʽһ
+        uint64_t m_ullCachedSecond;
+        char     m_szCachedTime[32];
 
         //־ļ
         FILE*    m_pLogFile;
@@ -155,17 +280,473 @@ class as_log
 
 as_log* as_log::g_pASLog = NULL;
 
+static inline uint32_t LogLoadAcquire(volatile uint32_t* pValue)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    uint32_t ulValue = *pValue;
+    _ReadWriteBarrier();
+    return ulValue;
+#else
+    return __atomic_load_n(pValue, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void LogStoreRelease(volatile uint32_t* pValue, uint32_t ulValue)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    _ReadWriteBarrier();
+    *pValue = ulValue;
+#else
+    __atomic_store_n(pValue, ulValue, __ATOMIC_RELEASE);
+#endif
+}
+
+//ǰʱ䣬1970ĺֻ߳ȡʱӲת
+static inline uint64_t LogNowMs()
+{
+#if AS_APP_OS == AS_OS_LINUX
+    struct timespec ts;
+#ifdef CLOCK_REALTIME_COARSE
+    (void)clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+#else
+    (void)clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#elif AS_APP_OS == AS_OS_WIN32
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    uint64_t ullTime = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    //1601굽1970100ns
+    return (ullTime - 116444736000000000ULL) / 10000;
+#endif
+}
+
+//һʽ˵pָ'%'˵λ
+static const char* LogParseSpec(const char* p, AS_LOG_SPEC& spec)
+{
+    spec.pStart    = p;
+    spec.bWidthArg = false;
+    spec.bPrecArg  = false;
+    spec.lPrec     = -1;
+    spec.enType    = LOG_ARG_UNSUPPORTED;
+    p++;
+
+    if('%' == *p)
+    {
+        spec.enType = LOG_ARG_NONE;
+        spec.ulLen  = 2;
+        return p + 1;
+    }
+
+    //־
+    while(('\0' != *p) && (NULL != ::strchr("-+ #0'", *p)))
+    {
+        p++;
+    }
+    //
+    if('*' == *p)
+    {
+        spec.bWidthArg = true;
+        p++;
+    }
+    else
+    {
+        while(('0' <= *p) && ('9' >= *p))
+        {
+            p++;
+        }
+    }
+    //
+    if('.' == *p)
+    {
+        p++;
+        if('*' == *p)
+        {
+            spec.bPrecArg = true;
+            p++;
+        }
+        else
+        {
+            spec.lPrec = 0;
+            while(('0' <= *p) && ('9' >= *p))
+            {
+                spec.lPrec = spec.lPrec * 10 + (*p - '0');
+                p++;
+            }
+        }
+    }
+    //
+    long lLong = 0;
+    bool bSize = false;
+    bool bLongDouble = false;
+    for(;;)
+    {
+        if('h' == *p)
+        {
+            p++;
+        }
+        else if('l' == *p)
+        {
+            lLong++;
+            p++;
+        }
+        else if(('q' == *p) || ('j' == *p))
+        {
+            lLong = 2;
+            p++;
+        }
+        else if(('z' == *p) || ('t' == *p))
+        {
+            bSize = true;
+            p++;
+        }
+        else if('L' == *p)
+        {
+            bLongDouble = true;
+            p++;
+        }
+        else if(('I' == *p) && ('6' == p[1]) && ('4' == p[2]))
+        {
+            lLong = 2;
+            p += 3;
+        }
+        else if(('I' == *p) && ('3' == p[1]) && ('2' == p[2]))
+        {
+            p += 3;
+        }
+        else if('I' == *p)
+        {
+            bSize = true;
+            p++;
+        }
+        else
+        {
+            break;
+        }
+    }
+    //
+    switch(*p)
+    {
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            if(bSize)
+            {
+                spec.enType = LOG_ARG_SIZE;
+            }
+            else if(2 <= lLong)
+            {
+                spec.enType = LOG_ARG_LLONG;
+            }
+            else if(1 == lLong)
+            {
+                spec.enType = LOG_ARG_LONG;
+            }
+            else
+            {
+                spec.enType = LOG_ARG_INT;
+            }
+            break;
+        case 'c':
+            spec.enType = (0 == lLong) ? LOG_ARG_INT : LOG_ARG_UNSUPPORTED;
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            spec.enType = bLongDouble ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+            break;
+        case 'p':
+            spec.enType = LOG_ARG_PTR;
+            break;
+        case 's':
+            spec.enType = (0 == lLong) ? LOG_ARG_STR : LOG_ARG_UNSUPPORTED;
+            break;
+        default:
+            break;
+    }
+    if('\0' != *p)
+    {
+        p++;
+    }
+
+    spec.ulLen = (uint32_t)(p - spec.pStart);
+    if(LOG_MAX_SPEC_LEN <= spec.ulLen)
+    {
+        spec.enType = LOG_ARG_UNSUPPORTED;
+    }
+    return p;
+}
+
+static inline void LogPutInt(uint8_t* pData, uint32_t& ulPos, int64_t llValue)
+{
+    ::memcpy(pData + ulPos, &llValue, sizeof(llValue));
+    ulPos += sizeof(int64_t);
+}
+
+static inline int64_t LogGetInt(const uint8_t* pData, uint32_t& ulPos)
+{
+    int64_t llValue;
+    ::memcpy(&llValue, pData + ulPos, sizeof(llValue));
+    ulPos += sizeof(int64_t);
+    return llValue;
+}
+
+//long double16ֽڴ
+#define LOG_LDOUBLE_SLOT    16
+//ַǰĳȣNULLָΪֵ
+#define LOG_NULL_STRING     0xFFFFFFFF
+
+//ѲʽpDataֵ֧˵ռ䲻ʱfalse
+static bool LogEncodeArgs(uint8_t* pData, uint32_t ulSize, const char* format,
+                          va_list argp, uint32_t& ulLen)
+{
+    AS_LOG_SPEC spec;
+    uint32_t ulPos = 0;
+    const char* p = format;
+    while(NULL != (p = ::strchr(p, '%')))
+    {
+        p = LogParseSpec(p, spec);
+        if(LOG_ARG_NONE == spec.enType)
+        {
+            continue;
+        }
+        if(LOG_ARG_UNSUPPORTED == spec.enType)
+        {
+            return false;
+        }
+        //ȡȺͶ40ֽ
+        if(ulPos + 40 > ulSize)
+        {
+            return false;
+        }
+        if(spec.bWidthArg)
+        {
+            LogPutInt(pData, ulPos, va_arg(argp, int));
+        }
+        long lPrec = spec.lPrec;
+        if(spec.bPrecArg)
+        {
+            lPrec = va_arg(argp, int);
+            LogPutInt(pData, ulPos, lPrec);
+        }
+
+        switch(spec.enType)
+        {
+            case LOG_ARG_INT:
+                LogPutInt(pData, ulPos, va_arg(argp, int));
+                break;
+            case LOG_ARG_LONG:
+                LogPutInt(pData, ulPos, va_arg(argp, long));
+                break;
+            case LOG_ARG_LLONG:
+                LogPutInt(pData, ulPos, va_arg(argp, long long));
+                break;
+            case LOG_ARG_SIZE:
+                LogPutInt(pData, ulPos, (int64_t)va_arg(argp, size_t));
+                break;
+            case LOG_ARG_PTR:
+                LogPutInt(pData, ulPos, (int64_t)(uintptr_t)va_arg(argp, void*));
+                break;
+            case LOG_ARG_DOUBLE:
+            {
+                double dValue = va_arg(argp, double);
+                ::memcpy(pData + ulPos, &dValue, sizeof(dValue));
+                ulPos += sizeof(int64_t);
+                break;
+            }
+            case LOG_ARG_LDOUBLE:
+            {
+                long double ldValue = va_arg(argp, long double);
+                ::memcpy(pData + ulPos, &ldValue, sizeof(ldValue));
+                ulPos += LOG_LDOUBLE_SLOT;
+                break;
+            }
+            case LOG_ARG_STR:
+            {
+                const char* pszValue = va_arg(argp, const char*);
+                uint32_t ulStrLen = LOG_NULL_STRING;
+                if(NULL != pszValue)
+                {
+                    //оʱַûн࿴ȸֽ
+                    uint32_t ulMax = ulSize - ulPos - sizeof(int64_t) - 1;
+                    if(MAX_LEN_OF_SINGLE_LOG < ulMax)
+                    {
+                        ulMax = MAX_LEN_OF_SINGLE_LOG;
+                    }
+                    if((0 <= lPrec) && ((uint32_t)lPrec < ulMax))
+                    {
+                        ulMax = (uint32_t)lPrec;
+                    }
+                    const char* pEnd = (const char*)::memchr(pszValue, '\0', ulMax);
+                    ulStrLen = (NULL != pEnd) ? (uint32_t)(pEnd - pszValue) : ulMax;
+                }
+                ::memcpy(pData + ulPos, &ulStrLen, sizeof(ulStrLen));
+                ulPos += sizeof(int64_t);
+                if(LOG_NULL_STRING != ulStrLen)
+                {
+                    ::memcpy(pData + ulPos, pszValue, ulStrLen);
+                    pData[ulPos + ulStrLen] = '\0';
+                    ulPos += (ulStrLen + 1 + 7) & ~7U;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    ulLen = ulPos;
+    return true;
+}
+
+//ʽLogEncodeArgsµĲʽдĳ
+static unsigned long LogFormatArgs(char* pBuf, unsigned long ulBufLen,
+                                   const char* format, const uint8_t* pData)
+{
+    AS_LOG_SPEC spec;
+    char szSpec[LOG_MAX_SPEC_LEN + 48];
+    unsigned long ulOut = 0;
+    uint32_t ulPos = 0;
+    const char* p = format;
+
+    while(('\0' != *p) && (ulOut + 1 < ulBufLen))
+    {
+        if('%' != *p)
+        {
+            pBuf[ulOut++] = *p++;
+            continue;
+        }
+
+        p = LogParseSpec(p, spec);
+        if(LOG_ARG_NONE == spec.enType)
+        {
+            pBuf[ulOut++] = '%';
+            continue;
+        }
+
+        //'*'ɴµĿȺ;
+        int64_t llWidth = spec.bWidthArg ? LogGetInt(pData, ulPos) : 0;
+        int64_t llPrec  = spec.bPrecArg ? LogGetInt(pData, ulPos) : 0;
+        unsigned long ulSpecLen = 0;
+        for(uint32_t i = 0; i < spec.ulLen; i++)
+        {
+            char c = spec.pStart[i];
+            if('*' != c)
+            {
+                szSpec[ulSpecLen++] = c;
+            }
+            else if((0 < ulSpecLen) && ('.' == szSpec[ulSpecLen - 1]))
+            {
+                if(0 > llPrec)
+                {
+                    //Ϊûо
+                    ulSpecLen--;
+                }
+                else
+                {
+                    ulSpecLen += (unsigned long)::sprintf(szSpec + ulSpecLen, "%d", (int)llPrec);
+                }
+            }
+            else
+            {
+                ulSpecLen += (unsigned long)::sprintf(szSpec + ulSpecLen, "%d", (int)llWidth);
+            }
+        }
+        szSpec[ulSpecLen] = '\0';
+
+        char* pOut = pBuf + ulOut;
+        unsigned long ulLeft = ulBufLen - ulOut;
+        int lResult = 0;
+        switch(spec.enType)
+        {
+            case LOG_ARG_INT:
+                lResult = as_log_snprintf(pOut, ulLeft, szSpec, (int)LogGetInt(pData, ulPos));
+                break;
+            case LOG_ARG_LONG:
+                lResult = as_log_snprintf(pOut, ulLeft, szSpec, (long)LogGetInt(pData, ulPos));
+                break;
+            case LOG_ARG_LLONG:
+                lResult = as_log_snprintf(pOut, ulLeft, szSpec, (long long)LogGetInt(pData, ulPos));
+                break;
+            case LOG_ARG_SIZE:
+                lResult = as_log_snprintf(pOut, ulLeft, szSpec, (size_t)LogGetInt(pData, ulPos));
+                break;
+            case LOG_ARG_PTR:
+                lResult = as_log_snprintf(pOut, ulLeft, szSpec, (void*)(uintptr_t)LogGetInt(pData, ulPos));
+                break;
+            case LOG_ARG_DOUBLE:
+            {
+                double dValue;
+                ::memcpy(&dValue, pData + ulPos, sizeof(dValue));
+                ulPos += sizeof(int64_t);
+                lResult = as_log_snprintf(pOut, ulLeft, szSpec, dValue);
+                break;
+            }
+            case LOG_ARG_LDOUBLE:
+            {
+                long double ldValue;
+                ::memcpy(&ldValue, pData + ulPos, sizeof(ldValue));
+                ulPos += LOG_LDOUBLE_SLOT;
+                lResult = as_log_snprintf(pOut, ulLeft, szSpec, ldValue);
+                break;
+            }
+            case LOG_ARG_STR:
+            {
+                uint32_t ulStrLen;
+                ::memcpy(&ulStrLen, pData + ulPos, sizeof(ulStrLen));
+                ulPos += sizeof(int64_t);
+                const char* pszValue = NULL;
+                if(LOG_NULL_STRING != ulStrLen)
+                {
+                    pszValue = (const char*)(pData + ulPos);
+                    ulPos += (ulStrLen + 1 + 7) & ~7U;
+                }
+                lResult = as_log_snprintf(pOut, ulLeft, szSpec, pszValue);
+                break;
+            }
+            default:
+                break;
+        }
+
+        if((0 > lResult) || ((unsigned long)lResult >= ulLeft))
+        {
+            //岻ض
+            ulOut = ulBufLen - 1;
+            break;
+        }
+        ulOut += (unsigned long)lResult;
+    }
+
+    return ulOut;
+}
+
 as_log::as_log()
 {
     m_bRun = false;
     m_bAllowWrite = false;
     m_bDiskFull = false;
     m_dwLastCheckDiskSpaceTime = 0;
-    m_lLevel = AS_LOG_INFO;
     m_hWriteThread = NULL;
     m_hWriteEvent = NULL;
     m_hThreadExitEvent = NULL;
 
+    m_pRingMutex = as_create_mutex();
+    m_pRings = NULL;
+#if AS_APP_OS == AS_OS_LINUX
+    (void)pthread_key_create(&m_RingKey, ThreadRingExit);
+#endif
+    m_ullRetiredDropped = 0;
+    m_ullCachedSecond = 0;
+    ::memset(m_szCachedTime,0,sizeof(m_szCachedTime));
+
     m_pLogFile = NULL;
     m_ulFileLenLimit = DEFAULT_CHANGE_FILE_LEN;
     ::memset(m_szLogFilePathName,0,MAX_LOG_FILE_PATH_NAME_LEN);
@@ -199,6 +780,19 @@ as_log::~as_log()
             m_pLogFile = NULL;
         }
 
+        //ͷ־
+        while(NULL != m_pRings)
+        {
+            AS_LOG_RING* pRing = m_pRings;
+            m_pRings = pRing->pNext;
+            delete[] pRing->pBuf;
+            delete pRing;
+        }
+        if(NULL != m_pRingMutex)
+        {
+            (void)as_destroy_mutex(m_pRingMutex);
+            m_pRingMutex = NULL;
+        }
     }
     catch(...)
     {
@@ -242,11 +836,9 @@ long as_log::Start()
         return ASLOG_ERROR_OK;
     }
 
-    //ʼΪ2M
-    unsigned long ulCacheSize = m_Cache.SetCacheSize(DEFAULT_CACHE_SIZE);
-    if(DEFAULT_CACHE_SIZE != ulCacheSize)
+    if(NULL == m_pRingMutex)
     {
-        //ʧ
+        //־ʧ
         return ASLOG_ERROR_INIT_CACHE;
     }
 
@@ -348,7 +940,7 @@ void as_log::SetLevel(long lLevel)
         case AS_LOG_NOTICE:
         case AS_LOG_INFO:
         case AS_LOG_DEBUG:
-            m_lLevel = lLevel;
+            g_lASLogLevel = lLevel;
             break;
         default:
             break;
@@ -394,8 +986,55 @@ void as_log::SetFileLengthLimit(unsigned long ulLimitLengthKB)
     }
 }
 
-//дһ־:
+//ȡ̵߳־һд־ʱ벢ע
+AS_LOG_RING* as_log::GetThreadRing()
+{
+    AS_LOG_RING* pRing = g_pThreadLogRing;
+    if(NULL != pRing)
+    {
+        return pRing;
+    }
+
+    try
+    {
+        pRing = new AS_LOG_RING;
+        ::memset(pRing, 0, sizeof(AS_LOG_RING));
+        pRing->pBuf = new uint8_t[LOG_RING_SIZE];
+    }
+    catch(...)
+    {
+        if(NULL != pRing)
+        {
+            delete pRing;
+        }
+        return NULL;
+    }
+    pRing->ulThreadID = as_get_threadid();
+
+    (void)as_mutex_lock(m_pRingMutex);
+    pRing->pNext = m_pRings;
+    m_pRings = pRing;
+    (void)as_mutex_unlock(m_pRingMutex);
+
+    g_pThreadLogRing = pRing;
+#if AS_APP_OS == AS_OS_LINUX
+    (void)pthread_setspecific(m_RingKey, pRing);
+#endif
+    return pRing;
+}
+
+#if AS_APP_OS == AS_OS_LINUX
+//߳˳־д̶߳պͷ
+void as_log::ThreadRingExit(void* pRing)
+{
+    g_pThreadLogRing = NULL;
+    LogStoreRelease(&((AS_LOG_RING*)pRing)->ulRetired, 1);
+}
+#endif
+
+//дһ־̵߳־д̸߳ʽ:
 //2008-08-17 10:45:45.939[DEBUG|Log.cpp:152|PID:772|TID:2342|Err:0]...
+//ֻ߳¼ʽָ롢ʱԭʼʱȴ
 long as_log::Write(const char* szFile, long lLine,
                 long lLevel, const char* format, va_list argp)
 {
@@ -405,41 +1044,146 @@ long as_log::Write(const char* szFile, long lLine,
         return 0;
     }
 
-    //δд
+    //־
+    if(lLevel > g_lASLogLevel)
+    {
+        return 0;
+    }
+
+    AS_LOG_RING* pRing = GetThreadRing();
+    if(NULL == pRing)
+    {
+        return 0;
+    }
+
+    //δд()дָ̼߳
     if(!m_bAllowWrite)
     {
-        //̿ռﵽָ׼ָ־룬־
-        m_dwLastCheckDiskSpaceTime = 0;
-        m_bDiskFull = false;
-        m_bAllowWrite = true;
+        pRing->ullDropped = pRing->ullDropped + 1;
+        return 0;
+    }
 
-        //ļδ򿪣Ҫ´־ļд־Ϣ
-        if(NULL == m_pLogFile)
+    //ǰ
+#if AS_APP_OS == AS_OS_LINUX
+    unsigned long ulErr = 0;
+#elif AS_APP_OS == AS_OS_WIN32
+    unsigned long ulErr = GetLastError();
+#endif
+
+    //ڻԤһ¼ռ
+    uint32_t ulHead = pRing->ulHead;
+    uint32_t ulUsed = ulHead - LogLoadAcquire(&pRing->ulTail);
+    uint32_t ulPos  = ulHead & (LOG_RING_SIZE - 1);
+    if(LOG_RING_SIZE - ulPos < LOG_MAX_RECORD_LEN)
+    {
+        //βʣռ䲻һתǣӻ׿ʼд
+        if(ulUsed + (LOG_RING_SIZE - ulPos) + LOG_MAX_RECORD_LEN > LOG_RING_SIZE)
         {
-            m_pLogFile = ::fopen(m_szLogFilePathName, "a+");
-            if(NULL == m_pLogFile)
-            {
-                //Ȼ⣬ָǣ´ٳԴ
-                m_bDiskFull = true;
-                m_bAllowWrite = false;
-                return 0;
-            }
-            //֪ͨд߳д־
-            as_set_event(m_hWriteEvent);
+            pRing->ullDropped = pRing->ullDropped + 1;
+            (void)as_set_event(m_hWriteEvent);
+            return 0;
         }
+        ((AS_LOG_RECORD*)(pRing->pBuf + ulPos))->ulSize = 0;
+        ulUsed += LOG_RING_SIZE - ulPos;
+        ulHead += LOG_RING_SIZE - ulPos;
+        ulPos   = 0;
     }
-
-    //־
-    if(lLevel > m_lLevel)
+    else if(ulUsed + LOG_MAX_RECORD_LEN > LOG_RING_SIZE)
     {
+        //
+        pRing->ullDropped = pRing->ullDropped + 1;
+        (void)as_set_event(m_hWriteEvent);
         return 0;
     }
 
-//Ϣ׼
-    //־ʱ
-    time_t ulTick = time(NULL);
-    //־
-    const char* pszLevel = GetLevelString(lLevel);
+    AS_LOG_RECORD* pRecord = (AS_LOG_RECORD*)(pRing->pBuf + ulPos);
+    uint8_t* pData = (uint8_t*)(pRecord + 1);
+    uint32_t ulDataSize = LOG_MAX_RECORD_LEN - sizeof(AS_LOG_RECORD);
+    pRecord->ullTimeMs = LogNowMs();
+    pRecord->szFile    = szFile;
+    pRecord->szFormat  = format;
+    pRecord->lLine     = lLine;
+    pRecord->lLevel    = lLevel;
+    pRecord->ulErr     = ulErr;
+    pRecord->ulType    = LOG_RECORD_ARGS;
+
+    va_list argCopy;
+    va_copy(argCopy, argp);
+    uint32_t ulDataLen = 0;
+    if(!LogEncodeArgs(pData, ulDataSize, format, argCopy, ulDataLen))
+    {
+        //ʽвֵ֧˵ڱ̸߳ʽ
+        pRecord->ulType = LOG_RECORD_TEXT;
+#if AS_APP_OS == AS_OS_LINUX
+        int lResult = ::vsnprintf((char*)pData, MAX_LEN_OF_SINGLE_LOG, format, argp);
+#elif AS_APP_OS == AS_OS_WIN32
+        int lResult = ::_vsnprintf((char*)pData, MAX_LEN_OF_SINGLE_LOG - 1, format, argp);
+#endif
+        pData[MAX_LEN_OF_SINGLE_LOG - 1] = '\0';
+        ulDataLen = (0 > lResult) ? 0 : (uint32_t)lResult;
+        if(MAX_LEN_OF_SINGLE_LOG - 1 < ulDataLen)
+        {
+            ulDataLen = MAX_LEN_OF_SINGLE_LOG - 1;
+        }
+    }
+    va_end(argCopy);
+
+    pRecord->ulDataLen = ulDataLen;
+    pRecord->ulSize = (uint32_t)((sizeof(AS_LOG_RECORD) + ulDataLen + 7) & ~7U);
+    LogStoreRelease(&pRing->ulHead, ulHead + pRecord->ulSize);
+
+    //ʱŻд̣߳д̶߳ʱȡ
+    if((ulUsed < LOG_RING_SIZE / 2)
+        && (ulUsed + pRecord->ulSize >= LOG_RING_SIZE / 2))
+    {
+        (void)as_set_event(m_hWriteEvent);
+    }
+    return 0;
+}
+
+//̵߳־ǷѶ
+bool as_log::RingsEmpty()
+{
+    bool bEmpty = true;
+    (void)as_mutex_lock(m_pRingMutex);
+    for(AS_LOG_RING* pRing = m_pRings; NULL != pRing; pRing = pRing->pNext)
+    {
+        if(LogLoadAcquire(&pRing->ulHead) != LogLoadAcquire(&pRing->ulTail))
+        {
+            bEmpty = false;
+            break;
+        }
+    }
+    (void)as_mutex_unlock(m_pRingMutex);
+    return bEmpty;
+}
+
+//־
+unsigned long long as_log::GetDroppedCount()
+{
+    unsigned long long ullDropped = 0;
+    (void)as_mutex_lock(m_pRingMutex);
+    ullDropped = m_ullRetiredDropped;
+    for(AS_LOG_RING* pRing = m_pRings; NULL != pRing; pRing = pRing->pNext)
+    {
+        ullDropped += pRing->ullDropped;
+    }
+    (void)as_mutex_unlock(m_pRingMutex);
+    return ullDropped;
+}
+
+//־ͷʱַÿֻʽһ
+unsigned long as_log::FormatHeader(char* pBuf, uint64_t ullTimeMs, long lLevel,
+                                   const char* szFile, long lLine,
+                                   uint32_t ulThreadID, unsigned long ulErr)
+{
+    uint64_t ullSecond = ullTimeMs / 1000;
+    if(ullSecond != m_ullCachedSecond)
+    {
+        as_strftime(m_szCachedTime, sizeof(m_szCachedTime), (char*)"%Y-%m-%d %H:%M:%S", (time_t)ullSecond);
+        m_ullCachedSecond = ullSecond;
+    }
+
     //ļ
     const char* pszFileName = ::strrchr(szFile, '\\');
     if(NULL != pszFileName)
@@ -452,53 +1196,130 @@ long as_log::Write(const char* szFile, long lLine,
         pszFileName = szFile;
     }
 
-    //߳ID
-    unsigned long ulThreadID = as_get_threadid();
-    //ǰ
-#if AS_APP_OS == AS_OS_LINUX
-    unsigned long ulErr = 0;
-#elif AS_APP_OS == AS_OS_WIN32
-    unsigned long ulErr = GetLastError();
-#endif
-//Ϣ׼
-
-    //ʹóԱ̻߳
-    char szLogTmp [MAX_LEN_OF_SINGLE_LOG] = {0};
-    char szLogTime[MAX_LEN_OF_SINGLE_LOG] = { 0 };
-    as_strftime(szLogTime, MAX_LEN_OF_SINGLE_LOG, "%Y-%m-%d %H:%M:%S", ulTick);
-    //־ϢмϢ
-    (void)::sprintf(szLogTmp,"%s[%s|%20s:%05d|TID:0x%04X|Err:0x%04X] ",
-        szLogTime, pszLevel, pszFileName, lLine, ulThreadID, ulErr);
-
-    //ûϢڶϢд־
-    unsigned long ulLen = ::strlen(szLogTmp);
-#if AS_APP_OS == AS_OS_LINUX
-    (void)::vsnprintf(szLogTmp + ulLen, (MAX_LEN_OF_SINGLE_LOG - ulLen) - 1, format, argp);
-#elif AS_APP_OS == AS_OS_WIN32
-    (void)::_vsnprintf(szLogTmp + ulLen, (MAX_LEN_OF_SINGLE_LOG - ulLen) - 1, format, argp);
-#endif
-    szLogTmp[MAX_LEN_OF_SINGLE_LOG-1] = '\0';
-    ulLen = ::strlen(szLogTmp);
-    if((ulLen+2) < MAX_LEN_OF_SINGLE_LOG)
-    {//Զһ
-        szLogTmp[ulLen] = '\n';
-        szLogTmp[ulLen+1] = '\0';
+    int lResult = as_log_snprintf(pBuf, LOG_MAX_HEADER_LEN, "%s.%03u[%s|%20s:%05ld|TID:0x%04X|Err:0x%04lX] ",
+        m_szCachedTime, (unsigned int)(ullTimeMs % 1000), GetLevelString(lLevel),
+        pszFileName, lLine, ulThreadID, ulErr);
+    if((0 > lResult) || (LOG_MAX_HEADER_LEN <= lResult))
+    {
+        //ļ̫ض
+        lResult = LOG_MAX_HEADER_LEN - 1;
     }
+    return (unsigned long)lResult;
+}
 
-    //־д
-    unsigned long ulWriteLen = m_Cache.Write(szLogTmp, ::strlen(szLogTmp));
-    while(0 == ulWriteLen)
+//ʽһ¼Իн
+unsigned long as_log::FormatRecord(char* pBuf, unsigned long ulBufLen,
+                                   const AS_LOG_RECORD* pRecord, uint32_t ulThreadID)
+{
+    unsigned long ulLen = FormatHeader(pBuf, pRecord->ullTimeMs, pRecord->lLevel,
+                                       pRecord->szFile, pRecord->lLine,
+                                       ulThreadID, pRecord->ulErr);
+    const uint8_t* pData = (const uint8_t*)(pRecord + 1);
+    if(LOG_RECORD_TEXT == pRecord->ulType)
     {
-        //֪ͨд߳д־
-        as_set_event(m_hWriteEvent);
-        //ȴд뻺
-        as_sleep(LOG_WAIT_FOR_WRITE_OVER_INTERVAL);
-        ulWriteLen = m_Cache.Write(szLogTmp, ::strlen(szLogTmp));
+        ::memcpy(pBuf + ulLen, pData, pRecord->ulDataLen);
+        ulLen += pRecord->ulDataLen;
+    }
+    else
+    {
+        ulLen += LogFormatArgs(pBuf + ulLen, ulBufLen - ulLen - 1, pRecord->szFormat, pData);
     }
+    //Զһ
+    pBuf[ulLen++] = '\n';
+    return ulLen;
+}
 
-    //֪ͨд߳д־
-    as_set_event(m_hWriteEvent);
-    return 0;
+//ʱϲ߳־еļ¼ʽpBuf
+unsigned long as_log::Drain(char* pBuf, unsigned long ulBufLen, bool& bMore)
+{
+    unsigned long ulLen = 0;
+    bMore = false;
+
+    (void)as_mutex_lock(m_pRingMutex);
+
+    //ȡֿɶķΧͷ˳̶߳յĻ
+    AS_LOG_RING** ppRing = &m_pRings;
+    while(NULL != *ppRing)
+    {
+        AS_LOG_RING* pRing = *ppRing;
+        uint32_t ulRetired = LogLoadAcquire(&pRing->ulRetired);
+        pRing->ulReadPos = pRing->ulTail;
+        pRing->ulReadEnd = LogLoadAcquire(&pRing->ulHead);
+        if((0 != ulRetired) && (pRing->ulReadPos == pRing->ulReadEnd)
+            && (pRing->ullReported == pRing->ullDropped))
+        {
+            *ppRing = pRing->pNext;
+            m_ullRetiredDropped += pRing->ullDropped;
+            delete[] pRing->pBuf;
+            delete pRing;
+            continue;
+        }
+        ppRing = &pRing->pNext;
+    }
+
+    for(;;)
+    {
+        //ÿ־һеĿռ
+        if(ulLen + LOG_MAX_HEADER_LEN + MAX_LEN_OF_SINGLE_LOG + 2 > ulBufLen)
+        {
+            bMore = true;
+            break;
+        }
+
+        //ʱļ¼
+        AS_LOG_RING* pOldest = NULL;
+        AS_LOG_RECORD* pOldestRecord = NULL;
+        for(AS_LOG_RING* pRing = m_pRings; NULL != pRing; pRing = pRing->pNext)
+        {
+            while(pRing->ulReadPos != pRing->ulReadEnd)
+            {
+                uint32_t ulPos = pRing->ulReadPos & (LOG_RING_SIZE - 1);
+                AS_LOG_RECORD* pRecord = (AS_LOG_RECORD*)(pRing->pBuf + ulPos);
+                if(0 == pRecord->ulSize)
+                {
+                    //ת
+                    pRing->ulReadPos += LOG_RING_SIZE - ulPos;
+                    continue;
+                }
+                if((NULL == pOldestRecord) || (pRecord->ullTimeMs < pOldestRecord->ullTimeMs))
+                {
+                    pOldest = pRing;
+                    pOldestRecord = pRecord;
+                }
+                break;
+            }
+        }
+        if(NULL == pOldest)
+        {
+            break;
+        }
+
+        ulLen += FormatRecord(pBuf + ulLen, LOG_MAX_HEADER_LEN + MAX_LEN_OF_SINGLE_LOG + 2,
+                              pOldestRecord, pOldest->ulThreadID);
+        pOldest->ulReadPos += pOldestRecord->ulSize;
+    }
+
+    //黹Ŀռ
+    for(AS_LOG_RING* pRing = m_pRings; NULL != pRing; pRing = pRing->pNext)
+    {
+        LogStoreRelease(&pRing->ulTail, pRing->ulReadPos);
+
+        //涪־
+        uint64_t ullDropped = pRing->ullDropped;
+        if((ullDropped != pRing->ullReported)
+            && (ulLen + LOG_MAX_HEADER_LEN + 128 <= ulBufLen))
+        {
+            ulLen += FormatHeader(pBuf + ulLen, LogNowMs(), AS_LOG_WARNING,
+                                  __FILE__, __LINE__, pRing->ulThreadID, 0);
+            ulLen += (unsigned long)::sprintf(pBuf + ulLen,
+                                  "%llu logs of the thread were dropped,the log ring was full.\n",
+                                  (unsigned long long)(ullDropped - pRing->ullReported));
+            pRing->ullReported = ullDropped;
+        }
+    }
+
+    (void)as_mutex_unlock(m_pRingMutex);
+    return ulLen;
 }
 
 //ֹͣ־ֹд߳
@@ -519,7 +1340,7 @@ long as_log::Stop()
     long lWaitTime = LOG_WAIT_FOR_EXIT_EVENT;
     while(lWaitTime >= 0)
     {
-        if(0 == m_Cache.GetDataSize())
+        if(RingsEmpty())
         {
             //־Ѿдļ
             break;
@@ -581,9 +1402,6 @@ long as_log::Stop()
         m_pLogFile = NULL;
     }
 
-    //ջ
-    m_Cache.Clear();
-
     return ASLOG_ERROR_OK;
 }
 
@@ -611,11 +1429,12 @@ void as_log::WriteLogFileThread()
     char szNewFileName[MAX_LOG_FILE_PATH_NAME_LEN] = {0};
     unsigned long ulLogDataLen = 0;
     unsigned long ulCurFileLen = 0;
+    bool bMore = false;
     char* pLogInfo = NULL;
     try
     {
-        //ݿռ
-        pLogInfo = new char[m_Cache.GetCacheSize()];
+        //ʽռ
+        pLogInfo = new char[LOG_WRITE_BLOCK_SIZE];
     }
     catch(...)
     {
@@ -635,26 +1454,43 @@ void as_log::WriteLogFileThread()
     //ѭ
     while(m_bRun)
     {
-        //ȴдļ¼
-        as_wait_event(m_hWriteEvent, 0);
+        //һûж򲻵ȴд¼ˢ¼
+        if(!bMore)
+        {
+            (void)as_wait_event(m_hWriteEvent, LOG_FLUSH_INTERVAL);
+        }
+        bMore = false;
 
-        //ļδ
-        if(m_bDiskFull || NULL == m_pLogFile)
+        //´ļָ־
+        if(m_bDiskFull)
         {
-            //Ǵȴ
-            if(m_bDiskFull)
+            if((uint32_t)(as_get_cur_msecond() - m_dwLastCheckDiskSpaceTime) < DISK_SPACE_CHECK_INTERVAL)
             {
                 continue;
             }
-            else
-            {   //Ϊɵģ˳
-                break;
+            m_dwLastCheckDiskSpaceTime = as_get_cur_msecond();
+            if(NULL == m_pLogFile)
+            {
+                m_pLogFile = ::fopen(m_szLogFilePathName, "a+");
+                if(NULL == m_pLogFile)
+                {
+                    //Ȼ⣬´ٳԴ
+                    continue;
+                }
             }
+            m_bDiskFull = false;
+            m_bAllowWrite = true;
         }
 
-        //
-        ulLogDataLen = m_Cache.GetCacheSize();
-        ulLogDataLen= m_Cache.Read(pLogInfo, ulLogDataLen);
+        //ļδ
+        if(NULL == m_pLogFile)
+        {
+            //Ϊɵģ˳
+            break;
+        }
+
+        //ϲ̵߳־ʽ
+        ulLogDataLen = Drain(pLogInfo, LOG_WRITE_BLOCK_SIZE, bMore);
         if(0 == ulLogDataLen)
         {
             //Ϊδ
@@ -670,6 +1506,7 @@ void as_log::WriteLogFileThread()
             {
                 m_bAllowWrite = false;
                 m_bDiskFull = true;
+                m_dwLastCheckDiskSpaceTime = as_get_cur_msecond();
                 continue;
             }
             else
@@ -689,6 +1526,7 @@ void as_log::WriteLogFileThread()
             {
                 m_bAllowWrite = false;
                 m_bDiskFull = true;
+                m_dwLastCheckDiskSpaceTime = as_get_cur_msecond();
                 continue;
             }
             else
@@ -743,6 +1581,7 @@ void as_log::WriteLogFileThread()
         //Ǵͣ־ȴռ
         m_bAllowWrite = false;
         m_bDiskFull = true;
+        m_dwLastCheckDiskSpaceTime = as_get_cur_msecond();
     }
 
     //ָ״̬
@@ -775,7 +1614,6 @@ void as_log::WriteLogFileThread()
     //߳˳¼֪ͨ
     as_set_event(m_hThreadExitEvent);
 }
-
 //ȡ־ַ
 const char* as_log::GetLevelString(long lLevel) const
 {
@@ -885,5 +1723,13 @@ ASLOG_API void ASSetLogFileLengthLimit(unsigned long ulLimitLengthKB)
     //ļ
     pASLog->SetFileLengthLimit(ulLimitLengthKB);
 }
+
+//ȡ־־(߳ۼ)
+ASLOG_API unsigned long long ASGetLogDroppedCount(void)
+{
+    //ȡ־ʵ
+    as_log* pASLog = as_log::GetASLogInstance();
+    return pASLog->GetDroppedCount();
+}
 /************************ End ־ģûӿʵ ****************************/
 
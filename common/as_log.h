@@ -61,6 +61,12 @@ ASLOG_API void __ASWriteLog(const char* szFileName, long lLine,
 //ֹͣAS־ģ
 ASLOG_API void ASStopLog(void);
 
+//ȡ־־(߳ۼ)
+ASLOG_API unsigned long long ASGetLogDroppedCount(void);
+
+//ǰ־CWriterȡ֮ǰȽϣ˵־κθʽ
+extern volatile long g_lASLogLevel;
+
 //vc6Լvc7.1֧C99(g++֧)
 //ﲻʹÿɱ궨壬ö()ʵ
 class CWriter
@@ -73,6 +79,10 @@ class CWriter
         }
         void operator()(long level, const char* format, ...)
         {
+            if(level > g_lASLogLevel)
+            {
+                return;
+            }
             va_list argp;
             va_start(argp, format);
             __ASWriteLog(m_file_,m_line_,level,format,argp);
@@ -28,6 +28,69 @@ extern "C"{
 #include "as_time.h"
 #include "as_json.h"
 }
+#if AS_APP_OS == AS_OS_LINUX
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdlib.h>
+#endif
+
+//Windows˫ӳַ߳ռʱԴ
+#define AS_RING_CACHE_MAP_RETRY     16
+
+static inline uint64_t RingLoadAcquire(volatile uint64_t* pValue)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)pValue, 0, 0);
+#else
+    return __atomic_load_n(pValue, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void RingStoreRelease(volatile uint64_t* pValue, uint64_t ullValue)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    (void)InterlockedExchange64((volatile LONG64*)pValue, (LONG64)ullValue);
+#else
+    __atomic_store_n(pValue, ullValue, __ATOMIC_RELEASE);
+#endif
+}
+
+#if AS_APP_OS == AS_OS_LINUX
+//ulSizeֽڵĹڴļļʧܷ-1
+static int RingCreateMemFile(unsigned long ulSize)
+{
+    int fd = -1;
+#ifdef SYS_memfd_create
+    fd = (int)::syscall(SYS_memfd_create, "as_ring_cache", 0);
+#endif
+    if(0 > fd)
+    {
+        //ں˲֧memfdʱļ
+        const char* pszDirs[] = {"/dev/shm", "/tmp"};
+        for(unsigned long i = 0; (i < sizeof(pszDirs)/sizeof(pszDirs[0])) && (0 > fd); i++)
+        {
+            char szPath[64];
+            (void)::snprintf(szPath, sizeof(szPath), "%s/as_ring_cache_XXXXXX", pszDirs[i]);
+            fd = ::mkstemp(szPath);
+            if(0 <= fd)
+            {
+                (void)::unlink(szPath);
+            }
+        }
+    }
+    if(0 > fd)
+    {
+        return -1;
+    }
+    if(0 != ::ftruncate(fd, (off_t)ulSize))
+    {
+        (void)::close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
 
 as_ring_cache::as_ring_cache()
 {
@@ -37,12 +100,23 @@ as_ring_cache::as_ring_cache()
     m_ulWriter = 0;
     m_ulDataSize = 0;
 
+    m_bSpsc = false;
+    m_ullSpscWriter = 0;
+    m_ullSpscReader = 0;
+#if AS_APP_OS == AS_OS_WIN32
+    m_hSpscMapping = NULL;
+#endif
+
     m_pMutex = as_create_mutex();
 }
 
 as_ring_cache::~as_ring_cache()
 {
-    if(NULL != m_pBuffer)
+    if(m_bSpsc)
+    {
+        ReleaseSpscBuffer();
+    }
+    else if(NULL != m_pBuffer)
     {
         try
         {
@@ -72,6 +146,12 @@ unsigned long as_ring_cache::SetCacheSize(unsigned long ulCacheSize)
     m_ulWriter = 0;
     m_ulDataSize = 0;
 
+    //SPSCģʽлͷ˫ӳ
+    if(m_bSpsc)
+    {
+        ReleaseSpscBuffer();
+    }
+
     //Сδ仯Ҫڴ
     if(ulCacheSize == m_ulBufferSize)
     {
@@ -129,6 +209,18 @@ unsigned long as_ring_cache::Peek(char* pBuf, unsigned long ulPeekLen)/*lint -e1
 {
     unsigned long ulResult = 0;
 
+    //SPSCģʽ
+    if(m_bSpsc)
+    {
+        char* pData = PeekSpan(ulResult);
+        ulResult = ulResult>ulPeekLen?ulPeekLen:ulResult;
+        if(0 != ulResult)
+        {
+            ::memcpy(pBuf, pData, ulResult);
+        }
+        return ulResult;
+    }
+
     as_mutex_lock(m_pMutex);
 
     //ʵʿɶȡĳ
@@ -173,6 +265,19 @@ unsigned long as_ring_cache::Read(char* pBuf, unsigned long ulReadLen)
 {
     unsigned long ulResult = 0;
 
+    //SPSCģʽ
+    if(m_bSpsc)
+    {
+        char* pData = PeekSpan(ulResult);
+        ulResult = ulResult>ulReadLen?ulReadLen:ulResult;
+        if(0 != ulResult)
+        {
+            ::memcpy(pBuf, pData, ulResult);
+            Consume(ulResult);
+        }
+        return ulResult;
+    }
+
     as_mutex_lock(m_pMutex);
 
     //ʵʿɶȡĳ
@@ -231,6 +336,19 @@ unsigned long as_ring_cache::Write(const char* pBuf, unsigned long ulWriteLen)
 {
     unsigned long ulResult = 0;
 
+    //SPSCģʽ
+    if(m_bSpsc)
+    {
+        char* pSpace = Reserve(ulWriteLen);
+        if((NULL == pSpace) || (0 == ulWriteLen))
+        {
+            return 0;
+        }
+        ::memcpy(pSpace, pBuf, ulWriteLen);
+        Commit(ulWriteLen);
+        return ulWriteLen;
+    }
+
     as_mutex_lock(m_pMutex);
 
     //ʵʿд볤ȣ໺д
@@ -286,13 +404,19 @@ unsigned long as_ring_cache::Write(const char* pBuf, unsigned long ulWriteLen)
 //õǰݴС
 unsigned long as_ring_cache::GetDataSize() const
 {
+    if(m_bSpsc)
+    {
+        //ȶλãдλֻ
+        uint64_t ullReader = RingLoadAcquire((volatile uint64_t*)&m_ullSpscReader);
+        return (unsigned long)(RingLoadAcquire((volatile uint64_t*)&m_ullSpscWriter) - ullReader);
+    }
     return m_ulDataSize;
 }
 
 //õǰ໺С
 unsigned long as_ring_cache::GetEmptySize() const
 {
-    return (m_ulBufferSize - m_ulDataSize);
+    return (m_ulBufferSize - GetDataSize());
 }
 
 //
@@ -302,6 +426,8 @@ void as_ring_cache::Clear()
     m_ulReader = 0;
     m_ulWriter = 0;
     m_ulDataSize = 0;
+    m_ullSpscWriter = 0;
+    m_ullSpscReader = 0;
     as_mutex_unlock(m_pMutex);
 }
 
@@ -314,8 +440,214 @@ unsigned long as_ring_cache::GetUsingPercent() const
         return 0;
     }
 
-    unsigned long ulCurrentUsingPercent = (m_ulDataSize*100)/m_ulBufferSize;
+    unsigned long ulCurrentUsingPercent = (GetDataSize()*100)/m_ulBufferSize;
 
     return ulCurrentUsingPercent;
 }
 
+//лΪSPSCģʽûСɺ󻺳ĴСʧܷ0
+unsigned long as_ring_cache::SetSpscCacheSize(unsigned long ulCacheSize)
+{
+    as_mutex_lock(m_pMutex);
+
+    //ͷŵǰڴ
+    if(m_bSpsc)
+    {
+        ReleaseSpscBuffer();
+    }
+    else if(NULL != m_pBuffer)
+    {
+        try
+        {
+            delete[] m_pBuffer;
+        }
+        catch(...)
+        {
+        }
+        m_pBuffer = NULL;
+    }
+    m_ulBufferSize = 0;
+    m_ulReader = 0;
+    m_ulWriter = 0;
+    m_ulDataSize = 0;
+    m_ullSpscWriter = 0;
+    m_ullSpscReader = 0;
+
+    if(0 == ulCacheSize)
+    {
+        as_mutex_unlock(m_pMutex);
+        return 0;
+    }
+
+    char* pBase = NULL;
+#if AS_APP_OS == AS_OS_LINUX
+    //ӳĴСҳ
+    unsigned long ulPage = (unsigned long)::sysconf(_SC_PAGESIZE);
+    unsigned long ulSize = ((ulCacheSize + ulPage - 1) / ulPage) * ulPage;
+    int fd = RingCreateMemFile(ulSize);
+    if(0 > fd)
+    {
+        as_mutex_unlock(m_pMutex);
+        return 0;
+    }
+
+    //ռסСĵַռ䣬ٰͬһڴӳ䵽ǰ
+    void* pAddr = ::mmap(NULL, ulSize * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(MAP_FAILED != pAddr)
+    {
+        void* pFirst = ::mmap(pAddr, ulSize, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_FIXED, fd, 0);
+        void* pSecond = ::mmap((char*)pAddr + ulSize, ulSize, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_FIXED, fd, 0);
+        if((pAddr == pFirst) && ((char*)pAddr + ulSize == (char*)pSecond))
+        {
+            pBase = (char*)pAddr;
+        }
+        else
+        {
+            (void)::munmap(pAddr, ulSize * 2);
+        }
+    }
+    (void)::close(fd);
+#elif AS_APP_OS == AS_OS_WIN32
+    //ӳĴСǷȵ
+    SYSTEM_INFO stInfo;
+    ::GetSystemInfo(&stInfo);
+    unsigned long ulGranularity = stInfo.dwAllocationGranularity;
+    unsigned long ulSize = ((ulCacheSize + ulGranularity - 1) / ulGranularity) * ulGranularity;
+    m_hSpscMapping = ::CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                         0, ulSize, NULL);
+    if(NULL == m_hSpscMapping)
+    {
+        as_mutex_unlock(m_pMutex);
+        return 0;
+    }
+
+    //һСĿеַͷźӳ䣬ַ߳ռ
+    for(unsigned long i = 0; (i < AS_RING_CACHE_MAP_RETRY) && (NULL == pBase); i++)
+    {
+        char* pAddr = (char*)::VirtualAlloc(NULL, ulSize * 2, MEM_RESERVE, PAGE_NOACCESS);
+        if(NULL == pAddr)
+        {
+            break;
+        }
+        (void)::VirtualFree(pAddr, 0, MEM_RELEASE);
+
+        void* pFirst = ::MapViewOfFileEx(m_hSpscMapping, FILE_MAP_ALL_ACCESS, 0, 0, ulSize, pAddr);
+        if(NULL == pFirst)
+        {
+            continue;
+        }
+        void* pSecond = ::MapViewOfFileEx(m_hSpscMapping, FILE_MAP_ALL_ACCESS, 0, 0, ulSize, pAddr + ulSize);
+        if(NULL == pSecond)
+        {
+            (void)::UnmapViewOfFile(pFirst);
+            continue;
+        }
+        pBase = pAddr;
+    }
+    if(NULL == pBase)
+    {
+        (void)::CloseHandle(m_hSpscMapping);
+        m_hSpscMapping = NULL;
+    }
+#endif
+
+    if(NULL == pBase)
+    {
+        //ӳʧ
+        as_mutex_unlock(m_pMutex);
+        return 0;
+    }
+
+    m_pBuffer = pBase;
+    m_ulBufferSize = ulSize;
+    m_bSpsc = true;
+
+    as_mutex_unlock(m_pMutex);
+    return m_ulBufferSize;
+}
+
+//ͷSPSCģʽ˫ӳ
+void as_ring_cache::ReleaseSpscBuffer()
+{
+    if(NULL != m_pBuffer)
+    {
+#if AS_APP_OS == AS_OS_LINUX
+        (void)::munmap(m_pBuffer, m_ulBufferSize * 2);
+#elif AS_APP_OS == AS_OS_WIN32
+        (void)::UnmapViewOfFile(m_pBuffer);
+        (void)::UnmapViewOfFile(m_pBuffer + m_ulBufferSize);
+#endif
+        m_pBuffer = NULL;
+    }
+#if AS_APP_OS == AS_OS_WIN32
+    if(NULL != m_hSpscMapping)
+    {
+        (void)::CloseHandle(m_hSpscMapping);
+        m_hSpscMapping = NULL;
+    }
+#endif
+    m_ulBufferSize = 0;
+    m_ullSpscWriter = 0;
+    m_ullSpscReader = 0;
+    m_bSpsc = false;
+}
+
+//ǷSPSCģʽ
+bool as_ring_cache::IsSpsc() const
+{
+    return m_bSpsc;
+}
+
+//SPSCдˣȡulLenֽĿ໺壬ռ䲻NULL
+char* as_ring_cache::Reserve(unsigned long ulLen)
+{
+    if(!m_bSpsc)
+    {
+        return NULL;
+    }
+
+    //дλֻб߳޸
+    uint64_t ullWriter = m_ullSpscWriter;
+    uint64_t ullUsed = ullWriter - RingLoadAcquire(&m_ullSpscReader);
+    if(ulLen > m_ulBufferSize - ullUsed)
+    {
+        return NULL;
+    }
+
+    //˫ӳ䣬дλÿʼĻСֽڶ
+    return m_pBuffer + (unsigned long)(ullWriter % m_ulBufferSize);
+}
+
+//SPSCдˣύReserveĻǰulLenֽ
+void as_ring_cache::Commit(unsigned long ulLen)
+{
+    RingStoreRelease(&m_ullSpscWriter, m_ullSpscWriter + ulLen);
+}
+
+//SPSCˣȫݵ䣬ulLenΪݳȣݷNULL
+char* as_ring_cache::PeekSpan(unsigned long& ulLen)
+{
+    ulLen = 0;
+    if(!m_bSpsc)
+    {
+        return NULL;
+    }
+
+    //λֻб߳޸
+    uint64_t ullReader = m_ullSpscReader;
+    ulLen = (unsigned long)(RingLoadAcquire(&m_ullSpscWriter) - ullReader);
+    if(0 == ulLen)
+    {
+        return NULL;
+    }
+
+    return m_pBuffer + (unsigned long)(ullReader % m_ulBufferSize);
+}
+
+//SPSCˣͷͷulLenֽ
+void as_ring_cache::Consume(unsigned long ulLen)
+{
+    RingStoreRelease(&m_ullSpscReader, m_ullSpscReader + ulLen);
+}
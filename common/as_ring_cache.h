@@ -23,6 +23,17 @@
  *                                   
  *           
  *
+ *      3SPSCģʽ(SetSpscCacheSize)
+ *         ֻһд̺߳һ̣߳дλacquire/releaseͬ
+ *         ַӳΣ[0,size)Ż[0,size)
+ *         BݺͿҲģReserve/PeekSpanֱӷ
+ *         еָ룬Ҫֶο
+ *
+ *         дp = Reserve(len); p; Commit(len);
+ *         p = PeekSpan(len); p; Consume(len);
+ *
+ *         Read/Write/PeekSPSCģʽͬ(д߳Write߳Read/Peek)
+ *
  */
 
 #ifndef _RING_CACHE_H_
@@ -41,6 +52,7 @@ extern "C"{
 #include "as_time.h"
 #include "as_json.h"
 }
+#include <stdint.h>
 
 class as_ring_cache
 {
@@ -73,8 +85,29 @@ class as_ring_cache
         //õǰ໺С
         unsigned long GetEmptySize() const;
 
-        //
+        //ݣSPSCģʽֻڶд˶ֹͣʱ
         void Clear();
+
+        //лΪSPSCģʽûС(ȡҳС)ɺ󻺳ĴСʧܷ0
+        unsigned long SetSpscCacheSize(unsigned long ulCacheSize);
+
+        //ǷSPSCģʽ
+        bool IsSpsc() const;
+
+        //SPSCдˣȡulLenֽĿ໺壬ռ䲻NULL
+        char* Reserve(unsigned long ulLen);
+
+        //SPSCдˣύReserveĻǰulLenֽ
+        void Commit(unsigned long ulLen);
+
+        //SPSCˣȫݵ䣬ulLenΪݳȣݷNULL
+        char* PeekSpan(unsigned long& ulLen);
+
+        //SPSCˣͷͷulLenֽ
+        void Consume(unsigned long ulLen);
+    private:
+        //ͷSPSCģʽ˫ӳ
+        void ReleaseSpscBuffer();
     private:
         as_mutex_t*      m_pMutex;    //ʱ
 
@@ -86,6 +119,18 @@ class as_ring_cache
         //ֵǴ˱ţƫֵ
         unsigned long    m_ulReader;        //ͷ(ݶȡ)
         unsigned long    m_ulWriter;        //ͷ(д)
+
+        //SPSCģʽm_pBufferָ˫ӳĻ
+        bool     m_bSpsc;
+        //SPSCģʽĶдλֻڲͬĻ
+        char     m_szPad1[64];
+        volatile uint64_t    m_ullSpscWriter;
+        char     m_szPad2[64];
+        volatile uint64_t    m_ullSpscReader;
+        char     m_szPad3[64];
+#if AS_APP_OS == AS_OS_WIN32
+        HANDLE   m_hSpscMapping;
+#endif
 };
 
 #endif
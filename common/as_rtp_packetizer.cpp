@@ -0,0 +1,593 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "as_rtp_packetizer.h"
+#include "as_log.h"
+#include "as_mem.h"
+#if AS_APP_OS == AS_OS_LINUX
+#include <arpa/inet.h>
+#include <time.h>
+#endif
+
+/* NAL unit types of the aggregation and fragmentation packets */
+#define H264_NAL_STAP_A     24
+#define H264_NAL_FU_A       28
+#define H265_NAL_AP         48
+#define H265_NAL_FU         49
+
+#define FU_START_BIT        0x80
+#define FU_END_BIT          0x40
+#define RTP_MARKER_BIT      0x80
+
+/* the frame interval(us) until the timestamps tell it,25 frames/s */
+#define PACE_DEFAULT_INTERVAL   40000
+/* the packets the bucket holds by default */
+#define PACE_BURST_PACKETS      4
+
+as_rtp_packetizer::as_rtp_packetizer()
+{
+    m_enCodec        = AS_RTP_CODEC_H264;
+    m_ucPayloadType  = 0;
+    m_ulSsrc         = 0;
+    m_usSeq          = 0;
+    m_ulMaxPayload   = AS_RTP_PACKETIZER_MAX_PAYLOAD;
+    m_ulNalHdrLen    = 1;
+    memset(&m_destAddr,0,sizeof(m_destAddr));
+    m_pHdrs          = NULL;
+    m_pIovs          = NULL;
+#if AS_APP_OS == AS_OS_LINUX
+    m_pMsgs          = NULL;
+#endif
+    m_ulBatch        = AS_RTP_PACKETIZER_BATCH;
+    m_ulPackets      = 0;
+    m_ulPaced        = 0;
+    m_bBorrowed      = false;
+    m_pAggBufs       = NULL;
+    m_ulAggUsed      = 0;
+    m_ulAggLen       = 0;
+    m_ulAggNals      = 0;
+    m_ulAggFirstLen  = 0;
+    m_ulAggTimestamp = 0;
+    m_ucAggF         = 0;
+    m_ucAggNri       = 0;
+    m_ucAggLayer     = 0;
+    m_ulPacePercent  = 0;
+    m_ulClockRate    = 90000;
+    m_ulBurstBytes   = 0;
+    m_ulFrameInterval= 0;
+    m_ulLastTimestamp= 0;
+    m_bHaveTimestamp = false;
+    m_dTokens        = 0;
+    m_dRate          = 0;
+    m_ullRefillTime  = 0;
+    m_ullPaceStart   = 0;
+    m_ullFrameDeadline = 0;
+    memset(&m_stat,0,sizeof(m_stat));
+}
+
+as_rtp_packetizer::~as_rtp_packetizer()
+{
+    release();
+}
+
+int32_t as_rtp_packetizer::init(AS_RTP_VIDEO_CODEC enCodec, uint8_t ucPayloadType, uint32_t ulSsrc,
+                                uint32_t ulMaxPayload, uint32_t ulBatch)
+{
+    m_enCodec       = enCodec;
+    m_ucPayloadType = ucPayloadType & 0x7F;
+    m_ulSsrc        = ulSsrc;
+    m_usSeq         = (uint16_t)rand();
+    m_ulNalHdrLen   = (AS_RTP_CODEC_H265 == enCodec) ? 2 : 1;
+    /* an aggregation packet takes the payload header and one size at least */
+    m_ulMaxPayload  = ulMaxPayload;
+    if(m_ulMaxPayload <= m_ulNalHdrLen + 4) {
+        m_ulMaxPayload = AS_RTP_PACKETIZER_MAX_PAYLOAD;
+    }
+    m_ulBatch = ulBatch;
+    if((0 == m_ulBatch) || (AS_RTP_PACKETIZER_MAX_BATCH < m_ulBatch)) {
+        m_ulBatch = AS_RTP_PACKETIZER_BATCH;
+    }
+
+    if((NULL == AS_NEW(m_pHdrs,m_ulBatch*AS_RTP_PACKETIZER_HDR_SIZE))
+        || (NULL == AS_NEW(m_pIovs,m_ulBatch*2))
+        || (NULL == AS_NEW(m_pAggBufs,AS_RTP_PACKETIZER_AGG_SLOTS*m_ulMaxPayload))) {
+        AS_LOG(AS_LOG_ERROR,"as_rtp_packetizer::init,alloc the batch fail.");
+        release();
+        return AS_ERROR_CODE_FAIL;
+    }
+#if AS_APP_OS == AS_OS_LINUX
+    if(NULL == AS_NEW(m_pMsgs,m_ulBatch)) {
+        AS_LOG(AS_LOG_ERROR,"as_rtp_packetizer::init,alloc the messages fail.");
+        release();
+        return AS_ERROR_CODE_FAIL;
+    }
+    /* each message keeps its two iovecs,only the lengths change */
+    memset(m_pMsgs,0,sizeof(struct mmsghdr)*m_ulBatch);
+    for(uint32_t i = 0; i < m_ulBatch; i++) {
+        m_pMsgs[i].msg_hdr.msg_name    = &m_destAddr;
+        m_pMsgs[i].msg_hdr.msg_namelen = sizeof(m_destAddr);
+        m_pMsgs[i].msg_hdr.msg_iov     = &m_pIovs[i*2];
+        m_pMsgs[i].msg_hdr.msg_iovlen  = 2;
+    }
+#endif
+
+    m_ulPackets = 0;
+    m_ulPaced   = 0;
+    m_bBorrowed = false;
+    m_ulAggUsed = 0;
+    m_ulAggLen  = 0;
+    m_ulAggNals = 0;
+    memset(&m_stat,0,sizeof(m_stat));
+    AS_LOG(AS_LOG_INFO,"as_rtp_packetizer::init,codec:[%d],payload type:[%d],ssrc:[0x%x],max payload:[%d],batch:[%d].",
+                       enCodec,m_ucPayloadType,ulSsrc,m_ulMaxPayload,m_ulBatch);
+    return AS_ERROR_CODE_OK;
+}
+
+void as_rtp_packetizer::release()
+{
+    AS_DELETE(m_pHdrs,MULTI);
+    AS_DELETE(m_pIovs,MULTI);
+    AS_DELETE(m_pAggBufs,MULTI);
+#if AS_APP_OS == AS_OS_LINUX
+    AS_DELETE(m_pMsgs,MULTI);
+#endif
+    m_ulPackets = 0;
+    m_ulPaced   = 0;
+    m_ulAggUsed = 0;
+    m_ulAggLen  = 0;
+    m_ulAggNals = 0;
+}
+
+int32_t as_rtp_packetizer::set_destination(const char* pszAddr, uint16_t usPort)
+{
+    memset(&m_destAddr,0,sizeof(m_destAddr));
+    m_destAddr.sin_family      = AF_INET;
+    m_destAddr.sin_port        = htons(usPort);
+    m_destAddr.sin_addr.s_addr = inet_addr(pszAddr);
+    if(INADDR_NONE == m_destAddr.sin_addr.s_addr) {
+        AS_LOG(AS_LOG_WARNING,"as_rtp_packetizer::set_destination,the address:[%s] is not right.",pszAddr);
+        return AS_ERROR_CODE_FAIL;
+    }
+    return AS_ERROR_CODE_OK;
+}
+
+int32_t as_rtp_packetizer::send_nals(as_rtp_socket_t lSockFd, const uint8_t* pData, uint32_t ulSize,
+                                     uint32_t ulTimestamp, bool bEndOfFrame)
+{
+    if(NULL == m_pHdrs) {
+        return AS_ERROR_CODE_FAIL;
+    }
+
+    const uint8_t* pEnd  = pData + ulSize;
+    uint32_t ulCodeLen   = 0;
+    const uint8_t* pCode = find_start_code(pData, pEnd, ulCodeLen);
+    if(NULL == pCode) {
+        /* a bare NAL */
+        if(0 < ulSize) {
+            add_nal(lSockFd, pData, ulSize, ulTimestamp);
+        }
+    }
+    else {
+        const uint8_t* pNal = pCode + ulCodeLen;
+        while(pNal < pEnd) {
+            const uint8_t* pNext = find_start_code(pNal, pEnd, ulCodeLen);
+            const uint8_t* pNalEnd = (NULL == pNext) ? pEnd : pNext;
+            /* a NAL never ends with a zero byte,those are trailing_zero_8bits */
+            while((pNalEnd > pNal) && (0 == pNalEnd[-1])) {
+                pNalEnd--;
+            }
+            if(pNalEnd > pNal) {
+                add_nal(lSockFd, pNal, (uint32_t)(pNalEnd - pNal), ulTimestamp);
+            }
+            if(NULL == pNext) {
+                break;
+            }
+            pNal = pNext + ulCodeLen;
+        }
+    }
+
+    if(bEndOfFrame) {
+        agg_close(lSockFd);
+        if(0 < m_ulPackets) {
+            m_pHdrs[(m_ulPackets - 1)*AS_RTP_PACKETIZER_HDR_SIZE + 1] |= RTP_MARKER_BIT;
+        }
+        m_stat.ullFrames++;
+        if(paced()) {
+            pace_start(ulTimestamp);
+            return AS_ERROR_CODE_OK;
+        }
+        return send_batch(lSockFd);
+    }
+    /* the caller reuses its buffer after the return(or after pace() is done) */
+    if(m_bBorrowed) {
+        if(paced()) {
+            pace_start(ulTimestamp);
+            return AS_ERROR_CODE_OK;
+        }
+        return send_batch(lSockFd);
+    }
+    return AS_ERROR_CODE_OK;
+}
+
+int32_t as_rtp_packetizer::flush(as_rtp_socket_t lSockFd)
+{
+    agg_close(lSockFd);
+    return send_batch(lSockFd);
+}
+
+void as_rtp_packetizer::set_pacing(uint32_t ulPercent, uint32_t ulClockRate, uint32_t ulBurstBytes)
+{
+    m_ulPacePercent = (100 < ulPercent) ? 100 : ulPercent;
+    m_ulClockRate   = (0 == ulClockRate) ? 90000 : ulClockRate;
+    m_ulBurstBytes  = ulBurstBytes;
+    if(0 == m_ulBurstBytes) {
+        m_ulBurstBytes = PACE_BURST_PACKETS*(AS_RTP_HEADER_SIZE + m_ulMaxPayload);
+    }
+    m_ulFrameInterval = 0;
+    m_bHaveTimestamp  = false;
+    m_dTokens         = m_ulBurstBytes;
+    m_dRate           = 0;
+    m_ullRefillTime   = now_us();
+    AS_LOG(AS_LOG_INFO,"as_rtp_packetizer::set_pacing,percent:[%d],clock rate:[%d],burst:[%d].",
+                       m_ulPacePercent,m_ulClockRate,m_ulBurstBytes);
+}
+
+int32_t as_rtp_packetizer::pace(as_rtp_socket_t lSockFd, uint32_t& ulDelayUs)
+{
+    ulDelayUs = 0;
+    if(m_ulPaced >= m_ulPackets) {
+        return AS_ERROR_CODE_OK;
+    }
+
+    uint64_t ullNow = now_us();
+    if(ullNow > m_ullRefillTime) {
+        m_dTokens += m_dRate*(double)(ullNow - m_ullRefillTime);
+        if(m_dTokens > m_ulBurstBytes) {
+            m_dTokens = m_ulBurstBytes;
+        }
+    }
+    m_ullRefillTime = ullNow;
+
+    /* the bucket may go below zero by the last packet,the delay pays it back */
+    uint32_t ulTo = m_ulPaced;
+    while((ulTo < m_ulPackets) && (0 < m_dTokens)) {
+        m_dTokens -= (double)(m_pIovs[ulTo*2].iov_len + m_pIovs[ulTo*2 + 1].iov_len);
+        ulTo++;
+    }
+    uint32_t ulCount = ulTo - m_ulPaced;
+    uint32_t ulSent  = (0 < ulCount) ? send_range(lSockFd, ulTo) : 0;
+
+    if(m_ulPaced >= m_ulPackets) {
+        uint64_t ullDelay = ullNow - m_ullPaceStart;
+        m_stat.ullPacedFrames++;
+        m_stat.ullPaceDelay += ullDelay;
+        if(ullDelay > m_stat.ullPaceMaxDelay) {
+            m_stat.ullPaceMaxDelay = ullDelay;
+        }
+        send_batch(lSockFd);
+    }
+    else if(0 < m_dRate) {
+        ulDelayUs = (uint32_t)(-m_dTokens/m_dRate) + 1;
+    }
+    else {
+        ulDelayUs = 1;
+    }
+    return (ulSent < ulCount) ? AS_ERROR_CODE_FAIL : AS_ERROR_CODE_OK;
+}
+
+void as_rtp_packetizer::pace_start(uint32_t ulTimestamp)
+{
+    /* the NALs of one timestamp are one access unit to the pacer */
+    bool bNewFrame = (!m_bHaveTimestamp) || (ulTimestamp != m_ulLastTimestamp);
+    if(m_bHaveTimestamp && bNewFrame) {
+        uint64_t ullUs = (uint64_t)(uint32_t)(ulTimestamp - m_ulLastTimestamp)*1000000/m_ulClockRate;
+        if((0 < ullUs) && (1000000 > ullUs)) {
+            m_ulFrameInterval = (0 == m_ulFrameInterval) ? (uint32_t)ullUs
+                              : (uint32_t)((7*(uint64_t)m_ulFrameInterval + ullUs)/8);
+        }
+    }
+    m_ulLastTimestamp = ulTimestamp;
+    m_bHaveTimestamp  = true;
+
+    uint64_t ullBytes = 0;
+    for(uint32_t i = m_ulPaced; i < m_ulPackets; i++) {
+        ullBytes += m_pIovs[i*2].iov_len + m_pIovs[i*2 + 1].iov_len;
+    }
+    m_stat.ullQueuedBytes = ullBytes;
+
+    /* the access unit is spread over its share of the interval,a batch sent
+     * before its end(a big NAL) leaves the rest of the share to the next one */
+    uint64_t ullNow = now_us();
+    if(bNewFrame) {
+        uint32_t ulInterval = (0 == m_ulFrameInterval) ? PACE_DEFAULT_INTERVAL : m_ulFrameInterval;
+        m_ullFrameDeadline = ullNow + (uint64_t)ulInterval*m_ulPacePercent/100;
+    }
+    double dLeft = (m_ullFrameDeadline > ullNow) ? (double)(m_ullFrameDeadline - ullNow) : 1;
+    /* a small one goes in a burst */
+    if(ullBytes < m_ulBurstBytes) {
+        ullBytes = m_ulBurstBytes;
+    }
+    m_dRate        = (double)ullBytes/dLeft;
+    m_ullPaceStart = ullNow;
+}
+
+uint64_t as_rtp_packetizer::now_us()
+{
+#if AS_APP_OS == AS_OS_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000 + (uint64_t)ts.tv_nsec/1000;
+#elif AS_APP_OS == AS_OS_WIN32
+    LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (uint64_t)(count.QuadPart/freq.QuadPart)*1000000
+         + (uint64_t)(count.QuadPart%freq.QuadPart)*1000000/freq.QuadPart;
+#endif
+}
+
+void as_rtp_packetizer::add_nal(as_rtp_socket_t lSockFd, const uint8_t* pNal, uint32_t ulLen, uint32_t ulTimestamp)
+{
+    if(ulLen <= m_ulNalHdrLen) {
+        return;
+    }
+    m_stat.ullNals++;
+
+    /* an aggregation packet carries one timestamp */
+    if((0 != m_ulAggLen) && (m_ulAggTimestamp != ulTimestamp)) {
+        agg_close(lSockFd);
+    }
+    for(;;) {
+        if((0 == m_ulAggLen) && (AS_RTP_PACKETIZER_AGG_SLOTS <= m_ulAggUsed)) {
+            send_batch(lSockFd);
+        }
+        if(agg_append(pNal, ulLen, ulTimestamp)) {
+            return;
+        }
+        if(0 == m_ulAggLen) {
+            /* too big to be aggregated */
+            break;
+        }
+        /* the open one is full,close it and start another */
+        agg_close(lSockFd);
+    }
+
+    if(ulLen <= m_ulMaxPayload) {
+        /* single NAL unit packet,sent in place */
+        if(m_ulBatch <= m_ulPackets) {
+            send_batch(lSockFd);
+        }
+        add_packet(AS_RTP_HEADER_SIZE, pNal, ulLen, ulTimestamp);
+        m_bBorrowed = true;
+        return;
+    }
+    fragment(lSockFd, pNal, ulLen, ulTimestamp);
+}
+
+bool as_rtp_packetizer::agg_append(const uint8_t* pNal, uint32_t ulLen, uint32_t ulTimestamp)
+{
+    /* the payload header and the size of the first NAL are written when it closes */
+    uint32_t ulReserve = m_ulNalHdrLen + 2;
+    uint8_t* pBuf      = m_pAggBufs + m_ulAggUsed*m_ulMaxPayload;
+
+    if(0 == m_ulAggLen) {
+        /* only the small NALs(parameter sets,SEI,small slices) are worth the copy */
+        if(ulReserve + ulLen > m_ulMaxPayload/2) {
+            return false;
+        }
+        memcpy(pBuf + ulReserve, pNal, ulLen);
+        m_ulAggLen       = ulReserve + ulLen;
+        m_ulAggNals      = 1;
+        m_ulAggFirstLen  = ulLen;
+        m_ulAggTimestamp = ulTimestamp;
+        m_ucAggF         = pNal[0] & 0x80;
+        if(AS_RTP_CODEC_H265 == m_enCodec) {
+            m_ucAggLayer = (uint8_t)(((pNal[0] & 0x01) << 5) | (pNal[1] >> 3));
+            m_ucAggNri   = pNal[1] & 0x07;
+        }
+        else {
+            m_ucAggNri   = pNal[0] & 0x60;
+        }
+        return true;
+    }
+
+    if(m_ulAggLen + 2 + ulLen > m_ulMaxPayload) {
+        return false;
+    }
+    pBuf[m_ulAggLen]     = (uint8_t)(ulLen >> 8);
+    pBuf[m_ulAggLen + 1] = (uint8_t)(ulLen & 0xFF);
+    memcpy(pBuf + m_ulAggLen + 2, pNal, ulLen);
+    m_ulAggLen += 2 + ulLen;
+    m_ulAggNals++;
+    m_ucAggF |= pNal[0] & 0x80;
+    if(AS_RTP_CODEC_H265 == m_enCodec) {
+        uint8_t ucLayer = (uint8_t)(((pNal[0] & 0x01) << 5) | (pNal[1] >> 3));
+        uint8_t ucTid   = pNal[1] & 0x07;
+        m_ucAggLayer = (ucLayer < m_ucAggLayer) ? ucLayer : m_ucAggLayer;
+        m_ucAggNri   = (ucTid < m_ucAggNri) ? ucTid : m_ucAggNri;
+    }
+    else if((pNal[0] & 0x60) > m_ucAggNri) {
+        m_ucAggNri = pNal[0] & 0x60;
+    }
+    return true;
+}
+
+void as_rtp_packetizer::agg_close(as_rtp_socket_t lSockFd)
+{
+    if(0 == m_ulAggLen) {
+        return;
+    }
+    /* before the pointers are taken,a send moves the open packet to the first slot */
+    if(m_ulBatch <= m_ulPackets) {
+        send_batch(lSockFd);
+    }
+
+    uint32_t ulReserve = m_ulNalHdrLen + 2;
+    uint8_t* pBuf      = m_pAggBufs + m_ulAggUsed*m_ulMaxPayload;
+    if(1 == m_ulAggNals) {
+        /* one NAL goes as a single NAL unit packet */
+        add_packet(AS_RTP_HEADER_SIZE, pBuf + ulReserve, m_ulAggLen - ulReserve, m_ulAggTimestamp);
+    }
+    else {
+        if(AS_RTP_CODEC_H265 == m_enCodec) {
+            pBuf[0] = (uint8_t)(m_ucAggF | (H265_NAL_AP << 1) | (m_ucAggLayer >> 5));
+            pBuf[1] = (uint8_t)((m_ucAggLayer << 3) | m_ucAggNri);
+        }
+        else {
+            pBuf[0] = (uint8_t)(m_ucAggF | m_ucAggNri | H264_NAL_STAP_A);
+        }
+        pBuf[m_ulNalHdrLen]     = (uint8_t)(m_ulAggFirstLen >> 8);
+        pBuf[m_ulNalHdrLen + 1] = (uint8_t)(m_ulAggFirstLen & 0xFF);
+        add_packet(AS_RTP_HEADER_SIZE, pBuf, m_ulAggLen, m_ulAggTimestamp);
+    }
+    m_ulAggUsed++;
+    m_ulAggLen  = 0;
+    m_ulAggNals = 0;
+}
+
+void as_rtp_packetizer::fragment(as_rtp_socket_t lSockFd, const uint8_t* pNal, uint32_t ulLen, uint32_t ulTimestamp)
+{
+    /* the NAL header is carried by the FU headers,not by the fragments */
+    uint32_t ulFuHdrLen    = m_ulNalHdrLen + 1;
+    uint32_t ulMaxFragment = m_ulMaxPayload - ulFuHdrLen;
+    const uint8_t* pData   = pNal + m_ulNalHdrLen;
+    uint32_t ulRemain      = ulLen - m_ulNalHdrLen;
+    uint8_t  ucStart       = FU_START_BIT;
+
+    while(0 < ulRemain) {
+        uint32_t ulFragment = (ulRemain > ulMaxFragment) ? ulMaxFragment : ulRemain;
+        uint8_t  ucEnd      = (ulFragment == ulRemain) ? FU_END_BIT : 0;
+
+        if(m_ulBatch <= m_ulPackets) {
+            send_batch(lSockFd);
+        }
+        uint8_t* pFuHdr = add_packet(AS_RTP_HEADER_SIZE + ulFuHdrLen, pData, ulFragment, ulTimestamp);
+        if(AS_RTP_CODEC_H265 == m_enCodec) {
+            pFuHdr[0] = (uint8_t)((pNal[0] & 0x81) | (H265_NAL_FU << 1));
+            pFuHdr[1] = pNal[1];
+            pFuHdr[2] = (uint8_t)(ucStart | ucEnd | ((pNal[0] >> 1) & 0x3F));
+        }
+        else {
+            pFuHdr[0] = (uint8_t)((pNal[0] & 0xE0) | H264_NAL_FU_A);
+            pFuHdr[1] = (uint8_t)(ucStart | ucEnd | (pNal[0] & 0x1F));
+        }
+
+        pData    += ulFragment;
+        ulRemain -= ulFragment;
+        ucStart   = 0;
+    }
+    m_bBorrowed = true;
+}
+
+uint8_t* as_rtp_packetizer::add_packet(uint32_t ulHdrLen, const uint8_t* pPayload, uint32_t ulLen,
+                                       uint32_t ulTimestamp)
+{
+    uint8_t* pHdr = m_pHdrs + m_ulPackets*AS_RTP_PACKETIZER_HDR_SIZE;
+
+    pHdr[0]  = 0x80;                       /* V=2 */
+    pHdr[1]  = m_ucPayloadType;
+    pHdr[2]  = (uint8_t)(m_usSeq >> 8);
+    pHdr[3]  = (uint8_t)(m_usSeq & 0xFF);
+    pHdr[4]  = (uint8_t)(ulTimestamp >> 24);
+    pHdr[5]  = (uint8_t)(ulTimestamp >> 16);
+    pHdr[6]  = (uint8_t)(ulTimestamp >> 8);
+    pHdr[7]  = (uint8_t)(ulTimestamp & 0xFF);
+    pHdr[8]  = (uint8_t)(m_ulSsrc >> 24);
+    pHdr[9]  = (uint8_t)(m_ulSsrc >> 16);
+    pHdr[10] = (uint8_t)(m_ulSsrc >> 8);
+    pHdr[11] = (uint8_t)(m_ulSsrc & 0xFF);
+    m_usSeq++;
+
+    m_pIovs[m_ulPackets*2].iov_base     = pHdr;
+    m_pIovs[m_ulPackets*2].iov_len      = ulHdrLen;
+    m_pIovs[m_ulPackets*2 + 1].iov_base = (void*)pPayload;
+    m_pIovs[m_ulPackets*2 + 1].iov_len  = ulLen;
+    m_ulPackets++;
+    return pHdr + AS_RTP_HEADER_SIZE;
+}
+
+int32_t as_rtp_packetizer::send_batch(as_rtp_socket_t lSockFd)
+{
+    uint32_t ulCount = m_ulPackets - m_ulPaced;
+    uint32_t ulSent  = send_range(lSockFd, m_ulPackets);
+
+    m_ulPackets = 0;
+    m_ulPaced   = 0;
+    m_bBorrowed = false;
+    m_stat.ullQueuedBytes = 0;
+    if((0 != m_ulAggLen) && (0 != m_ulAggUsed)) {
+        memmove(m_pAggBufs, m_pAggBufs + m_ulAggUsed*m_ulMaxPayload, m_ulAggLen);
+    }
+    m_ulAggUsed = 0;
+    return (ulSent < ulCount) ? AS_ERROR_CODE_FAIL : AS_ERROR_CODE_OK;
+}
+
+uint32_t as_rtp_packetizer::send_range(as_rtp_socket_t lSockFd, uint32_t ulTo)
+{
+    uint32_t ulSent  = m_ulPaced;
+    uint64_t ullBytes = 0;
+
+#if AS_APP_OS == AS_OS_LINUX
+    while(ulSent < ulTo) {
+        int lRet = sendmmsg(lSockFd, &m_pMsgs[ulSent], ulTo - ulSent, 0);
+        m_stat.ullSendCalls++;
+        if(0 > lRet) {
+            if(EINTR == errno) {
+                continue;
+            }
+            break;
+        }
+        for(int i = 0; i < lRet; i++) {
+            ullBytes += m_pMsgs[ulSent + i].msg_len;
+        }
+        ulSent += (uint32_t)lRet;
+    }
+#elif AS_APP_OS == AS_OS_WIN32
+    /* no sendmmsg,one WSASendTo a packet,gathered from its header and payload without a copy */
+    for(; ulSent < ulTo; ulSent++) {
+        WSABUF bufs[2];
+        DWORD  ulBytesSent = 0;
+        bufs[0].buf = (CHAR*)m_pIovs[ulSent*2].iov_base;
+        bufs[0].len = (ULONG)m_pIovs[ulSent*2].iov_len;
+        bufs[1].buf = (CHAR*)m_pIovs[ulSent*2 + 1].iov_base;
+        bufs[1].len = (ULONG)m_pIovs[ulSent*2 + 1].iov_len;
+        m_stat.ullSendCalls++;
+        if(SOCKET_ERROR == WSASendTo(lSockFd, bufs, 2, &ulBytesSent, 0,
+                                     (struct sockaddr*)&m_destAddr, sizeof(m_destAddr), NULL, NULL)) {
+            break;
+        }
+        ullBytes += ulBytesSent;
+    }
+#endif
+    uint32_t ulCount = ulSent - m_ulPaced;
+    m_stat.ullPackets += ulCount;
+    m_stat.ullBytes   += ullBytes;
+    /* a full socket buffer drops the rest,as a router would */
+    m_stat.ullDropped += ulTo - ulSent;
+    m_stat.ullQueuedBytes = (m_stat.ullQueuedBytes > ullBytes) ? (m_stat.ullQueuedBytes - ullBytes) : 0;
+    m_ulPaced = ulTo;
+    return ulCount;
+}
+
+const uint8_t* as_rtp_packetizer::find_start_code(const uint8_t* pStart, const uint8_t* pEnd, uint32_t& ulCodeLen)
+{
+    const uint8_t* p = pStart;
+    while(p + 3 <= pEnd) {
+        /* look for the 0x01,then check the two zeros before it */
+        const uint8_t* q = (const uint8_t*)memchr(p + 2, 0x01, (size_t)(pEnd - (p + 2)));
+        if(NULL == q) {
+            return NULL;
+        }
+        if((0 == q[-1]) && (0 == q[-2])) {
+            if((q - 3 >= pStart) && (0 == q[-3])) {
+                ulCodeLen = 4;
+                return q - 3;
+            }
+            ulCodeLen = 3;
+            return q - 2;
+        }
+        p = q - 1;
+    }
+    return NULL;
+}
@@ -0,0 +1,167 @@
+#ifndef __AS_RTP_PACKETIZER_H__
+#define __AS_RTP_PACKETIZER_H__
+
+#include <stdint.h>
+extern "C"{
+#include "as_config.h"
+#include "as_basetype.h"
+#include "as_common.h"
+}
+#if AS_APP_OS == AS_OS_LINUX
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+typedef int     as_rtp_socket_t;
+#elif AS_APP_OS == AS_OS_WIN32
+#include <winsock2.h>
+typedef SOCKET  as_rtp_socket_t;
+struct iovec
+{
+    void   *iov_base;
+    size_t  iov_len;
+};
+#endif
+
+#define AS_RTP_HEADER_SIZE             12
+/* payload of one packet,without the RTP header,it keeps a packet within 1500 */
+#define AS_RTP_PACKETIZER_MAX_PAYLOAD  1400
+/* packets handed to one sendmmsg by default */
+#define AS_RTP_PACKETIZER_BATCH        256
+/* the packets a paced frame may queue,a 1.4MB frame */
+#define AS_RTP_PACKETIZER_MAX_BATCH    1024
+/* aggregation packets(STAP-A/AP) waiting for the send at once */
+#define AS_RTP_PACKETIZER_AGG_SLOTS    16
+/* the RTP header,plus the FU indicator and FU header(H.264) or the 3 bytes of H.265 */
+#define AS_RTP_PACKETIZER_HDR_SIZE     (AS_RTP_HEADER_SIZE + 4)
+
+enum AS_RTP_VIDEO_CODEC
+{
+    AS_RTP_CODEC_H264 = 0,
+    AS_RTP_CODEC_H265 = 1
+};
+
+typedef struct tagAS_RTP_PACKETIZER_STAT
+{
+    uint64_t ullFrames;       /* access units,counted by the end of frame */
+    uint64_t ullNals;
+    uint64_t ullPackets;
+    uint64_t ullBytes;        /* with the RTP headers */
+    uint64_t ullSendCalls;    /* sendmmsg(or sendto) calls */
+    uint64_t ullDropped;      /* packets the socket did not take */
+    uint64_t ullQueuedBytes;  /* pacing:the bytes waiting in the batch now */
+    uint64_t ullPacedFrames;  /* pacing:the batches drained by pace() */
+    uint64_t ullPaceDelay;    /* pacing:the time(us) the batches took to drain,in total */
+    uint64_t ullPaceMaxDelay; /* pacing:the longest of them(us) */
+} AS_RTP_PACKETIZER_STAT;
+
+/*
+ * RTP packetizer of H.264(RFC 6184) and H.265(RFC 7798) over UDP.
+ * the NAL units that fit one packet are copied and aggregated(STAP-A/AP),the
+ * bigger ones are fragmented(FU-A/FU) and sent from the caller's buffer in
+ * place,each packet is an iovec of its header and its payload.the packets of
+ * a frame are sent in one sendmmsg,Win32 has none and sends them one
+ * WSASendTo a packet.
+ * with the pacing on,the packets are queued instead and pace() sends them
+ * through a token bucket,so a frame goes out over a part of the frame
+ * interval rather than in one burst.
+ */
+class as_rtp_packetizer
+{
+public:
+    as_rtp_packetizer();
+    virtual ~as_rtp_packetizer();
+public:
+    int32_t init(AS_RTP_VIDEO_CODEC enCodec, uint8_t ucPayloadType, uint32_t ulSsrc,
+                 uint32_t ulMaxPayload = AS_RTP_PACKETIZER_MAX_PAYLOAD,
+                 uint32_t ulBatch = AS_RTP_PACKETIZER_BATCH);
+    void    release();
+    /* IPv4 only */
+    int32_t set_destination(const char* pszAddr, uint16_t usPort);
+
+    /*
+     * packetize the Annex-B data(one or more NAL units,the start codes may be
+     * left out if it is one NAL) of the frame ulTimestamp.the packets are sent
+     * when bEndOfFrame is set(the last one carries the marker bit),and before
+     * the call returns if pData is referenced,so pData may be reused after it.
+     */
+    int32_t send_nals(as_rtp_socket_t lSockFd, const uint8_t* pData, uint32_t ulSize,
+                      uint32_t ulTimestamp, bool bEndOfFrame);
+    /* send everything pending,including an open aggregation packet */
+    int32_t flush(as_rtp_socket_t lSockFd);
+
+    /*
+     * spread each frame over ulPercent% of the frame interval(0:no pacing),the
+     * NALs of one timestamp are one frame even if they are queued by several
+     * send_nals(),the interval is taken from the timestamps at ulClockRate,ulBurstBytes go out
+     * without delay(0:4 packets).with the pacing on,send_nals() only queues the
+     * packets(a batch that is full is still sent at once),the caller calls
+     * pace() until ulDelayUs is 0 before the next send_nals() or the reuse of
+     * its buffer.
+     */
+    void    set_pacing(uint32_t ulPercent, uint32_t ulClockRate, uint32_t ulBurstBytes = 0);
+    bool    paced(){return 0 < m_ulPacePercent;};
+    /* send what the bucket allows,ulDelayUs:when to call it again,0 if nothing is left */
+    int32_t pace(as_rtp_socket_t lSockFd, uint32_t& ulDelayUs);
+
+    uint16_t next_seq(){return m_usSeq;};
+    void     get_stat(AS_RTP_PACKETIZER_STAT& stat){stat = m_stat;};
+private:
+    void     add_nal(as_rtp_socket_t lSockFd, const uint8_t* pNal, uint32_t ulLen, uint32_t ulTimestamp);
+    bool     agg_append(const uint8_t* pNal, uint32_t ulLen, uint32_t ulTimestamp);
+    void     agg_close(as_rtp_socket_t lSockFd);
+    void     fragment(as_rtp_socket_t lSockFd, const uint8_t* pNal, uint32_t ulLen, uint32_t ulTimestamp);
+    /* the caller makes room in the batch first,it returns where the header goes on after the RTP header */
+    uint8_t* add_packet(uint32_t ulHdrLen, const uint8_t* pPayload, uint32_t ulLen, uint32_t ulTimestamp);
+    int32_t  send_batch(as_rtp_socket_t lSockFd);
+    /* send the packets[m_ulPaced,ulTo),it returns how many the socket took */
+    uint32_t send_range(as_rtp_socket_t lSockFd, uint32_t ulTo);
+    void     pace_start(uint32_t ulTimestamp);
+    static uint64_t now_us();
+    static const uint8_t* find_start_code(const uint8_t* pStart, const uint8_t* pEnd, uint32_t& ulCodeLen);
+private:
+    AS_RTP_VIDEO_CODEC   m_enCodec;
+    uint8_t              m_ucPayloadType;
+    uint32_t             m_ulSsrc;
+    uint16_t             m_usSeq;
+    uint32_t             m_ulMaxPayload;
+    uint32_t             m_ulNalHdrLen;     /* 1:H.264 2:H.265 */
+    struct sockaddr_in   m_destAddr;
+
+    /* the batch,each packet is two iovecs:the header and the payload */
+    uint8_t             *m_pHdrs;           /* AS_RTP_PACKETIZER_BATCH headers */
+    struct iovec        *m_pIovs;
+#if AS_APP_OS == AS_OS_LINUX
+    struct mmsghdr      *m_pMsgs;
+#endif
+    uint32_t             m_ulBatch;
+    uint32_t             m_ulPackets;
+    uint32_t             m_ulPaced;         /* the packets of the batch pace() has sent */
+    bool                 m_bBorrowed;       /* the batch references the caller's data */
+
+    /* the aggregation packets,m_ulAggUsed of them are in the batch */
+    uint8_t             *m_pAggBufs;
+    uint32_t             m_ulAggUsed;
+    uint32_t             m_ulAggLen;        /* the open one,0 if there is none */
+    uint32_t             m_ulAggNals;
+    uint32_t             m_ulAggFirstLen;
+    uint32_t             m_ulAggTimestamp;
+    uint8_t              m_ucAggF;          /* the F bit of any NAL */
+    uint8_t              m_ucAggNri;        /* H.264:the highest NRI,H.265:the lowest TID */
+    uint8_t              m_ucAggLayer;      /* H.265:the lowest layer id */
+
+    /* the token bucket */
+    uint32_t             m_ulPacePercent;
+    uint32_t             m_ulClockRate;
+    uint32_t             m_ulBurstBytes;
+    uint32_t             m_ulFrameInterval; /* us,estimated from the timestamps */
+    uint32_t             m_ulLastTimestamp;
+    bool                 m_bHaveTimestamp;
+    double               m_dTokens;         /* bytes */
+    double               m_dRate;           /* bytes per us */
+    uint64_t             m_ullRefillTime;
+    uint64_t             m_ullPaceStart;
+    uint64_t             m_ullFrameDeadline;/* when the access unit should be out */
+    AS_RTP_PACKETIZER_STAT m_stat;
+};
+#endif /* __AS_RTP_PACKETIZER_H__ */
@@ -0,0 +1,595 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "as_rtp_port_pool.h"
+#include "as_lock_guard.h"
+#include "as_log.h"
+#include "as_mem.h"
+#include "as_ini_config.h"
+#if AS_APP_OS == AS_OS_LINUX
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <ifaddrs.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#elif AS_APP_OS == AS_OS_WIN32
+#include <ws2tcpip.h>
+#endif
+
+#define RTCP_PT_SR          200
+#define RTCP_PT_RR          201
+#define RTCP_PT_FIRST       192
+#define RTCP_PT_LAST        223
+
+static inline uint32_t lowest_bit(uint64_t ullBits)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    unsigned long ulIndex = 0;
+    if(0 != (uint32_t)ullBits) {
+        _BitScanForward(&ulIndex, (unsigned long)(uint32_t)ullBits);
+        return (uint32_t)ulIndex;
+    }
+    _BitScanForward(&ulIndex, (unsigned long)(ullBits >> 32));
+    return (uint32_t)ulIndex + 32;
+#else
+    return (uint32_t)__builtin_ctzll(ullBits);
+#endif
+}
+
+static inline uint32_t read_be32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+as_rtp_port_pool::as_rtp_port_pool()
+{
+    m_mutex           = NULL;
+    m_usStart         = 0;
+    m_usEnd           = 0;
+    m_ulCallPorts     = AS_RTP_PORT_POOL_CALL_PORTS;
+    m_strLocalIp      = "";
+    m_strIfName       = "";
+    m_bReusePort      = false;
+    m_ulGroups        = 0;
+    m_ulSlots         = 0;
+    m_ulWords         = 0;
+    m_pFree           = NULL;
+    m_pSummary        = NULL;
+    m_ulCursor        = 0;
+    m_ulUsed          = 0;
+    m_pDemuxThread    = NULL;
+    m_bExit           = false;
+    m_ullDemuxPackets = 0;
+    m_ullDemuxUnknown = 0;
+    memset(m_aGroupSlot,0,sizeof(m_aGroupSlot));
+    memset(m_aGroupCalls,0,sizeof(m_aGroupCalls));
+    for(uint32_t i = 0; i < AS_RTP_PORT_POOL_MAX_GROUPS; i++) {
+        for(uint32_t j = 0; j < AS_RTP_PORT_POOL_CALL_PORTS; j++) {
+            m_aSocks[i][j] = AS_RTP_PORT_POOL_INVALID_SOCK;
+        }
+    }
+}
+
+as_rtp_port_pool::~as_rtp_port_pool()
+{
+    close();
+}
+
+void as_rtp_port_pool::set_conf(uint16_t usStart, uint16_t usEnd, const char* pszLocalIp,
+                                const char* pszIfName, bool bReusePort, uint32_t ulGroups,
+                                uint32_t ulCallPorts)
+{
+    m_usStart     = usStart;
+    m_usEnd       = usEnd;
+    m_strLocalIp  = (NULL == pszLocalIp) ? "" : pszLocalIp;
+    m_strIfName   = (NULL == pszIfName) ? "" : pszIfName;
+    m_bReusePort  = bReusePort;
+    m_ulGroups    = (AS_RTP_PORT_POOL_MAX_GROUPS < ulGroups) ? AS_RTP_PORT_POOL_MAX_GROUPS : ulGroups;
+    m_ulCallPorts = ulCallPorts;
+    if((0 == m_ulCallPorts) || (AS_RTP_PORT_POOL_CALL_PORTS < m_ulCallPorts)) {
+        m_ulCallPorts = AS_RTP_PORT_POOL_CALL_PORTS;
+    }
+}
+
+void as_rtp_port_pool::read_conf(as_ini_config& config, const char* pszSection)
+{
+    std::string strValue = "";
+
+    if(INI_SUCCESS == config.GetValue(pszSection,"PortStart",strValue)) {
+        m_usStart = (uint16_t)atoi(strValue.c_str());
+    }
+    if(INI_SUCCESS == config.GetValue(pszSection,"PortEnd",strValue)) {
+        m_usEnd = (uint16_t)atoi(strValue.c_str());
+    }
+    if(INI_SUCCESS == config.GetValue(pszSection,"LocalIP",strValue)) {
+        m_strLocalIp = strValue;
+    }
+    if(INI_SUCCESS == config.GetValue(pszSection,"Interface",strValue)) {
+        m_strIfName = strValue;
+    }
+    if(INI_SUCCESS == config.GetValue(pszSection,"ReusePort",strValue)) {
+        m_bReusePort = (0 != atoi(strValue.c_str()));
+    }
+    if(INI_SUCCESS == config.GetValue(pszSection,"SharedGroups",strValue)) {
+        m_ulGroups = (uint32_t)atoi(strValue.c_str());
+        if(AS_RTP_PORT_POOL_MAX_GROUPS < m_ulGroups) {
+            m_ulGroups = AS_RTP_PORT_POOL_MAX_GROUPS;
+        }
+    }
+}
+
+int32_t as_rtp_port_pool::open()
+{
+    AS_LOG(AS_LOG_DEBUG,"as_rtp_port_pool::open begin.");
+    if(m_usEnd < m_usStart) {
+        AS_LOG(AS_LOG_ERROR,"as_rtp_port_pool::open,the port range:[%d-%d] is not right.",m_usStart,m_usEnd);
+        return AS_ERROR_CODE_FAIL;
+    }
+    m_ulSlots = ((uint32_t)m_usEnd - m_usStart + 1)/m_ulCallPorts;
+    if((0 == m_ulSlots) || (m_ulGroups > m_ulSlots)) {
+        AS_LOG(AS_LOG_ERROR,"as_rtp_port_pool::open,the port range:[%d-%d] is too small.",m_usStart,m_usEnd);
+        return AS_ERROR_CODE_FAIL;
+    }
+
+    /* bind the configured address,or the address of the interface */
+    if((0 == m_strLocalIp.length()) || ("0.0.0.0" == m_strLocalIp)) {
+        std::string strIp = "";
+        if(AS_ERROR_CODE_OK == detect_local_ip(m_strIfName.c_str(), strIp)) {
+            m_strLocalIp = strIp;
+        }
+        else {
+            AS_LOG(AS_LOG_WARNING,"as_rtp_port_pool::open,no address on the interface:[%s],bind any address.",
+                                  m_strIfName.c_str());
+            m_strLocalIp = "0.0.0.0";
+        }
+    }
+
+    m_mutex = as_create_mutex();
+    if(NULL == m_mutex) {
+        AS_LOG(AS_LOG_ERROR,"as_rtp_port_pool::open,create mutex fail.");
+        return AS_ERROR_CODE_FAIL;
+    }
+
+    m_ulWords = (m_ulSlots + 63)/64;
+    uint32_t ulSummaryWords = (m_ulWords + 63)/64;
+    if((NULL == AS_NEW(m_pFree,m_ulWords)) || (NULL == AS_NEW(m_pSummary,ulSummaryWords))) {
+        AS_LOG(AS_LOG_ERROR,"as_rtp_port_pool::open,alloc the bitmap fail.");
+        close();
+        return AS_ERROR_CODE_FAIL;
+    }
+    for(uint32_t i = 0; i < m_ulWords; i++) {
+        uint32_t ulBits = ((i + 1)*64 <= m_ulSlots) ? 64 : (m_ulSlots - i*64);
+        m_pFree[i] = (64 == ulBits) ? ~(uint64_t)0 : (((uint64_t)1 << ulBits) - 1);
+    }
+    for(uint32_t i = 0; i < ulSummaryWords; i++) {
+        uint32_t ulBits = ((i + 1)*64 <= m_ulWords) ? 64 : (m_ulWords - i*64);
+        m_pSummary[i] = (64 == ulBits) ? ~(uint64_t)0 : (((uint64_t)1 << ulBits) - 1);
+    }
+    m_ulCursor = 0;
+    m_ulUsed   = 0;
+
+    if(shared() && (AS_ERROR_CODE_OK != open_groups())) {
+        close();
+        return AS_ERROR_CODE_FAIL;
+    }
+
+    AS_LOG(AS_LOG_INFO,"as_rtp_port_pool::open,ports:[%d-%d],slots:[%d],local ip:[%s],reuse port:[%d],shared groups:[%d].",
+                       m_usStart,m_usEnd,m_ulSlots,m_strLocalIp.c_str(),m_bReusePort,m_ulGroups);
+    return AS_ERROR_CODE_OK;
+}
+
+void as_rtp_port_pool::close()
+{
+    if(NULL != m_pDemuxThread) {
+        m_bExit = true;
+        as_join_thread(m_pDemuxThread);
+        m_pDemuxThread = NULL;
+    }
+    for(uint32_t i = 0; i < AS_RTP_PORT_POOL_MAX_GROUPS; i++) {
+        for(uint32_t j = 0; j < AS_RTP_PORT_POOL_CALL_PORTS; j++) {
+            if(AS_RTP_PORT_POOL_INVALID_SOCK == m_aSocks[i][j]) {
+                continue;
+            }
+#if AS_APP_OS == AS_OS_LINUX
+            ::close(m_aSocks[i][j]);
+#elif AS_APP_OS == AS_OS_WIN32
+            closesocket(m_aSocks[i][j]);
+#endif
+            m_aSocks[i][j] = AS_RTP_PORT_POOL_INVALID_SOCK;
+        }
+    }
+    AS_DELETE(m_pFree,MULTI);
+    AS_DELETE(m_pSummary,MULTI);
+    m_ssrcMap.clear();
+    m_ulUsed = 0;
+    if(NULL != m_mutex) {
+        as_destroy_mutex(m_mutex);
+        m_mutex = NULL;
+    }
+}
+
+int32_t as_rtp_port_pool::alloc(AS_RTP_PORTS& ports)
+{
+    as_lock_guard locker(m_mutex);
+    if(NULL == m_pFree) {
+        return AS_ERROR_CODE_FAIL;
+    }
+
+    for(uint32_t i = 0; i < AS_RTP_PORT_POOL_CALL_PORTS; i++) {
+        ports.aSocks[i] = AS_RTP_PORT_POOL_INVALID_SOCK;
+    }
+    if(shared()) {
+        /* the group with the fewest calls */
+        uint32_t ulGroup = 0;
+        for(uint32_t i = 1; i < m_ulGroups; i++) {
+            if(m_aGroupCalls[i] < m_aGroupCalls[ulGroup]) {
+                ulGroup = i;
+            }
+        }
+        m_aGroupCalls[ulGroup]++;
+        ports.usBase = (uint16_t)(m_usStart + m_aGroupSlot[ulGroup]*m_ulCallPorts);
+        ports.lGroup = (int32_t)ulGroup;
+        for(uint32_t i = 0; i < m_ulCallPorts; i++) {
+            ports.aSocks[i] = m_aSocks[ulGroup][i];
+        }
+        return AS_ERROR_CODE_OK;
+    }
+
+    uint32_t ulSlot = 0;
+    if(AS_ERROR_CODE_OK != take_slot(ulSlot)) {
+        AS_LOG(AS_LOG_WARNING,"as_rtp_port_pool::alloc,all the:[%d] slots are used.",m_ulSlots);
+        return AS_ERROR_CODE_FAIL;
+    }
+    ports.usBase = (uint16_t)(m_usStart + ulSlot*m_ulCallPorts);
+    ports.lGroup = -1;
+    return AS_ERROR_CODE_OK;
+}
+
+void as_rtp_port_pool::free(const AS_RTP_PORTS& ports)
+{
+    as_lock_guard locker(m_mutex);
+    if(NULL == m_pFree) {
+        return;
+    }
+
+    if(0 <= ports.lGroup) {
+        if(((uint32_t)ports.lGroup < m_ulGroups) && (0 < m_aGroupCalls[ports.lGroup])) {
+            m_aGroupCalls[ports.lGroup]--;
+        }
+        return;
+    }
+    if((ports.usBase < m_usStart) || (0 != (ports.usBase - m_usStart) % m_ulCallPorts)) {
+        AS_LOG(AS_LOG_WARNING,"as_rtp_port_pool::free,the port:[%d] is not from the pool.",ports.usBase);
+        return;
+    }
+    give_slot((ports.usBase - m_usStart)/m_ulCallPorts);
+}
+
+int32_t as_rtp_port_pool::take_slot(uint32_t& ulSlot)
+{
+    if(m_ulUsed >= m_ulSlots) {
+        return AS_ERROR_CODE_FAIL;
+    }
+
+    /* the slots after the cursor in its word first,then the words after it,then
+     * the ones from the start up to the cursor word again,so a slot just freed
+     * waits for all the others even with a single word */
+    uint32_t ulCursor = m_ulCursor % m_ulSlots;
+    uint32_t ulCursorWord = ulCursor/64;
+    uint64_t ullAfter = m_pFree[ulCursorWord] & (~(uint64_t)0 << (ulCursor % 64));
+    if(0 != ullAfter) {
+        return take_bit(ulCursorWord, lowest_bit(ullAfter), ulSlot);
+    }
+    for(uint32_t ulPass = 0; ulPass < 2; ulPass++) {
+        uint32_t ulFrom = (0 == ulPass) ? (ulCursorWord + 1) : 0;
+        uint32_t ulTo   = (0 == ulPass) ? m_ulWords : (ulCursorWord + 1);
+        for(uint32_t s = ulFrom/64; s*64 < ulTo; s++) {
+            uint64_t ullWords = m_pSummary[s];
+            if(s == ulFrom/64) {
+                ullWords &= ~(uint64_t)0 << (ulFrom % 64);
+            }
+            if((s + 1)*64 > ulTo) {
+                ullWords &= ((uint64_t)1 << (ulTo - s*64)) - 1;
+            }
+            if(0 == ullWords) {
+                continue;
+            }
+            uint32_t ulWord = s*64 + lowest_bit(ullWords);
+            return take_bit(ulWord, lowest_bit(m_pFree[ulWord]), ulSlot);
+        }
+    }
+    return AS_ERROR_CODE_FAIL;
+}
+
+int32_t as_rtp_port_pool::take_bit(uint32_t ulWord, uint32_t ulBit, uint32_t& ulSlot)
+{
+    m_pFree[ulWord] &= ~((uint64_t)1 << ulBit);
+    if(0 == m_pFree[ulWord]) {
+        m_pSummary[ulWord/64] &= ~((uint64_t)1 << (ulWord % 64));
+    }
+    ulSlot = ulWord*64 + ulBit;
+    m_ulCursor = ulSlot + 1;
+    m_ulUsed++;
+    return AS_ERROR_CODE_OK;
+}
+
+void as_rtp_port_pool::give_slot(uint32_t ulSlot)
+{
+    if(ulSlot >= m_ulSlots) {
+        return;
+    }
+    uint32_t ulWord = ulSlot/64;
+    uint64_t ullBit = (uint64_t)1 << (ulSlot % 64);
+    if(0 != (m_pFree[ulWord] & ullBit)) {
+        AS_LOG(AS_LOG_WARNING,"as_rtp_port_pool::give_slot,the slot:[%d] is free already.",ulSlot);
+        return;
+    }
+    m_pFree[ulWord] |= ullBit;
+    m_pSummary[ulWord/64] |= (uint64_t)1 << (ulWord % 64);
+    m_ulUsed--;
+}
+
+int32_t as_rtp_port_pool::open_groups()
+{
+    for(uint32_t i = 0; i < m_ulGroups; i++) {
+        uint32_t ulSlot = 0;
+        if(AS_ERROR_CODE_OK != take_slot(ulSlot)) {
+            return AS_ERROR_CODE_FAIL;
+        }
+        m_aGroupSlot[i]  = ulSlot;
+        m_aGroupCalls[i] = 0;
+        for(uint32_t j = 0; j < m_ulCallPorts; j++) {
+            uint16_t usPort = (uint16_t)(m_usStart + ulSlot*m_ulCallPorts + j);
+            m_aSocks[i][j] = open_socket(usPort);
+            if(AS_RTP_PORT_POOL_INVALID_SOCK == m_aSocks[i][j]) {
+                AS_LOG(AS_LOG_ERROR,"as_rtp_port_pool::open_groups,open the port:[%s:%d] fail.",
+                                    m_strLocalIp.c_str(),usPort);
+                return AS_ERROR_CODE_FAIL;
+            }
+        }
+    }
+
+    m_bExit = false;
+    if(AS_ERROR_CODE_OK != as_create_thread((AS_THREAD_FUNC)demux_invoke,
+                                            this,&m_pDemuxThread,AS_DEFAULT_STACK_SIZE)) {
+        AS_LOG(AS_LOG_ERROR,"as_rtp_port_pool::open_groups,create the demux thread fail.");
+        m_pDemuxThread = NULL;
+        return AS_ERROR_CODE_FAIL;
+    }
+    return AS_ERROR_CODE_OK;
+}
+
+as_rtp_socket_t as_rtp_port_pool::open_socket(uint16_t usPort)
+{
+    as_rtp_socket_t lSockFd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(AS_RTP_PORT_POOL_INVALID_SOCK == lSockFd) {
+        return AS_RTP_PORT_POOL_INVALID_SOCK;
+    }
+
+    if(m_bReusePort) {
+        int lFlag = 1;
+        setsockopt(lSockFd, SOL_SOCKET, SO_REUSEADDR, (char*)&lFlag, sizeof(lFlag));
+#ifdef SO_REUSEPORT
+        setsockopt(lSockFd, SOL_SOCKET, SO_REUSEPORT, (char*)&lFlag, sizeof(lFlag));
+#endif
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr,0,sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(usPort);
+    addr.sin_addr.s_addr = inet_addr(m_strLocalIp.c_str());
+    int lRet = bind(lSockFd, (struct sockaddr*)&addr, sizeof(addr));
+#if AS_APP_OS == AS_OS_LINUX
+    if(0 == lRet) {
+        lRet = fcntl(lSockFd, F_SETFL, fcntl(lSockFd, F_GETFL, 0) | O_NONBLOCK);
+    }
+    if(0 != lRet) {
+        ::close(lSockFd);
+        return AS_RTP_PORT_POOL_INVALID_SOCK;
+    }
+#elif AS_APP_OS == AS_OS_WIN32
+    u_long ulNonBlock = 1;
+    if(0 == lRet) {
+        lRet = ioctlsocket(lSockFd, FIONBIO, &ulNonBlock);
+    }
+    if(0 != lRet) {
+        closesocket(lSockFd);
+        return AS_RTP_PORT_POOL_INVALID_SOCK;
+    }
+#endif
+    return lSockFd;
+}
+
+int32_t as_rtp_port_pool::bind_ssrc(uint32_t& ulSsrc, AS_RTP_DEMUX_FUNC pFunc, void* pCtx)
+{
+    as_lock_guard locker(m_mutex);
+    /* a collision takes a new ssrc(RFC 3550 8.2),the map is far from full */
+    uint32_t ulTry = 0;
+    while(m_ssrcMap.end() != m_ssrcMap.find(ulSsrc)) {
+        if(AS_RTP_PORT_POOL_SSRC_RETRY <= ulTry++) {
+            AS_LOG(AS_LOG_WARNING,"as_rtp_port_pool::bind_ssrc,no free ssrc after:[%d] tries.",ulTry);
+            return AS_ERROR_CODE_FAIL;
+        }
+        uint32_t ulNew = ((uint32_t)rand() << 16) ^ (uint32_t)rand() ^ (uint32_t)time(NULL);
+        AS_LOG(AS_LOG_INFO,"as_rtp_port_pool::bind_ssrc,the ssrc:[0x%x] is bound already,take:[0x%x].",
+                           ulSsrc,ulNew);
+        ulSsrc = ulNew;
+    }
+    AS_RTP_SSRC_BIND bind;
+    bind.pFunc = pFunc;
+    bind.pCtx  = pCtx;
+    m_ssrcMap.insert(SSRCBINDMAP::value_type(ulSsrc,bind));
+    return AS_ERROR_CODE_OK;
+}
+
+void as_rtp_port_pool::unbind_ssrc(uint32_t ulSsrc)
+{
+    /* the demux calls the handlers with the lock,so none runs after this */
+    as_lock_guard locker(m_mutex);
+    m_ssrcMap.erase(ulSsrc);
+}
+
+void as_rtp_port_pool::get_demux_stat(uint64_t& ullPackets, uint64_t& ullUnknown)
+{
+    as_lock_guard locker(m_mutex);
+    ullPackets = m_ullDemuxPackets;
+    ullUnknown = m_ullDemuxUnknown;
+}
+
+void *as_rtp_port_pool::demux_invoke(void *arg)
+{
+    as_rtp_port_pool* pPool = (as_rtp_port_pool*)arg;
+    pPool->demux_thread();
+    return NULL;
+}
+
+void as_rtp_port_pool::demux_thread()
+{
+    uint8_t  buf[AS_RTP_PORT_POOL_RECV_SIZE];
+    uint32_t ulCount = m_ulGroups*m_ulCallPorts;
+
+    AS_LOG(AS_LOG_INFO,"as_rtp_port_pool::demux_thread,start,sockets:[%d].",ulCount);
+#if AS_APP_OS == AS_OS_LINUX
+    struct pollfd fds[AS_RTP_PORT_POOL_MAX_GROUPS*AS_RTP_PORT_POOL_CALL_PORTS];
+    for(uint32_t i = 0; i < ulCount; i++) {
+        fds[i].fd     = m_aSocks[i/m_ulCallPorts][i%m_ulCallPorts];
+        fds[i].events = POLLIN;
+    }
+#endif
+    while(!m_bExit) {
+#if AS_APP_OS == AS_OS_LINUX
+        int lReady = poll(fds, ulCount, AS_RTP_PORT_POOL_POLL_TIMEOUT);
+#elif AS_APP_OS == AS_OS_WIN32
+        fd_set rset;
+        FD_ZERO(&rset);
+        for(uint32_t i = 0; i < ulCount; i++) {
+            FD_SET(m_aSocks[i/m_ulCallPorts][i%m_ulCallPorts], &rset);
+        }
+        struct timeval tv;
+        tv.tv_sec  = 0;
+        tv.tv_usec = AS_RTP_PORT_POOL_POLL_TIMEOUT*1000;
+        int lReady = select(0, &rset, NULL, NULL, &tv);
+#endif
+        if(0 >= lReady) {
+            continue;
+        }
+        for(uint32_t i = 0; i < ulCount; i++) {
+            as_rtp_socket_t lSockFd = m_aSocks[i/m_ulCallPorts][i%m_ulCallPorts];
+#if AS_APP_OS == AS_OS_LINUX
+            if(0 == (fds[i].revents & POLLIN)) {
+                continue;
+            }
+#elif AS_APP_OS == AS_OS_WIN32
+            if(!FD_ISSET(lSockFd, &rset)) {
+                continue;
+            }
+#endif
+            /* the sockets are non-blocking,read until they are empty */
+            for(;;) {
+                int lLen = recv(lSockFd, (char*)buf, sizeof(buf), 0);
+                if(0 >= lLen) {
+                    break;
+                }
+                demux(i%m_ulCallPorts, buf, (uint32_t)lLen);
+            }
+        }
+    }
+    AS_LOG(AS_LOG_INFO,"as_rtp_port_pool::demux_thread,exit.");
+}
+
+void as_rtp_port_pool::demux(uint32_t ulPort, const uint8_t* pData, uint32_t ulLen)
+{
+    if((8 > ulLen) || (2 != (pData[0] >> 6))) {
+        return;
+    }
+
+    uint32_t ulSsrc = 0;
+    if((RTCP_PT_FIRST <= pData[1]) && (RTCP_PT_LAST >= pData[1])) {
+        /* our ssrc is the source of the report blocks,else take the sender's */
+        uint32_t ulReports = pData[0] & 0x1F;
+        uint32_t ulBlock   = (RTCP_PT_SR == pData[1]) ? 28 : 8;
+        if((0 < ulReports) && ((RTCP_PT_SR == pData[1]) || (RTCP_PT_RR == pData[1]))
+            && (ulBlock + 4 <= ulLen)) {
+            ulSsrc = read_be32(pData + ulBlock);
+        }
+        else {
+            ulSsrc = read_be32(pData + 4);
+        }
+    }
+    else {
+        if(12 > ulLen) {
+            return;
+        }
+        ulSsrc = read_be32(pData + 8);
+    }
+
+    as_lock_guard locker(m_mutex);
+    m_ullDemuxPackets++;
+    SSRCBINDMAP::iterator iter = m_ssrcMap.find(ulSsrc);
+    if(m_ssrcMap.end() == iter) {
+        m_ullDemuxUnknown++;
+        return;
+    }
+    iter->second.pFunc(iter->second.pCtx, ulPort, pData, ulLen);
+}
+
+int32_t as_rtp_port_pool::detect_local_ip(const char* pszIfName, std::string& strIp)
+{
+#if AS_APP_OS == AS_OS_LINUX
+    struct ifaddrs* pIfList = NULL;
+    if(0 != getifaddrs(&pIfList)) {
+        return AS_ERROR_CODE_FAIL;
+    }
+    int32_t lResult = AS_ERROR_CODE_FAIL;
+    for(struct ifaddrs* pIf = pIfList; NULL != pIf; pIf = pIf->ifa_next) {
+        if((NULL == pIf->ifa_addr) || (AF_INET != pIf->ifa_addr->sa_family)
+            || (0 == (pIf->ifa_flags & IFF_UP))) {
+            continue;
+        }
+        if((NULL != pszIfName) && ('\0' != pszIfName[0])) {
+            if(0 != strcmp(pIf->ifa_name, pszIfName)) {
+                continue;
+            }
+        }
+        else if(0 != (pIf->ifa_flags & IFF_LOOPBACK)) {
+            continue;
+        }
+        char szIp[INET_ADDRSTRLEN] = {0};
+        if(NULL != inet_ntop(AF_INET, &((struct sockaddr_in*)pIf->ifa_addr)->sin_addr, szIp, sizeof(szIp))) {
+            strIp   = szIp;
+            lResult = AS_ERROR_CODE_OK;
+            break;
+        }
+    }
+    freeifaddrs(pIfList);
+    return lResult;
+#elif AS_APP_OS == AS_OS_WIN32
+    /* the interface name is not looked at,the first address of the host is taken */
+    char szHost[256] = {0};
+    if(0 != gethostname(szHost, sizeof(szHost))) {
+        return AS_ERROR_CODE_FAIL;
+    }
+    struct addrinfo hints;
+    struct addrinfo* pList = NULL;
+    memset(&hints,0,sizeof(hints));
+    hints.ai_family = AF_INET;
+    if(0 != getaddrinfo(szHost, NULL, &hints, &pList)) {
+        return AS_ERROR_CODE_FAIL;
+    }
+    int32_t lResult = AS_ERROR_CODE_FAIL;
+    for(struct addrinfo* p = pList; NULL != p; p = p->ai_next) {
+        struct sockaddr_in* pAddr = (struct sockaddr_in*)p->ai_addr;
+        if(127 == (ntohl(pAddr->sin_addr.s_addr) >> 24)) {
+            continue;
+        }
+        strIp   = inet_ntoa(pAddr->sin_addr);
+        lResult = AS_ERROR_CODE_OK;
+        break;
+    }
+    freeaddrinfo(pList);
+    return lResult;
+#endif
+}
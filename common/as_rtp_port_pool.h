@@ -0,0 +1,132 @@
+#ifndef __AS_RTP_PORT_POOL_H__
+#define __AS_RTP_PORT_POOL_H__
+
+#include <stdint.h>
+#include <string>
+#include <map>
+extern "C"{
+#include "as_config.h"
+#include "as_basetype.h"
+#include "as_common.h"
+#include "as_mutex.h"
+#include "as_thread.h"
+}
+#include "as_rtp_packetizer.h"
+
+class as_ini_config;
+
+/* the ports of one call,video rtp/rtcp and audio rtp/rtcp */
+#define AS_RTP_PORT_POOL_CALL_PORTS    4
+/* the groups of shared sockets at most */
+#define AS_RTP_PORT_POOL_MAX_GROUPS    16
+/* the demux thread looks at the exit flag at this interval(ms) */
+#define AS_RTP_PORT_POOL_POLL_TIMEOUT  100
+#define AS_RTP_PORT_POOL_RECV_SIZE     2048
+#define AS_RTP_PORT_POOL_INVALID_SOCK  ((as_rtp_socket_t)-1)
+/* the new ssrcs bind_ssrc() tries on a collision */
+#define AS_RTP_PORT_POOL_SSRC_RETRY    8
+
+typedef struct tagAS_RTP_PORTS
+{
+    uint16_t        usBase;     /* the first port,the others follow it */
+    int32_t         lGroup;     /* the shared group,-1 if the ports are the call's own */
+    as_rtp_socket_t aSocks[AS_RTP_PORT_POOL_CALL_PORTS]; /* shared mode only */
+} AS_RTP_PORTS;
+
+/*
+ * a packet that came to a shared socket for the ssrc it was bound with,on
+ * the demux thread.ulPort is the index of the port in the group.
+ */
+typedef void (*AS_RTP_DEMUX_FUNC)(void* pCtx, uint32_t ulPort, const uint8_t* pData, uint32_t ulLen);
+
+/*
+ * the local RTP ports of the calls.the range is cut into slots of
+ * ulCallPorts ports,the free slots are kept in a bitmap with a summary word
+ * per 64 words,so alloc()/free() do not walk the range.the slots are taken
+ * round robin from the slot after the last one taken,so a port just freed is
+ * reused only after all the other free ones.
+ * in the shared mode the pool opens ulGroups groups of sockets at open()
+ * and every call sends on one of them,the packets coming back are handed to
+ * the call by the ssrc they carry(the ssrc of source of the first report
+ * block for RTCP SR/RR,the ssrc for RTP).
+ */
+class as_rtp_port_pool
+{
+public:
+    as_rtp_port_pool();
+    virtual ~as_rtp_port_pool();
+public:
+    /* pszLocalIp:""/0.0.0.0 to take the address of pszIfName(or the first interface up) */
+    void    set_conf(uint16_t usStart, uint16_t usEnd, const char* pszLocalIp,
+                     const char* pszIfName, bool bReusePort, uint32_t ulGroups,
+                     uint32_t ulCallPorts = AS_RTP_PORT_POOL_CALL_PORTS);
+    /* PortStart,PortEnd,LocalIP,Interface,ReusePort,SharedGroups of the section */
+    void    read_conf(as_ini_config& config, const char* pszSection);
+    int32_t open();
+    void    close();
+
+    int32_t alloc(AS_RTP_PORTS& ports);
+    void    free(const AS_RTP_PORTS& ports);
+
+    const char* local_ip(){return m_strLocalIp.c_str();};
+    bool     shared(){return 0 < m_ulGroups;};
+    bool     reuse_port(){return m_bReusePort;};
+    uint32_t capacity(){return m_ulSlots;};
+    uint32_t used(){return m_ulUsed;};
+
+    /*
+     * shared mode,the packets of ulSsrc go to pFunc(pCtx,...) until it is
+     * unbound.an ulSsrc bound already is replaced by a new random one,the
+     * caller sends with the ulSsrc it gets back.
+     */
+    int32_t bind_ssrc(uint32_t& ulSsrc, AS_RTP_DEMUX_FUNC pFunc, void* pCtx);
+    void    unbind_ssrc(uint32_t ulSsrc);
+    void    get_demux_stat(uint64_t& ullPackets, uint64_t& ullUnknown);
+
+    /* the IPv4 address of pszIfName,or of the first interface up but the loopback */
+    static int32_t detect_local_ip(const char* pszIfName, std::string& strIp);
+private:
+    int32_t take_slot(uint32_t& ulSlot);
+    int32_t take_bit(uint32_t ulWord, uint32_t ulBit, uint32_t& ulSlot);
+    void    give_slot(uint32_t ulSlot);
+    int32_t open_groups();
+    as_rtp_socket_t open_socket(uint16_t usPort);
+    static void *demux_invoke(void *arg);
+    void    demux_thread();
+    void    demux(uint32_t ulPort, const uint8_t* pData, uint32_t ulLen);
+private:
+    typedef struct tagAS_RTP_SSRC_BIND
+    {
+        AS_RTP_DEMUX_FUNC pFunc;
+        void             *pCtx;
+    } AS_RTP_SSRC_BIND;
+    typedef std::map<uint32_t,AS_RTP_SSRC_BIND> SSRCBINDMAP;
+
+    as_mutex_t      *m_mutex;
+    uint16_t         m_usStart;
+    uint16_t         m_usEnd;
+    uint32_t         m_ulCallPorts;
+    std::string      m_strLocalIp;
+    std::string      m_strIfName;
+    bool             m_bReusePort;
+    uint32_t         m_ulGroups;
+
+    /* the bitmap of the free slots */
+    uint32_t         m_ulSlots;
+    uint32_t         m_ulWords;
+    uint64_t        *m_pFree;
+    uint64_t        *m_pSummary;       /* a bit per word that has a free slot */
+    uint32_t         m_ulCursor;       /* the word the next search starts from */
+    uint32_t         m_ulUsed;
+
+    /* the shared mode */
+    uint32_t         m_aGroupSlot[AS_RTP_PORT_POOL_MAX_GROUPS];
+    uint32_t         m_aGroupCalls[AS_RTP_PORT_POOL_MAX_GROUPS];
+    as_rtp_socket_t  m_aSocks[AS_RTP_PORT_POOL_MAX_GROUPS][AS_RTP_PORT_POOL_CALL_PORTS];
+    SSRCBINDMAP      m_ssrcMap;
+    as_thread_t     *m_pDemuxThread;
+    volatile bool    m_bExit;
+    uint64_t         m_ullDemuxPackets;
+    uint64_t         m_ullDemuxUnknown;
+};
+#endif /* __AS_RTP_PORT_POOL_H__ */
@@ -34,6 +34,9 @@ ITimerLog *g_pTimerLog = NULL;
 #endif
 
 #define _TIMER_FL_ "as_timer.cpp", __LINE__
+
+//һಹϵʱ(ms)
+#define TIMER_MAX_CATCH_UP_MS   60000
 /*******************************************************************************
   Function:       TIMER_WRITE_LOG()
   Description:    ־ӡ
@@ -67,9 +70,54 @@ void TIMER_WRITE_LOG(long lLevel, const char *format, ...)
     va_end (args);
 
 };
+
+/*******************************************************************************
+  Function:       timerPushPending()/timerTakePending()
+  Description:    ύУ߳ѹ룬ʱ߳һȡȫ
+*******************************************************************************/
+static inline void timerPushPending(CTimerItem * volatile *ppHead, CTimerItem *pTimerItem)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    CTimerItem *pHead = NULL;
+    do
+    {
+        pHead = *ppHead;
+        pTimerItem->m_pNextPending = pHead;
+    } while (InterlockedCompareExchangePointer((PVOID volatile *)ppHead,
+                                               pTimerItem, pHead) != pHead);
+#else
+    CTimerItem *pHead = __atomic_load_n(ppHead, __ATOMIC_RELAXED);
+    do
+    {
+        pTimerItem->m_pNextPending = pHead;
+    } while (!__atomic_compare_exchange_n(ppHead, &pHead, pTimerItem, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#endif
+}
+
+static inline CTimerItem *timerTakePending(CTimerItem * volatile *ppHead)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    return (CTimerItem *)InterlockedExchangePointer((PVOID volatile *)ppHead, NULL);
+#else
+    return __atomic_exchange_n(ppHead, (CTimerItem *)NULL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void timerCountAdd(volatile ULONG *pulCount, long lDelta)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    (void)InterlockedExchangeAdd((volatile LONG *)pulCount, lDelta);
+#else
+    (void)__atomic_add_fetch(pulCount, (ULONG)lDelta, __ATOMIC_RELAXED);
+#endif
+}
+
 as_timer::as_timer()
 {
-    m_plistTrigger = NULL;
+    m_pWheel = NULL;
+    m_pPendingHead = NULL;
+    m_ulTimerCount = 0;
     m_ulTimerScale = DefaultTimerScale;
     m_ullRrsAbsTimeScales = 0;
     m_pMutexListOfTrigger = NULL;
@@ -90,19 +138,13 @@ as_timer::~as_timer()
 {
     try
     {
-        if(NULL != m_plistTrigger)
+        if(NULL != m_pWheel)
         {
-            ListOfTriggerIte itListOfTrigger = m_plistTrigger->begin();
             TIMER_WRITE_LOG(TIMER_DEBUG, "FILE(%s)LINE(%d): as_timer::~as_timer: thread = %u",
                 _TIMER_FL_, as_thread_self());
-            while(itListOfTrigger != m_plistTrigger->end())
-            {
-                AS_DELETE((*itListOfTrigger).second);
-                ++itListOfTrigger;
-            };
-            m_plistTrigger->clear();
-            AS_DELETE(m_plistTrigger);
-            m_plistTrigger = NULL;
+            clearTimer();
+            AS_DELETE(m_pWheel, MULTI);
+            m_pWheel = NULL;
         }
 
         if(m_pASThread != NULL)
@@ -155,11 +197,11 @@ long as_timer::init(ULONG ulTimerScale)
 
     m_ullRrsAbsTimeScales = as_get_ticks() / m_ulTimerScale;
 
-    (void)AS_NEW( m_plistTrigger );
-    if( NULL == m_plistTrigger )
+    (void)AS_NEW(m_pWheel, TimerWheelSlots);
+    if( NULL == m_pWheel )
     {
         TIMER_WRITE_LOG(TIMER_ERROR,
-            "FILE(%s)LINE(%d): m_plistTrigger is NULL.",
+            "FILE(%s)LINE(%d): m_pWheel is NULL.",
             _TIMER_FL_);
         return AS_FAIL;
     }
@@ -237,7 +279,8 @@ void as_timer::exit()
 
 /*******************************************************************************
   Function:       as_timer::registerTimer()
-  Description:    עᶨʱ
+  Description:    עᶨʱʱѹύУ
+                  ʱ߳һ̶ȰŽʱ
   Calls:
   Called By:
   Input:          pTrigger: ʱʵ, void *pArg: ʱ,
@@ -286,55 +329,16 @@ long as_timer::registerTimer(ITrigger *pTrigger, void *pArg, ULONG nScales,
         return AS_FAIL;
     }
 
-    pTrigger->m_pTimerItem = pTimerItem;
-
+    //pTrigger->m_pTimerItemdrainPendingãﲻд
+    //onTickcancelTimerڵ޸ľ
     pTimerItem->m_pTrigger = pTrigger;
     pTimerItem->m_pArg = pArg;
     pTimerItem->m_ulInitialScales = nScales;
     pTimerItem->m_ullCurScales = m_ullRrsAbsTimeScales + nScales;
     pTimerItem->m_enStyle = enStyle;
 
-    //(mainloopͬһ̲߳Ҫ)
-    AS_BOOLEAN bNeedLock = AS_FALSE;
-    AS_BOOLEAN bLocked = AS_FALSE;
-    if (NULL == m_pASThread)
-    {
-        bNeedLock = AS_TRUE;
-    }
-    else
-    {
-        if(as_thread_self() != m_pASThread->pthead)
-        {
-            bNeedLock = AS_TRUE;
-        }
-    }
-
-    if(AS_TRUE == bNeedLock)
-    {
-        if (AS_ERROR_CODE_OK != as_mutex_lock(m_pMutexListOfTrigger))
-        {
-            TIMER_WRITE_LOG(TIMER_ERROR,
-                "FILE(%s)LINE(%d):as_timer::registerTimer: get lock failed",
-                _TIMER_FL_);
-        }
-        else
-        {
-            bLocked = AS_TRUE;
-        }
-    }
-
-    (void)(m_plistTrigger->insert(ListOfTriggerPair(pTimerItem->m_ullCurScales, pTimerItem)));
-
-    //
-    if(AS_TRUE == bLocked)
-    {
-        if (AS_ERROR_CODE_OK != as_mutex_unlock(m_pMutexListOfTrigger))
-        {
-            TIMER_WRITE_LOG(TIMER_ERROR,
-                "FILE(%s)LINE(%d): as_timer::registerTimer: release lock failed",
-                _TIMER_FL_);
-        }
-    }
+    timerCountAdd(&m_ulTimerCount, 1);
+    timerPushPending(&m_pPendingHead, pTimerItem);
 
     return AS_SUCCESS;
 };
@@ -350,26 +354,40 @@ long as_timer::registerTimer(ITrigger *pTrigger, void *pArg, ULONG nScales,
 *******************************************************************************/
 void as_timer::clearTimer( )
 {
-    CTimerItem *pTimerItem = NULL;
+    if(NULL == m_pWheel)
+    {
+        return;
+    }
 
     if(AS_ERROR_CODE_OK != as_mutex_lock(m_pMutexListOfTrigger))
     {
         return;
     };
-    ListOfTriggerIte itListOfTrigger = m_plistTrigger->begin();
-    ListOfTriggerIte itCurrentTrigger = m_plistTrigger->begin();
-    while(itListOfTrigger != m_plistTrigger->end())
+
+    drainPending();
+
+    CTimerItem *pTimerItem = NULL;
+    for(ULONG i = 0; i < TimerWheelSlots; i++)
     {
-        pTimerItem = (*itListOfTrigger).second;
-        itCurrentTrigger = itListOfTrigger;
-        ++itListOfTrigger;
-        (void)(m_plistTrigger->erase(itCurrentTrigger));
+        CTimerLink *pSlot = &m_pWheel[i];
+        while(pSlot->m_pNext != pSlot)
+        {
+            pTimerItem = static_cast<CTimerItem *>(pSlot->m_pNext);
+            unlinkItem(pTimerItem);
 
-        TIMER_WRITE_LOG(TIMER_DEBUG,
-            "FILE(%s)LINE(%d): clearTimer erase pTimerItem(0x%x) .\n",
-                        _TIMER_FL_, pTimerItem);
+            //עtriggerָͷŵĶʱ
+            if((NULL != pTimerItem->m_pTrigger)
+                && (pTimerItem == pTimerItem->m_pTrigger->m_pTimerItem))
+            {
+                pTimerItem->m_pTrigger->m_pTimerItem = NULL;
+            }
 
-        continue;
+            TIMER_WRITE_LOG(TIMER_DEBUG,
+                "FILE(%s)LINE(%d): clearTimer erase pTimerItem(0x%x) .\n",
+                            _TIMER_FL_, pTimerItem);
+            AS_DELETE(pTimerItem);
+            timerCountAdd(&m_ulTimerCount, -1);
+        }
     }
     (void)as_mutex_unlock(m_pMutexListOfTrigger);
 
@@ -377,7 +395,7 @@ void as_timer::clearTimer( )
 
 /*******************************************************************************
   Function:       as_timer::cancelTimer()
-  Description:    עʱ
+  Description:    עʱͨtriggerĶʱֱӴӲժ
   Calls:
   Called By:
   Input:          pTrigger: ʱʵ
@@ -396,57 +414,47 @@ long as_timer::cancelTimer(ITrigger *pTrigger)
         return AS_FAIL;
     };
 
-    //(mainloopͬһ̲߳Ҫ)
-    AS_BOOLEAN bNeedLock = AS_FALSE;
-    AS_BOOLEAN bLocked = AS_FALSE;
-    if (NULL == m_pASThread)
+    //ǵݹģonTriggerעҲԣʱ̴߳ʱи
+    //Էغ󲻻иtriggeronTrigger
+    if (AS_ERROR_CODE_OK != as_mutex_lock(m_pMutexListOfTrigger))
     {
-        bNeedLock = AS_TRUE;
-    }
-    else
-    {
-        if(as_thread_self() != m_pASThread->pthead)
-        {
-            bNeedLock = AS_TRUE;
-        }
+        TIMER_WRITE_LOG(TIMER_ERROR,
+            "FILE(%s)LINE(%d): as_timer::cancelTimer: get lock failed",
+            _TIMER_FL_);
+        return AS_FAIL;
     }
 
-    if(AS_TRUE == bNeedLock)
-    {
-        if (AS_ERROR_CODE_OK != as_mutex_lock(m_pMutexListOfTrigger))
-        {
-            TIMER_WRITE_LOG(TIMER_ERROR,
-                "FILE(%s)LINE(%d): as_timer::cancelTimer: get lock failed",
-                _TIMER_FL_);
-        }
-        else
-        {
-            bLocked = AS_TRUE;
-        }
-    }
+    //עĶʱύУȷŽʱ֣ͨm_pTimerItemҵ
+    drainPending();
 
-    if(pTrigger->m_pTimerItem != NULL)
+    CTimerItem *pTimerItem = pTrigger->m_pTimerItem;
+    if(NULL != pTimerItem)
     {
-        pTrigger->m_pTimerItem->m_bRemoved = AS_TRUE;
-        pTrigger->m_pTimerItem->m_pTrigger = NULL;
+        pTimerItem->m_bRemoved = AS_TRUE;
+        pTimerItem->m_pTrigger = NULL;
         pTrigger->m_pTimerItem = NULL;
+
+        //ڲеֱժͷţύеdrainPendingͷţ
+        //ڴonTickonTriggerغͷ
+        if(enTimerLinked == pTimerItem->m_enState)
+        {
+            unlinkItem(pTimerItem);
+            AS_DELETE(pTimerItem);
+            timerCountAdd(&m_ulTimerCount, -1);
+        }
     }
 
     TIMER_WRITE_LOG(TIMER_DEBUG,
                 "FILE(%s)LINE(%d): cancelTimer set m_bRemoved=AS_TRUE"
                 "  pTimerItem(0x%x) pTrigger(0x%x) .\n",
-                _TIMER_FL_, pTrigger->m_pTimerItem, pTrigger);
+                _TIMER_FL_, pTimerItem, pTrigger);
 
-
-    //(ͬһ߳)
-    if(AS_TRUE == bLocked)
+    //
+    if (AS_ERROR_CODE_OK != as_mutex_unlock(m_pMutexListOfTrigger))
     {
-        if (AS_ERROR_CODE_OK != as_mutex_unlock(m_pMutexListOfTrigger))
-        {
-            TIMER_WRITE_LOG(TIMER_ERROR,
-                "FILE(%s)LINE(%d): as_timer::cancelTimer: release lock failed",
-                _TIMER_FL_);
-        }
+        TIMER_WRITE_LOG(TIMER_ERROR,
+            "FILE(%s)LINE(%d): as_timer::cancelTimer: release lock failed",
+            _TIMER_FL_);
     }
 
     return AS_SUCCESS;
@@ -454,7 +462,8 @@ long as_timer::cancelTimer(ITrigger *pTrigger)
 
 /*******************************************************************************
   Function:       as_timer::mainLoop()
-  Description:    ִ߳еĶʱѭ
+  Description:    ִ߳еĶʱѭʵŵʱƽ̶ȣ
+                  ˯߱ƳʱߵĿ̶
   Calls:
   Called By:
   Input:          
@@ -463,93 +472,196 @@ long as_timer::cancelTimer(ITrigger *pTrigger)
 *******************************************************************************/
 void as_timer::mainLoop()
 {
-    ULONGLONG ullCurrentScales = 0;
+    uint32_t ulLastMs = as_get_cur_msecond();
+    ULONG ulElapsed = 0;
     while(AS_FALSE == m_bExit)
     {
 
 #ifdef WIN32
-        Sleep(m_ulTimerScale);
+        Sleep(m_ulTimerScale - ulElapsed);
 #else
         struct timeval tv;
-        tv.tv_sec = (long)(m_ulTimerScale/TIMER_SECOND_IN_MS);
-        tv.tv_usec = (m_ulTimerScale%TIMER_SECOND_IN_MS)*TIMER_MS_IN_US;
+        tv.tv_sec = (long)((m_ulTimerScale - ulElapsed)/TIMER_SECOND_IN_MS);
+        tv.tv_usec = ((m_ulTimerScale - ulElapsed)%TIMER_SECOND_IN_MS)*TIMER_MS_IN_US;
         (void)select(0, AS_NULL, AS_NULL, AS_NULL, &tv);
 #endif
 
-        //
-        CTimerItem *pTimerItem = NULL;
-        ITrigger *pTrigger = NULL;
-        ++m_ullRrsAbsTimeScales ;//ڲʱ׼һ̶
-        ullCurrentScales = m_ullRrsAbsTimeScales;
-
-        if (AS_ERROR_CODE_OK != as_mutex_lock(m_pMutexListOfTrigger))
+        //32λֵڻʱҲȷϵͳʱ䱻صʱֻһ̶
+        uint32_t ulNowMs = as_get_cur_msecond();
+        uint32_t ulDelta = ulNowMs - ulLastMs;
+        ulLastMs = ulNowMs;
+        if(ulDelta > TIMER_MAX_CATCH_UP_MS)
         {
-            break;
-        };
-        ListOfTriggerIte itListOfTrigger = m_plistTrigger->begin();
-        ListOfTriggerIte itCurrentTrigger = m_plistTrigger->begin();
-        while(itListOfTrigger != m_plistTrigger->end())
+            ulDelta = m_ulTimerScale;
+        }
+        ulElapsed += ulDelta;
+
+        while((ulElapsed >= m_ulTimerScale) && (AS_FALSE == m_bExit))
         {
-            pTimerItem = (*itListOfTrigger).second;
-            if(NULL == pTimerItem)
-            {
-                TIMER_WRITE_LOG(TIMER_ERROR,
-                    "FILE(%s)LINE(%d): pTimerItem is NULL.", _TIMER_FL_);
-                itCurrentTrigger = itListOfTrigger;
-                ++itListOfTrigger;
-                (void)(m_plistTrigger->erase(itCurrentTrigger));
-                continue;
-            }
+            ulElapsed -= m_ulTimerScale;
+            onTick();
+        }
+    }
 
-            pTrigger = (ITrigger *)pTimerItem->m_pTrigger;
+    return;
+}
 
-            //ʱעɾʱһ
-            if((NULL == pTrigger) || (AS_TRUE == pTimerItem->m_bRemoved))
-            {
-                TIMER_WRITE_LOG(TIMER_DEBUG,
-                    "FILE(%s)LINE(%d): Timer(0x%x) removed.", _TIMER_FL_, pTimerItem);
-                itCurrentTrigger = itListOfTrigger;
-                ++itListOfTrigger;
-                (void)(m_plistTrigger->erase(itCurrentTrigger));
-                AS_DELETE(pTimerItem);
-                continue;
-            };
-
-            if(ullCurrentScales < pTimerItem->m_ullCurScales)
-            {
-                break;
-            }
+/*******************************************************************************
+  Function:       as_timer::onTick()
+  Description:    ƽһ̶ȣȡύУժǰеڵĶʱ
+                  ʱԺִεģ
+  Calls:
+  Called By:
+  Input:          
+  Output:         
+  Return:         
+*******************************************************************************/
+void as_timer::onTick()
+{
+    if (AS_ERROR_CODE_OK != as_mutex_lock(m_pMutexListOfTrigger))
+    {
+        return;
+    };
+
+    ++m_ullRrsAbsTimeScales ;//ڲʱ׼һ̶
+    ULONGLONG ullCurrentScales = m_ullRrsAbsTimeScales;
 
-            itCurrentTrigger = itListOfTrigger;
-            ++itListOfTrigger;
-            (void)(m_plistTrigger->erase(itCurrentTrigger));
+    drainPending();
+
+    //ժonTriggerעע᲻Ӱ
+    CTimerLink expired;
+    CTimerLink *pSlot = &m_pWheel[ullCurrentScales & (TimerWheelSlots - 1)];
+    CTimerLink *pLink = pSlot->m_pNext;
+    while(pLink != pSlot)
+    {
+        CTimerItem *pTimerItem = static_cast<CTimerItem *>(pLink);
+        pLink = pLink->m_pNext;
+        if(ullCurrentScales < pTimerItem->m_ullCurScales)
+        {
+            continue;
+        }
+        unlinkItem(pTimerItem);
+        pTimerItem->m_pPrev = expired.m_pPrev;
+        pTimerItem->m_pNext = &expired;
+        expired.m_pPrev->m_pNext = pTimerItem;
+        expired.m_pPrev = pTimerItem;
+    }
+
+    while(expired.m_pNext != &expired)
+    {
+        CTimerItem *pTimerItem = static_cast<CTimerItem *>(expired.m_pNext);
+        unlinkItem(pTimerItem);
+
+        ITrigger *pTrigger = pTimerItem->m_pTrigger;
+        if((NULL == pTrigger) || (AS_TRUE == pTimerItem->m_bRemoved))
+        {
+            TIMER_WRITE_LOG(TIMER_DEBUG,
+                "FILE(%s)LINE(%d): Timer(0x%x) removed.", _TIMER_FL_, pTimerItem);
+            AS_DELETE(pTimerItem);
+            timerCountAdd(&m_ulTimerCount, -1);
+            continue;
+        }
 
-            //triggeronTrigger
-            pTrigger->onTrigger(pTimerItem->m_pArg,
-                ullCurrentScales, pTimerItem->m_enStyle);
+        //triggeronTrigger
+        pTimerItem->m_enState = enTimerFiring;
+        pTrigger->onTrigger(pTimerItem->m_pArg,
+            ullCurrentScales, pTimerItem->m_enStyle);
 
-            //ֻһΣɾʱ
-            if(enOneShot == pTimerItem->m_enStyle)
+        //onTriggerעˣֻһΣɾʱ
+        if((AS_TRUE == pTimerItem->m_bRemoved)
+            || (enOneShot == pTimerItem->m_enStyle))
+        {
+            //onTriggerпעµĶʱָֻ򱾶ʱ
+            if((AS_TRUE != pTimerItem->m_bRemoved)
+                && (pTimerItem == pTrigger->m_pTimerItem))
             {
-                TIMER_WRITE_LOG(TIMER_DEBUG,
-                    "FILE(%s)LINE(%d): Timer(0x%x) remove trigger once timer.",
-                    _TIMER_FL_, pTimerItem);
-                //ֹpTrigger->onTriggerɾʱ
                 pTrigger->m_pTimerItem = NULL;
-                AS_DELETE(pTimerItem);
-                continue;
             }
+            AS_DELETE(pTimerItem);
+            timerCountAdd(&m_ulTimerCount, -1);
+            continue;
+        }
 
-            //ظʱҪ޸´γʱ¼¼multimap
-            pTimerItem->m_ullCurScales = ullCurrentScales
-                + pTimerItem->m_ulInitialScales;
-            (void)(m_plistTrigger->insert(ListOfTriggerPair(pTimerItem->m_ullCurScales,
-                pTimerItem)));
-        };
-        (void)as_mutex_unlock(m_pMutexListOfTrigger);
+        //ظʱҪ޸´γʱ¼·Žʱ
+        pTimerItem->m_ullCurScales = ullCurrentScales
+            + pTimerItem->m_ulInitialScales;
+        linkItem(pTimerItem);
     }
 
-    return;
+    (void)as_mutex_unlock(m_pMutexListOfTrigger);
 }
 
+/*******************************************************************************
+  Function:       as_timer::drainPending()
+  Description:    ȡύУע˳Žʱ֣עֱͷţ
+                  triggerm_pTimerItem߳m_pMutexListOfTrigger
+  Calls:
+  Called By:
+  Input:          
+  Output:         
+  Return:         
+*******************************************************************************/
+void as_timer::drainPending()
+{
+    CTimerItem *pList = timerTakePending(&m_pPendingHead);
 
+    //Ǻȳģתע˳
+    CTimerItem *pOrdered = NULL;
+    while(NULL != pList)
+    {
+        CTimerItem *pNext = pList->m_pNextPending;
+        pList->m_pNextPending = pOrdered;
+        pOrdered = pList;
+        pList = pNext;
+    }
+
+    while(NULL != pOrdered)
+    {
+        CTimerItem *pTimerItem = pOrdered;
+        pOrdered = pOrdered->m_pNextPending;
+        pTimerItem->m_pNextPending = NULL;
+
+        if(AS_TRUE == pTimerItem->m_bRemoved)
+        {
+            AS_DELETE(pTimerItem);
+            timerCountAdd(&m_ulTimerCount, -1);
+            continue;
+        }
+        //ͬһtriggerעʱעΪ׼
+        pTimerItem->m_pTrigger->m_pTimerItem = pTimerItem;
+        linkItem(pTimerItem);
+    }
+}
+
+/*******************************************************************************
+  Function:       as_timer::linkItem()
+  Description:    ʱ̶ɢнʱֵĲۣѹڵķŽǰ̶ȵĲ
+  Calls:
+  Called By:
+  Input:          pTimerItem: ʱ
+  Output:         
+  Return:         
+*******************************************************************************/
+void as_timer::linkItem(CTimerItem *pTimerItem)
+{
+    ULONGLONG ullScales = pTimerItem->m_ullCurScales;
+    if(ullScales < m_ullRrsAbsTimeScales)
+    {
+        ullScales = m_ullRrsAbsTimeScales;
+    }
+
+    CTimerLink *pSlot = &m_pWheel[ullScales & (TimerWheelSlots - 1)];
+    pTimerItem->m_pPrev = pSlot->m_pPrev;
+    pTimerItem->m_pNext = pSlot;
+    pSlot->m_pPrev->m_pNext = pTimerItem;
+    pSlot->m_pPrev = pTimerItem;
+    pTimerItem->m_enState = enTimerLinked;
+}
+
+void as_timer::unlinkItem(CTimerItem *pTimerItem)
+{
+    pTimerItem->m_pPrev->m_pNext = pTimerItem->m_pNext;
+    pTimerItem->m_pNext->m_pPrev = pTimerItem->m_pPrev;
+    pTimerItem->m_pPrev = pTimerItem;
+    pTimerItem->m_pNext = pTimerItem;
+}
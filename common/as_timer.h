@@ -33,21 +33,12 @@ extern "C"{
 const ULONG DefaultTimerScale = 100; //ȱʡʱΪ100ms
 const ULONG MinTimerScale = 1; //ʱСΪ1ms
 
+//ʱֵĲ2ݣʱ̶Ȱȡģɢе
+const ULONG TimerWheelSlots = 16384;
+
 class ITrigger;
 class CTimerItem;
 
-class CCmpTimeOut
-{
-  public:
-    bool operator()(const ULONGLONG ullTimerOut1, const ULONGLONG ullTimerOut2) const
-    {
-        return (ullTimerOut1 < ullTimerOut2);
-    };
-};
-typedef std::multimap<ULONGLONG, CTimerItem *, CCmpTimeOut> ListOfTrigger;
-typedef std::pair<ULONGLONG const, CTimerItem *> ListOfTriggerPair;
-typedef ListOfTrigger::iterator ListOfTriggerIte;
-
 typedef enum tagTriggerStyle
 {
     enOneShot = 0,
@@ -70,7 +61,30 @@ class ITrigger
     CTimerItem *m_pTimerItem;
 };
 
-class CTimerItem
+//ʱֲе˫ѭڵ㣬۱ڱڵ
+class CTimerLink
+{
+  public:
+    CTimerLink()
+    {
+        m_pPrev = this;
+        m_pNext = this;
+    };
+
+  public:
+    CTimerLink *m_pPrev;
+    CTimerLink *m_pNext;
+};
+
+//ʱ״̬
+typedef enum tagTimerItemState
+{
+    enTimerPending = 0,  //ύУδŽʱ
+    enTimerLinked  = 1,  //ʱֵĲ(򱾿̶ȴ)
+    enTimerFiring  = 2   //ڵonTrigger
+} TimerItemState;
+
+class CTimerItem : public CTimerLink
 {
   public:
     CTimerItem()
@@ -78,6 +92,8 @@ class CTimerItem
         m_pTrigger = NULL;
         m_pArg = NULL;
         m_bRemoved = AS_FALSE;
+        m_enState = enTimerPending;
+        m_pNextPending = NULL;
     };
 
   public:
@@ -87,6 +103,8 @@ class CTimerItem
     ULONGLONG m_ullCurScales;
     TriggerStyle m_enStyle;
     AS_BOOLEAN m_bRemoved;
+    TimerItemState m_enState;
+    CTimerItem *m_pNextPending;  //ύеһ
 };
 
 // 4־
@@ -135,11 +153,19 @@ public:
     void exit();
 
 public:
+     //ע᲻ʱѹύУɶʱ߳һ̶ȷŽʱ
      virtual long registerTimer(ITrigger *pRrsTrigger, void *pArg, ULONG nScales,
         TriggerStyle enStyle);
+     //ȡύУͨpRrsTrigger->m_pTimerItemֱӴӲժO(1)غ󲻻ٴ
      virtual long cancelTimer(ITrigger *pRrsTrigger);
 
     void clearTimer( );
+
+    //ǰĶʱ(ύе)
+    ULONG getTimerCount() const
+    {
+        return m_ulTimerCount;
+    };
 protected:
     as_timer();
 private:
@@ -152,11 +178,20 @@ private:
     };
 
     void mainLoop();
+    //һ̶ȣȡύУǰеڵĶʱ
+    void onTick();
+    //ύеĶʱŽʱ
+    void drainPending();
+    void linkItem(CTimerItem *pTimerItem);
+    static void unlinkItem(CTimerItem *pTimerItem);
 
 private:
     ULONG m_ulTimerScale;
-    ULONGLONG m_ullRrsAbsTimeScales;
-    ListOfTrigger *m_plistTrigger;
+    volatile ULONGLONG m_ullRrsAbsTimeScales;
+    CTimerLink *m_pWheel;                  //TimerWheelSlots
+    CTimerItem * volatile m_pPendingHead;  //ύ(ȳȡʱת)
+    volatile ULONG m_ulTimerCount;
+    //ʱֻ֣ڶʱ̴̶߳Ⱥעʱʱʹ
     as_mutex_t *m_pMutexListOfTrigger;
     as_thread_t *m_pASThread;
     volatile AS_BOOLEAN m_bExit;
@@ -0,0 +1,445 @@
+/*
+ * micro benchmark of as_conn_manage:
+ *  accept: a burst of loopback connections spread over the reactors,
+ *          the accept rate and the connections per reactor.
+ *  emfile: the connections pending while the fds run out must be rejected
+ *          rather than left in the backlog of the edge triggered listener.
+ *  async:  a slow reader behind a small send queue,the sends that went
+ *          to the queue partly,the sends refused by a full queue and the
+ *          throughput,the reader checks the byte stream.
+ *  sync:   the same with blocking sends,which must not use the queue.
+ *  close:  close right after a burst,the queued bytes must reach the peer.
+ * usage: bench_conn_manage [reactors] [connections] [MB per run]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include "as_conn_manage.h"
+
+#define BENCH_MAX_CONNS         4096
+#define BENCH_EMFILE_CONNS      64
+#define BENCH_CHUNK_SIZE        (64 * 1024)
+#define BENCH_READ_SIZE         (16 * 1024)
+#define BENCH_RCVBUF_SIZE       (64 * 1024)
+/* the send queue of the async run,small enough to fill up */
+#define BENCH_ASYNC_QUEUE_SIZE  (256 * 1024)
+#define BENCH_CLOSE_BURST       (4 * 1024 * 1024)
+#define BENCH_WAIT_MS           5000
+
+class CBenchConn : public CTcpConnHandle
+{
+public:
+    CBenchConn(){m_bWritable = false;};
+    virtual void handle_recv(void)
+    {
+        char buf[BENCH_READ_SIZE];
+        CNetworkAddr addr;
+        while (0 < recv(buf, &addr, sizeof(buf), enAsyncOp))
+        {
+        }
+        setHandleRecv(AS_TRUE);
+    };
+    virtual void handle_send(void)
+    {
+        m_bWritable = true;
+    };
+public:
+    volatile bool m_bWritable;
+};
+
+static CBenchConn* g_pConns[BENCH_MAX_CONNS];
+static volatile uint32_t g_ulAccepted = 0;
+
+class CBenchServer : public CTcpServerHandle
+{
+public:
+    virtual long handle_accept(const CNetworkAddr *pRemoteAddr,
+                               CTcpConnHandle *&pTcpConnHandle)
+    {
+        if (BENCH_MAX_CONNS <= g_ulAccepted)
+        {
+            return AS_ERROR_CODE_FAIL;
+        }
+        CBenchConn* pConn = new CBenchConn();
+        g_pConns[g_ulAccepted] = pConn;
+        __atomic_add_fetch(&g_ulAccepted, 1, __ATOMIC_SEQ_CST);
+        pTcpConnHandle = pConn;
+        return AS_ERROR_CODE_OK;
+    };
+};
+
+typedef struct tagBENCH_READER
+{
+    int             fd;
+    uint64_t        ullBytes;
+    uint64_t        ullBadBytes;
+    bool            bEof;
+}BENCH_READER;
+
+static uint64_t bench_now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static bool bench_wait(volatile uint32_t* pulCount, uint32_t ulTarget)
+{
+    uint64_t ullEnd = bench_now_us() + BENCH_WAIT_MS * 1000ULL;
+    while (__atomic_load_n(pulCount, __ATOMIC_SEQ_CST) < ulTarget)
+    {
+        if (bench_now_us() > ullEnd)
+        {
+            return false;
+        }
+        usleep(100);
+    }
+    return true;
+}
+
+static int bench_connect(unsigned short usPort, int nRcvBuf)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (0 > fd)
+    {
+        return -1;
+    }
+    if (0 < nRcvBuf)
+    {
+        (void)setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &nRcvBuf, sizeof(nRcvBuf));
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = usPort;
+    if (0 != connect(fd, (struct sockaddr*)&addr, sizeof(addr)))
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* the byte at stream offset n is n % 251,so a lost or repeated block shows */
+static void bench_fill(char* pBuf, uint32_t ulLen, uint64_t ullOffset)
+{
+    for (uint32_t i = 0; i < ulLen; i++)
+    {
+        pBuf[i] = (char)((ullOffset + i) % 251);
+    }
+}
+
+/* read slowly(a pause per read) up to the eof and check the stream */
+static void* bench_read(void* arg)
+{
+    BENCH_READER* pReader = (BENCH_READER*)arg;
+    char buf[BENCH_READ_SIZE];
+    for (;;)
+    {
+        ssize_t n = read(pReader->fd, buf, sizeof(buf));
+        if (0 >= n)
+        {
+            pReader->bEof = (0 == n);
+            break;
+        }
+        for (ssize_t i = 0; i < n; i++)
+        {
+            if ((char)((pReader->ullBytes + i) % 251) != buf[i])
+            {
+                pReader->ullBadBytes++;
+            }
+        }
+        pReader->ullBytes += (uint64_t)n;
+        usleep(1000);
+    }
+    return NULL;
+}
+
+static void bench_remove(uint32_t ulFirst, uint32_t ulCount)
+{
+    for (uint32_t i = ulFirst; i < ulFirst + ulCount; i++)
+    {
+        CConnMgr::Instance().removeTcpClient(g_pConns[i]);
+        delete g_pConns[i];
+        g_pConns[i] = NULL;
+    }
+}
+
+static void bench_accept(unsigned short usPort, uint32_t ulConns, uint32_t ulReactors)
+{
+    int fds[BENCH_MAX_CONNS];
+    uint32_t ulFirst = g_ulAccepted;
+    uint64_t ullBegin = bench_now_us();
+    for (uint32_t i = 0; i < ulConns; i++)
+    {
+        fds[i] = bench_connect(usPort, 0);
+    }
+    bool bAll = bench_wait(&g_ulAccepted, ulFirst + ulConns);
+    uint64_t ullWall = bench_now_us() - ullBegin;
+    usleep(10000);
+
+    /* the reactor of each connection,in the order they first show up */
+    CHandleManager* pMgrs[MAX_CONN_REACTOR_NUM];
+    uint32_t ulPerMgr[MAX_CONN_REACTOR_NUM];
+    uint32_t ulMgrs = 0;
+    memset(ulPerMgr, 0, sizeof(ulPerMgr));
+    for (uint32_t i = ulFirst; i < g_ulAccepted; i++)
+    {
+        uint32_t j = 0;
+        while ((j < ulMgrs) && (pMgrs[j] != g_pConns[i]->m_pHandleMgr))
+        {
+            j++;
+        }
+        if ((j == ulMgrs) && (ulMgrs < MAX_CONN_REACTOR_NUM))
+        {
+            pMgrs[ulMgrs++] = g_pConns[i]->m_pHandleMgr;
+        }
+        ulPerMgr[j]++;
+    }
+    uint32_t ulMin = (0 < ulMgrs) ? ulPerMgr[0] : 0;
+    uint32_t ulMax = 0;
+    for (uint32_t j = 0; j < ulMgrs; j++)
+    {
+        ulMin = (ulPerMgr[j] < ulMin) ? ulPerMgr[j] : ulMin;
+        ulMax = (ulPerMgr[j] > ulMax) ? ulPerMgr[j] : ulMax;
+    }
+    printf("%-8s conns:%5u accepted:%5u conns/s:%10.0f reactors:%2u/%2u per reactor:%u-%u%s\n",
+           "accept", ulConns, g_ulAccepted - ulFirst,
+           (double)(g_ulAccepted - ulFirst) * 1e6 / (double)(0 == ullWall ? 1 : ullWall),
+           ulMgrs, ulReactors, ulMin, ulMax, bAll ? "" : " (timeout)");
+
+    bench_remove(ulFirst, g_ulAccepted - ulFirst);
+    for (uint32_t i = 0; i < ulConns; i++)
+    {
+        if (0 <= fds[i])
+        {
+            close(fds[i]);
+        }
+    }
+}
+
+static void bench_emfile(CBenchServer* pServer, unsigned short usPort)
+{
+    int fds[BENCH_EMFILE_CONNS];
+    uint32_t ulFirst = g_ulAccepted;
+
+    /* queue the connections in the backlog while accept is held */
+    pServer->setHandleRecv(AS_FALSE);
+    for (uint32_t i = 0; i < BENCH_EMFILE_CONNS; i++)
+    {
+        fds[i] = bench_connect(usPort, 0);
+    }
+
+    /* leave room for half of them */
+    struct rlimit stOld;
+    getrlimit(RLIMIT_NOFILE, &stOld);
+    uint32_t ulFree = 0;
+    int fd = 0;
+    for (; ulFree < BENCH_EMFILE_CONNS / 2; fd++)
+    {
+        if ((-1 == fcntl(fd, F_GETFD)) && (EBADF == errno))
+        {
+            ulFree++;
+        }
+    }
+    struct rlimit stLimit = stOld;
+    stLimit.rlim_cur = (rlim_t)fd;
+    setrlimit(RLIMIT_NOFILE, &stLimit);
+    pServer->setHandleRecv(AS_TRUE);
+
+    /* each connection ends accepted or closed by the server */
+    uint32_t ulRejected = 0;
+    uint64_t ullEnd = bench_now_us() + 2000000ULL;
+    bool bRejected[BENCH_EMFILE_CONNS];
+    memset(bRejected, 0, sizeof(bRejected));
+    while (bench_now_us() < ullEnd)
+    {
+        for (uint32_t i = 0; i < BENCH_EMFILE_CONNS; i++)
+        {
+            char c;
+            if ((0 > fds[i]) || bRejected[i])
+            {
+                continue;
+            }
+            ssize_t n = recv(fds[i], &c, 1, MSG_PEEK | MSG_DONTWAIT);
+            if ((0 == n) || ((0 > n) && (EAGAIN != errno)))
+            {
+                bRejected[i] = true;
+                ulRejected++;
+            }
+        }
+        if (g_ulAccepted - ulFirst + ulRejected >= BENCH_EMFILE_CONNS)
+        {
+            break;
+        }
+        usleep(1000);
+    }
+    setrlimit(RLIMIT_NOFILE, &stOld);
+    uint32_t ulAccepted = g_ulAccepted - ulFirst;
+    printf("%-8s conns:%5u accepted:%5u rejected:%5u pending:%5u\n", "emfile",
+           BENCH_EMFILE_CONNS, ulAccepted, ulRejected,
+           BENCH_EMFILE_CONNS - ulAccepted - ulRejected);
+
+    bench_remove(ulFirst, ulAccepted);
+    for (uint32_t i = 0; i < BENCH_EMFILE_CONNS; i++)
+    {
+        if (0 <= fds[i])
+        {
+            close(fds[i]);
+        }
+    }
+}
+
+/* one connection with a slow reader,ulBytes sent in chunks,then closed */
+static void bench_stream(const char* pszRun, unsigned short usPort,
+                         EnumSyncAsync enSync, uint64_t ullBytes, uint32_t ulChunk,
+                         ULONG ulQueueSize)
+{
+    BENCH_READER reader;
+    memset(&reader, 0, sizeof(reader));
+    uint32_t ulIndex = g_ulAccepted;
+    reader.fd = bench_connect(usPort, BENCH_RCVBUF_SIZE);
+    if ((0 > reader.fd) || !bench_wait(&g_ulAccepted, ulIndex + 1))
+    {
+        printf("%-8s connect fail\n", pszRun);
+        return;
+    }
+    CBenchConn* pConn = g_pConns[ulIndex];
+    pConn->setMaxSendQueueSize(ulQueueSize);
+    pthread_t thread;
+    pthread_create(&thread, NULL, bench_read, &reader);
+
+    char* pBuf = new char[ulChunk];
+    uint64_t ullSent = 0;
+    uint32_t ulPartial = 0;
+    uint32_t ulFull = 0;
+    uint32_t ulErrors = 0;
+    uint64_t ullBegin = bench_now_us();
+    while (ullSent < ullBytes)
+    {
+        uint32_t ulLen = (ullBytes - ullSent < ulChunk) ? (uint32_t)(ullBytes - ullSent) : ulChunk;
+        bench_fill(pBuf, ulLen, ullSent);
+        pConn->m_bWritable = false;
+        long lSent = pConn->send(pBuf, ulLen, enSync);
+        if (0 > lSent)
+        {
+            ulErrors++;
+            if (SendRecvErrorTIMEO != lSent)
+            {
+                break;
+            }
+            continue;
+        }
+        ullSent += (uint64_t)lSent;
+        if ((uint32_t)lSent < ulLen)
+        {
+            /* refused by the queue:the rest goes again once handle_send says so */
+            ulFull++;
+            uint64_t ullEnd = bench_now_us() + BENCH_WAIT_MS * 1000ULL;
+            while (!pConn->m_bWritable && (bench_now_us() < ullEnd))
+            {
+                usleep(100);
+            }
+        }
+        else if (0 < pConn->getSendQueueSize())
+        {
+            ulPartial++;
+        }
+    }
+    uint64_t ullQueued = pConn->getSendQueueSize();
+
+    /* close drains what is still queued before the fd goes */
+    uint64_t ullClose = bench_now_us();
+    bench_remove(ulIndex, 1);
+    ullClose = bench_now_us() - ullClose;
+    pthread_join(thread, NULL);
+    uint64_t ullWall = bench_now_us() - ullBegin;
+    printf("%-8s sent:%9llu recv:%9llu bad:%llu eof:%d partial:%5u full:%5u errors:%u "
+           "queued at close:%7llu close ms:%5.1f MB/s:%7.1f\n",
+           pszRun, (unsigned long long)ullSent, (unsigned long long)reader.ullBytes,
+           (unsigned long long)reader.ullBadBytes, reader.bEof ? 1 : 0,
+           ulPartial, ulFull, ulErrors, (unsigned long long)ullQueued,
+           (double)ullClose / 1000.0,
+           (double)reader.ullBytes / (double)(0 == ullWall ? 1 : ullWall));
+    close(reader.fd);
+    delete[] pBuf;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t ulReactors = 4;
+    uint32_t ulConns    = 1000;
+    uint32_t ulMBytes   = 32;
+    if (1 < argc)
+    {
+        ulReactors = (uint32_t)atoi(argv[1]);
+    }
+    if (2 < argc)
+    {
+        ulConns = (uint32_t)atoi(argv[2]);
+    }
+    if (3 < argc)
+    {
+        ulMBytes = (uint32_t)atoi(argv[3]);
+    }
+    /* every run takes its connections from g_pConns,the accept run the most */
+    if ((0 == ulReactors) || (MAX_CONN_REACTOR_NUM < ulReactors) || (0 == ulConns)
+        || (BENCH_MAX_CONNS - BENCH_EMFILE_CONNS - 3 < ulConns))
+    {
+        printf("usage: bench_conn_manage [reactors] [connections] [MB per run]\n");
+        return 1;
+    }
+
+    struct rlimit stLimit;
+    getrlimit(RLIMIT_NOFILE, &stLimit);
+    if (stLimit.rlim_cur < 2 * ulConns + 64)
+    {
+        stLimit.rlim_cur = (stLimit.rlim_max < 2 * ulConns + 64) ? stLimit.rlim_max
+                                                                 : 2 * ulConns + 64;
+        setrlimit(RLIMIT_NOFILE, &stLimit);
+    }
+
+    CConnMgr& connMgr = CConnMgr::Instance();
+    if ((AS_ERROR_CODE_OK != connMgr.init(DEFAULT_SELECT_PERIOD, AS_FALSE, AS_TRUE,
+                                          AS_TRUE, ulReactors))
+        || (AS_ERROR_CODE_OK != connMgr.run()))
+    {
+        printf("start the connection manager fail\n");
+        return 1;
+    }
+
+    CBenchServer server;
+    CNetworkAddr addr;
+    addr.m_lIpAddr = (long)htonl(INADDR_LOOPBACK);
+    addr.m_usPort = 0;
+    if (AS_ERROR_CODE_OK != connMgr.regTcpServer(&addr, &server))
+    {
+        printf("listen fail\n");
+        return 1;
+    }
+    struct sockaddr_in stLocal;
+    socklen_t len = sizeof(stLocal);
+    getsockname((int)server.m_lSockFD, (struct sockaddr*)&stLocal, &len);
+    unsigned short usPort = stLocal.sin_port;
+
+    uint64_t ullBytes = (uint64_t)ulMBytes * 1024 * 1024;
+    bench_emfile(&server, usPort);
+    bench_accept(usPort, ulConns, ulReactors);
+    bench_stream("async", usPort, enAsyncOp, ullBytes, BENCH_CHUNK_SIZE,
+                 BENCH_ASYNC_QUEUE_SIZE);
+    bench_stream("sync", usPort, enSyncOp, ullBytes, BENCH_CHUNK_SIZE,
+                 DEFAULT_TCP_SEND_QUEUE_SIZE);
+    bench_stream("close", usPort, enAsyncOp, BENCH_CLOSE_BURST, BENCH_CLOSE_BURST,
+                 2 * BENCH_CLOSE_BURST);
+
+    connMgr.removeTcpServer(&server);
+    connMgr.exit();
+    return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * micro benchmark of as_ring_cache:one producer feeds one consumer with
+ * framed messages,report the throughput of the mutex mode(Write/Read),the
+ * SPSC mode through the same copying calls and the SPSC mode zero-copy
+ * (Reserve/Commit,PeekSpan/Consume).the consumer checks the sequence.
+ * usage: bench_ring_cache [MB per run]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "as_ring_cache.h"
+
+#define BENCH_CACHE_SIZE    (1024*1024)
+/* RTP over TCP sized messages,7 TS packets and the interleaved header */
+#define BENCH_MSG_SIZE      1320
+#define BENCH_HDR_SIZE      8
+
+enum BENCH_MODE
+{
+    BENCH_MODE_MUTEX = 0,
+    BENCH_MODE_SPSC_COPY,
+    BENCH_MODE_SPSC_ZERO_COPY
+};
+
+static uint64_t bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+typedef struct tagBENCH_CTX
+{
+    as_ring_cache*  pCache;
+    BENCH_MODE      enMode;
+    uint32_t        ulMsgs;
+}BENCH_CTX;
+
+/* a message is its length,its sequence and the payload */
+static void bench_fill(char* pMsg, uint32_t ulSeq)
+{
+    uint32_t ulLen = BENCH_MSG_SIZE;
+    memcpy(pMsg, &ulLen, sizeof(ulLen));
+    memcpy(pMsg + 4, &ulSeq, sizeof(ulSeq));
+    memset(pMsg + BENCH_HDR_SIZE, (int)(ulSeq & 0xFF), BENCH_MSG_SIZE - BENCH_HDR_SIZE);
+}
+
+static void* bench_producer(void* arg)
+{
+    BENCH_CTX* pCtx = (BENCH_CTX*)arg;
+    char szMsg[BENCH_MSG_SIZE];
+    for (uint32_t i = 0; i < pCtx->ulMsgs; i++)
+    {
+        if (BENCH_MODE_SPSC_ZERO_COPY == pCtx->enMode)
+        {
+            char* pSpace = NULL;
+            while (NULL == (pSpace = pCtx->pCache->Reserve(BENCH_MSG_SIZE)))
+            {
+                sched_yield();
+            }
+            bench_fill(pSpace, i);
+            pCtx->pCache->Commit(BENCH_MSG_SIZE);
+            continue;
+        }
+
+        bench_fill(szMsg, i);
+        while (0 == pCtx->pCache->Write(szMsg, BENCH_MSG_SIZE))
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/* check the messages of pData,it returns the bytes of the whole ones */
+static unsigned long bench_check(const char* pData, unsigned long ulLen,
+                                 uint32_t& ulNextSeq, uint64_t& ullErrors)
+{
+    unsigned long ulPos = 0;
+    while (ulLen - ulPos >= BENCH_MSG_SIZE)
+    {
+        uint32_t ulSeq = 0;
+        memcpy(&ulSeq, pData + ulPos + 4, sizeof(ulSeq));
+        if ((ulSeq != ulNextSeq)
+            || ((char)(ulSeq & 0xFF) != pData[ulPos + BENCH_MSG_SIZE - 1]))
+        {
+            ullErrors++;
+        }
+        ulNextSeq = ulSeq + 1;
+        ulPos += BENCH_MSG_SIZE;
+    }
+    return ulPos;
+}
+
+static void bench_run(BENCH_MODE enMode, uint32_t ulMsgs)
+{
+    const char* pszMode[] = {"mutex Write/Read", "spsc Write/Read", "spsc Reserve/PeekSpan"};
+    as_ring_cache cache;
+    unsigned long ulSize = 0;
+    if (BENCH_MODE_MUTEX == enMode)
+    {
+        ulSize = cache.SetCacheSize(BENCH_CACHE_SIZE);
+    }
+    else
+    {
+        ulSize = cache.SetSpscCacheSize(BENCH_CACHE_SIZE);
+    }
+    if (0 == ulSize)
+    {
+        printf("%-22s set the cache size fail\n", pszMode[enMode]);
+        return;
+    }
+
+    BENCH_CTX ctx;
+    ctx.pCache = &cache;
+    ctx.enMode = enMode;
+    ctx.ulMsgs = ulMsgs;
+
+    static char szRecv[BENCH_CACHE_SIZE + BENCH_MSG_SIZE];
+    unsigned long ulPending = 0;
+    uint32_t ulNextSeq = 0;
+    uint64_t ullErrors = 0;
+    uint64_t ullBytes = (uint64_t)ulMsgs * BENCH_MSG_SIZE;
+    uint64_t ullRecv = 0;
+    uint64_t ullCalls = 0;
+
+    pthread_t thread;
+    uint64_t ullStart = bench_now_ns();
+    pthread_create(&thread, NULL, bench_producer, &ctx);
+    while (ullRecv < ullBytes)
+    {
+        unsigned long ulLen = 0;
+        if (BENCH_MODE_SPSC_ZERO_COPY == enMode)
+        {
+            char* pData = cache.PeekSpan(ulLen);
+            if (NULL == pData)
+            {
+                sched_yield();
+                continue;
+            }
+            ulLen = bench_check(pData, ulLen, ulNextSeq, ullErrors);
+            cache.Consume(ulLen);
+        }
+        else
+        {
+            /* a read may end in the middle of a message */
+            ulLen = cache.Read(szRecv + ulPending, BENCH_CACHE_SIZE);
+            if (0 == ulLen)
+            {
+                sched_yield();
+                continue;
+            }
+            ulPending += ulLen;
+            unsigned long ulDone = bench_check(szRecv, ulPending, ulNextSeq, ullErrors);
+            memmove(szRecv, szRecv + ulDone, ulPending - ulDone);
+            ulPending -= ulDone;
+        }
+        ullRecv += ulLen;
+        ullCalls++;
+    }
+    uint64_t ullCost = bench_now_ns() - ullStart;
+    pthread_join(thread, NULL);
+
+    printf("%-22s MB/s:%8.0f msgs/s:%10.0f bytes/read:%8.0f errors:%llu\n",
+           pszMode[enMode], (double)ullRecv * 1e3 / (double)ullCost,
+           (double)ulMsgs * 1e9 / (double)ullCost,
+           (double)ullRecv / (double)(0 == ullCalls ? 1 : ullCalls),
+           (unsigned long long)ullErrors);
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t ulMB = 2048;
+    if (1 < argc)
+    {
+        ulMB = (uint32_t)atoi(argv[1]);
+    }
+    uint32_t ulMsgs = (uint32_t)(((uint64_t)ulMB * 1024 * 1024) / BENCH_MSG_SIZE);
+
+    bench_run(BENCH_MODE_MUTEX, ulMsgs);
+    bench_run(BENCH_MODE_SPSC_COPY, ulMsgs);
+    bench_run(BENCH_MODE_SPSC_ZERO_COPY, ulMsgs);
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * micro benchmark of as_timer:keep a number of repeating timers of 30-60s
+ * on the wheel and report the cpu of the process while the timer thread
+ * only ticks,then while two threads keep cancelling and re-registering
+ * timers at a given rate(0:as fast as they can).the cpu of the churn
+ * threads is reported apart,the rest is the cost of the timer thread.
+ * usage: bench_timer [timers] [seconds per run] [timer scale ms] [churn ops/s]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "as_timer.h"
+
+#define BENCH_CHURN_THREADS     2
+/* the timers of 30-60s,as the session keep-alive timers */
+#define BENCH_PERIOD_MIN_MS     30000
+#define BENCH_PERIOD_MAX_MS     60000
+
+class CBenchTrigger : public ITrigger
+{
+public:
+    CBenchTrigger(){m_ullFired = 0;};
+    virtual void onTrigger(void *pArg, ULONGLONG ullScales, TriggerStyle enStyle)
+    {
+        m_ullFired++;
+    };
+public:
+    unsigned long long m_ullFired;
+};
+
+typedef struct tagBENCH_CTX
+{
+    CBenchTrigger*  pTriggers;
+    uint32_t        ulFirst;
+    uint32_t        ulCount;
+    uint32_t        ulScale;
+    uint32_t        ulRate;
+    volatile bool   bStop;
+    uint64_t        ullOps;
+    uint64_t        ullCpuUs;
+}BENCH_CTX;
+
+static uint64_t bench_now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static uint64_t bench_cpu_us(int who)
+{
+    struct rusage usage;
+    getrusage(who, &usage);
+    return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL
+         + (uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+static ULONG bench_scales(uint32_t ulScale, unsigned int* pSeed)
+{
+    uint32_t ulMs = BENCH_PERIOD_MIN_MS
+                  + (uint32_t)rand_r(pSeed) % (BENCH_PERIOD_MAX_MS - BENCH_PERIOD_MIN_MS);
+    return (ULONG)(ulMs / ulScale);
+}
+
+/* cancel and re-register the timers of its range,round and round */
+static void* bench_churn(void* arg)
+{
+    BENCH_CTX* pCtx = (BENCH_CTX*)arg;
+    unsigned int seed = pCtx->ulFirst + 1;
+    uint64_t ullStart = bench_cpu_us(RUSAGE_THREAD);
+    uint64_t ullBegin = bench_now_us();
+    uint32_t i = 0;
+    while (!pCtx->bStop)
+    {
+        if ((0 < pCtx->ulRate)
+            && (pCtx->ullOps >= (bench_now_us() - ullBegin) * pCtx->ulRate / 1000000))
+        {
+            usleep(1000);
+            continue;
+        }
+        CBenchTrigger* pTrigger = &pCtx->pTriggers[pCtx->ulFirst + i];
+        (void)as_timer::instance().cancelTimer(pTrigger);
+        (void)as_timer::instance().registerTimer(pTrigger, NULL,
+                                                 bench_scales(pCtx->ulScale, &seed), enRepeated);
+        pCtx->ullOps++;
+        i = (i + 1) % pCtx->ulCount;
+    }
+    pCtx->ullCpuUs = bench_cpu_us(RUSAGE_THREAD) - ullStart;
+    return NULL;
+}
+
+static void bench_report(const char* pszRun, uint64_t ullWallUs, uint64_t ullCpuUs,
+                         uint64_t ullChurnCpuUs, uint64_t ullOps)
+{
+    double dWall = (double)(0 == ullWallUs ? 1 : ullWallUs);
+    printf("%-8s timers:%7lu process cpu:%6.2f%% timer thread cpu:%6.2f%% churn ops/s:%10.0f\n",
+           pszRun, as_timer::instance().getTimerCount(),
+           (double)ullCpuUs * 100.0 / dWall,
+           (double)(ullCpuUs - ullChurnCpuUs) * 100.0 / dWall,
+           (double)ullOps * 1e6 / dWall);
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t ulTimers  = 100000;
+    uint32_t ulSeconds = 10;
+    uint32_t ulScale   = 10;
+    uint32_t ulRate    = 40000;
+    if (1 < argc)
+    {
+        ulTimers = (uint32_t)atoi(argv[1]);
+    }
+    if (2 < argc)
+    {
+        ulSeconds = (uint32_t)atoi(argv[2]);
+    }
+    if (3 < argc)
+    {
+        ulScale = (uint32_t)atoi(argv[3]);
+    }
+    if (4 < argc)
+    {
+        ulRate = (uint32_t)atoi(argv[4]);
+    }
+    if ((BENCH_CHURN_THREADS > ulTimers) || (0 == ulScale))
+    {
+        printf("usage: bench_timer [timers] [seconds per run] [timer scale ms] [churn ops/s]\n");
+        return 1;
+    }
+
+    if ((AS_SUCCESS != as_timer::instance().init(ulScale))
+        || (AS_SUCCESS != as_timer::instance().run()))
+    {
+        printf("start the timer fail\n");
+        return 1;
+    }
+
+    CBenchTrigger* pTriggers = new CBenchTrigger[ulTimers];
+    unsigned int seed = 1;
+    for (uint32_t i = 0; i < ulTimers; i++)
+    {
+        (void)as_timer::instance().registerTimer(&pTriggers[i], NULL,
+                                                 bench_scales(ulScale, &seed), enRepeated);
+    }
+
+    /* idle:the timer thread ticks over the wheel */
+    uint64_t ullWall = bench_now_us();
+    uint64_t ullCpu  = bench_cpu_us(RUSAGE_SELF);
+    sleep(ulSeconds);
+    bench_report("idle", bench_now_us() - ullWall, bench_cpu_us(RUSAGE_SELF) - ullCpu, 0, 0);
+
+    /* churn:each thread owns a part of the timers */
+    BENCH_CTX ctx[BENCH_CHURN_THREADS];
+    pthread_t threads[BENCH_CHURN_THREADS];
+    uint32_t ulPart = ulTimers / BENCH_CHURN_THREADS;
+    ullWall = bench_now_us();
+    ullCpu  = bench_cpu_us(RUSAGE_SELF);
+    for (uint32_t i = 0; i < BENCH_CHURN_THREADS; i++)
+    {
+        memset(&ctx[i], 0, sizeof(BENCH_CTX));
+        ctx[i].pTriggers = pTriggers;
+        ctx[i].ulFirst   = i * ulPart;
+        ctx[i].ulCount   = ulPart;
+        ctx[i].ulScale   = ulScale;
+        ctx[i].ulRate    = ulRate / BENCH_CHURN_THREADS;
+        pthread_create(&threads[i], NULL, bench_churn, &ctx[i]);
+    }
+    sleep(ulSeconds);
+    uint64_t ullChurnCpu = 0;
+    uint64_t ullOps = 0;
+    for (uint32_t i = 0; i < BENCH_CHURN_THREADS; i++)
+    {
+        ctx[i].bStop = true;
+        pthread_join(threads[i], NULL);
+        ullChurnCpu += ctx[i].ullCpuUs;
+        ullOps += ctx[i].ullOps;
+    }
+    bench_report("churn", bench_now_us() - ullWall, bench_cpu_us(RUSAGE_SELF) - ullCpu,
+                 ullChurnCpu, ullOps);
+
+    as_timer::instance().exit();
+    as_timer::instance().clearTimer();
+    delete[] pTriggers;
+    return 0;
+}
@@ -68,6 +68,39 @@ Boolean OutputSocket::write(netAddressBits address, portNumBits portNum, u_int8_
   return True;
 }
 
+unsigned OutputSocket::writeBatch(struct sockaddr_in const* destinations, unsigned numDestinations, u_int8_t ttl,
+                  unsigned char* buffer, unsigned bufferSize) {
+  if ((unsigned)ttl != fLastSentTTL) {
+    // Set the socket's TTL once, for the whole batch:
+#if defined(__WIN32__) || defined(_WIN32)
+    int ttlToSet = (int)ttl;
+#else
+    u_int8_t ttlToSet = ttl;
+#endif
+    if (setsockopt(socketNum(), IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttlToSet, sizeof ttlToSet) < 0) {
+      env().setResultErrMsg("setsockopt(IP_MULTICAST_TTL) error: ");
+      return 0;
+    }
+    fLastSentTTL = (unsigned)ttl;
+  }
+
+  unsigned numSent = writeSocketBatch(env(), socketNum(), destinations, numDestinations, buffer, bufferSize);
+
+  if (numSent > 0 && sourcePortNum() == 0) {
+    // Now that we've sent a packet, we can find out what the
+    // kernel chose as our ephemeral source port number:
+    if (!getSourcePort(env(), socketNum(), fSourcePort)) {
+      if (DebugLevel >= 1)
+    env() << *this
+         << ": failed to get source port: "
+         << env().getResultMsg() << "\n";
+      return 0;
+    }
+  }
+
+  return numSent;
+}
+
 // By default, we don't do reads:
 Boolean OutputSocket
 ::handleRead(unsigned char* /*buffer*/, unsigned /*bufferMaxSize*/,
@@ -264,11 +297,31 @@ Boolean Groupsock::output(UsageEnvironment& env, unsigned char* buffer, unsigned
   do {
     // First, do the datagram send, to each destination:
     Boolean writeSuccess = True;
-    for (destRecord* dests = fDests; dests != NULL; dests = dests->fNext) {
-      if (!write(dests->fGroupEId.groupAddress().s_addr, dests->fGroupEId.portNum(), dests->fGroupEId.ttl(),
-         buffer, bufferSize)) {
+    if (!hasMultipleDestinations()) {
+      if (fDests != NULL
+      && !write(fDests->fGroupEId.groupAddress().s_addr, fDests->fGroupEId.portNum(), fDests->fGroupEId.ttl(),
+            buffer, bufferSize)) {
+    writeSuccess = False;
+      }
+    } else {
+      // Many clients may be sharing this packet, so send it to them in batches (of destinations with the
+      // same TTL).  Also, a destination that fails doesn't stop the packet from reaching the others:
+      struct sockaddr_in batch[MAX_WRITE_SOCKET_BATCH];
+      unsigned batchSize = 0;
+      u_int8_t batchTTL = 0;
+      for (destRecord* dests = fDests; dests != NULL; dests = dests->fNext) {
+    u_int8_t ttl = dests->fGroupEId.ttl();
+    if (batchSize > 0 && (batchSize == MAX_WRITE_SOCKET_BATCH || ttl != batchTTL)) {
+      if (writeBatch(batch, batchSize, batchTTL, buffer, bufferSize) != batchSize) writeSuccess = False;
+      batchSize = 0;
+    }
+
+    MAKE_SOCKADDR_IN(dest, dests->fGroupEId.groupAddress().s_addr, dests->fGroupEId.portNum());
+    batch[batchSize++] = dest;
+    batchTTL = ttl;
+      }
+      if (batchSize > 0 && writeBatch(batch, batchSize, batchTTL, buffer, bufferSize) != batchSize) {
     writeSuccess = False;
-    break;
       }
     }
     if (!writeSuccess) break;
@@ -323,28 +376,59 @@ Boolean Groupsock::handleRead(unsigned char* buffer, unsigned bufferMaxSize,
     return False;
   }
 
+  if (acceptIncomingPacket(buffer, (unsigned)numBytes, fromAddressAndPort)) {
+    bytesRead = numBytes;
+  }
+
+  return True;
+}
+
+int Groupsock::handleReadBatch(unsigned char* buffer, unsigned slotSize, unsigned maxPackets,
+                   unsigned* bytesRead, struct sockaddr_in* fromAddresses,
+                   Boolean* truncated) {
+  int numRead = readSocketBatch(env(), socketNum(), buffer, slotSize,
+                slotSize - TunnelEncapsulationTrailerMaxSize, maxPackets,
+                bytesRead, fromAddresses, truncated);
+  if (numRead < 0) {
+    if (DebugLevel >= 0) { // this is a fatal error
+      UsageEnvironment::MsgString msg = strDup(env().getResultMsg());
+      env().setResultMsg("Groupsock read failed: ", msg);
+      delete[] (char*)msg;
+    }
+    return -1;
+  }
+
+  for (int i = 0; i < numRead; ++i) {
+    if (!acceptIncomingPacket(&buffer[i*slotSize], bytesRead[i], fromAddresses[i])) {
+      bytesRead[i] = 0;
+    }
+  }
+
+  return numRead;
+}
+
+Boolean Groupsock::acceptIncomingPacket(unsigned char* buffer, unsigned bytesRead,
+                    struct sockaddr_in& fromAddressAndPort) {
   // If we're a SSM group, make sure the source address matches:
   if (isSSM()
       && fromAddressAndPort.sin_addr.s_addr != sourceFilterAddress().s_addr) {
-    return True;
+    return False;
   }
 
   // We'll handle this data.
   // Also write it (with the encapsulation trailer) to each member,
   // unless the packet was originally sent by us to begin with.
-  bytesRead = numBytes;
-
   int numMembers = 0;
   if (!wasLoopedBackFromUs(env(), fromAddressAndPort)) {
-    statsIncoming.countPacket(numBytes);
-    statsGroupIncoming.countPacket(numBytes);
+    statsIncoming.countPacket(bytesRead);
+    statsGroupIncoming.countPacket(bytesRead);
     numMembers =
       outputToAllMembersExcept(NULL, ttl(),
                    buffer, bytesRead,
                    fromAddressAndPort.sin_addr.s_addr);
     if (numMembers > 0) {
-      statsRelayedIncoming.countPacket(numBytes);
-      statsGroupRelayedIncoming.countPacket(numBytes);
+      statsRelayedIncoming.countPacket(bytesRead);
+      statsGroupRelayedIncoming.countPacket(bytesRead);
     }
   }
   if (DebugLevel >= 3) {
@@ -36,6 +36,7 @@ extern "C" int initializeWinsockIfNecessary();
 #define USE_SIGNALS 1
 #endif
 #include <stdio.h>
+#include <string.h>
 
 // By default, use INADDR_ANY for the sending and receiving interfaces:
 netAddressBits SendingInterfaceAddr = INADDR_ANY;
@@ -323,6 +324,116 @@ int readSocket(UsageEnvironment& env,
   return bytesRead;
 }
 
+int readSocketBatch(UsageEnvironment& env,
+            int socket, unsigned char* buffer, unsigned slotSize,
+            unsigned maxBytesPerSlot, unsigned maxPackets,
+            unsigned* bytesRead, struct sockaddr_in* fromAddresses,
+            Boolean* truncated) {
+  if (maxPackets > MAX_READ_SOCKET_BATCH) maxPackets = MAX_READ_SOCKET_BATCH;
+  if (maxBytesPerSlot > slotSize) maxBytesPerSlot = slotSize;
+
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+  struct mmsghdr msgs[MAX_READ_SOCKET_BATCH];
+  struct iovec iovs[MAX_READ_SOCKET_BATCH];
+  for (unsigned i = 0; i < maxPackets; ++i) {
+    iovs[i].iov_base = &buffer[i*slotSize];
+    iovs[i].iov_len = maxBytesPerSlot;
+    memset(&msgs[i], 0, sizeof msgs[i]);
+    msgs[i].msg_hdr.msg_name = &fromAddresses[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof fromAddresses[i];
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int numRead = recvmmsg(socket, msgs, maxPackets, MSG_DONTWAIT, NULL);
+  if (numRead < 0) {
+    int err = env.getErrno();
+    if (err == EAGAIN || err == EINTR
+    || err == 111 /*ECONNREFUSED*/ || err == 113 /*EHOSTUNREACH*/) {
+      return 0; // as in "readSocket()"
+    }
+    socketErr(env, "recvmmsg() error: ");
+    return -1;
+  }
+
+  for (int i = 0; i < numRead; ++i) {
+    bytesRead[i] = msgs[i].msg_len;
+    truncated[i] = (msgs[i].msg_hdr.msg_flags&MSG_TRUNC) != 0;
+  }
+  return numRead;
+#else
+  // No "recvmmsg()": Read the datagrams one at a time, until there are no more.
+  // (A datagram that fills its slot exactly is assumed to have been truncated.)
+  unsigned numRead = 0;
+  while (numRead < maxPackets) {
+    int bytes = readSocket(env, socket, &buffer[numRead*slotSize], maxBytesPerSlot,
+               fromAddresses[numRead]);
+    if (bytes < 0) return numRead > 0 ? (int)numRead : -1;
+    if (bytes == 0) break;
+
+    bytesRead[numRead] = (unsigned)bytes;
+    truncated[numRead] = (unsigned)bytes >= maxBytesPerSlot;
+    ++numRead;
+  }
+  return (int)numRead;
+#endif
+}
+
+unsigned writeSocketBatch(UsageEnvironment& env,
+              int socket, struct sockaddr_in const* destinations, unsigned numDestinations,
+              unsigned char* buffer, unsigned bufferSize) {
+  if (numDestinations > MAX_WRITE_SOCKET_BATCH) numDestinations = MAX_WRITE_SOCKET_BATCH;
+  unsigned numSent = 0;
+
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+  struct mmsghdr msgs[MAX_WRITE_SOCKET_BATCH];
+  struct iovec iov;
+  iov.iov_base = buffer;
+  iov.iov_len = bufferSize;
+  for (unsigned i = 0; i < numDestinations; ++i) {
+    memset(&msgs[i], 0, sizeof msgs[i]);
+    msgs[i].msg_hdr.msg_name = (void*)&destinations[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof destinations[i];
+    msgs[i].msg_hdr.msg_iov = &iov;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  unsigned i = 0;
+  while (i < numDestinations) {
+    int numWritten = sendmmsg(socket, &msgs[i], numDestinations - i, 0);
+    if (numWritten <= 0) {
+      int err = env.getErrno();
+      if (err == EINTR) continue;
+
+      // "sendmmsg()" stops at the first destination that fails.  Report it, and carry on after it:
+      char tmpBuf[100];
+      sprintf(tmpBuf, "writeSocketBatch(%d), sendmmsg() error: ", socket);
+      socketErr(env, tmpBuf);
+      // ...unless the socket itself can't take any more right now; then every remaining destination would fail too:
+      if (err == EAGAIN || err == EWOULDBLOCK || err == ENOBUFS) break;
+      ++i;
+      continue;
+    }
+
+    for (int j = 0; j < numWritten; ++j) {
+      if (msgs[i+j].msg_len == bufferSize) ++numSent;
+    }
+    i += numWritten;
+  }
+#else
+  // No "sendmmsg()": Send to each destination in turn:
+  for (unsigned i = 0; i < numDestinations; ++i) {
+    if (writeSocket(env, socket, destinations[i].sin_addr, destinations[i].sin_port, buffer, bufferSize)) {
+      ++numSent;
+    } else if (env.getErrno() == EWOULDBLOCK) {
+      break; // the socket is full; so are the remaining sends
+    }
+  }
+#endif
+
+  return numSent;
+}
+
 Boolean writeSocket(UsageEnvironment& env,
             int socket, struct in_addr address, portNumBits portNum,
             u_int8_t ttlArg,
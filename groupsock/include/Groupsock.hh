@@ -47,6 +47,10 @@ public:
         unsigned char* buffer, unsigned bufferSize) {
     return write(addressAndPort.sin_addr.s_addr, addressAndPort.sin_port, ttl, buffer, bufferSize);
   }
+  unsigned writeBatch(struct sockaddr_in const* destinations, unsigned numDestinations, u_int8_t ttl,
+              unsigned char* buffer, unsigned bufferSize);
+      // Sends the same packet to several destinations at once (see "writeSocketBatch()").
+      // Returns the number of destinations that it was sent to.
 
 protected:
   OutputSocket(UsageEnvironment& env, Port port);
@@ -152,10 +156,19 @@ public: // redefined virtual functions
                  unsigned& bytesRead,
                  struct sockaddr_in& fromAddressAndPort);
 
+  int handleReadBatch(unsigned char* buffer, unsigned slotSize, unsigned maxPackets,
+              unsigned* bytesRead, struct sockaddr_in* fromAddresses,
+              Boolean* truncated);
+      // Like "handleRead()", but reads up to "maxPackets" datagrams at once (see "readSocketBatch()").
+      // Returns the number of slots filled, or -1 on error; a slot with "bytesRead" 0 is to be ignored.
+
 protected:
   destRecord* lookupDestRecordFromDestination(struct sockaddr_in const& destAddrAndPort) const;
 
 private:
+  Boolean acceptIncomingPacket(unsigned char* buffer, unsigned bytesRead,
+                   struct sockaddr_in& fromAddressAndPort);
+    // used to implement "handleRead()" and "handleReadBatch()"
   void removeDestinationFrom(destRecord*& dests, unsigned sessionId);
     // used to implement (the public) "removeDestination()", and "changeDestinationParameters()"
   int outputToAllMembersExcept(DirectedNetInterface* exceptInterface,
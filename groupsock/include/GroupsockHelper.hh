@@ -33,6 +33,27 @@ int readSocket(UsageEnvironment& env,
            int socket, unsigned char* buffer, unsigned bufferSize,
            struct sockaddr_in& fromAddress);
 
+#define MAX_READ_SOCKET_BATCH 64
+int readSocketBatch(UsageEnvironment& env,
+            int socket, unsigned char* buffer, unsigned slotSize,
+            unsigned maxBytesPerSlot, unsigned maxPackets,
+            unsigned* bytesRead, struct sockaddr_in* fromAddresses,
+            Boolean* truncated);
+    // Reads up to "maxPackets" (at most MAX_READ_SOCKET_BATCH) pending datagrams at once -
+    // using "recvmmsg()" where available - into consecutive "slotSize"-byte slots of "buffer".
+    // Returns the number of datagrams read (0 if none was pending), or -1 on error.
+    // "truncated[i]" is set if datagram "i" did not fit in "maxBytesPerSlot" bytes.
+
+#define MAX_WRITE_SOCKET_BATCH 64
+unsigned writeSocketBatch(UsageEnvironment& env,
+              int socket, struct sockaddr_in const* destinations, unsigned numDestinations,
+              unsigned char* buffer, unsigned bufferSize);
+    // Sends the same datagram to each of "numDestinations" (at most MAX_WRITE_SOCKET_BATCH) destinations -
+    // using "sendmmsg()" where available, so that one system call covers them all.
+    // A failed send doesn't stop the datagram from being sent to the remaining destinations - except when the socket
+    // has no room for it (EAGAIN/ENOBUFS), in which case the rest of the batch is dropped rather than retried.
+    // Returns the number of destinations that the datagram was sent to.
+
 Boolean writeSocket(UsageEnvironment& env,
             int socket, struct in_addr address, portNumBits portNum/*network byte order*/,
             u_int8_t ttlArg,
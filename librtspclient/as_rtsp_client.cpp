@@ -28,6 +28,7 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "as_rtsp_client.h"
 #include "RTSPCommon.hh"
 #include "as_lock_guard.h"
+#include <ctype.h>
 
 
 #if defined(__WIN32__) || defined(_WIN32)
@@ -47,66 +48,70 @@ UsageEnvironment& operator<<(UsageEnvironment& env, const MediaSubsession& subse
 
 // Implementation of "ASRtspClient":
 
-ASRtspClient* ASRtspClient::createNew(u_int32_t ulEnvIndex,UsageEnvironment& env, char const* rtspURL,
+ASRtspClient* ASRtspClient::createNew(ASRtspUpstream* pUpstream,UsageEnvironment& env, char const* rtspURL,
                     int verbosityLevel, char const* applicationName, portNumBits tunnelOverHTTPPortNum) {
-  return new ASRtspClient(ulEnvIndex,env, rtspURL, verbosityLevel, applicationName, tunnelOverHTTPPortNum);
+  return new ASRtspClient(pUpstream,env, rtspURL, verbosityLevel, applicationName, tunnelOverHTTPPortNum);
 }
 
-ASRtspClient::ASRtspClient(u_int32_t ulEnvIndex,UsageEnvironment& env, char const* rtspURL,
+ASRtspClient::ASRtspClient(ASRtspUpstream* pUpstream,UsageEnvironment& env, char const* rtspURL,
                  int verbosityLevel, char const* applicationName, portNumBits tunnelOverHTTPPortNum)
   : RTSPClient(env,rtspURL, verbosityLevel, applicationName, tunnelOverHTTPPortNum, -1) {
-  m_ulEnvIndex = ulEnvIndex;
+  m_pUpstream = pUpstream;
   m_bSupportsGetParameter = False;
   m_dStarttime = 0.0;
   m_dEndTime = 0.0;
   m_curStatus = AS_RTSP_STATUS_INIT;
-  m_mutex = as_create_mutex();
-  m_ulRefCount = 1;
+  m_bFastStart = False;
+  m_bRedescribed = False;
+  m_shutdownTask = NULL;
 }
 
 ASRtspClient::~ASRtspClient() {
-    if (NULL != m_mutex) {
-        as_destroy_mutex(m_mutex);
-        m_mutex = NULL;
-    }
 }
 
-int32_t ASRtspClient::open(as_rtsp_callback_t* cb)
+int32_t ASRtspClient::open()
 {
-    as_lock_guard locker(m_mutex);
-    m_cb = cb;
     // Next, send a RTSP "DESCRIBE" command, to get a SDP description for the stream.
     // Note that this command - like all RTSP commands - is sent asynchronously; we do not block, waiting for a response.
     // Instead, the following function call returns immediately, and we handle the RTSP response later, from within the event loop:
-    scs.Start();
-    m_ulRefCount++;
-    m_bRunning = true;
-    //return sendDescribeCommand(continueAfterDESCRIBE);
-    return sendOptionsCommand(continueAfterOPTIONS);
+    m_bFastStart = (0 != ASRtspClientManager::instance().getFastStart());
+    if (!m_bFastStart) {
+        return sendOptionsCommand(continueAfterOPTIONS);
+    }
+
+    /* no OPTIONS,the SETUPs and the PLAY follow the DESCRIBE at once */
+    setRequestPipelining(True);
+    /* nothing tells if GET_PARAMETER is supported,send the keep-alive anyway,an error answer is ignored */
+    SupportsGetParameter(True);
+    setDescribeCacheTTL(ASRtspClientManager::instance().getDescribeCacheTTL());
+    return sendDescribeCommand(continueAfterDESCRIBE);
 }
-void    ASRtspClient::close()
+void    ASRtspClient::addConsumer(ASRtspConsumer* pConsumer)
 {
-    as_lock_guard locker(m_mutex);
-    scs.Stop();
-    m_cb = NULL;
-    m_ulRefCount--;
-    m_bRunning = false;
+    m_ConsumerList.push_back(pConsumer);
+
+    /* a late joiner gets the subsessions set up already,and the status */
+    REPLICATORMAP::iterator iter = m_ReplicatorMap.begin();
+    for (; iter != m_ReplicatorMap.end(); ++iter) {
+        attachConsumer(pConsumer, iter->first);
+    }
+    if ((AS_RTSP_STATUS_INIT != m_curStatus) && (NULL != pConsumer->m_cb)
+        && (NULL != pConsumer->m_cb->f_status_cb)) {
+        pConsumer->m_cb->f_status_cb((AS_HANDLE)pConsumer, m_curStatus, pConsumer->m_cb->ctx);
+    }
 }
-void    ASRtspClient::destory()
+void    ASRtspClient::removeConsumer(ASRtspConsumer* pConsumer)
 {
-    as_lock_guard locker(m_mutex);
-    m_ulRefCount--;
-    shutdownStream();
+    detachConsumer(pConsumer);
+    m_ConsumerList.remove(pConsumer);
 }
-double ASRtspClient::getDuration()
+void    ASRtspClient::destory()
 {
-    as_lock_guard locker(m_mutex);
-    return scs.duration;
+    shutdownStream();
 }
 
 void ASRtspClient::seek(double start)
 {
-    as_lock_guard locker(m_mutex);
     if(NULL == scs.session)
     {
         return;
@@ -131,7 +136,6 @@ void ASRtspClient::seek(double start)
 }
 void ASRtspClient::pause()
 {
-    as_lock_guard locker(m_mutex);
     if(NULL == scs.session)
     {
         return;
@@ -141,7 +145,6 @@ void ASRtspClient::pause()
 }
 void ASRtspClient::play()
 {
-    as_lock_guard locker(m_mutex);
     if (AS_RTSP_STATUS_PAUSE != m_curStatus)
     {
         return;
@@ -160,29 +163,90 @@ void ASRtspClient::play()
 void ASRtspClient::report_status(int status)
 {
     m_curStatus = status;
-    if(NULL == m_cb) {
+
+    /* a consumer may leave in its callback,the leave is run later on this thread */
+    CONSUMERLIST::iterator iter = m_ConsumerList.begin();
+    for (; iter != m_ConsumerList.end(); ++iter) {
+        ASRtspConsumer* pConsumer = *iter;
+        if ((NULL == pConsumer->m_cb) || (NULL == pConsumer->m_cb->f_status_cb)) {
+            continue;
+        }
+        pConsumer->m_cb->f_status_cb((AS_HANDLE)pConsumer, status, pConsumer->m_cb->ctx);
+    }
+}
+
+void ASRtspClient::startFanout(MediaSubsession* subsession)
+{
+    /* the cache sink keeps the subsession flowing while no consumer reads it */
+    StreamReplicator* replicator = StreamReplicator::createNew(envir(), subsession->readSource(), False);
+    m_ReplicatorMap[subsession] = replicator;
+
+    FramedSource* replica = replicator->createStreamReplica();
+    subsession->sink = ASGopCacheSink::createNew(envir(), *subsession, replica);
+    subsession->miscPtr = this; // a hack to let subsession handler functions get the "RTSPClient" from the subsession
+    subsession->sink->startPlaying(*replica, subsessionAfterPlaying, subsession);
+}
+
+void ASRtspClient::attachConsumer(ASRtspConsumer* pConsumer,MediaSubsession* subsession)
+{
+    REPLICATORMAP::iterator iter = m_ReplicatorMap.find(subsession);
+    if ((iter == m_ReplicatorMap.end()) || (NULL == subsession->sink)) {
         return;
     }
-    if(NULL == m_cb->f_status_cb) {
+
+    ASStreamSink* sink = ASStreamSink::createNew(envir(), *subsession, url(), pConsumer->m_cb);
+    if (NULL == sink) {
         return;
     }
+    FramedSource* replica = iter->second->createStreamReplica();
+    sink->setReplica(replica);
+    pConsumer->m_SinkList.push_back(sink);
 
-    m_cb->f_status_cb(this,status,m_cb->ctx);
+    /* the cache is up to the last frame delivered,the replica goes on from the next one */
+    ((ASGopCacheSink*)subsession->sink)->replay(sink);
+    sink->startPlaying(*replica, NULL, NULL);
 }
 
+void ASRtspClient::detachConsumer(ASRtspConsumer* pConsumer)
+{
+    std::list<ASStreamSink*>::iterator iter = pConsumer->m_SinkList.begin();
+    for (; iter != pConsumer->m_SinkList.end(); ++iter) {
+        Medium::close(*iter);
+    }
+    pConsumer->m_SinkList.clear();
+}
 
-void ASRtspClient::handleAfterOPTIONS(int resultCode, char* resultString)
+void ASRtspClient::closeFanout()
 {
-    do {
-        if (NULL != resultString) {
-            delete[] resultString;
-        }
+    /* the replicas of the consumers go first */
+    CONSUMERLIST::iterator consumerIter = m_ConsumerList.begin();
+    for (; consumerIter != m_ConsumerList.end(); ++consumerIter) {
+        detachConsumer(*consumerIter);
+    }
 
-        if(NULL == scs.streamTimerTask) {
-            unsigned uSecsToDelay = (unsigned)(RTSP_CLIENT_TIME*1000);
-            scs.streamTimerTask = envir().taskScheduler().scheduleDelayedTask(uSecsToDelay, (TaskFunc*)streamTimerHandler, this);
+    if (scs.session != NULL) {
+        MediaSubsessionIterator iter(*scs.session);
+        MediaSubsession* subsession;
+        while ((subsession = iter.next()) != NULL) {
+            if (subsession->sink != NULL) {
+                Medium::close(subsession->sink);
+                subsession->sink = NULL;
+            }
         }
+    }
+
+    /* no replica is left,the input of a replicator is closed with the session */
+    REPLICATORMAP::iterator replicatorIter = m_ReplicatorMap.begin();
+    for (; replicatorIter != m_ReplicatorMap.end(); ++replicatorIter) {
+        replicatorIter->second->detachInputSource();
+        Medium::close(replicatorIter->second);
+    }
+    m_ReplicatorMap.clear();
+}
 
+void ASRtspClient::handleAfterOPTIONS(int resultCode, char* resultString)
+{
+    do {
         Boolean serverSupportsGetParameter = RTSPOptionIsSupported("GET_PARAMETER", resultString);
         delete[] resultString;
         SupportsGetParameter(serverSupportsGetParameter);
@@ -197,6 +261,7 @@ void ASRtspClient::handleAfterOPTIONS(int resultCode, char* resultString)
 void ASRtspClient::handleAfterDESCRIBE(int resultCode, char* resultString)
 {
     if (0 != resultCode) {
+        delete[] resultString;
         destory();
         return;
     }
@@ -219,11 +284,6 @@ void ASRtspClient::handleAfterDESCRIBE(int resultCode, char* resultString)
             break;
         }
 
-        if(NULL == scs.streamTimerTask) {
-            unsigned uSecsToDelay = (unsigned)(RTSP_CLIENT_TIME*1000);
-            scs.streamTimerTask = envir().taskScheduler().scheduleDelayedTask(uSecsToDelay, (TaskFunc*)streamTimerHandler, this);
-        }
-
         /* report the status */
         report_status(AS_RTSP_STATUS_INIT);
 
@@ -231,7 +291,12 @@ void ASRtspClient::handleAfterDESCRIBE(int resultCode, char* resultString)
         // calling "MediaSubsession::initiate()", and then sending a RTSP "SETUP" command, on each one.
         // (Each 'subsession' will have its own data source.)
         scs.iter = new MediaSubsessionIterator(*scs.session);
-        setupNextSubsession();
+        if (m_bFastStart) {
+            setupAllSubsessions();
+        }
+        else {
+            setupNextSubsession();
+        }
 
         return;
     } while (0);
@@ -240,39 +305,73 @@ void ASRtspClient::handleAfterDESCRIBE(int resultCode, char* resultString)
     destory();
 }
 void ASRtspClient::setupNextSubsession() {
-    UsageEnvironment& env = envir(); // alias
-
     scs.subsession = scs.iter->next();
     if (scs.subsession != NULL) {
-        if (!scs.subsession->initiate()) {
+        if (!initSubsession(scs.subsession)) {
             setupNextSubsession(); // give up on this subsession; go to the next one
         }
         else {
-
-            if (scs.subsession->rtpSource() != NULL) {
-                // Because we're saving the incoming data, rather than playing
-                // it in real time, allow an especially large time threshold
-                // (1 second) for reordering misordered incoming packets:
-                unsigned const thresh = 1000000; // 1 second
-                scs.subsession->rtpSource()->setPacketReorderingThresholdTime(thresh);
-
-                // Set the RTP source's OS socket buffer size as appropriate - either if we were explicitly asked (using -B),
-                // or if the desired FileSink buffer size happens to be larger than the current OS socket buffer size.
-                // (The latter case is a heuristic, on the assumption that if the user asked for a large FileSink buffer size,
-                // then the input data rate may be large enough to justify increasing the OS socket buffer size also.)
-                int socketNum = scs.subsession->rtpSource()->RTPgs()->socketNum();
-                unsigned curBufferSize = getReceiveBufferSize(env, socketNum);
-                unsigned ulRecvBufSize = ASRtspClientManager::instance().getRecvBufSize();
-                if (ulRecvBufSize > curBufferSize) {
-                    (void)setReceiveBufferTo(env, socketNum, ulRecvBufSize);
-                }
-            }
-
             // Continue setting up this subsession, by sending a RTSP "SETUP" command:
             sendSetupCommand(*scs.subsession, continueAfterSETUP, False, REQUEST_STREAMING_OVER_TCP);
         }
         return;
     }
+    sendPlay();
+    return;
+}
+void ASRtspClient::setupAllSubsessions() {
+    /* the client holds the SETUPs after the first one and the PLAY until the session is known */
+    MediaSubsession* subsession;
+    while ((subsession = scs.iter->next()) != NULL) {
+        if (initSubsession(subsession)) {
+            sendSetupCommand(*subsession, continueAfterSETUP, False, REQUEST_STREAMING_OVER_TCP);
+        }
+    }
+    scs.iter->reset();
+    scs.subsession = NULL;
+    sendPlay();
+}
+MediaSubsession* ASRtspClient::nextSetupSubsession() {
+    /* the subsessions not initiated got no SETUP */
+    MediaSubsession* subsession;
+    while ((subsession = scs.iter->next()) != NULL) {
+        if (subsession->readSource() != NULL) {
+            break;
+        }
+    }
+    return subsession;
+}
+Boolean ASRtspClient::initSubsession(MediaSubsession* subsession) {
+    UsageEnvironment& env = envir(); // alias
+
+    if (!subsession->initiate()) {
+        return False;
+    }
+
+    if (subsession->rtpSource() != NULL) {
+        // Because we're saving the incoming data, rather than playing
+        // it in real time, allow an especially large time threshold
+        // (1 second) for reordering misordered incoming packets:
+        unsigned const thresh = 1000000; // 1 second
+        subsession->rtpSource()->setPacketReorderingThresholdTime(thresh);
+
+        // Set the RTP source's OS socket buffer size as appropriate - either if we were explicitly asked (using -B),
+        // or if the desired FileSink buffer size happens to be larger than the current OS socket buffer size.
+        // (The latter case is a heuristic, on the assumption that if the user asked for a large FileSink buffer size,
+        // then the input data rate may be large enough to justify increasing the OS socket buffer size also.)
+        int socketNum = subsession->rtpSource()->RTPgs()->socketNum();
+        unsigned curBufferSize = getReceiveBufferSize(env, socketNum);
+        unsigned ulRecvBufSize = ASRtspClientManager::instance().getRecvBufSize();
+        if (ulRecvBufSize > curBufferSize) {
+            (void)setReceiveBufferTo(env, socketNum, ulRecvBufSize);
+        }
+
+        // Read the packets of a wakeup in one batch, if we were asked to:
+        subsession->rtpSource()->setReceiveBatch(ASRtspClientManager::instance().getRecvBatch());
+    }
+    return True;
+}
+void ASRtspClient::sendPlay() {
     /* report the status */
     report_status(AS_RTSP_STATUS_SETUP);
     // We've finished setting up all of the subsessions.  Now, send a RTSP "PLAY" command to start the streaming:
@@ -282,37 +381,58 @@ void ASRtspClient::setupNextSubsession() {
     }
     else {
         scs.duration = scs.session->playEndTime() - scs.session->playStartTime();
+        m_pUpstream->m_dDuration = scs.duration;
         sendPlayCommand(*scs.session, continueAfterPLAY);
     }
+}
+Boolean ASRtspClient::redescribe(int resultCode) {
+    /* only an answer of the server says the SDP is stale,the client dropped it from the cache already */
+    if ((0 >= resultCode) || !describeWasCached() || m_bRedescribed) {
+        return False;
+    }
+    m_bRedescribed = True;
 
-    return;
+    closeFanout();
+    if (scs.session != NULL) {
+        Medium::close(scs.session);
+        scs.session = NULL;
+    }
+    delete scs.iter;
+    scs.iter = NULL;
+    scs.subsession = NULL;
+
+    resetForRedescribe();
+    sendDescribeCommand(continueAfterDESCRIBE);
+    return True;
 }
 void ASRtspClient::handleAfterSETUP(int resultCode, char* resultString)
 {
     if (0 != resultCode) {
+        delete[] resultString;
+        if (redescribe(resultCode)) {
+            return;
+        }
         destory();
         return;
     }
+    if (m_bFastStart) {
+        /* the answers come in the order of the SETUPs */
+        scs.subsession = nextSetupSubsession();
+    }
     do {
-        UsageEnvironment& env = envir(); // alias
-
-        if (resultCode != 0) {
+        if ((resultCode != 0) || (scs.subsession == NULL)) {
             break;
         }
 
         // Having successfully setup the subsession, create a data sink for it, and call "startPlaying()" on it.
         // (This will prepare the data sink to receive data; the actual flow of data from the client won't start happening until later,
         // after we've sent a RTSP "PLAY" command.)
-
-        scs.subsession->sink = ASStreamSink::createNew(env, *scs.subsession, url(), get_cb());
-        // perhaps use your own custom "MediaSink" subclass instead
-        if (scs.subsession->sink == NULL) {
-            break;
+        // The subsession is replicated,each consumer reads a replica of its own:
+        startFanout(scs.subsession);
+        CONSUMERLIST::iterator iter = m_ConsumerList.begin();
+        for (; iter != m_ConsumerList.end(); ++iter) {
+            attachConsumer(*iter, scs.subsession);
         }
-
-        scs.subsession->miscPtr = this; // a hack to let subsession handler functions get the "RTSPClient" from the subsession
-        scs.subsession->sink->startPlaying(*(scs.subsession->readSource()),
-            subsessionAfterPlaying, scs.subsession);
         // Also set a handler to be called if a RTCP "BYE" arrives for this subsession:
         if (scs.subsession->rtcpInstance() != NULL) {
             scs.subsession->rtcpInstance()->setByeHandler(subsessionByeHandler, scs.subsession);
@@ -321,12 +441,18 @@ void ASRtspClient::handleAfterSETUP(int resultCode, char* resultString)
     delete[] resultString;
 
     // Set up the next subsession, if any:
-    setupNextSubsession();
+    if (!m_bFastStart) {
+        setupNextSubsession();
+    }
 }
 void ASRtspClient::handleAfterPLAY(int resultCode, char* resultString)
 {
     Boolean success = False;
     if (0 != resultCode) {
+        delete[] resultString;
+        if (redescribe(resultCode)) {
+            return;
+        }
         destory();
         return;
     }
@@ -394,21 +520,13 @@ void ASRtspClient::handleAfterTeardown(int resultCode, char* resultString)
 
 void ASRtspClient::handlesubsessionAfterPlaying(MediaSubsession* subsession)
 {
-    // Begin by closing this subsession's stream:
-    Medium::close(subsession->sink);
-    subsession->sink = NULL;
-
-    // Next, check whether *all* subsessions' streams have now been closed:
-    MediaSession& session = subsession->parentSession();
-    MediaSubsessionIterator iter(session);
-    while ((subsession = iter.next()) != NULL) {
-        if (subsession->sink != NULL) return; // this subsession is still active
-    }
-
-    // All subsessions' streams have now been closed, so shutdown the client:
-    destory();
+    closeSubsession(subsession);
 }
 void ASRtspClient::handlesubsessionByeHandler(MediaSubsession* subsession)
+{
+    closeSubsession(subsession);
+}
+void ASRtspClient::closeSubsession(MediaSubsession* subsession)
 {
     // Begin by closing this subsession's stream:
     Medium::close(subsession->sink);
@@ -421,25 +539,11 @@ void ASRtspClient::handlesubsessionByeHandler(MediaSubsession* subsession)
         if (subsession->sink != NULL) return; // this subsession is still active
     }
 
-    // All subsessions' streams have now been closed, so shutdown the client:
-    destory();
-}
-void ASRtspClient::handlestreamTimerHandler(MediaSubsession* subsession)
-{
-    scs.streamTimerTask = NULL;
-
-    // Shut down the stream:
-    if((!m_bRunning)||(0 >= m_ulRefCount)) {
-        shutdownStream();
-        return;
+    /* the replicator may be signalling the closure,shutdown the client out of its call */
+    if (NULL == m_shutdownTask) {
+        m_shutdownTask = envir().taskScheduler().scheduleDelayedTask(0, shutdownHandler, this);
     }
-
-    unsigned uSecsToDelay = (unsigned)(RTSP_CLIENT_TIME*1000);
-    scs.streamTimerTask
-       = envir().taskScheduler().scheduleDelayedTask(uSecsToDelay,
-                                                 (TaskFunc*)streamTimerHandler, this);
 }
-
 // Implementation of the RTSP 'response handlers':
 void ASRtspClient::continueAfterOPTIONS(RTSPClient* rtspClient, int resultCode, char* resultString) {
 
@@ -498,6 +602,12 @@ void ASRtspClient::subsessionAfterPlaying(void* clientData) {
     pAsRtspClient->handlesubsessionAfterPlaying(subsession);
 }
 
+void ASRtspClient::shutdownHandler(void* clientData) {
+    ASRtspClient* pAsRtspClient = (ASRtspClient*)clientData;
+    pAsRtspClient->m_shutdownTask = NULL;
+    pAsRtspClient->destory();
+}
+
 void ASRtspClient::subsessionByeHandler(void* clientData) {
     MediaSubsession* subsession = (MediaSubsession*)clientData;
     RTSPClient* rtspClient = (RTSPClient*)subsession->miscPtr;
@@ -507,23 +617,8 @@ void ASRtspClient::subsessionByeHandler(void* clientData) {
     pAsRtspClient->handlesubsessionByeHandler(subsession);
 }
 
-void ASRtspClient::streamTimerHandler(void* clientData) {
-    MediaSubsession* subsession = (MediaSubsession*)clientData;
-    RTSPClient* rtspClient = (RTSPClient*)subsession->miscPtr;
-    ASRtspClient* pAsRtspClient = (ASRtspClient*)rtspClient;
-    pAsRtspClient->handlestreamTimerHandler(subsession);
-}
-
 void ASRtspClient::shutdownStream() {
-    UsageEnvironment& env = envir(); // alias
-    if (0 < m_ulRefCount) {
-        return;
-    }
-
-    if(NULL != scs.streamTimerTask) {
-        envir().taskScheduler().unscheduleDelayedTask(scs.streamTimerTask);
-        scs.streamTimerTask = NULL;
-    }
+    envir().taskScheduler().unscheduleDelayedTask(m_shutdownTask);
 
     // First, check whether any subsessions have still to be closed:
     if (scs.session != NULL) {
@@ -533,14 +628,13 @@ void ASRtspClient::shutdownStream() {
 
         while ((subsession = iter.next()) != NULL) {
             if (subsession->sink != NULL) {
-                Medium::close(subsession->sink);
-                subsession->sink = NULL;
                 if (subsession->rtcpInstance() != NULL) {
                     subsession->rtcpInstance()->setByeHandler(NULL, NULL); // in case the server sends a RTCP "BYE" while handling "TEARDOWN"
                 }
                 someSubsessionsWereActive = True;
             }
         }
+        closeFanout();
 
         if (someSubsessionsWereActive) {
             // Send a RTSP "TEARDOWN" command, to tell the server to shutdown the stream.
@@ -550,12 +644,14 @@ void ASRtspClient::shutdownStream() {
     }
 
     /* report the status */
-    if (m_bRunning) {
-        report_status(AS_RTSP_STATUS_TEARDOWN);
-    }
+    report_status(AS_RTSP_STATUS_TEARDOWN);
+    m_ConsumerList.clear();
+
+    /* the consumers left stay on the upstream until they are closed,a new open pulls the url again */
+    m_pUpstream->m_pClient = NULL;
+    ASRtspClientManager::instance().detachUpstream(m_pUpstream);
 
-    /* not close here ,it will be closed by the close URL */
-    Medium::close(this);            //Modified by Chris@201712011000;
+    Medium::close(this);
     // Note that this will also cause this stream's "ASRtspStreamState" structure to get reclaimed.
 }
 
@@ -563,51 +659,15 @@ void ASRtspClient::shutdownStream() {
 // Implementation of "ASRtspStreamState":
 
 ASRtspStreamState::ASRtspStreamState()
-  : iter(NULL), session(NULL), subsession(NULL), streamTimerTask(NULL), duration(0.0) {
+  : iter(NULL), session(NULL), subsession(NULL), duration(0.0) {
 }
 
 ASRtspStreamState::~ASRtspStreamState() {
   delete iter;
   if (session != NULL) {
-    // We also need to delete "session", and unschedule "streamTimerTask" (if set)
-    UsageEnvironment& env = session->envir(); // alias
-
-    env.taskScheduler().unscheduleDelayedTask(streamTimerTask);
     Medium::close(session);
   }
 }
-void ASRtspStreamState::Start()
-{
-    if (session != NULL) {
-        MediaSubsessionIterator iter(*session);
-        MediaSubsession* subsession;
-        ASStreamSink* sink = NULL;
-        while ((subsession = iter.next()) != NULL) {
-            if (subsession->sink != NULL) {
-                sink = (ASStreamSink*)subsession->sink;
-                if (sink != NULL) {
-                    sink->Start();
-                }
-            }
-        }
-    }
-}
-void ASRtspStreamState::Stop()
-{
-    if (session != NULL) {
-        MediaSubsessionIterator iter(*session);
-        MediaSubsession* subsession;
-        ASStreamSink* sink = NULL;
-        while ((subsession = iter.next()) != NULL) {
-            if (subsession->sink != NULL) {
-                sink = (ASStreamSink*)subsession->sink;
-                if (sink != NULL) {
-                    sink->Stop();
-                }
-            }
-        }
-    }
-}
 
 
 
@@ -649,13 +709,17 @@ ASStreamSink::ASStreamSink(UsageEnvironment& env, MediaSubsession& subsession,
     m_MediaInfo.videoFPS =fSubsession.videoFPS();
     m_MediaInfo.numChannels =fSubsession.numChannels();
 
+    m_pReplica = NULL;
     m_bRunning = true;
 
 }
 
 ASStreamSink::~ASStreamSink() {
+    stopPlaying();
+    Medium::close(m_pReplica);
+    m_pReplica = NULL;
     fReceiveBuffer = NULL;
-    if(NULL == fStreamId) {
+    if(NULL != fStreamId) {
         delete[] fStreamId;
         fStreamId = NULL;
     }
@@ -669,11 +733,25 @@ void ASStreamSink::afterGettingFrame(void* clientData, unsigned frameSize, unsig
 
 void ASStreamSink::afterGettingFrame(unsigned frameSize, unsigned numTruncatedBytes,
                   struct timeval presentationTime, unsigned /*durationInMicroseconds*/) {
+    deliverFrame(NULL, frameSize, presentationTime);
+    // Then continue, to request the next frame of data:
+    continuePlaying();
+}
+
+void ASStreamSink::deliverFrame(u_int8_t const* frame, unsigned frameSize, struct timeval presentationTime) {
 
     if(!m_bRunning) {
         return;
     }
 
+    /* a cached frame is copied behind the start code,a received one is there already */
+    if(NULL != frame) {
+        if(frameSize > DUMMY_SINK_RECEIVE_BUFFER_SIZE) {
+            frameSize = DUMMY_SINK_RECEIVE_BUFFER_SIZE;
+        }
+        memcpy(fReceiveBuffer, frame, frameSize);
+    }
+
     m_MediaInfo.rtpPayloadFormat = fSubsession.rtpPayloadFormat();
     m_MediaInfo.rtpTimestampFrequency = fSubsession.rtpTimestampFrequency();
     m_MediaInfo.presentationTime = presentationTime;
@@ -690,8 +768,6 @@ void ASStreamSink::afterGettingFrame(unsigned frameSize, unsigned numTruncatedBy
             m_cb->f_data_cb(&m_MediaInfo,(char*)&fMediaBuffer[0],size,m_cb->ctx);
         }
     }
-    // Then continue, to request the next frame of data:
-    continuePlaying();
 }
 
 Boolean ASStreamSink::continuePlaying() {
@@ -714,11 +790,197 @@ void ASStreamSink::Stop()
 }
 
 
+// Implementation of "ASGopCacheSink":
+
+ASGopCacheSink* ASGopCacheSink::createNew(UsageEnvironment& env, MediaSubsession& subsession, FramedSource* replica) {
+  return new ASGopCacheSink(env, subsession, replica);
+}
+
+ASGopCacheSink::ASGopCacheSink(UsageEnvironment& env, MediaSubsession& subsession, FramedSource* replica)
+  : MediaSink(env) {
+    m_pReplica  = replica;
+    m_bH264     = False;
+    m_bH265     = False;
+    m_bGopValid = False;
+    m_ulGopSize = 0;
+    memset(m_ParamSets, 0, sizeof(m_ParamSets));
+
+    if (strcmp(subsession.mediumName(), "video")) {
+        return;
+    }
+    m_bH264 = (0 == strcmp(subsession.codecName(), "H264"));
+    m_bH265 = (0 == strcmp(subsession.codecName(), "H265"));
+
+    /* the parameter sets of the SDP,an in-band one replaces them */
+    struct timeval presentationTime = {0, 0};
+    char const* sProps[AS_GOP_PARAM_SET_MAX] = {NULL, NULL, NULL};
+    if (m_bH264) {
+        sProps[1] = subsession.fmtp_spropparametersets();
+    }
+    else if (m_bH265) {
+        sProps[0] = subsession.fmtp_spropvps();
+        sProps[1] = subsession.fmtp_spropsps();
+        sProps[2] = subsession.fmtp_sproppps();
+    }
+    for (u_int32_t i = 0; i < AS_GOP_PARAM_SET_MAX; i++) {
+        if (NULL == sProps[i]) {
+            continue;
+        }
+        unsigned numSPropRecords = 0;
+        SPropRecord* sPropRecords = parseSPropParameterSets(sProps[i], numSPropRecords);
+        for (unsigned j = 0; j < numSPropRecords; j++) {
+            addFrame(sPropRecords[j].sPropBytes, sPropRecords[j].sPropLength, presentationTime);
+        }
+        delete[] sPropRecords;
+    }
+}
+
+ASGopCacheSink::~ASGopCacheSink() {
+    clearGop();
+    for (u_int32_t i = 0; i < AS_GOP_PARAM_SET_MAX; i++) {
+        delete[] m_ParamSets[i].pData;
+        m_ParamSets[i].pData = NULL;
+    }
+    stopPlaying();
+    Medium::close(m_pReplica);
+    m_pReplica = NULL;
+}
+
+void ASGopCacheSink::replay(ASStreamSink* sink) {
+    for (u_int32_t i = 0; i < AS_GOP_PARAM_SET_MAX; i++) {
+        if (NULL != m_ParamSets[i].pData) {
+            sink->deliverFrame(m_ParamSets[i].pData, m_ParamSets[i].ulSize, m_ParamSets[i].presentationTime);
+        }
+    }
+    if (!m_bGopValid) {
+        return;
+    }
+    std::list<ASCachedFrame>::iterator iter = m_GopList.begin();
+    for (; iter != m_GopList.end(); ++iter) {
+        sink->deliverFrame(iter->pData, iter->ulSize, iter->presentationTime);
+    }
+}
+
+void ASGopCacheSink::afterGettingFrame(void* clientData, unsigned frameSize, unsigned numTruncatedBytes,
+                  struct timeval presentationTime, unsigned /*durationInMicroseconds*/) {
+    ASGopCacheSink* sink = (ASGopCacheSink*)clientData;
+    /* the frame is counted once for the loop,whatever the number of consumers */
+    as_env_pool::add_frame(frameSize);
+    sink->afterGettingFrame(frameSize, numTruncatedBytes, presentationTime);
+}
+
+void ASGopCacheSink::afterGettingFrame(unsigned frameSize, unsigned numTruncatedBytes,
+                  struct timeval presentationTime) {
+    if ((m_bH264 || m_bH265) && (0 < frameSize) && (0 == numTruncatedBytes)) {
+        addFrame(fReceiveBuffer, frameSize, presentationTime);
+    }
+    // Then continue, to request the next frame of data:
+    continuePlaying();
+}
+
+void ASGopCacheSink::setParamSet(u_int32_t index, u_int8_t const* nal, unsigned size, struct timeval presentationTime) {
+    ASCachedFrame& paramSet = m_ParamSets[index];
+    if ((NULL != paramSet.pData) && (paramSet.ulSize == size)
+        && (0 == memcmp(paramSet.pData, nal, size))) {
+        return;
+    }
+    delete[] paramSet.pData;
+    paramSet.pData = new u_int8_t[size];
+    memcpy(paramSet.pData, nal, size);
+    paramSet.ulSize = size;
+    paramSet.presentationTime = presentationTime;
+}
+
+void ASGopCacheSink::addFrame(u_int8_t const* nal, unsigned size, struct timeval presentationTime) {
+    if (0 == size) {
+        return;
+    }
+
+    int32_t paramIndex = -1;
+    Boolean bKeyFrame = False;
+    if (m_bH264) {
+        u_int8_t nalType = nal[0] & 0x1F;
+        if (7 == nalType) {
+            paramIndex = 1;
+        }
+        else if (8 == nalType) {
+            paramIndex = 2;
+        }
+        bKeyFrame = (5 == nalType);
+    }
+    else {
+        u_int8_t nalType = (nal[0] >> 1) & 0x3F;
+        if ((32 <= nalType) && (34 >= nalType)) {
+            paramIndex = nalType - 32;
+        }
+        bKeyFrame = ((16 <= nalType) && (21 >= nalType));
+    }
+
+    if (0 <= paramIndex) {
+        setParamSet((u_int32_t)paramIndex, nal, size, presentationTime);
+        return;
+    }
+
+    /* the slices of a key frame start a new GOP,a lost one leaves the cache empty till the next */
+    if (bKeyFrame) {
+        if (m_bGopValid && !m_GopList.empty()) {
+            ASCachedFrame& last = m_GopList.back();
+            u_int8_t lastType = m_bH264 ? (last.pData[0] & 0x1F) : ((last.pData[0] >> 1) & 0x3F);
+            Boolean bLastKey = m_bH264 ? (5 == lastType) : ((16 <= lastType) && (21 >= lastType));
+            if (!bLastKey || (last.presentationTime.tv_sec != presentationTime.tv_sec)
+                || (last.presentationTime.tv_usec != presentationTime.tv_usec)) {
+                clearGop();
+            }
+        }
+        else {
+            clearGop();
+        }
+        m_bGopValid = True;
+    }
+    if (!m_bGopValid) {
+        return;
+    }
+    if (AS_GOP_CACHE_MAX_SIZE < m_ulGopSize + size) {
+        clearGop();
+        m_bGopValid = False;
+        return;
+    }
+
+    ASCachedFrame frame;
+    frame.pData = new u_int8_t[size];
+    memcpy(frame.pData, nal, size);
+    frame.ulSize = size;
+    frame.presentationTime = presentationTime;
+    m_GopList.push_back(frame);
+    m_ulGopSize += size;
+}
+
+void ASGopCacheSink::clearGop() {
+    std::list<ASCachedFrame>::iterator iter = m_GopList.begin();
+    for (; iter != m_GopList.end(); ++iter) {
+        delete[] iter->pData;
+    }
+    m_GopList.clear();
+    m_ulGopSize = 0;
+}
+
+Boolean ASGopCacheSink::continuePlaying() {
+  if (fSource == NULL) return False; // sanity check (should not happen)
+
+  fSource->getNextFrame(fReceiveBuffer, DUMMY_SINK_RECEIVE_BUFFER_SIZE,
+                        afterGettingFrame, this,
+                        onSourceClosure, this);
+  return True;
+}
+
+
 ASRtspClientManager::ASRtspClientManager()
 {
-    m_ulTdIndex     = 0;
-    m_LoopWatchVar  = 0;
     m_ulRecvBufSize = RTSP_SOCKET_RECV_BUFFER_SIZE_DEFAULT;
+    m_ulRecvBatch   = 0;
+    m_ulFastStart   = 0;
+    m_ulDescribeCacheTTL = 0;
+    m_ulShareUpstream = 1;
     m_ulModel       = AS_RTSP_MODEL_MUTIL;
 }
 
@@ -729,8 +991,6 @@ ASRtspClientManager::~ASRtspClientManager()
 int32_t ASRtspClientManager::init(u_int32_t model)
 {
     m_ulModel = model;
-    // Begin by setting up our usage environment:
-    u_int32_t i = 0;
 
     m_mutex = as_create_mutex();
     if(NULL == m_mutex) {
@@ -738,17 +998,9 @@ int32_t ASRtspClientManager::init(u_int32_t model)
     }
 
     if(AS_RTSP_MODEL_MUTIL == m_ulModel) {
-        for(i = 0;i < RTSP_MANAGE_ENV_MAX_COUNT;i++) {
-            m_envArray[i] = NULL;
-            m_clCountArray[i] = 0;
-        }
-        m_LoopWatchVar = 0;
-        for(i = 0;i < RTSP_MANAGE_ENV_MAX_COUNT;i++) {
-            if( AS_ERROR_CODE_OK != as_create_thread((AS_THREAD_FUNC)rtsp_env_invoke,
-                                                     this,&m_ThreadHandle[i],AS_DEFAULT_STACK_SIZE)) {
-                return -1;
-            }
-
+        /* the pool starts with AS_ENV_POOL_DEFAULT_COUNT loops,grows up to the number of cores */
+        if( AS_ERROR_CODE_OK != m_envPool.open()) {
+            return -1;
         }
     }
 
@@ -756,149 +1008,366 @@ int32_t ASRtspClientManager::init(u_int32_t model)
 }
 void    ASRtspClientManager::release()
 {
-    m_LoopWatchVar = 1;
+    if(AS_RTSP_MODEL_MUTIL == m_ulModel) {
+        /* the cached sdp holds the env,drop it before the env is reclaimed */
+        u_int32_t ulEnvCount = m_envPool.env_count();
+        for(u_int32_t i = 0; i < ulEnvCount; i++) {
+            (void)m_envPool.post(i,clear_describe_cache,NULL);
+        }
+        m_envPool.close();
+    }
     as_destroy_mutex(m_mutex);
     m_mutex = NULL;
 }
 
-void *ASRtspClientManager::rtsp_env_invoke(void *arg)
+u_int32_t ASRtspClientManager::find_beast_thread()
 {
-    ASRtspClientManager* manager = (ASRtspClientManager*)(void*)arg;
-    manager->rtsp_env_thread();
-    return NULL;
+    return m_envPool.alloc_env();
 }
-void ASRtspClientManager::rtsp_env_thread()
+
+void ASRtspClientManager::clear_describe_cache(UsageEnvironment& env,void* pArg)
 {
-    u_int32_t index = thread_index();
+    RTSPClient::invalidateDescribeCache(env);
+}
 
-    TaskScheduler* scheduler = NULL;
-    UsageEnvironment* env = NULL;
 
 
-    if(RTSP_MANAGE_ENV_MAX_COUNT <= index) {
-        return;
+std::string ASRtspClientManager::normalize_url(char const* rtspURL)
+{
+    /* the scheme and the host are not case sensitive,the default port and a trailing '/' say nothing */
+    std::string strUrl = rtspURL;
+    std::string::size_type ulHostStart = strUrl.find("://");
+    if (std::string::npos == ulHostStart) {
+        return strUrl;
+    }
+    for (std::string::size_type i = 0; i < ulHostStart; i++) {
+        strUrl[i] = (char)tolower((unsigned char)strUrl[i]);
     }
-    scheduler = BasicTaskScheduler::createNew();
-    env = BasicUsageEnvironment::createNew(*scheduler);
-    m_envArray[index] = env;
-    m_clCountArray[index] = 0;
+    ulHostStart += 3;
 
+    std::string::size_type ulHostEnd = strUrl.find('/', ulHostStart);
+    if (std::string::npos == ulHostEnd) {
+        ulHostEnd = strUrl.length();
+    }
+    /* the user and the password stay as they are */
+    std::string::size_type ulAt = strUrl.rfind('@', ulHostEnd);
+    if ((std::string::npos != ulAt) && (ulAt >= ulHostStart)) {
+        ulHostStart = ulAt + 1;
+    }
+    for (std::string::size_type i = ulHostStart; i < ulHostEnd; i++) {
+        strUrl[i] = (char)tolower((unsigned char)strUrl[i]);
+    }
 
-    // All subsequent activity takes place within the event loop:
-    env->taskScheduler().doEventLoop(&m_LoopWatchVar);
+    char szDefaultPort[16] = {0};
+    snprintf(szDefaultPort, sizeof(szDefaultPort), ":%d", RTSP_DEFAULT_PORT);
+    std::string::size_type ulPortLen = strlen(szDefaultPort);
+    if ((ulHostEnd - ulHostStart > ulPortLen)
+        && (0 == strUrl.compare(ulHostEnd - ulPortLen, ulPortLen, szDefaultPort))) {
+        strUrl.erase(ulHostEnd - ulPortLen, ulPortLen);
+        ulHostEnd -= ulPortLen;
+    }
 
-    // LOOP EXIST
-    env->reclaim();
-    env = NULL;
-    delete scheduler;
-    scheduler = NULL;
-    m_envArray[index] = NULL;
-    m_clCountArray[index] = 0;
-    return;
+    while ((strUrl.length() > ulHostEnd + 1) && ('/' == strUrl[strUrl.length() - 1])) {
+        strUrl.erase(strUrl.length() - 1);
+    }
+    if (strUrl.length() == ulHostEnd + 1) {
+        strUrl.erase(ulHostEnd);
+    }
+    return strUrl;
 }
 
-u_int32_t ASRtspClientManager::find_beast_thread()
+int32_t ASRtspClientManager::post_cmd(ASRtspUpstream* pUpstream,ASRtspCmd* pCmd)
 {
-
-    u_int32_t index = 0;
-    u_int32_t count = 0xFFFFFFFF;
-    for(u_int32_t i = 0; i < RTSP_MANAGE_ENV_MAX_COUNT;i++) {
-        if(count > m_clCountArray[i]) {
-            index = i;
-            count = m_clCountArray[i];
-        }
+    if(AS_RTSP_MODEL_MUTIL == m_ulModel) {
+        return m_envPool.post(pUpstream->m_ulEnvIndex,run_cmd,pCmd,free_cmd);
     }
 
-    return index;
+    /* the single model has no loop running yet,the caller's thread is the env thread */
+    run_cmd(*pUpstream->m_pEnv,pCmd);
+    return AS_ERROR_CODE_OK;
 }
 
+void ASRtspClientManager::run_cmd(UsageEnvironment& env,void* pArg)
+{
+    ASRtspCmd* pCmd = (ASRtspCmd*)pArg;
+    ASRtspConsumer* pConsumer = pCmd->pConsumer;
+    ASRtspUpstream* pUpstream = pConsumer->m_pUpstream;
+
+    switch (pCmd->enCmd) {
+        case AS_RTSP_CMD_JOIN:
+            if ((NULL == pUpstream->m_pClient) && !pUpstream->m_bStarted) {
+                pUpstream->m_bStarted = true;
+                pUpstream->m_pClient = ASRtspClient::createNew(pUpstream, env, pUpstream->m_strUrl.c_str(),
+                                                               RTSP_CLIENT_VERBOSITY_LEVEL, RTSP_AGENT_NAME);
+                if (NULL != pUpstream->m_pClient) {
+                    pUpstream->m_pClient->open();
+                }
+            }
+            if (NULL != pUpstream->m_pClient) {
+                pUpstream->m_pClient->addConsumer(pConsumer);
+            }
+            else if ((NULL != pConsumer->m_cb) && (NULL != pConsumer->m_cb->f_status_cb)) {
+                /* the upstream ended before this consumer joined */
+                pConsumer->m_cb->f_status_cb((AS_HANDLE)pConsumer, AS_RTSP_STATUS_TEARDOWN, pConsumer->m_cb->ctx);
+            }
+            break;
+        case AS_RTSP_CMD_LEAVE:
+            if (NULL != pUpstream->m_pClient) {
+                pUpstream->m_pClient->removeConsumer(pConsumer);
+            }
+            delete pConsumer;
+            if (pCmd->bLast) {
+                if (NULL != pUpstream->m_pClient) {
+                    pUpstream->m_pClient->shutdownStream();
+                }
+                if (ASRtspClientManager::instance().m_ulModel == AS_RTSP_MODEL_MUTIL) {
+                    ASRtspClientManager::instance().m_envPool.release_env(pUpstream->m_ulEnvIndex);
+                }
+                delete pUpstream;
+            }
+            break;
+        case AS_RTSP_CMD_SEEK:
+            if (pCmd->bOwner && (NULL != pUpstream->m_pClient)) {
+                pUpstream->m_pClient->seek(pCmd->dStart);
+            }
+            break;
+        case AS_RTSP_CMD_PAUSE:
+            if (pCmd->bOwner && (NULL != pUpstream->m_pClient)) {
+                pUpstream->m_pClient->pause();
+            }
+            break;
+        case AS_RTSP_CMD_PLAY:
+            if (pCmd->bOwner && (NULL != pUpstream->m_pClient)) {
+                pUpstream->m_pClient->play();
+            }
+            break;
+        default:
+            break;
+    }
+    delete pCmd;
+}
 
+void ASRtspClientManager::free_cmd(void* pArg)
+{
+    ASRtspCmd* pCmd = (ASRtspCmd*)pArg;
+    delete pCmd;
+}
 
 AS_HANDLE ASRtspClientManager::openURL(char const* rtspURL,as_rtsp_callback_t* cb) {
 
-    as_lock_guard locker(m_mutex);
-    TaskScheduler* scheduler = NULL;
-    UsageEnvironment* env = NULL;
-    u_int32_t index =  0;
-    if(AS_RTSP_MODEL_MUTIL == m_ulModel) {
-        index = find_beast_thread();
-        env = m_envArray[index];
+    if (NULL == rtspURL) {
+        return NULL;
     }
-    else {
-        scheduler = BasicTaskScheduler::createNew();
-        env = BasicUsageEnvironment::createNew(*scheduler);
+
+    ASRtspUpstream* pUpstream = NULL;
+    ASRtspConsumer* pConsumer = NULL;
+    {
+        as_lock_guard locker(m_mutex);
+        std::string strKey = normalize_url(rtspURL);
+        bool bShare = (AS_RTSP_MODEL_MUTIL == m_ulModel) && (0 != m_ulShareUpstream);
+        if (bShare) {
+            UPSTREAMMAP::iterator iter = m_UpstreamMap.find(strKey);
+            if (iter != m_UpstreamMap.end()) {
+                pUpstream = iter->second;
+            }
+        }
+
+        if (NULL == pUpstream) {
+            pUpstream = new ASRtspUpstream();
+            pUpstream->m_strKey = strKey;
+            pUpstream->m_strUrl = rtspURL;
+            if (AS_RTSP_MODEL_MUTIL == m_ulModel) {
+                pUpstream->m_ulEnvIndex = find_beast_thread();
+                pUpstream->m_pEnv = m_envPool.get_env(pUpstream->m_ulEnvIndex);
+            }
+            else {
+                TaskScheduler* scheduler = BasicTaskScheduler::createNew();
+                pUpstream->m_pEnv = BasicUsageEnvironment::createNew(*scheduler);
+            }
+            if (NULL == pUpstream->m_pEnv) {
+                if (AS_RTSP_MODEL_MUTIL == m_ulModel) {
+                    m_envPool.release_env(pUpstream->m_ulEnvIndex);
+                }
+                delete pUpstream;
+                return NULL;
+            }
+            if (bShare) {
+                pUpstream->m_bRegistered = true;
+                m_UpstreamMap[strKey] = pUpstream;
+            }
+        }
+
+        pConsumer = new ASRtspConsumer(cb,pUpstream);
+        pUpstream->m_ulConsumers++;
     }
 
-    RTSPClient* rtspClient = ASRtspClient::createNew(index,*env, rtspURL, RTSP_CLIENT_VERBOSITY_LEVEL, RTSP_AGENT_NAME);
-    if (rtspClient == NULL) {
+    ASRtspCmd* pCmd = new ASRtspCmd();
+    pCmd->enCmd     = AS_RTSP_CMD_JOIN;
+    pCmd->pConsumer = pConsumer;
+    pCmd->bLast     = false;
+    pCmd->bOwner    = false;
+    pCmd->dStart    = 0.0;
+    if (AS_ERROR_CODE_OK != post_cmd(pUpstream,pCmd)) {
+        delete pCmd;
+        bool bLast = false;
+        bool bJoinPosted = false;
+        {
+            as_lock_guard locker(m_mutex);
+            pUpstream->m_ulConsumers--;
+            bLast = (0 == pUpstream->m_ulConsumers);
+            bJoinPosted = pUpstream->m_bJoinPosted;
+            if (bLast && pUpstream->m_bRegistered) {
+                m_UpstreamMap.erase(pUpstream->m_strKey);
+                pUpstream->m_bRegistered = false;
+            }
+        }
+        if (!bLast) {
+            /* this consumer never joined,the others keep the upstream */
+            delete pConsumer;
+            return NULL;
+        }
+        if (!bJoinPosted) {
+            /* no JOIN ever went to the env,the upstream has no client */
+            delete pConsumer;
+            m_envPool.release_env(pUpstream->m_ulEnvIndex);
+            delete pUpstream;
+            return NULL;
+        }
+
+        /* an earlier JOIN may have started the client,only the env can stop it */
+        pCmd = new ASRtspCmd();
+        pCmd->enCmd     = AS_RTSP_CMD_LEAVE;
+        pCmd->pConsumer = pConsumer;
+        pCmd->bLast     = true;
+        pCmd->bOwner    = false;
+        pCmd->dStart    = 0.0;
+        if (AS_ERROR_CODE_OK != post_cmd(pUpstream,pCmd)) {
+            /* the env may still hold the client,leak the upstream rather than free it under the env */
+            delete pCmd;
+            delete pConsumer;
+        }
         return NULL;
     }
-    if(AS_RTSP_MODEL_MUTIL == m_ulModel) {
-        m_clCountArray[index]++;
+    {
+        as_lock_guard locker(m_mutex);
+        pUpstream->m_bJoinPosted = true;
     }
-
-    ASRtspClient* AsRtspClient = (ASRtspClient*)rtspClient;
-
-    AsRtspClient->open(cb);
-    return (AS_HANDLE)AsRtspClient;
+    return (AS_HANDLE)pConsumer;
 }
 
 void      ASRtspClientManager::closeURL(AS_HANDLE handle)
 {
-    as_lock_guard locker(m_mutex);
-    TaskScheduler* scheduler = NULL;
-    UsageEnvironment* env = NULL;
-
-    ASRtspClient* pAsRtspClient = (ASRtspClient*)handle;
-    pAsRtspClient->close();
-    if(AS_RTSP_MODEL_MUTIL == m_ulModel) {
-       u_int32_t index = pAsRtspClient->index();
-       m_clCountArray[index]--;
+    ASRtspConsumer* pConsumer = (ASRtspConsumer*)handle;
+    if (NULL == pConsumer) {
+        return;
     }
-    else {
-        env = &pAsRtspClient->envir();
-        scheduler = &env->taskScheduler();
-        env->reclaim();
-        env = NULL;
-        delete scheduler;
-        scheduler = NULL;
+    ASRtspUpstream* pUpstream = pConsumer->m_pUpstream;
+    UsageEnvironment* env = pUpstream->m_pEnv;
+
+    ASRtspCmd* pCmd = new ASRtspCmd();
+    pCmd->enCmd     = AS_RTSP_CMD_LEAVE;
+    pCmd->pConsumer = pConsumer;
+    pCmd->bOwner    = false;
+    pCmd->dStart    = 0.0;
+    {
+        as_lock_guard locker(m_mutex);
+        pUpstream->m_ulConsumers--;
+        pCmd->bLast = (0 == pUpstream->m_ulConsumers);
+        if (pCmd->bLast && pUpstream->m_bRegistered) {
+            /* a new open of the url pulls it again,this upstream is going */
+            m_UpstreamMap.erase(pUpstream->m_strKey);
+            pUpstream->m_bRegistered = false;
+        }
+    }
+    /* the consumer and the upstream are freed by the env thread */
+    if ((AS_ERROR_CODE_OK != post_cmd(pUpstream,pCmd)) || (AS_RTSP_MODEL_MUTIL == m_ulModel)) {
+        return;
     }
+
+    TaskScheduler* scheduler = &env->taskScheduler();
+    RTSPClient::invalidateDescribeCache(*env);
+    env->reclaim();
+    env = NULL;
+    delete scheduler;
+    scheduler = NULL;
     return;
 }
 
+void ASRtspClientManager::detachUpstream(ASRtspUpstream* pUpstream)
+{
+    as_lock_guard locker(m_mutex);
+    if (pUpstream->m_bRegistered) {
+        m_UpstreamMap.erase(pUpstream->m_strKey);
+        pUpstream->m_bRegistered = false;
+    }
+}
+
 double ASRtspClientManager::getDuration(AS_HANDLE handle)
 {
-    ASRtspClient* pAsRtspClient = (ASRtspClient*)handle;
-    return pAsRtspClient->getDuration();
+    ASRtspConsumer* pConsumer = (ASRtspConsumer*)handle;
+    return pConsumer->m_pUpstream->m_dDuration;
 }
 void ASRtspClientManager::seek(AS_HANDLE handle,double start)
 {
-    ASRtspClient* pAsRtspClient = (ASRtspClient*)handle;
-    pAsRtspClient->seek(start);
+    ASRtspConsumer* pConsumer = (ASRtspConsumer*)handle;
+    ASRtspCmd* pCmd = new ASRtspCmd();
+    pCmd->enCmd     = AS_RTSP_CMD_SEEK;
+    pCmd->pConsumer = pConsumer;
+    pCmd->bLast     = false;
+    pCmd->dStart    = start;
+    {
+        /* a consumer sharing the upstream may not move it under the others */
+        as_lock_guard locker(m_mutex);
+        pCmd->bOwner = (1 == pConsumer->m_pUpstream->m_ulConsumers);
+    }
+    if (AS_ERROR_CODE_OK != post_cmd(pConsumer->m_pUpstream,pCmd)) {
+        delete pCmd;
+    }
     return;
 }
 void ASRtspClientManager::pause(AS_HANDLE handle)
 {
-    ASRtspClient* pAsRtspClient = (ASRtspClient*)handle;
-    pAsRtspClient->pause();
+    ASRtspConsumer* pConsumer = (ASRtspConsumer*)handle;
+    ASRtspCmd* pCmd = new ASRtspCmd();
+    pCmd->enCmd     = AS_RTSP_CMD_PAUSE;
+    pCmd->pConsumer = pConsumer;
+    pCmd->bLast     = false;
+    pCmd->dStart    = 0.0;
+    {
+        as_lock_guard locker(m_mutex);
+        pCmd->bOwner = (1 == pConsumer->m_pUpstream->m_ulConsumers);
+    }
+    if (AS_ERROR_CODE_OK != post_cmd(pConsumer->m_pUpstream,pCmd)) {
+        delete pCmd;
+    }
 }
 void ASRtspClientManager::play(AS_HANDLE handle)
 {
-    ASRtspClient* pAsRtspClient = (ASRtspClient*)handle;
-    pAsRtspClient->play();
+    ASRtspConsumer* pConsumer = (ASRtspConsumer*)handle;
+    ASRtspCmd* pCmd = new ASRtspCmd();
+    pCmd->enCmd     = AS_RTSP_CMD_PLAY;
+    pCmd->pConsumer = pConsumer;
+    pCmd->bLast     = false;
+    pCmd->dStart    = 0.0;
+    {
+        as_lock_guard locker(m_mutex);
+        pCmd->bOwner = (1 == pConsumer->m_pUpstream->m_ulConsumers);
+    }
+    if (AS_ERROR_CODE_OK != post_cmd(pConsumer->m_pUpstream,pCmd)) {
+        delete pCmd;
+    }
 }
 void ASRtspClientManager::run(AS_HANDLE handle,char* LoopWatchVar)
 {
-    TaskScheduler* scheduler = NULL;
     UsageEnvironment* env = NULL;
     if(AS_RTSP_MODEL_MUTIL == m_ulModel) {
         return;
     }
-    ASRtspClient* pAsRtspClient = (ASRtspClient*)handle;
-    if(NULL == pAsRtspClient) {
+    ASRtspConsumer* pConsumer = (ASRtspConsumer*)handle;
+    if(NULL == pConsumer) {
         return;
     }
-    env = &pAsRtspClient->envir();
+    env = pConsumer->m_pUpstream->m_pEnv;
     if(NULL == env) {
         return;
     }
@@ -914,6 +1383,38 @@ u_int32_t ASRtspClientManager::getRecvBufSize()
 {
     return m_ulRecvBufSize;
 }
+void ASRtspClientManager::setRecvBatch(u_int32_t ulBatch)
+{
+    m_ulRecvBatch = ulBatch;
+}
+u_int32_t ASRtspClientManager::getRecvBatch()
+{
+    return m_ulRecvBatch;
+}
+void ASRtspClientManager::setFastStart(u_int32_t ulFastStart)
+{
+    m_ulFastStart = ulFastStart;
+}
+u_int32_t ASRtspClientManager::getFastStart()
+{
+    return m_ulFastStart;
+}
+void ASRtspClientManager::setDescribeCacheTTL(u_int32_t ulTTL)
+{
+    m_ulDescribeCacheTTL = ulTTL;
+}
+u_int32_t ASRtspClientManager::getDescribeCacheTTL()
+{
+    return m_ulDescribeCacheTTL;
+}
+void ASRtspClientManager::setShareUpstream(u_int32_t ulShare)
+{
+    m_ulShareUpstream = ulShare;
+}
+u_int32_t ASRtspClientManager::getShareUpstream()
+{
+    return m_ulShareUpstream;
+}
 
 
 
@@ -6,6 +6,10 @@
 extern "C"{
 #include "as_common.h"
 }
+#include "as_env_pool.h"
+#include <list>
+#include <map>
+#include <string>
 //#ifndef _BASIC_USAGE_ENVIRONMENT0_HH
 //#include "BasicUsageEnvironment0.hh"
 //#endif
@@ -34,10 +38,18 @@ extern "C"{
 // If you don't want to see debugging output for each received frame, then comment out the following line:
 #define DEBUG_PRINT_EACH_RECEIVED_FRAME 1
 
-#define RTSP_MANAGE_ENV_MAX_COUNT       4
 #define RTSP_AGENT_NAME                 "all stream media"
 
-#define RTSP_CLIENT_TIME               5000
+#define RTSP_DEFAULT_PORT              554
+
+/* the last GOP kept for the late joiners is dropped above this size */
+#define AS_GOP_CACHE_MAX_SIZE          (4*1024*1024)
+/* VPS,SPS and PPS */
+#define AS_GOP_PARAM_SET_MAX           3
+
+class ASRtspConsumer;
+class ASRtspUpstream;
+class ASStreamSink;
 
 // Define a class to hold per-stream state that we maintain throughout each stream's lifetime:
 
@@ -46,14 +58,10 @@ public:
   ASRtspStreamState();
   virtual ~ASRtspStreamState();
 
-  void Start();
-  void Stop();
-
 public:
   MediaSubsessionIterator* iter;
   MediaSession* session;
   MediaSubsession* subsession;
-  TaskToken streamTimerTask;
   double duration;
 };
 
@@ -62,29 +70,34 @@ public:
 // showing how to play multiple streams, concurrently, we can't do that.  Instead, we have to have a separate "ASRtspStreamState"
 // structure for each "RTSPClient".  To do this, we subclass "RTSPClient", and add a "ASRtspStreamState" field to the subclass:
 
+/*
+ * the client of an upstream,it pulls the url once and hands each subsession
+ * to its consumers through a StreamReplicator.all its methods run on the
+ * thread of its env.
+ */
 class ASRtspClient: public RTSPClient {
 public:
-    static ASRtspClient* createNew(u_int32_t ulEnvIndex,UsageEnvironment& env, char const* rtspURL,
+    static ASRtspClient* createNew(ASRtspUpstream* pUpstream,UsageEnvironment& env, char const* rtspURL,
                   int verbosityLevel = 0,
                   char const* applicationName = NULL,
                   portNumBits tunnelOverHTTPPortNum = 0);
 protected:
-    ASRtspClient(u_int32_t ulEnvIndex,UsageEnvironment& env, char const* rtspURL,
+    ASRtspClient(ASRtspUpstream* pUpstream,UsageEnvironment& env, char const* rtspURL,
             int verbosityLevel, char const* applicationName, portNumBits tunnelOverHTTPPortNum);
     // called only by createNew();
     virtual ~ASRtspClient();
 public:
-    int32_t open(as_rtsp_callback_t* cb);
-    void    close();
-    double  getDuration();
+    int32_t open();
+    void    addConsumer(ASRtspConsumer* pConsumer);
+    void    removeConsumer(ASRtspConsumer* pConsumer);
     void    seek(double start);
     void    pause();
     void    play();
-    u_int32_t index(){return m_ulEnvIndex;};
     void    report_status(int status);
     void    SupportsGetParameter(Boolean bSupportsGetParameter) {m_bSupportsGetParameter = bSupportsGetParameter;};
     Boolean SupportsGetParameter(){return m_bSupportsGetParameter;};
-    as_rtsp_callback_t* get_cb(){return m_cb;};
+    // Used to shut down and close a stream (including its "RTSPClient" object):
+    void shutdownStream();
 public:
     void handleAfterOPTIONS(int resultCode, char* resultString);
     void handleAfterDESCRIBE(int resultCode, char* resultString);
@@ -98,14 +111,25 @@ public:
     // Other event handler functions:
     void handlesubsessionAfterPlaying(MediaSubsession* subsession); // called when a stream's subsession (e.g., audio or video substream) ends
     void handlesubsessionByeHandler(MediaSubsession* subsession); // called when a RTCP "BYE" is received for a subsession
-    void handlestreamTimerHandler(MediaSubsession* subsession);
 
     // Used to iterate through each stream's 'subsessions', setting up each one:
     void setupNextSubsession();
+    // Used to send the "SETUP"s of all the 'subsessions' and the "PLAY" at once:
+    void setupAllSubsessions();
 private:
+    MediaSubsession* nextSetupSubsession();
+    Boolean initSubsession(MediaSubsession* subsession);
+    void    sendPlay();
+    // Used to "DESCRIBE" again when the server refuses a cached SDP description:
+    Boolean redescribe(int resultCode);
     void    destory();
-    // Used to shut down and close a stream (including its "RTSPClient" object):
-    void shutdownStream();
+    // Used to hand a subsession that is set up to the consumers:
+    void    startFanout(MediaSubsession* subsession);
+    void    attachConsumer(ASRtspConsumer* pConsumer,MediaSubsession* subsession);
+    void    detachConsumer(ASRtspConsumer* pConsumer);
+    void    closeFanout();
+    // Used to close the stream of a subsession that ended,the client is shutdown with the last one:
+    void    closeSubsession(MediaSubsession* subsession);
 public:
     // RTSP 'response handlers':
     static void continueAfterOPTIONS(RTSPClient* rtspClient, int resultCode, char* resultString);
@@ -120,19 +144,22 @@ public:
     // Other event handler functions:
     static void subsessionAfterPlaying(void* clientData); // called when a stream's subsession (e.g., audio or video substream) ends
     static void subsessionByeHandler(void* clientData); // called when a RTCP "BYE" is received for a subsession
-    static void streamTimerHandler(void* clientData);
+    static void shutdownHandler(void* clientData);
 public:
     ASRtspStreamState   scs;
 private:
-    u_int32_t           m_ulEnvIndex;
-    as_rtsp_callback_t *m_cb;
+    typedef std::list<ASRtspConsumer*>                   CONSUMERLIST;
+    typedef std::map<MediaSubsession*,StreamReplicator*> REPLICATORMAP;
+    ASRtspUpstream     *m_pUpstream;
+    CONSUMERLIST        m_ConsumerList;
+    REPLICATORMAP       m_ReplicatorMap;
     Boolean             m_bSupportsGetParameter;
     double              m_dStarttime;
     double              m_dEndTime;
     int                 m_curStatus;
-    as_mutex_t         *m_mutex;
-    volatile int32_t    m_ulRefCount;
-    volatile bool       m_bRunning;
+    Boolean             m_bFastStart;
+    Boolean             m_bRedescribed;
+    TaskToken           m_shutdownTask;
 };
 
 // Define a data sink (a subclass of "MediaSink") to receive the data for each subsession (i.e., each audio or video 'substream').
@@ -149,6 +176,11 @@ public:
 
   void Start();
   void Stop();
+  MediaSubsession& subsession() {return fSubsession;}
+  // The replica of the subsession read by this sink,it is closed with the sink:
+  void setReplica(FramedSource* replica) {m_pReplica = replica;}
+  // Hands a cached frame to the callback,as if it was just received:
+  void deliverFrame(u_int8_t const* frame, unsigned frameSize, struct timeval presentationTime);
 
 private:
   ASStreamSink(UsageEnvironment& env, MediaSubsession& subsession, char const* streamId,as_rtsp_callback_t* cb);
@@ -175,10 +207,119 @@ private:
   char* fStreamId;
   as_rtsp_callback_t *m_cb;
   MediaFrameInfo      m_MediaInfo;
+  FramedSource       *m_pReplica;
 
   volatile bool m_bRunning;
 };
 
+typedef struct tagASCachedFrame
+{
+    u_int8_t       *pData;
+    u_int32_t       ulSize;
+    struct timeval  presentationTime;
+} ASCachedFrame;
+
+/*
+ * reads a replica of each subsession so that the upstream flows with no
+ * consumer.for the H.264/H.265 video it keeps the parameter sets(from the
+ * SDP,then in-band) and the frames since the last key frame,a late joiner
+ * gets them before the live frames and can decode at once.
+ */
+class ASGopCacheSink: public MediaSink {
+public:
+  static ASGopCacheSink* createNew(UsageEnvironment& env, MediaSubsession& subsession, FramedSource* replica);
+
+  // Hands the parameter sets and the last GOP to "sink":
+  void replay(ASStreamSink* sink);
+
+private:
+  ASGopCacheSink(UsageEnvironment& env, MediaSubsession& subsession, FramedSource* replica);
+    // called only by "createNew()"
+  virtual ~ASGopCacheSink();
+
+  static void afterGettingFrame(void* clientData, unsigned frameSize,
+                                unsigned numTruncatedBytes,
+                struct timeval presentationTime,
+                                unsigned durationInMicroseconds);
+  void afterGettingFrame(unsigned frameSize, unsigned numTruncatedBytes,
+             struct timeval presentationTime);
+  void setParamSet(u_int32_t index, u_int8_t const* nal, unsigned size, struct timeval presentationTime);
+  void addFrame(u_int8_t const* nal, unsigned size, struct timeval presentationTime);
+  void clearGop();
+
+private:
+  // redefined virtual functions:
+  virtual Boolean continuePlaying();
+
+private:
+  u_int8_t                 fReceiveBuffer[DUMMY_SINK_RECEIVE_BUFFER_SIZE];
+  FramedSource            *m_pReplica;
+  Boolean                  m_bH264;
+  Boolean                  m_bH265;
+  Boolean                  m_bGopValid;
+  ASCachedFrame            m_ParamSets[AS_GOP_PARAM_SET_MAX];
+  std::list<ASCachedFrame> m_GopList;
+  u_int32_t                m_ulGopSize;
+};
+
+/* an user handle of an upstream */
+class ASRtspConsumer
+{
+public:
+    ASRtspConsumer(as_rtsp_callback_t* cb,ASRtspUpstream* pUpstream)
+        : m_cb(cb),m_pUpstream(pUpstream) {};
+    virtual ~ASRtspConsumer() {};
+public:
+    as_rtsp_callback_t       *m_cb;
+    ASRtspUpstream           *m_pUpstream;
+    /* touched by the env thread only */
+    std::list<ASStreamSink*>  m_SinkList;
+};
+
+/* an url pulled once,shared by the consumers of the same normalized url */
+class ASRtspUpstream
+{
+public:
+    ASRtspUpstream()
+        : m_ulEnvIndex(0),m_pEnv(NULL),m_pClient(NULL),m_bStarted(false),
+          m_ulConsumers(0),m_bRegistered(false),m_bJoinPosted(false),m_dDuration(0.0) {};
+    virtual ~ASRtspUpstream() {};
+public:
+    std::string       m_strKey;
+    std::string       m_strUrl;
+    u_int32_t         m_ulEnvIndex;
+    UsageEnvironment *m_pEnv;
+    /* touched by the env thread only */
+    ASRtspClient     *m_pClient;
+    bool              m_bStarted;
+    /* touched under the mutex of the manager */
+    u_int32_t         m_ulConsumers;
+    bool              m_bRegistered;
+    /* a JOIN went to the env,its client may be running there */
+    bool              m_bJoinPosted;
+    volatile double   m_dDuration;
+};
+
+/* a command of a consumer,run on the env thread of its upstream */
+enum AS_RTSP_CMD {
+    AS_RTSP_CMD_JOIN   = 0,
+    AS_RTSP_CMD_LEAVE  = 1,
+    AS_RTSP_CMD_SEEK   = 2,
+    AS_RTSP_CMD_PAUSE  = 3,
+    AS_RTSP_CMD_PLAY   = 4,
+};
+
+typedef struct tagASRtspCmd
+{
+    AS_RTSP_CMD      enCmd;
+    ASRtspConsumer  *pConsumer;
+    /* the last consumer leaves,the upstream goes with it */
+    bool             bLast;
+    /* the control of a consumer which does not own the upstream is ignored */
+    bool             bOwner;
+    double           dStart;
+} ASRtspCmd;
+
 
 class ASRtspClientManager
 {
@@ -204,29 +345,35 @@ public:
     // option set function
     void      setRecvBufSize(u_int32_t ulSize);
     u_int32_t getRecvBufSize();
-public:
-    void rtsp_env_thread();
-
+    void      setRecvBatch(u_int32_t ulBatch);
+    u_int32_t getRecvBatch();
+    void      setFastStart(u_int32_t ulFastStart);
+    u_int32_t getFastStart();
+    void      setDescribeCacheTTL(u_int32_t ulTTL);
+    u_int32_t getDescribeCacheTTL();
+    void      setShareUpstream(u_int32_t ulShare);
+    u_int32_t getShareUpstream();
+    // called by the client when its upstream ends by itself:
+    void      detachUpstream(ASRtspUpstream* pUpstream);
 protected:
     ASRtspClientManager();
 private:
-    static void *rtsp_env_invoke(void *arg);
-    u_int32_t thread_index()
-    {
-        as_lock_guard locker(m_mutex);
-        u_int32_t index = m_ulTdIndex;
-        m_ulTdIndex++;
-        return index;
-    }
     u_int32_t find_beast_thread();
+    int32_t   post_cmd(ASRtspUpstream* pUpstream,ASRtspCmd* pCmd);
+    static void run_cmd(UsageEnvironment& env,void* pArg);
+    static void free_cmd(void* pArg);
+    static void clear_describe_cache(UsageEnvironment& env,void* pArg);
+    static std::string normalize_url(char const* rtspURL);
 private:
+    typedef std::map<std::string,ASRtspUpstream*> UPSTREAMMAP;
+    UPSTREAMMAP       m_UpstreamMap;
     u_int32_t         m_ulModel;
-    u_int32_t         m_ulTdIndex;
     as_mutex_t       *m_mutex;
-    char              m_LoopWatchVar;
-    as_thread_t      *m_ThreadHandle[RTSP_MANAGE_ENV_MAX_COUNT];
-    UsageEnvironment *m_envArray[RTSP_MANAGE_ENV_MAX_COUNT];
-    u_int32_t         m_clCountArray[RTSP_MANAGE_ENV_MAX_COUNT];
+    as_env_pool       m_envPool;
     u_int32_t         m_ulRecvBufSize;
+    u_int32_t         m_ulRecvBatch;
+    u_int32_t         m_ulFastStart;
+    u_int32_t         m_ulDescribeCacheTTL;
+    u_int32_t         m_ulShareUpstream;
 };
 #endif /* __AS_RTSP_CLIENT_MANAGE_H__ */
@@ -23,6 +23,46 @@ uint32_t as_lib_get_recv_buffer_size()
 {
     return ASRtspClientManager::instance().getRecvBufSize();
 }
+/* set the rtp packets read at once over udp */
+void      as_lib_set_recv_batch(uint32_t batch)
+{
+    ASRtspClientManager::instance().setRecvBatch(batch);
+}
+/* get the rtp packets read at once over udp */
+uint32_t as_lib_get_recv_batch()
+{
+    return ASRtspClientManager::instance().getRecvBatch();
+}
+/* skip the OPTIONS and send the SETUPs and the PLAY at once */
+void      as_lib_set_fast_start(uint32_t fast)
+{
+    ASRtspClientManager::instance().setFastStart(fast);
+}
+/* get whether the SETUPs and the PLAY are sent at once */
+uint32_t as_lib_get_fast_start()
+{
+    return ASRtspClientManager::instance().getFastStart();
+}
+/* set the seconds the SDP of a DESCRIBE is reused for the same url */
+void      as_lib_set_describe_cache_ttl(uint32_t ttl)
+{
+    ASRtspClientManager::instance().setDescribeCacheTTL(ttl);
+}
+/* get the seconds the SDP of a DESCRIBE is reused */
+uint32_t as_lib_get_describe_cache_ttl()
+{
+    return ASRtspClientManager::instance().getDescribeCacheTTL();
+}
+/* pull an url once for all its handles */
+void      as_lib_set_share_upstream(uint32_t share)
+{
+    ASRtspClientManager::instance().setShareUpstream(share);
+}
+/* get whether the handles of an url share one pull */
+uint32_t as_lib_get_share_upstream()
+{
+    return ASRtspClientManager::instance().getShareUpstream();
+}
 /* open a rtsp client handle */
 AS_HANDLE as_create_handle(char const* rtspURL,as_rtsp_callback_t* cb)
 {
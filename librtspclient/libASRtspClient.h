@@ -21,6 +21,22 @@ extern "C"
     AS_API void      as_lib_set_recv_buffer_size(uint32_t size);
     /* get the socket recv buffer size*/
     AS_API uint32_t  as_lib_get_recv_buffer_size();
+    /* set the rtp packets read at once over udp(recvmmsg),0:one by one */
+    AS_API void      as_lib_set_recv_batch(uint32_t batch);
+    /* get the rtp packets read at once over udp */
+    AS_API uint32_t  as_lib_get_recv_batch();
+    /* skip the OPTIONS and send the SETUPs and the PLAY at once,0:one by one */
+    AS_API void      as_lib_set_fast_start(uint32_t fast);
+    /* get whether the SETUPs and the PLAY are sent at once */
+    AS_API uint32_t  as_lib_get_fast_start();
+    /* set the seconds the SDP of a DESCRIBE is reused for the same url(fast start only),0:no cache */
+    AS_API void      as_lib_set_describe_cache_ttl(uint32_t ttl);
+    /* get the seconds the SDP of a DESCRIBE is reused */
+    AS_API uint32_t  as_lib_get_describe_cache_ttl();
+    /* pull an url once for all its handles(multi model only),seek/pause/continue act for the only handle,0:one pull per handle,1:default */
+    AS_API void      as_lib_set_share_upstream(uint32_t share);
+    /* get whether the handles of an url share one pull */
+    AS_API uint32_t  as_lib_get_share_upstream();
     /* open a rtsp client handle */
     AS_API AS_HANDLE as_create_handle(char const* rtspURL,as_rtsp_callback_t* cb);
     /* destory a rtsp client handle */
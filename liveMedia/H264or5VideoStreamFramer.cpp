@@ -22,6 +22,16 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "MPEGVideoStreamParser.hh"
 #include "BitVector.hh"
 
+// Define "NO_SIMD_NAL_SCANNING" to always scan for start codes and 'emulation prevention' bytes with a scalar loop:
+#if !defined(NO_SIMD_NAL_SCANNING) && defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define USE_SSE2_NAL_SCANNING 1
+#include <emmintrin.h>
+#if (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define USE_AVX2_NAL_SCANNING 1
+#include <immintrin.h>
+#endif
+#endif
+
 ////////// H264or5VideoStreamParser definition //////////
 
 class H264or5VideoStreamParser: public MPEGVideoStreamParser {
@@ -943,237 +953,335 @@ void H264or5VideoStreamParser::flushInput() {
 #define NUM_NEXT_SLICE_HEADER_BYTES_TO_ANALYZE 12
 
 unsigned H264or5VideoStreamParser::parse() {
-  try {
-    // The stream must start with a 0x00000001:
-    if (!fHaveSeenFirstStartCode) {
-      // Skip over any input bytes that precede the first 0x00000001:
-      u_int32_t first4Bytes;
-      while ((first4Bytes = test4Bytes()) != 0x00000001) {
-    get1Byte(); setParseState(); // ensures that we progress over bad data
+  // The stream must start with a 0x00000001:
+  if (!fHaveSeenFirstStartCode) {
+    // Skip over any input bytes that precede the first 0x00000001:
+    while (1) {
+      if (!requestBytes(4)) return 0; // we need more input data
+
+      u_int8_t const* from = bufferedBytes();
+      unsigned const numBytes = numBufferedBytes();
+      unsigned const startCode = findH264or5StartCode(from, numBytes);
+      if (startCode < numBytes && startCode > 0 && from[startCode-1] == 0) {
+        skipBufferedBytes(startCode+3); // skip this initial code
+        break;
       }
-      skipBytes(4); // skip this initial code
 
-      setParseState();
-      fHaveSeenFirstStartCode = True; // from now on
+      // Skip over the bad data, but keep the last 3 bytes, because a 0x00000001 might begin there:
+      skipBufferedBytes(startCode < numBytes ? startCode+1 : numBytes-3);
+      setParseState(); // ensures that we progress over bad data
     }
 
-    if (fOutputStartCodeSize > 0 && curFrameSize() == 0 && !haveSeenEOF()) {
-      // Include a start code in the output:
-      save4Bytes(0x00000001);
-    }
+    setParseState();
+    fHaveSeenFirstStartCode = True; // from now on
+  }
 
-    // Then save everything up until the next 0x00000001 (4 bytes) or 0x000001 (3 bytes), or we hit EOF.
-    // Also make note of the first byte, because it contains the "nal_unit_type":
-    if (haveSeenEOF()) {
-      // We hit EOF the last time that we tried to parse this data, so we know that any remaining unparsed data
-      // forms a complete NAL unit, and that there's no 'start code' at the end:
-      unsigned remainingDataSize = totNumValidBytes() - curOffset();
+  if (fOutputStartCodeSize > 0 && curFrameSize() == 0 && !haveSeenEOF()) {
+    // Include a start code in the output:
+    save4Bytes(0x00000001);
+  }
+
+  // Then save everything up until the next 0x00000001 (4 bytes) or 0x000001 (3 bytes), or we hit EOF.
+  // Also make note of the first byte, because it contains the "nal_unit_type":
+  if (haveSeenEOF()) {
+    // We hit EOF the last time that we tried to parse this data, so we know that any remaining unparsed data
+    // forms a complete NAL unit, and that there's no 'start code' at the end:
+    unsigned remainingDataSize = numBufferedBytes();
 #ifdef DEBUG
-      unsigned const trailingNALUnitSize = remainingDataSize;
+    unsigned const trailingNALUnitSize = remainingDataSize;
 #endif
-      while (remainingDataSize > 0) {
-    u_int8_t nextByte = get1Byte();
-    if (!fHaveSeenFirstByteOfNALUnit) {
-      fFirstByteOfNALUnit = nextByte;
-      fHaveSeenFirstByteOfNALUnit = True;
-    }
-    saveByte(nextByte);
-    --remainingDataSize;
+    if (remainingDataSize > 0) {
+      if (!fHaveSeenFirstByteOfNALUnit) {
+        fFirstByteOfNALUnit = bufferedBytes()[0];
+        fHaveSeenFirstByteOfNALUnit = True;
       }
+      saveBytes(bufferedBytes(), remainingDataSize);
+      skipBufferedBytes(remainingDataSize);
+    }
 
 #ifdef DEBUG
-      if (fHNumber == 264) {
-    u_int8_t nal_ref_idc = (fFirstByteOfNALUnit&0x60)>>5;
-    u_int8_t nal_unit_type = fFirstByteOfNALUnit&0x1F;
-    fprintf(stderr, "Parsed trailing %d-byte NAL-unit (nal_ref_idc: %d, nal_unit_type: %d (\"%s\"))\n",
-        trailingNALUnitSize, nal_ref_idc, nal_unit_type, nal_unit_type_description_h264[nal_unit_type]);
-      } else { // 265
-    u_int8_t nal_unit_type = (fFirstByteOfNALUnit&0x7E)>>1;
-    fprintf(stderr, "Parsed trailing %d-byte NAL-unit (nal_unit_type: %d (\"%s\"))\n",
-        trailingNALUnitSize, nal_unit_type, nal_unit_type_description_h265[nal_unit_type]);
-      }
+    if (fHNumber == 264) {
+      u_int8_t nal_ref_idc = (fFirstByteOfNALUnit&0x60)>>5;
+      u_int8_t nal_unit_type = fFirstByteOfNALUnit&0x1F;
+      fprintf(stderr, "Parsed trailing %d-byte NAL-unit (nal_ref_idc: %d, nal_unit_type: %d (\"%s\"))\n",
+              trailingNALUnitSize, nal_ref_idc, nal_unit_type, nal_unit_type_description_h264[nal_unit_type]);
+    } else { // 265
+      u_int8_t nal_unit_type = (fFirstByteOfNALUnit&0x7E)>>1;
+      fprintf(stderr, "Parsed trailing %d-byte NAL-unit (nal_unit_type: %d (\"%s\"))\n",
+              trailingNALUnitSize, nal_unit_type, nal_unit_type_description_h265[nal_unit_type]);
+    }
 #endif
 
-      (void)get1Byte(); // forces another read, which will cause EOF to get handled for real this time
-      return 0;
-    } else {
-      u_int32_t next4Bytes = test4Bytes();
-      if (!fHaveSeenFirstByteOfNALUnit) {
-    fFirstByteOfNALUnit = next4Bytes>>24;
-    fHaveSeenFirstByteOfNALUnit = True;
+    (void)requestBytes(1); // forces another read, which will cause EOF to get handled for real this time
+    return 0;
+  } else {
+    // Scan the buffered data for the next start code, saving the data that precedes it.  The NAL unit may be
+    // larger than what's buffered, so we save it piece by piece, and never keep more than a few bytes of parser state:
+    while (1) {
+      u_int8_t const* from = bufferedBytes();
+      unsigned const numBytes = numBufferedBytes();
+      if (!fHaveSeenFirstByteOfNALUnit && numBytes > 0) {
+        fFirstByteOfNALUnit = from[0];
+        fHaveSeenFirstByteOfNALUnit = True;
       }
-      while (next4Bytes != 0x00000001 && (next4Bytes&0xFFFFFF00) != 0x00000100) {
-    // We save at least some of "next4Bytes".
-    if ((unsigned)(next4Bytes&0xFF) > 1) {
-      // Common case: 0x00000001 or 0x000001 definitely doesn't begin anywhere in "next4Bytes", so we save all of it:
-      save4Bytes(next4Bytes);
-      skipBytes(4);
-    } else {
-      // Save the first byte, and continue testing the rest:
-      saveByte(next4Bytes>>24);
-      skipBytes(1);
-    }
-    setParseState(); // ensures forward progress
-    next4Bytes = test4Bytes();
+
+      unsigned startCode = findH264or5StartCode(from, numBytes);
+      if (startCode < numBytes) {
+        unsigned startCodeSize = 3;
+        if (startCode > 0 && from[startCode-1] == 0) { // it's a 0x00000001
+          --startCode;
+          startCodeSize = 4;
+        }
+        saveBytes(from, startCode);
+        skipBufferedBytes(startCode);
+        setParseState(); // ensures forward progress
+
+        // We may need to look at the first bytes of the next NAL unit (below), so make sure that we have them:
+        if (!requestBytes(startCodeSize + 3)) return 0;
+
+        // Assert: We've saved all bytes before the start code (forming a complete NAL unit).
+        // Skip over the start code, up until the start of the next NAL unit:
+        skipBufferedBytes(startCodeSize);
+        break;
       }
-      // Assert: next4Bytes starts with 0x00000001 or 0x000001, and we've saved all previous bytes (forming a complete NAL unit).
-      // Skip over these remaining bytes, up until the start of the next NAL unit:
-      if (next4Bytes == 0x00000001) {
-    skipBytes(4);
-      } else {
-    skipBytes(3);
+
+      // There's no start code here.  Save all but the last 3 bytes, because a start code might begin there:
+      if (numBytes > 3) {
+        saveBytes(from, numBytes-3);
+        skipBufferedBytes(numBytes-3);
+        setParseState(); // ensures forward progress
       }
+      if (!requestBytes(4)) return 0; // we need more input data
     }
+  }
 
-    fHaveSeenFirstByteOfNALUnit = False; // for the next NAL unit that we'll parse
-    u_int8_t nal_unit_type;
-    if (fHNumber == 264) {
-      nal_unit_type = fFirstByteOfNALUnit&0x1F;
+  fHaveSeenFirstByteOfNALUnit = False; // for the next NAL unit that we'll parse
+  u_int8_t nal_unit_type;
+  if (fHNumber == 264) {
+    nal_unit_type = fFirstByteOfNALUnit&0x1F;
 #ifdef DEBUG
-      u_int8_t nal_ref_idc = (fFirstByteOfNALUnit&0x60)>>5;
-      fprintf(stderr, "Parsed %d-byte NAL-unit (nal_ref_idc: %d, nal_unit_type: %d (\"%s\"))\n",
-          curFrameSize()-fOutputStartCodeSize, nal_ref_idc, nal_unit_type, nal_unit_type_description_h264[nal_unit_type]);
+    u_int8_t nal_ref_idc = (fFirstByteOfNALUnit&0x60)>>5;
+    fprintf(stderr, "Parsed %d-byte NAL-unit (nal_ref_idc: %d, nal_unit_type: %d (\"%s\"))\n",
+        curFrameSize()-fOutputStartCodeSize, nal_ref_idc, nal_unit_type, nal_unit_type_description_h264[nal_unit_type]);
 #endif
-    } else { // 265
-      nal_unit_type = (fFirstByteOfNALUnit&0x7E)>>1;
+  } else { // 265
+    nal_unit_type = (fFirstByteOfNALUnit&0x7E)>>1;
 #ifdef DEBUG
-      fprintf(stderr, "Parsed %d-byte NAL-unit (nal_unit_type: %d (\"%s\"))\n",
-          curFrameSize()-fOutputStartCodeSize, nal_unit_type, nal_unit_type_description_h265[nal_unit_type]);
+    fprintf(stderr, "Parsed %d-byte NAL-unit (nal_unit_type: %d (\"%s\"))\n",
+        curFrameSize()-fOutputStartCodeSize, nal_unit_type, nal_unit_type_description_h265[nal_unit_type]);
 #endif
-    }
+  }
 
-    // Now that we have found (& copied) a NAL unit, process it if it's of special interest to us:
-    if (isVPS(nal_unit_type)) { // Video parameter set
-      // First, save a copy of this NAL unit, in case the downstream object wants to see it:
-      usingSource()->saveCopyOfVPS(fStartOfFrame + fOutputStartCodeSize, curFrameSize() - fOutputStartCodeSize);
-
-      if (fParsedFrameRate == 0.0) {
-    // We haven't yet parsed a frame rate from the stream.
-    // So parse this NAL unit to check whether frame rate information is present:
-    unsigned num_units_in_tick, time_scale;
-    analyze_video_parameter_set_data(num_units_in_tick, time_scale);
-    if (time_scale > 0 && num_units_in_tick > 0) {
-      usingSource()->fFrameRate = fParsedFrameRate
-        = time_scale/(DeltaTfiDivisor*num_units_in_tick);
+  // Now that we have found (& copied) a NAL unit, process it if it's of special interest to us:
+  if (isVPS(nal_unit_type)) { // Video parameter set
+    // First, save a copy of this NAL unit, in case the downstream object wants to see it:
+    usingSource()->saveCopyOfVPS(fStartOfFrame + fOutputStartCodeSize, curFrameSize() - fOutputStartCodeSize);
+
+    if (fParsedFrameRate == 0.0) {
+      // We haven't yet parsed a frame rate from the stream.
+      // So parse this NAL unit to check whether frame rate information is present:
+      unsigned num_units_in_tick, time_scale;
+      analyze_video_parameter_set_data(num_units_in_tick, time_scale);
+      if (time_scale > 0 && num_units_in_tick > 0) {
+        usingSource()->fFrameRate = fParsedFrameRate
+          = time_scale/(DeltaTfiDivisor*num_units_in_tick);
 #ifdef DEBUG
-      fprintf(stderr, "Set frame rate to %f fps\n", usingSource()->fFrameRate);
+        fprintf(stderr, "Set frame rate to %f fps\n", usingSource()->fFrameRate);
 #endif
-    } else {
+      } else {
 #ifdef DEBUG
-      fprintf(stderr, "\tThis \"Video Parameter Set\" NAL unit contained no frame rate information, so we use a default frame rate of %f fps\n", usingSource()->fFrameRate);
+        fprintf(stderr, "\tThis \"Video Parameter Set\" NAL unit contained no frame rate information, so we use a default frame rate of %f fps\n", usingSource()->fFrameRate);
 #endif
-    }
       }
-    } else if (isSPS(nal_unit_type)) { // Sequence parameter set
-      // First, save a copy of this NAL unit, in case the downstream object wants to see it:
-      usingSource()->saveCopyOfSPS(fStartOfFrame + fOutputStartCodeSize, curFrameSize() - fOutputStartCodeSize);
-
-      if (fParsedFrameRate == 0.0) {
-    // We haven't yet parsed a frame rate from the stream.
-    // So parse this NAL unit to check whether frame rate information is present:
-    unsigned num_units_in_tick, time_scale;
-    analyze_seq_parameter_set_data(num_units_in_tick, time_scale);
-    if (time_scale > 0 && num_units_in_tick > 0) {
-      usingSource()->fFrameRate = fParsedFrameRate
-        = time_scale/(DeltaTfiDivisor*num_units_in_tick);
+    }
+  } else if (isSPS(nal_unit_type)) { // Sequence parameter set
+    // First, save a copy of this NAL unit, in case the downstream object wants to see it:
+    usingSource()->saveCopyOfSPS(fStartOfFrame + fOutputStartCodeSize, curFrameSize() - fOutputStartCodeSize);
+
+    if (fParsedFrameRate == 0.0) {
+      // We haven't yet parsed a frame rate from the stream.
+      // So parse this NAL unit to check whether frame rate information is present:
+      unsigned num_units_in_tick, time_scale;
+      analyze_seq_parameter_set_data(num_units_in_tick, time_scale);
+      if (time_scale > 0 && num_units_in_tick > 0) {
+        usingSource()->fFrameRate = fParsedFrameRate
+          = time_scale/(DeltaTfiDivisor*num_units_in_tick);
 #ifdef DEBUG
-      fprintf(stderr, "Set frame rate to %f fps\n", usingSource()->fFrameRate);
+        fprintf(stderr, "Set frame rate to %f fps\n", usingSource()->fFrameRate);
 #endif
-    } else {
+      } else {
 #ifdef DEBUG
-      fprintf(stderr, "\tThis \"Sequence Parameter Set\" NAL unit contained no frame rate information, so we use a default frame rate of %f fps\n", usingSource()->fFrameRate);
+        fprintf(stderr, "\tThis \"Sequence Parameter Set\" NAL unit contained no frame rate information, so we use a default frame rate of %f fps\n", usingSource()->fFrameRate);
 #endif
-    }
       }
-    } else if (isPPS(nal_unit_type)) { // Picture parameter set
-      // Save a copy of this NAL unit, in case the downstream object wants to see it:
-      usingSource()->saveCopyOfPPS(fStartOfFrame + fOutputStartCodeSize, curFrameSize() - fOutputStartCodeSize);
-    } else if (isSEI(nal_unit_type)) { // Supplemental enhancement information (SEI)
-      analyze_sei_data(nal_unit_type);
-      // Later, perhaps adjust "fPresentationTime" if we saw a "pic_timing" SEI payload??? #####
     }
+  } else if (isPPS(nal_unit_type)) { // Picture parameter set
+    // Save a copy of this NAL unit, in case the downstream object wants to see it:
+    usingSource()->saveCopyOfPPS(fStartOfFrame + fOutputStartCodeSize, curFrameSize() - fOutputStartCodeSize);
+  } else if (isSEI(nal_unit_type)) { // Supplemental enhancement information (SEI)
+    analyze_sei_data(nal_unit_type);
+    // Later, perhaps adjust "fPresentationTime" if we saw a "pic_timing" SEI payload??? #####
+  }
 
-    usingSource()->setPresentationTime();
+  usingSource()->setPresentationTime();
 #ifdef DEBUG
-    unsigned long secs = (unsigned long)usingSource()->fPresentationTime.tv_sec;
-    unsigned uSecs = (unsigned)usingSource()->fPresentationTime.tv_usec;
-    fprintf(stderr, "\tPresentation time: %lu.%06u\n", secs, uSecs);
+  unsigned long secs = (unsigned long)usingSource()->fPresentationTime.tv_sec;
+  unsigned uSecs = (unsigned)usingSource()->fPresentationTime.tv_usec;
+  fprintf(stderr, "\tPresentation time: %lu.%06u\n", secs, uSecs);
 #endif
 
-    // Now, check whether this NAL unit ends an 'access unit'.
-    // (RTP streamers need to know this in order to figure out whether or not to set the "M" bit.)
-    Boolean thisNALUnitEndsAccessUnit;
-    if (haveSeenEOF() || isEOF(nal_unit_type)) {
-      // There is no next NAL unit, so we assume that this one ends the current 'access unit':
-      thisNALUnitEndsAccessUnit = True;
-    } else if (usuallyBeginsAccessUnit(nal_unit_type)) {
-      // These NAL units usually *begin* an access unit, so assume that they don't end one here:
-      thisNALUnitEndsAccessUnit = False;
-    } else {
-      // We need to check the *next* NAL unit to figure out whether
-      // the current NAL unit ends an 'access unit':
-      u_int8_t firstBytesOfNextNALUnit[3];
-      testBytes(firstBytesOfNextNALUnit, 3);
-
-      u_int8_t const& next_nal_unit_type = fHNumber == 264
-    ? (firstBytesOfNextNALUnit[0]&0x1F) : ((firstBytesOfNextNALUnit[0]&0x7E)>>1);
-      if (isVCL(next_nal_unit_type)) {
-    // The high-order bit of the byte after the "nal_unit_header" tells us whether it's
-    // the start of a new 'access unit' (and thus the current NAL unit ends an 'access unit'):
-    u_int8_t const byteAfter_nal_unit_header
-      = fHNumber == 264 ? firstBytesOfNextNALUnit[1] : firstBytesOfNextNALUnit[2];
-    thisNALUnitEndsAccessUnit = (byteAfter_nal_unit_header&0x80) != 0;
-      } else if (usuallyBeginsAccessUnit(next_nal_unit_type)) {
-    // The next NAL unit's type is one that usually appears at the start of an 'access unit',
-    // so we assume that the current NAL unit ends an 'access unit':
+  // Now, check whether this NAL unit ends an 'access unit'.
+  // (RTP streamers need to know this in order to figure out whether or not to set the "M" bit.)
+  Boolean thisNALUnitEndsAccessUnit;
+  if (haveSeenEOF() || isEOF(nal_unit_type)) {
+    // There is no next NAL unit, so we assume that this one ends the current 'access unit':
     thisNALUnitEndsAccessUnit = True;
-      } else {
-    // The next NAL unit definitely doesn't start a new 'access unit',
-    // which means that the current NAL unit doesn't end one:
+  } else if (usuallyBeginsAccessUnit(nal_unit_type)) {
+    // These NAL units usually *begin* an access unit, so assume that they don't end one here:
     thisNALUnitEndsAccessUnit = False;
-      }
+  } else {
+    // We need to check the *next* NAL unit to figure out whether
+    // the current NAL unit ends an 'access unit':
+    u_int8_t const* firstBytesOfNextNALUnit = bufferedBytes(); // we made sure (above) that there are at least 3 bytes
+
+    u_int8_t const& next_nal_unit_type = fHNumber == 264
+      ? (firstBytesOfNextNALUnit[0]&0x1F) : ((firstBytesOfNextNALUnit[0]&0x7E)>>1);
+    if (isVCL(next_nal_unit_type)) {
+      // The high-order bit of the byte after the "nal_unit_header" tells us whether it's
+      // the start of a new 'access unit' (and thus the current NAL unit ends an 'access unit'):
+      u_int8_t const byteAfter_nal_unit_header
+        = fHNumber == 264 ? firstBytesOfNextNALUnit[1] : firstBytesOfNextNALUnit[2];
+      thisNALUnitEndsAccessUnit = (byteAfter_nal_unit_header&0x80) != 0;
+    } else if (usuallyBeginsAccessUnit(next_nal_unit_type)) {
+      // The next NAL unit's type is one that usually appears at the start of an 'access unit',
+      // so we assume that the current NAL unit ends an 'access unit':
+      thisNALUnitEndsAccessUnit = True;
+    } else {
+      // The next NAL unit definitely doesn't start a new 'access unit',
+      // which means that the current NAL unit doesn't end one:
+      thisNALUnitEndsAccessUnit = False;
     }
+  }
 
-    if (thisNALUnitEndsAccessUnit) {
+  if (thisNALUnitEndsAccessUnit) {
 #ifdef DEBUG
-      fprintf(stderr, "*****This NAL unit ends the current access unit*****\n");
+    fprintf(stderr, "*****This NAL unit ends the current access unit*****\n");
 #endif
-      usingSource()->fPictureEndMarker = True;
-      ++usingSource()->fPictureCount;
-
-      // Note that the presentation time for the next NAL unit will be different:
-      struct timeval& nextPT = usingSource()->fNextPresentationTime; // alias
-      nextPT = usingSource()->fPresentationTime;
-      double nextFraction = nextPT.tv_usec/1000000.0 + 1/usingSource()->fFrameRate;
-      unsigned nextSecsIncrement = (long)nextFraction;
-      nextPT.tv_sec += (long)nextSecsIncrement;
-      nextPT.tv_usec = (long)((nextFraction - nextSecsIncrement)*1000000);
+    usingSource()->fPictureEndMarker = True;
+    ++usingSource()->fPictureCount;
+
+    // Note that the presentation time for the next NAL unit will be different:
+    struct timeval& nextPT = usingSource()->fNextPresentationTime; // alias
+    nextPT = usingSource()->fPresentationTime;
+    double nextFraction = nextPT.tv_usec/1000000.0 + 1/usingSource()->fFrameRate;
+    unsigned nextSecsIncrement = (long)nextFraction;
+    nextPT.tv_sec += (long)nextSecsIncrement;
+    nextPT.tv_usec = (long)((nextFraction - nextSecsIncrement)*1000000);
+  }
+  setParseState();
+
+  return curFrameSize();
+}
+
+////////// Scanning for 0x0000xx byte patterns //////////
+
+// Start codes (0x000001) and 'emulation prevention' bytes (0x000003) are both found by looking for a 0x0000xx pattern.
+// Where the CPU allows it, we compare 16 (SSE2) or 32 (AVX2) positions at once; otherwise, we use a scalar loop.
+// Returns the offset of the first 0x00, 0x00, "thirdByte" pattern in "from" (with "thirdByte" != 0), or "size" if there's none:
+static unsigned findZeroZeroXXScalar(u_int8_t const* from, unsigned size, u_int8_t thirdByte) {
+  unsigned i = 0;
+  while (i+2 < size) {
+    u_int8_t const c = from[i+2];
+    if (c == thirdByte) {
+      if (from[i+1] == 0 && from[i] == 0) return i;
+    } else if (c != 0) {
+      // The pattern can't begin at "i", "i+1" or "i+2":
+      i += 3;
+      continue;
     }
-    setParseState();
+    ++i;
+  }
 
-    return curFrameSize();
-  } catch (int /*e*/) {
-#ifdef DEBUG
-    fprintf(stderr, "H264or5VideoStreamParser::parse() EXCEPTION (This is normal behavior - *not* an error)\n");
+  return size;
+}
+
+#ifdef USE_SSE2_NAL_SCANNING
+static unsigned findZeroZeroXXSSE2(u_int8_t const* from, unsigned size, u_int8_t thirdByte) {
+  __m128i const zero = _mm_setzero_si128();
+  __m128i const third = _mm_set1_epi8((char)thirdByte);
+  unsigned i = 0;
+  for (; i+18 <= size; i += 16) { // bytes "i" through "i+17" are examined
+    __m128i const b0 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const*)&from[i]), zero);
+    __m128i const b1 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const*)&from[i+1]), zero);
+    __m128i const b2 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const*)&from[i+2]), third);
+    unsigned const mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(b0, b1), b2));
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+
+  return i + findZeroZeroXXScalar(&from[i], size - i, thirdByte);
+}
 #endif
-    return 0;  // the parsing got interrupted
+
+#ifdef USE_AVX2_NAL_SCANNING
+__attribute__((target("avx2")))
+static unsigned findZeroZeroXXAVX2(u_int8_t const* from, unsigned size, u_int8_t thirdByte) {
+  __m256i const zero = _mm256_setzero_si256();
+  __m256i const third = _mm256_set1_epi8((char)thirdByte);
+  unsigned i = 0;
+  for (; i+34 <= size; i += 32) { // bytes "i" through "i+33" are examined
+    __m256i const b0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const*)&from[i]), zero);
+    __m256i const b1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const*)&from[i+1]), zero);
+    __m256i const b2 = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const*)&from[i+2]), third);
+    unsigned const mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(b0, b1), b2));
+    if (mask != 0) return i + __builtin_ctz(mask);
   }
+
+  return i + findZeroZeroXXSSE2(&from[i], size - i, thirdByte);
+}
+#endif
+
+typedef unsigned (findZeroZeroXXFunc)(u_int8_t const* from, unsigned size, u_int8_t thirdByte);
+
+static findZeroZeroXXFunc* chooseFindZeroZeroXX() {
+#ifdef USE_AVX2_NAL_SCANNING
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return findZeroZeroXXAVX2;
+#endif
+#ifdef USE_SSE2_NAL_SCANNING
+  return findZeroZeroXXSSE2;
+#else
+  return findZeroZeroXXScalar;
+#endif
+}
+
+static findZeroZeroXXFunc* const findZeroZeroXX = chooseFindZeroZeroXX();
+
+unsigned findH264or5StartCode(u_int8_t const* from, unsigned size) {
+  return findZeroZeroXX(from, size, 0x01);
 }
 
 unsigned removeH264or5EmulationBytes(u_int8_t* to, unsigned toMaxSize,
                                      u_int8_t const* from, unsigned fromSize) {
+  // Copy the runs of bytes between the 0x000003 patterns as a whole, dropping each 0x03.
+  // (As before, at most "toMaxSize"-1 bytes are copied, except for the 0x0000 that precedes a dropped 0x03.)
   unsigned toSize = 0;
   unsigned i = 0;
   while (i < fromSize && toSize+1 < toMaxSize) {
-    if (i+2 < fromSize && from[i] == 0 && from[i+1] == 0 && from[i+2] == 3) {
-      to[toSize] = to[toSize+1] = 0;
-      toSize += 2;
-      i += 3;
-    } else {
-      to[toSize] = from[i];
-      toSize += 1;
-      i += 1;
-    }
+    unsigned const emulation = i + findZeroZeroXX(&from[i], fromSize - i, 0x03);
+
+    unsigned runSize = emulation - i;
+    unsigned const maxRunSize = toMaxSize - 1 - toSize;
+    if (runSize > maxRunSize) runSize = maxRunSize;
+    memmove(&to[toSize], &from[i], runSize);
+    toSize += runSize;
+    i += runSize;
+
+    if (i < emulation || emulation == fromSize || toSize+1 >= toMaxSize) break;
+
+    // "from[i]" starts a 0x000003:
+    to[toSize] = to[toSize+1] = 0;
+    toSize += 2;
+    i += 3;
   }
 
   return toSize;
@@ -70,6 +70,17 @@ protected:
     *fTo++ = word>>24; *fTo++ = word>>16; *fTo++ = word>>8; *fTo++ = word;
   }
 
+  void saveBytes(u_int8_t const* from, unsigned numBytes) {
+    unsigned numBytesToSave = numBytes;
+    if (fTo+numBytesToSave > fLimit) { // there's not enough space left
+      numBytesToSave = fLimit - fTo;
+      fNumTruncatedBytes += numBytes - numBytesToSave;
+    }
+
+    memmove(fTo, from, numBytesToSave);
+    fTo += numBytesToSave;
+  }
+
   // Save data until we see a sync word (0x000001xx):
   void saveToNextCode(u_int32_t& curWord) {
     saveByte(curWord>>24);
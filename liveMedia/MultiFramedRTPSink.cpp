@@ -52,8 +52,15 @@ MultiFramedRTPSink::MultiFramedRTPSink(UsageEnvironment& env,
   : RTPSink(env, rtpGS, rtpPayloadType, rtpTimestampFrequency,
         rtpPayloadFormatName, numChannels),
     fOutBuf(NULL), fCurFragmentationOffset(0), fPreviousFrameEndedFragmentation(False),
-    fOnSendErrorFunc(NULL), fOnSendErrorData(NULL) {
+    fOnSendErrorFunc(NULL), fOnSendErrorData(NULL),
+    fPacingPercent(0), fPacingBurst(0), fPacingTokens(0.0), fPacingRate(0.0),
+    fPacingFrameInterval(0), fPacingQueuedBytes(0),
+    fPacingLastDelay(0), fPacingMaxDelay(0), fPacingNumDelayedPackets(0), fPacingTotalDelay(0) {
   setPacketSizes((RTP_PAYLOAD_PREFERRED_SIZE), (RTP_PAYLOAD_MAX_SIZE));
+  fPacingLastRefill.tv_sec = fPacingLastRefill.tv_usec = 0;
+  fPacingPrevPresentationTime.tv_sec = fPacingPrevPresentationTime.tv_usec = 0;
+  fPacingFrameDeadline.tv_sec = fPacingFrameDeadline.tv_usec = 0;
+  if (defaultPacingPercent > 0) setPacing(defaultPacingPercent);
 }
 
 MultiFramedRTPSink::~MultiFramedRTPSink() {
@@ -153,6 +160,98 @@ void MultiFramedRTPSink::setFramePadding(unsigned numPaddingBytes) {
   }
 }
 
+// The frame interval that is assumed until we can estimate it (25 frames/second):
+#define PACING_DEFAULT_FRAME_INTERVAL 40000
+// The number of maximum-size packets that the bucket holds by default:
+#define PACING_DEFAULT_BURST_PACKETS 4
+
+unsigned MultiFramedRTPSink::defaultPacingPercent = 0;
+
+void MultiFramedRTPSink::setPacing(unsigned percentOfFrameInterval, unsigned burstBytes) {
+  if (percentOfFrameInterval > 100) percentOfFrameInterval = 100;
+  fPacingPercent = percentOfFrameInterval;
+  fPacingBurst = burstBytes > 0 ? burstBytes : PACING_DEFAULT_BURST_PACKETS*fOurMaxPacketSize;
+  fPacingTokens = fPacingBurst; // start with a full bucket
+  gettimeofday(&fPacingLastRefill, NULL);
+}
+
+void MultiFramedRTPSink::pacingNewFrame(unsigned frameSize, struct timeval presentationTime,
+                                        unsigned durationInMicroseconds) {
+  fPacingQueuedBytes += frameSize;
+  if (fPacingPercent == 0) return;
+
+  // Frames that share a presentation time (e.g., the NAL units of one access unit)
+  // are one frame to the pacer:
+  Boolean isNewFrame = presentationTime.tv_sec != fPacingPrevPresentationTime.tv_sec
+    || presentationTime.tv_usec != fPacingPrevPresentationTime.tv_usec;
+
+  // Update our estimate of the frame interval:
+  if (durationInMicroseconds > 0) {
+    fPacingFrameInterval = durationInMicroseconds;
+  } else if (isNewFrame
+             && (fPacingPrevPresentationTime.tv_sec != 0 || fPacingPrevPresentationTime.tv_usec != 0)) {
+    int64_t uSecondsDiff
+      = (int64_t)(presentationTime.tv_sec - fPacingPrevPresentationTime.tv_sec)*1000000
+      + (presentationTime.tv_usec - fPacingPrevPresentationTime.tv_usec);
+    if (uSecondsDiff > 0 && uSecondsDiff < 1000000) {
+      fPacingFrameInterval = fPacingFrameInterval == 0 ? (unsigned)uSecondsDiff
+        : (unsigned)((7*(int64_t)fPacingFrameInterval + uSecondsDiff)/8);
+    }
+  }
+  fPacingPrevPresentationTime = presentationTime;
+
+  // A new frame gets its share of the frame interval.  Each later part of it picks the rate
+  // at which the bytes still queued get out by the same deadline, so the whole frame - not
+  // each part - is spread over the share.
+  // (Frames that fit in the bucket are never slowed down more than this.)
+  struct timeval timeNow;
+  gettimeofday(&timeNow, NULL);
+  if (isNewFrame) {
+    unsigned frameInterval = fPacingFrameInterval > 0 ? fPacingFrameInterval : PACING_DEFAULT_FRAME_INTERVAL;
+    unsigned budget = frameInterval*fPacingPercent/100;
+    fPacingFrameDeadline.tv_sec = timeNow.tv_sec + budget/1000000;
+    fPacingFrameDeadline.tv_usec = timeNow.tv_usec + budget%1000000;
+    if (fPacingFrameDeadline.tv_usec >= 1000000) {
+      fPacingFrameDeadline.tv_usec -= 1000000;
+      ++fPacingFrameDeadline.tv_sec;
+    }
+  }
+  int64_t uSecondsLeft
+    = (int64_t)(fPacingFrameDeadline.tv_sec - timeNow.tv_sec)*1000000
+    + (fPacingFrameDeadline.tv_usec - timeNow.tv_usec);
+  if (uSecondsLeft < 1) uSecondsLeft = 1;
+  unsigned bytesToSpread = fPacingQueuedBytes > fPacingBurst ? fPacingQueuedBytes : fPacingBurst;
+  fPacingRate = (double)bytesToSpread/uSecondsLeft;
+}
+
+unsigned MultiFramedRTPSink::pacingDelay(unsigned packetSize, unsigned payloadSize) {
+  fPacingQueuedBytes = fPacingQueuedBytes > payloadSize ? fPacingQueuedBytes - payloadSize : 0;
+  if (fPacingPercent == 0 || fPacingRate <= 0.0) return 0;
+
+  // Refill the bucket for the time that has passed, then take this packet from it:
+  struct timeval timeNow;
+  gettimeofday(&timeNow, NULL);
+  int64_t uSecondsElapsed
+    = (int64_t)(timeNow.tv_sec - fPacingLastRefill.tv_sec)*1000000
+    + (timeNow.tv_usec - fPacingLastRefill.tv_usec);
+  fPacingLastRefill = timeNow;
+  if (uSecondsElapsed > 0) {
+    fPacingTokens += fPacingRate*uSecondsElapsed;
+    if (fPacingTokens > fPacingBurst) fPacingTokens = fPacingBurst;
+  }
+  fPacingTokens -= packetSize;
+
+  unsigned delay = 0;
+  if (fPacingTokens < 0.0) {
+    delay = (unsigned)(-fPacingTokens/fPacingRate);
+    ++fPacingNumDelayedPackets;
+    fPacingTotalDelay += delay;
+    if (delay > fPacingMaxDelay) fPacingMaxDelay = delay;
+  }
+  fPacingLastDelay = delay;
+  return delay;
+}
+
 Boolean MultiFramedRTPSink::continuePlaying() {
   // Send the first packet.
   // (This will also schedule any future sends.)
@@ -164,6 +263,7 @@ void MultiFramedRTPSink::stopPlaying() {
   fOutBuf->resetPacketStart();
   fOutBuf->resetOffset();
   fOutBuf->resetOverflowData();
+  fPacingQueuedBytes = 0;
 
   // Then call the default "stopPlaying()" function:
   MediaSink::stopPlaying();
@@ -231,6 +331,7 @@ void MultiFramedRTPSink
             struct timeval presentationTime,
             unsigned durationInMicroseconds) {
   MultiFramedRTPSink* sink = (MultiFramedRTPSink*)clientData;
+  sink->pacingNewFrame(numBytesRead, presentationTime, durationInMicroseconds);
   sink->afterGettingFrame1(numBytesRead, numTruncatedBytes,
                presentationTime, durationInMicroseconds);
 }
@@ -363,6 +464,7 @@ Boolean MultiFramedRTPSink::isTooBigForAPacket(unsigned numBytes) const {
 }
 
 void MultiFramedRTPSink::sendPacketIfNecessary() {
+  unsigned pacingDelayUs = 0;
   if (fNumFramesUsedSoFar > 0) {
     // Send the packet:
 #ifdef TEST_LOSS
@@ -374,8 +476,10 @@ void MultiFramedRTPSink::sendPacketIfNecessary() {
       }
     ++fPacketCount;
     fTotalOctetCount += fOutBuf->curPacketSize();
-    fOctetCount += fOutBuf->curPacketSize()
+    unsigned payloadSize = fOutBuf->curPacketSize()
       - rtpHeaderSize - fSpecialHeaderSize - fTotalFrameSpecificHeaderSizes;
+    fOctetCount += payloadSize;
+    pacingDelayUs = pacingDelay(fOutBuf->curPacketSize(), payloadSize);
 
     ++fSeqNo; // for next time
   }
@@ -410,6 +514,8 @@ void MultiFramedRTPSink::sendPacketIfNecessary() {
     if (uSecondsToGo < 0 || secsDiff < 0) { // sanity check: Make sure that the time-to-delay is non-negative:
       uSecondsToGo = 0;
     }
+    // If we're pacing, don't send the next packet before the bucket allows it:
+    if (uSecondsToGo < pacingDelayUs) uSecondsToGo = pacingDelayUs;
 
     // Delay this amount of time:
     nextTask() = envir().taskScheduler().scheduleDelayedTask(uSecondsToGo, (TaskFunc*)sendNext, this);
@@ -22,13 +22,14 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "MultiFramedRTPSource.hh"
 #include "RTCP.hh"
 #include "GroupsockHelper.hh"
+#include "TunnelEncaps.hh"
 #include <string.h>
 
 ////////// ReorderingPacketBuffer definition //////////
 
 class ReorderingPacketBuffer {
 public:
-  ReorderingPacketBuffer(BufferedPacketFactory* packetFactory);
+  ReorderingPacketBuffer(BufferedPacketFactory* packetFactory, BufferedPacketSlab* slab);
   virtual ~ReorderingPacketBuffer();
   void reset();
 
@@ -40,6 +41,7 @@ public:
     if (packet != fSavedPacket) {
       delete packet;
     } else {
+      packet->releaseBuffer(); // so that an idle source holds no packet buffer
       fSavedPacketFree = True;
     }
   }
@@ -50,6 +52,7 @@ public:
 
 private:
   BufferedPacketFactory* fPacketFactory;
+  BufferedPacketSlab* fSlab;
   unsigned fThresholdTime; // uSeconds
   Boolean fHaveSeenFirstPacket; // used to set initial "fNextExpectedSeqNo"
   unsigned short fNextExpectedSeqNo;
@@ -68,9 +71,12 @@ MultiFramedRTPSource
                unsigned char rtpPayloadFormat,
                unsigned rtpTimestampFrequency,
                BufferedPacketFactory* packetFactory)
-  : RTPSource(env, RTPgs, rtpPayloadFormat, rtpTimestampFrequency) {
+  : RTPSource(env, RTPgs, rtpPayloadFormat, rtpTimestampFrequency),
+    fDatagramsNeedJumboSlots(False), fReceiveBatchMax(0), fReceiveSlotSize(0),
+    fReceiveBytes(NULL), fReceiveFrom(NULL), fReceiveTruncated(NULL) {
   reset();
-  fReorderingBuffer = new ReorderingPacketBuffer(packetFactory);
+  fSlab = BufferedPacketSlab::addSource(env);
+  fReorderingBuffer = new ReorderingPacketBuffer(packetFactory, fSlab);
 
   // Try to use a big receive buffer for RTP:
   increaseReceiveBufferTo(env, RTPgs->socketNum(), 50*1024);
@@ -87,6 +93,8 @@ void MultiFramedRTPSource::reset() {
 
 MultiFramedRTPSource::~MultiFramedRTPSource() {
   delete fReorderingBuffer;
+  setReceiveBatch(0, 0); // frees the batch arrays
+  BufferedPacketSlab::removeSource(envir());
 }
 
 Boolean MultiFramedRTPSource
@@ -220,13 +228,37 @@ void MultiFramedRTPSource
   fReorderingBuffer->setThresholdTime(uSeconds);
 }
 
-#define ADVANCE(n) do { bPacket->skip(n); } while (0)
+void MultiFramedRTPSource
+::setReceiveBatch(unsigned maxPackets, unsigned slotSize) {
+  delete[] fReceiveBytes; fReceiveBytes = NULL;
+  delete[] fReceiveFrom; fReceiveFrom = NULL;
+  delete[] fReceiveTruncated; fReceiveTruncated = NULL;
+
+  if (maxPackets > MAX_READ_SOCKET_BATCH) maxPackets = MAX_READ_SOCKET_BATCH;
+  if (maxPackets <= 1) {
+    fReceiveBatchMax = 0;
+    return;
+  }
+  if (slotSize < 256) slotSize = 256;
+
+  fReceiveBatchMax = maxPackets;
+  fReceiveSlotSize = slotSize;
+  fReceiveBytes = new unsigned[maxPackets];
+  fReceiveFrom = new struct sockaddr_in[maxPackets];
+  fReceiveTruncated = new Boolean[maxPackets];
+}
 
 void MultiFramedRTPSource::networkReadHandler(MultiFramedRTPSource* source, int /*mask*/) {
   source->networkReadHandler1();
 }
 
 void MultiFramedRTPSource::networkReadHandler1() {
+  if (fReceiveBatchMax > 0 && fPacketReadInProgress == NULL
+      && fRTPInterface.nextReadIsFromDatagramSocket()) {
+    networkReadBatch();
+    return;
+  }
+
   BufferedPacket* bPacket = fPacketReadInProgress;
   if (bPacket == NULL) {
     // Normal case: Get a free BufferedPacket descriptor to hold the new network packet:
@@ -238,8 +270,12 @@ void MultiFramedRTPSource::networkReadHandler1() {
   do {
     struct sockaddr_in fromAddress;
     Boolean packetReadWasIncomplete = fPacketReadInProgress != NULL;
-    if (!bPacket->fillInData(fRTPInterface, fromAddress, packetReadWasIncomplete)) {
-      if (bPacket->bytesAvailable() == 0) { // should not happen??
+    Boolean datagramNeededJumboSlot = fDatagramsNeedJumboSlots;
+    if (!bPacket->fillInData(fRTPInterface, fromAddress, packetReadWasIncomplete, fDatagramsNeedJumboSlots)) {
+      if (fDatagramsNeedJumboSlots && !datagramNeededJumboSlot) {
+        envir() << "MultiFramedRTPSource: Received a packet larger than the small slot size ("
+                << PACKET_SLAB_SMALL_SLOT_SIZE << " bytes); reading packets into jumbo slots from now on\n";
+      } else if (bPacket->hasBuffer() && bPacket->bytesAvailable() == 0) { // should not happen??
     envir() << "MultiFramedRTPSource internal error: Hit limit when reading incoming packet over TCP\n";
       }
       fPacketReadInProgress = NULL;
@@ -252,6 +288,58 @@ void MultiFramedRTPSource::networkReadHandler1() {
     } else {
       fPacketReadInProgress = NULL;
     }
+
+    readSuccess = processIncomingPacket(bPacket, fromAddress);
+  } while (0);
+  if (!readSuccess) fReorderingBuffer->freePacket(bPacket);
+
+  doGetNextFrame1();
+  // If we didn't get proper data this time, we'll get another chance
+}
+
+void MultiFramedRTPSource::networkReadBatch() {
+  // Read all of the pending datagrams (up to "fReceiveBatchMax") at once, then store them
+  // all in the reordering buffer before delivering any data:
+  unsigned char* slots = fSlab->readBuffer(fReceiveBatchMax*fReceiveSlotSize);
+  int numRead = fRTPInterface.handleReadBatch(slots, fReceiveSlotSize, fReceiveBatchMax,
+                                              fReceiveBytes, fReceiveFrom, fReceiveTruncated);
+  if (numRead > 0) {
+    ++fNumReceiveBatches;
+    fNumBatchedPackets += numRead;
+    if ((unsigned)numRead > fMaxReceiveBatchSize) fMaxReceiveBatchSize = numRead;
+  }
+
+  Boolean packetWasTruncated = False;
+  for (int i = 0; i < numRead; ++i) {
+    if (fReceiveTruncated[i]) {
+      // This packet didn't fit in its slot, and so can't be used:
+      packetWasTruncated = True;
+      continue;
+    }
+    if (fReceiveBytes[i] == 0) continue;
+
+    BufferedPacket* bPacket = fReorderingBuffer->getFreePacket(this);
+    bPacket->fillInData(&slots[i*fReceiveSlotSize], fReceiveBytes[i]);
+    if (!processIncomingPacket(bPacket, fReceiveFrom[i])) fReorderingBuffer->freePacket(bPacket);
+  }
+
+  if (packetWasTruncated) {
+    // The sender uses packets bigger than our slots, so go back to reading packets one at a time
+    // (into full-size buffers) from now on:
+    envir() << "MultiFramedRTPSource: Received a packet larger than the batch slot size ("
+            << fReceiveSlotSize << " bytes); turning off batched reception\n";
+    setReceiveBatch(0, 0);
+  }
+
+  doGetNextFrame1();
+}
+
+#define ADVANCE(n) do { bPacket->skip(n); } while (0)
+
+Boolean MultiFramedRTPSource
+::processIncomingPacket(BufferedPacket* bPacket, struct sockaddr_in& fromAddress) {
+  Boolean readSuccess = False;
+  do {
 #ifdef TEST_LOSS
     setPacketReorderingThresholdTime(0);
        // don't wait for 'lost' packets to arrive out-of-order later
@@ -333,10 +421,8 @@ void MultiFramedRTPSource::networkReadHandler1() {
 
     readSuccess = True;
   } while (0);
-  if (!readSuccess) fReorderingBuffer->freePacket(bPacket);
 
-  doGetNextFrame1();
-  // If we didn't get proper data this time, we'll get another chance
+  return readSuccess;
 }
 
 
@@ -345,14 +431,39 @@ void MultiFramedRTPSource::networkReadHandler1() {
 #define MAX_PACKET_SIZE 65536
 
 BufferedPacket::BufferedPacket()
-  : fPacketSize(MAX_PACKET_SIZE),
-    fBuf(new unsigned char[MAX_PACKET_SIZE]),
-    fNextPacket(NULL) {
+  : fPacketSize(0), fBuf(NULL), fHead(0), fTail(0),
+    fSlab(NULL), fNextPacket(NULL) {
+  // Our buffer is attached later, when data is filled in
 }
 
 BufferedPacket::~BufferedPacket() {
   delete fNextPacket;
-  delete[] fBuf;
+  releaseBuffer();
+}
+
+void BufferedPacket::attachBuffer(unsigned minSize) {
+  if (fBuf != NULL && fPacketSize >= minSize) return; // the one that we have will do
+
+  releaseBuffer();
+  if (fSlab == NULL) {
+    fBuf = new unsigned char[MAX_PACKET_SIZE];
+    fPacketSize = MAX_PACKET_SIZE;
+  } else {
+    fBuf = fSlab->allocSlot(minSize, fPacketSize);
+  }
+}
+
+void BufferedPacket::releaseBuffer() {
+  if (fBuf == NULL) return;
+
+  if (fSlab == NULL) {
+    delete[] fBuf;
+  } else {
+    fSlab->freeSlot(fBuf, fPacketSize);
+  }
+  fBuf = NULL;
+  fPacketSize = 0;
+  fHead = fTail = 0;
 }
 
 void BufferedPacket::reset() {
@@ -386,15 +497,44 @@ void BufferedPacket
 }
 
 Boolean BufferedPacket::fillInData(RTPInterface& rtpInterface, struct sockaddr_in& fromAddress,
-                   Boolean& packetReadWasIncomplete) {
-  if (!packetReadWasIncomplete) reset();
+                   Boolean& packetReadWasIncomplete, Boolean& datagramNeedsJumboSlot) {
+  int tcpSocketNum; // not used
+  unsigned char tcpStreamChannelId; // not used
+  if (fSlab != NULL && rtpInterface.nextReadIsFromDatagramSocket()) {
+    // Read the datagram straight into a slot, after the room that "reset()" reserves in front of it:
+    Boolean inSmallSlot = !datagramNeedsJumboSlot;
+    attachBuffer(inSmallSlot ? PACKET_SLAB_SMALL_SLOT_SIZE : PACKET_SLAB_JUMBO_SLOT_SIZE);
+    reset();
+    unsigned const maxBytesToRead
+      = bytesAvailable() > PACKET_SLAB_TAILROOM ? bytesAvailable() - PACKET_SLAB_TAILROOM : 0;
+    if (maxBytesToRead == 0) return False; // shouldn't happen
+    unsigned numBytesRead;
+    if (!rtpInterface.handleRead(&fBuf[fTail], maxBytesToRead,
+                 numBytesRead, fromAddress,
+                 tcpSocketNum, tcpStreamChannelId,
+                 packetReadWasIncomplete)) {
+      return False;
+    }
+    if (inSmallSlot && numBytesRead + TunnelEncapsulationTrailerMaxSize >= maxBytesToRead) {
+      // The datagram filled what "Groupsock::handleRead()" reads, and so may have been cut short.
+      // Drop it, and use jumbo slots from now on:
+      datagramNeedsJumboSlot = True;
+      return False;
+    }
+    fTail += numBytesRead;
+    return True;
+  }
+
+  if (!packetReadWasIncomplete) {
+    // Data read over TCP may arrive in pieces, so read it straight into a full-size buffer:
+    attachBuffer(PACKET_SLAB_JUMBO_SLOT_SIZE);
+    reset();
+  }
 
   unsigned const maxBytesToRead = bytesAvailable();
   if (maxBytesToRead == 0) return False; // exceeded buffer size when reading over TCP
 
   unsigned numBytesRead;
-  int tcpSocketNum; // not used
-  unsigned char tcpStreamChannelId; // not used
   if (!rtpInterface.handleRead(&fBuf[fTail], maxBytesToRead,
                    numBytesRead, fromAddress,
                    tcpSocketNum, tcpStreamChannelId,
@@ -405,6 +545,21 @@ Boolean BufferedPacket::fillInData(RTPInterface& rtpInterface, struct sockaddr_i
   return True;
 }
 
+void BufferedPacket::fillInData(unsigned char const* data, unsigned numBytes) {
+  attachBuffer(numBytes + PACKET_SLAB_TAILROOM);
+  reset();
+  if (fTail + numBytes + PACKET_SLAB_TAILROOM > fPacketSize) {
+    // Our "reset()" reserved space in front of the data (for a synthesized header), so we
+    // need a bigger buffer:
+    attachBuffer(fTail + numBytes + PACKET_SLAB_TAILROOM);
+    reset();
+  }
+
+  if (numBytes > fPacketSize - fTail) numBytes = fPacketSize - fTail;
+  memmove(&fBuf[fTail], data, numBytes);
+  fTail += numBytes;
+}
+
 void BufferedPacket
 ::assignMiscParams(unsigned short rtpSeqNo, unsigned rtpTimestamp,
            struct timeval presentationTime,
@@ -483,11 +638,152 @@ BufferedPacket* BufferedPacketFactory
 }
 
 
+////////// BufferedPacketSlab implementation //////////
+
+BufferedPacketSlab* BufferedPacketSlab::addSource(UsageEnvironment& env) {
+  _Tables* ourTables = _Tables::getOurTables(env);
+  if (ourTables->packetSlab == NULL) {
+    ourTables->packetSlab = new BufferedPacketSlab;
+  }
+
+  BufferedPacketSlab* slab = (BufferedPacketSlab*)(ourTables->packetSlab);
+  ++slab->fNumSources;
+  return slab;
+}
+
+void BufferedPacketSlab::removeSource(UsageEnvironment& env) {
+  _Tables* ourTables = _Tables::getOurTables(env, False);
+  if (ourTables == NULL || ourTables->packetSlab == NULL) return;
+
+  BufferedPacketSlab* slab = (BufferedPacketSlab*)(ourTables->packetSlab);
+  if (--slab->fNumSources == 0) {
+    // Our last source is gone, so we can also delete the slab (to reclaim space):
+    delete slab;
+    ourTables->packetSlab = NULL;
+    ourTables->reclaimIfPossible();
+  }
+}
+
+Boolean BufferedPacketSlab::getStats(UsageEnvironment& env, PacketSlabStats& stats) {
+  memset(&stats, 0, sizeof stats);
+  _Tables* ourTables = _Tables::getOurTables(env, False);
+  if (ourTables == NULL || ourTables->packetSlab == NULL) return False;
+
+  BufferedPacketSlab* slab = (BufferedPacketSlab*)(ourTables->packetSlab);
+  stats.numSources = slab->fNumSources;
+  stats.smallSlots = slab->fSmall.numSlots;
+  stats.smallSlotsInUse = slab->fSmall.numInUse;
+  stats.smallSlotsPeak = slab->fSmall.peakInUse;
+  stats.jumboSlots = slab->fJumbo.numSlots;
+  stats.jumboSlotsInUse = slab->fJumbo.numInUse;
+  stats.jumboSlotsPeak = slab->fJumbo.peakInUse;
+  stats.readBufferSize = slab->fReadBufferSize;
+  stats.bytesAllocated = (u_int64_t)slab->fSmall.numSlots*slab->fSmall.slotSize
+    + (u_int64_t)slab->fJumbo.numSlots*slab->fJumbo.slotSize + slab->fReadBufferSize;
+  return True;
+}
+
+BufferedPacketSlab::BufferedPacketSlab()
+  : fNumSources(0), fChunks(NULL), fNumChunks(0), fMaxChunks(0),
+    fReadBuffer(NULL), fReadBufferSize(0) {
+  memset(&fSmall, 0, sizeof fSmall);
+  fSmall.slotSize = PACKET_SLAB_SMALL_SLOT_SIZE;
+  memset(&fJumbo, 0, sizeof fJumbo);
+  fJumbo.slotSize = PACKET_SLAB_JUMBO_SLOT_SIZE;
+}
+
+BufferedPacketSlab::~BufferedPacketSlab() {
+  // Our sources are all gone, so every slot is free now.
+  // The jumbo slots were allocated one at a time:
+  while (fJumbo.freeList != NULL) {
+    unsigned char* slot = fJumbo.freeList;
+    fJumbo.freeList = *(unsigned char**)slot;
+    delete[] slot;
+  }
+
+  // The small ones, a chunk at a time:
+  for (unsigned i = 0; i < fNumChunks; ++i) delete[] fChunks[i];
+  delete[] fChunks;
+
+  delete[] fReadBuffer;
+}
+
+unsigned char* BufferedPacketSlab::allocSlot(unsigned minSize, unsigned& slotSize) {
+  if (minSize <= fSmall.slotSize) {
+    slotSize = fSmall.slotSize;
+    return allocFrom(fSmall, PACKET_SLAB_SMALL_SLOTS_PER_CHUNK);
+  }
+
+  slotSize = fJumbo.slotSize; // Note: This may be less than "minSize"; the caller truncates its data
+  return allocFrom(fJumbo, 1);
+}
+
+void BufferedPacketSlab::freeSlot(unsigned char* slot, unsigned slotSize) {
+  if (slotSize == fSmall.slotSize) {
+    freeTo(fSmall, slot);
+  } else if (fJumbo.numFree >= PACKET_SLAB_MAX_FREE_JUMBO_SLOTS) {
+    // Don't hold on to too many idle jumbo slots:
+    delete[] slot;
+    --fJumbo.numSlots;
+    --fJumbo.numInUse;
+  } else {
+    freeTo(fJumbo, slot);
+  }
+}
+
+unsigned char* BufferedPacketSlab::readBuffer(unsigned minSize) {
+  if (minSize > fReadBufferSize) {
+    delete[] fReadBuffer;
+    fReadBuffer = new unsigned char[minSize];
+    fReadBufferSize = minSize;
+  }
+  return fReadBuffer;
+}
+
+unsigned char* BufferedPacketSlab::allocFrom(SizeClass& sizeClass, unsigned slotsPerChunk) {
+  if (sizeClass.freeList == NULL) {
+    // Carve a new chunk into slots, and put them on the free list:
+    unsigned char* chunk = new unsigned char[slotsPerChunk*sizeClass.slotSize];
+    if (slotsPerChunk > 1) {
+      // Remember the chunk, so that we can delete it later:
+      if (fNumChunks == fMaxChunks) {
+        fMaxChunks = fMaxChunks == 0 ? 16 : 2*fMaxChunks;
+        unsigned char** newChunks = new unsigned char*[fMaxChunks];
+        for (unsigned i = 0; i < fNumChunks; ++i) newChunks[i] = fChunks[i];
+        delete[] fChunks; fChunks = newChunks;
+      }
+      fChunks[fNumChunks++] = chunk;
+    }
+
+    for (unsigned i = slotsPerChunk; i > 0; --i) {
+      unsigned char* slot = &chunk[(i-1)*sizeClass.slotSize];
+      *(unsigned char**)slot = sizeClass.freeList;
+      sizeClass.freeList = slot;
+    }
+    sizeClass.numFree += slotsPerChunk;
+    sizeClass.numSlots += slotsPerChunk;
+  }
+
+  unsigned char* slot = sizeClass.freeList;
+  sizeClass.freeList = *(unsigned char**)slot;
+  --sizeClass.numFree;
+  if (++sizeClass.numInUse > sizeClass.peakInUse) sizeClass.peakInUse = sizeClass.numInUse;
+  return slot;
+}
+
+void BufferedPacketSlab::freeTo(SizeClass& sizeClass, unsigned char* slot) {
+  *(unsigned char**)slot = sizeClass.freeList;
+  sizeClass.freeList = slot;
+  ++sizeClass.numFree;
+  --sizeClass.numInUse;
+}
+
+
 ////////// ReorderingPacketBuffer implementation //////////
 
 ReorderingPacketBuffer
-::ReorderingPacketBuffer(BufferedPacketFactory* packetFactory)
-  : fThresholdTime(100000) /* default reordering threshold: 100 ms */,
+::ReorderingPacketBuffer(BufferedPacketFactory* packetFactory, BufferedPacketSlab* slab)
+  : fSlab(slab), fThresholdTime(100000) /* default reordering threshold: 100 ms */,
     fHaveSeenFirstPacket(False), fHeadPacket(NULL), fTailPacket(NULL), fSavedPacket(NULL), fSavedPacketFree(True) {
   fPacketFactory = (packetFactory == NULL)
     ? (new BufferedPacketFactory)
@@ -509,6 +805,7 @@ void ReorderingPacketBuffer::reset() {
 BufferedPacket* ReorderingPacketBuffer::getFreePacket(MultiFramedRTPSource* ourSource) {
   if (fSavedPacket == NULL) { // we're being called for the first time
     fSavedPacket = fPacketFactory->createNewPacket(ourSource);
+    fSavedPacket->setSlab(fSlab);
     fSavedPacketFree = True;
   }
 
@@ -516,7 +813,10 @@ BufferedPacket* ReorderingPacketBuffer::getFreePacket(MultiFramedRTPSource* ourS
     fSavedPacketFree = False;
     return fSavedPacket;
   } else {
-    return fPacketFactory->createNewPacket(ourSource);
+    // Packet descriptors are small; their buffers come from the slab:
+    BufferedPacket* packet = fPacketFactory->createNewPacket(ourSource);
+    packet->setSlab(fSlab);
+    return packet;
   }
 }
 
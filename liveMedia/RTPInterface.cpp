@@ -21,8 +21,12 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 // Implementation
 
 #include "RTPInterface.hh"
+#include "RTPSink.hh"
 #include <GroupsockHelper.hh>
 #include <stdio.h>
+#if !defined(__WIN32__) && !defined(_WIN32)
+#include <sys/uio.h>
+#endif
 
 ////////// Helper Functions - Definition //////////
 
@@ -34,6 +38,33 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 // "SocketDescriptor" that contains a hash table for each of the
 // sub-channels that are reading from this socket.
 
+// Sending RTP-over-TCP never blocks.  If a socket is backed up (because the receiver - or the network - isn't
+// keeping up), its "SocketDescriptor" queues the output (up to RTPINTERFACE_MAX_TCP_BACKLOG_SIZE bytes), and
+// sends it when the socket becomes writable.  Beyond that size, packets get dropped: video non-reference
+// frames first, then the rest of a video stream up to its next key frame, then any other RTP packets.
+// (RTCP packets and RTSP responses are never dropped.)  A video stream that has been skipped ahead waits at most
+// RTPINTERFACE_KEY_FRAME_WAIT_MS for its next key frame; after that, it resumes as soon as the backlog has drained.
+
+#ifndef RTPINTERFACE_MAX_TCP_BACKLOG_SIZE
+#define RTPINTERFACE_MAX_TCP_BACKLOG_SIZE 1000000
+#endif
+#ifndef RTPINTERFACE_KEY_FRAME_WAIT_MS
+#define RTPINTERFACE_KEY_FRAME_WAIT_MS 2000
+#endif
+#ifndef RTPINTERFACE_BLOCKING_WRITE_TIMEOUT_MS
+#define RTPINTERFACE_BLOCKING_WRITE_TIMEOUT_MS 500
+#endif
+#define MAX_TCP_OUTPUT_BUFFERS 64 // per "writev()"
+
+// How a packet may be dropped, if its socket is backed up (in the order in which packets get dropped):
+enum {
+  TCP_PACKET_NON_REFERENCE, // part of a video frame that no other frame depends on
+  TCP_PACKET_REFERENCE, // part of any other video frame
+  TCP_PACKET_KEY_FRAME_START, // the start of a video key frame (or of its parameter sets)
+  TCP_PACKET_OTHER, // any other RTP packet
+  TCP_PACKET_ESSENTIAL // never dropped (RTCP packets, and RTSP responses)
+};
+
 static HashTable* socketHashTable(UsageEnvironment& env, Boolean createIfNotPresent = True) {
   _Tables* ourTables = _Tables::getOurTables(env, createIfNotPresent);
   if (ourTables == NULL) return NULL;
@@ -45,6 +76,63 @@ static HashTable* socketHashTable(UsageEnvironment& env, Boolean createIfNotPres
   return (HashTable*)(ourTables->socketTable);
 }
 
+// Output that is waiting to be sent over a TCP socket:
+class tcpOutputChunk {
+public:
+  tcpOutputChunk(u_int8_t const* data1, unsigned size1, u_int8_t const* data2, unsigned size2,
+         unsigned numBytesAlreadySent, u_int8_t streamChannelId, u_int8_t packetClass)
+    : fNext(NULL), fSize(size1+size2), fNumBytesSent(numBytesAlreadySent),
+      fStreamChannelId(streamChannelId), fPacketClass(packetClass) {
+    fData = new u_int8_t[fSize];
+    memmove(fData, data1, size1);
+    if (size2 > 0) memmove(&fData[size1], data2, size2);
+  }
+  virtual ~tcpOutputChunk() { delete[] fData; }
+
+public:
+  tcpOutputChunk* fNext;
+  u_int8_t* fData;
+  unsigned fSize, fNumBytesSent;
+  u_int8_t fStreamChannelId, fPacketClass;
+};
+
+struct tcpOutputBuffer {
+  u_int8_t const* data;
+  unsigned size;
+};
+
+// Sends as much as possible of "buffers" (in order) over a non-blocking TCP socket - using a single "writev()" where
+// possible.  Returns the number of bytes sent (0 if the socket is full), or -1 if the socket has failed.
+static int sendBuffers(UsageEnvironment& env, int socketNum, tcpOutputBuffer const* buffers, unsigned numBuffers) {
+#if !defined(__WIN32__) && !defined(_WIN32)
+  struct iovec iov[MAX_TCP_OUTPUT_BUFFERS];
+  if (numBuffers > MAX_TCP_OUTPUT_BUFFERS) numBuffers = MAX_TCP_OUTPUT_BUFFERS;
+  for (unsigned i = 0; i < numBuffers; ++i) {
+    iov[i].iov_base = (void*)buffers[i].data;
+    iov[i].iov_len = buffers[i].size;
+  }
+
+  int result = writev(socketNum, iov, numBuffers);
+  if (result < 0) {
+    int err = env.getErrno();
+    return (err == EAGAIN || err == EWOULDBLOCK || err == EINTR) ? 0 : -1;
+  }
+  return result;
+#else
+  int totalSent = 0;
+  for (unsigned i = 0; i < numBuffers; ++i) {
+    int result = send(socketNum, (char const*)buffers[i].data, buffers[i].size, 0/*flags*/);
+    if (result < 0) {
+      if (env.getErrno() == EWOULDBLOCK) break;
+      return totalSent > 0 ? totalSent : -1;
+    }
+    totalSent += result;
+    if ((unsigned)result < buffers[i].size) break;
+  }
+  return totalSent;
+#endif
+}
+
 class SocketDescriptor {
 public:
   SocketDescriptor(UsageEnvironment& env, int socketNum);
@@ -55,15 +143,29 @@ public:
   RTPInterface* lookupRTPInterface(unsigned char streamChannelId);
   void deregisterRTPInterface(unsigned char streamChannelId);
 
-  void setServerRequestAlternativeByteHandler(ServerRequestAlternativeByteHandler* handler, void* clientData) {
-    fServerRequestAlternativeByteHandler = handler;
-    fServerRequestAlternativeByteHandlerClientData = clientData;
-  }
+  void setServerRequestAlternativeByteHandler(ServerRequestAlternativeByteHandler* handler, void* clientData);
+
+  Boolean sendPacket(u_int8_t const* framingHeader, u_int8_t const* packet, unsigned packetSize,
+             u_int8_t streamChannelId, u_int8_t packetClass);
+      // Sends - or queues, or (if too much is queued already) drops - a RTP or RTCP packet.
+      // Returns False iff the socket has failed.
+  Boolean sendData(u_int8_t const* data, unsigned dataSize); // like "sendPacket()", but the data is never dropped
+  void getBacklogStats(RTPOverTCPBacklogStats& stats) const { stats = fBacklogStats; }
 
 private:
+  static void tcpSocketHandler(SocketDescriptor*, int mask);
   static void tcpReadHandler(SocketDescriptor*, int mask);
   Boolean tcpReadHandler1(int mask);
 
+  void queueOutput(u_int8_t const* data1, unsigned size1, u_int8_t const* data2, unsigned size2,
+           unsigned numBytesAlreadySent, u_int8_t streamChannelId, u_int8_t packetClass);
+  Boolean makeRoomFor(unsigned frameSize, u_int8_t streamChannelId, u_int8_t packetClass);
+  Boolean isStillAwaitingKeyFrame(u_int8_t streamChannelId, u_int8_t packetClass);
+  void dropQueuedPackets(int streamChannelId/*-1 means any*/, u_int8_t maxPacketClass, unsigned numBytesWanted/*0 means all*/);
+  Boolean flushOutput(); // returns False iff the socket has failed
+  void finishOutput();
+  void updateBackgroundHandling();
+
 private:
   UsageEnvironment& fEnv;
   int fOurSocketNum;
@@ -73,6 +175,14 @@ private:
   u_int8_t fStreamChannelId, fSizeByte1;
   Boolean fReadErrorOccurred, fDeleteMyselfNext, fAreInReadHandlerLoop;
   enum { AWAITING_DOLLAR, AWAITING_STREAM_CHANNEL_ID, AWAITING_SIZE1, AWAITING_SIZE2, AWAITING_PACKET_DATA } fTCPReadingState;
+
+  // Output that's waiting for the socket to become writable:
+  tcpOutputChunk* fOutputQueue;
+  tcpOutputChunk** fOutputQueueTail;
+  Boolean fAreHandlingWrites;
+  Boolean fIsAwaitingKeyFrame[256]; // indexed by stream channel id
+  struct timeval fKeyFrameWaitStart[256]; // ditto; when we started waiting
+  RTPOverTCPBacklogStats fBacklogStats;
 };
 
 static SocketDescriptor* lookupSocketDescriptor(UsageEnvironment& env, int sockNum, Boolean createIfNotFound = True) {
@@ -213,6 +323,33 @@ void RTPInterface::clearServerRequestAlternativeByteHandler(UsageEnvironment& en
   setServerRequestAlternativeByteHandler(env, socketNum, NULL, NULL);
 }
 
+void RTPInterface::noteServerRequestAlternativeByteHandler(int socketNum,
+                               ServerRequestAlternativeByteHandler* handler, void* clientData) {
+  for (tcpStreamRecord* stream = fTCPStreams; stream != NULL; stream = stream->fNext) {
+    if (stream->fStreamSocketNum == socketNum) {
+      stream->fServerRequestAlternativeByteHandler = handler;
+      stream->fServerRequestAlternativeByteHandlerClientData = clientData;
+    }
+  }
+}
+
+Boolean RTPInterface::sendNonRTPDataOverTCP(UsageEnvironment& env, int socketNum,
+                        u_int8_t const* data, unsigned dataSize) {
+  SocketDescriptor* socketDescriptor = lookupSocketDescriptor(env, socketNum, False);
+  if (socketDescriptor != NULL) return socketDescriptor->sendData(data, dataSize);
+
+  // The socket isn't carrying RTP/RTCP, so just send the data:
+  return send(socketNum, (char const*)data, dataSize, 0/*flags*/) >= 0;
+}
+
+Boolean RTPInterface::getTCPBacklogStats(UsageEnvironment& env, int socketNum, RTPOverTCPBacklogStats& stats) {
+  SocketDescriptor* socketDescriptor = lookupSocketDescriptor(env, socketNum, False);
+  if (socketDescriptor == NULL) return False;
+
+  socketDescriptor->getBacklogStats(stats);
+  return True;
+}
+
 Boolean RTPInterface::sendPacket(unsigned char* packet, unsigned packetSize) {
   Boolean success = True; // we'll return False instead if any of the sends fail
 
@@ -300,6 +437,21 @@ Boolean RTPInterface::handleRead(unsigned char* buffer, unsigned bufferMaxSize,
   return readSuccess;
 }
 
+int RTPInterface::handleReadBatch(unsigned char* buffer, unsigned slotSize, unsigned maxPackets,
+                  unsigned* bytesRead, struct sockaddr_in* fromAddresses,
+                  Boolean* truncated) {
+  int numRead = fGS->handleReadBatch(buffer, slotSize, maxPackets,
+                     bytesRead, fromAddresses, truncated);
+
+  if (fAuxReadHandlerFunc != NULL) {
+    // Also pass each newly-read packet to our auxilliary handler:
+    for (int i = 0; i < numRead; ++i) {
+      (*fAuxReadHandlerFunc)(fAuxReadHandlerClientData, &buffer[i*slotSize], bytesRead[i]);
+    }
+  }
+  return numRead;
+}
+
 void RTPInterface::stopNetworkReading() {
   // Normal case
   if (fGS != NULL) envir().taskScheduler().turnOffBackgroundReadHandling(fGS->socketNum());
@@ -313,96 +465,117 @@ void RTPInterface::stopNetworkReading() {
 
 ////////// Helper Functions - Implementation /////////
 
+// Returns how - if its socket is backed up - a RTP or RTCP packet that's being sent by "owner" may be dropped:
+static u_int8_t classifyPacket(Medium* owner, u_int8_t const* packet, unsigned packetSize) {
+  if (owner == NULL || owner->isRTCPInstance()) return TCP_PACKET_ESSENTIAL;
+  if (!owner->isSink() || !((MediaSink*)owner)->isRTPSink()) return TCP_PACKET_OTHER;
+  char const* payloadFormatName = ((RTPSink*)owner)->rtpPayloadFormatName();
+
+  // Skip over the RTP header (including any CSRCs and header extension) to the payload:
+  if (packetSize < 12) return TCP_PACKET_OTHER;
+  unsigned headerSize = 12 + 4*(packet[0]&0x0F);
+  if ((packet[0]&0x10) != 0) { // there's a header extension
+    if (packetSize < headerSize + 4) return TCP_PACKET_OTHER;
+    headerSize += 4 + 4*((packet[headerSize+2]<<8)|packet[headerSize+3]);
+  }
+  if (packetSize < headerSize + 3) return TCP_PACKET_OTHER;
+  u_int8_t const* p = &packet[headerSize];
+
+  if (strcmp(payloadFormatName, "H264") == 0) {
+    u_int8_t nri = p[0]&0x60;
+    u_int8_t nalUnitType = p[0]&0x1F;
+    Boolean isStart = True;
+    if (nalUnitType == 24) { // STAP-A: use the first aggregated NAL unit
+      if (packetSize < headerSize + 4) return TCP_PACKET_REFERENCE;
+      nri = p[3]&0x60;
+      nalUnitType = p[3]&0x1F;
+    } else if (nalUnitType == 28 || nalUnitType == 29) { // FU-A or FU-B
+      isStart = (p[1]&0x80) != 0;
+      nalUnitType = p[1]&0x1F;
+    }
+    if (nalUnitType == 7/*SPS*/ || (nalUnitType == 5/*IDR*/ && isStart)) return TCP_PACKET_KEY_FRAME_START;
+    return nri == 0 ? TCP_PACKET_NON_REFERENCE : TCP_PACKET_REFERENCE;
+  } else if (strcmp(payloadFormatName, "H265") == 0) {
+    u_int8_t nalUnitType = (p[0]&0x7E)>>1;
+    Boolean isStart = True;
+    if (nalUnitType == 48) { // AP: use the first aggregated NAL unit
+      if (packetSize < headerSize + 5) return TCP_PACKET_REFERENCE;
+      nalUnitType = (p[4]&0x7E)>>1;
+    } else if (nalUnitType == 49) { // FU
+      isStart = (p[2]&0x80) != 0;
+      nalUnitType = p[2]&0x3F;
+    }
+    if (nalUnitType == 32/*VPS*/ || nalUnitType == 33/*SPS*/
+    || (nalUnitType >= 16 && nalUnitType <= 21/*IRAP*/ && isStart)) return TCP_PACKET_KEY_FRAME_START;
+    // Sub-layer non-reference pictures have even-numbered types, up to 14:
+    return (nalUnitType <= 14 && (nalUnitType&1) == 0) ? TCP_PACKET_NON_REFERENCE : TCP_PACKET_REFERENCE;
+  }
+
+  return TCP_PACKET_OTHER;
+}
+
 Boolean RTPInterface::sendRTPorRTCPPacketOverTCP(u_int8_t* packet, unsigned packetSize,
                          int socketNum, unsigned char streamChannelId) {
 #ifdef DEBUG_SEND
   fprintf(stderr, "sendRTPorRTCPPacketOverTCP: %d bytes over channel %d (socket %d)\n",
       packetSize, streamChannelId, socketNum); fflush(stderr);
 #endif
+  SocketDescriptor* socketDescriptor = lookupSocketDescriptor(envir(), socketNum, False);
+  if (socketDescriptor == NULL) {
+    // This stream has lost its descriptor, but the socket may still be fine.  Set it up again, as "addStreamSocket()"
+    // does, so that the packet gets queued (rather than the socket being given up on):
+    socketDescriptor = lookupSocketDescriptor(envir(), socketNum);
+    socketDescriptor->registerRTPInterface(streamChannelId, this);
+
+    // The new descriptor now reads the socket, so it must also pass on any RTSP bytes, as the old one did:
+    for (tcpStreamRecord* stream = fTCPStreams; stream != NULL; stream = stream->fNext) {
+      if (stream->fStreamSocketNum == socketNum && stream->fServerRequestAlternativeByteHandler != NULL) {
+    socketDescriptor->setServerRequestAlternativeByteHandler(stream->fServerRequestAlternativeByteHandler,
+                                 stream->fServerRequestAlternativeByteHandlerClientData);
+    break;
+      }
+    }
+  }
+
   // Send a RTP/RTCP packet over TCP, using the encoding defined in RFC 2326, section 10.12:
   //     $<streamChannelId><packetSize><packet>
-  // (If the initial "send()" of '$<streamChannelId><packetSize>' succeeds, then we force
-  // the subsequent "send()" for the <packet> data to succeed, even if we have to do so with
-  // a blocking "send()".)
-  do {
-    u_int8_t framingHeader[4];
-    framingHeader[0] = '$';
-    framingHeader[1] = streamChannelId;
-    framingHeader[2] = (u_int8_t) ((packetSize&0xFF00)>>8);
-    framingHeader[3] = (u_int8_t) (packetSize&0xFF);
-    if (!sendDataOverTCP(socketNum, framingHeader, 4, False)) break;
-
-    if (!sendDataOverTCP(socketNum, packet, packetSize, True)) break;
+  // (The framing header and the packet are sent together.  Whatever can't be sent now gets queued - in full -
+  // so that the stream never becomes misframed.)
+  u_int8_t framingHeader[4];
+  framingHeader[0] = '$';
+  framingHeader[1] = streamChannelId;
+  framingHeader[2] = (u_int8_t) ((packetSize&0xFF00)>>8);
+  framingHeader[3] = (u_int8_t) (packetSize&0xFF);
+  if (socketDescriptor->sendPacket(framingHeader, packet, packetSize, streamChannelId,
+                   classifyPacket(fOwner, packet, packetSize))) {
 #ifdef DEBUG_SEND
     fprintf(stderr, "sendRTPorRTCPPacketOverTCP: completed\n"); fflush(stderr);
 #endif
-
     return True;
-  } while (0);
+  }
 
+  // Because the socket failed, assume that it's now unusable, so stop using it (for both RTP and RTCP):
 #ifdef DEBUG_SEND
   fprintf(stderr, "sendRTPorRTCPPacketOverTCP: failed! (errno %d)\n", envir().getErrno()); fflush(stderr);
 #endif
+  removeStreamSocket(socketNum, 0xFF);
   return False;
 }
 
-#ifndef RTPINTERFACE_BLOCKING_WRITE_TIMEOUT_MS
-#define RTPINTERFACE_BLOCKING_WRITE_TIMEOUT_MS 500
-#endif
-
-Boolean RTPInterface::sendDataOverTCP(int socketNum, u_int8_t const* data, unsigned dataSize, Boolean forceSendToSucceed) {
-  int sendResult = send(socketNum, (char const*)data, dataSize, 0/*flags*/);
-  if (sendResult < (int)dataSize) {
-    // The TCP send() failed - at least partially.
-
-    unsigned numBytesSentSoFar = sendResult < 0 ? 0 : (unsigned)sendResult;
-    if (numBytesSentSoFar > 0 || (forceSendToSucceed && envir().getErrno() == EAGAIN)) {
-      // The OS's TCP send buffer has filled up (because the stream's bitrate has exceeded
-      // the capacity of the TCP connection!).
-      // Force this data write to succeed, by blocking if necessary until it does:
-      unsigned numBytesRemainingToSend = dataSize - numBytesSentSoFar;
-#ifdef DEBUG_SEND
-      fprintf(stderr, "sendDataOverTCP: resending %d-byte send (blocking)\n", numBytesRemainingToSend); fflush(stderr);
-#endif
-      makeSocketBlocking(socketNum, RTPINTERFACE_BLOCKING_WRITE_TIMEOUT_MS);
-      sendResult = send(socketNum, (char const*)(&data[numBytesSentSoFar]), numBytesRemainingToSend, 0/*flags*/);
-      if ((unsigned)sendResult != numBytesRemainingToSend) {
-    // The blocking "send()" failed, or timed out.  In either case, we assume that the
-    // TCP connection has failed (or is 'hanging' indefinitely), and we stop using it
-    // (for both RTP and RTP).
-    // (If we kept using the socket here, the RTP or RTCP packet write would be in an
-    //  incomplete, inconsistent state.)
-#ifdef DEBUG_SEND
-    fprintf(stderr, "sendDataOverTCP: blocking send() failed (delivering %d bytes out of %d); closing socket %d\n", sendResult, numBytesRemainingToSend, socketNum); fflush(stderr);
-#endif
-    removeStreamSocket(socketNum, 0xFF);
-    return False;
-      }
-      makeSocketNonBlocking(socketNum);
-
-      return True;
-    } else if (sendResult < 0 && envir().getErrno() != EAGAIN) {
-      // Because the "send()" call failed, assume that the socket is now unusable, so stop
-      // using it (for both RTP and RTCP):
-      removeStreamSocket(socketNum, 0xFF);
-    }
-
-    return False;
-  }
-
-  return True;
-}
-
 SocketDescriptor::SocketDescriptor(UsageEnvironment& env, int socketNum)
   :fEnv(env), fOurSocketNum(socketNum),
     fSubChannelHashTable(HashTable::create(ONE_WORD_HASH_KEYS)),
    fServerRequestAlternativeByteHandler(NULL), fServerRequestAlternativeByteHandlerClientData(NULL),
-   fReadErrorOccurred(False), fDeleteMyselfNext(False), fAreInReadHandlerLoop(False), fTCPReadingState(AWAITING_DOLLAR) {
+   fReadErrorOccurred(False), fDeleteMyselfNext(False), fAreInReadHandlerLoop(False), fTCPReadingState(AWAITING_DOLLAR),
+   fOutputQueue(NULL), fOutputQueueTail(&fOutputQueue), fAreHandlingWrites(False) {
+  memset(fIsAwaitingKeyFrame, 0, sizeof fIsAwaitingKeyFrame);
+  memset(&fBacklogStats, 0, sizeof fBacklogStats);
 }
 
 SocketDescriptor::~SocketDescriptor() {
   fEnv.taskScheduler().turnOffBackgroundReadHandling(fOurSocketNum);
   removeSocketDescription(fEnv, fOurSocketNum);
+  finishOutput();
 
   if (fSubChannelHashTable != NULL) {
     // Remove knowledge of this socket from any "RTPInterface"s that are using it:
@@ -441,14 +614,242 @@ void SocketDescriptor::registerRTPInterface(unsigned char streamChannelId,
 #endif
   fSubChannelHashTable->Add((char const*)(long)streamChannelId,
                 rtpInterface);
+  if (fServerRequestAlternativeByteHandler != NULL) {
+    rtpInterface->noteServerRequestAlternativeByteHandler(fOurSocketNum, fServerRequestAlternativeByteHandler,
+                              fServerRequestAlternativeByteHandlerClientData);
+  }
 
   if (isFirstRegistration) {
-    // Arrange to handle reads on this TCP socket:
-    TaskScheduler::BackgroundHandlerProc* handler
-      = (TaskScheduler::BackgroundHandlerProc*)&tcpReadHandler;
-    fEnv.taskScheduler().
-      setBackgroundHandling(fOurSocketNum, SOCKET_READABLE|SOCKET_EXCEPTION, handler, this);
+    // Arrange to handle reads (and, when we have queued output, writes) on this TCP socket:
+    updateBackgroundHandling();
+  }
+}
+
+void SocketDescriptor::updateBackgroundHandling() {
+  fAreHandlingWrites = fOutputQueue != NULL;
+  TaskScheduler::BackgroundHandlerProc* handler
+    = (TaskScheduler::BackgroundHandlerProc*)&tcpSocketHandler;
+  fEnv.taskScheduler().
+    setBackgroundHandling(fOurSocketNum, SOCKET_READABLE|SOCKET_EXCEPTION|(fAreHandlingWrites ? SOCKET_WRITABLE : 0),
+              handler, this);
+}
+
+Boolean SocketDescriptor::sendPacket(u_int8_t const* framingHeader, u_int8_t const* packet, unsigned packetSize,
+                     u_int8_t streamChannelId, u_int8_t packetClass) {
+  unsigned frameSize = 4 + packetSize;
+  Boolean isVideo = packetClass <= TCP_PACKET_KEY_FRAME_START;
+
+  if (isVideo && isStillAwaitingKeyFrame(streamChannelId, packetClass)) {
+    // We skipped ahead (because we were backed up), so don't send anything on this channel until its next key frame:
+    ++fBacklogStats.numPacketsDropped;
+    fBacklogStats.numBytesDropped += frameSize;
+    return True;
+  }
+
+  if (fOutputQueue == NULL) {
+    // Common case: Nothing is queued, so try to send the whole frame now:
+    tcpOutputBuffer buffers[2];
+    buffers[0].data = framingHeader; buffers[0].size = 4;
+    buffers[1].data = packet; buffers[1].size = packetSize;
+    int sendResult = sendBuffers(fEnv, fOurSocketNum, buffers, 2);
+    if (sendResult < 0) return False;
+    if ((unsigned)sendResult == frameSize) return True;
+
+    // The OS's TCP send buffer has filled up (because the stream's bitrate has exceeded the capacity of the
+    // TCP connection!).  Queue the rest of the frame, to be sent when the socket becomes writable:
+    queueOutput(framingHeader, 4, packet, packetSize, (unsigned)sendResult, streamChannelId, packetClass);
+    return True;
+  }
+
+  if (fBacklogStats.queuedBytes + frameSize > RTPINTERFACE_MAX_TCP_BACKLOG_SIZE
+      && !makeRoomFor(frameSize, streamChannelId, packetClass)) {
+    ++fBacklogStats.numPacketsDropped;
+    fBacklogStats.numBytesDropped += frameSize;
+    return True; // the packet was dropped, but the socket is still OK
+  }
+
+  queueOutput(framingHeader, 4, packet, packetSize, 0, streamChannelId, packetClass);
+  return True;
+}
+
+Boolean SocketDescriptor::sendData(u_int8_t const* data, unsigned dataSize) {
+  if (fOutputQueue == NULL) {
+    tcpOutputBuffer buffer;
+    buffer.data = data; buffer.size = dataSize;
+    int sendResult = sendBuffers(fEnv, fOurSocketNum, &buffer, 1);
+    if (sendResult < 0) return False;
+    if ((unsigned)sendResult == dataSize) return True;
+
+    queueOutput(data, dataSize, NULL, 0, (unsigned)sendResult, 0xFF, TCP_PACKET_ESSENTIAL);
+    return True;
+  }
+
+  // Queue the data behind the RTP/RTCP packets that are already waiting, so that the stream stays properly framed:
+  queueOutput(data, dataSize, NULL, 0, 0, 0xFF, TCP_PACKET_ESSENTIAL);
+  return True;
+}
+
+void SocketDescriptor::queueOutput(u_int8_t const* data1, unsigned size1, u_int8_t const* data2, unsigned size2,
+                   unsigned numBytesAlreadySent, u_int8_t streamChannelId, u_int8_t packetClass) {
+  tcpOutputChunk* chunk
+    = new tcpOutputChunk(data1, size1, data2, size2, numBytesAlreadySent, streamChannelId, packetClass);
+  *fOutputQueueTail = chunk;
+  fOutputQueueTail = &chunk->fNext;
+
+  fBacklogStats.queuedBytes += chunk->fSize - numBytesAlreadySent;
+  ++fBacklogStats.queuedPackets;
+  if (fBacklogStats.queuedBytes > fBacklogStats.maxQueuedBytes) fBacklogStats.maxQueuedBytes = fBacklogStats.queuedBytes;
+
+  if (!fAreHandlingWrites) updateBackgroundHandling();
+}
+
+Boolean SocketDescriptor::makeRoomFor(unsigned frameSize, u_int8_t streamChannelId, u_int8_t packetClass) {
+  // Our backlog is full.  Returns True iff we've made enough room to queue the new frame; False if it should be dropped.
+  if (packetClass == TCP_PACKET_ESSENTIAL) return True; // we always queue these
+  if (packetClass == TCP_PACKET_NON_REFERENCE || packetClass == TCP_PACKET_OTHER) return False;
+
+  // First, drop queued non-reference frames (from any stream):
+  unsigned numBytesWanted = fBacklogStats.queuedBytes + frameSize - RTPINTERFACE_MAX_TCP_BACKLOG_SIZE;
+  dropQueuedPackets(-1, TCP_PACKET_NON_REFERENCE, numBytesWanted);
+  if (fBacklogStats.queuedBytes + frameSize <= RTPINTERFACE_MAX_TCP_BACKLOG_SIZE) return True;
+
+  // That wasn't enough, so skip this stream ahead to its next key frame.  (The queued frames - and any new frames
+  // before the next key frame - would be useless without the frames that we'd have to drop.)
+  dropQueuedPackets(streamChannelId, TCP_PACKET_KEY_FRAME_START, 0/*all*/);
+  ++fBacklogStats.numKeyFrameSkips;
+  if (packetClass == TCP_PACKET_KEY_FRAME_START
+      && fBacklogStats.queuedBytes + frameSize <= RTPINTERFACE_MAX_TCP_BACKLOG_SIZE) {
+    return True;
+  }
+
+  fIsAwaitingKeyFrame[streamChannelId] = True;
+  gettimeofday(&fKeyFrameWaitStart[streamChannelId], NULL);
+  return False;
+}
+
+Boolean SocketDescriptor::isStillAwaitingKeyFrame(u_int8_t streamChannelId, u_int8_t packetClass) {
+  if (!fIsAwaitingKeyFrame[streamChannelId]) return False;
+
+  if (packetClass != TCP_PACKET_KEY_FRAME_START) {
+    // Keep waiting, unless the key frame is overdue (e.g., because the stream uses 'intra refresh' rather than key frames)
+    // and our backlog has drained.  (If the backlog is still there, resuming now would just overflow it again.)
+    if (fOutputQueue != NULL) return True;
+
+    struct timeval timeNow;
+    gettimeofday(&timeNow, NULL);
+    struct timeval const& waitStart = fKeyFrameWaitStart[streamChannelId];
+    int64_t waitMs = (int64_t)(timeNow.tv_sec - waitStart.tv_sec)*1000 + (timeNow.tv_usec - waitStart.tv_usec)/1000;
+    if (waitMs < RTPINTERFACE_KEY_FRAME_WAIT_MS) return True;
+
+    ++fBacklogStats.numKeyFrameWaitTimeouts;
   }
+
+  fIsAwaitingKeyFrame[streamChannelId] = False;
+  return False;
+}
+
+void SocketDescriptor::dropQueuedPackets(int streamChannelId, u_int8_t maxPacketClass, unsigned numBytesWanted) {
+  // Note: We never drop the head of the queue if it's been partially sent, because the receiver would then be misframed.
+  unsigned numBytesDropped = 0;
+  tcpOutputChunk** chunkPtr = &fOutputQueue;
+  while (*chunkPtr != NULL && (numBytesWanted == 0 || numBytesDropped < numBytesWanted)) {
+    tcpOutputChunk* chunk = *chunkPtr;
+    if (chunk->fNumBytesSent == 0 && chunk->fPacketClass <= maxPacketClass
+    && (streamChannelId < 0 || chunk->fStreamChannelId == streamChannelId)) {
+      *chunkPtr = chunk->fNext;
+      if (fOutputQueueTail == &chunk->fNext) fOutputQueueTail = chunkPtr;
+
+      numBytesDropped += chunk->fSize;
+      fBacklogStats.queuedBytes -= chunk->fSize;
+      --fBacklogStats.queuedPackets;
+      ++fBacklogStats.numPacketsDropped;
+      fBacklogStats.numBytesDropped += chunk->fSize;
+      delete chunk;
+    } else {
+      chunkPtr = &chunk->fNext;
+    }
+  }
+}
+
+Boolean SocketDescriptor::flushOutput() {
+  while (fOutputQueue != NULL) {
+    tcpOutputBuffer buffers[MAX_TCP_OUTPUT_BUFFERS];
+    unsigned numBuffers = 0;
+    for (tcpOutputChunk* chunk = fOutputQueue; chunk != NULL && numBuffers < MAX_TCP_OUTPUT_BUFFERS; chunk = chunk->fNext) {
+      buffers[numBuffers].data = &chunk->fData[chunk->fNumBytesSent];
+      buffers[numBuffers].size = chunk->fSize - chunk->fNumBytesSent;
+      ++numBuffers;
+    }
+
+    int sendResult = sendBuffers(fEnv, fOurSocketNum, buffers, numBuffers);
+    if (sendResult < 0) return False;
+    if (sendResult == 0) break; // the socket is full again
+
+    // Advance past the data that got sent:
+    unsigned numBytesSent = (unsigned)sendResult;
+    fBacklogStats.queuedBytes -= numBytesSent;
+    while (numBytesSent > 0) {
+      tcpOutputChunk* chunk = fOutputQueue;
+      unsigned chunkRemaining = chunk->fSize - chunk->fNumBytesSent;
+      if (numBytesSent < chunkRemaining) {
+    chunk->fNumBytesSent += numBytesSent;
+    break;
+      }
+
+      numBytesSent -= chunkRemaining;
+      fOutputQueue = chunk->fNext;
+      if (fOutputQueue == NULL) fOutputQueueTail = &fOutputQueue;
+      --fBacklogStats.queuedPackets;
+      delete chunk;
+    }
+  }
+
+  if (fOutputQueue == NULL && fAreHandlingWrites) updateBackgroundHandling(); // stop handling writes
+  return True;
+}
+
+void SocketDescriptor::finishOutput() {
+  // We're going away, so drop any RTP packets that haven't started to be sent:
+  dropQueuedPackets(-1, TCP_PACKET_OTHER, 0/*all*/);
+
+  if (fOutputQueue != NULL && !fReadErrorOccurred) {
+    // Complete any partially-sent packet (so that the socket - if it's still used for RTSP - stays properly framed),
+    // and send any RTCP packets or RTSP responses, blocking (but not indefinitely) if necessary:
+    makeSocketBlocking(fOurSocketNum, RTPINTERFACE_BLOCKING_WRITE_TIMEOUT_MS);
+    while (fOutputQueue != NULL) {
+      tcpOutputChunk* chunk = fOutputQueue;
+      int sendResult = send(fOurSocketNum, (char const*)&chunk->fData[chunk->fNumBytesSent],
+                chunk->fSize - chunk->fNumBytesSent, 0/*flags*/);
+      if (sendResult <= 0) break; // the socket has failed, or timed out
+      chunk->fNumBytesSent += sendResult;
+      if (chunk->fNumBytesSent < chunk->fSize) continue;
+
+      fOutputQueue = chunk->fNext;
+      delete chunk;
+    }
+    makeSocketNonBlocking(fOurSocketNum);
+  }
+
+  while (fOutputQueue != NULL) {
+    tcpOutputChunk* chunk = fOutputQueue;
+    fOutputQueue = chunk->fNext;
+    delete chunk;
+  }
+  fOutputQueueTail = &fOutputQueue;
+}
+
+void SocketDescriptor::setServerRequestAlternativeByteHandler(ServerRequestAlternativeByteHandler* handler, void* clientData) {
+  fServerRequestAlternativeByteHandler = handler;
+  fServerRequestAlternativeByteHandlerClientData = clientData;
+
+  // Also tell the "RTPInterface"s that are using us, in case we get deleted (and recreated) while they're still streaming:
+  HashTable::Iterator* iter = HashTable::Iterator::create(*fSubChannelHashTable);
+  RTPInterface* rtpInterface;
+  char const* key;
+  while ((rtpInterface = (RTPInterface*)(iter->next(key))) != NULL) {
+    rtpInterface->noteServerRequestAlternativeByteHandler(fOurSocketNum, handler, clientData);
+  }
+  delete iter;
 }
 
 RTPInterface* SocketDescriptor
@@ -474,6 +875,17 @@ void SocketDescriptor
   }
 }
 
+void SocketDescriptor::tcpSocketHandler(SocketDescriptor* socketDescriptor, int mask) {
+  if ((mask&SOCKET_WRITABLE) != 0 && !socketDescriptor->flushOutput()) {
+    // The socket has failed.  Handle this the same way as a read error:
+    socketDescriptor->fReadErrorOccurred = True;
+    delete socketDescriptor;
+    return;
+  }
+
+  if ((mask&(SOCKET_READABLE|SOCKET_EXCEPTION)) != 0) tcpReadHandler(socketDescriptor, mask);
+}
+
 void SocketDescriptor::tcpReadHandler(SocketDescriptor* socketDescriptor, int mask) {
   // Call the read handler until it returns false, with a limit to avoid starving other sockets
   unsigned count = 2000;
@@ -612,7 +1024,8 @@ tcpStreamRecord
 ::tcpStreamRecord(int streamSocketNum, unsigned char streamChannelId,
           tcpStreamRecord* next)
   : fNext(next),
-    fStreamSocketNum(streamSocketNum), fStreamChannelId(streamChannelId) {
+    fStreamSocketNum(streamSocketNum), fStreamChannelId(streamChannelId),
+    fServerRequestAlternativeByteHandler(NULL), fServerRequestAlternativeByteHandlerClientData(NULL) {
 }
 
 tcpStreamRecord::~tcpStreamRecord() {
@@ -44,6 +44,10 @@ Boolean RTPSource::hasBeenSynchronizedUsingRTCP() {
   return fCurPacketHasBeenSynchronizedUsingRTCP;
 }
 
+void RTPSource::setReceiveBatch(unsigned /*maxPackets*/, unsigned /*slotSize*/) {
+  // Default implementation: Do nothing
+}
+
 Boolean RTPSource::isRTPSource() const {
   return True;
 }
@@ -55,6 +59,7 @@ RTPSource::RTPSource(UsageEnvironment& env, Groupsock* RTPgs,
     fRTPInterface(this, RTPgs),
     fCurPacketHasBeenSynchronizedUsingRTCP(False), fLastReceivedSSRC(0),
     fRTCPInstanceForMultiplexedRTCPPackets(NULL),
+    fNumReceiveBatches(0), fNumBatchedPackets(0), fMaxReceiveBatchSize(0),
     fRTPPayloadFormat(rtpPayloadFormat), fTimestampFrequency(rtpTimestampFrequency),
     fSSRC(our_random32()), fEnableRTCPReports(True) {
   fReceptionStatsDB = new RTPReceptionStatsDB();
@@ -24,6 +24,154 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "Locale.hh"
 #include <GroupsockHelper.hh>
 #include "ourMD5.hh"
+#if !defined(__WIN32__) && !defined(_WIN32)
+#include <netinet/tcp.h>
+#endif
+
+////////// DescribeCache //////////
+
+// The SDP descriptions returned by "DESCRIBE" commands, keyed by URL.  There is (at most) one of these per "UsageEnvironment";
+// it is deleted when its last entry is removed (or has expired).
+
+#define DESCRIBE_CACHE_MAX_ENTRIES 1024
+
+class DescribeCache {
+public:
+  static DescribeCache* ourCache(UsageEnvironment& env, Boolean createIfNotPresent);
+
+  Boolean lookup(char const* url, char const*& sdpDescription, char const*& baseURL);
+      // returns False if "url" has no entry, or if its entry has expired
+  void store(char const* url, char const* sdpDescription, char const* baseURL, unsigned ttlSeconds);
+  void remove(char const* url); // "url" == NULL means all entries
+      // Note: These may delete the cache (if it becomes empty)
+
+private:
+  DescribeCache(UsageEnvironment& env);
+  virtual ~DescribeCache();
+
+  struct Entry {
+    char* sdpDescription;
+    char* baseURL;
+    time_t expiry;
+  };
+  static void deleteEntry(Entry* entry);
+  void purge(time_t now); // removes the expired entries, and (if we're still full) the one that would expire first
+  void reclaimIfEmpty();
+
+private:
+  UsageEnvironment& fEnv;
+  HashTable* fTable;
+};
+
+static time_t describeCacheNow() {
+  struct timeval timeNow;
+  gettimeofday(&timeNow, NULL);
+  return timeNow.tv_sec;
+}
+
+DescribeCache* DescribeCache::ourCache(UsageEnvironment& env, Boolean createIfNotPresent) {
+  _Tables* ourTables = _Tables::getOurTables(env, createIfNotPresent);
+  if (ourTables == NULL) return NULL;
+
+  if (ourTables->describeCache == NULL && createIfNotPresent) {
+    ourTables->describeCache = new DescribeCache(env);
+  }
+  return (DescribeCache*)(ourTables->describeCache);
+}
+
+Boolean DescribeCache::lookup(char const* url, char const*& sdpDescription, char const*& baseURL) {
+  Entry* entry = (Entry*)(fTable->Lookup(url));
+  if (entry == NULL) return False;
+
+  if (entry->expiry <= describeCacheNow()) {
+    remove(url);
+    return False;
+  }
+  sdpDescription = entry->sdpDescription;
+  baseURL = entry->baseURL;
+  return True;
+}
+
+void DescribeCache::store(char const* url, char const* sdpDescription, char const* baseURL, unsigned ttlSeconds) {
+  time_t now = describeCacheNow();
+  if (fTable->Lookup(url) == NULL && fTable->numEntries() >= DESCRIBE_CACHE_MAX_ENTRIES) purge(now);
+
+  Entry* entry = new Entry;
+  entry->sdpDescription = strDup(sdpDescription);
+  entry->baseURL = strDup(baseURL);
+  entry->expiry = now + ttlSeconds;
+  deleteEntry((Entry*)(fTable->Add(url, entry)));
+}
+
+void DescribeCache::remove(char const* url) {
+  if (url == NULL) {
+    Entry* entry;
+    while ((entry = (Entry*)(fTable->RemoveNext())) != NULL) deleteEntry(entry);
+  } else {
+    Entry* entry = (Entry*)(fTable->Lookup(url));
+    if (entry == NULL) return;
+    fTable->Remove(url);
+    deleteEntry(entry);
+  }
+  reclaimIfEmpty();
+}
+
+DescribeCache::DescribeCache(UsageEnvironment& env)
+  : fEnv(env), fTable(HashTable::create(STRING_HASH_KEYS)) {
+}
+
+DescribeCache::~DescribeCache() {
+  Entry* entry;
+  while ((entry = (Entry*)(fTable->RemoveNext())) != NULL) deleteEntry(entry);
+  delete fTable;
+}
+
+void DescribeCache::deleteEntry(Entry* entry) {
+  if (entry == NULL) return;
+  delete[] entry->sdpDescription; delete[] entry->baseURL;
+  delete entry;
+}
+
+void DescribeCache::purge(time_t now) {
+  char const* oldestURL = NULL;
+  time_t oldestExpiry = 0;
+  char const* url;
+  Entry* entry;
+
+  // Note: We can't remove entries while iterating, so we do this in two passes:
+  HashTable* expiredTable = HashTable::create(STRING_HASH_KEYS);
+  HashTable::Iterator* iter = HashTable::Iterator::create(*fTable);
+  while ((entry = (Entry*)(iter->next(url))) != NULL) {
+    if (entry->expiry <= now) {
+      expiredTable->Add(url, entry);
+    } else if (oldestURL == NULL || entry->expiry < oldestExpiry) {
+      oldestURL = url;
+      oldestExpiry = entry->expiry;
+    }
+  }
+  delete iter;
+
+  if (expiredTable->IsEmpty() && oldestURL != NULL) {
+    expiredTable->Add(oldestURL, fTable->Lookup(oldestURL));
+  }
+  iter = HashTable::Iterator::create(*expiredTable);
+  while ((entry = (Entry*)(iter->next(url))) != NULL) {
+    fTable->Remove(url);
+    deleteEntry(entry);
+  }
+  delete iter;
+  delete expiredTable;
+}
+
+void DescribeCache::reclaimIfEmpty() {
+  if (!fTable->IsEmpty()) return;
+
+  _Tables* ourTables = _Tables::getOurTables(fEnv, False);
+  if (ourTables == NULL) return;
+  delete this;
+  ourTables->describeCache = NULL;
+  ourTables->reclaimIfPossible();
+}
 
 ////////// RTSPClient implementation //////////
 
@@ -38,6 +186,26 @@ RTSPClient* RTSPClient::createNew(UsageEnvironment& env, char const* rtspURL,
 
 unsigned RTSPClient::sendDescribeCommand(responseHandler* responseHandler, Authenticator* authenticator) {
   if (fCurrentAuthenticator < authenticator) fCurrentAuthenticator = *authenticator;
+
+  delete[] fDescribeURL; fDescribeURL = strDup(fBaseURL);
+  fDescribeWasCached = False;
+  if (fDescribeCacheTTL > 0 && fCachedDescribeRequest == NULL) {
+    DescribeCache* cache = DescribeCache::ourCache(envir(), False);
+    char const* sdpDescription;
+    char const* baseURL;
+    if (cache != NULL && cache->lookup(fDescribeURL, sdpDescription, baseURL)) {
+      // Answer the command from the cache.  (We call the handler later, from the event loop, just as if it had been sent.)
+      fCachedDescribeRequest = new RequestRecord(++fCSeq, "DESCRIBE", responseHandler,
+                                                 NULL, NULL, 0, 0.0, 0.0, 0.0, sdpDescription);
+      setBaseURL(baseURL);
+      fDescribeWasCached = True;
+      if (fVerbosityLevel >= 1) envir() << "Using the cached \"DESCRIBE\" response for \"" << fDescribeURL << "\"\n";
+
+      fCachedDescribeTask = envir().taskScheduler().scheduleDelayedTask(0, handleCachedDescribe, this);
+      return fCachedDescribeRequest->cseq();
+    }
+  }
+
   return sendRequest(new RequestRecord(++fCSeq, "DESCRIBE", responseHandler));
 }
 
@@ -68,7 +236,7 @@ unsigned RTSPClient::sendPlayCommand(MediaSession& session, responseHandler* res
                                      double start, double end, float scale,
                                      Authenticator* authenticator) {
   if (fCurrentAuthenticator < authenticator) fCurrentAuthenticator = *authenticator;
-  sendDummyUDPPackets(session); // hack to improve NAT traversal
+  if (!sessionIsPending()) sendDummyUDPPackets(session); // hack to improve NAT traversal
   return sendRequest(new RequestRecord(++fCSeq, "PLAY", responseHandler, &session, NULL, 0, start, end, scale));
 }
 
@@ -76,7 +244,7 @@ unsigned RTSPClient::sendPlayCommand(MediaSubsession& subsession, responseHandle
                                      double start, double end, float scale,
                                      Authenticator* authenticator) {
   if (fCurrentAuthenticator < authenticator) fCurrentAuthenticator = *authenticator;
-  sendDummyUDPPackets(subsession); // hack to improve NAT traversal
+  if (!sessionIsPending()) sendDummyUDPPackets(subsession); // hack to improve NAT traversal
   return sendRequest(new RequestRecord(++fCSeq, "PLAY", responseHandler, NULL, &subsession, 0, start, end, scale));
 }
 
@@ -84,7 +252,7 @@ unsigned RTSPClient::sendPlayCommand(MediaSession& session, responseHandler* res
                      char const* absStartTime, char const* absEndTime, float scale,
                                      Authenticator* authenticator) {
   if (fCurrentAuthenticator < authenticator) fCurrentAuthenticator = *authenticator;
-  sendDummyUDPPackets(session); // hack to improve NAT traversal
+  if (!sessionIsPending()) sendDummyUDPPackets(session); // hack to improve NAT traversal
   return sendRequest(new RequestRecord(++fCSeq, responseHandler, absStartTime, absEndTime, scale, &session, NULL));
 }
 
@@ -92,7 +260,7 @@ unsigned RTSPClient::sendPlayCommand(MediaSubsession& subsession, responseHandle
                      char const* absStartTime, char const* absEndTime, float scale,
                                      Authenticator* authenticator) {
   if (fCurrentAuthenticator < authenticator) fCurrentAuthenticator = *authenticator;
-  sendDummyUDPPackets(subsession); // hack to improve NAT traversal
+  if (!sessionIsPending()) sendDummyUDPPackets(subsession); // hack to improve NAT traversal
   return sendRequest(new RequestRecord(++fCSeq, responseHandler, absStartTime, absEndTime, scale, NULL, &subsession));
 }
 
@@ -200,10 +368,15 @@ Boolean RTSPClient::changeResponseHandler(unsigned cseq, responseHandler* newRes
   RequestRecord* request;
   if ((request = fRequestsAwaitingConnection.findByCSeq(cseq)) != NULL
       || (request = fRequestsAwaitingHTTPTunneling.findByCSeq(cseq)) != NULL
-      || (request = fRequestsAwaitingResponse.findByCSeq(cseq)) != NULL) {
+      || (request = fRequestsAwaitingResponse.findByCSeq(cseq)) != NULL
+      || (request = fRequestsAwaitingSessionId.findByCSeq(cseq)) != NULL) {
     request->handler() = newResponseHandler;
     return True;
   }
+  if (fCachedDescribeRequest != NULL && fCachedDescribeRequest->cseq() == cseq) {
+    fCachedDescribeRequest->handler() = newResponseHandler;
+    return True;
+  }
 
   return False;
 }
@@ -364,7 +537,10 @@ RTSPClient::RTSPClient(UsageEnvironment& env, char const* rtspURL,
     fTunnelOverHTTPPortNum(tunnelOverHTTPPortNum),
     fUserAgentHeaderStr(NULL), fUserAgentHeaderStrLen(0),
     fInputSocketNum(-1), fOutputSocketNum(-1), fBaseURL(NULL), fTCPStreamIdCount(0),
-    fLastSessionId(NULL), fSessionTimeoutParameter(0), fSessionCookieCounter(0), fHTTPTunnelingConnectionIsPending(False) {
+    fLastSessionId(NULL), fSessionTimeoutParameter(0),
+    fRequestPipelining(False), fSessionSetupRequest(NULL), fSessionIdTask(NULL),
+    fDescribeCacheTTL(0), fDescribeURL(NULL), fDescribeWasCached(False), fCachedDescribeRequest(NULL), fCachedDescribeTask(NULL),
+    fSessionCookieCounter(0), fHTTPTunnelingConnectionIsPending(False) {
   setBaseURL(rtspURL);
 
   fResponseBuffer = new char[responseBufferSize+1];
@@ -401,6 +577,7 @@ RTSPClient::~RTSPClient() {
 
   delete[] fResponseBuffer;
   delete[] fUserAgentHeaderStr;
+  delete[] fDescribeURL;
 }
 
 void RTSPClient::reset() {
@@ -409,6 +586,11 @@ void RTSPClient::reset() {
   fRequestsAwaitingConnection.reset();
   fRequestsAwaitingHTTPTunneling.reset();
   fRequestsAwaitingResponse.reset();
+  fRequestsAwaitingSessionId.reset();
+  fSessionSetupRequest = NULL;
+  envir().taskScheduler().unscheduleDelayedTask(fSessionIdTask);
+  envir().taskScheduler().unscheduleDelayedTask(fCachedDescribeTask);
+  delete fCachedDescribeRequest; fCachedDescribeRequest = NULL;
   fServerAddress = 0;
 
   setBaseURL(NULL);
@@ -418,6 +600,13 @@ void RTSPClient::reset() {
   delete[] fLastSessionId; fLastSessionId = NULL;
 }
 
+void RTSPClient::resetForRedescribe() {
+  char* url = strDup(fDescribeURL != NULL ? fDescribeURL : fBaseURL);
+  reset();
+  setBaseURL(url);
+  delete[] url;
+}
+
 void RTSPClient::setBaseURL(char const* url) {
   delete[] fBaseURL; fBaseURL = strDup(url);
 }
@@ -430,9 +619,35 @@ int RTSPClient::grabSocket() {
   return inputSocket;
 }
 
+void RTSPClient::setRequestPipelining(Boolean pipelining) {
+  fRequestPipelining = pipelining;
+  if (fRequestPipelining) setNoDelay();
+}
+
+void RTSPClient::setDescribeCacheTTL(unsigned ttlSeconds) {
+  fDescribeCacheTTL = ttlSeconds;
+}
+
+void RTSPClient::invalidateDescribeCache(UsageEnvironment& env, char const* url) {
+  DescribeCache* cache = DescribeCache::ourCache(env, False);
+  if (cache != NULL) cache->remove(url);
+}
+
 unsigned RTSPClient::sendRequest(RequestRecord* request) {
   char* cmd = NULL;
   do {
+    if (fRequestPipelining && request != fSessionSetupRequest && requestNeedsSession(request)) {
+      if (sessionIsPending()) {
+    // Hold this request until the pending "SETUP" has given us a session (and send it after any held before it):
+    fRequestsAwaitingSessionId.enqueue(request);
+    return request->cseq();
+      }
+      if (fLastSessionId == NULL && strcmp(request->commandName(), "SETUP") == 0) {
+    // This "SETUP" will create our session; requests that need it are held (rather than failed) until it completes:
+    fSessionSetupRequest = request;
+      }
+    }
+
     Boolean connectionIsPending = False;
     if (!fRequestsAwaitingConnection.isEmpty()) {
       // A connection is currently pending (with at least one enqueued request).  Enqueue this request also:
@@ -536,7 +751,7 @@ unsigned RTSPClient::sendRequest(RequestRecord* request) {
       delete[] origCmd;
     }
 
-    if (send(fOutputSocketNum, cmd, strlen(cmd), 0) < 0) {
+    if (!RTPInterface::sendNonRTPDataOverTCP(envir(), fOutputSocketNum, (u_int8_t const*)cmd, strlen(cmd))) {
       char const* errFmt = "%s send() failed: ";
       unsigned const errLength = strlen(errFmt) + strlen(request->commandName());
       char* err = new char[errLength];
@@ -872,6 +1087,7 @@ int RTSPClient::openConnection() {
     ignoreSigPipeOnSocket(fInputSocketNum); // so that servers on the same host that get killed don't also kill us
     if (fOutputSocketNum < 0) fOutputSocketNum = fInputSocketNum;
     envir() << "Created new TCP socket " << fInputSocketNum << " for connection\n";
+    if (fRequestPipelining) setNoDelay(); // so that pipelined requests don't wait for each other's ACKs
 
     // Connect to the remote endpoint:
     fServerAddress = *(netAddressBits*)(destAddress.data());
@@ -973,6 +1189,8 @@ char* RTSPClient::createBlocksizeString(Boolean streamUsingTCP) {
 }
 
 void RTSPClient::handleRequestError(RequestRecord* request) {
+  sessionSetupDone(request);
+
   int resultCode = -envir().getErrno();
   if (resultCode == 0) {
     // Choose some generic error code instead:
@@ -985,6 +1203,73 @@ void RTSPClient::handleRequestError(RequestRecord* request) {
   if (request->handler() != NULL) (*request->handler())(this, resultCode, strDup(envir().getResultMsg()));
 }
 
+Boolean RTSPClient::requestNeedsSession(RequestRecord* request) const {
+  char const* cmd = request->commandName();
+  return strcmp(cmd, "SETUP") == 0 || strcmp(cmd, "PLAY") == 0 || strcmp(cmd, "PAUSE") == 0 || strcmp(cmd, "RECORD") == 0
+    || strcmp(cmd, "TEARDOWN") == 0 || strcmp(cmd, "SET_PARAMETER") == 0 || strcmp(cmd, "GET_PARAMETER") == 0;
+}
+
+void RTSPClient::sessionSetupDone(RequestRecord* request) {
+  if (request == NULL || request != fSessionSetupRequest) return;
+
+  // The "SETUP" that was to create our session has completed (or failed).  Send the requests that were held behind it
+  // - but from the event loop, so that its own response handler gets called first:
+  fSessionSetupRequest = NULL;
+  if (!fRequestsAwaitingSessionId.isEmpty()) {
+    envir().taskScheduler().unscheduleDelayedTask(fSessionIdTask);
+    fSessionIdTask = envir().taskScheduler().scheduleDelayedTask(0, sendRequestsAwaitingSessionId, this);
+  }
+}
+
+void RTSPClient::sendRequestsAwaitingSessionId(void* clientData) {
+  ((RTSPClient*)clientData)->sendRequestsAwaitingSessionId1();
+}
+
+void RTSPClient::sendRequestsAwaitingSessionId1() {
+  fSessionIdTask = NULL;
+
+  // If the "SETUP" succeeded, then the held requests now go out back-to-back.  If it failed, then the next held "SETUP" (if any)
+  // becomes the one that is to create our session (with the requests after it held again), and any request before it fails:
+  RequestQueue requestQueue(fRequestsAwaitingSessionId);
+  RequestRecord* request;
+  while ((request = requestQueue.dequeue()) != NULL) {
+    if (strcmp(request->commandName(), "PLAY") == 0 && !sessionIsPending()) {
+      // The NAT traversal hack that "sendPlayCommand()" skipped:
+      if (request->session() != NULL) sendDummyUDPPackets(*request->session());
+      else if (request->subsession() != NULL) sendDummyUDPPackets(*request->subsession());
+    }
+    (void)sendRequest(request);
+  }
+}
+
+void RTSPClient::setNoDelay() {
+  if (fOutputSocketNum < 0) return;
+
+  int flag = 1;
+  setsockopt(fOutputSocketNum, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof flag);
+}
+
+void RTSPClient::handleCachedDescribe(void* clientData) {
+  ((RTSPClient*)clientData)->handleCachedDescribe1();
+}
+
+void RTSPClient::handleCachedDescribe1() {
+  fCachedDescribeTask = NULL;
+  RequestRecord* request = fCachedDescribeRequest;
+  fCachedDescribeRequest = NULL;
+  if (request == NULL) return;
+
+  // Note: We delete the request before calling its handler, in case the handler deletes us:
+  responseHandler* handler = request->handler();
+  char* resultString = strDup(request->contentStr());
+  delete request;
+  if (handler != NULL) {
+    (*handler)(this, 0, resultString);
+  } else {
+    delete[] resultString;
+  }
+}
+
 Boolean RTSPClient
 ::parseResponseCode(char const* line, unsigned& responseCode, char const*& responseString) {
   if (sscanf(line, "RTSP/%*s%u", &responseCode) != 1 &&
@@ -1655,6 +1940,7 @@ void RTSPClient::handleResponseBytes(int newBytesRead) {
     char const* rtpInfoParamsStr = NULL;
     char const* wwwAuthenticateParamsStr = NULL;
     char const* publicParamsStr = NULL;
+    char const* cacheControlParamsStr = NULL;
     char* bodyStart = NULL;
     unsigned numBodyBytes = 0;
     responseSuccess = False;
@@ -1704,6 +1990,7 @@ void RTSPClient::handleResponseBytes(int newBytesRead) {
         envir() << "WARNING: The server did not respond to our \"" << request->commandName() << "\" request (CSeq: "
             << request->cseq() << ").  The server appears to be buggy (perhaps not handling pipelined requests properly).\n";
           }
+          sessionSetupDone(request);
           delete request;
         } else if (request->cseq() == cseq) {
           // This is the handler that we want. Remove its record, but remember it, so that we can later call its handler:
@@ -1736,6 +2023,7 @@ void RTSPClient::handleResponseBytes(int newBytesRead) {
     } else if (checkForHeader(lineStart, "Public:", 7, publicParamsStr)) {
     } else if (checkForHeader(lineStart, "Allow:", 6, publicParamsStr)) {
       // Note: we accept "Allow:" instead of "Public:", so that "OPTIONS" requests made to HTTP servers will work.
+    } else if (checkForHeader(lineStart, "Cache-Control:", 14, cacheControlParamsStr)) {
     } else if (checkForHeader(lineStart, "Location:", 9, headerParamsStr)) {
       setBaseURL(headerParamsStr);
     } else if (checkForHeader(lineStart, "com.ses.streamID:", 17, headerParamsStr)) {
@@ -1865,6 +2153,22 @@ void RTSPClient::handleResponseBytes(int newBytesRead) {
     } else {
       resetResponseBuffer();
     }
+    if (foundRequest != NULL) {
+      sessionSetupDone(foundRequest);
+
+      if (fDescribeCacheTTL > 0 && responseSuccess && responseCode == 200 && numBodyBytes > 0
+      && strcmp(foundRequest->commandName(), "DESCRIBE") == 0 && fDescribeURL != NULL
+      && strstr(bodyStart, "m=") != NULL
+      && (cacheControlParamsStr == NULL
+          || (strstr(cacheControlParamsStr, "no-cache") == NULL && strstr(cacheControlParamsStr, "no-store") == NULL))) {
+    DescribeCache::ourCache(envir(), True)->store(fDescribeURL, bodyStart, fBaseURL, fDescribeCacheTTL);
+      } else if (fDescribeWasCached && (!responseSuccess || responseCode != 200)
+         && (strcmp(foundRequest->commandName(), "SETUP") == 0 || strcmp(foundRequest->commandName(), "PLAY") == 0)) {
+    // The cached description may be stale, so don't use it again.  ("describeWasCached()" stays True, so that the
+    // response handler can tell that it should "DESCRIBE" again.)
+    invalidateDescribeCache(envir(), fDescribeURL);
+      }
+    }
     if (foundRequest != NULL && foundRequest->handler() != NULL) {
       int resultCode;
       char* resultString;
@@ -133,6 +133,16 @@ Boolean RTSPServer::specialClientUserAccessCheck(int /*clientSocket*/, struct so
   return True;
 }
 
+Boolean RTSPServer::lookupServerMediaSessionLater(char const* /*streamName*/,
+                          lookupCompletionFunc* /*completionFunc*/, void* /*completionClientData*/) {
+  // default implementation; every lookup is done synchronously:
+  return False;
+}
+
+void RTSPServer::cancelLookupLater(void* /*completionClientData*/) {
+  // default implementation; nothing is ever pending
+}
+
 
 RTSPServer::RTSPServer(UsageEnvironment& env,
                int ourSocket, Port ourPort,
@@ -272,7 +282,7 @@ RTSPServer::RTSPClientConnection
 ::RTSPClientConnection(RTSPServer& ourServer, int clientSocket, struct sockaddr_in clientAddr)
   : GenericMediaServer::ClientConnection(ourServer, clientSocket, clientAddr),
     fOurRTSPServer(ourServer), fClientInputSocket(fOurSocket), fClientOutputSocket(fOurSocket),
-    fIsActive(True), fRecursionCount(0), fOurSessionCookie(NULL) {
+    fIsActive(True), fRecursionCount(0), fDescribeIsPending(False), fPendingCSeq(NULL), fOurSessionCookie(NULL) {
   resetRequestBuffer();
 }
 
@@ -282,6 +292,8 @@ RTSPServer::RTSPClientConnection::~RTSPClientConnection() {
     fOurRTSPServer.fClientConnectionsForHTTPTunneling->Remove(fOurSessionCookie);
     delete[] fOurSessionCookie;
   }
+  if (fDescribeIsPending) fOurRTSPServer.cancelLookupLater(this);
+  delete[] fPendingCSeq;
 
   closeSocketsRTSP();
 }
@@ -312,26 +324,38 @@ void RTSPServer::RTSPClientConnection
 
 void RTSPServer::RTSPClientConnection
 ::handleCmd_DESCRIBE(char const* urlPreSuffix, char const* urlSuffix, char const* fullRequestStr) {
-  ServerMediaSession* session = NULL;
-  char* sdpDescription = NULL;
-  char* rtspURL = NULL;
-  do {
-    char urlTotalSuffix[2*RTSP_PARAM_STRING_MAX];
-        // enough space for urlPreSuffix/urlSuffix'\0'
-    urlTotalSuffix[0] = '\0';
-    if (urlPreSuffix[0] != '\0') {
-      strcat(urlTotalSuffix, urlPreSuffix);
-      strcat(urlTotalSuffix, "/");
-    }
-    strcat(urlTotalSuffix, urlSuffix);
+  char urlTotalSuffix[2*RTSP_PARAM_STRING_MAX];
+      // enough space for urlPreSuffix/urlSuffix'\0'
+  urlTotalSuffix[0] = '\0';
+  if (urlPreSuffix[0] != '\0') {
+    strcat(urlTotalSuffix, urlPreSuffix);
+    strcat(urlTotalSuffix, "/");
+  }
+  strcat(urlTotalSuffix, urlSuffix);
+
+  if (!authenticationOK("DESCRIBE", urlTotalSuffix, fullRequestStr)) return;
+
+  // We should really check that the request contains an "Accept:" #####
+  // for "application/sdp", because that's what we're sending back #####
 
-    if (!authenticationOK("DESCRIBE", urlTotalSuffix, fullRequestStr)) break;
+  // If our server can't look up the "ServerMediaSession" without waiting (e.g., because it first has to parse a file),
+  // then we send our response later, rather than stall every other client meanwhile.
+  // (We don't do this for RTSP-over-HTTP tunneling, where later input bytes would still need to be Base64-decoded.)
+  if (fClientOutputSocket == fClientInputSocket
+      && fOurRTSPServer.lookupServerMediaSessionLater(urlTotalSuffix, describeLookupCompleted, this)) {
+    fDescribeIsPending = True;
+    delete[] fPendingCSeq; fPendingCSeq = strDup(fCurrentCSeq);
+    return;
+  }
 
-    // We should really check that the request contains an "Accept:" #####
-    // for "application/sdp", because that's what we're sending back #####
+  // Look up the "ServerMediaSession" object for the specified "urlTotalSuffix" now:
+  describeSession(fOurServer.lookupServerMediaSession(urlTotalSuffix));
+}
 
-    // Begin by looking up the "ServerMediaSession" object for the specified "urlTotalSuffix":
-    session = fOurServer.lookupServerMediaSession(urlTotalSuffix);
+void RTSPServer::RTSPClientConnection::describeSession(ServerMediaSession* session) {
+  char* sdpDescription = NULL;
+  char* rtspURL = NULL;
+  do {
     if (session == NULL) {
       handleCmd_notFound();
       break;
@@ -381,6 +405,24 @@ void RTSPServer::RTSPClientConnection
   delete[] rtspURL;
 }
 
+void RTSPServer::RTSPClientConnection::describeLookupCompleted(void* clientData, ServerMediaSession* session) {
+  ((RTSPClientConnection*)clientData)->describeLookupCompleted1(session);
+}
+
+void RTSPServer::RTSPClientConnection::describeLookupCompleted1(ServerMediaSession* session) {
+  fDescribeIsPending = False;
+  fCurrentCSeq = fPendingCSeq;
+  describeSession(session);
+  RTPInterface::sendNonRTPDataOverTCP(envir(), fClientOutputSocket, fResponseBuffer, strlen((char*)fResponseBuffer));
+
+  // Then handle any (pipelined) request data that arrived while we were waiting:
+  unsigned numBytesHeld = fRequestBytesAlreadySeen;
+  if (numBytesHeld > 0) {
+    resetRequestBuffer();
+    handleRequestBytes(numBytesHeld);
+  }
+}
+
 static void lookForHeader(char const* headerName, char const* source, unsigned sourceLen, char* resultStr, unsigned resultMaxSize) {
   resultStr[0] = '\0';  // by default, return an empty string
   unsigned headerNameLen = strlen(headerName);
@@ -621,6 +663,13 @@ void RTSPServer::RTSPClientConnection::handleRequestBytes(int newBytesRead) {
       break;
     }
 
+    if (fDescribeIsPending) {
+      // We haven't answered a previous "DESCRIBE" yet, so just hold onto this data until we do:
+      fRequestBufferBytesLeft -= newBytesRead;
+      fRequestBytesAlreadySeen += newBytesRead;
+      break;
+    }
+
     Boolean endOfMsg = False;
     unsigned char* ptr = &fRequestBuffer[fRequestBytesAlreadySeen];
 #ifdef DEBUG
@@ -862,10 +911,25 @@ void RTSPServer::RTSPClientConnection::handleRequestBytes(int newBytesRead) {
       }
     }
 
+    if (fDescribeIsPending) {
+      // Our response gets sent later, by "describeLookupCompleted1()".  Until then, hold onto any pipelined request:
+      unsigned requestSize = (fLastCRLF+4-fRequestBuffer) + contentLength;
+      unsigned numBytesHeld = fRequestBytesAlreadySeen - requestSize;
+      resetRequestBuffer();
+      if (numBytesHeld > 0) {
+    memmove(fRequestBuffer, &fRequestBuffer[requestSize], numBytesHeld);
+    fRequestBytesAlreadySeen += numBytesHeld;
+    fRequestBufferBytesLeft -= numBytesHeld;
+      }
+      break;
+    }
+
 #ifdef DEBUG
     fprintf(stderr, "sending response: %s", fResponseBuffer);
 #endif
-    send(fClientOutputSocket, (char const*)fResponseBuffer, strlen((char*)fResponseBuffer), 0);
+    // (If we're also streaming RTP-over-TCP on this socket, then the response gets queued behind any RTP/RTCP packets
+    // that are waiting to be sent.)
+    RTPInterface::sendNonRTPDataOverTCP(envir(), fClientOutputSocket, fResponseBuffer, strlen((char*)fResponseBuffer));
 
     if (playAfterSetup) {
       // The client has asked for streaming to commence now, rather than after a
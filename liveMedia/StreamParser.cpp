@@ -24,6 +24,8 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include <stdlib.h>
 
 #define BANK_SIZE 150000
+// A bank grows - by doubling - up to this size, for parsers that keep a lot of saved state (e.g., large frames):
+#define MAX_BANK_SIZE (64*BANK_SIZE)
 
 void StreamParser::flushInput() {
   fCurParserIndex = fSavedParserIndex = 0;
@@ -42,9 +44,9 @@ StreamParser::StreamParser(FramedSource* inputSource,
     fClientContinueClientData(clientContinueClientData),
     fSavedParserIndex(0), fSavedRemainingUnparsedBits(0),
     fCurParserIndex(0), fRemainingUnparsedBits(0),
-    fTotNumValidBytes(0), fHaveSeenEOF(False) {
-  fBank[0] = new unsigned char[BANK_SIZE];
-  fBank[1] = new unsigned char[BANK_SIZE];
+    fTotNumValidBytes(0), fBankSize(BANK_SIZE), fHaveSeenEOF(False) {
+  fBank[0] = new unsigned char[fBankSize];
+  fBank[1] = new unsigned char[fBankSize];
   fCurBankNum = 0;
   fCurBank = fBank[fCurBankNum];
 
@@ -113,12 +115,31 @@ unsigned StreamParser::getBits(unsigned numBits) {
 }
 
 unsigned StreamParser::bankSize() const {
-  return BANK_SIZE;
+  return fBankSize;
 }
 
 #define NO_MORE_BUFFERED_INPUT 1
 
 void StreamParser::ensureValidBytes1(unsigned numBytesNeeded) {
+  readMoreBytes(numBytesNeeded);
+
+  throw NO_MORE_BUFFERED_INPUT;
+}
+
+void StreamParser::growBanks(unsigned newBankSize) {
+  // Only the current bank holds data that we still need:
+  unsigned char* newBank[2];
+  newBank[0] = new unsigned char[newBankSize];
+  newBank[1] = new unsigned char[newBankSize];
+  memmove(newBank[fCurBankNum], curBank(), fTotNumValidBytes);
+
+  delete[] fBank[0]; delete[] fBank[1];
+  fBank[0] = newBank[0]; fBank[1] = newBank[1];
+  fCurBank = fBank[fCurBankNum];
+  fBankSize = newBankSize;
+}
+
+void StreamParser::readMoreBytes(unsigned numBytesNeeded) {
   // We need to read some more bytes from the input source.
   // First, clarify how much data to ask for:
   unsigned maxInputFrameSize = fInputSource->maxFrameSize();
@@ -126,7 +147,7 @@ void StreamParser::ensureValidBytes1(unsigned numBytesNeeded) {
 
   // First, check whether these new bytes would overflow the current
   // bank.  If so, start using a new bank now.
-  if (fCurParserIndex + numBytesNeeded > BANK_SIZE) {
+  if (fCurParserIndex + numBytesNeeded > fBankSize) {
     // Swap banks, but save any still-needed bytes from the old bank:
     unsigned numBytesToSave = fTotNumValidBytes - fSavedParserIndex;
     unsigned char const* from = &curBank()[fSavedParserIndex];
@@ -139,26 +160,31 @@ void StreamParser::ensureValidBytes1(unsigned numBytesNeeded) {
     fTotNumValidBytes = numBytesToSave;
   }
 
+  if (fCurParserIndex + numBytesNeeded > fBankSize) {
+    // We have too much saved parser state for the bank, so grow the banks:
+    unsigned newBankSize = fBankSize;
+    while (fCurParserIndex + numBytesNeeded > newBankSize && newBankSize < MAX_BANK_SIZE) newBankSize *= 2;
+    if (newBankSize > fBankSize) growBanks(newBankSize);
+  }
+
   // ASSERT: fCurParserIndex + numBytesNeeded > fTotNumValidBytes
-  //      && fCurParserIndex + numBytesNeeded <= BANK_SIZE
-  if (fCurParserIndex + numBytesNeeded > BANK_SIZE) {
+  //      && fCurParserIndex + numBytesNeeded <= fBankSize
+  if (fCurParserIndex + numBytesNeeded > fBankSize) {
     // If this happens, it means that we have too much saved parser state.
-    // To fix this, increase BANK_SIZE as appropriate.
+    // To fix this, increase MAX_BANK_SIZE as appropriate.
     fInputSource->envir() << "StreamParser internal error ("
               << fCurParserIndex << " + "
               << numBytesNeeded << " > "
-              << BANK_SIZE << ")\n";
+              << fBankSize << ")\n";
     fInputSource->envir().internalError();
   }
 
   // Try to read as many new bytes as will fit in the current bank:
-  unsigned maxNumBytesToRead = BANK_SIZE - fTotNumValidBytes;
+  unsigned maxNumBytesToRead = fBankSize - fTotNumValidBytes;
   fInputSource->getNextFrame(&curBank()[fTotNumValidBytes],
                  maxNumBytesToRead,
                  afterGettingBytes, this,
                  onInputClosure, this);
-
-  throw NO_MORE_BUFFERED_INPUT;
 }
 
 void StreamParser::afterGettingBytes(void* clientData,
@@ -172,11 +198,11 @@ void StreamParser::afterGettingBytes(void* clientData,
 
 void StreamParser::afterGettingBytes1(unsigned numBytesRead, struct timeval presentationTime) {
   // Sanity check: Make sure we didn't get too many bytes for our bank:
-  if (fTotNumValidBytes + numBytesRead > BANK_SIZE) {
+  if (fTotNumValidBytes + numBytesRead > fBankSize) {
     fInputSource->envir()
       << "StreamParser::afterGettingBytes() warning: read "
       << numBytesRead << " bytes; expected no more than "
-      << BANK_SIZE - fTotNumValidBytes << "\n";
+      << fBankSize - fTotNumValidBytes << "\n";
   }
 
   fLastSeenPresentationTime = presentationTime;
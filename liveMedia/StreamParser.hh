@@ -105,6 +105,22 @@ protected: // we're a virtual base class
 
   unsigned bankSize() const;
 
+  // Non-throwing access to the bytes that are buffered already, for parsers that scan them in bulk:
+  unsigned numBufferedBytes() const { return fTotNumValidBytes - fCurParserIndex; }
+  unsigned char const* bufferedBytes() { return nextToParse(); }
+  void skipBufferedBytes(unsigned numBytes) { // numBytes <= numBufferedBytes()
+    fCurParserIndex += numBytes;
+    fRemainingUnparsedBits = 0;
+  }
+  Boolean requestBytes(unsigned numBytesNeeded) {
+    // Returns True iff "numBytesNeeded" bytes are buffered.  Otherwise, asks the input source for more, and returns False;
+    // the client's 'continue' function gets called when they arrive (as it does after an exception):
+    if (fCurParserIndex + numBytesNeeded <= fTotNumValidBytes) return True;
+
+    readMoreBytes(numBytesNeeded);
+    return False;
+  }
+
 private:
   unsigned char* curBank() { return fCurBank; }
   unsigned char* nextToParse() { return &curBank()[fCurParserIndex]; }
@@ -118,6 +134,8 @@ private:
     ensureValidBytes1(numBytesNeeded);
   }
   void ensureValidBytes1(unsigned numBytesNeeded);
+  void readMoreBytes(unsigned numBytesNeeded);
+  void growBanks(unsigned newBankSize);
 
   static void afterGettingBytes(void* clientData, unsigned numBytesRead,
                 unsigned numTruncatedBytes,
@@ -149,7 +167,10 @@ private:
   unsigned char fRemainingUnparsedBits; // in previous byte: [0,7]
 
   // The total number of valid bytes stored in the current bank:
-  unsigned fTotNumValidBytes; // <= BANK_SIZE
+  unsigned fTotNumValidBytes; // <= fBankSize
+
+  // The size of each bank; it grows (up to a limit) if the saved parser state doesn't fit:
+  unsigned fBankSize;
 
   // Whether we have seen EOF on the input source:
   Boolean fHaveSeenEOF;
@@ -84,4 +84,9 @@ unsigned removeH264or5EmulationBytes(u_int8_t* to, unsigned toMaxSize,
                      u_int8_t const* from, unsigned fromSize);
     // returns the size of the copy; it will be <= min(toMaxSize,fromSize)
 
+// A general routine for finding the next (H.264 or H.265) start code:
+unsigned findH264or5StartCode(u_int8_t const* from, unsigned size);
+    // returns the offset of the first 0x000001 in "from" (it's part of a 0x00000001 if the byte before it is 0),
+    // or "size" if there's none
+
 #endif
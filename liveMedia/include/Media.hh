@@ -125,6 +125,8 @@ public:
 
   MediaLookupTable* mediaTable;
   void* socketTable;
+  void* packetSlab; // used by "MultiFramedRTPSource"
+  void* describeCache; // used by "RTSPClient"
 
 protected:
   _Tables(UsageEnvironment& env);
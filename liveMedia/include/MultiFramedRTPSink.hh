@@ -37,6 +37,23 @@ public:
     fOnSendErrorData = onSendErrorFuncData;
   }
 
+  void setPacing(unsigned percentOfFrameInterval, unsigned burstBytes = 0);
+      // Optional token-bucket pacing of the outgoing packets: each frame is sent over
+      // "percentOfFrameInterval" percent of the frame interval (taken from the frames'
+      // durations, or else from their presentation times), rather than back-to-back.
+      // "burstBytes" may be sent without delay (0 means: 4 maximum-size packets).
+      // A "percentOfFrameInterval" of 0 (the default) turns pacing off.
+      // The frames that share a presentation time (e.g., the NAL units of one access
+      // unit) are paced as one frame, over one share of the interval.
+  static unsigned defaultPacingPercent;
+      // if > 0, each new sink starts with "setPacing(defaultPacingPercent)"
+  unsigned pacingQueuedBytes() const { return fPacingQueuedBytes; }
+      // bytes of frames that have been read from the source, but not yet sent
+  unsigned pacingLastDelay() const { return fPacingLastDelay; } // in microseconds
+  unsigned pacingMaxDelay() const { return fPacingMaxDelay; } // in microseconds
+  u_int64_t pacingTotalDelay() const { return fPacingTotalDelay; } // in microseconds
+  unsigned pacingNumDelayedPackets() const { return fPacingNumDelayedPackets; }
+
 protected:
   MultiFramedRTPSink(UsageEnvironment& env,
              Groupsock* rtpgs, unsigned char rtpPayloadType,
@@ -112,6 +129,9 @@ private:
               struct timeval presentationTime,
               unsigned durationInMicroseconds);
   Boolean isTooBigForAPacket(unsigned numBytes) const;
+  void pacingNewFrame(unsigned frameSize, struct timeval presentationTime,
+                      unsigned durationInMicroseconds);
+  unsigned pacingDelay(unsigned packetSize, unsigned payloadSize);
 
   static void ourHandleClosure(void* clientData);
 
@@ -135,6 +155,19 @@ private:
 
   onSendErrorFunc* fOnSendErrorFunc;
   void* fOnSendErrorData;
+
+  // Pacing:
+  unsigned fPacingPercent; // 0 iff pacing is off
+  unsigned fPacingBurst; // the bucket size, in bytes
+  double fPacingTokens; // bytes; may go negative while a frame is being paced
+  double fPacingRate; // bytes per microsecond
+  struct timeval fPacingLastRefill;
+  struct timeval fPacingPrevPresentationTime;
+  struct timeval fPacingFrameDeadline; // when the current frame (access unit) should be out
+  unsigned fPacingFrameInterval; // estimated, in microseconds
+  unsigned fPacingQueuedBytes;
+  unsigned fPacingLastDelay, fPacingMaxDelay, fPacingNumDelayedPackets;
+  u_int64_t fPacingTotalDelay;
 };
 
 #endif
@@ -28,6 +28,7 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 
 class BufferedPacket; // forward
 class BufferedPacketFactory; // forward
+class BufferedPacketSlab; // forward
 
 class MultiFramedRTPSource: public RTPSource {
 protected:
@@ -59,6 +60,7 @@ private:
   // redefined virtual functions:
   virtual void doGetNextFrame();
   virtual void setPacketReorderingThresholdTime(unsigned uSeconds);
+  virtual void setReceiveBatch(unsigned maxPackets, unsigned slotSize);
 
 private:
   void reset();
@@ -66,9 +68,13 @@ private:
 
   static void networkReadHandler(MultiFramedRTPSource* source, int /*mask*/);
   void networkReadHandler1();
+  void networkReadBatch();
+  Boolean processIncomingPacket(BufferedPacket* bPacket, struct sockaddr_in& fromAddress);
+      // checks the RTP header, and stores the packet if it's OK
 
   Boolean fAreDoingNetworkReads;
   BufferedPacket* fPacketReadInProgress;
+  Boolean fDatagramsNeedJumboSlots; // set once a datagram has filled a small slot
   Boolean fNeedDelivery;
   Boolean fPacketLossInFragmentedFrame;
   unsigned char* fSavedTo;
@@ -76,6 +82,15 @@ private:
 
   // A buffer to (optionally) hold incoming pkts that have been reorderered
   class ReorderingPacketBuffer* fReorderingBuffer;
+  BufferedPacketSlab* fSlab; // shared by all sources in our environment
+
+  // Batched reception (optional): "fReceiveBatchMax" slots of "fReceiveSlotSize" bytes each,
+  // in our slab's read buffer
+  unsigned fReceiveBatchMax; // 0 iff batching is off
+  unsigned fReceiveSlotSize;
+  unsigned* fReceiveBytes;
+  struct sockaddr_in* fReceiveFrom;
+  Boolean* fReceiveTruncated;
 };
 
 
@@ -89,9 +104,16 @@ public:
   virtual ~BufferedPacket();
 
   Boolean hasUsableData() const { return fTail > fHead; }
+  Boolean hasBuffer() const { return fBuf != NULL; }
   unsigned useCount() const { return fUseCount; }
 
-  Boolean fillInData(RTPInterface& rtpInterface, struct sockaddr_in& fromAddress, Boolean& packetReadWasIncomplete);
+  Boolean fillInData(RTPInterface& rtpInterface, struct sockaddr_in& fromAddress, Boolean& packetReadWasIncomplete,
+                     Boolean& datagramNeedsJumboSlot);
+      // A datagram is read straight into a small slot, unless "datagramNeedsJumboSlot" is set.  If it
+      // fills the small slot (and so may have been truncated), it is dropped, and "datagramNeedsJumboSlot"
+      // gets set.
+  void fillInData(unsigned char const* data, unsigned numBytes);
+      // used for a packet that has already been read (e.g., as part of a batch)
   void assignMiscParams(unsigned short rtpSeqNo, unsigned rtpTimestamp,
             struct timeval presentationTime,
             Boolean hasBeenSyncedUsingRTCP,
@@ -107,6 +129,11 @@ public:
 
   BufferedPacket*& nextPacket() { return fNextPacket; }
 
+  // Packet buffers are taken from a slab (if one is set) when data is filled in, and given back
+  // when the packet is freed:
+  void setSlab(BufferedPacketSlab* slab) { fSlab = slab; }
+  void releaseBuffer();
+
   unsigned short rtpSeqNo() const { return fRTPSeqNo; }
   struct timeval const& timeReceived() const { return fTimeReceived; }
 
@@ -132,6 +159,9 @@ protected:
   unsigned fTail;
 
 private:
+  void attachBuffer(unsigned minSize);
+
+  BufferedPacketSlab* fSlab; // if NULL, we use a (full-size) buffer of our own
   BufferedPacket* fNextPacket; // used to link together packets
 
   unsigned fUseCount;
@@ -156,4 +186,64 @@ public:
   virtual BufferedPacket* createNewPacket(MultiFramedRTPSource* ourSource);
 };
 
+// A per-environment allocator of packet buffers, shared by all "MultiFramedRTPSource"s in the
+// environment.  Buffers are fixed-size slots, carved from larger chunks: small (MTU-sized)
+// slots for datagrams, and 'jumbo' slots for packets received over TCP (or too big for a
+// small slot).  Freed slots go on a free list, for reuse by any source.
+
+#define PACKET_SLAB_MAX_DATAGRAM_SIZE 1500 // an Ethernet MTU
+#define PACKET_SLAB_MAX_HEADROOM 1024 // reserved in front of the data by "BufferedPacket::reset()" (at most
+    // "MAX_JPEG_HEADER_SIZE", for the JPEG header that "JPEGBufferedPacket" synthesizes)
+#define PACKET_SLAB_TAILROOM 64 // kept free after the data, for trailers added by some payload formats
+#define PACKET_SLAB_SMALL_SLOT_SIZE \
+  ((PACKET_SLAB_MAX_HEADROOM + PACKET_SLAB_MAX_DATAGRAM_SIZE + PACKET_SLAB_TAILROOM + 63) & ~63)
+#define PACKET_SLAB_SMALL_SLOTS_PER_CHUNK 32
+#define PACKET_SLAB_JUMBO_SLOT_SIZE 65536
+#define PACKET_SLAB_MAX_FREE_JUMBO_SLOTS 4 // beyond this, freed jumbo slots are deleted
+
+struct PacketSlabStats {
+  unsigned numSources;
+  unsigned smallSlots, smallSlotsInUse, smallSlotsPeak;
+  unsigned jumboSlots, jumboSlotsInUse, jumboSlotsPeak;
+  unsigned readBufferSize;
+  u_int64_t bytesAllocated; // in all slots (in use or free), plus the read buffer
+};
+
+class BufferedPacketSlab {
+public:
+  static BufferedPacketSlab* addSource(UsageEnvironment& env);
+  static void removeSource(UsageEnvironment& env);
+      // The slab is created with the first source in "env", and deleted with the last one.
+  static Boolean getStats(UsageEnvironment& env, PacketSlabStats& stats);
+      // Returns False (and zeroes "stats") if "env" has no slab (i.e., no "MultiFramedRTPSource").
+
+  unsigned char* allocSlot(unsigned minSize, unsigned& slotSize);
+  void freeSlot(unsigned char* slot, unsigned slotSize);
+
+  unsigned char* readBuffer(unsigned minSize);
+      // A scratch buffer for reading incoming packets before their size is known.  Its contents
+      // are valid only until the read handler returns to the event loop.
+
+private:
+  BufferedPacketSlab();
+  virtual ~BufferedPacketSlab();
+
+  struct SizeClass {
+    unsigned slotSize;
+    unsigned char* freeList; // linked through the first bytes of each free slot
+    unsigned numFree;
+    unsigned numSlots, numInUse, peakInUse;
+  };
+  unsigned char* allocFrom(SizeClass& sizeClass, unsigned slotsPerChunk);
+  void freeTo(SizeClass& sizeClass, unsigned char* slot);
+
+private:
+  unsigned fNumSources;
+  SizeClass fSmall, fJumbo;
+  unsigned char** fChunks; // the small-slot chunks, deleted with us
+  unsigned fNumChunks, fMaxChunks;
+  unsigned char* fReadBuffer;
+  unsigned fReadBufferSize;
+};
+
 #endif
@@ -40,6 +40,17 @@ typedef void ServerRequestAlternativeByteHandler(void* instance, u_int8_t reques
 // the same TCP connection.  A RTSP server implementation would supply a function like this - as a parameter to
 // "ServerMediaSubsession::startStream()".
 
+// Statistics about the output that is backed up - because the receiver isn't keeping up - on a RTP-over-TCP socket:
+struct RTPOverTCPBacklogStats {
+  unsigned queuedBytes; // not yet sent
+  unsigned queuedPackets;
+  unsigned maxQueuedBytes; // the 'high water mark' of "queuedBytes"
+  unsigned numPacketsDropped;
+  u_int64_t numBytesDropped;
+  unsigned numKeyFrameSkips; // the number of times that a video stream was skipped ahead to its next key frame
+  unsigned numKeyFrameWaitTimeouts; // the number of those skips that ended (after a timeout) without a key frame
+};
+
 class tcpStreamRecord {
 public:
   tcpStreamRecord(int streamSocketNum, unsigned char streamChannelId,
@@ -50,6 +61,8 @@ public:
   tcpStreamRecord* fNext;
   int fStreamSocketNum;
   unsigned char fStreamChannelId;
+  ServerRequestAlternativeByteHandler* fServerRequestAlternativeByteHandler; // if any, for "fStreamSocketNum"
+  void* fServerRequestAlternativeByteHandlerClientData;
 };
 
 class RTPInterface {
@@ -65,6 +78,12 @@ public:
   static void setServerRequestAlternativeByteHandler(UsageEnvironment& env, int socketNum,
                              ServerRequestAlternativeByteHandler* handler, void* clientData);
   static void clearServerRequestAlternativeByteHandler(UsageEnvironment& env, int socketNum);
+  static Boolean sendNonRTPDataOverTCP(UsageEnvironment& env, int socketNum, u_int8_t const* data, unsigned dataSize);
+      // Sends data other than RTP or RTCP (e.g., a RTSP request or response) over a TCP socket that may also be carrying RTP/RTCP.
+      // If RTP/RTCP packets are backed up on the socket, then "data" is queued behind them (and is never dropped).
+      // Returns False iff the send failed.
+  static Boolean getTCPBacklogStats(UsageEnvironment& env, int socketNum, RTPOverTCPBacklogStats& stats);
+      // Returns False if "socketNum" isn't currently being used for RTP-over-TCP
 
   Boolean sendPacket(unsigned char* packet, unsigned packetSize);
   void startNetworkReading(TaskScheduler::BackgroundHandlerProc*
@@ -81,6 +100,15 @@ public:
   // Otherwise (if "tcpSocketNum" >= 0), the packet was received (interleaved) over TCP, and
   //   "tcpStreamChannelId" will return the channel id.
 
+  Boolean nextReadIsFromDatagramSocket() const { return fNextTCPReadStreamSocketNum < 0; }
+  int handleReadBatch(unsigned char* buffer, unsigned slotSize, unsigned maxPackets,
+              // out parameters:
+              unsigned* bytesRead, struct sockaddr_in* fromAddresses,
+              Boolean* truncated);
+  // Reads up to "maxPackets" datagrams at once into consecutive "slotSize"-byte slots of "buffer"
+  // (see "Groupsock::handleReadBatch()").  Call this only if "nextReadIsFromDatagramSocket()".
+  // Returns the number of slots filled, or -1 on error; a slot with "bytesRead" 0 is to be ignored.
+
   void stopNetworkReading();
 
   UsageEnvironment& envir() const { return fOwner->envir(); }
@@ -97,10 +125,12 @@ public:
     // is also being read from elsewhere.)
 
 private:
-  // Helper functions for sending a RTP or RTCP packet over a TCP connection:
+  // Helper function for sending a RTP or RTCP packet over a TCP connection:
   Boolean sendRTPorRTCPPacketOverTCP(unsigned char* packet, unsigned packetSize,
                      int socketNum, unsigned char streamChannelId);
-  Boolean sendDataOverTCP(int socketNum, u_int8_t const* data, unsigned dataSize, Boolean forceSendToSucceed);
+  void noteServerRequestAlternativeByteHandler(int socketNum,
+                           ServerRequestAlternativeByteHandler* handler, void* clientData);
+      // Remembers the handler that's being used on "socketNum", in case its "SocketDescriptor" has to be recreated
 
 private:
   friend class SocketDescriptor;
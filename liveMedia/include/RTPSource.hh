@@ -45,6 +45,18 @@ public:
 
   virtual void setPacketReorderingThresholdTime(unsigned uSeconds) = 0;
 
+  virtual void setReceiveBatch(unsigned maxPackets, unsigned slotSize = 2048);
+      // Optionally, read incoming RTP-over-UDP packets in batches: up to "maxPackets" of them
+      // (into "slotSize"-byte slots) each time the socket becomes readable.
+      // A "maxPackets" of 0 or 1 (the default) turns this off.
+      // (The default implementation does nothing; "MultiFramedRTPSource" redefines it.)
+  unsigned numReceiveBatches() const { return fNumReceiveBatches; }
+  u_int64_t numBatchedPackets() const { return fNumBatchedPackets; }
+  unsigned maxReceiveBatchSize() const { return fMaxReceiveBatchSize; }
+  float averageReceiveBatchSize() const {
+    return fNumReceiveBatches == 0 ? 0.0f : (float)((double)fNumBatchedPackets/fNumReceiveBatches);
+  }
+
   // used by RTCP:
   u_int32_t SSRC() const { return fSSRC; }
       // Note: This is *our* SSRC, not the SSRC in incoming RTP packets.
@@ -98,6 +110,9 @@ protected:
   Boolean fCurPacketHasBeenSynchronizedUsingRTCP;
   u_int32_t fLastReceivedSSRC;
   class RTCPInstance* fRTCPInstanceForMultiplexedRTCPPackets;
+  unsigned fNumReceiveBatches; // reads that returned at least one packet
+  u_int64_t fNumBatchedPackets;
+  unsigned fMaxReceiveBatchSize;
 
 private:
   // redefined virtual functions:
@@ -165,6 +165,24 @@ public:
       //  of an implementation of a 'timeout handler' on the command, for example.)
       // This function returns True iff "cseq" was for a valid previously-performed command (whose response is still unhandled).
 
+  void setRequestPipelining(Boolean pipelining);
+      // If "pipelining" is True, then commands that need a RTSP session (further "SETUP"s, "PLAY", etc.) may be issued before
+      //     the first "SETUP" has completed.  They are held until its response gives us a "Session:", and are then sent back-to-back
+      //     (without waiting for each other's responses), so that a multi-track session starts in two round trips.
+      // The response handlers are still called in order; if the first "SETUP" fails, the next held "SETUP" (if any) is tried instead.
+
+  void setDescribeCacheTTL(unsigned ttlSeconds);
+      // If "ttlSeconds" is non-zero, then the SDP description returned by a successful "DESCRIBE" is cached (for the URL that
+      //     the command was sent to, and shared by all "RTSPClient"s in this "UsageEnvironment") for this many seconds.
+      //     A later "sendDescribeCommand()" for the same URL is then answered from the cache, without being sent to the server.
+      // A cached description is not stored if the server forbids it (using "Cache-Control: no-cache" or "no-store"),
+      //     and is dropped if a "SETUP" or "PLAY" that was based upon it fails.
+  Boolean describeWasCached() const { return fDescribeWasCached; }
+      // True iff the response to our most recent "DESCRIBE" came from the cache
+  static void invalidateDescribeCache(UsageEnvironment& env, char const* url = NULL);
+      // Drops the cached SDP description of "url" - or all of them, if "url" is NULL.
+      // (Call this with "url" == NULL before reclaiming "env", if any "RTSPClient" in it used the cache.)
+
   int socketNum() const { return fInputSocketNum; }
 
   static Boolean lookupByName(UsageEnvironment& env,
@@ -237,6 +255,10 @@ protected:
   virtual ~RTSPClient();
 
   void reset();
+  void resetForRedescribe();
+      // Like "reset()", but then goes back to the URL that our most recent "DESCRIBE" was sent to, so that a subclass can start
+      //     again with a new "DESCRIBE" (e.g., after a "SETUP" based upon a cached description has failed).
+      // (Any pending requests are dropped without their response handlers being called.)
   void setBaseURL(char const* url);
   int grabSocket(); // allows a subclass to reuse our input socket, so that it won't get closed when we're deleted
   virtual unsigned sendRequest(RequestRecord* request);
@@ -275,6 +297,14 @@ private:
   char* createAuthenticatorString(char const* cmd, char const* url);
   char* createBlocksizeString(Boolean streamUsingTCP);
   void handleRequestError(RequestRecord* request);
+  Boolean requestNeedsSession(RequestRecord* request) const;
+  Boolean sessionIsPending() const { return fSessionSetupRequest != NULL || !fRequestsAwaitingSessionId.isEmpty(); }
+  void sessionSetupDone(RequestRecord* request);
+  static void sendRequestsAwaitingSessionId(void* clientData);
+  void sendRequestsAwaitingSessionId1();
+  void setNoDelay();
+  static void handleCachedDescribe(void* clientData);
+  void handleCachedDescribe1();
   Boolean parseResponseCode(char const* line, unsigned& responseCode, char const*& responseString);
   void handleIncomingRequest();
   static Boolean checkForHeader(char const* line, char const* headerName, unsigned headerNameLength, char const*& headerParams);
@@ -341,6 +371,19 @@ private:
   unsigned fResponseBytesAlreadySeen, fResponseBufferBytesLeft;
   RequestQueue fRequestsAwaitingConnection, fRequestsAwaitingHTTPTunneling, fRequestsAwaitingResponse;
 
+  // Support for pipelining requests behind the "SETUP" that creates our session:
+  Boolean fRequestPipelining;
+  RequestRecord* fSessionSetupRequest;
+  RequestQueue fRequestsAwaitingSessionId;
+  TaskToken fSessionIdTask;
+
+  // Support for caching "DESCRIBE" responses:
+  unsigned fDescribeCacheTTL;
+  char* fDescribeURL; // the URL that our most recent "DESCRIBE" was for (the cache key)
+  Boolean fDescribeWasCached;
+  RequestRecord* fCachedDescribeRequest;
+  TaskToken fCachedDescribeTask;
+
   // Support for tunneling RTSP-over-HTTP:
   char fSessionCookie[33];
   unsigned fSessionCookieCounter;
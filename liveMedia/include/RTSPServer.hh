@@ -97,6 +97,8 @@ public:
       //  and http://images.apple.com/br/quicktime/pdf/QTSS_Modules.pdf
   portNumBits httpServerPortNum() const; // in host byte order.  (Returns 0 if not present.)
 
+  typedef void (lookupCompletionFunc)(void* clientData, ServerMediaSession* sessionLookedUp);
+
 protected:
   RTSPServer(UsageEnvironment& env,
          int ourSocket, Port ourPort,
@@ -125,6 +127,15 @@ protected:
       // another hook that allows subclassed servers to do server-specific access checking
       // - this time after normal digest authentication has already taken place (and would otherwise allow access).
       // (This test can only be used to further restrict access, not to grant additional access.)
+  virtual Boolean lookupServerMediaSessionLater(char const* streamName,
+                                                lookupCompletionFunc* completionFunc, void* completionClientData);
+      // a hook that allows subclassed servers to answer a "DESCRIBE" without blocking the event loop
+      // (e.g., while they parse a file to create its "ServerMediaSession").
+      // If this returns True, then "(*completionFunc)(completionClientData, session)" will be called later, from the event loop
+      // (never from within this call), with "session" NULL if there's none.
+      // The default implementation returns False, meaning: call "lookupServerMediaSession()" now, as usual.
+  virtual void cancelLookupLater(void* completionClientData);
+      // called if a client connection goes away while its "lookupServerMediaSessionLater()" is still pending
 
 private: // redefined virtual functions
   virtual Boolean isRTSPServer() const;
@@ -197,6 +208,9 @@ public: // should be protected, but some old compilers complain otherwise
       // used to implement RTSP-over-HTTP tunneling
     static void continueHandlingREGISTER(ParamsForREGISTER* params);
     virtual void continueHandlingREGISTER1(ParamsForREGISTER* params);
+    void describeSession(ServerMediaSession* session);
+    static void describeLookupCompleted(void* clientData, ServerMediaSession* session);
+    void describeLookupCompleted1(ServerMediaSession* session);
 
     // Shortcuts for setting up a RTSP response (prior to sending it):
     void setRTSPResponse(char const* responseStr);
@@ -211,6 +225,8 @@ public: // should be protected, but some old compilers complain otherwise
     unsigned char* fLastCRLF;
     unsigned fRecursionCount;
     char const* fCurrentCSeq;
+    Boolean fDescribeIsPending; // if True, we're waiting for "lookupServerMediaSessionLater()" to answer a "DESCRIBE"
+    char* fPendingCSeq; // the "CSeq:" of that "DESCRIBE"
     Authenticator fCurrentAuthenticator; // used if access control is needed
     char* fOurSessionCookie; // used for optional RTSP-over-HTTP tunneling
     unsigned fBase64RemainderCount; // used for optional RTSP-over-HTTP tunneling (possible values: 0,1,2,3)
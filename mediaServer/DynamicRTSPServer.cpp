@@ -21,6 +21,108 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "DynamicRTSPServer.hh"
 #include <liveMedia.hh>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// The state of a file when its "ServerMediaSession" was created:
+class FileState {
+public:
+  FileState(ServerMediaSession* sms, struct stat const& sb)
+    : fSMS(sms), fModificationTime(sb.st_mtime), fSize(sb.st_size), fIsWatched(False),
+      fWatchDescriptor(-1), fNextWatched(NULL) {
+    char const* slash = strrchr(sms->streamName(), '/');
+    fBaseName = strDup(slash == NULL ? sms->streamName() : slash + 1);
+  }
+  virtual ~FileState() {
+    delete[] fBaseName;
+  }
+
+  Boolean isUnchanged(struct stat const& sb) const {
+    return fModificationTime == sb.st_mtime && fSize == sb.st_size;
+  }
+
+  ServerMediaSession* fSMS;
+  time_t fModificationTime;
+  off_t fSize;
+  Boolean fIsWatched; // if True, the file hasn't changed since we last checked it
+  char* fBaseName; // the file's name within its directory
+  int fWatchDescriptor; // of the file's directory, while we're in "fWatchedFiles"; otherwise -1
+  FileState* fNextWatched; // another stream name for the same file (e.g., "x.264" and "./x.264")
+};
+
+// A Matroska or Ogg file that's being parsed (in the background) to answer "DESCRIBE"s:
+class PendingLookup {
+public:
+  PendingLookup(DynamicRTSPServer& server, char const* streamName,
+                struct stat const& sb, int watchDescriptor, unsigned fileEventCount)
+    : fServer(&server), fStreamName(strDup(streamName)), fStat(sb), fWatchDescriptor(watchDescriptor),
+      fFileEventCount(fileEventCount), fDemux(NULL), fSMS(NULL), fCompletionTask(NULL), fWaiters(NULL) {
+  }
+  virtual ~PendingLookup() {
+    delete[] fStreamName;
+    while (fWaiters != NULL) {
+      Waiter* next = fWaiters->fNext;
+      delete fWaiters;
+      fWaiters = next;
+    }
+  }
+
+  void addWaiter(RTSPServer::lookupCompletionFunc* completionFunc, void* completionClientData) {
+    Waiter* waiter = new Waiter;
+    waiter->fCompletionFunc = completionFunc;
+    waiter->fCompletionClientData = completionClientData;
+    waiter->fNext = NULL;
+
+    Waiter** last = &fWaiters; // keep the waiters in order, so that they get answered in order
+    while (*last != NULL) last = &(*last)->fNext;
+    *last = waiter;
+  }
+
+  void removeWaiter(void* completionClientData) {
+    for (Waiter** ptr = &fWaiters; *ptr != NULL; ) {
+      if ((*ptr)->fCompletionClientData == completionClientData) {
+        Waiter* waiter = *ptr;
+        *ptr = waiter->fNext;
+        delete waiter;
+      } else {
+        ptr = &(*ptr)->fNext;
+      }
+    }
+  }
+
+  void complete() {
+    fCompletionTask = NULL;
+    if (fServer == NULL) {
+      // Our server went away while the file was being parsed:
+      Medium::close(fSMS);
+      Medium::close(fDemux);
+      delete this;
+      return;
+    }
+
+    fServer->completeLookupLater(this);
+  }
+
+  struct Waiter {
+    RTSPServer::lookupCompletionFunc* fCompletionFunc;
+    void* fCompletionClientData;
+    Waiter* fNext;
+  };
+
+  DynamicRTSPServer* fServer; // NULL if the server went away while the file was being parsed
+  char* fStreamName;
+  struct stat fStat; // the state of the file when we started parsing it
+  int fWatchDescriptor;
+  unsigned fFileEventCount; // the server's "fFileEventCount" when we started parsing the file
+  Medium* fDemux; // set once the file has been parsed
+  ServerMediaSession* fSMS; // ditto
+  TaskToken fCompletionTask;
+  Waiter* fWaiters;
+};
 
 DynamicRTSPServer*
 DynamicRTSPServer::createNew(UsageEnvironment& env, Port ourPort,
@@ -35,50 +137,333 @@ DynamicRTSPServer::createNew(UsageEnvironment& env, Port ourPort,
 DynamicRTSPServer::DynamicRTSPServer(UsageEnvironment& env, int ourSocket,
                      Port ourPort,
                      UserAuthenticationDatabase* authDatabase, unsigned reclamationTestSeconds)
-  : RTSPServerSupportingHTTPStreaming(env, ourSocket, ourPort, authDatabase, reclamationTestSeconds) {
+  : RTSPServerSupportingHTTPStreaming(env, ourSocket, ourPort, authDatabase, reclamationTestSeconds),
+    fFileStates(HashTable::create(STRING_HASH_KEYS)), fFileEventsSocket(-1),
+    fWatchedFiles(HashTable::create(STRING_HASH_KEYS)), fFileEventCount(0),
+    fPendingLookups(HashTable::create(STRING_HASH_KEYS)), fCompletingLookup(NULL) {
+#ifdef __linux__
+  fFileEventsSocket = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+  if (fFileEventsSocket >= 0) {
+    env.taskScheduler().turnOnBackgroundReadHandling(fFileEventsSocket, incomingFileEventsHandler, this);
+  }
+#endif
 }
 
 DynamicRTSPServer::~DynamicRTSPServer() {
+  PendingLookup* pending;
+  while ((pending = (PendingLookup*)fPendingLookups->RemoveNext()) != NULL) {
+    if (pending->fSMS != NULL) {
+      // The file has already been parsed:
+      envir().taskScheduler().unscheduleDelayedTask(pending->fCompletionTask);
+      Medium::close(pending->fSMS);
+      Medium::close(pending->fDemux);
+      delete pending;
+    } else {
+      pending->fServer = NULL; // the parsing will finish without us, and then delete "pending"
+    }
+  }
+  delete fPendingLookups;
+
+  delete fWatchedFiles; // its "FileState"s are also in "fFileStates"
+#ifdef __linux__
+  if (fFileEventsSocket >= 0) {
+    envir().taskScheduler().turnOffBackgroundReadHandling(fFileEventsSocket);
+    ::close(fFileEventsSocket);
+  }
+#endif
+
+  FileState* state;
+  while ((state = (FileState*)fFileStates->RemoveNext()) != NULL) delete state;
+  delete fFileStates;
 }
 
 static ServerMediaSession* createNewSMS(UsageEnvironment& env,
-                    char const* fileName, FILE* fid); // forward
+                    char const* fileName); // forward
+static Boolean isParsedOnCreation(char const* fileName); // forward
+static void startParsing(UsageEnvironment& env, PendingLookup* pending); // forward
 
 ServerMediaSession* DynamicRTSPServer
 ::lookupServerMediaSession(char const* streamName, Boolean isFirstLookupInSession) {
-  // First, check whether the specified "streamName" exists as a local file:
-  FILE* fid = fopen(streamName, "rb");
-  Boolean fileExists = fid != NULL;
+  ServerMediaSession* sms;
+  struct stat sb;
+  int watchDescriptor;
+  if (checkFile(streamName, isFirstLookupInSession, sms, sb, watchDescriptor)) return sms;
+
+  unsigned fileEventCount = fFileEventCount;
+  sms = createNewSMS(envir(), streamName);
+  return noteNewSMS(sms, sb, watchDescriptor, fileEventCount);
+}
+
+Boolean DynamicRTSPServer
+::lookupServerMediaSessionLater(char const* streamName,
+                                lookupCompletionFunc* completionFunc, void* completionClientData) {
+  // Only Matroska and Ogg files need parsing (which may take a while) before we can create their "ServerMediaSession":
+  if (!isParsedOnCreation(streamName)) return False;
+
+  PendingLookup* pending = (PendingLookup*)(fPendingLookups->Lookup(streamName));
+  if (pending == NULL) {
+    ServerMediaSession* sms;
+    struct stat sb;
+    int watchDescriptor;
+    if (checkFile(streamName, True, sms, sb, watchDescriptor)) return False; // the caller's lookup will be answered at once
+
+    pending = new PendingLookup(*this, streamName, sb, watchDescriptor, fFileEventCount);
+    fPendingLookups->Add(pending->fStreamName, pending);
+    startParsing(envir(), pending);
+  }
+
+  // (If the parsing has already finished, then we still get answered from the event loop, by "completeLookupLater()".)
+  pending->addWaiter(completionFunc, completionClientData);
+  return True;
+}
+
+void DynamicRTSPServer::cancelLookupLater(void* completionClientData) {
+  // Note: We let the parsing finish anyway, so that the next lookup of the file finds its "ServerMediaSession".
+  HashTable::Iterator* iter = HashTable::Iterator::create(*fPendingLookups);
+  char const* key;
+  PendingLookup* pending;
+  while ((pending = (PendingLookup*)(iter->next(key))) != NULL) pending->removeWaiter(completionClientData);
+  delete iter;
+
+  if (fCompletingLookup != NULL) fCompletingLookup->removeWaiter(completionClientData);
+}
 
-  // Next, check whether we already have a "ServerMediaSession" for this file:
-  ServerMediaSession* sms = RTSPServer::lookupServerMediaSession(streamName);
-  Boolean smsExists = sms != NULL;
+Boolean DynamicRTSPServer
+::checkFile(char const* streamName, Boolean isFirstLookupInSession,
+            ServerMediaSession*& sms, struct stat& sb, int& watchDescriptor) {
+  // First, check whether we already have a "ServerMediaSession" for this file:
+  sms = RTSPServer::lookupServerMediaSession(streamName);
+  FileState* state = (FileState*)(fFileStates->Lookup(streamName));
+  if (state != NULL && state->fSMS != sms) {
+    // "sms" (if any) wasn't created by us:
+    forgetFile(streamName);
+    state = NULL;
+  }
+
+  // If we're watching the file, and it hasn't changed, then we can use "sms" as is:
+  if (state != NULL && state->fIsWatched) return True;
+
+  // Otherwise, check whether the specified "streamName" (still) exists as a local file.
+  // (We start watching the file's directory first, so that we can't miss a change made after the check.)
+  watchDescriptor = watchFile(streamName);
+  Boolean fileExists = stat(streamName, &sb) == 0 && (sb.st_mode&S_IFMT) == S_IFREG;
+      // ("S_ISREG()" isn't available everywhere, e.g., with MSVC)
 
-  // Handle the four possibilities for "fileExists" and "smsExists":
   if (!fileExists) {
-    if (smsExists) {
+    if (sms != NULL) {
       // "sms" was created for a file that no longer exists. Remove it:
+      forgetFile(streamName);
       removeServerMediaSession(sms);
       sms = NULL;
     }
 
-    return NULL;
+    return True;
+  }
+
+  if (sms != NULL) {
+    if (state != NULL && state->isUnchanged(sb)) {
+      // The file hasn't changed since we created "sms":
+      state->fIsWatched = watchDescriptor >= 0;
+      linkWatchedFile(state, watchDescriptor);
+      return True;
+    }
+    if (!isFirstLookupInSession) return True; // we're in the middle of setting up a session; keep using "sms"
+
+    // The file has changed since we created "sms", so remove it, and create a new one:
+    forgetFile(streamName);
+    removeServerMediaSession(sms);
+    sms = NULL;
+  }
+
+  return False;
+}
+
+ServerMediaSession* DynamicRTSPServer
+::noteNewSMS(ServerMediaSession* sms, struct stat const& sb, int watchDescriptor, unsigned fileEventCount) {
+  if (sms == NULL) return NULL;
+  addServerMediaSession(sms);
+
+  forgetFile(sms->streamName()); // in case a lookup made while "sms" was being created added a state
+  FileState* state = new FileState(sms, sb);
+  // "sb" was taken before "sms" was created.  If a file event arrived since then, it may have been for this file - and found
+  // no state to mark - so don't trust "sb" until the next lookup checks the file again:
+  state->fIsWatched = watchDescriptor >= 0 && fFileEventCount == fileEventCount;
+  fFileStates->Add(sms->streamName(), state);
+  // (If not, "watchDescriptor" may even be stale; the next lookup links the state, once the file is found unchanged.)
+  if (state->fIsWatched) linkWatchedFile(state, watchDescriptor);
+  return sms;
+}
+
+void DynamicRTSPServer::completeLookupLater(PendingLookup* pending) {
+  fPendingLookups->Remove(pending->fStreamName);
+
+  // If another lookup created a "ServerMediaSession" for this file while we were parsing it, then use that one instead:
+  ServerMediaSession* sms;
+  struct stat sb;
+  int watchDescriptor;
+  if (checkFile(pending->fStreamName, True, sms, sb, watchDescriptor)) {
+    Medium::close(pending->fSMS);
+    Medium::close(pending->fDemux);
   } else {
-    if (smsExists && isFirstLookupInSession) {
-      // Remove the existing "ServerMediaSession" and create a new one, in case the underlying
-      // file has changed in some way:
-      removeServerMediaSession(sms);
-      sms = NULL;
+    sms = noteNewSMS(pending->fSMS, pending->fStat, pending->fWatchDescriptor, pending->fFileEventCount);
+  }
+
+  // Answer each waiter in turn.  (Any of them may cancel others - or look up "sms" again - while we do this.)
+  if (sms != NULL) sms->incrementReferenceCount();
+  fCompletingLookup = pending;
+  PendingLookup::Waiter* waiter;
+  while ((waiter = pending->fWaiters) != NULL) {
+    pending->fWaiters = waiter->fNext;
+    RTSPServer::lookupCompletionFunc* completionFunc = waiter->fCompletionFunc;
+    void* completionClientData = waiter->fCompletionClientData;
+    delete waiter;
+
+    (*completionFunc)(completionClientData, sms);
+  }
+  fCompletingLookup = NULL;
+  delete pending;
+
+  if (sms != NULL) {
+    sms->decrementReferenceCount();
+    if (sms->referenceCount() == 0 && sms->deleteWhenUnreferenced()) removeServerMediaSession(sms);
+  }
+}
+
+void DynamicRTSPServer::forgetFile(char const* streamName) {
+  FileState* state = (FileState*)(fFileStates->Lookup(streamName));
+  if (state == NULL) return;
+
+  fFileStates->Remove(streamName);
+  unlinkWatchedFile(state);
+  delete state;
+}
+
+static char* watchedFileKey(int watchDescriptor, char const* baseName) {
+  // "fWatchedFiles" is keyed by "<watch descriptor>/<name>", as is each inotify event:
+  char* key = new char[20 + strlen(baseName)];
+  sprintf(key, "%d/%s", watchDescriptor, baseName);
+  return key;
+}
+
+void DynamicRTSPServer::linkWatchedFile(FileState* state, int watchDescriptor) {
+  if (state->fWatchDescriptor == watchDescriptor) return;
+  unlinkWatchedFile(state);
+  if (watchDescriptor < 0) return;
+
+  char* key = watchedFileKey(watchDescriptor, state->fBaseName);
+  state->fNextWatched = (FileState*)(fWatchedFiles->Lookup(key));
+  state->fWatchDescriptor = watchDescriptor;
+  fWatchedFiles->Add(key, state);
+  delete[] key;
+}
+
+void DynamicRTSPServer::unlinkWatchedFile(FileState* state) {
+  if (state->fWatchDescriptor < 0) return;
+
+  char* key = watchedFileKey(state->fWatchDescriptor, state->fBaseName);
+  FileState* first = (FileState*)(fWatchedFiles->Lookup(key));
+  if (first == state) {
+    if (state->fNextWatched == NULL) {
+      fWatchedFiles->Remove(key);
+    } else {
+      fWatchedFiles->Add(key, state->fNextWatched);
+    }
+  } else {
+    for (FileState* prev = first; prev != NULL; prev = prev->fNextWatched) {
+      if (prev->fNextWatched == state) {
+        prev->fNextWatched = state->fNextWatched;
+        break;
+      }
     }
+  }
+  delete[] key;
+
+  state->fWatchDescriptor = -1;
+  state->fNextWatched = NULL;
+}
+
+int DynamicRTSPServer::watchFile(char const* streamName) {
+#ifdef __linux__
+  if (fFileEventsSocket < 0) return -1;
+
+  // Watch the file's directory (rather than the file itself), so that we also see the file being replaced:
+  char const* slash = strrchr(streamName, '/');
+  char* dirName;
+  if (slash == NULL) {
+    dirName = strDup(".");
+  } else {
+    unsigned dirNameLen = slash == streamName ? 1 : slash - streamName;
+    dirName = new char[dirNameLen + 1];
+    strncpy(dirName, streamName, dirNameLen);
+    dirName[dirNameLen] = '\0';
+  }
+
+  int wd = inotify_add_watch(fFileEventsSocket, dirName,
+                 IN_MODIFY|IN_CLOSE_WRITE|IN_ATTRIB|IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO
+                 |IN_DELETE_SELF|IN_MOVE_SELF);
+  delete[] dirName;
+  // (Each alias of a directory - e.g., "." and "./" - gets the same watch descriptor.)
+  return wd;
+#else
+  return -1;
+#endif
+}
+
+void DynamicRTSPServer::incomingFileEventsHandler(void* instance, int /*mask*/) {
+  ((DynamicRTSPServer*)instance)->incomingFileEventsHandler();
+}
 
-    if (sms == NULL) {
-      sms = createNewSMS(envir(), streamName, fid);
-      addServerMediaSession(sms);
+void DynamicRTSPServer::incomingFileEventsHandler() {
+#ifdef __linux__
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  int bytesRead;
+  while ((bytesRead = read(fFileEventsSocket, buf, sizeof buf)) > 0) {
+    for (char* ptr = buf; ptr < &buf[bytesRead]; ptr += sizeof (struct inotify_event) + ((struct inotify_event*)ptr)->len) {
+      struct inotify_event const* event = (struct inotify_event const*)ptr;
+      ++fFileEventCount;
+
+      if ((event->mask&(IN_Q_OVERFLOW|IN_IGNORED|IN_DELETE_SELF|IN_MOVE_SELF)) != 0) {
+        // We may have missed changes, or the directory itself has gone away.  Check every file (again):
+        unwatchAllFiles();
+        continue;
+      }
+      if (event->len == 0) continue;
+
+      // Make the next lookup of this file - under each of its stream names - check it again:
+      char* key = watchedFileKey(event->wd, event->name);
+      for (FileState* state = (FileState*)(fWatchedFiles->Lookup(key)); state != NULL; state = state->fNextWatched) {
+        state->fIsWatched = False;
+      }
+      delete[] key;
     }
+  }
+#endif
+}
+
+void DynamicRTSPServer::unwatchAllFiles() {
+  HashTable::Iterator* iter = HashTable::Iterator::create(*fFileStates);
+  char const* key;
+  FileState* state;
+  while ((state = (FileState*)(iter->next(key))) != NULL) {
+    state->fIsWatched = False;
+    state->fWatchDescriptor = -1;
+    state->fNextWatched = NULL;
+  }
+  delete iter;
 
-    fclose(fid);
-    return sms;
+  while (fWatchedFiles->RemoveNext() != NULL) {}
+#ifdef __linux__
+  // Start again with a fresh inotify instance, so that no stale watches remain:
+  if (fFileEventsSocket >= 0) {
+    envir().taskScheduler().turnOffBackgroundReadHandling(fFileEventsSocket);
+    ::close(fFileEventsSocket);
+    fFileEventsSocket = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+    if (fFileEventsSocket >= 0) {
+      envir().taskScheduler().turnOnBackgroundReadHandling(fFileEventsSocket, incomingFileEventsHandler, this);
+    }
   }
+#endif
 }
 
 // Special code for handling Matroska files:
@@ -111,8 +496,69 @@ char const* descStr = description\
 sms = ServerMediaSession::createNew(env, fileName, fileName, descStr);\
 } while(0)
 
+// Special code for parsing Matroska and Ogg files without blocking the event loop:
+static Boolean isParsedOnCreation(char const* fileName) {
+  char const* extension = strrchr(fileName, '.');
+  if (extension == NULL) return False;
+
+  return strcmp(extension, ".mkv") == 0 || strcmp(extension, ".webm") == 0
+    || strcmp(extension, ".ogg") == 0 || strcmp(extension, ".ogv") == 0 || strcmp(extension, ".opus") == 0;
+}
+
+static void completePendingLookup(void* clientData) {
+  ((PendingLookup*)clientData)->complete();
+}
+
+static void noteParsingDone(PendingLookup* pending, Medium* demux, ServerMediaSession* sms) {
+  // Continue from the event loop, because we might have been called from within "startParsing()"
+  // (or from within the demux's own creation code):
+  pending->fDemux = demux;
+  pending->fSMS = sms;
+  pending->fCompletionTask
+    = demux->envir().taskScheduler().scheduleDelayedTask(0, (TaskFunc*)completePendingLookup, pending);
+}
+
+static void onMatroskaDemuxCreationLater(MatroskaFileServerDemux* newDemux, void* clientData) {
+  PendingLookup* pending = (PendingLookup*)clientData;
+  UsageEnvironment& env = newDemux->envir();
+  char const* fileName = pending->fStreamName;
+  ServerMediaSession* sms;
+  NEW_SMS("Matroska video+audio+(optional)subtitles");
+
+  ServerMediaSubsession* smss;
+  while ((smss = newDemux->newServerMediaSubsession()) != NULL) {
+    sms->addSubsession(smss);
+  }
+  noteParsingDone(pending, newDemux, sms);
+}
+
+static void onOggDemuxCreationLater(OggFileServerDemux* newDemux, void* clientData) {
+  PendingLookup* pending = (PendingLookup*)clientData;
+  UsageEnvironment& env = newDemux->envir();
+  char const* fileName = pending->fStreamName;
+  ServerMediaSession* sms;
+  NEW_SMS("Ogg video and/or audio");
+
+  ServerMediaSubsession* smss;
+  while ((smss = newDemux->newServerMediaSubsession()) != NULL) {
+    sms->addSubsession(smss);
+  }
+  noteParsingDone(pending, newDemux, sms);
+}
+
+static void startParsing(UsageEnvironment& env, PendingLookup* pending) {
+  char const* extension = strrchr(pending->fStreamName, '.');
+  if (strcmp(extension, ".mkv") == 0 || strcmp(extension, ".webm") == 0) {
+    OutPacketBuffer::maxSize = 100000; // allow for some possibly large VP8 or VP9 frames
+    MatroskaFileServerDemux::createNew(env, pending->fStreamName, onMatroskaDemuxCreationLater, pending);
+  } else {
+    OggFileServerDemux::createNew(env, pending->fStreamName, onOggDemuxCreationLater, pending);
+  }
+}
+// END Special code for parsing Matroska and Ogg files without blocking the event loop
+
 static ServerMediaSession* createNewSMS(UsageEnvironment& env,
-                    char const* fileName, FILE* /*fid*/) {
+                    char const* fileName) {
   // Use the file name extension to determine the type of "ServerMediaSession":
   char const* extension = strrchr(fileName, '.');
   if (extension == NULL) return NULL;
@@ -209,7 +655,8 @@ static ServerMediaSession* createNewSMS(UsageEnvironment& env,
     NEW_SMS("Matroska video+audio+(optional)subtitles");
 
     // Create a Matroska file server demultiplexor for the specified file.
-    // (We enter the event loop to wait for this to complete.)
+    // (We enter the event loop to wait for this to complete.  A "DESCRIBE" doesn't get here; it uses
+    //  "lookupServerMediaSessionLater()" instead, so that other clients don't have to wait too.)
     MatroskaDemuxCreationState creationState;
     creationState.watchVariable = 0;
     MatroskaFileServerDemux::createNew(env, fileName, onMatroskaDemuxCreation, &creationState);
@@ -224,7 +671,7 @@ static ServerMediaSession* createNewSMS(UsageEnvironment& env,
     NEW_SMS("Ogg video and/or audio");
 
     // Create a Ogg file server demultiplexor for the specified file.
-    // (We enter the event loop to wait for this to complete.)
+    // (We enter the event loop to wait for this to complete.  A "DESCRIBE" doesn't get here; see above.)
     OggDemuxCreationState creationState;
     creationState.watchVariable = 0;
     OggFileServerDemux::createNew(env, fileName, onOggDemuxCreation, &creationState);
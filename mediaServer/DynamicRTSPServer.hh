@@ -25,6 +25,9 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "RTSPServerSupportingHTTPStreaming.hh"
 #endif
 
+class PendingLookup; // forward
+class FileState; // forward
+
 class DynamicRTSPServer: public RTSPServerSupportingHTTPStreaming {
 public:
   static DynamicRTSPServer* createNew(UsageEnvironment& env, Port ourPort,
@@ -40,6 +43,34 @@ protected:
 protected: // redefined virtual functions
   virtual ServerMediaSession*
   lookupServerMediaSession(char const* streamName, Boolean isFirstLookupInSession);
+  virtual Boolean lookupServerMediaSessionLater(char const* streamName,
+                                                lookupCompletionFunc* completionFunc, void* completionClientData);
+  virtual void cancelLookupLater(void* completionClientData);
+
+private:
+  friend class PendingLookup;
+  Boolean checkFile(char const* streamName, Boolean isFirstLookupInSession,
+                    ServerMediaSession*& sms, struct stat& sb, int& watchDescriptor);
+      // Returns True iff "sms" (possibly NULL) is the answer; otherwise, a new "ServerMediaSession" needs to be created
+      // for the (existing) file, whose state is returned in "sb" and "watchDescriptor" (of its directory; -1 if unwatched).
+  ServerMediaSession* noteNewSMS(ServerMediaSession* sms, struct stat const& sb, int watchDescriptor,
+                                 unsigned fileEventCount);
+  void completeLookupLater(PendingLookup* pending);
+  void forgetFile(char const* streamName);
+  int watchFile(char const* streamName); // returns the watch descriptor of the file's directory, or -1
+  void linkWatchedFile(FileState* state, int watchDescriptor);
+  void unlinkWatchedFile(FileState* state);
+  static void incomingFileEventsHandler(void* instance, int /*mask*/);
+  void incomingFileEventsHandler();
+  void unwatchAllFiles();
+
+private:
+  HashTable* fFileStates; // maps stream names to the state of the file when its "ServerMediaSession" was created
+  int fFileEventsSocket; // inotify; -1 if file changes can't be watched (so each lookup checks the file instead)
+  HashTable* fWatchedFiles; // maps "<watch descriptor>/<name>" to the "FileState"s (chained) of that file
+  unsigned fFileEventCount; // incremented on each inotify event, so that we can tell if one arrived while we created a "ServerMediaSession"
+  HashTable* fPendingLookups; // maps stream names to "PendingLookup"s (for files that are still being parsed)
+  PendingLookup* fCompletingLookup; // set while "completeLookupLater()" calls its completion functions
 };
 
 #endif
@@ -0,0 +1,481 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 3 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// A subclass of "RTSPServer" that spreads the proxied streams over several 'shards', each of which is a
+// thread with its own event loop and its own "RTSPServer".  This (front) server only accepts connections:
+// it peeks at the requests on each one, and hands the socket to the shard that owns the first stream named.
+// Implementation
+
+#include "ProxyShardServer.hh"
+#include <BasicUsageEnvironment.hh>
+#include <GroupsockHelper.hh>
+#include <RTSPCommon.hh>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define PEEK_BUFFER_SIZE 1000
+#define PEEK_RETRY_INTERVAL 10000 /* microseconds */
+#define MAX_NUM_PEEK_RETRIES 500 /* i.e., give up on a client that hasn't sent its request line after 5 seconds */
+
+////////// ProxyShardRTSPServer //////////
+// The "RTSPServer" of one shard.  It doesn't listen for connections itself; instead, it adopts the
+// connections that the front server has accepted (and handed off) for it.
+
+class ProxyShardRTSPServer: public RTSPServer {
+public:
+  static ProxyShardRTSPServer* createNew(UsageEnvironment& env, Port frontPort,
+                     UserAuthenticationDatabase* authDatabase, unsigned reclamationTestSeconds) {
+    // A socket is needed only to satisfy our parent class; it is never bound or listened on:
+    int ourSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (ourSocket < 0) {
+      env.setResultErrMsg("unable to create a socket: ");
+      return NULL;
+    }
+
+    return new ProxyShardRTSPServer(env, ourSocket, frontPort, authDatabase, reclamationTestSeconds);
+  }
+
+  void adoptClientConnection(int clientSocket, struct sockaddr_in const& clientAddr) {
+    // The front server has already prepared "clientSocket" (non-blocking, etc.):
+    (void)createNewClientConnection(clientSocket, clientAddr);
+  }
+
+protected:
+  ProxyShardRTSPServer(UsageEnvironment& env, int ourSocket, Port frontPort,
+               UserAuthenticationDatabase* authDatabase, unsigned reclamationTestSeconds)
+    // Use the front server's port, so that our "rtspURL()"s (and "Content-Base:" headers) refer to it:
+    : RTSPServer(env, ourSocket, frontPort, authDatabase, reclamationTestSeconds) {
+    env.taskScheduler().turnOffBackgroundReadHandling(ourSocket);
+  }
+};
+
+////////// ProxyShard //////////
+
+// What the front server writes to a shard's hand-off pipe, for each connection:
+struct ProxyShardHandOff {
+  int clientSocket;
+  struct sockaddr_in clientAddr;
+};
+
+class ProxyShard {
+public:
+  static ProxyShard* createNew(unsigned index, Port frontPort,
+                   UserAuthenticationDatabase* authDatabase, unsigned reclamationTestSeconds);
+  virtual ~ProxyShard();
+
+  UsageEnvironment& envir() const { return *fEnv; }
+  ProxyShardRTSPServer* server() const { return fServer; }
+
+  Boolean start();
+  void handOff(int clientSocket, struct sockaddr_in const& clientAddr); // called from the front server's thread
+
+protected:
+  ProxyShard(unsigned index);
+
+private:
+  static void* threadMain(void* instance);
+  static void incomingHandOffHandler(void* instance, int /*mask*/);
+  void incomingHandOffHandler();
+
+private:
+  unsigned fIndex;
+  TaskScheduler* fScheduler;
+  UsageEnvironment* fEnv;
+  ProxyShardRTSPServer* fServer;
+  int fHandOffPipe[2]; // [0] is read by this shard; [1] is written by the front server
+};
+
+ProxyShard* ProxyShard::createNew(unsigned index, Port frontPort,
+                  UserAuthenticationDatabase* authDatabase, unsigned reclamationTestSeconds) {
+  ProxyShard* shard = new ProxyShard(index);
+
+  do {
+    if (pipe(shard->fHandOffPipe) < 0) {
+      shard->envir().setResultErrMsg("unable to create the hand-off pipe: ");
+      shard->fHandOffPipe[0] = shard->fHandOffPipe[1] = -1;
+      break;
+    }
+    makeSocketNonBlocking(shard->fHandOffPipe[0]);
+    // The front server must never block on a shard that falls behind; a hand-off that doesn't fit is dropped:
+    makeSocketNonBlocking(shard->fHandOffPipe[1]);
+
+    shard->fServer = ProxyShardRTSPServer::createNew(shard->envir(), frontPort, authDatabase, reclamationTestSeconds);
+    if (shard->fServer == NULL) break;
+
+    shard->fScheduler->turnOnBackgroundReadHandling(shard->fHandOffPipe[0], incomingHandOffHandler, shard);
+    return shard;
+  } while (0);
+
+  delete shard;
+  return NULL;
+}
+
+ProxyShard::ProxyShard(unsigned index)
+  : fIndex(index), fServer(NULL) {
+  fHandOffPipe[0] = fHandOffPipe[1] = -1;
+  fScheduler = BasicTaskScheduler::createNew();
+  fEnv = BasicUsageEnvironment::createNew(*fScheduler);
+}
+
+ProxyShard::~ProxyShard() {
+  // Note: This is called only for shards whose thread was never started.
+  Medium::close(fServer);
+  if (fHandOffPipe[0] >= 0) {
+    fScheduler->turnOffBackgroundReadHandling(fHandOffPipe[0]);
+    close(fHandOffPipe[0]);
+  }
+  if (fHandOffPipe[1] >= 0) close(fHandOffPipe[1]);
+  fEnv->reclaim();
+  delete fScheduler;
+}
+
+Boolean ProxyShard::start() {
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, threadMain, this) != 0) {
+    envir() << "Failed to start the thread of proxy shard " << fIndex << "\n";
+    return False;
+  }
+  pthread_detach(thread);
+
+  return True;
+}
+
+void ProxyShard::handOff(int clientSocket, struct sockaddr_in const& clientAddr) {
+  ProxyShardHandOff handOff;
+  handOff.clientSocket = clientSocket;
+  handOff.clientAddr = clientAddr;
+
+  // A write this small to a pipe is atomic, so our shard always reads whole records.
+  // If the pipe is full (EAGAIN), the shard is overloaded, so drop the client:
+  if (write(fHandOffPipe[1], &handOff, sizeof handOff) != (int)sizeof handOff) {
+    ::closeSocket(clientSocket);
+  }
+}
+
+void* ProxyShard::threadMain(void* instance) {
+  ProxyShard* shard = (ProxyShard*)instance;
+
+  shard->fScheduler->doEventLoop(); // does not return
+  return NULL;
+}
+
+void ProxyShard::incomingHandOffHandler(void* instance, int /*mask*/) {
+  ProxyShard* shard = (ProxyShard*)instance;
+  shard->incomingHandOffHandler();
+}
+
+void ProxyShard::incomingHandOffHandler() {
+  ProxyShardHandOff handOffs[32];
+
+  int numBytesRead;
+  while ((numBytesRead = read(fHandOffPipe[0], handOffs, sizeof handOffs)) > 0) {
+    unsigned numHandOffs = numBytesRead/sizeof handOffs[0];
+    for (unsigned i = 0; i < numHandOffs; ++i) {
+      fServer->adoptClientConnection(handOffs[i].clientSocket, handOffs[i].clientAddr);
+    }
+  }
+}
+
+////////// ProxyShardPendingConnection //////////
+// A connection that the front server has accepted, but whose first request that names a stream hasn't yet
+// been seen.  (A bare "OPTIONS" that comes before it - e.g., "OPTIONS rtsp://host/" - is answered here, so
+// that it doesn't pin the connection to the first shard.)
+
+class ProxyShardPendingConnection {
+public:
+  ProxyShardPendingConnection(ProxyShardServer& ourServer, int clientSocket, struct sockaddr_in const& clientAddr);
+  virtual ~ProxyShardPendingConnection();
+
+private:
+  static void incomingRequestHandler(void* instance, int /*mask*/);
+  static void retryHandler(void* instance);
+  void tryHandOff();
+  void waitForMore();
+  int answerBareOPTIONS(char const* req, unsigned reqSize);
+
+private:
+  ProxyShardServer& fOurServer;
+  int fClientSocket;
+  struct sockaddr_in fClientAddr;
+  TaskToken fRetryTask;
+  unsigned fNumRetries;
+};
+
+// Returns the stream name (i.e., the first path component of the URL) of the request line in "req", or
+// False if the URL might not yet be complete.  (A malformed request line gives an empty stream name.)
+static Boolean parseStreamName(char const* req, unsigned reqSize, char* resultStreamName) {
+  resultStreamName[0] = '\0';
+
+  // Skip over the command name ("DESCRIBE", "GET", etc.):
+  unsigned i = 0;
+  while (i < reqSize && req[i] != ' ' && req[i] != '\t' && req[i] != '\r' && req[i] != '\n') ++i;
+  if (i == reqSize) return False;
+  if (req[i] == '\r' || req[i] == '\n') return True; // malformed
+  while (i < reqSize && (req[i] == ' ' || req[i] == '\t')) ++i;
+
+  // Then find the end of the URL:
+  unsigned urlStart = i;
+  while (i < reqSize && req[i] != ' ' && req[i] != '\t' && req[i] != '\r' && req[i] != '\n') ++i;
+  if (i == reqSize) return False;
+  char const* url = &req[urlStart];
+  unsigned urlSize = i - urlStart;
+
+  // Skip over any "<scheme>://<host>[:<port>]" prefix ("OPTIONS *", or "GET /<path>", have none):
+  for (unsigned j = 0; j < urlSize && url[j] != '/'; ++j) {
+    if (j+2 < urlSize && url[j] == ':' && url[j+1] == '/' && url[j+2] == '/') {
+      j += 3;
+      while (j < urlSize && url[j] != '/') ++j;
+      url += j; urlSize -= j;
+      break;
+    }
+  }
+  while (urlSize > 0 && url[0] == '/') { ++url; --urlSize; }
+
+  // The stream name is everything up to the track id (or query), if any:
+  unsigned k;
+  for (k = 0; k < urlSize && url[k] != '/' && url[k] != '?'; ++k) resultStreamName[k] = url[k];
+  resultStreamName[k] = '\0';
+
+  return True;
+}
+
+ProxyShardPendingConnection
+::ProxyShardPendingConnection(ProxyShardServer& ourServer, int clientSocket, struct sockaddr_in const& clientAddr)
+  : fOurServer(ourServer), fClientSocket(clientSocket), fClientAddr(clientAddr), fRetryTask(NULL), fNumRetries(0) {
+  fOurServer.envir().taskScheduler().turnOnBackgroundReadHandling(fClientSocket, incomingRequestHandler, this);
+}
+
+ProxyShardPendingConnection::~ProxyShardPendingConnection() {
+  fOurServer.envir().taskScheduler().unscheduleDelayedTask(fRetryTask);
+  if (fClientSocket >= 0) {
+    fOurServer.envir().taskScheduler().turnOffBackgroundReadHandling(fClientSocket);
+    ::closeSocket(fClientSocket);
+  }
+}
+
+void ProxyShardPendingConnection::incomingRequestHandler(void* instance, int /*mask*/) {
+  ((ProxyShardPendingConnection*)instance)->tryHandOff();
+}
+
+void ProxyShardPendingConnection::retryHandler(void* instance) {
+  ProxyShardPendingConnection* connection = (ProxyShardPendingConnection*)instance;
+  connection->fRetryTask = NULL;
+  connection->tryHandOff();
+}
+
+void ProxyShardPendingConnection::tryHandOff() {
+  char buf[PEEK_BUFFER_SIZE];
+  char streamName[PEEK_BUFFER_SIZE];
+
+  while (1) {
+    // Look at - but leave for the shard's "RTSPClientConnection" - what the client has sent so far:
+    int bytesRead = recv(fClientSocket, buf, sizeof buf, MSG_PEEK);
+    if (bytesRead <= 0) {
+      if (bytesRead < 0 && fOurServer.envir().getErrno() == EWOULDBLOCK) {
+        // (We may have got here from "retryHandler()", after answering an "OPTIONS".)
+        fOurServer.envir().taskScheduler().turnOnBackgroundReadHandling(fClientSocket, incomingRequestHandler, this);
+        return;
+      }
+      delete this; // the client has gone away
+      return;
+    }
+
+    if (!parseStreamName(buf, bytesRead, streamName)) {
+      if (bytesRead < (int)sizeof buf) {
+        // We don't yet have the whole URL:
+        waitForMore();
+        return;
+      }
+      // Otherwise, the request line is too long; let a shard respond to it (with an error).
+      break;
+    }
+    if (streamName[0] != '\0') break;
+
+    // The request names no stream.  If it's an "OPTIONS", answer it ourself, and look at the next request:
+    int optionsSize = answerBareOPTIONS(buf, bytesRead);
+    if (optionsSize == 0) break; // something else (e.g., "GET_PARAMETER *"); the first shard handles it
+    if (optionsSize < 0) {
+      if (bytesRead < (int)sizeof buf) {
+        waitForMore();
+        return;
+      }
+      break;
+    }
+    if (recv(fClientSocket, buf, optionsSize, 0) != optionsSize) {
+      delete this;
+      return;
+    }
+    fNumRetries = 0;
+  }
+
+  fOurServer.envir().taskScheduler().turnOffBackgroundReadHandling(fClientSocket);
+  fOurServer.handOffConnection(fClientSocket, fClientAddr, streamName);
+  fClientSocket = -1; // it's no longer ours
+  delete this;
+}
+
+void ProxyShardPendingConnection::waitForMore() {
+  // Wait a while (but not forever) for the rest of the request:
+  fOurServer.envir().taskScheduler().turnOffBackgroundReadHandling(fClientSocket);
+  if (++fNumRetries > MAX_NUM_PEEK_RETRIES) {
+    delete this;
+  } else {
+    fRetryTask = fOurServer.envir().taskScheduler().scheduleDelayedTask(PEEK_RETRY_INTERVAL, retryHandler, this);
+  }
+}
+
+// If "req" begins with a complete "OPTIONS" request, sends our response to it, and returns its size.
+// Returns 0 if "req" is some other request, or -1 if we don't yet have the whole request.
+int ProxyShardPendingConnection::answerBareOPTIONS(char const* req, unsigned reqSize) {
+  if (reqSize < 8 || strncmp(req, "OPTIONS", 7) != 0 || (req[7] != ' ' && req[7] != '\t')) return 0;
+
+  unsigned i;
+  for (i = 3; i < reqSize; ++i) {
+    if (req[i-3] == '\r' && req[i-2] == '\n' && req[i-1] == '\r' && req[i] == '\n') break;
+  }
+  if (i == reqSize) return -1;
+  unsigned requestSize = i+1;
+
+  char cmdName[RTSP_PARAM_STRING_MAX];
+  char urlPreSuffix[RTSP_PARAM_STRING_MAX];
+  char urlSuffix[RTSP_PARAM_STRING_MAX];
+  char cseq[RTSP_PARAM_STRING_MAX];
+  char sessionId[RTSP_PARAM_STRING_MAX];
+  unsigned contentLength = 0;
+  if (!parseRTSPRequestString(req, requestSize, cmdName, sizeof cmdName, urlPreSuffix, sizeof urlPreSuffix,
+                  urlSuffix, sizeof urlSuffix, cseq, sizeof cseq, sessionId, sizeof sessionId,
+                  contentLength)
+      || contentLength > 0) {
+    return 0; // let a shard deal with it
+  }
+
+  char response[RTSP_PARAM_STRING_MAX + 400];
+  snprintf(response, sizeof response, "RTSP/1.0 200 OK\r\nCSeq: %s\r\n%sPublic: %s\r\n\r\n",
+       cseq, dateHeader(), fOurServer.allowedCommandNames());
+  send(fClientSocket, response, strlen(response), 0);
+
+  return (int)requestSize;
+}
+
+////////// ProxyShardServer //////////
+
+ProxyShardServer*
+ProxyShardServer::createNew(UsageEnvironment& env, Port ourPort, unsigned numShards,
+                UserAuthenticationDatabase* authDatabase,
+                unsigned reclamationTestSeconds) {
+  if (numShards == 0 || numShards > PROXY_SHARD_MAX_NUM_SHARDS) {
+    env.setResultMsg("bad number of proxy shards");
+    return NULL;
+  }
+
+  int ourSocket = setUpOurSocket(env, ourPort);
+  if (ourSocket == -1) return NULL;
+
+  ProxyShardServer* server
+    = new ProxyShardServer(env, ourSocket, ourPort, numShards, authDatabase, reclamationTestSeconds);
+  if (!server->createShards(authDatabase, reclamationTestSeconds)) {
+    env.setResultMsg("failed to create the proxy shards");
+    Medium::close(server);
+    return NULL;
+  }
+
+  return server;
+}
+
+ProxyShardServer::ProxyShardServer(UsageEnvironment& env, int ourSocket, Port ourPort, unsigned numShards,
+                   UserAuthenticationDatabase* authDatabase, unsigned reclamationTestSeconds)
+  : RTSPServer(env, ourSocket, ourPort, authDatabase, reclamationTestSeconds),
+    fNumShards(numShards), fShardsByStreamName(HashTable::create(STRING_HASH_KEYS)),
+    fNextShardIndex(0), fShardsAreRunning(False) {
+  for (unsigned i = 0; i < PROXY_SHARD_MAX_NUM_SHARDS; ++i) fShards[i] = NULL;
+}
+
+ProxyShardServer::~ProxyShardServer() {
+  // A running shard's thread can't be stopped, so we can reclaim only shards that were never started:
+  if (!fShardsAreRunning) {
+    for (unsigned i = 0; i < fNumShards; ++i) delete fShards[i];
+  }
+  delete fShardsByStreamName;
+}
+
+Boolean ProxyShardServer::createShards(UserAuthenticationDatabase* authDatabase, unsigned reclamationTestSeconds) {
+  for (unsigned i = 0; i < fNumShards; ++i) {
+    fShards[i] = ProxyShard::createNew(i, fServerPort, authDatabase, reclamationTestSeconds);
+    if (fShards[i] == NULL) return False;
+  }
+
+  return True;
+}
+
+ServerMediaSession* ProxyShardServer
+::addProxyStream(char const* inputStreamURL, char const* streamName,
+         char const* username, char const* password,
+         portNumBits tunnelOverHTTPPortNum, int verbosityLevel) {
+  if (fShardsAreRunning) return NULL; // too late
+
+  ProxyShard* shard = fShards[fNextShardIndex];
+  fNextShardIndex = (fNextShardIndex+1)%fNumShards;
+
+  // The new session (and its back-end "ProxyRTSPClient") lives in "shard"s environment:
+  ServerMediaSession* sms
+    = ProxyServerMediaSession::createNew(shard->envir(), shard->server(),
+                     inputStreamURL, streamName,
+                     username, password, tunnelOverHTTPPortNum, verbosityLevel);
+  if (sms == NULL) return NULL;
+
+  shard->server()->addServerMediaSession(sms);
+  fShardsByStreamName->Add(sms->streamName(), shard);
+  return sms;
+}
+
+char* ProxyShardServer::proxyStreamURL(ServerMediaSession const* sms) const {
+  return shardForStreamName(sms->streamName())->server()->rtspURL(sms);
+}
+
+Boolean ProxyShardServer::startShards() {
+  if (fShardsAreRunning) return True;
+
+  for (unsigned i = 0; i < fNumShards; ++i) {
+    if (!fShards[i]->start()) {
+      // Some shards may already be running, so we can't reclaim any of them:
+      fShardsAreRunning = True;
+      return False;
+    }
+  }
+
+  fShardsAreRunning = True;
+  return True;
+}
+
+ProxyShard* ProxyShardServer::shardForStreamName(char const* streamName) const {
+  ProxyShard* shard = (ProxyShard*)(fShardsByStreamName->Lookup(streamName));
+
+  // Requests for unknown streams (or for no stream, e.g. "OPTIONS *") go to the first shard:
+  return shard != NULL ? shard : fShards[0];
+}
+
+GenericMediaServer::ClientConnection*
+ProxyShardServer::createNewClientConnection(int clientSocket, struct sockaddr_in clientAddr) {
+  // Note that this is also called for connections accepted on our RTSP-over-HTTP tunneling port.  Both
+  // of a tunnel's connections ("GET" and "POST") name the stream, so they get handed to the same shard.
+  (void)new ProxyShardPendingConnection(*this, clientSocket, clientAddr);
+  return NULL;
+}
+
+void ProxyShardServer::handOffConnection(int clientSocket, struct sockaddr_in const& clientAddr,
+                     char const* streamName) {
+  shardForStreamName(streamName)->handOff(clientSocket, clientAddr);
+}
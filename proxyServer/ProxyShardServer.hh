@@ -0,0 +1,79 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 3 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// A subclass of "RTSPServer" that spreads the proxied streams over several 'shards', each of which is a
+// thread with its own event loop and its own "RTSPServer".  This (front) server only accepts connections:
+// it peeks at the requests on each one, and hands the socket to the shard that owns the first stream named.
+// Each "ProxyServerMediaSession" - with its back-end "ProxyRTSPClient", its "StreamReplicator"s, and all of
+// its front-end "RTPSink"s - therefore stays within one thread.
+// Header file
+
+#ifndef _PROXY_SHARD_SERVER_HH
+#define _PROXY_SHARD_SERVER_HH
+
+#ifndef _LIVEMEDIA_HH
+#include "liveMedia.hh"
+#endif
+
+#define PROXY_SHARD_MAX_NUM_SHARDS 64
+
+class ProxyShard; // forward
+
+class ProxyShardServer: public RTSPServer {
+public:
+  static ProxyShardServer* createNew(UsageEnvironment& env, Port ourPort, unsigned numShards,
+                     UserAuthenticationDatabase* authDatabase,
+                     unsigned reclamationTestSeconds = 65);
+
+  ServerMediaSession* addProxyStream(char const* inputStreamURL, char const* streamName,
+                     char const* username, char const* password,
+                     portNumBits tunnelOverHTTPPortNum, int verbosityLevel);
+      // Creates a "ProxyServerMediaSession" in the next shard (round-robin).
+      // This must be called only before "startShards()".
+  char* proxyStreamURL(ServerMediaSession const* sms) const; // result is to be delete[]d
+
+  Boolean startShards();
+      // Starts each shard's event loop in its own thread.  (After this, the shards' objects are touched
+      // only from within their own thread.)
+
+  unsigned numShards() const { return fNumShards; }
+
+protected:
+  ProxyShardServer(UsageEnvironment& env, int ourSocket, Port ourPort, unsigned numShards,
+           UserAuthenticationDatabase* authDatabase, unsigned reclamationTestSeconds);
+      // called only by createNew();
+  virtual ~ProxyShardServer();
+
+  Boolean createShards(UserAuthenticationDatabase* authDatabase, unsigned reclamationTestSeconds);
+  ProxyShard* shardForStreamName(char const* streamName) const;
+
+protected: // redefined virtual functions
+  virtual ClientConnection* createNewClientConnection(int clientSocket, struct sockaddr_in clientAddr);
+      // Doesn't create a connection; instead, waits for the client's first request, and then hands the
+      // socket to a shard.
+
+private:
+  friend class ProxyShardPendingConnection;
+  void handOffConnection(int clientSocket, struct sockaddr_in const& clientAddr, char const* streamName);
+
+private:
+  unsigned fNumShards;
+  ProxyShard* fShards[PROXY_SHARD_MAX_NUM_SHARDS];
+  HashTable* fShardsByStreamName; // maps stream names to "ProxyShard"s
+  unsigned fNextShardIndex; // for new proxy streams
+  Boolean fShardsAreRunning;
+};
+
+#endif
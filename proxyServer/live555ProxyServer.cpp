@@ -19,6 +19,7 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 
 #include "liveMedia.hh"
 #include "BasicUsageEnvironment.hh"
+#include "ProxyShardServer.hh"
 
 char const* progName;
 UsageEnvironment* env;
@@ -35,9 +36,12 @@ char* password = NULL;
 Boolean proxyREGISTERRequests = False;
 char* usernameForREGISTER = NULL;
 char* passwordForREGISTER = NULL;
+unsigned numShards = 0; // if > 0, the proxied streams are spread over this many threads
 
 static RTSPServer* createRTSPServer(Port port) {
-  if (proxyREGISTERRequests) {
+  if (numShards > 0) {
+    return ProxyShardServer::createNew(*env, port, numShards, authDB);
+  } else if (proxyREGISTERRequests) {
     return RTSPServerWithREGISTERProxying::createNew(*env, port, authDB, authDBForREGISTER, 65, streamRTPOverTCP, verbosityLevel);
   } else {
     return RTSPServer::createNew(*env, port, authDB);
@@ -51,7 +55,11 @@ void usage() {
        << " [-p <rtspServer-port>]"
        << " [-u <username> <password>]"
        << " [-R] [-U <username-for-REGISTER> <password-for-REGISTER>]"
-       << " <rtsp-url-1> ... <rtsp-url-n>\n";
+       << " [-W <number-of-worker-threads>]"
+       << " [-P <pacing-percent-of-frame-interval>]"
+       << " <rtsp-url-1> ... <rtsp-url-n>\n"
+       << "\t(With -W, a client connection is served by the worker thread of the first stream that it names,\n"
+       << "\t so a client that plays several streams must use a separate connection for each.)\n";
   exit(1);
 }
 
@@ -151,6 +159,38 @@ int main(int argc, char** argv) {
       break;
     }
 
+    case 'W': {
+      // Spread the proxied streams over this many worker threads (each with its own event loop):
+      if (argc > 2 && argv[2][0] != '-') {
+        if (sscanf(argv[2], "%u", &numShards) == 1
+            && numShards > 0 && numShards <= PROXY_SHARD_MAX_NUM_SHARDS) {
+          ++argv; --argc;
+          break;
+        }
+      }
+
+      // If we get here, the option was specified incorrectly:
+      usage();
+      break;
+    }
+
+    case 'P': {
+      // Pace the outgoing RTP packets of each frame over this percentage of the frame interval:
+      if (argc > 2 && argv[2][0] != '-') {
+        unsigned pacingPercent;
+        if (sscanf(argv[2], "%u", &pacingPercent) == 1
+            && pacingPercent > 0 && pacingPercent <= 100) {
+          MultiFramedRTPSink::defaultPacingPercent = pacingPercent;
+          ++argv; --argc;
+          break;
+        }
+      }
+
+      // If we get here, the option was specified incorrectly:
+      usage();
+      break;
+    }
+
     default: {
       usage();
       break;
@@ -170,6 +210,11 @@ int main(int argc, char** argv) {
     *env << "The '-U <username> <password>' option can be used only with -R\n";
     usage();
   }
+  if (numShards > 0 && proxyREGISTERRequests) {
+    // (A stream that's added by a "REGISTER" command would have no shard to live in.)
+    *env << "The -W and -R options cannot both be used!\n";
+    usage();
+  }
   if (streamRTPOverTCP) {
     if (tunnelOverHTTPPortNum > 0) {
       *env << "The -t and -T options cannot both be used!\n";
@@ -209,6 +254,8 @@ int main(int argc, char** argv) {
     exit(1);
   }
 
+  ProxyShardServer* shardServer = numShards > 0 ? (ProxyShardServer*)rtspServer : NULL;
+
   // Create a proxy for each "rtsp://" URL specified on the command line:
   for (i = 1; i < argc; ++i) {
     char const* proxiedStreamURL = argv[i];
@@ -218,13 +265,20 @@ int main(int argc, char** argv) {
     } else {
       sprintf(streamName, "proxyStream-%d", i); // there's more than one stream; distinguish them by name
     }
-    ServerMediaSession* sms
-      = ProxyServerMediaSession::createNew(*env, rtspServer,
-                       proxiedStreamURL, streamName,
-                       username, password, tunnelOverHTTPPortNum, verbosityLevel);
-    rtspServer->addServerMediaSession(sms);
-
-    char* proxyStreamURL = rtspServer->rtspURL(sms);
+    ServerMediaSession* sms;
+    char* proxyStreamURL;
+    if (shardServer != NULL) {
+      // The stream is proxied by (and lives in) one of the worker threads:
+      sms = shardServer->addProxyStream(proxiedStreamURL, streamName,
+                    username, password, tunnelOverHTTPPortNum, verbosityLevel);
+      proxyStreamURL = shardServer->proxyStreamURL(sms);
+    } else {
+      sms = ProxyServerMediaSession::createNew(*env, rtspServer,
+                           proxiedStreamURL, streamName,
+                           username, password, tunnelOverHTTPPortNum, verbosityLevel);
+      rtspServer->addServerMediaSession(sms);
+      proxyStreamURL = rtspServer->rtspURL(sms);
+    }
     *env << "RTSP stream, proxying the stream \"" << proxiedStreamURL << "\"\n";
     *env << "\tPlay this stream using the URL: " << proxyStreamURL << "\n";
     delete[] proxyStreamURL;
@@ -244,6 +298,15 @@ int main(int argc, char** argv) {
     *env << "\n(RTSP-over-HTTP tunneling is not available.)\n";
   }
 
+  if (shardServer != NULL) {
+    // From now on, each stream is handled only by its worker thread; this thread just accepts connections:
+    if (!shardServer->startShards()) {
+      *env << "Failed to start the worker threads\n";
+      exit(1);
+    }
+    *env << "(The streams are proxied by " << shardServer->numShards() << " worker threads.)\n";
+  }
+
   // Now, enter the event loop:
   env->taskScheduler().doEventLoop(); // does not return
 
@@ -68,6 +68,9 @@ ASRtsp2RtpChannel::ASRtsp2RtpChannel(u_int32_t ulEnvIndex,UsageEnvironment& env,
   m_nTransID  = 0;
   m_LocalPorts = NULL;
   m_enStatus = AS_RTSP_STATUS_INIT;
+  m_bFastStart = False;
+  m_bRedescribed = False;
+  m_ulSetupPending = 0;
 }
 
 ASRtsp2RtpChannel::~ASRtsp2RtpChannel() {
@@ -83,7 +86,17 @@ int32_t ASRtsp2RtpChannel::open(int nCallId,int nTransID,CRtpPortPair* local_por
     m_nCallId = nCallId;
     m_nTransID = nTransID;
 
-    return sendOptionsCommand(&ASRtsp2RtpChannel::continueAfterOPTIONS);
+    m_bFastStart = (0 != ASRtsp2SiptManager::instance().getFastStart());
+    if (!m_bFastStart) {
+        return sendOptionsCommand(&ASRtsp2RtpChannel::continueAfterOPTIONS);
+    }
+
+    /* no OPTIONS,the SETUPs follow the DESCRIBE at once */
+    setRequestPipelining(True);
+    /* nothing tells if GET_PARAMETER is supported,send the keep-alive anyway,an error answer is ignored */
+    SupportsGetParameter(True);
+    setDescribeCacheTTL(ASRtsp2SiptManager::instance().getDescribeCacheTTL());
+    return sendDescribeCommand(continueAfterDESCRIBE);
 }
 void    ASRtsp2RtpChannel::close()
 {
@@ -103,7 +116,37 @@ void    ASRtsp2RtpChannel::close()
             // Don't bother handling the response to the "TEARDOWN".
             sendTeardownCommand(*scs.session, continueAfterTeardown);
         }
+
+        /* the packet buffers of all the sources of this env */
+        PacketSlabStats slabStats;
+        if (BufferedPacketSlab::getStats(envir(),slabStats)) {
+            AS_LOG(AS_LOG_INFO,"ASRtsp2RtpChannel::close,packet slab sources:[%u] small slots:[%u/%u] peak:[%u] "
+                               "jumbo slots:[%u/%u] peak:[%u] bytes:[%llu].",
+                               slabStats.numSources,slabStats.smallSlotsInUse,slabStats.smallSlots,
+                               slabStats.smallSlotsPeak,slabStats.jumboSlotsInUse,slabStats.jumboSlots,
+                               slabStats.jumboSlotsPeak,(unsigned long long)slabStats.bytesAllocated);
+        }
+
+        /* the sinks give their ports back now,not when the teardown is answered */
+        iter.reset();
+        while ((subsession = iter.next()) != NULL) {
+            RTPSource* pRtpSource = subsession->rtpSource();
+            if ((NULL != pRtpSource) && (0 < pRtpSource->numReceiveBatches())) {
+                AS_LOG(AS_LOG_INFO,"ASRtsp2RtpChannel::close,subsession:[%s] recv batches:[%u] packets:[%llu] "
+                                   "average:[%.1f] max:[%u].",
+                                   subsession->mediumName(),pRtpSource->numReceiveBatches(),
+                                   (unsigned long long)pRtpSource->numBatchedPackets(),
+                                   pRtpSource->averageReceiveBatchSize(),pRtpSource->maxReceiveBatchSize());
+            }
+            if (subsession->sink != NULL) {
+                Medium::close(subsession->sink);
+                subsession->sink = NULL;
+            }
+        }
     }
+    /* the call is gone,its session and ports may be deleted before the teardown is answered */
+    m_pObserver  = NULL;
+    m_LocalPorts = NULL;
 }
 
 void ASRtsp2RtpChannel::play()
@@ -130,6 +173,13 @@ void ASRtsp2RtpChannel::play()
                subsession->sink = NULL;
                continue;
            }
+            if (NULL == subsession->sink) {
+                /* a call without one of its media is not set up */
+                AS_LOG(AS_LOG_ERROR,"ASRtsp2RtpChannel::play,create the %s sink of the call:[%d] fail.",
+                                    subsession->mediumName(),m_nCallId);
+                shutdownStream();
+                return;
+            }
 
 #else
             // Having successfully setup the subsession, create a data sink for it, and call "startPlaying()" on it.
@@ -236,7 +286,11 @@ void    ASRtsp2RtpChannel::handle_after_describe(int resultCode, char* resultStr
         // calling "MediaSubsession::initiate()", and then sending a RTSP "SETUP" command, on each one.
         // (Each 'subsession' will have its own data source.)
         scs.iter = new MediaSubsessionIterator(*scs.session);
-        setupNextSubsession();
+        if (m_bFastStart) {
+            setupAllSubsessions();
+        } else {
+            setupNextSubsession();
+        }
 
         return;
     } while (0);
@@ -251,6 +305,10 @@ void    ASRtsp2RtpChannel::handle_after_describe(int resultCode, char* resultStr
 void    ASRtsp2RtpChannel::handle_after_setup(int resultCode, char* resultString)
 {
     if(0 != resultCode) {
+        delete[] resultString;
+        if (redescribe(resultCode)) {
+            return;
+        }
         shutdownStream();
         return;
     }
@@ -262,6 +320,14 @@ void    ASRtsp2RtpChannel::handle_after_setup(int resultCode, char* resultString
     } while (0);
     delete[] resultString;
 
+    /* the sip answer waits for the last SETUP */
+    if (m_bFastStart) {
+        if ((0 < m_ulSetupPending) && (0 == --m_ulSetupPending)) {
+            setupDone();
+        }
+        return;
+    }
+
     // Set up the next subsession, if any:
     setupNextSubsession();
     return;
@@ -455,35 +521,66 @@ void ASRtsp2RtpChannel::setupNextSubsession() {
 
     scs.subsession = scs.iter->next();
     if (scs.subsession != NULL) {
-        if (!scs.subsession->initiate()) {
+        if (!initSubsession(scs.subsession)) {
             setupNextSubsession(); // give up on this subsession; go to the next one
         } else {
-
-            if (scs.subsession->rtpSource() != NULL) {
-            // Because we're saving the incoming data, rather than playing
-            // it in real time, allow an especially large time threshold
-            // (1 second) for reordering misordered incoming packets:
-            unsigned const thresh = 1000000; // 1 second
-            scs.subsession->rtpSource()->setPacketReorderingThresholdTime(thresh);
-
-            // Set the RTP source's OS socket buffer size as appropriate - either if we were explicitly asked (using -B),
-            // or if the desired FileSink buffer size happens to be larger than the current OS socket buffer size.
-            // (The latter case is a heuristic, on the assumption that if the user asked for a large FileSink buffer size,
-            // then the input data rate may be large enough to justify increasing the OS socket buffer size also.)
-            int socketNum = scs.subsession->rtpSource()->RTPgs()->socketNum();
-            unsigned curBufferSize = getReceiveBufferSize(envir(), socketNum);
-            unsigned ulRecvBufSize = ASRtsp2SiptManager::instance().getRecvBufSize();
-            if (ulRecvBufSize > curBufferSize) {
-                (void)setReceiveBufferTo(envir(), socketNum, ulRecvBufSize);
-              }
-            }
-
             // Continue setting up this subsession, by sending a RTSP "SETUP" command:
             sendSetupCommand(*scs.subsession, continueAfterSETUP, False, REQUEST_STREAMING_OVER_TCP);
         }
         return;
     }
 
+    setupDone();
+    return;
+}
+
+void ASRtsp2RtpChannel::setupAllSubsessions() {
+    /* the client holds the SETUPs after the first one until the session is known */
+    MediaSubsession* subsession;
+    m_ulSetupPending = 0;
+    while ((subsession = scs.iter->next()) != NULL) {
+        if (initSubsession(subsession)) {
+            sendSetupCommand(*subsession, continueAfterSETUP, False, REQUEST_STREAMING_OVER_TCP);
+            m_ulSetupPending++;
+        }
+    }
+    scs.subsession = NULL;
+    if (0 == m_ulSetupPending) {
+        setupDone();
+    }
+    return;
+}
+
+Boolean ASRtsp2RtpChannel::initSubsession(MediaSubsession* subsession) {
+    if (!subsession->initiate()) {
+        return False;
+    }
+
+    if (subsession->rtpSource() != NULL) {
+        // Because we're saving the incoming data, rather than playing
+        // it in real time, allow an especially large time threshold
+        // (1 second) for reordering misordered incoming packets:
+        unsigned const thresh = 1000000; // 1 second
+        subsession->rtpSource()->setPacketReorderingThresholdTime(thresh);
+
+        // Set the RTP source's OS socket buffer size as appropriate - either if we were explicitly asked (using -B),
+        // or if the desired FileSink buffer size happens to be larger than the current OS socket buffer size.
+        // (The latter case is a heuristic, on the assumption that if the user asked for a large FileSink buffer size,
+        // then the input data rate may be large enough to justify increasing the OS socket buffer size also.)
+        int socketNum = subsession->rtpSource()->RTPgs()->socketNum();
+        unsigned curBufferSize = getReceiveBufferSize(envir(), socketNum);
+        unsigned ulRecvBufSize = ASRtsp2SiptManager::instance().getRecvBufSize();
+        if (ulRecvBufSize > curBufferSize) {
+            (void)setReceiveBufferTo(envir(), socketNum, ulRecvBufSize);
+        }
+
+        /* read the rtp packets of a wakeup in one recvmmsg */
+        subsession->rtpSource()->setReceiveBatch(ASRtsp2SiptManager::instance().getRecvBatch());
+    }
+    return True;
+}
+
+void ASRtsp2RtpChannel::setupDone() {
     if(NULL != m_pObserver)
     {
         m_enStatus = AS_RTSP_STATUS_SETUP;
@@ -491,10 +588,31 @@ void ASRtsp2RtpChannel::setupNextSubsession() {
     }
 
     /* send the play by the control */
-
     return;
 }
 
+Boolean ASRtsp2RtpChannel::redescribe(int resultCode) {
+    /* only an answer of the server says the SDP is stale,the client dropped it from the cache already */
+    if ((0 >= resultCode) || !describeWasCached() || m_bRedescribed) {
+        return False;
+    }
+    AS_LOG(AS_LOG_INFO,"ASRtsp2RtpChannel::redescribe,the cached sdp is refused:[%d],describe again.",resultCode);
+    m_bRedescribed = True;
+
+    /* no sink yet,the sinks are created by the play */
+    if (scs.session != NULL) {
+        Medium::close(scs.session);
+        scs.session = NULL;
+    }
+    delete scs.iter;
+    scs.iter = NULL;
+    scs.subsession = NULL;
+
+    resetForRedescribe();
+    sendDescribeCommand(continueAfterDESCRIBE);
+    return True;
+}
+
 void ASRtsp2RtpChannel::shutdownStream(int exitCode) {
 
     // First, check whether any subsessions have still to be closed:
@@ -664,9 +782,40 @@ void ASRtsp2SipStreamState::open(CRtpPortPair* local_ports)
 }
 
 
+CRtpPeerReport::CRtpPeerReport()
+{
+    m_ulPackets        = 0;
+    m_ulFractionLost   = 0;
+    m_ulCumulativeLost = 0;
+}
+
+void CRtpPeerReport::on_packet(void* pCtx, uint32_t ulPort, const uint8_t* pData, uint32_t ulLen)
+{
+    CRtpPeerReport* pReport = (CRtpPeerReport*)pCtx;
+    pReport->m_ulPackets++;
+
+    /* the first report block of a SR(200) or RR(201) is about our stream */
+    if ((0 == (pData[0] & 0x1F)) || ((200 != pData[1]) && (201 != pData[1]))) {
+        return;
+    }
+    uint32_t ulBlock = (200 == pData[1]) ? 28 : 8;
+    if (ulBlock + 8 > ulLen) {
+        return;
+    }
+    pReport->m_ulFractionLost   = pData[ulBlock + 4];
+    pReport->m_ulCumulativeLost = ((u_int32_t)pData[ulBlock + 5] << 16)
+                                | ((u_int32_t)pData[ulBlock + 6] << 8) | pData[ulBlock + 7];
+}
+
 ASRtsp2SipVideoSink* ASRtsp2SipVideoSink::createNew(UsageEnvironment& env, MediaSubsession& subsession,
                                   CRtpPortPair* local_ports,CRtpDestinations* des) {
-    return new ASRtsp2SipVideoSink(env, subsession,local_ports,des);
+    ASRtsp2SipVideoSink* pSink = new ASRtsp2SipVideoSink(env, subsession,local_ports,des);
+    if (pSink->m_bShared && !pSink->m_bSsrcBound) {
+        /* the peer's reports on the shared socket could not find the call */
+        Medium::close(pSink);
+        return NULL;
+    }
+    return pSink;
 }
 
 ASRtsp2SipVideoSink::ASRtsp2SipVideoSink(UsageEnvironment& env, MediaSubsession& subsession,
@@ -675,6 +824,9 @@ ASRtsp2SipVideoSink::ASRtsp2SipVideoSink(UsageEnvironment& env, MediaSubsession&
     fReceiveBuffer = (u_int8_t*)&fMediaBuffer[0];
     prefixSize = 0;
     m_pVideoSession = NULL;
+    m_paceTask = NULL;
+    m_bShared = local_ports->shared();
+    m_bSsrcBound = false;
 
     fReceiveBuffer = (u_int8_t*)&fMediaBuffer[DUMMY_SINK_H264_STARTCODE_SIZE];
     fMediaBuffer[0] = 0x00;
@@ -688,29 +840,88 @@ ASRtsp2SipVideoSink::ASRtsp2SipVideoSink(UsageEnvironment& env, MediaSubsession&
 
     rtp_session_set_scheduling_mode(m_pVideoSession,1);
     rtp_session_set_blocking_mode(m_pVideoSession,0);
-    rtp_session_set_local_addr(m_pVideoSession, "192.168.2.27", local_ports->getVRtpPort(), local_ports->getVRtcpPort());
+    if (m_bShared) {
+        /* the sockets belong to the port pool,the session only sends on them */
+        rtp_session_set_sockets(m_pVideoSession, local_ports->getVRtpSock(), local_ports->getVRtcpSock());
+    }
+    else {
+        rtp_session_set_reuseaddr(m_pVideoSession, ASRtsp2SiptManager::instance().getRtpReusePort());
+        rtp_session_set_local_addr(m_pVideoSession, ASRtsp2SiptManager::instance().getRtpLocalIP(),
+                                   local_ports->getVRtpPort(), local_ports->getVRtcpPort());
+    }
     rtp_session_set_remote_addr_full (m_pVideoSession,des->ServerVideoAddr().c_str(), des->ServerVideoPort(), des->ServerVideoAddr().c_str(), des->ServerVideoPort()+1);
     rtp_session_enable_adaptive_jitter_compensation(m_pVideoSession,1);
     rtp_session_set_jitter_compensation(m_pVideoSession,40);
-    rtp_session_set_payload_type(m_pVideoSession,105/*fSubsession.rtpPayloadFormat()*/);
-
-    uint32_t rtpTimestampFrequency = fSubsession.rtpTimestampFrequency();
-    uint32_t ulFPS = fSubsession.videoFPS();
-    if (0 == rtpTimestampFrequency || 0 == ulFPS) {
-        m_rtpTimestampdiff = H264_RTP_TIMESTAMP_FREQUE;
+    rtp_session_set_payload_type(m_pVideoSession,fSubsession.rtpPayloadFormat());
+
+    m_ulTimestampFreq = fSubsession.rtpTimestampFrequency();
+    if (0 == m_ulTimestampFreq) {
+        m_ulTimestampFreq = VIDEO_RTP_TIMESTAMP_FREQUE;
+    }
+    m_ulTimestampBase = (u_int32_t)our_random32();
+
+    /* the rtp session keeps the ports,the packets are built and sent by the packetizer on its socket */
+    m_enCodec = AS_RTP_CODEC_H264;
+    if (0 == strcmp(fSubsession.codecName(), "H265")) {
+        m_enCodec = AS_RTP_CODEC_H265;
+    }
+    /* the ssrc may change on the bind,the packetizer sends with the one bound */
+    if (m_bShared) {
+        m_bSsrcBound = (AS_ERROR_CODE_OK == ASRtsp2SiptManager::instance().bind_rtp_ssrc(
+                                                m_pVideoSession, CRtpPeerReport::on_packet, &m_peerReport));
+        if (!m_bSsrcBound) {
+            AS_LOG(AS_LOG_ERROR,"ASRtsp2SipVideoSink::ASRtsp2SipVideoSink,bind the ssrc:[%u] on the shared socket fail.",
+                                rtp_session_get_send_ssrc(m_pVideoSession));
+        }
     }
-    else
-    {
-        m_rtpTimestampdiff = rtpTimestampFrequency / ulFPS;
+    /* a paced frame is queued whole,so the batch takes a big key frame */
+    u_int32_t ulPacePercent = ASRtsp2SiptManager::instance().getPacePercent();
+    m_bPacketizer = (AS_ERROR_CODE_OK == m_Packetizer.init(m_enCodec, fSubsession.rtpPayloadFormat(),
+                                                          rtp_session_get_send_ssrc(m_pVideoSession),
+                                                          MAX_RTP_PKT_LENGTH,
+                                                          (0 < ulPacePercent) ? AS_RTP_PACKETIZER_MAX_BATCH
+                                                                              : AS_RTP_PACKETIZER_BATCH))
+                 && (AS_ERROR_CODE_OK == m_Packetizer.set_destination(des->ServerVideoAddr().c_str(),
+                                                                     des->ServerVideoPort()));
+    if (!m_bPacketizer) {
+        AS_LOG(AS_LOG_ERROR,"ASRtsp2SipVideoSink::ASRtsp2SipVideoSink,init the packetizer to:[%s:%d] fail,"
+                            "send the video one packet a call.",
+                            des->ServerVideoAddr().c_str(),des->ServerVideoPort());
+        m_Packetizer.release();
+    }
+    if (m_bPacketizer && (0 < ulPacePercent)) {
+        m_Packetizer.set_pacing(ulPacePercent, m_ulTimestampFreq,
+                                ASRtsp2SiptManager::instance().getPaceBurst());
     }
-    m_lastTS = 0;
-
 }
 
 ASRtsp2SipVideoSink::~ASRtsp2SipVideoSink() {
     fReceiveBuffer = NULL;
+    envir().taskScheduler().unscheduleDelayedTask(m_paceTask);
+    if (m_bPacketizer) {
+        AS_RTP_PACKETIZER_STAT stat;
+        m_Packetizer.get_stat(stat);
+        AS_LOG(AS_LOG_INFO,"ASRtsp2SipVideoSink::~ASRtsp2SipVideoSink,frames:[%llu],nals:[%llu],packets:[%llu],"
+                           "bytes:[%llu],send calls:[%llu],dropped:[%llu],paced:[%llu],pace delay:[%llu]us,"
+                           "max pace delay:[%llu]us.",
+                           (unsigned long long)stat.ullFrames,(unsigned long long)stat.ullNals,
+                           (unsigned long long)stat.ullPackets,(unsigned long long)stat.ullBytes,
+                           (unsigned long long)stat.ullSendCalls,(unsigned long long)stat.ullDropped,
+                           (unsigned long long)stat.ullPacedFrames,(unsigned long long)stat.ullPaceDelay,
+                           (unsigned long long)stat.ullPaceMaxDelay);
+        m_Packetizer.release();
+    }
      if(NULL != m_pVideoSession)
     {
+        if (m_bSsrcBound) {
+            ASRtsp2SiptManager::instance().unbind_rtp_ssrc(rtp_session_get_send_ssrc(m_pVideoSession));
+            AS_LOG(AS_LOG_INFO,"ASRtsp2SipVideoSink::~ASRtsp2SipVideoSink,peer reports:[%u],fraction lost:[%u/256],lost:[%u].",
+                               m_peerReport.m_ulPackets,m_peerReport.m_ulFractionLost,m_peerReport.m_ulCumulativeLost);
+        }
+        if (m_bShared) {
+            /* do not let the session close the shared sockets */
+            rtp_session_set_sockets(m_pVideoSession, -1, -1);
+        }
         rtp_session_destroy(m_pVideoSession);
         m_pVideoSession = NULL;
     }
@@ -720,80 +931,109 @@ ASRtsp2SipVideoSink::~ASRtsp2SipVideoSink() {
 void ASRtsp2SipVideoSink::afterGettingFrame(void* clientData, unsigned frameSize, unsigned numTruncatedBytes,
                   struct timeval presentationTime, unsigned durationInMicroseconds) {
     ASRtsp2SipVideoSink* sink = (ASRtsp2SipVideoSink*)clientData;
+    as_env_pool::add_frame(frameSize);
     sink->afterGettingFrame(frameSize, numTruncatedBytes, presentationTime, durationInMicroseconds);
 }
 
 void ASRtsp2SipVideoSink::afterGettingFrame(unsigned frameSize, unsigned numTruncatedBytes,
                   struct timeval presentationTime, unsigned /*durationInMicroseconds*/) {
 
-    unsigned int size = frameSize;
-    int  sendBytes = 0;
-    uint32_t valid_len = frameSize;
-    unsigned char NALU = fMediaBuffer[prefixSize];
-    m_lastTS += m_rtpTimestampdiff;
-
-    mblk_t* packet = NULL;
+    /* the NALs of one access unit share the presentation time,and so the rtp timestamp */
+    u_int32_t ulTimestamp = m_ulTimestampBase
+                          + (u_int32_t)presentationTime.tv_sec*m_ulTimestampFreq
+                          + (u_int32_t)(((u_int64_t)presentationTime.tv_usec*m_ulTimestampFreq)/1000000);
+    /* the access unit ends with the marker bit of the packet that ended this NAL */
+    bool bEndOfFrame = true;
+    if (NULL != fSubsession.rtpSource()) {
+        bEndOfFrame = (False != fSubsession.rtpSource()->curPacketMarkerBit());
+    }
+    if (!m_bPacketizer) {
+        sendBySession(frameSize, ulTimestamp, bEndOfFrame);
+    }
+    else {
+        m_Packetizer.send_nals(rtp_session_get_rtp_socket(m_pVideoSession),
+                               &fMediaBuffer[0], frameSize + prefixSize, ulTimestamp, bEndOfFrame);
+        if (m_Packetizer.paced()) {
+            pace();
+            return;
+        }
+    }
 
+    continuePlaying();
+}
 
-    if (size <= MAX_RTP_PKT_LENGTH)
-    {
-        sendBytes = rtp_session_send_with_ts(m_pVideoSession, (uint8_t *)&fMediaBuffer[prefixSize], size, m_lastTS);
+void ASRtsp2SipVideoSink::sendBySession(unsigned frameSize, u_int32_t ulTimestamp, bool bEndOfFrame) {
+    u_int8_t* pNal        = &fMediaBuffer[prefixSize];
+    u_int32_t ulNalHdrLen = (AS_RTP_CODEC_H265 == m_enCodec) ? 2 : 1;
+    if (frameSize <= ulNalHdrLen) {
+        return;
     }
-    else if (size > MAX_RTP_PKT_LENGTH)
-    {
-        //зΪܶͣÿǰҪͷдһ
-        size -= 1;
-        int k = 0, l = 0;
-        k = size/MAX_RTP_PKT_LENGTH;
-        l = size%MAX_RTP_PKT_LENGTH;
-        int t = 0;
-        int pos = 5;
-        if (l != 0)
-        {
-            k = k + 1;
+    if (frameSize <= MAX_RTP_PKT_LENGTH) {
+        sendPacket(pNal, frameSize, ulTimestamp, bEndOfFrame);
+        return;
+    }
+
+    /* FU-A(H.264) or FU(H.265),the FU header of a fragment is written over the
+     * tail of the fragment sent before it,the first one over the start code */
+    u_int32_t ulFuHdrLen = ulNalHdrLen + 1;
+    u_int8_t  ucHdr0     = pNal[0];
+    u_int8_t  ucHdr1     = pNal[1];
+    u_int8_t  ucType     = (AS_RTP_CODEC_H265 == m_enCodec) ? ((ucHdr0 >> 1) & 0x3F) : (ucHdr0 & 0x1F);
+    u_int32_t ulOffset   = ulNalHdrLen;
+    while (ulOffset < frameSize) {
+        u_int32_t ulLen = frameSize - ulOffset;
+        if (ulLen > MAX_RTP_PKT_LENGTH - ulFuHdrLen) {
+            ulLen = MAX_RTP_PKT_LENGTH - ulFuHdrLen;
         }
-        while (t<k)//||(t==k&&l>0))
-        {
-            if (t<(k - 1))//(t<k&&l!=0)||(t<(k-1))&&(l==0))//(0==t)||(t<k&&0!=l))
-            {
-                fMediaBuffer[pos - 2] = (NALU & 0x60) | 28;
-                fMediaBuffer[pos - 1] = (NALU & 0x1f);
-                if (0 == t)
-                {
-                    fMediaBuffer[pos - 1] |= 0x80;
-                }
-                sendBytes = rtp_session_send_with_ts(m_pVideoSession,
-                    &fMediaBuffer[pos - 2],
-                    MAX_RTP_PKT_LENGTH + 2,
-                    m_lastTS);
-                t++;
-                pos += MAX_RTP_PKT_LENGTH;
-            }
-            else //if((k==t&&l>0)||((t==k-1)&&l==0))
-            {
-                int iSendLen;
-                if (l>0)
-                {
-                    iSendLen = valid_len - t*MAX_RTP_PKT_LENGTH;
-                }
-                else
-                    iSendLen = MAX_RTP_PKT_LENGTH;
-                fMediaBuffer[pos - 2] = (NALU & 0x60) | 28;
-                fMediaBuffer[pos - 1] = (NALU & 0x1f);
-                fMediaBuffer[pos - 1] |= 0x40;
-                packet = rtp_session_create_packet(m_pVideoSession, RTP_FIXED_HEADER_SIZE, &fMediaBuffer[pos - 2], iSendLen + 2);
-                if (NULL == packet)
-                {
-                    break;
-                }
-                rtp_header_t *rtp = (rtp_header_t*)packet->b_rptr;
-                rtp->markbit = 1;
-                sendBytes = rtp_session_sendm_with_ts(m_pVideoSession, packet,m_lastTS);
-                t++;
-            }
+        bool      bLast = (ulOffset + ulLen == frameSize);
+        u_int8_t* pFu   = pNal + ulOffset - ulFuHdrLen;
+        u_int8_t  ucFu  = ucType;
+        if (ulNalHdrLen == ulOffset) {
+            ucFu |= 0x80;
+        }
+        if (bLast) {
+            ucFu |= 0x40;
         }
+        if (AS_RTP_CODEC_H265 == m_enCodec) {
+            pFu[0] = (ucHdr0 & 0x81) | (49 << 1);
+            pFu[1] = ucHdr1;
+            pFu[2] = ucFu;
+        }
+        else {
+            pFu[0] = (ucHdr0 & 0xE0) | 28;
+            pFu[1] = ucFu;
+        }
+        sendPacket(pFu, ulFuHdrLen + ulLen, ulTimestamp, bLast && bEndOfFrame);
+        ulOffset += ulLen;
     }
+    /* the start code is kept for the next NAL */
+    fMediaBuffer[prefixSize - 1] = 0x01;
+}
 
+void ASRtsp2SipVideoSink::sendPacket(u_int8_t* pData, u_int32_t ulLen, u_int32_t ulTimestamp, bool bMarker) {
+    mblk_t* packet = rtp_session_create_packet(m_pVideoSession, RTP_FIXED_HEADER_SIZE, pData, ulLen);
+    if (NULL == packet) {
+        return;
+    }
+    rtp_header_t *rtp = (rtp_header_t*)packet->b_rptr;
+    rtp->markbit = bMarker ? 1 : 0;
+    rtp_session_sendm_with_ts(m_pVideoSession, packet, ulTimestamp);
+}
+
+void ASRtsp2SipVideoSink::paceTask(void* clientData) {
+    ASRtsp2SipVideoSink* sink = (ASRtsp2SipVideoSink*)clientData;
+    sink->pace();
+}
+
+void ASRtsp2SipVideoSink::pace() {
+    m_paceTask = NULL;
+    u_int32_t ulDelayUs = 0;
+    m_Packetizer.pace(rtp_session_get_rtp_socket(m_pVideoSession), ulDelayUs);
+    if (0 < ulDelayUs) {
+        /* the source keeps the packets meanwhile,fMediaBuffer is still referenced */
+        m_paceTask = envir().taskScheduler().scheduleDelayedTask(ulDelayUs, (TaskFunc*)paceTask, this);
+        return;
+    }
     continuePlaying();
 }
 
@@ -809,7 +1049,12 @@ Boolean ASRtsp2SipVideoSink::continuePlaying() {
 
 ASRtsp2SipAudioSink* ASRtsp2SipAudioSink::createNew(UsageEnvironment& env, MediaSubsession& subsession,
                                   CRtpPortPair* local_ports,CRtpDestinations* des) {
-  return new ASRtsp2SipAudioSink(env, subsession,local_ports,des);
+  ASRtsp2SipAudioSink* pSink = new ASRtsp2SipAudioSink(env, subsession,local_ports,des);
+  if (pSink->m_bShared && !pSink->m_bSsrcBound) {
+      Medium::close(pSink);
+      return NULL;
+  }
+  return pSink;
 }
 
 ASRtsp2SipAudioSink::ASRtsp2SipAudioSink(UsageEnvironment& env, MediaSubsession& subsession,
@@ -822,7 +1067,17 @@ ASRtsp2SipAudioSink::ASRtsp2SipAudioSink(UsageEnvironment& env, MediaSubsession&
 
     rtp_session_set_scheduling_mode(m_pAudioSession,1);
     rtp_session_set_blocking_mode(m_pAudioSession,0);
-    rtp_session_set_local_addr(m_pAudioSession, "192.168.2.27", local_ports->getARtpPort(), local_ports->getARtcpPort());
+    m_bShared = local_ports->shared();
+    m_bSsrcBound = false;
+    if (m_bShared) {
+        /* the sockets belong to the port pool,the session only sends on them */
+        rtp_session_set_sockets(m_pAudioSession, local_ports->getARtpSock(), local_ports->getARtcpSock());
+    }
+    else {
+        rtp_session_set_reuseaddr(m_pAudioSession, ASRtsp2SiptManager::instance().getRtpReusePort());
+        rtp_session_set_local_addr(m_pAudioSession, ASRtsp2SiptManager::instance().getRtpLocalIP(),
+                                   local_ports->getARtpPort(), local_ports->getARtcpPort());
+    }
     rtp_session_set_remote_addr_full (m_pAudioSession,des->ServerAudioAddr().c_str(), des->ServerAudioPort(), des->ServerAudioAddr().c_str(), des->ServerAudioPort()+1);
     rtp_session_enable_adaptive_jitter_compensation(m_pAudioSession,1);
     rtp_session_set_jitter_compensation(m_pAudioSession,20);
@@ -839,11 +1094,27 @@ ASRtsp2SipAudioSink::ASRtsp2SipAudioSink(UsageEnvironment& env, MediaSubsession&
     }
 
     m_lastTS = 0;
+    if (m_bShared) {
+        m_bSsrcBound = (AS_ERROR_CODE_OK == ASRtsp2SiptManager::instance().bind_rtp_ssrc(
+                                                m_pAudioSession, CRtpPeerReport::on_packet, &m_peerReport));
+        if (!m_bSsrcBound) {
+            AS_LOG(AS_LOG_ERROR,"ASRtsp2SipAudioSink::ASRtsp2SipAudioSink,bind the ssrc:[%u] on the shared socket fail.",
+                                rtp_session_get_send_ssrc(m_pAudioSession));
+        }
+    }
 }
 
 ASRtsp2SipAudioSink::~ASRtsp2SipAudioSink() {
     if(NULL != m_pAudioSession)
     {
+        if (m_bSsrcBound) {
+            ASRtsp2SiptManager::instance().unbind_rtp_ssrc(rtp_session_get_send_ssrc(m_pAudioSession));
+            AS_LOG(AS_LOG_INFO,"ASRtsp2SipAudioSink::~ASRtsp2SipAudioSink,peer reports:[%u],fraction lost:[%u/256],lost:[%u].",
+                               m_peerReport.m_ulPackets,m_peerReport.m_ulFractionLost,m_peerReport.m_ulCumulativeLost);
+        }
+        if (m_bShared) {
+            rtp_session_set_sockets(m_pAudioSession, -1, -1);
+        }
         rtp_session_destroy(m_pAudioSession);
         m_pAudioSession = NULL;
     }
@@ -852,6 +1123,7 @@ ASRtsp2SipAudioSink::~ASRtsp2SipAudioSink() {
 void ASRtsp2SipAudioSink::afterGettingFrame(void* clientData, unsigned frameSize, unsigned numTruncatedBytes,
                   struct timeval presentationTime, unsigned durationInMicroseconds) {
     ASRtsp2SipAudioSink* sink = (ASRtsp2SipAudioSink*)clientData;
+    as_env_pool::add_frame(frameSize);
     sink->afterGettingFrame(frameSize, numTruncatedBytes, presentationTime, durationInMicroseconds);
 }
 
@@ -1177,11 +1449,17 @@ CSipSession::CSipSession()
     m_strStreamType = "";
     m_ulRepInterval = GW_REPORT_DEFAULT;
     m_strReportUrl  = "";
+    m_ulCallCount   = 0;
+    m_bReleased     = false;
 }
 
 
 CSipSession::~CSipSession()
 {
+    if(NULL != m_mutex) {
+        as_destroy_mutex(m_mutex);
+        m_mutex = NULL;
+    }
 }
 
 void CSipSession::Init(std::string &strSessionID)
@@ -1227,11 +1505,6 @@ void CSipSession::SendStatusReport()
 }
 int32_t CSipSession::handle_invite(int nCallId,int nTransID,CRtpPortPair* local_ports,sdp_message_t *remote_sdp/* = NULL */)
 {
-    sdp_connection_t *audio_con  = NULL;
-    sdp_media_t      *md_audio   = NULL;
-    sdp_connection_t *video_con  = NULL;
-    sdp_media_t      *md_video   = NULL;
-    CRtpDestinations  dest;
     std::string strRtspUrl = "";
     ASEvLiveHttpClient as_http_client;
 
@@ -1244,120 +1517,254 @@ int32_t CSipSession::handle_invite(int nCallId,int nTransID,CRtpPortPair* local_
 #endif
 
     as_lock_guard locker(m_mutex);
-    /* get the rtsp play url first */
-
-    /* create the rtsp live session */
-    u_int32_t index = ASRtsp2SiptManager::instance().find_beast_thread();
-    UsageEnvironment* env = ASRtsp2SiptManager::instance().get_env(index);
-    RTSPClient* rtspClient = ASRtsp2RtpChannel::createNew(index,*env, strRtspUrl.c_str(),
-                                     RTSP_CLIENT_VERBOSITY_LEVEL, RTSP_AGENT_NAME);
-    if (rtspClient == NULL) {
-        ASRtsp2SiptManager::instance().releas_env(index);
+    if(m_callMap.end() != m_callMap.find(nCallId)) {
+        AS_LOG(AS_LOG_WARNING,"CSipSession::handle_invite,the call:[%d] is exist.",nCallId);
         return AS_ERROR_CODE_FAIL;
     }
 
-    ASRtsp2RtpChannel* AsRtspChannel = (ASRtsp2RtpChannel*)rtspClient;
-
-    if(NULL != remote_sdp) {
-        //set the remote info
-        audio_con = eXosip_get_audio_connection(remote_sdp);
-        md_audio = eXosip_get_audio_media(remote_sdp);
-        video_con = eXosip_get_video_connection(remote_sdp);
-        md_video = eXosip_get_video_media(remote_sdp);
-        std::string strVideoAddr = "";
-        std::string strAudioAddr = "";
-        unsigned short usVideoPort = 0;
-        unsigned short usAudioPort = 0;
-        if(video_con) {
-            strVideoAddr = video_con->c_addr;
-            usVideoPort = atoi(md_video->m_port);
-        }
-        if(audio_con) {
-            strAudioAddr = audio_con->c_addr;
-            usAudioPort = atoi(md_audio->m_port);
-        }
-        dest.init(strVideoAddr,usVideoPort, strAudioAddr,usAudioPort);
-        AsRtspChannel->SetDestination(dest);
+    /* the rtsp live session is created on the env thread,all the later commands go to the same env */
+    CSipCall* pCall = NULL;
+    pCall = AS_NEW(pCall);
+    if(NULL == pCall) {
+        return AS_ERROR_CODE_FAIL;
     }
+    pCall->m_pSession   = this;
+    pCall->m_nCallId    = nCallId;
+    pCall->m_nTransID   = nTransID;
+    pCall->m_LocalPorts = local_ports;
+    pCall->m_strRtspUrl = strRtspUrl;
+    pCall->m_ulEnvIndex = ASRtsp2SiptManager::instance().find_beast_thread();
 
-    AsRtspChannel->open(nCallId, nTransID,local_ports, this);
+    if(AS_ERROR_CODE_OK != post_call_cmd(pCall,open_call,remote_sdp)) {
+        ASRtsp2SiptManager::instance().releas_env(pCall->m_ulEnvIndex);
+        AS_DELETE(pCall);
+        return AS_ERROR_CODE_FAIL;
+    }
 
-    /* bind the rtsp channel */
-    m_callRtspMap.insert(CALLRTSPCHANNELMAP::value_type(nCallId,AsRtspChannel));
+    /* bind the call */
+    m_callMap.insert(SIPCALLMAP::value_type(nCallId,pCall));
+    m_ulCallCount++;
 
     return AS_ERROR_CODE_OK;
 }
 
 int32_t  CSipSession::handle_bye(int nCallId)
 {
-    as_lock_guard locker(m_mutex);
-    CALLRTSPCHANNELMAP::iterator iter = m_callRtspMap.find(nCallId);
-    if(iter == m_callRtspMap.end())
+    bool bFree = false;
     {
-        return AS_ERROR_CODE_FAIL;
-    }
+        as_lock_guard locker(m_mutex);
+        SIPCALLMAP::iterator iter = m_callMap.find(nCallId);
+        if(iter == m_callMap.end())
+        {
+            return AS_ERROR_CODE_FAIL;
+        }
 
-    ASRtsp2RtpChannel* AsRtspChannel = iter->second;
-    ASRtsp2SiptManager::instance().releas_env(AsRtspChannel->index());
-    AsRtspChannel->close();
-    m_callRtspMap.erase(iter);
+        CSipCall* pCall = iter->second;
+        m_callMap.erase(iter);
+        if(AS_ERROR_CODE_OK != post_call_cmd(pCall,close_call,NULL)) {
+            AS_LOG(AS_LOG_WARNING,"CSipSession::handle_bye,post the close of the call:[%d] fail,close it here.",nCallId);
+            /* the env is gone,no close comes back for this call */
+            finish_call(pCall);
+            m_ulCallCount--;
+            bFree = (m_bReleased && (0 == m_ulCallCount));
+        }
+    }
+    if(bFree) {
+        AS_DELETE(this);
+    }
     return AS_ERROR_CODE_OK;
 }
 void    CSipSession::handle_ack(int nCallId,sdp_message_t *remote_sdp/* = NULL */)
 {
-    sdp_connection_t *audio_con  = NULL;
-    sdp_media_t      *md_audio   = NULL;
-    sdp_connection_t *video_con  = NULL;
-    sdp_media_t      *md_video   = NULL;
-    CRtpDestinations  dest;
-
     as_lock_guard locker(m_mutex);
-    CALLRTSPCHANNELMAP::iterator iter = m_callRtspMap.find(nCallId);
-    if(iter == m_callRtspMap.end())
+    SIPCALLMAP::iterator iter = m_callMap.find(nCallId);
+    if(iter == m_callMap.end())
     {
         return;
     }
 
-    ASRtsp2RtpChannel* AsRtspChannel = iter->second;
-    if(NULL != remote_sdp) {
-        //set the remote info
-        audio_con = eXosip_get_audio_connection(remote_sdp);
-        md_audio = eXosip_get_audio_media(remote_sdp);
-        video_con = eXosip_get_video_connection(remote_sdp);
-        md_video = eXosip_get_video_media(remote_sdp);
-        std::string strVideoAddr = "";
-        std::string strAudioAddr = "";
-        unsigned short usVideoPort = 0;
-        unsigned short usAudioPort = 0;
-        if(video_con) {
-            strVideoAddr = video_con->c_addr;
-            usVideoPort = atoi(md_video->m_port);
-        }
-        if(audio_con) {
-            strAudioAddr = audio_con->c_addr;
-            usAudioPort = atoi(md_audio->m_port);
-        }
-        dest.init(strVideoAddr,usVideoPort, strAudioAddr,usAudioPort);
-        AsRtspChannel->SetDestination(dest);
+    if(AS_ERROR_CODE_OK != post_call_cmd(iter->second,play_call,remote_sdp)) {
+        AS_LOG(AS_LOG_WARNING,"CSipSession::handle_ack,post the play of the call:[%d] fail.",nCallId);
     }
-
-    AsRtspChannel->play();
 }
 
 void    CSipSession::close_all()
 {
     as_lock_guard locker(m_mutex);
-    ASRtsp2RtpChannel* AsRtspChannel =  NULL;
-    CALLRTSPCHANNELMAP::iterator iter = m_callRtspMap.begin();
-    for(;iter != m_callRtspMap.end();++iter)
+    SIPCALLMAP::iterator iter = m_callMap.begin();
+    for(;iter != m_callMap.end();++iter)
     {
-        AsRtspChannel = iter->second;
-        ASRtsp2SiptManager::instance().releas_env(AsRtspChannel->index());
-        AsRtspChannel->close();
+        if(AS_ERROR_CODE_OK != post_call_cmd(iter->second,close_call,NULL)) {
+            AS_LOG(AS_LOG_WARNING,"CSipSession::close_all,post the close of the call:[%d] fail,close it here.",iter->first);
+            finish_call(iter->second);
+            m_ulCallCount--;
+        }
     }
-    m_callRtspMap.clear();
+    m_callMap.clear();
     return;
 }
+
+void    CSipSession::release()
+{
+    bool bFree = false;
+    {
+        as_lock_guard locker(m_mutex);
+        m_bReleased = true;
+        bFree = (0 == m_ulCallCount);
+    }
+    if(bFree) {
+        delete this;
+    }
+}
+
+void    CSipSession::call_closed()
+{
+    bool bFree = false;
+    {
+        as_lock_guard locker(m_mutex);
+        m_ulCallCount--;
+        bFree = m_bReleased && (0 == m_ulCallCount);
+    }
+    if(bFree) {
+        delete this;
+    }
+}
+
+void CSipSession::get_destination(sdp_message_t *remote_sdp,CRtpDestinations& dest)
+{
+    sdp_connection_t *audio_con  = NULL;
+    sdp_media_t      *md_audio   = NULL;
+    sdp_connection_t *video_con  = NULL;
+    sdp_media_t      *md_video   = NULL;
+
+    if(NULL == remote_sdp) {
+        return;
+    }
+
+    //set the remote info
+    audio_con = eXosip_get_audio_connection(remote_sdp);
+    md_audio = eXosip_get_audio_media(remote_sdp);
+    video_con = eXosip_get_video_connection(remote_sdp);
+    md_video = eXosip_get_video_media(remote_sdp);
+    std::string strVideoAddr = "";
+    std::string strAudioAddr = "";
+    unsigned short usVideoPort = 0;
+    unsigned short usAudioPort = 0;
+    if(video_con) {
+        strVideoAddr = video_con->c_addr;
+        usVideoPort = atoi(md_video->m_port);
+    }
+    if(audio_con) {
+        strAudioAddr = audio_con->c_addr;
+        usAudioPort = atoi(md_audio->m_port);
+    }
+    dest.init(strVideoAddr,usVideoPort, strAudioAddr,usAudioPort);
+}
+
+int32_t CSipSession::post_call_cmd(CSipCall* pCall,AS_ENV_CMD_FUNC pFunc,sdp_message_t *remote_sdp)
+{
+    CSipCallCmd* pCmd = NULL;
+    pCmd = AS_NEW(pCmd);
+    if(NULL == pCmd) {
+        return AS_ERROR_CODE_FAIL;
+    }
+    pCmd->m_pCall = pCall;
+    /* the sdp belongs to the sip stack,parse it on this thread */
+    get_destination(remote_sdp,pCmd->m_dest);
+
+    /* a close must reach the session even if the env pool drops it */
+    AS_ENV_CMD_FREE pFree = (close_call == pFunc) ? free_close_cmd : free_call_cmd;
+    if(AS_ERROR_CODE_OK != ASRtsp2SiptManager::instance().post_env(pCall->m_ulEnvIndex,pFunc,pCmd,pFree)) {
+        AS_DELETE(pCmd);
+        return AS_ERROR_CODE_FAIL;
+    }
+    return AS_ERROR_CODE_OK;
+}
+
+void CSipSession::free_call_cmd(void* pArg)
+{
+    CSipCallCmd* pCmd = (CSipCallCmd*)pArg;
+    AS_DELETE(pCmd);
+}
+
+void CSipSession::free_close_cmd(void* pArg)
+{
+    CSipCallCmd* pCmd     = (CSipCallCmd*)pArg;
+    CSipCall*    pCall    = pCmd->m_pCall;
+    CSipSession* pSession = pCall->m_pSession;
+
+    AS_LOG(AS_LOG_WARNING,"CSipSession::free_close_cmd,the close of the call:[%d] is dropped,close it here.",
+                          pCall->m_nCallId);
+    finish_call(pCall);
+    AS_DELETE(pCmd);
+    pSession->call_closed();
+}
+
+void CSipSession::finish_call(CSipCall* pCall)
+{
+    /* the scheduler of the channel went with its env,the channel can not be closed any more */
+    if(NULL != pCall->m_pChannel) {
+        AS_LOG(AS_LOG_WARNING,"CSipSession::finish_call,the env of the call:[%d] is gone,leave its rtsp channel.",
+                              pCall->m_nCallId);
+        pCall->m_pChannel = NULL;
+    }
+    ASRtsp2SiptManager::instance().free_port_pair(pCall->m_nCallId);
+    ASRtsp2SiptManager::instance().releas_env(pCall->m_ulEnvIndex);
+    AS_DELETE(pCall);
+}
+
+void CSipSession::open_call(UsageEnvironment& env,void* pArg)
+{
+    CSipCallCmd* pCmd  = (CSipCallCmd*)pArg;
+    CSipCall*    pCall = pCmd->m_pCall;
+
+    /* create the rtsp live session */
+    pCall->m_pChannel = ASRtsp2RtpChannel::createNew(pCall->m_ulEnvIndex,env, pCall->m_strRtspUrl.c_str(),
+                                                     RTSP_CLIENT_VERBOSITY_LEVEL, RTSP_AGENT_NAME);
+    if(NULL == pCall->m_pChannel) {
+        AS_LOG(AS_LOG_ERROR,"CSipSession::open_call,create the rtsp channel of the call:[%d] fail.",
+                            pCall->m_nCallId);
+        AS_DELETE(pCmd);
+        return;
+    }
+
+    if(pCmd->m_dest.bSet()) {
+        pCall->m_pChannel->SetDestination(pCmd->m_dest);
+    }
+    pCall->m_pChannel->open(pCall->m_nCallId, pCall->m_nTransID,pCall->m_LocalPorts, pCall->m_pSession);
+    AS_DELETE(pCmd);
+}
+
+void CSipSession::play_call(UsageEnvironment& env,void* pArg)
+{
+    CSipCallCmd* pCmd  = (CSipCallCmd*)pArg;
+    CSipCall*    pCall = pCmd->m_pCall;
+
+    if(NULL != pCall->m_pChannel) {
+        if(pCmd->m_dest.bSet()) {
+            pCall->m_pChannel->SetDestination(pCmd->m_dest);
+        }
+        pCall->m_pChannel->play();
+    }
+    AS_DELETE(pCmd);
+}
+
+void CSipSession::close_call(UsageEnvironment& env,void* pArg)
+{
+    CSipCallCmd* pCmd     = (CSipCallCmd*)pArg;
+    CSipCall*    pCall    = pCmd->m_pCall;
+    CSipSession* pSession = pCall->m_pSession;
+
+    /* the last command of the call,the channel reports nothing to the session after it */
+    if(NULL != pCall->m_pChannel) {
+        pCall->m_pChannel->close();
+        pCall->m_pChannel = NULL;
+    }
+    /* the sinks are closed,the ports of the call go back to the pool */
+    finish_call(pCall);
+    AS_DELETE(pCmd);
+    pSession->call_closed();
+}
 void CSipSession::OnOptions(int nCallId)
 {
     // nothing to do
@@ -1365,8 +1772,8 @@ void CSipSession::OnOptions(int nCallId)
 }
 void CSipSession::OnDescribe(int nCallId,int nTransID,std::string& sdp)
 {
-    // save the sdp info
-    m_callRtspSdpMap.insert(TRANSSDPMAP::value_type(nTransID,sdp));
+    // save the sdp info,a second DESCRIBE of the call replaces it
+    m_callRtspSdpMap[nTransID] = sdp;
     return;
 }
 void CSipSession::OnSetUp(int nCallId,int nTransID,CRtpPortPair* local_ports)
@@ -1380,14 +1787,15 @@ void CSipSession::OnSetUp(int nCallId,int nTransID,CRtpPortPair* local_ports)
     }
     ASRtsp2SiptManager::instance().send_invit_200_ok(nTransID, local_ports,strsdp);
 
+    /* called on the env thread of the call,so the channel is safe to touch here */
     as_lock_guard locker(m_mutex);
-    CALLRTSPCHANNELMAP::iterator rtspiter = m_callRtspMap.find(nCallId);
-    if (rtspiter == m_callRtspMap.end())
+    SIPCALLMAP::iterator calliter = m_callMap.find(nCallId);
+    if (calliter == m_callMap.end())
     {
         return;
     }
 
-    ASRtsp2RtpChannel* AsRtspChannel = rtspiter->second;
+    ASRtsp2RtpChannel* AsRtspChannel = calliter->second->m_pChannel;
     if (NULL == AsRtspChannel)
     {
         return;
@@ -1415,20 +1823,20 @@ void CSipSessionTimer::onTrigger(void *pArg, ULONGLONG ullScales, TriggerStyle e
 
 ASRtsp2SiptManager::ASRtsp2SiptManager()
 {
-    m_ulTdIndex        = 0;
     m_LoopWatchVar     = 0;
     m_ulRecvBufSize    = RTSP_SOCKET_RECV_BUFFER_SIZE_DEFAULT;
+    m_ulPacePercent    = 0;
+    m_ulPaceBurst      = 0;
+    m_ulRecvBatch      = 0;
+    m_ulFastStart      = 0;
+    m_ulDescribeCacheTTL = 0;
     m_HttpThreadHandle = NULL;
     m_SipThreadHandle  = NULL;
     m_httpBase         = NULL;
     m_httpServer       = NULL;
     m_httpListenPort   = GW_SERVER_PORT_DEFAULT;
     m_mutex            = NULL;
-    m_ulRtpStartPort   = GW_RTP_PORT_START;
-    m_ulRtpEndPort     = GW_RTP_PORT_END;
-    memset(m_ThreadHandle,0,sizeof(as_thread_t*)*RTSP_MANAGE_ENV_MAX_COUNT);
-    memset(m_envArray,0,sizeof(UsageEnvironment*)*RTSP_MANAGE_ENV_MAX_COUNT);
-    memset(m_clCountArray,0,sizeof(u_int32_t)*RTSP_MANAGE_ENV_MAX_COUNT);
+    m_rtpPortPool.set_conf(GW_RTP_PORT_START, GW_RTP_PORT_END, "", "", false, 0, GW_PORT_PAIR_SIZE);
     m_ulLogLM          = AS_LOG_WARNING;
     m_pEXosipCtx       = NULL;
     m_strLocalIP       = "";
@@ -1496,8 +1904,8 @@ int32_t ASRtsp2SiptManager::init()
         oSipLogLevel = OSIP_FATAL;
     }
 
-    /* init the port pair */
-    if(AS_ERROR_CODE_OK != init_port_pairs()) {
+    /* init the rtp port pool */
+    if(AS_ERROR_CODE_OK != m_rtpPortPool.open()) {
         return AS_ERROR_CODE_FAIL;
     }
 
@@ -1578,10 +1986,6 @@ void    ASRtsp2SiptManager::release()
 
 int32_t ASRtsp2SiptManager::open()
 {
-
-    // Begin by setting up our usage environment:
-    u_int32_t i = 0;
-
     /* run the timer */
     if (AS_ERROR_CODE_OK != as_timer::instance().run()) {
         return AS_ERROR_CODE_FAIL;
@@ -1604,18 +2008,9 @@ int32_t ASRtsp2SiptManager::open()
         this, &m_SipThreadHandle, AS_DEFAULT_STACK_SIZE)) {
         return AS_ERROR_CODE_FAIL;
     }
-    /* start the rtsp client deal thread */
-    for(i = 0;i < RTSP_MANAGE_ENV_MAX_COUNT;i++) {
-        m_envArray[i] = NULL;
-        m_clCountArray[i] = 0;
-    }
-
-    for(i = 0;i < RTSP_MANAGE_ENV_MAX_COUNT;i++) {
-        if( AS_ERROR_CODE_OK != as_create_thread((AS_THREAD_FUNC)rtsp_env_invoke,
-                                                 this,&m_ThreadHandle[i],AS_DEFAULT_STACK_SIZE)) {
-            return AS_ERROR_CODE_FAIL;
-        }
-
+    /* start the rtsp client event loops */
+    if (AS_ERROR_CODE_OK != m_envPool.open()) {
+        return AS_ERROR_CODE_FAIL;
     }
 
     return 0;
@@ -1625,6 +2020,13 @@ void ASRtsp2SiptManager::close()
 {
     as_timer::instance().exit();
     m_LoopWatchVar = 1;
+    /* the cached sdp holds the env,drop it before the env is reclaimed */
+    u_int32_t ulEnvCount = m_envPool.env_count();
+    for(u_int32_t i = 0; i < ulEnvCount; i++) {
+        (void)m_envPool.post(i,clear_describe_cache,NULL);
+    }
+    m_envPool.close();
+    m_rtpPortPool.close();
 
     return;
 }
@@ -1645,23 +2047,44 @@ int32_t ASRtsp2SiptManager::read_system_conf()
         m_ulLogLM = atoi(strValue.c_str());
     }
 
-    /* http listen port */
-    if(INI_SUCCESS == config.GetValue("LISTEN_PORT","ListenPort",strValue))
+    /* rtsp event loop pool */
+    m_envPool.read_conf(config);
+
+    /* rtp pacing */
+    if(INI_SUCCESS == config.GetValue("RTP_PACING","PacePercent",strValue))
     {
-        m_httpListenPort = atoi(strValue.c_str());
+        m_ulPacePercent = atoi(strValue.c_str());
+    }
+    if(INI_SUCCESS == config.GetValue("RTP_PACING","PaceBurst",strValue))
+    {
+        m_ulPaceBurst = atoi(strValue.c_str());
     }
 
-    /* rtp port range */
-    if(INI_SUCCESS == config.GetValue("VIDEO_RTP_PORT_RANGE","PortStart",strValue))
+    /* batched rtp receive */
+    if(INI_SUCCESS == config.GetValue("RTP_RECV","RecvBatch",strValue))
+    {
+        m_ulRecvBatch = atoi(strValue.c_str());
+    }
+
+    /* rtsp handshake */
+    if(INI_SUCCESS == config.GetValue("RTSP_CFG","FastStart",strValue))
+    {
+        m_ulFastStart = atoi(strValue.c_str());
+    }
+    if(INI_SUCCESS == config.GetValue("RTSP_CFG","DescribeCacheTTL",strValue))
     {
-        m_ulRtpStartPort = atoi(strValue.c_str());
+        m_ulDescribeCacheTTL = atoi(strValue.c_str());
     }
 
-    if(INI_SUCCESS == config.GetValue("VIDEO_RTP_PORT_RANGE","PortEnd",strValue))
+    /* http listen port */
+    if(INI_SUCCESS == config.GetValue("LISTEN_PORT","ListenPort",strValue))
     {
-        m_ulRtpEndPort = atoi(strValue.c_str());
+        m_httpListenPort = atoi(strValue.c_str());
     }
 
+    /* rtp port range,local address and shared sockets */
+    m_rtpPortPool.read_conf(config,"VIDEO_RTP_PORT_RANGE");
+
     /* Sip LocalIP */
     if(INI_SUCCESS == config.GetValue("SIP_CFG","LocalIP",strValue))
     {
@@ -1721,6 +2144,11 @@ void  ASRtsp2SiptManager::http_callback(struct evhttp_request *req, void *arg)
     pManage->handle_http_req(req);
 }
 
+void  ASRtsp2SiptManager::clear_describe_cache(UsageEnvironment& env,void* pArg)
+{
+    RTSPClient::invalidateDescribeCache(env);
+}
+
 void *ASRtsp2SiptManager::http_env_invoke(void *arg)
 {
     ASRtsp2SiptManager* manager = (ASRtsp2SiptManager*)(void*)arg;
@@ -1733,12 +2161,6 @@ void *ASRtsp2SiptManager::sip_env_invoke(void *arg)
     manager->sip_env_thread();
     return NULL;
 }
-void *ASRtsp2SiptManager::rtsp_env_invoke(void *arg)
-{
-    ASRtsp2SiptManager* manager = (ASRtsp2SiptManager*)(void*)arg;
-    manager->rtsp_env_thread();
-    return NULL;
-}
 void ASRtsp2SiptManager::http_env_thread()
 {
     AS_LOG(AS_LOG_INFO,"ASRtsp2SiptManager::http_env_thread begin.");
@@ -1812,62 +2234,21 @@ void ASRtsp2SiptManager::sip_env_thread()
     AS_LOG(AS_LOG_INFO,"ASRtsp2SiptManager::sip_env_thread end.");
     return;
 }
-void ASRtsp2SiptManager::rtsp_env_thread()
-{
-    u_int32_t index = thread_index();
-
-    TaskScheduler* scheduler = NULL;
-    UsageEnvironment* env = NULL;
-
-
-    if(RTSP_MANAGE_ENV_MAX_COUNT <= index) {
-        return;
-    }
-    scheduler = BasicTaskScheduler::createNew();
-    env = BasicUsageEnvironment::createNew(*scheduler);
-    m_envArray[index] = env;
-    m_clCountArray[index] = 0;
-
-
-    // All subsequent activity takes place within the event loop:
-    env->taskScheduler().doEventLoop(&m_LoopWatchVar);
-
-    // LOOP EXIST
-    env->reclaim();
-    env = NULL;
-    delete scheduler;
-    scheduler = NULL;
-    m_envArray[index] = NULL;
-    m_clCountArray[index] = 0;
-    return;
-}
-
 u_int32_t ASRtsp2SiptManager::find_beast_thread()
 {
-    as_lock_guard locker(m_mutex);
-    u_int32_t index = 0;
-    u_int32_t count = 0xFFFFFFFF;
-    for(u_int32_t i = 0; i < RTSP_MANAGE_ENV_MAX_COUNT;i++) {
-        if(count > m_clCountArray[i]) {
-            index = i;
-            count = m_clCountArray[i];
-        }
-    }
-    return index;
+    return m_envPool.alloc_env();
 }
 UsageEnvironment* ASRtsp2SiptManager::get_env(u_int32_t index)
 {
-    UsageEnvironment* env = m_envArray[index];
-    m_clCountArray[index]++;
-    return env;
+    return m_envPool.get_env(index);
 }
 void ASRtsp2SiptManager::releas_env(u_int32_t index)
 {
-    if (0 == m_clCountArray[index])
-    {
-        return;
-    }
-    m_clCountArray[index]--;
+    m_envPool.release_env(index);
+}
+int32_t ASRtsp2SiptManager::post_env(u_int32_t index,AS_ENV_CMD_FUNC pFunc,void* pArg,AS_ENV_CMD_FREE pFree)
+{
+    return m_envPool.post(index,pFunc,pArg,pFree);
 }
 
 
@@ -1958,7 +2339,8 @@ void ASRtsp2SiptManager::check_all_sip_session()
             /* delete the session*/
             send_sip_unregsiter(pSession);
             iter = m_SipSessionMap.erase(iter);
-            AS_DELETE(pSession);
+            /* the calls closed by send_sip_unregsiter() free the session with the last of them */
+            pSession->release();
             continue;
         }
         ++iter;
@@ -2547,6 +2929,10 @@ void ASRtsp2SiptManager::send_invit_200_ok(int nTransID,CRtpPortPair*local_ports
     }
 
     eXosip_guess_localip(m_pEXosipCtx,AF_INET, localip, SIP_LOCAL_IP_LENS);
+    /* the media is bound to the address of the port pool */
+    if (0 != strcmp(m_rtpPortPool.local_ip(), "0.0.0.0")) {
+        strncpy(localip, m_rtpPortPool.local_ip(), SIP_LOCAL_IP_LENS - 1);
+    }
 
     snprintf (localsdp, SIP_SDP_LENS_MAX,
     "v=0\r\n"
@@ -2734,8 +3120,8 @@ void ASRtsp2SiptManager::deal_call_close_req(eXosip_event_t *event)
         }
         pSession = iter->second;
 
+        /* the ports are given back when the call is closed on its env */
         pSession->handle_bye(call_id);
-        free_port_pair(call_id);
     }
     else {
         as_lock_guard locker(m_mutex);
@@ -2749,7 +3135,6 @@ void ASRtsp2SiptManager::deal_call_close_req(eXosip_event_t *event)
             if (AS_ERROR_CODE_OK != pSession->handle_bye(call_id)) {
                 continue;
             }
-            free_port_pair(call_id);
             break;
         }
     }
@@ -2787,7 +3172,6 @@ void ASRtsp2SiptManager::deal_call_cancelled_req(eXosip_event_t *event)
         dialog_id = event->did;
 
         pSession->handle_bye(call_id);
-        free_port_pair(call_id);
     }
 
 
@@ -2824,53 +3208,34 @@ void ASRtsp2SiptManager::deal_message_req(eXosip_event_t *event)
     AS_LOG (AS_LOG_INFO, "%s answer with 200", event->request->sip_method);
     AS_LOG (AS_LOG_INFO, "CSipManager::deal_message_req,deal MESSAGE end");
 }
-int32_t       ASRtsp2SiptManager::init_port_pairs()
+CRtpPortPair* ASRtsp2SiptManager::get_free_port_pair(int nCallId)
 {
-    unsigned short usCount = m_ulRtpEndPort - m_ulRtpStartPort + 1;
-    unsigned short usPairCount = usCount / GW_PORT_PAIR_SIZE;
-    unsigned short usPort = m_ulRtpEndPort;
-    unsigned short usVRtpPort  = 0;
-    unsigned short usVRtcpPort = 0;
-    unsigned short usARtpPort  = 0;
-    unsigned short usARtcpPort = 0;
-
-    CRtpPortPair* pair = NULL;
-
-    for(unsigned short i = 0;i < usPairCount;i++)
+    as_lock_guard locker(m_mutex);
+    if(m_callPortMap.end() != m_callPortMap.find(nCallId))
     {
-        usVRtpPort = usPort++;
-        usVRtcpPort = usPort++;
-        usARtpPort = usPort++;
-        usARtcpPort = usPort++;
-
-        pair = AS_NEW(pair);
-        if(NULL == pair)
-        {
-            return AS_ERROR_CODE_FAIL;
-        }
-        pair->init(usVRtpPort, usVRtcpPort, usARtpPort, usARtcpPort);
-        m_freePortList.push_back(pair);
+        return NULL;
     }
 
-    m_callPortMap.clear();
-    return AS_ERROR_CODE_OK;
-}
-
-CRtpPortPair* ASRtsp2SiptManager::get_free_port_pair(int nCallId)
-{
+    AS_RTP_PORTS ports;
+    if(AS_ERROR_CODE_OK != m_rtpPortPool.alloc(ports))
+    {
+        return NULL;
+    }
     CRtpPortPair* pair = NULL;
-    if(0 == m_freePortList.size())
+    pair = AS_NEW(pair);
+    if(NULL == pair)
     {
+        m_rtpPortPool.free(ports);
         return NULL;
     }
-    pair = m_freePortList.front();
-    m_freePortList.pop_front();
+    pair->init(ports);
 
     m_callPortMap.insert(CALLPORTPAIREMAP::value_type(nCallId,pair));
     return pair;
 }
 void          ASRtsp2SiptManager::free_port_pair(int nCallId)
 {
+    as_lock_guard locker(m_mutex);
     CRtpPortPair* pair = NULL;
     CALLPORTPAIREMAP::iterator iter = m_callPortMap.find(nCallId);
     if(iter == m_callPortMap.end())
@@ -2879,9 +3244,25 @@ void          ASRtsp2SiptManager::free_port_pair(int nCallId)
     }
     pair = iter->second;
     m_callPortMap.erase(iter);
-    m_freePortList.push_back(pair);
+    m_rtpPortPool.free(pair->ports());
+    AS_DELETE(pair);
     return;
 }
+int32_t ASRtsp2SiptManager::bind_rtp_ssrc(RtpSession* pSession,AS_RTP_DEMUX_FUNC pFunc,void* pCtx)
+{
+    uint32_t ulSsrc = rtp_session_get_send_ssrc(pSession);
+    if(AS_ERROR_CODE_OK != m_rtpPortPool.bind_ssrc(ulSsrc,pFunc,pCtx)) {
+        return AS_ERROR_CODE_FAIL;
+    }
+    if(ulSsrc != rtp_session_get_send_ssrc(pSession)) {
+        rtp_session_set_ssrc(pSession,ulSsrc);
+    }
+    return AS_ERROR_CODE_OK;
+}
+void ASRtsp2SiptManager::unbind_rtp_ssrc(uint32_t ulSsrc)
+{
+    m_rtpPortPool.unbind_ssrc(ulSsrc);
+}
 void ASRtsp2SiptManager::setRecvBufSize(u_int32_t ulSize)
 {
     m_ulRecvBufSize = ulSize;
@@ -88,7 +88,7 @@ extern "C"{
 
 #define MAX_RTP_PKT_LENGTH        1400
 
-#define H264_RTP_TIMESTAMP_FREQUE 3600
+#define VIDEO_RTP_TIMESTAMP_FREQUE 90000
 #define G711_RTP_TIMESTAMP_FREQUE 400
 
 
@@ -116,38 +116,60 @@ extern "C"{
 // If you don't want to see debugging output for each received frame, then comment out the following line:
 #define DEBUG_PRINT_EACH_RECEIVED_FRAME 1
 
-#define RTSP_MANAGE_ENV_MAX_COUNT       4
-
 #define RTSP_AGENT_NAME                 "all stream media"
 
+/* the local ports of a call,taken from the rtp port pool */
 class CRtpPortPair
 {
 public:
     CRtpPortPair(){};
     virtual ~CRtpPortPair(){};
-    void init(unsigned short usVRtpPort,unsigned short usVRtcpPort,
-              unsigned short usARtpPort,unsigned short usARtcpPort)
+    void init(const AS_RTP_PORTS& ports)
               {
-                m_usVideoRtpPort = usVRtpPort;
-                m_usVideoRtcpPort = usVRtcpPort;
-                m_usAudioRtpPort = usARtpPort;
-                m_usAudioRtcpPort = usARtcpPort;
+                m_ports = ports;
+                m_usVideoRtpPort  = ports.usBase;
+                m_usVideoRtcpPort = ports.usBase + 1;
+                m_usAudioRtpPort  = ports.usBase + 2;
+                m_usAudioRtcpPort = ports.usBase + 3;
               };
 
     unsigned short getVRtpPort(){ return m_usVideoRtpPort; };
     unsigned short getVRtcpPort(){ return m_usVideoRtcpPort; };
     unsigned short getARtpPort(){ return m_usAudioRtpPort; };
     unsigned short getARtcpPort(){ return m_usAudioRtcpPort; };
+    /* the shared mode,the call sends on the sockets of its group */
+    bool shared(){ return 0 <= m_ports.lGroup; };
+    int  getVRtpSock(){ return (int)m_ports.aSocks[0]; };
+    int  getVRtcpSock(){ return (int)m_ports.aSocks[1]; };
+    int  getARtpSock(){ return (int)m_ports.aSocks[2]; };
+    int  getARtcpSock(){ return (int)m_ports.aSocks[3]; };
+    const AS_RTP_PORTS& ports(){ return m_ports; };
 private:
+    AS_RTP_PORTS   m_ports;
     unsigned short m_usVideoRtpPort;
     unsigned short m_usVideoRtcpPort;
     unsigned short m_usAudioRtpPort;
     unsigned short m_usAudioRtcpPort;
 };
 
-typedef std::list<CRtpPortPair*> RTPPORTPAIRLIST;
 typedef std::map<int, CRtpPortPair*> CALLPORTPAIREMAP;
 
+/*
+ * the RTCP reports the peer sends back for one of our streams,in the shared
+ * mode they are handed over by ssrc from the demux thread of the port pool.
+ */
+class CRtpPeerReport
+{
+public:
+    CRtpPeerReport();
+    virtual ~CRtpPeerReport(){};
+    static void on_packet(void* pCtx, uint32_t ulPort, const uint8_t* pData, uint32_t ulLen);
+public:
+    volatile u_int32_t m_ulPackets;
+    volatile u_int32_t m_ulFractionLost;   /* of 256,from the last report */
+    volatile u_int32_t m_ulCumulativeLost;
+};
+
 class CRtpDestinations
 {
 public:
@@ -255,6 +277,12 @@ public:
     RTPSink*  createNewRTPSink(MediaSubsession& subsession,Groupsock* rtpGroupsock);
     // Used to iterate through each stream's 'subsessions', setting up each one:
      void setupNextSubsession();
+    // Used to send the "SETUP"s of all the 'subsessions' at once:
+    void setupAllSubsessions();
+    Boolean initSubsession(MediaSubsession* subsession);
+    void    setupDone();
+    // Used to "DESCRIBE" again when the server refuses a cached SDP description:
+    Boolean redescribe(int resultCode);
     // Used to shut down and close a stream (including its "RTSPClient" object):
     void shutdownStream(int exitCode = 1);
 public:
@@ -283,6 +311,9 @@ private:
     CRtpPortPair*         m_LocalPorts;
     CRtpDestinations      m_DestinInfo;
     AS_RTSP_STATUS        m_enStatus;
+    Boolean               m_bFastStart;
+    Boolean               m_bRedescribed;
+    u_int32_t             m_ulSetupPending;
 };
 
 // Define a data sink (a subclass of "MediaSink") to receive the data for each subsession (i.e., each audio or video 'substream').
@@ -307,6 +338,12 @@ private:
                                 unsigned durationInMicroseconds);
   void afterGettingFrame(unsigned frameSize, unsigned numTruncatedBytes,
              struct timeval presentationTime, unsigned durationInMicroseconds);
+  /* send the queued packets of a paced frame,the next frame is read when they are out */
+  static void paceTask(void* clientData);
+  void pace();
+  /* without the packetizer,send the NAL one packet a call through the rtp session */
+  void sendBySession(unsigned frameSize, u_int32_t ulTimestamp, bool bEndOfFrame);
+  void sendPacket(u_int8_t* pData, u_int32_t ulLen, u_int32_t ulTimestamp, bool bMarker);
 
 private:
   // redefined virtual functions:
@@ -317,8 +354,15 @@ private:
   u_int32_t        prefixSize;
   MediaSubsession& fSubsession;
   RtpSession*      m_pVideoSession;
-  u_int32_t        m_rtpTimestampdiff;
-  u_int32_t        m_lastTS;
+  as_rtp_packetizer m_Packetizer;
+  bool             m_bPacketizer;
+  AS_RTP_VIDEO_CODEC m_enCodec;
+  TaskToken        m_paceTask;
+  bool             m_bShared;
+  bool             m_bSsrcBound;
+  CRtpPeerReport   m_peerReport;
+  u_int32_t        m_ulTimestampFreq;
+  u_int32_t        m_ulTimestampBase;
 };
 
 class ASRtsp2SipAudioSink: public MediaSink {
@@ -348,6 +392,9 @@ private:
   RtpSession*      m_pAudioSession;
   u_int32_t        m_rtpTimestampdiff;
   u_int32_t        m_lastTS;
+  bool             m_bShared;
+  bool             m_bSsrcBound;
+  CRtpPeerReport   m_peerReport;
 };
 
 enum SIP_SESSION_STATUS
@@ -388,7 +435,48 @@ private:
 
 
 
-typedef std::map<int,ASRtsp2RtpChannel*>  CALLRTSPCHANNELMAP;
+class CSipSession;
+
+/*
+ * a sip call and its rtsp channel,the channel is created,played and closed
+ * by the commands posted to the env m_ulEnvIndex,so it is only touched by
+ * that env's thread.
+ */
+class CSipCall
+{
+public:
+    CSipCall()
+    {
+        m_pSession   = NULL;
+        m_nCallId    = 0;
+        m_nTransID   = 0;
+        m_ulEnvIndex = 0;
+        m_LocalPorts = NULL;
+        m_pChannel   = NULL;
+    };
+    virtual ~CSipCall(){};
+public:
+    CSipSession       *m_pSession;
+    int                m_nCallId;
+    int                m_nTransID;
+    u_int32_t          m_ulEnvIndex;
+    CRtpPortPair      *m_LocalPorts;
+    std::string        m_strRtspUrl;
+    ASRtsp2RtpChannel *m_pChannel;
+};
+
+/* a command posted to the env of a call,it carries its own copy of the destination */
+class CSipCallCmd
+{
+public:
+    CSipCallCmd(){m_pCall = NULL;};
+    virtual ~CSipCallCmd(){};
+public:
+    CSipCall          *m_pCall;
+    CRtpDestinations   m_dest;
+};
+
+typedef std::map<int,CSipCall*>           SIPCALLMAP;
 typedef std::map<int,std::string>         TRANSSDPMAP;
 
 class CSipSession:public IRtspChannelObserver
@@ -417,12 +505,32 @@ public:
     int32_t handle_bye(int nCallId);
     void    handle_ack(int nCallId,sdp_message_t    *remote_sdp = NULL);
     void    close_all();
+    /*
+     * free the session instead of deleting it,the closes posted by close_all()
+     * still run on the env threads and reach the session through their calls,
+     * so the session goes with the close of its last call.
+     */
+    void    release();
 public:
     virtual void OnOptions(int nCallId);
     virtual void OnDescribe(int nCallId,int nTransID,std::string& sdp);
     virtual void OnSetUp(int nCallId,int nTransID,CRtpPortPair* local_ports);
     virtual void OnPlay(int nCallId);
     virtual void OnTearDown(int nCallId);
+private:
+    static void get_destination(sdp_message_t *remote_sdp,CRtpDestinations& dest);
+    int32_t     post_call_cmd(CSipCall* pCall,AS_ENV_CMD_FUNC pFunc,sdp_message_t *remote_sdp);
+    /* the commands run on the env thread of the call */
+    static void open_call(UsageEnvironment& env,void* pArg);
+    static void play_call(UsageEnvironment& env,void* pArg);
+    static void close_call(UsageEnvironment& env,void* pArg);
+    static void free_call_cmd(void* pArg);
+    /* a close dropped by the env pool,run it without the env */
+    static void free_close_cmd(void* pArg);
+    /* the part of the close which needs no env,for a call whose env is gone */
+    static void finish_call(CSipCall* pCall);
+    /* a call of the session is gone,free the released session with its last call */
+    void        call_closed();
 private:
     as_mutex_t         *m_mutex;
     SIP_SESSION_STATUS  m_enStatus;
@@ -437,8 +545,11 @@ private:
     std::string         m_strStreamType;
     u_int32_t           m_ulRepInterval;
     std::string         m_strReportUrl;
-    CALLRTSPCHANNELMAP  m_callRtspMap;
+    SIPCALLMAP          m_callMap;
     TRANSSDPMAP         m_callRtspSdpMap;
+    /* the calls not closed yet,including the ones out of m_callMap whose close is queued */
+    u_int32_t           m_ulCallCount;
+    bool                m_bReleased;
 };
 
 class CSipSessionTimer:public ITrigger
@@ -470,6 +581,18 @@ public:
     void    close();;
     void      setRecvBufSize(u_int32_t ulSize);
     u_int32_t getRecvBufSize();
+    u_int32_t getPacePercent(){return m_ulPacePercent;};
+    u_int32_t getPaceBurst(){return m_ulPaceBurst;};
+    u_int32_t getRecvBatch(){return m_ulRecvBatch;};
+    u_int32_t getFastStart(){return m_ulFastStart;};
+    u_int32_t getDescribeCacheTTL(){return m_ulDescribeCacheTTL;};
+    const char* getRtpLocalIP(){return m_rtpPortPool.local_ip();};
+    bool      getRtpReusePort(){return m_rtpPortPool.reuse_port();};
+    /* the ssrc of the session is changed if it collides with one bound already */
+    int32_t   bind_rtp_ssrc(RtpSession* pSession,AS_RTP_DEMUX_FUNC pFunc,void* pCtx);
+    void      unbind_rtp_ssrc(uint32_t ulSsrc);
+    CRtpPortPair* get_free_port_pair(int nCallId);
+    void          free_port_pair(int nCallId);
     std::string getAppID(){return m_strAppID;};
     std::string getAppSecret(){return m_strAppSecret;};
     std::string getAppKey(){return m_strAppKey;};
@@ -477,10 +600,10 @@ public:
 public:
     void http_env_thread();
     void sip_env_thread();
-    void rtsp_env_thread();
     u_int32_t find_beast_thread();
     UsageEnvironment* get_env(u_int32_t index);
     void releas_env(u_int32_t index);
+    int32_t post_env(u_int32_t index,AS_ENV_CMD_FUNC pFunc,void* pArg,AS_ENV_CMD_FREE pFree = NULL);
 public:
     void handle_http_req(struct evhttp_request *req);
     void check_all_sip_session();
@@ -492,17 +615,10 @@ protected:
 private:
     int32_t      read_system_conf();
     static void  http_callback(struct evhttp_request *req, void *arg);
+    static void  clear_describe_cache(UsageEnvironment& env,void* pArg);
 private:
     static void *http_env_invoke(void *arg);
     static void *sip_env_invoke(void *arg);
-    static void *rtsp_env_invoke(void *arg);
-    u_int32_t thread_index()
-    {
-        as_lock_guard locker(m_mutex);
-        u_int32_t index = m_ulTdIndex;
-        m_ulTdIndex++;
-        return index;
-    }
 
 private:
     int32_t handle_session(std::string &strReqMsg,std::string &strRespMsg);
@@ -521,11 +637,6 @@ private:
     void deal_call_cancelled_req(eXosip_event_t *event);
     void deal_message_req(eXosip_event_t *event);
 private:
-    int32_t       init_port_pairs();
-    CRtpPortPair* get_free_port_pair(int nCallId);
-    void          free_port_pair(int nCallId);
-private:
-    u_int32_t         m_ulTdIndex;
     as_mutex_t       *m_mutex;
     char              m_LoopWatchVar;
     struct event_base*m_httpBase;
@@ -533,15 +644,16 @@ private:
     as_thread_t      *m_HttpThreadHandle;
     u_int32_t         m_httpListenPort;
     as_thread_t      *m_SipThreadHandle;
-    u_int32_t         m_ulRtpStartPort;
-    u_int32_t         m_ulRtpEndPort;
-    RTPPORTPAIRLIST   m_freePortList;
+    as_rtp_port_pool  m_rtpPortPool;
     CALLPORTPAIREMAP  m_callPortMap;
-    as_thread_t      *m_ThreadHandle[RTSP_MANAGE_ENV_MAX_COUNT];
-    UsageEnvironment *m_envArray[RTSP_MANAGE_ENV_MAX_COUNT];
-    u_int32_t         m_clCountArray[RTSP_MANAGE_ENV_MAX_COUNT];
+    as_env_pool       m_envPool;
     u_int32_t         m_ulRecvBufSize;
     u_int32_t         m_ulLogLM;
+    u_int32_t         m_ulPacePercent;
+    u_int32_t         m_ulPaceBurst;
+    u_int32_t         m_ulRecvBatch;
+    u_int32_t         m_ulFastStart;
+    u_int32_t         m_ulDescribeCacheTTL;
 private:
     SIPSESSIONMAP     m_SipSessionMap;
     REGSESSIONMAP     m_RegSessionMap;
@@ -4,7 +4,6 @@
 #include "Base64.hh"
 #include "GroupsockHelper.hh"
 #include "BasicUsageEnvironment.hh"
-#include "EpollTaskScheduler.hh"
 #include "GroupsockHelper.hh"
 #include "as_rtsp_guard.h"
 #include "RTSPCommon.hh"
@@ -49,23 +48,49 @@ ASRtspCheckChannel::ASRtspCheckChannel(u_int32_t ulEnvIndex,UsageEnvironment& en
   m_bObervser      = NULL;
   m_bStop          = False;
   m_ulStartTime    = time(NULL);
+  m_ulEndTime      = m_ulStartTime;
+  gettimeofday(&m_stStartTime, NULL);
   m_enCheckResult  = AS_RTSP_CHECK_RESULT_SUCCESS;
+  m_enProbeMode    = AS_RTSP_PROBE_FULL;
+  m_pProbeSubsession = NULL;
+  m_bFastStart     = False;
+  m_bRedescribed   = False;
 }
 
 ASRtspCheckChannel::~ASRtspCheckChannel() {
     AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::~ASRtspCheckChannel.");
 }
 
-int32_t ASRtspCheckChannel::open(ASRtspStatusObervser* observer)
+int32_t ASRtspCheckChannel::open(ASRtspStatusObervser* observer,AS_RTSP_PROBE_MODE enProbeMode)
 {
-    AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::open,begin.");
+    AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::open,begin,probe mode:[%d].",enProbeMode);
     m_bObervser = observer;
+    m_enProbeMode = enProbeMode;
     m_ulStartTime= time(NULL);
-    if(0 == sendOptionsCommand(&ASRtspCheckChannel::continueAfterOPTIONS)) {
+    m_ulEndTime  = m_ulStartTime + ASRtspGuardManager::instance().getCheckDuration();
+    gettimeofday(&m_stStartTime, NULL);
+    m_bFastStart = (0 != ASRtspGuardManager::instance().getFastStart());
+    if(m_bFastStart) {
+        /* the OPTIONS only tells if GET_PARAMETER is supported,send the keep-alive anyway */
+        setRequestPipelining(True);
+        SupportsGetParameter(True);
+        if (AS_RTSP_PROBE_DESCRIBE != m_enProbeMode) {
+            /* a DESCRIBE probe asks the server each time,that is the check */
+            setDescribeCacheTTL(ASRtspGuardManager::instance().getDescribeCacheTTL());
+        }
+        if(0 == sendDescribeCommand(&ASRtspCheckChannel::continueAfterDESCRIBE)) {
+            AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::open,send describe fail.");
+            return AS_ERROR_CODE_FAIL;
+        }
+    }
+    else if(0 == sendOptionsCommand(&ASRtspCheckChannel::continueAfterOPTIONS)) {
         AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::open,send options fail.");
         return AS_ERROR_CODE_FAIL;
     }
 
+    /* the timer ends the check,even if the server never answers */
+    scheduleTimer();
+
     AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::open,end.");
     return AS_ERROR_CODE_OK;
 }
@@ -82,11 +107,6 @@ void    ASRtspCheckChannel::handle_after_options(int resultCode, char* resultStr
     AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::handle_after_options begin.");
 
     do {
-
-        unsigned uSecsToDelay = (unsigned)(GW_TIMER_CHECK_TASK*1000);
-        scs.streamTimerTask = envir().taskScheduler().scheduleDelayedTask(uSecsToDelay, (TaskFunc*)streamTimerHandler, this);
-
-
         Boolean serverSupportsGetParameter = RTSPOptionIsSupported("GET_PARAMETER", resultString);
         delete[] resultString;
         SupportsGetParameter(serverSupportsGetParameter);
@@ -96,7 +116,7 @@ void    ASRtspCheckChannel::handle_after_options(int resultCode, char* resultStr
     } while (0);
 
     // An unrecoverable error occurred with this stream.
-    m_enStatus = AS_RTSP_STATUS_TEARDOWN;
+    scheduleShutdown();
     AS_LOG(AS_LOG_WARNING,"ASRtspCheckChannel::handle_after_options exit.");
     return;
 }
@@ -112,30 +132,64 @@ void    ASRtspCheckChannel::handle_after_describe(int resultCode, char* resultSt
             break;
         }
 
-        // Create a media session object from this SDP description:
-        scs.session = MediaSession::createNew(envir(), resultString);
+        // Create a media session object from this SDP description,a probe reads it by its own source:
+        if ((AS_RTSP_PROBE_KEYFRAME == m_enProbeMode) || (AS_RTSP_PROBE_SAMPLE == m_enProbeMode)) {
+            scs.session = ASRtspProbeSession::createNew(envir(), resultString);
+        }
+        else {
+            scs.session = MediaSession::createNew(envir(), resultString);
+        }
         delete[] resultString; // because we don't need it anymore
         if (scs.session == NULL) {
             AS_LOG(AS_LOG_WARNING,"ASRtspCheckChannel::handle_after_describe,"
                                   "create the session fail.");
+            m_enCheckResult  = AS_RTSP_CHECK_RESULT_OPEN_URL;
             break;
         } else if (!scs.session->hasSubsessions()) {
             AS_LOG(AS_LOG_WARNING,"ASRtspCheckChannel::handle_after_describe,"
                                   "this is no sub session.");
+            m_enCheckResult  = AS_RTSP_CHECK_RESULT_OPEN_URL;
             break;
         }
 
+        if (AS_RTSP_PROBE_DESCRIBE == m_enProbeMode) {
+            /* the server knows the stream,nothing is set up */
+            AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::handle_after_describe,the describe probe is done.");
+            scheduleShutdown();
+            return;
+        }
+
+        if (AS_RTSP_PROBE_FULL != m_enProbeMode) {
+            /* a probe sets up the video only,or the first stream of a lens without video */
+            MediaSubsessionIterator iter(*scs.session);
+            MediaSubsession* subsession;
+            while ((subsession = iter.next()) != NULL) {
+                if (!strcmp(subsession->mediumName(), "video")) {
+                    m_pProbeSubsession = subsession;
+                    break;
+                }
+                if (NULL == m_pProbeSubsession) {
+                    m_pProbeSubsession = subsession;
+                }
+            }
+        }
+
         // Then, create and set up our data source objects for the session.  We do this by iterating over the session's 'subsessions',
         // calling "MediaSubsession::initiate()", and then sending a RTSP "SETUP" command, on each one.
         // (Each 'subsession' will have its own data source.)
         scs.iter = new MediaSubsessionIterator(*scs.session);
-        setupNextSubsession();
+        if (m_bFastStart) {
+            setupAllSubsessions();
+        }
+        else {
+            setupNextSubsession();
+        }
         AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::handle_after_describe end.");
         return;
     } while (0);
 
     // An unrecoverable error occurred with this stream.
-    m_enStatus = AS_RTSP_STATUS_TEARDOWN;
+    scheduleShutdown();
     AS_LOG(AS_LOG_WARNING,"ASRtspCheckChannel::handle_after_describe exit.");
     return;
 }
@@ -152,17 +206,40 @@ void    ASRtspCheckChannel::handle_after_setup(int resultCode, char* resultStrin
 {
     AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::handle_after_setup begin.");
     if(0 != resultCode) {
+        delete[] resultString;
+        if (redescribe(resultCode)) {
+            return;
+        }
         m_enCheckResult  = AS_RTSP_CHECK_RESULT_OPEN_URL;
-        m_enStatus = AS_RTSP_STATUS_TEARDOWN;
+        scheduleShutdown();
         return;
     }
+    if (m_bFastStart) {
+        /* the answers come in the order of the SETUPs */
+        scs.subsession = nextSetupSubsession();
+    }
 
-    if(scs.session != NULL) {
+    if((AS_RTSP_PROBE_FULL != m_enProbeMode) && (NULL != scs.subsession)) {
+        /* no sink,the probe source reads the packets itself */
+        ASRtspProbeSource* pSource = (ASRtspProbeSource*)scs.subsession->rtpSource();
+        if (NULL != pSource) {
+            AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::handle_after_setup,start the probe.");
+            pSource->startProbe(probeKeyFrameHandler, this);
+            if (scs.subsession->rtcpInstance() != NULL) {
+                scs.subsession->rtcpInstance()->setByeHandler(probeByeHandler, this);
+            }
+        }
+    }
+    else if(scs.session != NULL) {
         /* open the send rtp sik */
         MediaSubsessionIterator iter(*scs.session);
         MediaSubsession* subsession;
 
         while ((subsession = iter.next()) != NULL) {
+           /* a sink per subsession,the ones not set up (yet) have no source */
+           if ((subsession->sink != NULL) || (subsession->readSource() == NULL)) {
+               continue;
+           }
            if (!strcmp(subsession->mediumName(), "video")) {
                 AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::handle_after_setup,create a video sink.");
                 subsession->sink = ASRtspCheckVideoSink::createNew(envir(), *subsession);
@@ -197,7 +274,9 @@ void    ASRtspCheckChannel::handle_after_setup(int resultCode, char* resultStrin
         delete[] resultString;
     }
     // Set up the next subsession, if any:
-    setupNextSubsession();
+    if (!m_bFastStart) {
+        setupNextSubsession();
+    }
     AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::handle_after_setup end.");
     return;
 }
@@ -209,6 +288,10 @@ void    ASRtspCheckChannel::handle_after_play(int resultCode, char* resultString
     do {
 
         if (resultCode != 0) {
+            if (redescribe(resultCode)) {
+                delete[] resultString;
+                return;
+            }
             m_enCheckResult  = AS_RTSP_CHECK_RESULT_OPEN_URL;
             break;
         }
@@ -226,6 +309,15 @@ void    ASRtspCheckChannel::handle_after_play(int resultCode, char* resultString
         //}
 
         success = True;
+        if (AS_RTSP_PROBE_SAMPLE == m_enProbeMode) {
+            /* the sample is taken from now on */
+            time_t sampleEnd = time(NULL) + ASRtspGuardManager::instance().getProbeSampleTime();
+            if (sampleEnd < m_ulEndTime) {
+                m_ulEndTime = sampleEnd;
+                envir().taskScheduler().unscheduleDelayedTask(scs.streamTimerTask);
+                scheduleTimer();
+            }
+        }
         if(SupportsGetParameter()) {
             sendGetParameterCommand(*scs.session,continueAfterGET_PARAMETE, "", NULL);
         }
@@ -237,7 +329,7 @@ void    ASRtspCheckChannel::handle_after_play(int resultCode, char* resultString
     if (!success) {
         // An unrecoverable error occurred with this stream.
         AS_LOG(AS_LOG_WARNING,"ASRtspCheckChannel::handle_after_play,play not success.");
-        m_enStatus = AS_RTSP_STATUS_TEARDOWN;
+        scheduleShutdown();
     }
     else {
         m_enStatus = AS_RTSP_STATUS_PLAY;
@@ -271,7 +363,7 @@ void    ASRtspCheckChannel::handle_subsession_after_playing(MediaSubsession* sub
 
     // All subsessions' streams have now been closed, so shutdown the client:
     m_enCheckResult  = AS_RTSP_CHECK_RESULT_OPEN_URL;
-    m_enStatus = AS_RTSP_STATUS_TEARDOWN;
+    scheduleShutdown();
     AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::handle_subsession_after_playing exit.");
 }
 
@@ -281,13 +373,7 @@ void    ASRtspCheckChannel::handle_after_timeout()
     AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::streamTimerHandler.");
     scs.streamTimerTask = NULL;
 
-    // Shut down the stream:
-    if(m_bStop) {
-        shutdownStream();
-        return;
-    }
-
-    if( AS_RTSP_STATUS_PLAY == m_enStatus ) {
+    if( !m_bStop && (AS_RTSP_STATUS_PLAY == m_enStatus) ) {
         // Check the Stream recv Status
         if (scs.session != NULL) {
             MediaSubsessionIterator iter(*scs.session);
@@ -311,12 +397,42 @@ void    ASRtspCheckChannel::handle_after_timeout()
         }
     }
 
+    // Shut down the stream when it is closed,failed or checked long enough,
+    // the result goes to the observer at once:
+    if(m_bStop || (AS_RTSP_STATUS_TEARDOWN == m_enStatus)
+        || (time(NULL) >= m_ulEndTime)) {
+        if((AS_RTSP_CHECK_RESULT_SUCCESS == m_enCheckResult)
+            && ((AS_RTSP_STATUS_INIT == m_enStatus) || (AS_RTSP_STATUS_SETUP == m_enStatus))) {
+            /* the server never got to play */
+            m_enCheckResult = AS_RTSP_CHECK_RESULT_OPEN_URL;
+        }
+        if((AS_RTSP_CHECK_RESULT_SUCCESS == m_enCheckResult) && (NULL != m_pProbeSubsession)) {
+            /* the probe played to its end,a key frame or a BYE without the media it waits for */
+            ASRtspProbeSource* pSource = (ASRtspProbeSource*)m_pProbeSubsession->rtpSource();
+            if((NULL == pSource) || (0 == pSource->getPackets())
+                || ((AS_RTSP_PROBE_KEYFRAME == m_enProbeMode) && !pSource->hasKeyFrame())) {
+                AS_LOG(AS_LOG_WARNING,"ASRtspCheckChannel::streamTimerHandler,the probe got no video.");
+                m_enCheckResult = AS_RTSP_CHECK_RESULT_RECV_DATA;
+            }
+        }
+        shutdownStream();
+        return;
+    }
+
+    scheduleTimer();
+    return;
+}
 
-    unsigned uSecsToDelay = (unsigned)(GW_TIMER_CHECK_TASK*1000);
+void ASRtspCheckChannel::scheduleTimer() {
+    /* fire at the end of the check rather than on the next period */
+    time_t   left     = m_ulEndTime - time(NULL);
+    unsigned uMSecs   = GW_TIMER_CHECK_TASK;
+    if((0 <= left) && ((time_t)(uMSecs/1000) > left)) {
+        uMSecs = (unsigned)(left*1000);
+    }
     scs.streamTimerTask
-       = envir().taskScheduler().scheduleDelayedTask(uSecsToDelay,
+       = envir().taskScheduler().scheduleDelayedTask(uMSecs*1000,
                                                  (TaskFunc*)streamTimerHandler, this);
-    return;
 }
 
 
@@ -325,29 +441,9 @@ void ASRtspCheckChannel::setupNextSubsession() {
     AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::setupNextSubsession begin.");
     scs.subsession = scs.iter->next();
     if (scs.subsession != NULL) {
-        if (!scs.subsession->initiate()) {
+        if (!initSubsession(scs.subsession)) {
             setupNextSubsession(); // give up on this subsession; go to the next one
         } else {
-
-            if (scs.subsession->rtpSource() != NULL) {
-            // Because we're saving the incoming data, rather than playing
-            // it in real time, allow an especially large time threshold
-            // (1 second) for reordering misordered incoming packets:
-            unsigned const thresh = 1000000; // 1 second
-            scs.subsession->rtpSource()->setPacketReorderingThresholdTime(thresh);
-
-            // Set the RTP source's OS socket buffer size as appropriate - either if we were explicitly asked (using -B),
-            // or if the desired FileSink buffer size happens to be larger than the current OS socket buffer size.
-            // (The latter case is a heuristic, on the assumption that if the user asked for a large FileSink buffer size,
-            // then the input data rate may be large enough to justify increasing the OS socket buffer size also.)
-            int socketNum = scs.subsession->rtpSource()->RTPgs()->socketNum();
-            unsigned curBufferSize = getReceiveBufferSize(envir(), socketNum);
-            unsigned ulRecvBufSize = ASRtspGuardManager::instance().getRecvBufSize();
-            if (ulRecvBufSize > curBufferSize) {
-                (void)setReceiveBufferTo(envir(), socketNum, ulRecvBufSize);
-              }
-            }
-
             // Continue setting up this subsession, by sending a RTSP "SETUP" command:
             sendSetupCommand(*scs.subsession, continueAfterSETUP, False, REQUEST_STREAMING_OVER_TCP);
         }
@@ -355,29 +451,131 @@ void ASRtspCheckChannel::setupNextSubsession() {
         return;
     }
 
+    sendPlay();
+    AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::setupNextSubsession exit.");
+    return;
+}
+
+void ASRtspCheckChannel::setupAllSubsessions() {
+    AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::setupAllSubsessions begin.");
+    /* the client holds the SETUPs after the first one and the PLAY until the session is known */
+    MediaSubsession* subsession;
+    while ((subsession = scs.iter->next()) != NULL) {
+        if (initSubsession(subsession)) {
+            sendSetupCommand(*subsession, continueAfterSETUP, False, REQUEST_STREAMING_OVER_TCP);
+        }
+    }
+    scs.iter->reset();
+    scs.subsession = NULL;
+    sendPlay();
+    AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::setupAllSubsessions end.");
+}
+
+MediaSubsession* ASRtspCheckChannel::nextSetupSubsession() {
+    /* the subsessions not initiated got no SETUP */
+    MediaSubsession* subsession;
+    while ((subsession = scs.iter->next()) != NULL) {
+        if (subsession->readSource() != NULL) {
+            break;
+        }
+    }
+    return subsession;
+}
+
+Boolean ASRtspCheckChannel::initSubsession(MediaSubsession* subsession) {
+    if ((NULL != m_pProbeSubsession) && (subsession != m_pProbeSubsession)) {
+        return False; // a probe does not set up this one
+    }
+    if (!subsession->initiate()) {
+        return False;
+    }
+
+    if (subsession->rtpSource() != NULL) {
+        // Because we're saving the incoming data, rather than playing
+        // it in real time, allow an especially large time threshold
+        // (1 second) for reordering misordered incoming packets:
+        unsigned const thresh = 1000000; // 1 second
+        subsession->rtpSource()->setPacketReorderingThresholdTime(thresh);
+
+        // Set the RTP source's OS socket buffer size as appropriate - either if we were explicitly asked (using -B),
+        // or if the desired FileSink buffer size happens to be larger than the current OS socket buffer size.
+        // (The latter case is a heuristic, on the assumption that if the user asked for a large FileSink buffer size,
+        // then the input data rate may be large enough to justify increasing the OS socket buffer size also.)
+        // A probe keeps the default,it drops the payload anyway.
+        int socketNum = subsession->rtpSource()->RTPgs()->socketNum();
+        unsigned curBufferSize = getReceiveBufferSize(envir(), socketNum);
+        unsigned ulRecvBufSize = ASRtspGuardManager::instance().getRecvBufSize();
+        if ((NULL == m_pProbeSubsession) && (ulRecvBufSize > curBufferSize)) {
+            (void)setReceiveBufferTo(envir(), socketNum, ulRecvBufSize);
+        }
+    }
+    return True;
+}
+
+void ASRtspCheckChannel::sendPlay() {
     /* send the play by the control */
     m_enStatus = AS_RTSP_STATUS_SETUP;
     // We've finished setting up all of the subsessions.  Now, send a RTSP "PLAY" command to start the streaming:
     if (scs.session->absStartTime() != NULL) {
         // Special case: The stream is indexed by 'absolute' time, so send an appropriate "PLAY" command:
-        AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::setupNextSubsession,send play message,startime:[%s] endtime:[%s].",
+        AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::sendPlay,send play message,startime:[%s] endtime:[%s].",
                                                scs.session->absStartTime(),scs.session->absEndTime());
         sendPlayCommand(*scs.session, continueAfterPLAY, scs.session->absStartTime(), scs.session->absEndTime());
     } else {
         scs.duration = scs.session->playEndTime() - scs.session->playStartTime();
-        AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::setupNextSubsession,send play message,duration:[%f].",scs.duration);
+        AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::sendPlay,send play message,duration:[%f].",scs.duration);
         sendPlayCommand(*scs.session, continueAfterPLAY);
     }
-    AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::setupNextSubsession exit.");
-    return;
+}
+
+Boolean ASRtspCheckChannel::redescribe(int resultCode) {
+    /* only an answer of the server says the SDP is stale,the client dropped it from the cache already */
+    if ((0 >= resultCode) || !describeWasCached() || m_bRedescribed) {
+        return False;
+    }
+    AS_LOG(AS_LOG_INFO,"ASRtspCheckChannel::redescribe,the cached sdp is refused:[%d],describe again.",resultCode);
+    m_bRedescribed = True;
+
+    if (scs.session != NULL) {
+        MediaSubsessionIterator iter(*scs.session);
+        MediaSubsession* subsession;
+        while ((subsession = iter.next()) != NULL) {
+            if (subsession->sink != NULL) {
+                Medium::close(subsession->sink);
+                subsession->sink = NULL;
+            }
+        }
+        Medium::close(scs.session);
+        scs.session = NULL;
+    }
+    delete scs.iter;
+    scs.iter = NULL;
+    scs.subsession = NULL;
+    m_pProbeSubsession = NULL;
+    m_enStatus = AS_RTSP_STATUS_INIT;
+
+    resetForRedescribe();
+    sendDescribeCommand(continueAfterDESCRIBE);
+    return True;
+}
+
+void ASRtspCheckChannel::scheduleShutdown() {
+    /* not inside the response handler,the client is closed by the shutdown */
+    m_enStatus = AS_RTSP_STATUS_TEARDOWN;
+    envir().taskScheduler().unscheduleDelayedTask(scs.streamTimerTask);
+    scs.streamTimerTask = envir().taskScheduler().scheduleDelayedTask(0, (TaskFunc*)streamTimerHandler, this);
 }
 
 void ASRtspCheckChannel::shutdownStream() {
     AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::shutdownStream begin.");
+    /* the session may never be created,so the state does not unschedule it */
+    envir().taskScheduler().unscheduleDelayedTask(scs.streamTimerTask);
     // First, check whether any subsessions have still to be closed:
     uint32_t ulDuration  = time(NULL) - m_ulStartTime;
     uint64_t ulVideoRecv = 0;
     uint64_t ulAudioRecv = 0;
+    AS_RTSP_PROBE_METRICS stMetrics;
+    collectMetrics(stMetrics, ulVideoRecv);
     if (scs.session != NULL) {
         Boolean someSubsessionsWereActive = False;
         MediaSubsessionIterator iter(*scs.session);
@@ -405,6 +603,12 @@ void ASRtspCheckChannel::shutdownStream() {
                 someSubsessionsWereActive = True;
             }
         }
+        if ((NULL != m_pProbeSubsession) && (NULL != m_pProbeSubsession->sessionId())) {
+            if (m_pProbeSubsession->rtcpInstance() != NULL) {
+                m_pProbeSubsession->rtcpInstance()->setByeHandler(NULL, NULL);
+            }
+            someSubsessionsWereActive = True;
+        }
 
         if (someSubsessionsWereActive) {
           // Send a RTSP "TEARDOWN" command, to tell the server to shutdown the stream.
@@ -419,6 +623,7 @@ void ASRtspCheckChannel::shutdownStream() {
     {
         AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::shutdownStream,report release.");
         m_bObervser->NotifyStatus(AS_RTSP_STATUS_RELEASE);
+        m_bObervser->NotifyProbeData(stMetrics);
         m_bObervser->NotifyRecvData(m_enCheckResult,ulDuration, ulVideoRecv, ulAudioRecv);
     }
     AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::shutdownStream end.");
@@ -430,6 +635,66 @@ void ASRtspCheckChannel::shutdownStream() {
 }
 
 
+static uint32_t probe_elapsed_ms(struct timeval const& start,struct timeval const& end)
+{
+    if (0 == end.tv_sec) {
+        return 0;
+    }
+    int64_t llMs = (int64_t)(end.tv_sec - start.tv_sec)*1000
+                 + (end.tv_usec - start.tv_usec)/1000;
+    return (0 < llMs) ? (uint32_t)llMs : 1;
+}
+
+void ASRtspCheckChannel::collectMetrics(AS_RTSP_PROBE_METRICS& stMetrics,uint64_t& ulVideoRecv)
+{
+    memset(&stMetrics, 0, sizeof(stMetrics));
+    if (scs.session == NULL) {
+        return;
+    }
+
+    MediaSubsession* subsession = m_pProbeSubsession;
+    if (NULL == subsession) {
+        MediaSubsessionIterator iter(*scs.session);
+        while ((subsession = iter.next()) != NULL) {
+            if (!strcmp(subsession->mediumName(), "video")) {
+                break;
+            }
+        }
+    }
+    if ((NULL == subsession) || (NULL == subsession->rtpSource())) {
+        return;
+    }
+    RTPSource* pSource = subsession->rtpSource();
+
+    if (NULL != m_pProbeSubsession) {
+        ASRtspProbeSource* pProbe = (ASRtspProbeSource*)pSource;
+        ulVideoRecv = pProbe->getRecvSize();
+        stMetrics.ulFirstPacketMs = probe_elapsed_ms(m_stStartTime, pProbe->firstPacketTime());
+        stMetrics.ulKeyFrameMs    = probe_elapsed_ms(m_stStartTime, pProbe->keyFrameTime());
+    }
+
+    /* the stats of the last sender,a camera has one */
+    RTPReceptionStats* pStats = pSource->receptionStatsDB().lookup(pSource->lastReceivedSSRC());
+    if (NULL == pStats) {
+        return;
+    }
+    stMetrics.ulPackets = pStats->totNumPacketsReceived();
+    if (pStats->totNumPacketsExpected() > stMetrics.ulPackets) {
+        stMetrics.ulLost = pStats->totNumPacketsExpected() - stMetrics.ulPackets;
+    }
+    if (0 != pSource->timestampFrequency()) {
+        stMetrics.ulJitterUs = (uint32_t)((uint64_t)pStats->jitter()*1000000/pSource->timestampFrequency());
+    }
+    stMetrics.ulMaxGapMs = pStats->maxInterPacketGapUS()/1000;
+}
+
+void ASRtspCheckChannel::handle_probe_keyframe()
+{
+    AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::handle_probe_keyframe,probe mode:[%d].",m_enProbeMode);
+    if (AS_RTSP_PROBE_KEYFRAME == m_enProbeMode) {
+        scheduleShutdown();
+    }
+}
 
 // Implementation of the RTSP 'response handlers':
 void ASRtspCheckChannel::continueAfterOPTIONS(RTSPClient* rtspClient, int resultCode, char* resultString) {
@@ -493,6 +758,18 @@ void ASRtspCheckChannel::streamTimerHandler(void* clientData) {
     rtspClient->handle_after_timeout();
 }
 
+void ASRtspCheckChannel::probeKeyFrameHandler(void* clientData) {
+    ASRtspCheckChannel* rtspClient = (ASRtspCheckChannel*)clientData;
+    rtspClient->handle_probe_keyframe();
+}
+
+void ASRtspCheckChannel::probeByeHandler(void* clientData) {
+    ASRtspCheckChannel* rtspClient = (ASRtspCheckChannel*)clientData;
+    /* the server ends the stream,the probe is judged by what it got */
+    AS_LOG(AS_LOG_DEBUG,"ASRtspCheckChannel::probeByeHandler.");
+    rtspClient->scheduleShutdown();
+}
+
 
 
 
@@ -530,6 +807,7 @@ ASRtspCheckVideoSink::~ASRtspCheckVideoSink() {
 void ASRtspCheckVideoSink::afterGettingFrame(void* clientData, unsigned frameSize, unsigned numTruncatedBytes,
                   struct timeval presentationTime, unsigned durationInMicroseconds) {
     ASRtspCheckVideoSink* sink = (ASRtspCheckVideoSink*)clientData;
+    as_env_pool::add_frame(frameSize);
     sink->afterGettingFrame(frameSize, numTruncatedBytes, presentationTime, durationInMicroseconds);
 }
 
@@ -565,6 +843,7 @@ ASRtspCheckAudioSink::~ASRtspCheckAudioSink() {
 void ASRtspCheckAudioSink::afterGettingFrame(void* clientData, unsigned frameSize, unsigned numTruncatedBytes,
                   struct timeval presentationTime, unsigned durationInMicroseconds) {
     ASRtspCheckAudioSink* sink = (ASRtspCheckAudioSink*)clientData;
+    as_env_pool::add_frame(frameSize);
     sink->afterGettingFrame(frameSize, numTruncatedBytes, presentationTime, durationInMicroseconds);
 }
 
@@ -586,21 +865,288 @@ Boolean ASRtspCheckAudioSink::continuePlaying() {
 }
 
 
+ASRtspProbeSource* ASRtspProbeSource::createNew(UsageEnvironment& env, Groupsock* RTPgs,
+                                                unsigned char rtpPayloadFormat,
+                                                unsigned rtpTimestampFrequency,
+                                                char const* codecName) {
+    return new ASRtspProbeSource(env, RTPgs, rtpPayloadFormat, rtpTimestampFrequency, codecName);
+}
+
+ASRtspProbeSource::ASRtspProbeSource(UsageEnvironment& env, Groupsock* RTPgs,
+                                     unsigned char rtpPayloadFormat,
+                                     unsigned rtpTimestampFrequency,
+                                     char const* codecName)
+  : RTPSource(env, RTPgs, rtpPayloadFormat, rtpTimestampFrequency) {
+    m_ulPacketSize     = 0;
+    m_ulBufSize        = 0;
+    m_bReading         = False;
+    m_bH264            = (NULL != codecName) && (0 == strcmp(codecName, "H264"));
+    m_bH265            = (NULL != codecName) && (0 == strcmp(codecName, "H265"));
+    m_pKeyFrameHandler = NULL;
+    m_pKeyFrameData    = NULL;
+    m_ulPackets        = 0;
+    m_ulRecvSize       = 0;
+    m_bKeyFrame        = False;
+    memset(&m_stFirstPacket, 0, sizeof(m_stFirstPacket));
+    memset(&m_stKeyFrame, 0, sizeof(m_stKeyFrame));
+}
+
+ASRtspProbeSource::~ASRtspProbeSource() {
+    if (m_bReading) {
+        fRTPInterface.stopNetworkReading();
+    }
+}
+
+void ASRtspProbeSource::startProbe(TaskFunc* keyFrameHandler, void* clientData) {
+    m_pKeyFrameHandler = keyFrameHandler;
+    m_pKeyFrameData    = clientData;
+    if (!m_bReading) {
+        m_bReading = True;
+        TaskScheduler::BackgroundHandlerProc* handler
+          = (TaskScheduler::BackgroundHandlerProc*)&networkReadHandler;
+        fRTPInterface.startNetworkReading(handler);
+    }
+}
+
+void ASRtspProbeSource::doGetNextFrame() {
+    // the probe hands no frame to a reader:
+    handleClosure();
+}
+
+void ASRtspProbeSource::doStopGettingFrames() {
+}
+
+void ASRtspProbeSource::setPacketReorderingThresholdTime(unsigned /*uSeconds*/) {
+    // nothing is reordered,the packets are only counted
+}
+
+void ASRtspProbeSource::networkReadHandler(ASRtspProbeSource* source, int /*mask*/) {
+    source->readPacket();
+}
+
+void ASRtspProbeSource::readPacket() {
+    unsigned           bytesRead = 0;
+    struct sockaddr_in fromAddress;
+    int                tcpSocketNum = -1;
+    unsigned char      tcpStreamChannelId = 0xFF;
+    Boolean            packetReadWasIncomplete = False;
+
+    /* a packet over tcp may come in pieces,the tail of a large one is read over the bytes behind the head */
+    unsigned ulOffset = m_ulBufSize;
+    if (RTSP_PROBE_PACKET_SIZE <= ulOffset) {
+        ulOffset = RTSP_PROBE_HEAD_SIZE;
+    }
+    if (!fRTPInterface.handleRead(&m_szPacket[ulOffset], RTSP_PROBE_PACKET_SIZE - ulOffset,
+                                  bytesRead, fromAddress, tcpSocketNum, tcpStreamChannelId,
+                                  packetReadWasIncomplete)) {
+        m_ulPacketSize = 0;
+        m_ulBufSize    = 0;
+        return;
+    }
+    m_ulPacketSize += bytesRead;
+    m_ulBufSize     = ulOffset + bytesRead;
+    if (packetReadWasIncomplete) {
+        return;
+    }
+    if (RTSP_PROBE_PACKET_SIZE < m_ulPacketSize) {
+        /* the bytes behind the head are the tail now */
+        m_ulBufSize = RTSP_PROBE_HEAD_SIZE;
+    }
+
+    handlePacket(fromAddress);
+    m_ulPacketSize = 0;
+    m_ulBufSize    = 0;
+}
+
+void ASRtspProbeSource::handlePacket(struct sockaddr_in& fromAddress) {
+    // Check for the 12-byte RTP header:
+    if (m_ulBufSize < 12) {
+        return;
+    }
+    unsigned rtpHdr       = ntohl(*(u_int32_t*)&m_szPacket[0]);
+    unsigned rtpTimestamp = ntohl(*(u_int32_t*)&m_szPacket[4]);
+    unsigned rtpSSRC      = ntohl(*(u_int32_t*)&m_szPacket[8]);
+
+    // Check the RTP version number (it should be 2):
+    if ((rtpHdr&0xC0000000) != 0x80000000) {
+        return;
+    }
+
+    unsigned char rtpPayloadType = (unsigned char)((rtpHdr&0x007F0000)>>16);
+    if (rtpPayloadType != rtpPayloadFormat()) {
+        if ((fRTCPInstanceForMultiplexedRTCPPackets != NULL)
+            && (rtpPayloadType >= 64) && (rtpPayloadType <= 95)) {
+            // This is a multiplexed RTCP packet:
+            fRTCPInstanceForMultiplexedRTCPPackets->injectReport(m_szPacket, m_ulBufSize, fromAddress);
+        }
+        return;
+    }
+
+    // Skip over the CSRC identifiers and the header extension:
+    unsigned ulHead = 12 + ((rtpHdr>>24)&0x0F)*4;
+    if (rtpHdr&0x10000000) {
+        if (m_ulBufSize < (ulHead + 4)) {
+            return;
+        }
+        unsigned extHdr = ntohl(*(u_int32_t*)&m_szPacket[ulHead]);
+        ulHead += 4 + 4*(extHdr&0xFFFF);
+    }
+    if (m_ulPacketSize < ulHead) {
+        return;
+    }
+    unsigned ulPayloadSize = m_ulPacketSize - ulHead;
+
+    // Discard any padding bytes,the last byte is kept unless the packet is too large:
+    if ((rtpHdr&0x20000000) && (m_ulBufSize == m_ulPacketSize) && (0 < ulPayloadSize)) {
+        unsigned numPaddingBytes = m_szPacket[m_ulPacketSize - 1];
+        if (ulPayloadSize < numPaddingBytes) {
+            return;
+        }
+        ulPayloadSize -= numPaddingBytes;
+    }
+
+    fLastReceivedSSRC = rtpSSRC;
+    struct timeval presentationTime;
+    Boolean hasBeenSyncedUsingRTCP;
+    receptionStatsDB().noteIncomingPacket(rtpSSRC, (u_int16_t)(rtpHdr&0xFFFF), rtpTimestamp,
+                                          timestampFrequency(), True, presentationTime,
+                                          hasBeenSyncedUsingRTCP, ulPayloadSize);
+    as_env_pool::add_traffic(ulPayloadSize, 1);
+
+    struct timeval timeNow;
+    gettimeofday(&timeNow, NULL);
+    if (0 == m_ulPackets) {
+        m_stFirstPacket = timeNow;
+    }
+    m_ulPackets++;
+    m_ulRecvSize += ulPayloadSize;
+
+    if (m_bKeyFrame) {
+        return;
+    }
+    unsigned ulAvail = (m_ulBufSize > ulHead) ? (m_ulBufSize - ulHead) : 0;
+    if (ulAvail > ulPayloadSize) {
+        ulAvail = ulPayloadSize;
+    }
+    if (isKeyFrame(&m_szPacket[ulHead], ulAvail)) {
+        m_bKeyFrame  = True;
+        m_stKeyFrame = timeNow;
+        if (NULL != m_pKeyFrameHandler) {
+            (*m_pKeyFrameHandler)(m_pKeyFrameData);
+        }
+    }
+}
+
+/* the start of an IDR(H264) or an IRAP picture(H265),alone,aggregated or fragmented */
+Boolean ASRtspProbeSource::isKeyFrame(u_int8_t const* payload, unsigned size) {
+    unsigned pos = 0;
+    if (0 == size) {
+        return False;
+    }
+
+    if (m_bH264) {
+        u_int8_t nalType = payload[0]&0x1F;
+        if (24 == nalType) { // STAP-A
+            for (pos = 1; (pos + 3) <= size; pos += 2 + ((payload[pos]<<8)|payload[pos+1])) {
+                if (5 == (payload[pos+2]&0x1F)) {
+                    return True;
+                }
+            }
+            return False;
+        }
+        if (28 == nalType) { // FU-A
+            return (2 <= size) && (payload[1]&0x80) && (5 == (payload[1]&0x1F));
+        }
+        return (5 == nalType);
+    }
+
+    if (m_bH265) {
+        if (size < 3) {
+            return False;
+        }
+        u_int8_t nalType = (payload[0]>>1)&0x3F;
+        if (48 == nalType) { // AP
+            for (pos = 2; (pos + 3) <= size; pos += 2 + ((payload[pos]<<8)|payload[pos+1])) {
+                u_int8_t aggType = (payload[pos+2]>>1)&0x3F;
+                if ((16 <= aggType) && (aggType <= 21)) {
+                    return True;
+                }
+            }
+            return False;
+        }
+        if (49 == nalType) { // FU
+            u_int8_t fuType = payload[2]&0x3F;
+            return (payload[2]&0x80) && (16 <= fuType) && (fuType <= 21);
+        }
+        return (16 <= nalType) && (nalType <= 21);
+    }
+
+    /* the key frame of other codecs is not known,the first packet stands for it */
+    return True;
+}
+
+ASRtspProbeSession* ASRtspProbeSession::createNew(UsageEnvironment& env, char const* sdpDescription) {
+    ASRtspProbeSession* newSession = new ASRtspProbeSession(env);
+    if (newSession != NULL) {
+        if (!newSession->initializeWithSDP(sdpDescription)) {
+            delete newSession;
+            return NULL;
+        }
+    }
+    return newSession;
+}
+
+ASRtspProbeSession::ASRtspProbeSession(UsageEnvironment& env)
+  : MediaSession(env) {
+}
+
+ASRtspProbeSession::~ASRtspProbeSession() {
+}
+
+MediaSubsession* ASRtspProbeSession::createNewMediaSubsession() {
+    return new ASRtspProbeSubsession(*this);
+}
+
+ASRtspProbeSubsession::ASRtspProbeSubsession(MediaSession& parent)
+  : MediaSubsession(parent) {
+}
+
+ASRtspProbeSubsession::~ASRtspProbeSubsession() {
+}
+
+Boolean ASRtspProbeSubsession::createSourceObjects(int useSpecialRTPoffset) {
+    if (strcmp(fProtocolName, "UDP") == 0) {
+        // a raw udp stream has no rtp header to look at:
+        return MediaSubsession::createSourceObjects(useSpecialRTPoffset);
+    }
+    fReadSource = fRTPSource = ASRtspProbeSource::createNew(env(), fRTPSocket, fRTPPayloadFormat,
+                                                            fRTPTimestampFrequency, fCodecName);
+    return True;
+}
+
 
 ASLensInfo::ASLensInfo()
 {
     m_Status = AS_RTSP_CHECK_STATUS_WAIT;
     m_strCameraID = "";
     m_strStreamType = "";
+    m_strRtspUrl = "";
+    m_strHost = "";
+    m_pTask  = NULL;
+    m_pNextPost = NULL;
+    m_bRunning = false;
     m_handle = NULL;
     m_time = 0;
     m_ulDuration  = 0;
     m_ulVideoRecv = 0;
     m_ulAudioRecv = 0;
+    memset(&m_stMetrics,0,sizeof(m_stMetrics));
     m_enCheckResult = AS_RTSP_CHECK_RESULT_SUCCESS;
 }
 ASLensInfo::~ASLensInfo()
 {
+    /* a check released by the channel still holds its handle */
+    stopRtspCheck();
 }
 void ASLensInfo::setLensInfo(std::string& strCameraID,std::string& strStreamType)
 {
@@ -610,73 +1156,14 @@ void ASLensInfo::setLensInfo(std::string& strCameraID,std::string& strStreamType
     m_strStreamType = strStreamType;
 }
 
-void ASLensInfo::check()
-{
-    AS_LOG(AS_LOG_DEBUG,"ASLensInfo::check,status:[%d].",m_Status);
-    if(AS_RTSP_CHECK_STATUS_END == m_Status )
-    {
-        return;
-    }
-    if(AS_RTSP_CHECK_STATUS_RUN == m_Status)
-    {
-        /* check rtsp handle status */
-        if(NULL != m_handle)
-        {
-            AS_RTSP_STATUS eStatus = ASRtspGuardManager::instance().getStatus(m_handle);
-            AS_LOG(AS_LOG_DEBUG,"ASLensInfo::check,the rtsp handle status:[%d].",eStatus);
-            if(AS_RTSP_STATUS_TEARDOWN == eStatus) {
-                stopRtspCheck();
-            }
-        }
-        /* check the run time and break */
-        time_t duration = ASRtspGuardManager::instance().getCheckDuration();
-        time_t cur = time(NULL);
-        if(cur > (m_time + duration))
-        {
-            AS_LOG(AS_LOG_DEBUG,"ASLensInfo::check,the run timeout,so stop the task.");
-            stopRtspCheck();
-        }
-        return;
-    }
-
-    uint32_t ulCurHandleCount = ASRtspGuardManager::instance().getRtspHandleCount();
-    uint32_t ulMaxCheckCount  = ASRtspGuardManager::instance().getMaxCheckCount();
-
-    if(ulMaxCheckCount <= ulCurHandleCount)
-    {
-        AS_LOG(AS_LOG_DEBUG,"ASLensInfo::check,the run task is so big,max:[%d]"
-                            " current:[%d] ,so wait ......",ulMaxCheckCount,ulCurHandleCount);
-        return;
-    }
-
-    /* start the lens check */
-    AS_LOG(AS_LOG_DEBUG,"ASLensInfo::check,start the new rtsp .");
-
-    if(AS_ERROR_CODE_OK != StartRtspCheck())
-    {
-        /* start fail */
-        AS_LOG(AS_LOG_DEBUG,"ASLensInfo::check,start the new rtsp fail .");
-        m_Status = AS_RTSP_CHECK_STATUS_END;
-        return ;
-    }
-    m_time = time(NULL);
-
-    m_Status = AS_RTSP_CHECK_STATUS_RUN;
-}
-
 CHECK_STATUS ASLensInfo::Status()
 {
     return m_Status;
 }
 void ASLensInfo::NotifyStatus(AS_RTSP_STATUS status)
 {
-    AS_LOG(AS_LOG_DEBUG,"ASLensInfo::NotifyStatus begin,status:[%d].",status);
-    if(AS_RTSP_STATUS_RELEASE == status)
-    {
-        AS_LOG(AS_LOG_DEBUG,"ASLensInfo::NotifyStatus,end the check.");
-        m_Status = AS_RTSP_CHECK_STATUS_END;
-    }
-    AS_LOG(AS_LOG_DEBUG,"ASLensInfo::NotifyStatus end.");
+    /* the result follows by NotifyRecvData() */
+    AS_LOG(AS_LOG_DEBUG,"ASLensInfo::NotifyStatus,status:[%d].",status);
 }
 
 void ASLensInfo::NotifyRecvData(AS_RTSP_CHECK_RESULT enResult,uint32_t ulDuration,uint64_t ulVideoRecv,uint64_t ulAudioRecv)
@@ -685,29 +1172,58 @@ void ASLensInfo::NotifyRecvData(AS_RTSP_CHECK_RESULT enResult,uint32_t ulDuratio
     m_ulDuration    = ulDuration;
     m_ulVideoRecv   = ulVideoRecv;
     m_ulAudioRecv   = ulAudioRecv;
+    /* the last report of the channel,the lens may be gone after the post */
+    ASRtspGuardManager::instance().post_done(this);
 }
 
+void ASLensInfo::NotifyProbeData(const AS_RTSP_PROBE_METRICS& stMetrics)
+{
+    m_stMetrics = stMetrics;
+}
 
-int32_t ASLensInfo::StartRtspCheck()
+/* host[:port] of the rtsp url,the user info is dropped */
+static std::string rtsp_url_host(const std::string& strUrl)
 {
-    AS_LOG(AS_LOG_DEBUG,"ASLensInfo::StartRtspCheck begin.");
+    std::string::size_type begin = strUrl.find("://");
+    begin = (std::string::npos == begin) ? 0 : begin + 3;
+    std::string::size_type end = strUrl.find('/', begin);
+    std::string strHost = (std::string::npos == end) ? strUrl.substr(begin)
+                                                     : strUrl.substr(begin, end - begin);
+    std::string::size_type at = strHost.rfind('@');
+    if(std::string::npos != at) {
+        strHost = strHost.substr(at + 1);
+    }
+    return strHost;
+}
+
+int32_t ASLensInfo::ResolveRtspUrl()
+{
+    AS_LOG(AS_LOG_DEBUG,"ASLensInfo::ResolveRtspUrl begin.");
     ASEvLiveHttpClient httpHandle;
-    std::string strRtspUrl;
-    int32_t nRet = httpHandle.send_live_url_request(m_strCameraID,m_strStreamType,strRtspUrl);
+    int32_t nRet = httpHandle.send_live_url_request(m_strCameraID,m_strStreamType,m_strRtspUrl);
     if(nRet != AS_ERROR_CODE_OK)
     {
-        AS_LOG(AS_LOG_WARNING,"ASLensInfo::StartRtspCheck,get the rtsp url fail.");
+        AS_LOG(AS_LOG_WARNING,"ASLensInfo::ResolveRtspUrl,get the rtsp url fail.");
         m_enCheckResult = AS_RTSP_CHECK_RESULT_URL_FAIL;
         return AS_ERROR_CODE_FAIL;
     }
-    AS_LOG(AS_LOG_INFO,"ASLensInfo::StartRtspCheck,get the rtsp url:[%s].",strRtspUrl.c_str());
-    m_handle = ASRtspGuardManager::instance().openURL(strRtspUrl.c_str(),this);
+    m_strHost = rtsp_url_host(m_strRtspUrl);
+    AS_LOG(AS_LOG_INFO,"ASLensInfo::ResolveRtspUrl,get the rtsp url:[%s].",m_strRtspUrl.c_str());
+    return AS_ERROR_CODE_OK;
+}
+
+int32_t ASLensInfo::StartRtspCheck()
+{
+    AS_LOG(AS_LOG_DEBUG,"ASLensInfo::StartRtspCheck begin.");
+    m_handle = ASRtspGuardManager::instance().openURL(m_strRtspUrl.c_str(),this,m_pTask->getProbeMode());
     if(NULL == m_handle)
     {
-        AS_LOG(AS_LOG_WARNING,"ASLensInfo::StartRtspCheck,open the rtsp url:[%s] fail.",strRtspUrl.c_str());
+        AS_LOG(AS_LOG_WARNING,"ASLensInfo::StartRtspCheck,open the rtsp url:[%s] fail.",m_strRtspUrl.c_str());
         m_enCheckResult = AS_RTSP_CHECK_RESULT_OPEN_URL;
         return AS_ERROR_CODE_FAIL;
     }
+    m_time   = time(NULL);
+    m_Status = AS_RTSP_CHECK_STATUS_RUN;
     AS_LOG(AS_LOG_DEBUG,"ASLensInfo::StartRtspCheck end.");
     return AS_ERROR_CODE_OK;
 }
@@ -726,7 +1242,11 @@ void    ASLensInfo::stopRtspCheck()
 
 ASRtspCheckTask::ASRtspCheckTask()
 {
-    m_Status = AS_RTSP_CHECK_STATUS_WAIT;
+    m_Status      = AS_RTSP_CHECK_STATUS_WAIT;
+    m_ulLensCount = 0;
+    m_ulDoneCount = 0;
+    m_ulPriority  = 0;
+    m_enProbeMode = AS_RTSP_PROBE_FULL;
 }
 ASRtspCheckTask::~ASRtspCheckTask()
 {
@@ -761,44 +1281,22 @@ void ASRtspCheckTask::addCamera(std::string& strCameraID,std::string& strStreamT
         return;
     }
     pLenInfo->setLensInfo(strCameraID, strStreamTye);
+    pLenInfo->setTask(this);
     m_LensList.push_back(pLenInfo);
+    m_ulLensCount++;
     AS_LOG(AS_LOG_DEBUG,"ASRtspCheckTask::addCamera end.");
 }
-void ASRtspCheckTask::checkTask()
+bool ASRtspCheckTask::finishLens()
 {
-    AS_LOG(AS_LOG_DEBUG,"ASRtspCheckTask::checkTask begin.");
-    if(AS_RTSP_CHECK_STATUS_END == m_Status )
-    {
-        AS_LOG(AS_LOG_DEBUG,"ASRtspCheckTask::checkTask,task is end.");
-        return;
-    }
-
-    ASLensInfo* pLenInfo = NULL;
-    bool bRunning = false;
-
-    LENSINFOLISTITRT iter = m_LensList.begin();
-
-    for(; iter != m_LensList.end();++iter)
+    m_ulDoneCount++;
+    if(m_ulDoneCount < m_ulLensCount)
     {
-        pLenInfo = *iter;
-        pLenInfo->check();
-        if(AS_RTSP_CHECK_STATUS_END != pLenInfo->Status() )
-        {
-            bRunning = true;
-        }
+        m_Status = AS_RTSP_CHECK_STATUS_RUN;
+        return false;
     }
-
-    if(bRunning)
-    {
-        AS_LOG(AS_LOG_DEBUG,"ASRtspCheckTask::checkTask,task is go running now.");
-        return;
-    }
-
-    //report the task info to the server,and end eth task
-    ReportTaskStatus();
-
-    AS_LOG(AS_LOG_DEBUG,"ASRtspCheckTask::checkTask,task is stop ,so report to server.");
+    AS_LOG(AS_LOG_DEBUG,"ASRtspCheckTask::finishLens,task:[%s] is end.",m_strCheckID.c_str());
     m_Status = AS_RTSP_CHECK_STATUS_END;
+    return true;
 }
 CHECK_STATUS ASRtspCheckTask::TaskStatus()
 {
@@ -819,8 +1317,11 @@ void ASRtspCheckTask::ReportTaskStatus()
     report->SetAttribute("version", "1.0");
     XMLElement *check = msg.NewElement("check");
     report->InsertEndChild(check);
+    char           szbuf[RTSP_CHECK_TMP_BUF_SIZE] = {0};
 
     check->SetAttribute("checkid", m_strCheckID.c_str());
+    snprintf(szbuf,RTSP_CHECK_TMP_BUF_SIZE,"%d",m_enProbeMode);
+    check->SetAttribute("probe", szbuf);
     XMLElement *CameraList = msg.NewElement("cameralist");
     check->InsertEndChild(CameraList);
 
@@ -831,7 +1332,6 @@ void ASRtspCheckTask::ReportTaskStatus()
     uint32_t       ulDuration;
     uint64_t       ulVideoRecv;
     uint64_t       ulAudioRecv;
-    char           szbuf[RTSP_CHECK_TMP_BUF_SIZE] = {0};
 
     for(; iter != m_LensList.end();++iter)
     {
@@ -857,6 +1357,21 @@ void ASRtspCheckTask::ReportTaskStatus()
         Camera->SetAttribute("video_recv", szbuf);
         snprintf(szbuf,RTSP_CHECK_TMP_BUF_SIZE,"%lld",ulAudioRecv);
         Camera->SetAttribute("audio_recv", szbuf);
+
+        /* the video metrics,0 if not known */
+        const AS_RTSP_PROBE_METRICS& stMetrics = pLenInfo->getMetrics();
+        snprintf(szbuf,RTSP_CHECK_TMP_BUF_SIZE,"%u",stMetrics.ulFirstPacketMs);
+        Camera->SetAttribute("first_packet_ms", szbuf);
+        snprintf(szbuf,RTSP_CHECK_TMP_BUF_SIZE,"%u",stMetrics.ulKeyFrameMs);
+        Camera->SetAttribute("key_frame_ms", szbuf);
+        snprintf(szbuf,RTSP_CHECK_TMP_BUF_SIZE,"%u",stMetrics.ulPackets);
+        Camera->SetAttribute("packets", szbuf);
+        snprintf(szbuf,RTSP_CHECK_TMP_BUF_SIZE,"%u",stMetrics.ulLost);
+        Camera->SetAttribute("lost", szbuf);
+        snprintf(szbuf,RTSP_CHECK_TMP_BUF_SIZE,"%u",stMetrics.ulJitterUs);
+        Camera->SetAttribute("jitter_us", szbuf);
+        snprintf(szbuf,RTSP_CHECK_TMP_BUF_SIZE,"%u",stMetrics.ulMaxGapMs);
+        Camera->SetAttribute("max_gap_ms", szbuf);
     }
 
 
@@ -1269,7 +1784,6 @@ int32_t ASEvLiveHttpClient::send_http_request(std::string& strUrl,std::string& s
 
 ASRtspGuardManager::ASRtspGuardManager()
 {
-    m_ulTdIndex        = 0;
     m_LoopWatchVar     = 0;
     m_ulRecvBufSize    = RTSP_SOCKET_RECV_BUFFER_SIZE_DEFAULT;
     m_HttpThreadHandle = NULL;
@@ -1278,17 +1792,35 @@ ASRtspGuardManager::ASRtspGuardManager()
     m_httpServer       = NULL;
     m_httpListenPort   = GW_SERVER_PORT_DEFAULT;
     m_mutex            = NULL;
-    memset(m_ThreadHandle,0,sizeof(as_thread_t*)*RTSP_MANAGE_ENV_MAX_COUNT);
-    memset(m_envArray,0,sizeof(UsageEnvironment*)*RTSP_MANAGE_ENV_MAX_COUNT);
-    memset(m_clCountArray,0,sizeof(u_int32_t)*RTSP_MANAGE_ENV_MAX_COUNT);
     m_ulLogLM          = AS_LOG_WARNING;
     m_ulMaxCheckCount  = RTSP_CLINET_HANDLE_MAX;
     m_ulCheckDuration  = RTSP_CLINET_RUN_DURATION;
+    m_enProbeMode      = AS_RTSP_PROBE_FULL;
+    m_ulProbeSampleTime= RTSP_CHECK_PROBE_SAMPLE_DEFAULT;
+    m_ulFastStart      = 0;
+    m_ulDescribeCacheTTL = 0;
     m_strAppID         = "";
     m_strAppSecret     = "";
     m_strAppKey        = "";
     m_strAppKey        = "";
     m_ulRtspHandlCount = 0;
+    m_ulEnvMaxCheck    = RTSP_CHECK_ENV_MAX_DEFAULT;
+    m_ulEnvCheckRate   = RTSP_CHECK_ENV_RATE_DEFAULT;
+    m_ulHostMaxCheck   = RTSP_CHECK_HOST_MAX_DEFAULT;
+    m_ulHostCheckRate  = RTSP_CHECK_HOST_RATE_DEFAULT;
+    m_ulResolveThreadCount = RTSP_CHECK_RESOLVE_THREAD_DEFAULT;
+    memset(m_ResolveThreads,0,sizeof(m_ResolveThreads));
+    m_checkEvent       = NULL;
+    m_pResolvedHead    = NULL;
+    m_pDoneHead        = NULL;
+    m_resolveMutex     = NULL;
+    m_resolveEvent     = NULL;
+    m_ullCheckSeq      = 0;
+    m_ulResolving      = 0;
+    m_ulWaiting        = 0;
+    m_ulRunning        = 0;
+    m_ulLastSweep      = 0;
+    memset(&m_stEnvRate,0,sizeof(m_stEnvRate));
 }
 
 ASRtspGuardManager::~ASRtspGuardManager()
@@ -1318,6 +1850,14 @@ int32_t ASRtspGuardManager::init()
         return AS_ERROR_CODE_FAIL;
     }
 
+    m_resolveMutex = as_create_mutex();
+    m_checkEvent   = as_create_event();
+    m_resolveEvent = as_create_event();
+    if((NULL == m_resolveMutex) || (NULL == m_checkEvent) || (NULL == m_resolveEvent)) {
+        AS_LOG(AS_LOG_ERROR,"ASRtspGuardManager::init ,create the check scheduler fail");
+        return AS_ERROR_CODE_FAIL;
+    }
+
     AS_LOG(AS_LOG_DEBUG,"ASRtspGuardManager::init end");
 
     return AS_ERROR_CODE_OK;
@@ -1328,15 +1868,26 @@ void    ASRtspGuardManager::release()
     m_LoopWatchVar = 1;
     as_destroy_mutex(m_mutex);
     m_mutex = NULL;
+    if(NULL != m_resolveMutex) {
+        as_destroy_mutex(m_resolveMutex);
+        m_resolveMutex = NULL;
+    }
+    if(NULL != m_checkEvent) {
+        as_destroy_event(m_checkEvent);
+        free(m_checkEvent);
+        m_checkEvent = NULL;
+    }
+    if(NULL != m_resolveEvent) {
+        as_destroy_event(m_resolveEvent);
+        free(m_resolveEvent);
+        m_resolveEvent = NULL;
+    }
     ASStopLog();
     AS_LOG(AS_LOG_DEBUG,"ASRtspGuardManager::release end");
 }
 
 int32_t ASRtspGuardManager::open()
 {
-    // Begin by setting up our usage environment:
-    u_int32_t i = 0;
-
     AS_LOG(AS_LOG_DEBUG,"ASRtspGuardManager::open begin.");
 
     m_LoopWatchVar = 0;
@@ -1347,19 +1898,19 @@ int32_t ASRtspGuardManager::open()
         return AS_ERROR_CODE_FAIL;
     }
 
-    /* start the rtsp client deal thread */
-    for(i = 0;i < RTSP_MANAGE_ENV_MAX_COUNT;i++) {
-        m_envArray[i] = NULL;
-        m_clCountArray[i] = 0;
+    /* start the rtsp client event loops */
+    if (AS_ERROR_CODE_OK != m_envPool.open()) {
+        AS_LOG(AS_LOG_ERROR,"ASRtspGuardManager::open,open the rtsp env pool fail.");
+        return AS_ERROR_CODE_FAIL;
     }
 
-    for(i = 0;i < RTSP_MANAGE_ENV_MAX_COUNT;i++) {
-        if( AS_ERROR_CODE_OK != as_create_thread((AS_THREAD_FUNC)rtsp_env_invoke,
-                                                 this,&m_ThreadHandle[i],AS_DEFAULT_STACK_SIZE)) {
-            AS_LOG(AS_LOG_ERROR,"ASRtspGuardManager::open,create the rtsp server thread fail.");
+    /* start the threads asking the live url */
+    for(u_int32_t i = 0; i < m_ulResolveThreadCount; i++) {
+        if (AS_ERROR_CODE_OK != as_create_thread((AS_THREAD_FUNC)resolve_invoke,
+            this, &m_ResolveThreads[i], AS_DEFAULT_STACK_SIZE)) {
+            AS_LOG(AS_LOG_ERROR,"ASRtspGuardManager::open,create the resolve thread:[%d] fail.",i);
             return AS_ERROR_CODE_FAIL;
         }
-
     }
 
     /* start check task thread */
@@ -1378,55 +1929,166 @@ void ASRtspGuardManager::close()
     AS_LOG(AS_LOG_DEBUG,"ASRtspGuardManager::close.");
     m_LoopWatchVar = 1;
 
+    /* the check thread posts to the env pool,stop it first */
+    if(NULL != m_CheckThreadHandle) {
+        as_set_event(m_checkEvent);
+        as_join_thread(m_CheckThreadHandle);
+        m_CheckThreadHandle = NULL;
+    }
+    for(u_int32_t i = 0; i < RTSP_CHECK_RESOLVE_THREAD_MAX; i++) {
+        if(NULL == m_ResolveThreads[i]) {
+            continue;
+        }
+        as_join_thread(m_ResolveThreads[i]);
+        m_ResolveThreads[i] = NULL;
+    }
+    /* the cached sdp holds the env,drop it before the env is reclaimed */
+    u_int32_t ulEnvCount = m_envPool.env_count();
+    for(u_int32_t i = 0; i < ulEnvCount; i++) {
+        (void)m_envPool.post(i,clear_describe_cache,NULL);
+    }
+    m_envPool.close();
+
     return;
 }
-AS_HANDLE ASRtspGuardManager::openURL(char const* rtspURL,ASRtspStatusObervser* observer)
+AS_HANDLE ASRtspGuardManager::openURL(char const* rtspURL,ASRtspStatusObervser* observer,
+                                      AS_RTSP_PROBE_MODE enProbeMode)
 {
     as_lock_guard locker(m_mutex);
-    UsageEnvironment* env = NULL;
-    u_int32_t index =  0;
-
+    ASRtspCheckHandle* pHandle = NULL;
 
-    index = find_beast_thread();
-    env = m_envArray[index];
-    AS_LOG(AS_LOG_INFO,"ASRtspGuardManager::openURL:[%s],envIndex:[%d].",rtspURL,index);
-
-    ASRtspCheckChannel* rtspClient = ASRtspCheckChannel::createNew(index,*env, rtspURL,
-                                    RTSP_CLIENT_VERBOSITY_LEVEL, RTSP_AGENT_NAME);
-    if (rtspClient == NULL) {
-        AS_LOG(AS_LOG_WARNING,"ASRtspGuardManager::openURL,create new client fail,url:[%s].",rtspURL);
+    pHandle = AS_NEW(pHandle);
+    if (NULL == pHandle) {
+        AS_LOG(AS_LOG_WARNING,"ASRtspGuardManager::openURL,create the handle fail,url:[%s].",rtspURL);
+        return NULL;
+    }
+    pHandle->m_strUrl     = rtspURL;
+    pHandle->m_pObserver  = observer;
+    pHandle->m_enProbeMode= enProbeMode;
+    pHandle->m_ulEnvIndex = find_beast_thread();
+    if (AS_ENV_POOL_INVALID_INDEX == pHandle->m_ulEnvIndex) {
+        AS_LOG(AS_LOG_WARNING,"ASRtspGuardManager::openURL,every env is full,url:[%s].",rtspURL);
+        AS_DELETE(pHandle);
         return NULL;
     }
+    AS_LOG(AS_LOG_INFO,"ASRtspGuardManager::openURL:[%s],envIndex:[%d].",rtspURL,pHandle->m_ulEnvIndex);
 
-    ASRtspCheckChannel* AsRtspClient = (ASRtspCheckChannel*)rtspClient;
-    if(AS_ERROR_CODE_OK != AsRtspClient->open(observer)) {
-        /* fail ,return 0*/
-        AS_LOG(AS_LOG_WARNING,"ASRtspGuardManager::openURL,open new client fail,url:[%s].",rtspURL);
-        Medium::close(AsRtspClient);
+    /* the client is created on its env thread,this thread does not wait for it */
+    if (AS_ERROR_CODE_OK != m_envPool.post(pHandle->m_ulEnvIndex,open_channel,pHandle)) {
+        AS_LOG(AS_LOG_WARNING,"ASRtspGuardManager::openURL,post the open fail,url:[%s].",rtspURL);
+        releas_env(pHandle->m_ulEnvIndex);
+        AS_DELETE(pHandle);
         return NULL;
     }
 
-    m_clCountArray[index]++;
     m_ulRtspHandlCount++;
 
     AS_LOG(AS_LOG_DEBUG,"ASRtspGuardManager::openURL end.");
-    return (AS_HANDLE)AsRtspClient;
+    return (AS_HANDLE)pHandle;
 }
 void      ASRtspGuardManager::closeURL(AS_HANDLE handle)
 {
     as_lock_guard locker(m_mutex);
-    ASRtspCheckChannel* pAsRtspClient = (ASRtspCheckChannel*)handle;
+    ASRtspCheckHandle* pHandle = (ASRtspCheckHandle*)handle;
 
-    u_int32_t index = pAsRtspClient->index();
-    m_clCountArray[index]--;
+    u_int32_t index = pHandle->m_ulEnvIndex;
     m_ulRtspHandlCount--;
-    pAsRtspClient->close();
+    if (AS_ERROR_CODE_OK != m_envPool.post(index,close_channel,pHandle,free_handle)) {
+        AS_LOG(AS_LOG_WARNING,"ASRtspGuardManager::closeURL,post the close fail,envIndex:[%d].",index);
+    }
     AS_LOG(AS_LOG_DEBUG,"ASRtspGuardManager::closeURL,envIndex:[%d].",index);
 }
+void ASRtspGuardManager::clear_describe_cache(UsageEnvironment& env,void* pArg)
+{
+    RTSPClient::invalidateDescribeCache(env);
+}
+void ASRtspGuardManager::open_channel(UsageEnvironment& env,void* pArg)
+{
+    ASRtspCheckHandle* pHandle = (ASRtspCheckHandle*)pArg;
+    pHandle->m_pEnv = &env;
+
+    ASRtspCheckChannel* rtspClient = ASRtspCheckChannel::createNew(pHandle->m_ulEnvIndex,env,
+                                    pHandle->m_strUrl.c_str(),RTSP_CLIENT_VERBOSITY_LEVEL, RTSP_AGENT_NAME);
+    if (rtspClient == NULL) {
+        AS_LOG(AS_LOG_WARNING,"ASRtspGuardManager::open_channel,create new client fail,url:[%s].",
+                              pHandle->m_strUrl.c_str());
+        pHandle->NotifyStatus(AS_RTSP_STATUS_RELEASE);
+        pHandle->NotifyRecvData(AS_RTSP_CHECK_RESULT_OPEN_URL,0,0,0);
+        return;
+    }
+
+    if(AS_ERROR_CODE_OK != rtspClient->open(pHandle,pHandle->m_enProbeMode)) {
+        /* fail,report it as a released channel like the teardown does */
+        AS_LOG(AS_LOG_WARNING,"ASRtspGuardManager::open_channel,open new client fail,url:[%s].",
+                              pHandle->m_strUrl.c_str());
+        Medium::close(rtspClient);
+        pHandle->NotifyStatus(AS_RTSP_STATUS_RELEASE);
+        pHandle->NotifyRecvData(AS_RTSP_CHECK_RESULT_OPEN_URL,0,0,0);
+        return;
+    }
+    pHandle->m_pChannel = rtspClient;
+}
+void ASRtspGuardManager::close_channel(UsageEnvironment& env,void* pArg)
+{
+    ASRtspCheckHandle* pHandle = (ASRtspCheckHandle*)pArg;
+
+    ASRtspGuardManager::instance().releas_env(pHandle->m_ulEnvIndex);
+
+    /* the last command of the handle,a released channel is gone already */
+    if (NULL == pHandle->m_pChannel) {
+        AS_DELETE(pHandle);
+        return;
+    }
+    /* the channel still reports its release to the handle,free it after that */
+    pHandle->m_bClosed = true;
+    pHandle->m_pChannel->close();
+}
+void ASRtspGuardManager::free_handle(void* pArg)
+{
+    /* the close is dropped by the stopped env,nothing reports to the handle any more */
+    ASRtspCheckHandle* pHandle = (ASRtspCheckHandle*)pArg;
+    AS_DELETE(pHandle);
+}
+void ASRtspCheckHandle::NotifyStatus(AS_RTSP_STATUS status)
+{
+    if (AS_RTSP_STATUS_RELEASE == status) {
+        /* the channel closes itself after this report */
+        m_pChannel = NULL;
+        m_enStatus = AS_RTSP_STATUS_RELEASE;
+        if (m_bClosed) {
+            m_pEnv->taskScheduler().scheduleDelayedTask(0,free_handle,this);
+        }
+    }
+    if (NULL != m_pObserver) {
+        m_pObserver->NotifyStatus(status);
+    }
+}
+void ASRtspCheckHandle::free_handle(void* clientData)
+{
+    ASRtspCheckHandle* pHandle = (ASRtspCheckHandle*)clientData;
+    AS_DELETE(pHandle);
+}
+void ASRtspCheckHandle::NotifyRecvData(AS_RTSP_CHECK_RESULT enResult,uint32_t ulDuration,
+                                       uint64_t ulVideoRecv,uint64_t ulAudioRecv)
+{
+    if (NULL != m_pObserver) {
+        m_pObserver->NotifyRecvData(enResult,ulDuration,ulVideoRecv,ulAudioRecv);
+    }
+}
+void ASRtspCheckHandle::NotifyProbeData(const AS_RTSP_PROBE_METRICS& stMetrics)
+{
+    if (NULL != m_pObserver) {
+        m_pObserver->NotifyProbeData(stMetrics);
+    }
+}
 AS_RTSP_STATUS  ASRtspGuardManager::getStatus(AS_HANDLE handle)
 {
     as_lock_guard locker(m_mutex);
-    ASRtspCheckChannel* pAsRtspClient = (ASRtspCheckChannel*)handle;
+    ASRtspCheckHandle*  pHandle = (ASRtspCheckHandle*)handle;
+    ASRtspCheckChannel* pAsRtspClient = pHandle->m_pChannel;
+    if (NULL == pAsRtspClient) {
+        return pHandle->m_enStatus;
+    }
 
     return pAsRtspClient->getStatus();
 }
@@ -1448,6 +2110,9 @@ int32_t ASRtspGuardManager::read_system_conf()
         m_ulLogLM = atoi(strValue.c_str());
     }
 
+    /* rtsp event loop pool */
+    m_envPool.read_conf(config);
+
     /* http listen port */
     if(INI_SUCCESS == config.GetValue("LISTEN_PORT","ListenPort",strValue))
     {
@@ -1463,6 +2128,66 @@ int32_t ASRtspGuardManager::read_system_conf()
     {
         m_ulCheckDuration = (time_t)atoi(strValue.c_str());
     }
+
+    /* how far a check goes with the lens */
+    if(INI_SUCCESS == config.GetValue("CHECK_CFG","ProbeMode",strValue))
+    {
+        uint32_t ulMode = atoi(strValue.c_str());
+        if(AS_RTSP_PROBE_SAMPLE < ulMode)
+        {
+            AS_LOG(AS_LOG_WARNING,"ASRtspGuardManager::read_system_conf,the probe mode:[%d] is unknown.",ulMode);
+            ulMode = AS_RTSP_PROBE_FULL;
+        }
+        m_enProbeMode = (AS_RTSP_PROBE_MODE)ulMode;
+    }
+    if(INI_SUCCESS == config.GetValue("CHECK_CFG","ProbeSampleTime",strValue))
+    {
+        m_ulProbeSampleTime = atoi(strValue.c_str());
+    }
+    if(0 == m_ulProbeSampleTime)
+    {
+        m_ulProbeSampleTime = RTSP_CHECK_PROBE_SAMPLE_DEFAULT;
+    }
+
+    /* the fast start of the checks */
+    if(INI_SUCCESS == config.GetValue("CHECK_CFG","FastStart",strValue))
+    {
+        m_ulFastStart = atoi(strValue.c_str());
+    }
+    if(INI_SUCCESS == config.GetValue("CHECK_CFG","DescribeCacheTTL",strValue))
+    {
+        m_ulDescribeCacheTTL = atoi(strValue.c_str());
+    }
+
+    /* the check budgets per event loop and per target host */
+    if(INI_SUCCESS == config.GetValue("CHECK_CFG","EnvMaxCheckCount",strValue))
+    {
+        m_ulEnvMaxCheck = atoi(strValue.c_str());
+    }
+    if(INI_SUCCESS == config.GetValue("CHECK_CFG","EnvCheckRate",strValue))
+    {
+        m_ulEnvCheckRate = atoi(strValue.c_str());
+    }
+    if(INI_SUCCESS == config.GetValue("CHECK_CFG","HostMaxCheckCount",strValue))
+    {
+        m_ulHostMaxCheck = atoi(strValue.c_str());
+    }
+    if(INI_SUCCESS == config.GetValue("CHECK_CFG","HostCheckRate",strValue))
+    {
+        m_ulHostCheckRate = atoi(strValue.c_str());
+    }
+    if(INI_SUCCESS == config.GetValue("CHECK_CFG","ResolveThreadCount",strValue))
+    {
+        m_ulResolveThreadCount = atoi(strValue.c_str());
+    }
+    if(0 == m_ulResolveThreadCount)
+    {
+        m_ulResolveThreadCount = RTSP_CHECK_RESOLVE_THREAD_DEFAULT;
+    }
+    else if(RTSP_CHECK_RESOLVE_THREAD_MAX < m_ulResolveThreadCount)
+    {
+        m_ulResolveThreadCount = RTSP_CHECK_RESOLVE_THREAD_MAX;
+    }
     /* ACS AppID */
     if(INI_SUCCESS == config.GetValue("ACS_CFG","AppID",strValue))
     {
@@ -1509,16 +2234,17 @@ void *ASRtspGuardManager::http_env_invoke(void *arg)
     return NULL;
 }
 
-void *ASRtspGuardManager::rtsp_env_invoke(void *arg)
+void *ASRtspGuardManager::check_task_invoke(void *arg)
 {
     ASRtspGuardManager* manager = (ASRtspGuardManager*)(void*)arg;
-    manager->rtsp_env_thread();
+    manager->check_task_thread();
     return NULL;
 }
-void *ASRtspGuardManager::check_task_invoke(void *arg)
+
+void *ASRtspGuardManager::resolve_invoke(void *arg)
 {
     ASRtspGuardManager* manager = (ASRtspGuardManager*)(void*)arg;
-    manager->check_task_thread();
+    manager->resolve_thread();
     return NULL;
 }
 
@@ -1552,81 +2278,64 @@ void ASRtspGuardManager::http_env_thread()
     AS_LOG(AS_LOG_DEBUG,"ASRtspGuardManager::http_env_thread end.");
     return;
 }
-void ASRtspGuardManager::rtsp_env_thread()
+void ASRtspGuardManager::check_task_thread()
 {
-    u_int32_t index = thread_index();
-    AS_LOG(AS_LOG_DEBUG,"ASRtspGuardManager::rtsp_env_thread,index:[%d] begin.",index);
-
-    TaskScheduler* scheduler = NULL;
-    UsageEnvironment* env = NULL;
-
-
-    if(RTSP_MANAGE_ENV_MAX_COUNT <= index) {
-        return;
+    AS_LOG(AS_LOG_DEBUG,"ASRtspGuardManager::check_task_thread begin.");
+    while(0 == m_LoopWatchVar)
+    {
+        take_new_task();
+        take_done();
+        take_resolved();
+        start_waiting();
+        admit_check();
+        check_timeout();
+        sweep_host();
+
+        /* a post while the scheduler runs may not wake it,look before waiting */
+        if((NULL != m_pDoneHead) || (NULL != m_pResolvedHead)) {
+            continue;
+        }
+        (void)as_wait_event(m_checkEvent, GW_CHECK_SCHEDULE_WAIT);
     }
-#if AS_APP_OS == AS_OS_LINUX
-    scheduler = EpollTaskScheduler::createNew();
-#elif AS_APP_OS == AS_OS_WIN32
-    scheduler = BasicTaskScheduler::createNew();
-#endif
-
-    env = BasicUsageEnvironment::createNew(*scheduler);
-    m_envArray[index] = env;
-    m_clCountArray[index] = 0;
-
-
-    // All subsequent activity takes place within the event loop:
-    env->taskScheduler().doEventLoop(&m_LoopWatchVar);
-
-    // LOOP EXIST
-    env->reclaim();
-    env = NULL;
-    delete scheduler;
-    scheduler = NULL;
-    m_envArray[index] = NULL;
-    m_clCountArray[index] = 0;
-    AS_LOG(AS_LOG_ERROR,"ASRtspGuardManager::rtsp_env_thread,index:[%d] end.",index);
-    return;
+    AS_LOG(AS_LOG_ERROR,"ASRtspGuardManager::check_task_thread end.");
 }
 
-void ASRtspGuardManager::check_task_thread()
+void ASRtspGuardManager::resolve_thread()
 {
-    AS_LOG(AS_LOG_DEBUG,"ASRtspGuardManager::check_task_thread begin.");
+    AS_LOG(AS_LOG_DEBUG,"ASRtspGuardManager::resolve_thread begin.");
+    ASLensInfo* pLens = NULL;
     while(0 == m_LoopWatchVar)
     {
-        as_sleep(GW_TIMER_CHECK_TASK);
-        check_task_status();
+        pLens = NULL;
+        {
+            as_lock_guard locker(m_resolveMutex);
+            if(!m_ResolveList.empty()) {
+                pLens = m_ResolveList.front();
+                m_ResolveList.pop_front();
+            }
+        }
+        if(NULL == pLens) {
+            (void)as_wait_event(m_resolveEvent, GW_CHECK_SCHEDULE_WAIT);
+            continue;
+        }
+        (void)pLens->ResolveRtspUrl();
+        post_resolved(pLens);
     }
-    AS_LOG(AS_LOG_ERROR,"ASRtspGuardManager::check_task_thread end.");
+    AS_LOG(AS_LOG_DEBUG,"ASRtspGuardManager::resolve_thread end.");
 }
 
 
 u_int32_t ASRtspGuardManager::find_beast_thread()
 {
-    as_lock_guard locker(m_mutex);
-    u_int32_t index = 0;
-    u_int32_t count = 0xFFFFFFFF;
-    for(u_int32_t i = 0; i < RTSP_MANAGE_ENV_MAX_COUNT;i++) {
-        if(count > m_clCountArray[i]) {
-            index = i;
-            count = m_clCountArray[i];
-        }
-    }
-    return index;
+    return m_envPool.alloc_env(m_ulEnvMaxCheck);
 }
 UsageEnvironment* ASRtspGuardManager::get_env(u_int32_t index)
 {
-    UsageEnvironment* env = m_envArray[index];
-    m_clCountArray[index]++;
-    return env;
+    return m_envPool.get_env(index);
 }
 void ASRtspGuardManager::releas_env(u_int32_t index)
 {
-    if (0 == m_clCountArray[index])
-    {
-        return;
-    }
-    m_clCountArray[index]--;
+    m_envPool.release_env(index);
 }
 
 
@@ -1804,6 +2513,20 @@ int32_t ASRtspGuardManager::handle_check_task(const XMLElement *check)
 
     task->setTaskInfo(strCheckID,strReportURL);
 
+    const char* priority = check->Attribute("priority");
+    if(NULL != priority)
+    {
+        task->setPriority(atoi(priority));
+    }
+
+    /* the probe mode of the task,the configured one by default */
+    task->setProbeMode(m_enProbeMode);
+    const char* probe = check->Attribute("probe");
+    if((NULL != probe) && (AS_RTSP_PROBE_SAMPLE >= (uint32_t)atoi(probe)))
+    {
+        task->setProbeMode((AS_RTSP_PROBE_MODE)atoi(probe));
+    }
+
 
     const XMLElement *camera = CameraList->FirstChildElement("camera");
 
@@ -1833,40 +2556,367 @@ int32_t ASRtspGuardManager::handle_check_task(const XMLElement *check)
     AS_LOG(AS_LOG_INFO, "ASRtspGuardManager::handle_check_task,CheckID:[%s],camera count:[%d].",
         strCheckID.c_str(), count);
 
-    as_lock_guard locker(m_mutex);
-    m_TaskList.push_back(task);
-
-    AS_LOG(AS_LOG_INFO, "ASRtspGuardManager::handle_check_task,current task count:[%d].",
-        m_TaskList.size());
+    {
+        as_lock_guard locker(m_mutex);
+        m_TaskList.push_back(task);
+    }
+    as_set_event(m_checkEvent);
 
     AS_LOG(AS_LOG_DEBUG, "ASRtspGuardManager::handle_check_task,end");
     return AS_ERROR_CODE_OK;
 }
 
-void  ASRtspGuardManager::check_task_status()
+/* the token bucket of check starts,a second of burst */
+static void check_rate_init(ASCHECKRATE& stRate,uint32_t ulRate,uint32_t ulNow)
 {
-    ASRtspCheckTask* task     = NULL;
+    stRate.ulRate   = ulRate;
+    stRate.ulTokens = ulRate*1000;
+    stRate.ulLastMs = ulNow;
+}
 
-    as_lock_guard locker(m_mutex);
-    AS_LOG(AS_LOG_INFO, "ASRtspGuardManager::check_task_status,size:[%d] begin.",m_TaskList.size());
-    ASCHECKTASKLISTITER iter = m_TaskList.begin();
-    for(; iter != m_TaskList.end();)
+static bool check_rate_ready(ASCHECKRATE& stRate,uint32_t ulNow)
+{
+    if(0 == stRate.ulRate) {
+        return true;
+    }
+    uint32_t ulElapsed = ulNow - stRate.ulLastMs;
+    stRate.ulLastMs = ulNow;
+    if(1000 < ulElapsed) {
+        ulElapsed = 1000;
+    }
+    stRate.ulTokens += ulElapsed*stRate.ulRate;
+    if(stRate.ulTokens > stRate.ulRate*1000) {
+        stRate.ulTokens = stRate.ulRate*1000;
+    }
+    return (1000 <= stRate.ulTokens);
+}
+
+static void check_rate_take(ASCHECKRATE& stRate)
+{
+    if((0 != stRate.ulRate) && (1000 <= stRate.ulTokens)) {
+        stRate.ulTokens -= 1000;
+    }
+}
+
+/* push a lens to a lock-free post list,from any thread */
+static void check_post(ASLensInfo* volatile* ppHead,ASLensInfo* pLens)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    ASLensInfo* pHead = NULL;
+    do
     {
-        task = *iter;
-        task->checkTask();
-        AS_LOG(AS_LOG_INFO, "ASRtspGuardManager::check_task_status,task status:[%d].",task->TaskStatus());
+        pHead = *ppHead;
+        pLens->m_pNextPost = pHead;
+    } while (InterlockedCompareExchangePointer((PVOID volatile *)ppHead,
+                                               pLens, pHead) != pHead);
+#else
+    ASLensInfo* pHead = __atomic_load_n(ppHead, __ATOMIC_RELAXED);
+    do
+    {
+        pLens->m_pNextPost = pHead;
+    } while (!__atomic_compare_exchange_n(ppHead, &pHead, pLens, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#endif
+}
+
+void ASRtspGuardManager::post_resolved(ASLensInfo* pLens)
+{
+    check_post(&m_pResolvedHead,pLens);
+    as_set_event(m_checkEvent);
+}
+
+void ASRtspGuardManager::post_done(ASLensInfo* pLens)
+{
+    check_post(&m_pDoneHead,pLens);
+    as_set_event(m_checkEvent);
+}
+
+/* take all the posted lenses,the oldest first */
+ASLensInfo* ASRtspGuardManager::take_post(ASLensInfo* volatile* ppHead)
+{
+#if AS_APP_OS == AS_OS_WIN32
+    ASLensInfo* pLens = (ASLensInfo*)InterlockedExchangePointer((PVOID volatile *)ppHead, NULL);
+#else
+    ASLensInfo* pLens = __atomic_exchange_n(ppHead, (ASLensInfo*)NULL, __ATOMIC_ACQUIRE);
+#endif
+    ASLensInfo* pFirst = NULL;
+    ASLensInfo* pNext  = NULL;
+    while(NULL != pLens) {
+        pNext = pLens->m_pNextPost;
+        pLens->m_pNextPost = pFirst;
+        pFirst = pLens;
+        pLens  = pNext;
+    }
+    return pFirst;
+}
 
-        if(AS_RTSP_CHECK_STATUS_END == task->TaskStatus())
+void ASRtspGuardManager::take_new_task()
+{
+    ASCHECKTASKLIST  newList;
+    ASRtspCheckTask* task = NULL;
+    ASCHECKENTRY     entry;
+
+    {
+        as_lock_guard locker(m_mutex);
+        if(m_TaskList.empty()) {
+            return;
+        }
+        newList.splice(newList.end(),m_TaskList);
+    }
+
+    ASCHECKTASKLISTITER iter = newList.begin();
+    for(; iter != newList.end(); ++iter)
+    {
+        task = *iter;
+        if(0 == task->getLensCount())
         {
-            iter = m_TaskList.erase(iter);
+            task->ReportTaskStatus();
             AS_DELETE(task);
+            continue;
+        }
+        m_RunTaskList.push_back(task);
+
+        entry.ulPriority = task->getPriority();
+        LENSINFOLIST& lensList = task->getLensList();
+        LENSINFOLISTITRT lensIter = lensList.begin();
+        for(; lensIter != lensList.end(); ++lensIter)
+        {
+            entry.ullSeq = m_ullCheckSeq++;
+            entry.pLens  = *lensIter;
+            m_CheckQueue.push(entry);
+        }
+        AS_LOG(AS_LOG_INFO, "ASRtspGuardManager::take_new_task,lens count:[%d],priority:[%d],queued:[%d].",
+            task->getLensCount(),task->getPriority(),(uint32_t)m_CheckQueue.size());
+    }
+}
+
+void ASRtspGuardManager::take_resolved()
+{
+    ASLensInfo* pLens = take_post(&m_pResolvedHead);
+    ASLensInfo* pNext = NULL;
+    uint32_t    ulNow = as_get_cur_msecond();
+
+    for(; NULL != pLens; pLens = pNext)
+    {
+        pNext = pLens->m_pNextPost;
+        m_ulResolving--;
+        if(AS_RTSP_CHECK_RESULT_URL_FAIL == pLens->getResult())
+        {
+            finish_check(pLens);
+            continue;
+        }
+
+        ASCHECKHOSTMAPITER iter = m_HostMap.find(pLens->getHost());
+        if(iter == m_HostMap.end())
+        {
+            ASCHECKHOST stHost;
+            stHost.ulRunning = 0;
+            stHost.bWaiting  = false;
+            check_rate_init(stHost.stRate,m_ulHostCheckRate,ulNow);
+            iter = m_HostMap.insert(ASCHECKHOSTMAP::value_type(pLens->getHost(),stHost)).first;
+        }
+        ASCHECKHOST& host = iter->second;
+        host.WaitList.push_back(pLens);
+        m_ulWaiting++;
+        if(!host.bWaiting)
+        {
+            host.bWaiting = true;
+            m_HostWaitList.push_back(iter->first);
+        }
+    }
+}
+
+void ASRtspGuardManager::take_done()
+{
+    ASLensInfo* pLens = take_post(&m_pDoneHead);
+    ASLensInfo* pNext = NULL;
+
+    for(; NULL != pLens; pLens = pNext)
+    {
+        pNext = pLens->m_pNextPost;
+        ASCHECKHOSTMAPITER iter = m_HostMap.find(pLens->getHost());
+        if((iter != m_HostMap.end()) && (0 < iter->second.ulRunning))
+        {
+            iter->second.ulRunning--;
+        }
+        if(pLens->m_bRunning)
+        {
+            m_RunList.erase(pLens->m_RunIter);
+            pLens->m_bRunning = false;
+        }
+        m_ulRunning--;
+
+        /* the channel is released,the close frees the handle */
+        pLens->stopRtspCheck();
+        finish_check(pLens);
+    }
+}
+
+/*
+ * start the resolved lenses whose budgets allow it,one lens of each host
+ * in a pass so that a busy host does not hold back the others.
+ */
+void ASRtspGuardManager::start_waiting()
+{
+    uint32_t    ulNow   = as_get_cur_msecond();
+    bool        bStart  = true;
+    bool        bBlock  = false;
+    ASLensInfo* pLens   = NULL;
+
+    m_stEnvRate.ulRate = m_ulEnvCheckRate*m_envPool.env_count();
+
+    while(bStart && !bBlock)
+    {
+        bStart = false;
+        ASCHECKHOSTLISTITER iter = m_HostWaitList.begin();
+        while(iter != m_HostWaitList.end())
+        {
+            /* the budgets of all the hosts */
+            if((m_ulMaxCheckCount <= m_ulRunning)
+                || !check_rate_ready(m_stEnvRate,ulNow)
+                || !m_envPool.has_room(m_ulEnvMaxCheck))
+            {
+                bBlock = true;
+                break;
+            }
+
+            ASCHECKHOST& host = m_HostMap[*iter];
+            if(((0 == m_ulHostMaxCheck) || (host.ulRunning < m_ulHostMaxCheck))
+                && check_rate_ready(host.stRate,ulNow))
+            {
+                pLens = host.WaitList.front();
+                host.WaitList.pop_front();
+                m_ulWaiting--;
+                check_rate_take(m_stEnvRate);
+                check_rate_take(host.stRate);
+                start_check(pLens,host);
+                bStart = true;
+            }
+
+            if(host.WaitList.empty())
+            {
+                host.bWaiting = false;
+                iter = m_HostWaitList.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+}
+
+void ASRtspGuardManager::start_check(ASLensInfo* pLens,ASCHECKHOST& host)
+{
+    if(AS_ERROR_CODE_OK != pLens->StartRtspCheck())
+    {
+        finish_check(pLens);
+        return;
+    }
+    host.ulRunning++;
+    m_ulRunning++;
+    pLens->m_RunIter  = m_RunList.insert(m_RunList.end(),pLens);
+    pLens->m_bRunning = true;
+}
+
+/* hand the queued lenses to the resolve threads while the slots allow */
+void ASRtspGuardManager::admit_check()
+{
+    LENSINFOLIST admitList;
+    uint32_t     ulAdmit = 0;
+
+    while(!m_CheckQueue.empty()
+        && ((m_ulResolving + m_ulRunning) < m_ulMaxCheckCount)
+        && (m_ulWaiting < m_ulMaxCheckCount))
+    {
+        admitList.push_back(m_CheckQueue.top().pLens);
+        m_CheckQueue.pop();
+        m_ulResolving++;
+        ulAdmit++;
+    }
+    if(0 == ulAdmit)
+    {
+        return;
+    }
+
+    {
+        as_lock_guard locker(m_resolveMutex);
+        m_ResolveList.splice(m_ResolveList.end(),admitList);
+    }
+    for(uint32_t i = 0; (i < ulAdmit) && (i < m_ulResolveThreadCount); i++)
+    {
+        as_set_event(m_resolveEvent);
+    }
+    AS_LOG(AS_LOG_DEBUG, "ASRtspGuardManager::admit_check,admit:[%d],queued:[%d].",
+        ulAdmit,(uint32_t)m_CheckQueue.size());
+}
+
+/* the channel ends the check by itself,close the ones not reported in time */
+void ASRtspGuardManager::check_timeout()
+{
+    time_t      cur   = time(NULL);
+    time_t      limit = m_ulCheckDuration + RTSP_CHECK_REPORT_GRACE;
+    ASLensInfo* pLens = NULL;
+
+    while(!m_RunList.empty())
+    {
+        pLens = m_RunList.front();
+        if(cur <= (pLens->getStartTime() + limit))
+        {
+            break;
+        }
+        AS_LOG(AS_LOG_WARNING, "ASRtspGuardManager::check_timeout,the lens:[%s] is not reported,close it.",
+            pLens->getCameraID().c_str());
+        m_RunList.pop_front();
+        pLens->m_bRunning = false;
+        pLens->stopRtspCheck();
+    }
+}
+
+/* drop the idle hosts and report the scheduler state */
+void ASRtspGuardManager::sweep_host()
+{
+    uint32_t ulNow = as_get_cur_msecond();
+    if((ulNow - m_ulLastSweep) < GW_TIMER_CHECK_TASK)
+    {
+        return;
+    }
+    m_ulLastSweep = ulNow;
+
+    ASCHECKHOSTMAPITER iter = m_HostMap.begin();
+    while(iter != m_HostMap.end())
+    {
+        ASCHECKHOST& host = iter->second;
+        (void)check_rate_ready(host.stRate,ulNow);
+        if((0 == host.ulRunning) && !host.bWaiting
+            && (host.stRate.ulTokens >= host.stRate.ulRate*1000))
+        {
+            m_HostMap.erase(iter++);
         }
         else
         {
             ++iter;
         }
     }
-    AS_LOG(AS_LOG_DEBUG, "ASRtspGuardManager::check_task_status,end");
+
+    AS_LOG(AS_LOG_INFO, "ASRtspGuardManager::sweep_host,tasks:[%d],queued:[%d],resolving:[%d],"
+        "waiting:[%d],running:[%d],hosts:[%d].",(uint32_t)m_RunTaskList.size(),
+        (uint32_t)m_CheckQueue.size(),m_ulResolving,m_ulWaiting,m_ulRunning,(uint32_t)m_HostMap.size());
+}
+
+void ASRtspGuardManager::finish_check(ASLensInfo* pLens)
+{
+    pLens->setStatus(AS_RTSP_CHECK_STATUS_END);
+    ASRtspCheckTask* task = pLens->getTask();
+    if(!task->finishLens())
+    {
+        return;
+    }
+
+    /* report the task info to the server,and end the task */
+    task->ReportTaskStatus();
+    m_RunTaskList.remove(task);
+    AS_DELETE(task);
 }
 
 
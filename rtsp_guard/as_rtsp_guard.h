@@ -36,6 +36,8 @@ extern "C"{
 #endif
 #include <list>
 #include <map>
+#include <queue>
+#include <vector>
 #include "as_def.h"
 #include "as.h"
 
@@ -79,6 +81,8 @@ extern "C"{
 
 #define GW_TIMER_SCALE                 1000
 #define GW_TIMER_CHECK_TASK            5000
+/* the check scheduler and the resolve threads wake up at least this often(ms) */
+#define GW_CHECK_SCHEDULE_WAIT         100
 
 
 
@@ -101,8 +105,31 @@ extern "C"{
 
 #define RTSP_CLINET_HANDLE_MAX    1000
 
+/* the check budgets of [CHECK_CFG],0:no limit */
+#define RTSP_CHECK_ENV_MAX_DEFAULT     0   /* running checks per event loop */
+#define RTSP_CHECK_ENV_RATE_DEFAULT    50  /* check starts per second per event loop */
+#define RTSP_CHECK_HOST_MAX_DEFAULT    0   /* running checks per target host */
+#define RTSP_CHECK_HOST_RATE_DEFAULT   0   /* check starts per second per target host */
+
+/* the threads asking the live url of the lens */
+#define RTSP_CHECK_RESOLVE_THREAD_DEFAULT 8
+#define RTSP_CHECK_RESOLVE_THREAD_MAX     64
+
+/* a channel not reported this long(s) after the check duration is closed */
+#define RTSP_CHECK_REPORT_GRACE   (2*GW_TIMER_CHECK_TASK/1000)
+
 #define RTSP_CLINET_RUN_DURATION  60
 
+/* the seconds of media a sample probe looks at */
+#define RTSP_CHECK_PROBE_SAMPLE_DEFAULT 2
+
+/*
+ * a probe keeps the head of each rtp packet only,the rest of a larger packet
+ * is read over the bytes behind the head and dropped.
+ */
+#define RTSP_PROBE_PACKET_SIZE    2048
+#define RTSP_PROBE_HEAD_SIZE      256
+
 #define RTSP_CHECK_TMP_BUF_SIZE   256
 
 
@@ -131,8 +158,6 @@ extern "C"{
 // If you don't want to see debugging output for each received frame, then comment out the following line:
 #define DEBUG_PRINT_EACH_RECEIVED_FRAME 1
 
-#define RTSP_MANAGE_ENV_MAX_COUNT       4
-
 #define RTSP_AGENT_NAME                 "all stream media"
 
 enum AS_RTSP_CHECK_RESULT
@@ -143,6 +168,26 @@ enum AS_RTSP_CHECK_RESULT
     AS_RTSP_CHECK_RESULT_RECV_DATA  = 3, /* recv video data fail */
 };
 
+/* how far a check goes with the lens */
+enum AS_RTSP_PROBE_MODE
+{
+    AS_RTSP_PROBE_FULL      = 0, /* play the check duration and count the media bytes */
+    AS_RTSP_PROBE_DESCRIBE  = 1, /* a right answer of DESCRIBE is enough */
+    AS_RTSP_PROBE_KEYFRAME  = 2, /* play the video until the first key frame */
+    AS_RTSP_PROBE_SAMPLE    = 3, /* play the video for the sample time,rtp headers only */
+};
+
+/* what a check learned of the video stream,0 if it is not known */
+typedef struct tagASRtspProbeMetrics
+{
+    uint32_t ulFirstPacketMs;   /* the check start -> the first video packet */
+    uint32_t ulKeyFrameMs;      /* the check start -> the first key frame,probes only */
+    uint32_t ulPackets;         /* the video packets received */
+    uint32_t ulLost;            /* the sequence numbers missed */
+    uint32_t ulJitterUs;        /* the inter-arrival jitter of rfc 3550 */
+    uint32_t ulMaxGapMs;        /* the longest time between two packets */
+} AS_RTSP_PROBE_METRICS;
+
 
 // Define a class to hold per-stream state that we maintain throughout each stream's lifetime:
 enum AS_RTSP_STATUS {
@@ -163,6 +208,79 @@ public:
     virtual void NotifyStatus(AS_RTSP_STATUS status) = 0;
     virtual void NotifyRecvData(AS_RTSP_CHECK_RESULT enResult,uint32_t ulDuration,
                                 uint64_t ulVideoRecv,uint64_t ulAudioRecv) = 0;
+    /* comes before NotifyRecvData(),which is the last report of a channel */
+    virtual void NotifyProbeData(const AS_RTSP_PROBE_METRICS& stMetrics){};
+};
+
+/*
+ * the rtp source of a probe,no sink reads it and no payload is kept:it reads
+ * each packet into a small buffer,feeds the rtp header to the reception stats
+ * (sequence gaps,jitter,the RTCP receiver reports) and looks at the head of
+ * the payload for a key frame.
+ */
+class ASRtspProbeSource: public RTPSource {
+public:
+    static ASRtspProbeSource* createNew(UsageEnvironment& env, Groupsock* RTPgs,
+                                        unsigned char rtpPayloadFormat,
+                                        unsigned rtpTimestampFrequency,
+                                        char const* codecName);
+    // start reading the packets,the handler is called once at the first key frame:
+    void     startProbe(TaskFunc* keyFrameHandler, void* clientData);
+    uint32_t getPackets(){return m_ulPackets;};
+    uint64_t getRecvSize(){return m_ulRecvSize;};
+    Boolean  hasKeyFrame(){return m_bKeyFrame;};
+    struct timeval const& firstPacketTime(){return m_stFirstPacket;};
+    struct timeval const& keyFrameTime(){return m_stKeyFrame;};
+protected:
+    ASRtspProbeSource(UsageEnvironment& env, Groupsock* RTPgs,
+                      unsigned char rtpPayloadFormat,
+                      unsigned rtpTimestampFrequency,
+                      char const* codecName);
+    // called only by createNew()
+    virtual ~ASRtspProbeSource();
+private:
+    // redefined virtual functions:
+    virtual void doGetNextFrame();
+    virtual void doStopGettingFrames();
+    virtual void setPacketReorderingThresholdTime(unsigned uSeconds);
+private:
+    static void networkReadHandler(ASRtspProbeSource* source, int mask);
+    void    readPacket();
+    void    handlePacket(struct sockaddr_in& fromAddress);
+    Boolean isKeyFrame(u_int8_t const* payload, unsigned size);
+private:
+    u_int8_t  m_szPacket[RTSP_PROBE_PACKET_SIZE];
+    unsigned  m_ulPacketSize;   /* the bytes of the packet read so far */
+    unsigned  m_ulBufSize;      /* the bytes of them kept in the buffer */
+    Boolean   m_bReading;
+    Boolean   m_bH264;
+    Boolean   m_bH265;
+    TaskFunc *m_pKeyFrameHandler;
+    void     *m_pKeyFrameData;
+    uint32_t  m_ulPackets;
+    uint64_t  m_ulRecvSize;
+    Boolean   m_bKeyFrame;
+    struct timeval m_stFirstPacket;
+    struct timeval m_stKeyFrame;
+};
+
+// the session of a probe,its rtp subsessions read by ASRtspProbeSource:
+class ASRtspProbeSession: public MediaSession {
+public:
+    static ASRtspProbeSession* createNew(UsageEnvironment& env, char const* sdpDescription);
+protected:
+    ASRtspProbeSession(UsageEnvironment& env);
+    // called only by createNew()
+    virtual ~ASRtspProbeSession();
+    virtual MediaSubsession* createNewMediaSubsession();
+};
+
+class ASRtspProbeSubsession: public MediaSubsession {
+protected:
+    friend class ASRtspProbeSession;
+    ASRtspProbeSubsession(MediaSession& parent);
+    virtual ~ASRtspProbeSubsession();
+    virtual Boolean createSourceObjects(int useSpecialRTPoffset);
 };
 
 
@@ -195,7 +313,7 @@ protected:
     // called only by createNew();
     virtual ~ASRtspCheckChannel();
 public:
-    int32_t open(ASRtspStatusObervser* observer);
+    int32_t open(ASRtspStatusObervser* observer,AS_RTSP_PROBE_MODE enProbeMode = AS_RTSP_PROBE_FULL);
     void    close();
     u_int32_t index(){return m_ulEnvIndex;};
     AS_RTSP_STATUS  getStatus(){return m_enStatus;};
@@ -212,8 +330,24 @@ public:
     void    handle_after_timeout();
     // Used to iterate through each stream's 'subsessions', setting up each one:
     void    setupNextSubsession();
+    // fast start:the SETUPs of all the subsessions and the PLAY go out at once
+    void    setupAllSubsessions();
+    // the subsession the next SETUP answer is for,when they went out at once
+    MediaSubsession* nextSetupSubsession();
+    Boolean initSubsession(MediaSubsession* subsession);
+    void    sendPlay();
+    // a stale cached SDP,start over once with a real DESCRIBE
+    Boolean redescribe(int resultCode);
     // Used to shut down and close a stream (including its "RTSPClient" object):
     void    shutdownStream();
+    // end the check on the next pass of the loop,the result is reported then:
+    void    scheduleShutdown();
+    // arm the stream timer,it fires no later than the end of the check:
+    void    scheduleTimer();
+    // the first key frame of a probe:
+    void    handle_probe_keyframe();
+    // the video metrics of the check,from the rtp source:
+    void    collectMetrics(AS_RTSP_PROBE_METRICS& stMetrics,uint64_t& ulVideoRecv);
 public:
     // RTSP 'response handlers':
     static void continueAfterOPTIONS(RTSPClient* rtspClient, int resultCode, char* resultString);
@@ -227,6 +361,8 @@ public:
     static void subsessionAfterPlaying(void* clientData); // called when a stream's subsession (e.g., audio or video substream) ends
     static void subsessionByeHandler(void* clientData); // called when a RTCP "BYE" is received for a subsession
     static void streamTimerHandler(void* clientData);
+    static void probeKeyFrameHandler(void* clientData);
+    static void probeByeHandler(void* clientData);
 
 public:
     ASRtspCheckStreamState   scs;
@@ -237,7 +373,16 @@ private:
     ASRtspStatusObervser *m_bObervser;
     volatile Boolean      m_bStop;
     time_t                m_ulStartTime;
+    /* the check ends at this time,a sample probe moves it up at PLAY */
+    time_t                m_ulEndTime;
+    struct timeval        m_stStartTime;
     AS_RTSP_CHECK_RESULT  m_enCheckResult;
+    AS_RTSP_PROBE_MODE    m_enProbeMode;
+    /* the only subsession a probe sets up,the video one if any */
+    MediaSubsession      *m_pProbeSubsession;
+    /* skip the OPTIONS and pipeline the SETUPs and the PLAY */
+    Boolean               m_bFastStart;
+    Boolean               m_bRedescribed;
 };
 
 // Define a data sink (a subclass of "MediaSink") to receive the data for each subsession (i.e., each audio or video 'substream').
@@ -307,28 +452,57 @@ typedef enum AS_RTSP_CHECK_STATUS
     AS_RTSP_CHECK_STATUS_END    = 2
 }CHECK_STATUS;
 
+class ASLensInfo;
+class ASRtspCheckTask;
+
+typedef std::list<ASLensInfo*>    LENSINFOLIST;
+typedef LENSINFOLIST::iterator    LENSINFOLISTITRT;
+
+/*
+ * one lens of a check task,it is moved through the stages by the check
+ * scheduler:queued -> resolving(the live url) -> waiting for its host ->
+ * running -> end.the channel reports the result by NotifyRecvData(),the
+ * lens posts itself back to the scheduler then.
+ */
 class ASLensInfo:public ASRtspStatusObervser
 {
 public:
     ASLensInfo();
     virtual ~ASLensInfo();
     void setLensInfo(std::string& strCameraID,std::string& strStreamType);
-    void check();
+    void setTask(ASRtspCheckTask* pTask){m_pTask = pTask;};
+    ASRtspCheckTask* getTask(){return m_pTask;};
     CHECK_STATUS Status();
+    void setStatus(CHECK_STATUS enStatus){m_Status = enStatus;};
     std::string getCameraID(){return m_strCameraID;};
+    std::string& getHost(){return m_strHost;};
+    time_t      getStartTime(){return m_time;};
     AS_RTSP_CHECK_RESULT    getResult(){return m_enCheckResult;};
     uint32_t    getDuration(){return m_ulDuration;};
     uint64_t    getVideoRecv(){return m_ulVideoRecv;};
     uint64_t    getAudioRecv(){return m_ulAudioRecv;};
+    const AS_RTSP_PROBE_METRICS& getMetrics(){return m_stMetrics;};
     virtual void NotifyStatus(AS_RTSP_STATUS status);
     virtual void NotifyRecvData(AS_RTSP_CHECK_RESULT enResult,uint32_t ulDuration,uint64_t ulVideoRecv,uint64_t ulAudioRecv);
+    virtual void NotifyProbeData(const AS_RTSP_PROBE_METRICS& stMetrics);
 
-private:
+    /* ask the live url,run on a resolve thread */
+    int32_t ResolveRtspUrl();
+    /* open and close the rtsp check,run on the check thread */
     int32_t StartRtspCheck();
     void    stopRtspCheck();
+public:
+    /* the link of the lock-free post lists of the scheduler */
+    ASLensInfo    *m_pNextPost;
+    /* the place in the running list,valid while m_bRunning */
+    LENSINFOLISTITRT m_RunIter;
+    bool           m_bRunning;
 private:
     std::string    m_strCameraID;
     std::string    m_strStreamType;
+    std::string    m_strRtspUrl;
+    std::string    m_strHost;
+    ASRtspCheckTask *m_pTask;
     AS_HANDLE      m_handle;
     CHECK_STATUS   m_Status;
     time_t         m_time;
@@ -336,28 +510,35 @@ private:
     uint32_t       m_ulDuration;
     uint64_t       m_ulVideoRecv;
     uint64_t       m_ulAudioRecv;
+    AS_RTSP_PROBE_METRICS m_stMetrics;
 };
 
-typedef std::list<ASLensInfo*>    LENSINFOLIST;
-typedef LENSINFOLIST::iterator    LENSINFOLISTITRT;
-
-
-
 class ASRtspCheckTask
 {
 public:
     ASRtspCheckTask();
     virtual ~ASRtspCheckTask();
     void setTaskInfo(std::string& strCheckID,std::string& strReportUrl);
+    /* the lenses of a higher priority task are started first */
+    void setPriority(uint32_t ulPriority){m_ulPriority = ulPriority;};
+    uint32_t getPriority(){return m_ulPriority;};
+    void setProbeMode(AS_RTSP_PROBE_MODE enMode){m_enProbeMode = enMode;};
+    AS_RTSP_PROBE_MODE getProbeMode(){return m_enProbeMode;};
     void addCamera(std::string& strCameraID,std::string& strStreamTye);
-    void checkTask();
+    LENSINFOLIST& getLensList(){return m_LensList;};
+    uint32_t getLensCount(){return m_ulLensCount;};
+    /* one more lens is checked,true if it is the last one */
+    bool finishLens();
     CHECK_STATUS TaskStatus();
-private:
     void ReportTaskStatus();
 private:
     std::string   m_strCheckID;
     std::string   m_strReportUrl;
     LENSINFOLIST  m_LensList;
+    uint32_t      m_ulLensCount;
+    uint32_t      m_ulDoneCount;
+    uint32_t      m_ulPriority;
+    AS_RTSP_PROBE_MODE m_enProbeMode;
     CHECK_STATUS  m_Status;
 };
 
@@ -366,6 +547,49 @@ private:
 typedef std::list<ASRtspCheckTask*>  ASCHECKTASKLIST;
 typedef ASCHECKTASKLIST::iterator    ASCHECKTASKLISTITER;
 
+/* a queued lens,the higher priority first,then the earlier one */
+typedef struct tagASCheckEntry
+{
+    uint32_t    ulPriority;
+    uint64_t    ullSeq;
+    ASLensInfo *pLens;
+} ASCHECKENTRY;
+
+struct ASCheckEntryLess
+{
+    bool operator()(const ASCHECKENTRY& left,const ASCHECKENTRY& right) const
+    {
+        if(left.ulPriority != right.ulPriority) {
+            return left.ulPriority < right.ulPriority;
+        }
+        return left.ullSeq > right.ullSeq;
+    }
+};
+
+typedef std::priority_queue<ASCHECKENTRY,std::vector<ASCHECKENTRY>,ASCheckEntryLess> ASCHECKQUEUE;
+
+/* a token bucket of check starts,ulRate starts per second(0:no limit),1s of burst */
+typedef struct tagASCheckRate
+{
+    uint32_t ulRate;
+    uint32_t ulTokens;  /* in 1/1000 start */
+    uint32_t ulLastMs;
+} ASCHECKRATE;
+
+/* the checks of one target host(host[:port] of the rtsp url) */
+typedef struct tagASCheckHost
+{
+    uint32_t     ulRunning;
+    ASCHECKRATE  stRate;
+    LENSINFOLIST WaitList;
+    bool         bWaiting;  /* in the host wait list of the scheduler */
+} ASCHECKHOST;
+
+typedef std::map<std::string,ASCHECKHOST> ASCHECKHOSTMAP;
+typedef ASCHECKHOSTMAP::iterator          ASCHECKHOSTMAPITER;
+typedef std::list<std::string>            ASCHECKHOSTLIST;
+typedef ASCHECKHOSTLIST::iterator         ASCHECKHOSTLISTITER;
+
 class ASEvLiveHttpClient
 {
 public:
@@ -394,6 +618,42 @@ private:
 
 
 
+/*
+ * the handle returned by openURL(),the channel is created,closed and released
+ * on the env m_ulEnvIndex,it reports to the handle,which forwards to the user.
+ */
+class ASRtspCheckHandle:public ASRtspStatusObervser
+{
+public:
+    ASRtspCheckHandle()
+    {
+        m_ulEnvIndex = 0;
+        m_pObserver  = NULL;
+        m_pChannel   = NULL;
+        m_pEnv       = NULL;
+        m_bClosed    = false;
+        m_enStatus   = AS_RTSP_STATUS_INIT;
+        m_enProbeMode= AS_RTSP_PROBE_FULL;
+    };
+    virtual ~ASRtspCheckHandle(){};
+    virtual void NotifyStatus(AS_RTSP_STATUS status);
+    virtual void NotifyRecvData(AS_RTSP_CHECK_RESULT enResult,uint32_t ulDuration,
+                                uint64_t ulVideoRecv,uint64_t ulAudioRecv);
+    virtual void NotifyProbeData(const AS_RTSP_PROBE_METRICS& stMetrics);
+    static void free_handle(void* clientData);
+public:
+    u_int32_t                    m_ulEnvIndex;
+    std::string                  m_strUrl;
+    ASRtspStatusObervser        *m_pObserver;
+    /* NULL until the channel is created,and after it is released */
+    ASRtspCheckChannel *volatile m_pChannel;
+    UsageEnvironment            *m_pEnv;
+    /* closeURL() is done,the handle goes with the channel */
+    bool                         m_bClosed;
+    volatile AS_RTSP_STATUS      m_enStatus;
+    AS_RTSP_PROBE_MODE           m_enProbeMode;
+};
+
 class ASRtspGuardManager
 {
 public:
@@ -409,7 +669,8 @@ public:
     void    release();
     int32_t open();
     void    close();
-    AS_HANDLE openURL(char const* rtspURL,ASRtspStatusObervser* observer);
+    AS_HANDLE openURL(char const* rtspURL,ASRtspStatusObervser* observer,
+                      AS_RTSP_PROBE_MODE enProbeMode = AS_RTSP_PROBE_FULL);
     void      closeURL(AS_HANDLE handle);
     AS_RTSP_STATUS  getStatus(AS_HANDLE handle);
     void      setRecvBufSize(u_int32_t ulSize);
@@ -423,10 +684,17 @@ public:
     uint32_t    getRtspHandleCount(){return m_ulRtspHandlCount;};
     uint32_t    getMaxCheckCount(){ return m_ulMaxCheckCount;};
     uint32_t    getCheckDuration(){ return m_ulCheckDuration;};
+    AS_RTSP_PROBE_MODE getProbeMode(){ return m_enProbeMode;};
+    uint32_t    getProbeSampleTime(){ return m_ulProbeSampleTime;};
+    uint32_t    getFastStart(){ return m_ulFastStart;};
+    uint32_t    getDescribeCacheTTL(){ return m_ulDescribeCacheTTL;};
+    /* a lens is resolved/checked,from any thread,the check thread takes it */
+    void post_resolved(ASLensInfo* pLens);
+    void post_done(ASLensInfo* pLens);
 public:
     void http_env_thread();
-    void rtsp_env_thread();
     void check_task_thread();
+    void resolve_thread();
     u_int32_t find_beast_thread();
     UsageEnvironment* get_env(u_int32_t index);
     void releas_env(u_int32_t index);
@@ -439,22 +707,30 @@ private:
     static void  http_callback(struct evhttp_request *req, void *arg);
 private:
     static void *http_env_invoke(void *arg);
-    static void *rtsp_env_invoke(void *arg);
     static void *check_task_invoke(void *arg);
-    u_int32_t thread_index()
-    {
-        as_lock_guard locker(m_mutex);
-        u_int32_t index = m_ulTdIndex;
-        m_ulTdIndex++;;
-        return index;
-    }
+    static void *resolve_invoke(void *arg);
+    /* the commands run on the env thread of a handle */
+    static void open_channel(UsageEnvironment& env,void* pArg);
+    static void close_channel(UsageEnvironment& env,void* pArg);
+    static void free_handle(void* pArg);
+    static void clear_describe_cache(UsageEnvironment& env,void* pArg);
 
 private:
     int32_t handle_check(std::string &strReqMsg,std::string &strRespMsg);
     int32_t handle_check_task(const XMLElement *check);
-    void    check_task_status();
 private:
-    u_int32_t         m_ulTdIndex;
+    /* the check scheduler,all run on the check thread */
+    void    take_new_task();
+    void    take_resolved();
+    void    take_done();
+    void    start_waiting();
+    void    admit_check();
+    void    check_timeout();
+    void    sweep_host();
+    void    start_check(ASLensInfo* pLens,ASCHECKHOST& host);
+    void    finish_check(ASLensInfo* pLens);
+    ASLensInfo* take_post(ASLensInfo* volatile* ppHead);
+private:
     as_mutex_t       *m_mutex;
     char              m_LoopWatchVar;
     struct event_base*m_httpBase;
@@ -462,14 +738,22 @@ private:
     as_thread_t      *m_HttpThreadHandle;
     u_int32_t         m_httpListenPort;
     as_thread_t      *m_CheckThreadHandle;
-    as_thread_t      *m_ThreadHandle[RTSP_MANAGE_ENV_MAX_COUNT];
-    UsageEnvironment *m_envArray[RTSP_MANAGE_ENV_MAX_COUNT];
-    u_int32_t         m_clCountArray[RTSP_MANAGE_ENV_MAX_COUNT];
+    as_env_pool       m_envPool;
     u_int32_t         m_ulRtspHandlCount;
     u_int32_t         m_ulRecvBufSize;
     u_int32_t         m_ulLogLM;
     u_int32_t         m_ulMaxCheckCount;
     time_t            m_ulCheckDuration;
+    AS_RTSP_PROBE_MODE m_enProbeMode;
+    u_int32_t         m_ulProbeSampleTime;
+    u_int32_t         m_ulFastStart;
+    u_int32_t         m_ulDescribeCacheTTL;
+    u_int32_t         m_ulEnvMaxCheck;
+    u_int32_t         m_ulEnvCheckRate;
+    u_int32_t         m_ulHostMaxCheck;
+    u_int32_t         m_ulHostCheckRate;
+    u_int32_t         m_ulResolveThreadCount;
+    as_thread_t      *m_ResolveThreads[RTSP_CHECK_RESOLVE_THREAD_MAX];
 private:
     std::string       m_strAppID;
     std::string       m_strAppSecret;
@@ -477,6 +761,27 @@ private:
     std::string       m_strLiveUrl;
     std::string       m_strUserName;
     std::string       m_strPassword;
+    /* the new tasks from the http thread,under m_mutex */
     ASCHECKTASKLIST   m_TaskList;
+private:
+    /* the check scheduler */
+    as_event_t       *m_checkEvent;
+    ASLensInfo *volatile m_pResolvedHead;
+    ASLensInfo *volatile m_pDoneHead;
+    as_mutex_t       *m_resolveMutex;
+    as_event_t       *m_resolveEvent;
+    LENSINFOLIST      m_ResolveList;
+    /* the members below are owned by the check thread */
+    ASCHECKTASKLIST   m_RunTaskList;
+    ASCHECKQUEUE      m_CheckQueue;
+    uint64_t          m_ullCheckSeq;
+    ASCHECKHOSTMAP    m_HostMap;
+    ASCHECKHOSTLIST   m_HostWaitList;
+    LENSINFOLIST      m_RunList;
+    ASCHECKRATE       m_stEnvRate;
+    uint32_t          m_ulResolving;
+    uint32_t          m_ulWaiting;
+    uint32_t          m_ulRunning;
+    uint32_t          m_ulLastSweep;
 };
 #endif /* __AS_RTSP_CLIENT_MANAGE_H__ */
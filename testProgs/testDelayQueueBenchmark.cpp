@@ -0,0 +1,96 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 3 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// A benchmark that compares the "DELAY_QUEUE_LIST" and "DELAY_QUEUE_HEAP" delay queue implementations,
+// by scheduling N delayed tasks, cancelling them (in random order), and then scheduling and running
+// N immediately-due tasks.
+// main program
+
+#include "BasicUsageEnvironment.hh"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+static unsigned numFired = 0;
+static unsigned numExpected = 0;
+static char watchVariable = 0;
+
+static void timeoutHandler(void* /*clientData*/) {
+  if (++numFired >= numExpected) watchVariable = 1;
+}
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+static void runBenchmark(char const* name, DelayQueueType delayQueueType, unsigned n) {
+  // Use no 'scheduler tick', so that only our own tasks are in the delay queue:
+  TaskScheduler* scheduler = BasicTaskScheduler::createNew(0, delayQueueType);
+  UsageEnvironment* env = BasicUsageEnvironment::createNew(*scheduler);
+  TaskToken* tokens = new TaskToken[n];
+
+  // Schedule "n" tasks, with delays spread over 1-61 seconds (as RTCP and liveness timers are):
+  srandom(1234);
+  double start = now();
+  for (unsigned i = 0; i < n; ++i) {
+    int64_t delay = 1000000 + (int64_t)(random()%60000000);
+    tokens[i] = scheduler->scheduleDelayedTask(delay, timeoutHandler, NULL);
+  }
+  double scheduleElapsed = now() - start;
+
+  // Cancel them all, in random order:
+  for (unsigned i = n; i > 1; --i) {
+    unsigned j = random()%i;
+    TaskToken tmp = tokens[i-1]; tokens[i-1] = tokens[j]; tokens[j] = tmp;
+  }
+  start = now();
+  for (unsigned i = 0; i < n; ++i) scheduler->unscheduleDelayedTask(tokens[i]);
+  double cancelElapsed = now() - start;
+
+  // Schedule "n" tasks that are already due, and run them:
+  numFired = 0;
+  numExpected = n;
+  watchVariable = 0;
+  start = now();
+  for (unsigned i = 0; i < n; ++i) scheduler->scheduleDelayedTask(0, timeoutHandler, NULL);
+  env->taskScheduler().doEventLoop(&watchVariable);
+  double fireElapsed = now() - start;
+
+  fprintf(stderr, "%-18s tasks:%8u schedule ns/op:%9.1f cancel ns/op:%9.1f schedule+fire ns/op:%9.1f\n",
+	  name, n, scheduleElapsed*1e9/n, cancelElapsed*1e9/n, fireElapsed*1e9/n);
+
+  delete[] tokens;
+  env->reclaim();
+  delete scheduler;
+}
+
+int main(int argc, char** argv) {
+  unsigned const taskCounts[] = { 1000, 10000, 30000, 1000000 };
+  unsigned const maxListTaskCount = 30000; // the list is O(n^2) overall; larger counts take too long
+
+  for (unsigned i = 0; i < sizeof taskCounts/sizeof taskCounts[0]; ++i) {
+    unsigned n = taskCounts[i];
+    if (n <= maxListTaskCount) {
+      runBenchmark("DELAY_QUEUE_LIST", DELAY_QUEUE_LIST, n);
+    } else {
+      fprintf(stderr, "%-18s tasks:%8u skipped (too slow)\n", "DELAY_QUEUE_LIST", n);
+    }
+    runBenchmark("DELAY_QUEUE_HEAP", DELAY_QUEUE_HEAP, n);
+  }
+
+  return 0;
+}
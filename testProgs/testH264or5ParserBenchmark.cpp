@@ -0,0 +1,250 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 3 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// A benchmark that measures how fast (in GB/s) H.264 Annex-B data is parsed: the start code scan, the removal of
+// 'emulation prevention' bytes (each compared with a byte-at-a-time loop), and the whole "H264VideoStreamFramer".
+// The synthetic stream has GOPs of 40 frames, whose IDR frames are 600 kBytes (i.e., larger than a parser bank).
+// main program
+
+#include "liveMedia.hh"
+#include "BasicUsageEnvironment.hh"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define STREAM_SIZE (64*1024*1024)
+#define IDR_FRAME_SIZE 600000
+#define NON_IDR_FRAME_SIZE 20000
+#define GOP_LENGTH 40
+#define SINK_BUFFER_SIZE (1024*1024)
+#define NUM_REPETITIONS 5
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+// Appends a NAL unit of (about) "size" random bytes - with 'emulation prevention' bytes inserted - to "to":
+static unsigned appendNALUnit(u_int8_t* to, unsigned maxSize, u_int8_t nalHeader, unsigned size) {
+  if (maxSize < size*2 + 8) return 0;
+
+  unsigned toSize = 0;
+  to[toSize++] = 0; to[toSize++] = 0; to[toSize++] = 0; to[toSize++] = 1;
+  to[toSize++] = nalHeader;
+  to[toSize++] = 0x80 | (random()&0x7F); // "first_mb_in_slice" == 0: a new access unit
+
+  unsigned numZeros = 0;
+  for (unsigned i = 0; i < size; ++i) {
+    // Compressed data has some runs of 0s; make them common enough to exercise the scanners:
+    u_int8_t byte = (random()%64 == 0) ? 0 : (u_int8_t)random();
+    if (numZeros >= 2 && byte <= 3) {
+      to[toSize++] = 3;
+      numZeros = 0;
+    }
+    to[toSize++] = byte;
+    numZeros = byte == 0 ? numZeros+1 : 0;
+  }
+  if (numZeros > 0) to[toSize++] = 0x80; // "rbsp_stop_one_bit"
+
+  return toSize;
+}
+
+static unsigned generateStream(u_int8_t* to, unsigned maxSize) {
+  unsigned size = 0;
+  srandom(1234);
+  for (unsigned frameNum = 0; ; ++frameNum) {
+    unsigned added = 0;
+    if (frameNum%GOP_LENGTH == 0) {
+      added += appendNALUnit(&to[size+added], maxSize-size-added, 0x67, 20); // SPS
+      added += appendNALUnit(&to[size+added], maxSize-size-added, 0x68, 4); // PPS
+      added += appendNALUnit(&to[size+added], maxSize-size-added, 0x65, IDR_FRAME_SIZE); // IDR
+    } else {
+      added += appendNALUnit(&to[size+added], maxSize-size-added, 0x41, NON_IDR_FRAME_SIZE);
+    }
+    if (added == 0 || size + added + 2*IDR_FRAME_SIZE > maxSize) break;
+    size += added;
+  }
+
+  return size;
+}
+
+// The byte-at-a-time scan for a 0x000001, as the parser did it before:
+static unsigned findStartCodeByteByByte(u_int8_t const* from, unsigned size) {
+  for (unsigned i = 0; i+2 < size; ++i) {
+    if (from[i] == 0 && from[i+1] == 0 && from[i+2] == 1) return i;
+  }
+  return size;
+}
+
+static unsigned removeEmulationBytesByteByByte(u_int8_t* to, unsigned toMaxSize,
+                                                u_int8_t const* from, unsigned fromSize) {
+  unsigned toSize = 0;
+  unsigned i = 0;
+  while (i < fromSize && toSize+1 < toMaxSize) {
+    if (i+2 < fromSize && from[i] == 0 && from[i+1] == 0 && from[i+2] == 3) {
+      to[toSize] = to[toSize+1] = 0;
+      toSize += 2;
+      i += 3;
+    } else {
+      to[toSize] = from[i];
+      toSize += 1;
+      i += 1;
+    }
+  }
+
+  return toSize;
+}
+
+typedef unsigned (findStartCodeFunc)(u_int8_t const* from, unsigned size);
+
+static void benchmarkStartCodeScan(char const* name, findStartCodeFunc* find,
+                                   u_int8_t const* stream, unsigned streamSize, unsigned& numStartCodes) {
+  double start = now();
+  for (unsigned rep = 0; rep < NUM_REPETITIONS; ++rep) {
+    numStartCodes = 0;
+    unsigned offset = 0;
+    while (1) {
+      unsigned startCode = offset + (*find)(&stream[offset], streamSize - offset);
+      if (startCode >= streamSize) break;
+      ++numStartCodes;
+      offset = startCode + 3;
+    }
+  }
+  double elapsed = now() - start;
+
+  fprintf(stderr, "%-34s %7.2f GB/s (%u start codes)\n",
+          name, (double)streamSize*NUM_REPETITIONS/elapsed/1e9, numStartCodes);
+}
+
+typedef unsigned (removeEmulationBytesFunc)(u_int8_t* to, unsigned toMaxSize,
+                                            u_int8_t const* from, unsigned fromSize);
+
+static void benchmarkEmulationRemoval(char const* name, removeEmulationBytesFunc* remove,
+                                      u_int8_t const* stream, unsigned streamSize, u_int8_t* to, unsigned& toSize) {
+  double start = now();
+  for (unsigned rep = 0; rep < NUM_REPETITIONS; ++rep) {
+    toSize = (*remove)(to, streamSize, stream, streamSize);
+  }
+  double elapsed = now() - start;
+
+  fprintf(stderr, "%-34s %7.2f GB/s (%u bytes out)\n",
+          name, (double)streamSize*NUM_REPETITIONS/elapsed/1e9, toSize);
+}
+
+// A sink that just counts the NAL units that it gets from the framer:
+class CountingSink: public MediaSink {
+public:
+  CountingSink(UsageEnvironment& env)
+    : MediaSink(env), fNumNALUnits(0), fNumBytes(0), fNumTruncatedBytes(0) {
+    fBuffer = new u_int8_t[SINK_BUFFER_SIZE];
+  }
+  virtual ~CountingSink() { delete[] fBuffer; }
+
+  unsigned fNumNALUnits;
+  u_int64_t fNumBytes;
+  u_int64_t fNumTruncatedBytes;
+
+private:
+  static void afterGettingFrame(void* clientData, unsigned frameSize, unsigned numTruncatedBytes,
+                                struct timeval /*presentationTime*/, unsigned /*durationInMicroseconds*/) {
+    CountingSink* sink = (CountingSink*)clientData;
+    ++sink->fNumNALUnits;
+    sink->fNumBytes += frameSize;
+    sink->fNumTruncatedBytes += numTruncatedBytes;
+
+    // The framer calls us from within its own "getNextFrame()", so ask for the next frame from the event loop:
+    sink->envir().taskScheduler().scheduleDelayedTask(0, continuePlayingHandler, sink);
+  }
+  static void continuePlayingHandler(void* clientData) {
+    ((CountingSink*)clientData)->continuePlaying();
+  }
+
+  virtual Boolean continuePlaying() {
+    if (fSource == NULL) return False;
+
+    fSource->getNextFrame(fBuffer, SINK_BUFFER_SIZE, afterGettingFrame, this, onSourceClosure, this);
+    return True;
+  }
+
+private:
+  u_int8_t* fBuffer;
+};
+
+static char watchVariable = 0;
+
+static void afterPlaying(void* /*clientData*/) {
+  watchVariable = 1;
+}
+
+static void benchmarkFramer(u_int8_t* stream, unsigned streamSize, unsigned readSize) {
+  TaskScheduler* scheduler = BasicTaskScheduler::createNew();
+  UsageEnvironment* env = BasicUsageEnvironment::createNew(*scheduler);
+
+  ByteStreamMemoryBufferSource* source
+    = ByteStreamMemoryBufferSource::createNew(*env, stream, streamSize, False, readSize);
+  H264VideoStreamFramer* framer = H264VideoStreamFramer::createNew(*env, source);
+  CountingSink* sink = new CountingSink(*env);
+
+  watchVariable = 0;
+  double start = now();
+  sink->startPlaying(*framer, afterPlaying, NULL);
+  env->taskScheduler().doEventLoop(&watchVariable);
+  double elapsed = now() - start;
+
+  fprintf(stderr, "%-34s %7.2f GB/s (%u NAL units, %llu bytes, %llu truncated)\n",
+          "H264VideoStreamFramer", (double)streamSize/elapsed/1e9, sink->fNumNALUnits,
+          (unsigned long long)sink->fNumBytes, (unsigned long long)sink->fNumTruncatedBytes);
+
+  Medium::close(sink);
+  Medium::close(framer); // also closes "source"
+  env->reclaim();
+  delete scheduler;
+}
+
+int main(int argc, char** argv) {
+  u_int8_t* stream = new u_int8_t[STREAM_SIZE];
+  u_int8_t* to = new u_int8_t[STREAM_SIZE];
+  unsigned streamSize = generateStream(stream, STREAM_SIZE);
+  fprintf(stderr, "Annex-B stream: %u bytes, IDR frames of %u bytes\n", streamSize, IDR_FRAME_SIZE);
+
+  unsigned numStartCodes, numStartCodesByteByByte;
+  benchmarkStartCodeScan("start codes: byte by byte", findStartCodeByteByByte,
+                         stream, streamSize, numStartCodesByteByByte);
+  benchmarkStartCodeScan("start codes: findH264or5StartCode", findH264or5StartCode,
+                         stream, streamSize, numStartCodes);
+
+  unsigned toSize, toSizeByteByByte;
+  benchmarkEmulationRemoval("emulation bytes: byte by byte", removeEmulationBytesByteByByte,
+                            stream, streamSize, to, toSizeByteByByte);
+  u_int8_t* toByteByByte = new u_int8_t[toSizeByteByByte];
+  memcpy(toByteByByte, to, toSizeByteByByte);
+  benchmarkEmulationRemoval("emulation bytes: removeH264or5...", removeH264or5EmulationBytes,
+                            stream, streamSize, to, toSize);
+
+  if (numStartCodes != numStartCodesByteByByte || toSize != toSizeByteByByte
+      || memcmp(to, toByteByByte, toSize) != 0) {
+    fprintf(stderr, "MISMATCH between the byte by byte and the fast results!\n");
+    return 1;
+  }
+
+  benchmarkFramer(stream, streamSize, 65536);
+
+  delete[] toByteByByte;
+  delete[] to;
+  delete[] stream;
+  return 0;
+}
@@ -0,0 +1,283 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 3 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// A benchmark (and check) of the output queue and drop policy that "RTPInterface" uses for RTP-over-TCP.
+// A synthetic H.264 stream (IDR, P and non-reference B frames) is sent over one end of a socket pair, while the
+// other end is read - and its framing checked - first more slowly than the stream's bitrate, and then faster.
+// We check that sending never blocks, that the stream stays properly framed, and that any gap that loses a
+// reference frame ends at a key frame (or, for a stream without key frames, after the key frame wait times out).
+// We also check that RTSP bytes that arrive on the socket still reach the RTSP server's handler after the
+// socket's "SocketDescriptor" has been deleted and recreated.
+// main program
+
+#include "liveMedia.hh"
+#include "BasicUsageEnvironment.hh"
+#include "GroupsockHelper.hh"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+#define PACKETS_PER_FRAME 8
+#define PACKET_PAYLOAD_SIZE 1400
+#define TICK_US 10000 // we send one frame per tick, i.e., about 1.1 MBytes/second
+#define READ_BUFFER_SIZE (4*1024*1024)
+
+enum { NON_REFERENCE, REFERENCE, KEY_FRAME_START }; // how each packet that we send was classified
+
+struct Scenario {
+  char const* name;
+  unsigned gopLength; // 0 means that only the first frame is an IDR frame (as with 'intra refresh')
+  unsigned slowTicks, fastTicks;
+  unsigned slowReadBytesPerTick;
+};
+
+static UsageEnvironment* env;
+static RTPInterface* rtpInterface;
+static int readSocketNum;
+static char watchVariable;
+static Scenario const* scenario;
+static unsigned tickNum;
+
+static u_int8_t sentClass[65536]; // indexed by RTP sequence number
+static u_int16_t nextSeqNum;
+static unsigned numPacketsSent;
+static double sendElapsed, maxSendElapsed;
+
+static u_int8_t readBuffer[READ_BUFFER_SIZE];
+static unsigned readBufferSize;
+static Boolean haveReceivedAny;
+static u_int16_t expectedSeqNum;
+static unsigned numReceived[3], numReceivedInFastPhase;
+static unsigned numFramingErrors, numGapsWithoutKeyFrame;
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+static void sendFrame(unsigned frameNum) {
+  u_int8_t packet[12 + PACKET_PAYLOAD_SIZE];
+  memset(packet, 0, sizeof packet);
+  packet[0] = 0x80; packet[1] = 96;
+
+  Boolean isIDR = scenario->gopLength == 0 ? frameNum == 0 : frameNum%scenario->gopLength == 0;
+  Boolean isNonReference = !isIDR && frameNum%2 == 0 && scenario->gopLength != 0; // 'intra refresh' has no B frames
+  u_int8_t nri = isNonReference ? 0x00 : 0x60;
+  for (unsigned i = 0; i < PACKETS_PER_FRAME; ++i) {
+    packet[2] = nextSeqNum>>8; packet[3] = (u_int8_t)nextSeqNum;
+    // Each frame is a single NAL unit, sent as FU-A fragments:
+    packet[12] = nri|28;
+    packet[13] = (i == 0 ? 0x80 : 0x00)|(i == PACKETS_PER_FRAME-1 ? 0x40 : 0x00)|(isIDR ? 5 : 1);
+    sentClass[nextSeqNum] = isNonReference ? NON_REFERENCE : (isIDR && i == 0) ? KEY_FRAME_START : REFERENCE;
+
+    double start = now();
+    rtpInterface->sendPacket(packet, sizeof packet);
+    double elapsed = now() - start;
+    sendElapsed += elapsed;
+    if (elapsed > maxSendElapsed) maxSendElapsed = elapsed;
+    ++numPacketsSent;
+    ++nextSeqNum;
+  }
+}
+
+static void checkPacket(u_int8_t const* packet, unsigned packetSize, Boolean isFastPhase) {
+  if (packetSize < 14) { ++numFramingErrors; return; }
+  u_int16_t seqNum = (packet[2]<<8)|packet[3];
+  u_int8_t packetClass = sentClass[seqNum];
+
+  if (haveReceivedAny && seqNum != expectedSeqNum) {
+    // Packets were dropped.  If any of them belonged to a reference frame, then we must resume at a key frame:
+    Boolean lostReference = False;
+    for (u_int16_t s = expectedSeqNum; s != seqNum; ++s) {
+      if (sentClass[s] != NON_REFERENCE) lostReference = True;
+    }
+    if (lostReference && packetClass != KEY_FRAME_START) ++numGapsWithoutKeyFrame;
+  }
+  haveReceivedAny = True;
+  expectedSeqNum = seqNum + 1;
+  ++numReceived[packetClass];
+  if (isFastPhase) ++numReceivedInFastPhase;
+}
+
+static void readAndCheck(unsigned maxBytes, Boolean isFastPhase) {
+  while (maxBytes > 0 && readBufferSize < READ_BUFFER_SIZE) {
+    unsigned bytesToRead = READ_BUFFER_SIZE - readBufferSize;
+    if (bytesToRead > maxBytes) bytesToRead = maxBytes;
+    int result = recv(readSocketNum, (char*)&readBuffer[readBufferSize], bytesToRead, 0);
+    if (result <= 0) break;
+    readBufferSize += result;
+    maxBytes -= result;
+  }
+
+  // Check each complete "$<channel><size><packet>" that we've read:
+  unsigned pos = 0;
+  while (readBufferSize - pos >= 4) {
+    if (readBuffer[pos] != '$' || readBuffer[pos+1] != 0) {
+      ++numFramingErrors;
+      readBufferSize = 0;
+      return;
+    }
+    unsigned packetSize = (readBuffer[pos+2]<<8)|readBuffer[pos+3];
+    if (readBufferSize - pos < 4 + packetSize) break;
+    checkPacket(&readBuffer[pos+4], packetSize, isFastPhase);
+    pos += 4 + packetSize;
+  }
+  memmove(readBuffer, &readBuffer[pos], readBufferSize - pos);
+  readBufferSize -= pos;
+}
+
+static void tickHandler(void* /*clientData*/) {
+  Boolean isFastPhase = tickNum >= scenario->slowTicks;
+  if (tickNum >= scenario->slowTicks + scenario->fastTicks) {
+    watchVariable = 1;
+    return;
+  }
+
+  sendFrame(tickNum);
+  readAndCheck(isFastPhase ? READ_BUFFER_SIZE : scenario->slowReadBytesPerTick, isFastPhase);
+  ++tickNum;
+  env->taskScheduler().scheduleDelayedTask(TICK_US, tickHandler, NULL);
+}
+
+static Boolean makeSocketPair(int& sendSocketNum, int& receiveSocketNum) {
+  int sockets[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) return False;
+  sendSocketNum = sockets[0];
+  receiveSocketNum = sockets[1];
+  makeSocketNonBlocking(sendSocketNum);
+  makeSocketNonBlocking(receiveSocketNum);
+
+  // Use small socket buffers (as a slow viewer's connection would have), so that our own queue gets used:
+  int bufferSize = 64*1024;
+  setsockopt(sendSocketNum, SOL_SOCKET, SO_SNDBUF, (char*)&bufferSize, sizeof bufferSize);
+  setsockopt(receiveSocketNum, SOL_SOCKET, SO_RCVBUF, (char*)&bufferSize, sizeof bufferSize);
+  return True;
+}
+
+static Boolean runScenario(Groupsock& gs, RTPSink* sink, Scenario const& s) {
+  int sendSocketNum;
+  if (!makeSocketPair(sendSocketNum, readSocketNum)) return False;
+
+  scenario = &s;
+  tickNum = 0; nextSeqNum = 0; numPacketsSent = 0; sendElapsed = maxSendElapsed = 0.0;
+  readBufferSize = 0; haveReceivedAny = False; expectedSeqNum = 0;
+  memset(numReceived, 0, sizeof numReceived); numReceivedInFastPhase = 0;
+  numFramingErrors = numGapsWithoutKeyFrame = 0;
+
+  rtpInterface = new RTPInterface(sink, &gs);
+  rtpInterface->addStreamSocket(sendSocketNum, 0);
+
+  watchVariable = 0;
+  env->taskScheduler().scheduleDelayedTask(0, tickHandler, NULL);
+  env->taskScheduler().doEventLoop(&watchVariable);
+
+  RTPOverTCPBacklogStats stats;
+  memset(&stats, 0, sizeof stats);
+  RTPInterface::getTCPBacklogStats(*env, sendSocketNum, stats);
+
+  // Our own policy checks:
+  Boolean ok = numFramingErrors == 0 && numReceivedInFastPhase > 0 && maxSendElapsed < 0.1;
+  if (s.gopLength != 0) {
+    ok &= numGapsWithoutKeyFrame == 0 && stats.numKeyFrameWaitTimeouts == 0;
+  } else {
+    ok &= numGapsWithoutKeyFrame <= stats.numKeyFrameWaitTimeouts && stats.numKeyFrameWaitTimeouts > 0;
+  }
+
+  fprintf(stderr, "%-14s sent:%6u send ns/op:%8.1f max send us:%7.1f max queued:%8u dropped:%6u skips:%3u timeouts:%2u\n",
+	  s.name, numPacketsSent, sendElapsed*1e9/numPacketsSent, maxSendElapsed*1e6,
+	  stats.maxQueuedBytes, stats.numPacketsDropped, stats.numKeyFrameSkips, stats.numKeyFrameWaitTimeouts);
+  fprintf(stderr, "%-14s received key:%5u ref:%6u non-ref:%6u (after the slow phase:%6u) framing errors:%u gaps not at a key frame:%u %s\n",
+	  s.name, numReceived[KEY_FRAME_START], numReceived[REFERENCE], numReceived[NON_REFERENCE],
+	  numReceivedInFastPhase, numFramingErrors, numGapsWithoutKeyFrame, ok ? "OK" : "FAILED");
+
+  delete rtpInterface; rtpInterface = NULL;
+  closeSocket(sendSocketNum);
+  closeSocket(readSocketNum);
+  return ok;
+}
+
+static unsigned numRTSPBytesSeen, numTakeBacks;
+
+static void alternativeByteHandler(void* /*instance*/, u_int8_t requestByte) {
+  if (requestByte == 0xFE) ++numTakeBacks;
+  else if (requestByte != 0xFF) ++numRTSPBytesSeen;
+}
+
+static void stopLoop(void* /*clientData*/) {
+  watchVariable = 1;
+}
+
+static Boolean checkRecreatedDescriptor(Groupsock& gs, RTPSink* sink) {
+  // An RTSP server hands its socket over to RTP-over-TCP, and gets it back (with 0xFE) when the last stream stops
+  // reading.  If the stream then sends again, its recreated "SocketDescriptor" must pass RTSP bytes on once more:
+  int sendSocketNum;
+  if (!makeSocketPair(sendSocketNum, readSocketNum)) return False;
+  numRTSPBytesSeen = numTakeBacks = 0;
+
+  rtpInterface = new RTPInterface(sink, &gs);
+  rtpInterface->addStreamSocket(sendSocketNum, 0);
+  RTPInterface::setServerRequestAlternativeByteHandler(*env, sendSocketNum, alternativeByteHandler, NULL);
+  rtpInterface->stopNetworkReading(); // deletes the "SocketDescriptor"
+
+  u_int8_t packet[12 + 100];
+  memset(packet, 0, sizeof packet);
+  packet[0] = 0x80; packet[1] = 96; packet[12] = 0x41;
+  rtpInterface->sendPacket(packet, sizeof packet); // recreates it
+
+  char const* request = "OPTIONS rtsp://127.0.0.1/test RTSP/1.0\r\nCSeq: 3\r\n\r\n";
+  send(readSocketNum, request, strlen(request), 0);
+  watchVariable = 0;
+  env->taskScheduler().scheduleDelayedTask(100000, stopLoop, NULL);
+  env->taskScheduler().doEventLoop(&watchVariable);
+
+  Boolean ok = numTakeBacks == 1 && numRTSPBytesSeen == strlen(request);
+  fprintf(stderr, "%-14s handler take-backs:%u RTSP bytes passed on:%u/%u %s\n",
+	  "recreated", numTakeBacks, numRTSPBytesSeen, (unsigned)strlen(request), ok ? "OK" : "FAILED");
+
+  delete rtpInterface; rtpInterface = NULL;
+  closeSocket(sendSocketNum);
+  closeSocket(readSocketNum);
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  TaskScheduler* scheduler = BasicTaskScheduler::createNew();
+  env = BasicUsageEnvironment::createNew(*scheduler);
+
+  struct in_addr address;
+  address.s_addr = our_inet_addr("127.0.0.1");
+  Groupsock gs(*env, address, Port(0), 1);
+  gs.removeAllDestinations(); // we send over TCP only
+  RTPSink* sink = H264VideoRTPSink::createNew(*env, &gs, 96);
+
+  // The slow phases read 400 kBytes/second, less than half of the stream's bitrate:
+  Scenario const scenarios[] = {
+    { "gop", 50, 400, 300, 4000 },
+    { "intra-refresh", 0, 300, 400, 4000 }
+  };
+  Boolean ok = True;
+  for (unsigned i = 0; i < sizeof scenarios/sizeof scenarios[0]; ++i) {
+    ok &= runScenario(gs, sink, scenarios[i]);
+  }
+  ok &= checkRecreatedDescriptor(gs, sink);
+
+  Medium::close(sink);
+  env->reclaim();
+  delete scheduler;
+  return ok ? 0 : 1;
+}
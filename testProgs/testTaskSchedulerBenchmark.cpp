@@ -0,0 +1,151 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 3 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// A benchmark that compares "BasicTaskScheduler" (select()) with "EpollTaskScheduler", by delivering
+// one UDP datagram per round to each of N sockets, and re-arming each socket's handler (as many
+// "liveMedia" handlers do) after it reads.
+// (Linux only.)
+// main program
+
+#include "BasicUsageEnvironment.hh"
+#include "EpollTaskScheduler.hh"
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define NUM_ROUNDS 200
+
+static int* sockets = NULL;
+static struct sockaddr_in* addresses = NULL;
+static unsigned numSockets = 0;
+static unsigned numReceived = 0;
+static unsigned numExpected = 0;
+static char watchVariable = 0;
+static TaskScheduler* scheduler = NULL;
+
+static void readHandler(void* clientData, int /*mask*/) {
+  int sock = (int)(long)clientData;
+  char buffer[64];
+  while (recv(sock, buffer, sizeof buffer, 0) > 0) ++numReceived;
+
+  // Re-arm the handler, as "liveMedia" does each time it (re)starts reading:
+  scheduler->setBackgroundHandling(sock, SOCKET_READABLE, readHandler, clientData);
+
+  if (numReceived >= numExpected) watchVariable = 1;
+}
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+static Boolean openSockets(unsigned n) {
+  sockets = new int[n];
+  addresses = new struct sockaddr_in[n];
+  for (numSockets = 0; numSockets < n; ++numSockets) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) return False;
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0)|O_NONBLOCK);
+
+    struct sockaddr_in& addr = addresses[numSockets];
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof addr;
+    if (bind(sock, (struct sockaddr*)&addr, len) != 0
+	|| getsockname(sock, (struct sockaddr*)&addr, &len) != 0) {
+      close(sock);
+      return False;
+    }
+    sockets[numSockets] = sock;
+  }
+  return True;
+}
+
+static void closeSockets() {
+  for (unsigned i = 0; i < numSockets; ++i) close(sockets[i]);
+  delete[] sockets; sockets = NULL;
+  delete[] addresses; addresses = NULL;
+  numSockets = 0;
+}
+
+static void runBenchmark(char const* name, TaskScheduler* taskScheduler, unsigned n) {
+  scheduler = taskScheduler;
+  UsageEnvironment* env = BasicUsageEnvironment::createNew(*scheduler);
+
+  if (!openSockets(n)) {
+    fprintf(stderr, "%-20s sockets:%5u failed to open sockets (raise \"ulimit -n\")\n", name, n);
+    closeSockets();
+    env->reclaim(); delete scheduler;
+    return;
+  }
+  for (unsigned i = 0; i < numSockets; ++i) {
+    scheduler->setBackgroundHandling(sockets[i], SOCKET_READABLE, readHandler, (void*)(long)sockets[i]);
+  }
+
+  int sender = socket(AF_INET, SOCK_DGRAM, 0);
+  char const payload[] = "benchmark";
+  numReceived = 0;
+  double start = now();
+  for (unsigned round = 0; round < NUM_ROUNDS; ++round) {
+    for (unsigned i = 0; i < numSockets; ++i) {
+      sendto(sender, payload, sizeof payload, 0, (struct sockaddr*)&addresses[i], sizeof addresses[i]);
+    }
+    numExpected = (round+1)*numSockets;
+    watchVariable = 0;
+    env->taskScheduler().doEventLoop(&watchVariable);
+  }
+  double elapsed = now() - start;
+  close(sender);
+
+  fprintf(stderr, "%-20s sockets:%5u events/s:%10.0f us/event:%7.3f\n", name, n,
+	  numReceived/elapsed, elapsed*1000000.0/numReceived);
+
+  for (unsigned i = 0; i < numSockets; ++i) scheduler->disableBackgroundHandling(sockets[i]);
+  closeSockets();
+  env->reclaim();
+  delete scheduler;
+}
+
+int main(int argc, char** argv) {
+  unsigned const socketCounts[] = { 100, 1000, 5000 };
+
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+
+  for (unsigned i = 0; i < sizeof socketCounts/sizeof socketCounts[0]; ++i) {
+    unsigned n = socketCounts[i];
+    if (n + 16 < FD_SETSIZE) {
+      runBenchmark("BasicTaskScheduler", BasicTaskScheduler::createNew(), n);
+    } else {
+      fprintf(stderr, "%-20s sockets:%5u skipped (select() is limited to FD_SETSIZE=%d)\n",
+	      "BasicTaskScheduler", n, FD_SETSIZE);
+    }
+    runBenchmark("EpollTaskScheduler", EpollTaskScheduler::createNew(), n);
+  }
+
+  return 0;
+}